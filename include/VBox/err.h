@@ -597,6 +597,15 @@
 /** Internal processing error in the PGM physcal page handling code related to
  *  MMIO/MMIO2. */
 #define VERR_PGM_PHYS_MMIO_EX_IPE               (-1685)
+/** The post-copy phase of a live migration was abandoned while guest pages
+ * were still missing. */
+#define VERR_PGM_POST_COPY_ABORTED              (-1686)
+/** A copy-on-write save could not preserve the content of a guest page
+ * before it was modified. */
+#define VERR_PGM_SAVE_COW_PAGE_LOST             (-1687)
+/** A guest page which hasn't arrived from the post-copy source yet cannot be
+ * mapped because the caller owns the PGM lock. */
+#define VERR_PGM_POST_COPY_PAGE_MISSING         (-1688)
 /** @} */
 
 
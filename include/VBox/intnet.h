@@ -135,8 +135,12 @@ typedef struct INTNETBUF
     STAMCOUNTER     cStatLost;
     /** Number of bad frames (both rings). */
     STAMCOUNTER     cStatBadFrames;
-    /** Reserved for future use. */
-    STAMCOUNTER     aStatReserved[2];
+    /** Number of unicast destination lookups done using the MAC address hash
+     * (frames sent by this interface). */
+    STAMCOUNTER     cStatMacLookupsHashed;
+    /** Number of unicast destination lookups which had to scan the MAC address
+     * table because of promiscuous interfaces or unknown addresses. */
+    STAMCOUNTER     cStatMacLookupsScanned;
     /** Reserved for future send profiling. */
     STAMPROFILE     StatSend1;
     /** Reserved for future send profiling. */
@@ -795,6 +795,8 @@ typedef enum LOGGROUP
     LOG_GROUP_VD_QED,
     /** Raw virtual disk backend. */
     LOG_GROUP_VD_RAW,
+    /** VDD (deduplicating) virtual disk backend. */
+    LOG_GROUP_VD_VDD,
     /** VDI virtual disk backend. */
     LOG_GROUP_VD_VDI,
     /** VHD virtual disk backend. */
@@ -1204,6 +1206,7 @@ typedef enum LOGGROUP
     "VD_QCOW",      \
     "VD_QED",       \
     "VD_RAW",       \
+    "VD_VDD",       \
     "VD_VDI",       \
     "VD_VHD",       \
     "VD_VHDX",      \
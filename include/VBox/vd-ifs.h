@@ -71,6 +71,10 @@ typedef enum VDINTERFACETYPE
     VDINTERFACETYPE_TRAVERSEMETADATA,
     /** Interface for crypto operations. Per-filter. */
     VDINTERFACETYPE_CRYPTO,
+    /** Interface for throttling and checkpointing background operations. Per-operation. */
+    VDINTERFACETYPE_BGOP,
+    /** Interface for tuning image copy operations. Per-operation. */
+    VDINTERFACETYPE_COPY,
     /** invalid interface. */
     VDINTERFACETYPE_INVALID
 } VDINTERFACETYPE;
@@ -1472,6 +1476,120 @@ DECLINLINE(int) vdIfQueryRangeUse(PVDINTERFACEQUERYRANGEUSE pIfQueryRangeUse, ui
 }
 
 
+/**
+ * Interface to control long running operations (merging) which run in the
+ * background while the disk is in use by a VM.
+ *
+ * Per-operation interface. Optional. If present the operation is split into
+ * smaller chunks which are interleaved with the foreground I/O, limited to the
+ * configured bandwidth and made resumable using checkpoints.
+ */
+typedef struct VDINTERFACEBGOP
+{
+    /**
+     * Common interface header.
+     */
+    VDINTERFACE    Core;
+
+    /**
+     * Queries the current limits for the operation. Called before every chunk
+     * so the limits can be changed while the operation is running.
+     *
+     * @returns VBox status code.
+     * @param   pvUser          The opaque user data associated with this interface.
+     * @param   pcbPerSecMax    Where to store the maximum number of bytes per second
+     *                          the operation may transfer, 0 for unlimited.
+     * @param   pcMsIdle        Where to store the number of milliseconds without
+     *                          foreground I/O before the next chunk is processed,
+     *                          0 to not yield to foreground I/O.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnQueryLimits, (void *pvUser, uint64_t *pcbPerSecMax, uint32_t *pcMsIdle));
+
+    /**
+     * Loads a checkpoint saved by an earlier run of the same operation.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_NOT_FOUND if there is no checkpoint.
+     * @param   pvUser          The opaque user data associated with this interface.
+     * @param   pUuidModification Where to store the modification UUID of the source
+     *                          image the checkpoint is valid for.
+     * @param   poffResume      Where to store the disk offset to resume at.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnCheckpointLoad, (void *pvUser, PRTUUID pUuidModification, uint64_t *poffResume));
+
+    /**
+     * Saves a checkpoint for the operation.
+     *
+     * @returns VBox status code.
+     * @param   pvUser          The opaque user data associated with this interface.
+     * @param   pUuidModification The current modification UUID of the source image.
+     * @param   offResume       Everything before this disk offset is processed.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnCheckpointSave, (void *pvUser, PCRTUUID pUuidModification, uint64_t offResume));
+
+} VDINTERFACEBGOP, *PVDINTERFACEBGOP;
+
+/**
+ * Get background operation interface from interface list.
+ *
+ * @return Pointer to the first background operation interface in the list.
+ * @param  pVDIfs    Pointer to the interface list.
+ */
+DECLINLINE(PVDINTERFACEBGOP) VDIfBgOpGet(PVDINTERFACE pVDIfs)
+{
+    PVDINTERFACE pIf = VDInterfaceGet(pVDIfs, VDINTERFACETYPE_BGOP);
+
+    /* Check that the interface descriptor is a background operation interface. */
+    AssertMsgReturn(   !pIf
+                    || (   (pIf->enmInterface == VDINTERFACETYPE_BGOP)
+                        && (pIf->cbSize == sizeof(VDINTERFACEBGOP))),
+                    ("Not a background operation interface"), NULL);
+
+    return (PVDINTERFACEBGOP)pIf;
+}
+
+
+/**
+ * Interface for tuning image copy operations.
+ *
+ * Per-operation interface, optional. Only evaluated by VDCopy() and VDCopyEx()
+ * in the per-operation interface list of the source.
+ */
+typedef struct VDINTERFACECOPY
+{
+    /**
+     * Common interface header.
+     */
+    VDINTERFACE    Core;
+
+    /**
+     * Number of buffers to read ahead from the source while the destination is
+     * written. 0 or 1 selects the plain sequential copy.
+     */
+    uint32_t       cReadAhead;
+
+} VDINTERFACECOPY, *PVDINTERFACECOPY;
+
+/**
+ * Get copy interface from interface list.
+ *
+ * @return Pointer to the first copy interface in the list.
+ * @param  pVDIfs    Pointer to the interface list.
+ */
+DECLINLINE(PVDINTERFACECOPY) VDIfCopyGet(PVDINTERFACE pVDIfs)
+{
+    PVDINTERFACE pIf = VDInterfaceGet(pVDIfs, VDINTERFACETYPE_COPY);
+
+    /* Check that the interface descriptor is a copy interface. */
+    AssertMsgReturn(   !pIf
+                    || (   (pIf->enmInterface == VDINTERFACETYPE_COPY)
+                        && (pIf->cbSize == sizeof(VDINTERFACECOPY))),
+                    ("Not a copy interface"), NULL);
+
+    return (PVDINTERFACECOPY)pIf;
+}
+
+
 /**
  * Interface used to retrieve keys for cryptographic operations.
  *
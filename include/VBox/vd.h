@@ -340,6 +340,9 @@ DECLINLINE(uint32_t) VDOpenFlagsToFileOpenFlags(unsigned fOpenFlags, bool fCreat
 #define VD_CAP_DISCARD              RT_BIT(10)
 /** This is a frequently used backend. */
 #define VD_CAP_PREFERRED            RT_BIT(11)
+/** The backend can have several block allocating writes in flight at the same
+ * time, each one only locks the range of the block it allocates. */
+#define VD_CAP_CONCURRENT_ALLOC     RT_BIT(12)
 /** @}*/
 
 /** @name Configuration interface key handling flags.
@@ -482,6 +485,35 @@ VBOXDDU_DECL(int) VDInit(void);
  */
 VBOXDDU_DECL(int) VDShutdown(void);
 
+/**
+ * Statistics of the metadata table cache which is shared by all image
+ * backends keeping their translation tables in memory on demand (QCOW, QED, VHDX).
+ */
+typedef struct VDTBLCACHESTATS
+{
+    /** Number of table lookups satisfied from the cache. */
+    volatile uint64_t   cHits;
+    /** Number of table lookups requiring the table to be read from the image. */
+    volatile uint64_t   cMisses;
+    /** Number of tables evicted to make room for other tables. */
+    volatile uint64_t   cEvictions;
+    /** Amount of memory currently occupied by all caches. */
+    volatile uint64_t   cbUsed;
+    /** Amount of memory all caches together are allowed to use. */
+    volatile uint64_t   cbMax;
+} VDTBLCACHESTATS;
+/** Pointer to the metadata table cache statistics. */
+typedef VDTBLCACHESTATS *PVDTBLCACHESTATS;
+/** Pointer to const metadata table cache statistics. */
+typedef const VDTBLCACHESTATS *PCVDTBLCACHESTATS;
+
+/**
+ * Returns the live statistics of the metadata table cache.
+ *
+ * @returns Pointer to the statistics, valid for the lifetime of the library.
+ */
+VBOXDDU_DECL(PCVDTBLCACHESTATS) VDTblCacheGetStats(void);
+
 /**
  * Loads a single plugin given by filename.
  *
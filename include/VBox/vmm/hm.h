@@ -172,6 +172,7 @@ VMM_INT_DECL(int)               HMInvalidatePageOnAllVCpus(PVM pVM, RTGCPTR GCVi
 VMM_INT_DECL(int)               HMInvalidatePhysPage(PVM pVM, RTGCPHYS GCPhys);
 VMM_INT_DECL(bool)              HMIsNestedPagingActive(PVM pVM);
 VMM_INT_DECL(bool)              HMAreNestedPagingAndFullGuestExecEnabled(PVM pVM);
+VMM_INT_DECL(bool)              HMAreNestedPagingDirtyBitsEnabled(PVM pVM);
 VMM_INT_DECL(bool)              HMIsLongModeAllowed(PVM pVM);
 VMM_INT_DECL(bool)              HMAreMsrBitmapsAvailable(PVM pVM);
 VMM_INT_DECL(PGMMODE)           HMGetShwPagingMode(PVM pVM);
@@ -182,6 +183,7 @@ VMM_INT_DECL(uint64_t)          HMSvmNstGstApplyTscOffset(PVMCPU pVCpu, uint64_t
 # define HMFlushTLB(pVCpu)                              do { } while (0)
 # define HMIsNestedPagingActive(pVM)                    false
 # define HMAreNestedPagingAndFullGuestExecEnabled(pVM)  false
+# define HMAreNestedPagingDirtyBitsEnabled(pVM)         false
 # define HMIsLongModeAllowed(pVM)                       false
 # define HMAreMsrBitmapsAvailable(pVM)                  false
 # define HMFlushTLBOnAllVCpus(pVM)                      do { } while (0)
@@ -725,7 +725,10 @@ typedef struct EPTPTEBITS
     uint64_t    u3EMT           : 3;
     /** 6 - Ignore PAT memory type */
     uint64_t    u1IgnorePAT     : 1;
-    /** 11:7 - Available for software. */
+    /** 11:7 - Available for software.
+     * @remark Bits 8 and 9 are the accessed and dirty flags when the EPTP
+     *         enables them (VMX_EPT_ACCESS_DIRTY), see EPT_E_ACCESSED and
+     *         EPT_E_DIRTY. */
     uint64_t    u5Available     : 5;
     /** 51:12 - Physical address of page. Restricted by maximum physical
      *  address width of the cpu. */
@@ -737,6 +740,10 @@ AssertCompileSize(EPTPTEBITS, 8);
 
 /** Bits 12-51 - - EPT - Physical Page number of the next level. */
 #define EPT_PTE_PG_MASK         X86_PTE_PAE_PG_MASK
+/** Bit 8 - EPT - Accessed flag, only with VMX_EPT_ACCESS_DIRTY. */
+#define EPT_E_ACCESSED          RT_BIT_64(8)
+/** Bit 9 - EPT - Dirty flag of leaf entries, only with VMX_EPT_ACCESS_DIRTY. */
+#define EPT_E_DIRTY             RT_BIT_64(9)
 /** The page shift to get the EPT PTE index. */
 #define EPT_PT_SHIFT            X86_PT_PAE_SHIFT
 /** The EPT PT index mask (apply to a shifted page address). */
@@ -1184,6 +1191,8 @@ whose vector indexed a bit set in the EOI-exit bitmap. */
 /** Default EPT page-walk length (1 less than the actual EPT page-walk
  *  length) */
 #define VMX_EPT_PAGE_WALK_LENGTH_DEFAULT                        3
+/** Enables the accessed and dirty flags of the EPT paging structures (bit 6). */
+#define VMX_EPT_ACCESS_DIRTY                                    RT_BIT_64(6)
 /** @} */
 
 
@@ -686,14 +686,17 @@ typedef struct PDMIMEDIAEXPORT
                                                   size_t cbCopy));
 
     /**
-     * Queries a pointer to the memory buffer for the request from the drive/device above.
+     * Queries the memory buffer for the request from the drive/device above as a list of
+     * directly accessible segments.
      *
      * @returns VBox status code.
      * @retval  VERR_NOT_SUPPORTED if this is not supported for this request.
      * @param   pInterface      Pointer to the interface structure containing the called function pointer.
      * @param   hIoReq          The I/O request handle.
      * @param   pvIoReqAlloc    The allocator specific memory for this request.
-     * @param   ppvBuf          Where to store the pointer to the guest buffer on success.
+     * @param   ppaSegs         Where to store the pointer to the segments describing the guest buffer
+     *                          on success. The array is owned by the callee.
+     * @param   pcSegs          Where to store the number of segments on success.
      * @param   pcbBuf          Where to store the size of the buffer on success.
      *
      * @note This is an optional feature of the entity implementing this interface to avoid overhead
@@ -703,9 +706,14 @@ typedef struct PDMIMEDIAEXPORT
      *
      *       On the upside the caller of this interface might not call this method at all and just
      *       use the before mentioned methods to copy the data between the buffers.
+     *
+     *       The segments must cover the whole request and stay valid until the request completes,
+     *       the caller reads and writes them directly while the I/O is in flight. The segments
+     *       of a write request may be mapped read-only, the caller must only read from them.
      */
     DECLR3CALLBACKMEMBER(int, pfnIoReqQueryBuf, (PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
-                                                 void *pvIoReqAlloc, void **ppvBuf, size_t *pcbBuf));
+                                                 void *pvIoReqAlloc, PCRTSGSEG *ppaSegs, unsigned *pcSegs,
+                                                 size_t *pcbBuf));
 
     /**
      * Queries the specified amount of ranges to discard from the callee for the given I/O request.
@@ -747,7 +755,7 @@ typedef struct PDMIMEDIAEXPORT
 } PDMIMEDIAEXPORT;
 
 /** PDMIMEDIAAEXPORT interface ID. */
-#define PDMIMEDIAEXPORT_IID                  "0ae2e534-6c28-41d6-9a88-7f88f2cb2ff8"
+#define PDMIMEDIAEXPORT_IID                  "c4e1a7d2-3f58-4b9e-8a06-d27b5e91f3c8"
 
 
 /** Pointer to an extended media interface. */
@@ -327,6 +327,22 @@ typedef DECLCALLBACK(int) FNPGMENUMDIRTYFTPAGES(PVM pVM, RTGCPHYS GCPhys, uint8_
 typedef FNPGMENUMDIRTYFTPAGES *PFNPGMENUMDIRTYFTPAGES;
 
 
+/**
+ * PGMR3PostCopyTrgBegin callback for requesting a missing page from the source.
+ *
+ * This is called on the EMT accessing the page and shall only queue the
+ * request, the page is delivered via PGMR3PostCopyTrgPutPage.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhys          The guest physical address of the page.
+ * @param   pvUser          User argument.
+ */
+typedef DECLCALLBACK(int) FNPGMPOSTCOPYFETCH(PUVM pUVM, RTGCPHYS GCPhys, void *pvUser);
+/** Pointer to PGMR3PostCopyTrgBegin callback. */
+typedef FNPGMPOSTCOPYFETCH *PFNPGMPOSTCOPYFETCH;
+
+
 /**
  * Paging mode.
  *
@@ -920,6 +936,17 @@ VMMR3_INT_DECL(int) PGMR3DumpHierarchyShw(PVM pVM, uint64_t cr3, uint32_t fFlags
 VMMR3_INT_DECL(int) PGMR3DumpHierarchyGst(PVM pVM, uint64_t cr3, uint32_t fFlags, RTGCPTR FirstAddr, RTGCPTR LastAddr, uint32_t cMaxDepth, PCDBGFINFOHLP pHlp);
 
 
+/** @name Post-copy live migration
+ * @{ */
+VMMR3DECL(int)      PGMR3PostCopyEnable(PUVM pUVM, bool fEnable);
+VMMR3DECL(int)      PGMR3PostCopySrcNextPage(PUVM pUVM, PRTGCPHYS pGCPhys);
+VMMR3DECL(int)      PGMR3PostCopySrcReadPage(PUVM pUVM, RTGCPHYS GCPhys, void *pvPage);
+VMMR3DECL(int)      PGMR3PostCopyTrgBegin(PUVM pUVM, PFNPGMPOSTCOPYFETCH pfnFetch, void *pvUser, uint32_t *pcPages);
+VMMR3DECL(int)      PGMR3PostCopyTrgPutPage(PUVM pUVM, RTGCPHYS GCPhys, void const *pvPage, uint32_t *pcLeft);
+VMMR3DECL(int)      PGMR3PostCopyEnd(PUVM pUVM);
+/** @} */
+
+
 /** @name Page sharing
  * @{ */
 VMMR3DECL(int)     PGMR3SharedModuleRegister(PVM pVM, VBOXOSFAMILY enmGuestOS, char *pszModuleName, char *pszVersion,
@@ -81,6 +81,16 @@
  * interrupts (see @bugref{8624}).
  */
 #define E1K_IMS_INT_DELAY_NS 100
+/** @name Adaptive interrupt throttling intervals (in 256 ns ITR units).
+ * Used instead of ITR when the guest leaves it zero and ItrAdaptive is set.
+ * @{ */
+/** ~70000 interrupts/s, small request/response traffic. */
+#define E1K_ITR_LOWEST_LATENCY  55
+/** ~20000 interrupts/s, mixed traffic. */
+#define E1K_ITR_LOW_LATENCY     195
+/** ~4000 interrupts/s, bulk transfers. */
+#define E1K_ITR_BULK_LATENCY    976
+/** @} */
 /** @def E1K_TX_DELAY
  * E1K_TX_DELAY aims to improve guest-host transfer rate for TCP streams by
  * preventing packets to be sent immediately. It allows to send several
@@ -113,10 +123,6 @@
  * debugging of delayed interrupts, etc.
  */
 #define E1K_INT_STATS
-/** @def E1K_WITH_MSI
- * E1K_WITH_MSI enables rudimentary MSI support. Not implemented.
- */
-//#define E1K_WITH_MSI
 /** @def E1K_WITH_TX_CS
  * E1K_WITH_TX_CS protects e1kXmitPending with a critical section.
  */
@@ -254,14 +260,7 @@ static const struct E1kChips
 } g_aChips[] =
 {
     /* Vendor Device SSVendor SubSys  Name */
-    { 0x8086,
-      /* Temporary code, as MSI-aware driver dislike 0x100E. How to do that right? */
-# ifdef E1K_WITH_MSI
-      0x105E,
-# else
-      0x100E,
-# endif
-                      0x8086, 0x001E, "82540EM" }, /* Intel 82540EM-A in Intel PRO/1000 MT Desktop */
+    { 0x8086, 0x100E, 0x8086, 0x001E, "82540EM" }, /* Intel 82540EM-A in Intel PRO/1000 MT Desktop */
     { 0x8086, 0x1004, 0x8086, 0x1004, "82543GC" }, /* Intel 82543GC   in Intel PRO/1000 T  Server */
     { 0x8086, 0x100F, 0x15AD, 0x0750, "82545EM" }  /* Intel 82545EM-A in VMWare Network Adapter */
 };
@@ -1113,6 +1112,16 @@ struct E1kState_st
     bool        fItrRxEnabled;
     /** All: Delay TX interrupts using TIDV/TADV. */
     bool        fTidEnabled;
+    /** All: Throttle interrupts adaptively when the guest does not set ITR. */
+    bool        fItrAdaptive;
+    /** EMT: Deliver interrupts via MSI if the guest enables it. */
+    bool        fMsiEnabled;
+    /** All: Adaptive ITR - current throttling interval (in 256 ns units). */
+    uint32_t    uItrAdaptive;
+    /** All: Adaptive ITR - frames seen since the last interrupt. */
+    uint32_t volatile cItrFrames;
+    /** All: Adaptive ITR - bytes seen since the last interrupt. */
+    uint32_t volatile cbItrBytes;
     /** Link up delay (in milliseconds). */
     uint32_t    cMsLinkUpDelay;
 
@@ -1650,6 +1659,9 @@ static void e1kHardReset(PE1KSTATE pThis)
     TSPMT  = 0x01000400;/* TSMT=0400h TSPBP=0100h */
     Assert(GET_BITS(RCTL, BSIZE) == 0);
     pThis->u16RxBSize = 2048;
+    pThis->uItrAdaptive = E1K_ITR_LOW_LATENCY;
+    ASMAtomicWriteU32(&pThis->cItrFrames, 0);
+    ASMAtomicWriteU32(&pThis->cbItrBytes, 0);
 
     /* Reset promiscuous mode */
     if (pThis->pDrvR3)
@@ -2009,9 +2021,80 @@ inline void e1kPostponeInterrupt(PE1KSTATE pThis, uint64_t uNanoseconds)
         TMTimerSetNano(pThis->CTX_SUFF(pIntTimer), uNanoseconds);
 }
 
+/**
+ * Account a received or transmitted frame for adaptive interrupt throttling.
+ *
+ * @param   pThis       The device state structure.
+ * @param   cb          The size of the frame.
+ */
+DECLINLINE(void) e1kItrAccount(PE1KSTATE pThis, size_t cb)
+{
+    if (pThis->fItrAdaptive)
+    {
+        ASMAtomicIncU32(&pThis->cItrFrames);
+        ASMAtomicAddU32(&pThis->cbItrBytes, (uint32_t)cb);
+    }
+}
+
+/**
+ * Pick the adaptive throttling interval for the next interrupt based on the
+ * traffic seen since the previous one.
+ *
+ * Small packets at low rates get the lowest latency, large volumes of big
+ * frames the bulk one. The thresholds have some hysteresis so that the
+ * interval does not flip with every interrupt.
+ *
+ * @param   pThis       The device state structure.
+ * @thread  Any, under the device critical section.
+ */
+static void e1kItrAdapt(PE1KSTATE pThis)
+{
+    uint32_t const cFrames = ASMAtomicXchgU32(&pThis->cItrFrames, 0);
+    uint32_t const cbBytes = ASMAtomicXchgU32(&pThis->cbItrBytes, 0);
+    if (!cFrames)
+        return;
+
+    uint32_t const cbAvg = cbBytes / cFrames;
+    switch (pThis->uItrAdaptive)
+    {
+        case E1K_ITR_LOWEST_LATENCY:
+            if (cbBytes > 10000)
+                pThis->uItrAdaptive = cbAvg > 8000 ? E1K_ITR_BULK_LATENCY : E1K_ITR_LOW_LATENCY;
+            break;
+        case E1K_ITR_LOW_LATENCY:
+            if (cbBytes > 10000 && (cbAvg > 8000 || cFrames > 35))
+                pThis->uItrAdaptive = E1K_ITR_BULK_LATENCY;
+            else if (cbBytes < 2000 && cFrames < 5)
+                pThis->uItrAdaptive = E1K_ITR_LOWEST_LATENCY;
+            break;
+        default:
+            if (cbBytes < 6000)
+                pThis->uItrAdaptive = E1K_ITR_LOW_LATENCY;
+            break;
+    }
+}
+
+/**
+ * Get the interrupt throttling interval that applies to the pending causes.
+ *
+ * @returns Interval in 256 ns units, 0 if interrupts are not throttled.
+ * @param   pThis       The device state structure.
+ */
+DECLINLINE(uint32_t) e1kItrInterval(PE1KSTATE pThis)
+{
+    if (!pThis->fItrRxEnabled && (ICR & ICR_RXT0))
+        return 0;
+    if (ITR)
+        return pThis->fItrEnabled ? ITR : 0;
+    return pThis->fItrAdaptive ? pThis->uItrAdaptive : 0;
+}
+
 /**
  * Raise interrupt if not masked.
  *
+ * With MSI enabled by the guest PDMDevHlpPCISetIrq() sends a message when
+ * raising and lowering is a no-op, the throttling logic is the same.
+ *
  * @param   pThis       The device state structure.
  */
 static int e1kRaiseInterrupt(PE1KSTATE pThis, int rcBusy, uint32_t u32IntCause = 0)
@@ -2033,16 +2116,19 @@ static int e1kRaiseInterrupt(PE1KSTATE pThis, int rcBusy, uint32_t u32IntCause =
         else
         {
             uint64_t tsNow = TMTimerGet(pThis->CTX_SUFF(pIntTimer));
-            if (!!ITR && tsNow - pThis->u64AckedAt < ITR * 256
-                     && pThis->fItrEnabled && (pThis->fItrRxEnabled || !(ICR & ICR_RXT0)))
+            uint64_t const cNsItr = (uint64_t)e1kItrInterval(pThis) * 256;
+            if (tsNow - pThis->u64AckedAt < cNsItr)
             {
                 E1K_INC_ISTAT_CNT(pThis->uStatIntEarly);
                 E1kLog2(("%s e1kRaiseInterrupt: Too early to raise again: %d ns < %d ns.\n",
-                        pThis->szPrf, (uint32_t)(tsNow - pThis->u64AckedAt), ITR * 256));
-                e1kPostponeInterrupt(pThis, ITR * 256);
+                        pThis->szPrf, (uint32_t)(tsNow - pThis->u64AckedAt), (uint32_t)cNsItr));
+                /* Deliver it when the interval is over. */
+                e1kPostponeInterrupt(pThis, cNsItr - (tsNow - pThis->u64AckedAt));
             }
             else
             {
+                if (pThis->fItrAdaptive)
+                    e1kItrAdapt(pThis);
 
                 /* Since we are delivering the interrupt now
                  * there is no need to do it later -- stop the timer.
@@ -2434,6 +2520,7 @@ static int e1kHandleRxPacket(PE1KSTATE pThis, const void *pvBuf, size_t cb, E1KR
     /* Update octet receive counter */
     E1K_ADD_CNT64(GORCL, GORCH, cb);
     STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
+    e1kItrAccount(pThis, cb);
     if (cb == 64)
         E1K_INC_CNT32(PRC64);
     else if (cb < 128)
@@ -3991,6 +4078,7 @@ static void e1kTransmitFrame(PE1KSTATE pThis, bool fOnWorkerThread)
     E1K_ADD_CNT64(GOTCL, GOTCH, cbFrame);
     if (pThis->CTX_SUFF(pDrv))
         STAM_REL_COUNTER_ADD(&pThis->StatTransmitBytes, cbFrame);
+    e1kItrAccount(pThis, cbFrame);
     if (cbFrame == 64)
         E1K_INC_CNT32(PTC64);
     else if (cbFrame < 128)
@@ -7589,12 +7677,8 @@ static DECLCALLBACK(void) e1kConfigurePciDev(PPDMPCIDEV pPciDev, E1KCHIP eChip)
     /* PCI-X Configuration Registers *****************************************/
     /* Capability ID: PCI-X Configuration Registers */
     PCIDevSetByte( pPciDev, 0xE4,          VBOX_PCI_CAP_ID_PCIX);
-#ifdef E1K_WITH_MSI
-    PCIDevSetByte( pPciDev, 0xE4 + 1,                      0x80);
-#else
-    /* Next Item Pointer: None (Message Signalled Interrupts are disabled) */
+    /* Next Item Pointer: None (MSI is linked in by e1kR3Construct if enabled) */
     PCIDevSetByte( pPciDev, 0xE4 + 1,                      0x00);
-#endif
     /* PCI-X Command: Enable Relaxed Ordering */
     PCIDevSetWord( pPciDev, 0xE4 + 2,        VBOX_PCI_X_CMD_ERO);
     /* PCI-X Status: 32-bit, 66MHz*/
@@ -7628,6 +7712,7 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     pThis->fDelayInts   = false;
     pThis->fLocked      = false;
     pThis->u64AckedAt   = 0;
+    pThis->uItrAdaptive = E1K_ITR_LOW_LATENCY;
     pThis->led.u32Magic = PDMLED_MAGIC;
     pThis->u32PktNo     = 1;
 
@@ -7661,7 +7746,7 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
      */
     if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "AdapterType\0"
                                     "LineSpeed\0" "GCEnabled\0" "R0Enabled\0"
-                                    "ItrEnabled\0" "ItrRxEnabled\0"
+                                    "ItrEnabled\0" "ItrRxEnabled\0" "ItrAdaptive\0" "MsiEnabled\0"
                                     "EthernetCRC\0" "GSOEnabled\0" "LinkUpDelay\0"))
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                 N_("Invalid configuration for E1000 device"));
@@ -7717,6 +7802,16 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
         return PDMDEV_SET_ERROR(pDevIns, rc,
                                 N_("Configuration error: Failed to get the value of 'TidEnabled'"));
 
+    rc = CFGMR3QueryBoolDef(pCfg, "ItrAdaptive", &pThis->fItrAdaptive, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'ItrAdaptive'"));
+
+    rc = CFGMR3QueryBoolDef(pCfg, "MsiEnabled", &pThis->fMsiEnabled, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'MsiEnabled'"));
+
     rc = CFGMR3QueryU32Def(pCfg, "LinkUpDelay", (uint32_t*)&pThis->cMsLinkUpDelay, 3000); /* ms */
     if (RT_FAILURE(rc))
         return PDMDEV_SET_ERROR(pDevIns, rc,
@@ -7727,12 +7822,14 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     else if (pThis->cMsLinkUpDelay == 0)
         LogRel(("%s: WARNING! Link up delay is disabled!\n", pThis->szPrf));
 
-    LogRel(("%s: Chip=%s LinkUpDelay=%ums EthernetCRC=%s GSO=%s Itr=%s ItrRx=%s TID=%s R0=%s GC=%s\n", pThis->szPrf,
+    LogRel(("%s: Chip=%s LinkUpDelay=%ums EthernetCRC=%s GSO=%s Itr=%s ItrRx=%s ItrAdaptive=%s MSI=%s TID=%s R0=%s GC=%s\n", pThis->szPrf,
             g_aChips[pThis->eChip].pcszName, pThis->cMsLinkUpDelay,
             pThis->fEthernetCRC ? "on" : "off",
             pThis->fGSOEnabled ? "enabled" : "disabled",
             pThis->fItrEnabled ? "enabled" : "disabled",
             pThis->fItrRxEnabled ? "enabled" : "disabled",
+            pThis->fItrAdaptive ? "enabled" : "disabled",
+            pThis->fMsiEnabled ? "enabled" : "disabled",
             pThis->fTidEnabled ? "enabled" : "disabled",
             pThis->fR0Enabled ? "enabled" : "disabled",
             pThis->fRCEnabled ? "enabled" : "disabled"));
@@ -7773,15 +7870,27 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     if (RT_FAILURE(rc))
         return rc;
 
-#ifdef E1K_WITH_MSI
-    PDMMSIREG MsiReg;
-    RT_ZERO(MsiReg);
-    MsiReg.cMsiVectors    = 1;
-    MsiReg.iMsiCapOffset  = 0x80;
-    MsiReg.iMsiNextOffset = 0x0;
-    MsiReg.fMsi64bit      = false;
-    rc = PDMDevHlpPCIRegisterMsi(pDevIns, &MsiReg);
-    AssertRCReturn(rc, rc);
+#ifdef VBOX_WITH_MSI_DEVICES
+    if (pThis->fMsiEnabled)
+    {
+        PDMMSIREG MsiReg;
+        RT_ZERO(MsiReg);
+        MsiReg.cMsiVectors    = 1;
+        MsiReg.iMsiCapOffset  = 0x80;
+        MsiReg.iMsiNextOffset = 0x0;
+        MsiReg.fMsi64bit      = false;
+        rc = PDMDevHlpPCIRegisterMsi(pDevIns, &MsiReg);
+        if (RT_SUCCESS(rc))
+            PCIDevSetByte(&pThis->pciDevice, 0xE4 + 1, 0x80); /* PCI-X -> MSI */
+        else
+        {
+            /* That's OK, we can work without MSI */
+            LogRel(("%s: Failed to register MSI (%Rrc), using INTx\n", pThis->szPrf, rc));
+            pThis->fMsiEnabled = false;
+        }
+    }
+#else
+    pThis->fMsiEnabled = false;
 #endif
 
 
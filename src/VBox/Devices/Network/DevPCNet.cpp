@@ -79,6 +79,15 @@
 /* Enable to handle frequent io reads in the guest context (recommended) */
 #define PCNET_GC_ENABLED
 
+/** @def PCNET_WITH_DESC_CACHE
+ * PCNET_WITH_DESC_CACHE causes PCNet to prefetch the consecutive RX and TX
+ * descriptors owned by the card in one batch (two reads per batch instead of
+ * two reads per descriptor). Descriptors owned by the card must not be changed
+ * by the guest, so the cached copies stay valid until they are passed back or
+ * the rings are set up again. This saves most of the guest memory accesses
+ * when polling the rings for every frame and every transmit demand. */
+#define PCNET_WITH_DESC_CACHE
+
 #if defined(LOG_ENABLED)
 #define PCNET_DEBUG_IO
 #define PCNET_DEBUG_BCR
@@ -94,6 +103,11 @@
 
 #define PCNET_SAVEDSTATE_VERSION        10
 
+#ifdef PCNET_WITH_DESC_CACHE
+/** The max number of descriptors prefetched into each descriptor cache. */
+# define PCNET_DESC_CACHE_SIZE          16
+#endif
+
 #define BCR_MAX_RAP                     50
 #define MII_MAX_REG                     32
 #define CSR_MAX_REG                     128
@@ -243,6 +257,31 @@
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+#ifdef PCNET_WITH_DESC_CACHE
+/**
+ * Cache of consecutive ring descriptors owned by the card.
+ */
+typedef struct PCNETDESCCACHE
+{
+    /** Guest physical address of entry 0. */
+    RTGCPHYS32                          GCPhysBase;
+    /** Index of the first valid entry. */
+    uint16_t                            iFirst;
+    /** Number of entries read (entries iFirst..cEntries-1 are valid). */
+    uint16_t                            cEntries;
+    /** The descriptors as stored in guest memory, 8 or 16 bytes each. */
+    uint8_t                             abDescs[PCNET_DESC_CACHE_SIZE * 16];
+# ifdef VBOX_WITH_STATISTICS
+    /** Number of batches read into the cache. */
+    STAMCOUNTER                         StatFills;
+    /** Number of descriptors found in the cache. */
+    STAMCOUNTER                         StatHits;
+# endif
+} PCNETDESCCACHE;
+/** Pointer to a descriptor cache. */
+typedef PCNETDESCCACHE *PPCNETDESCCACHE;
+#endif
+
 /**
  * PCNET state.
  *
@@ -340,6 +379,12 @@ typedef struct PCNETSTATE
     uint8_t                             abLoopBuf[4096];
     /** The recv buffer. */
     uint8_t                             abRecvBuf[4096];
+#ifdef PCNET_WITH_DESC_CACHE
+    /** The receive descriptor cache. */
+    PCNETDESCCACHE                      RxdCache;
+    /** The transmit descriptor cache. */
+    PCNETDESCCACHE                      TxdCache;
+#endif
 
     /** Alignment padding. */
     uint32_t                            Alignment2;
@@ -658,46 +703,32 @@ DECLINLINE(bool) pcnetIsLinkUp(PPCNETSTATE pThis)
 }
 
 /**
- * Load transmit message descriptor
- * Make sure we read the own flag first.
+ * Convert a transmit message descriptor as stored in guest memory according
+ * to SWSTYLE.
  *
  * @param pThis         adapter private data
- * @param addr          physical address of the descriptor
- * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @param tmd           where to store the descriptor
+ * @param pvRaw         the descriptor as read from guest memory
+ * @param ownbyte       the byte holding the own flag, read before the descriptor
  * @return              true if we own the descriptor, false otherwise
  */
-DECLINLINE(bool) pcnetTmdLoad(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 addr, bool fRetIfNotOwn)
+DECLINLINE(bool) pcnetTmdFromRaw(PPCNETSTATE pThis, TMD *tmd, const void *pvRaw, uint8_t ownbyte)
 {
-    PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
-    uint8_t    ownbyte;
-
     if (RT_UNLIKELY(BCR_SWSTYLE(pThis) == 0))
     {
         uint16_t xda[4];
-
-        PDMDevHlpPhysRead(pDevIns, addr+3, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)&xda[0], sizeof(xda));
+        memcpy(xda, pvRaw, sizeof(xda));
         ((uint32_t *)tmd)[0] = (uint32_t)xda[0] | ((uint32_t)(xda[1] & 0x00ff) << 16);
         ((uint32_t *)tmd)[1] = (uint32_t)xda[2] | ((uint32_t)(xda[1] & 0xff00) << 16);
         ((uint32_t *)tmd)[2] = (uint32_t)xda[3] << 16;
         ((uint32_t *)tmd)[3] = 0;
     }
     else if (RT_LIKELY(BCR_SWSTYLE(pThis) != 3))
-    {
-        PDMDevHlpPhysRead(pDevIns, addr+7, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)tmd, 16);
-    }
+        memcpy(tmd, pvRaw, 16);
     else
     {
         uint32_t xda[4];
-        PDMDevHlpPhysRead(pDevIns, addr+7, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)&xda[0], sizeof(xda));
+        memcpy(xda, pvRaw, sizeof(xda));
         ((uint32_t *)tmd)[0] = xda[2];
         ((uint32_t *)tmd)[1] = xda[1];
         ((uint32_t *)tmd)[2] = xda[0];
@@ -714,6 +745,132 @@ DECLINLINE(bool) pcnetTmdLoad(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 addr, bool
     return !!tmd->tmd1.own;
 }
 
+/**
+ * Load transmit message descriptor
+ * Make sure we read the own flag first.
+ *
+ * @param pThis         adapter private data
+ * @param addr          physical address of the descriptor
+ * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @return              true if we own the descriptor, false otherwise
+ */
+DECLINLINE(bool) pcnetTmdLoad(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 addr, bool fRetIfNotOwn)
+{
+    PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
+    bool const fStyle0 = BCR_SWSTYLE(pThis) == 0;
+    uint8_t    ownbyte;
+    uint32_t   au32Raw[4];
+
+    PDMDevHlpPhysRead(pDevIns, addr + (fStyle0 ? 3 : 7), &ownbyte, 1);
+    if (!(ownbyte & 0x80) && fRetIfNotOwn)
+        return false;
+    PDMDevHlpPhysRead(pDevIns, addr, (void*)&au32Raw[0], fStyle0 ? 8 : 16);
+    return pcnetTmdFromRaw(pThis, tmd, au32Raw, ownbyte);
+}
+
+#ifdef PCNET_WITH_DESC_CACHE
+
+/**
+ * Get a descriptor through a descriptor cache.
+ *
+ * On a miss the own flag of the descriptor is read first, like pcnetTmdLoad
+ * and pcnetRmdLoad do. If the card owns it, the descriptors up to the end of
+ * the ring (at most PCNET_DESC_CACHE_SIZE) are read in one go and the
+ * following ones which turn out to be owned by the card too are read a second
+ * time, as the first read may have raced the guest filling them in.
+ *
+ * @param pThis         adapter private data
+ * @param pCache        the RX or TX descriptor cache
+ * @param addr          physical address of the descriptor
+ * @param cUntilEnd     number of descriptors from @a addr to the end of the ring
+ * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @param pvRaw         where to store the descriptor as stored in guest memory (16 bytes)
+ * @param pownbyte      where to store the byte holding the own flag
+ * @return              false if we don't own the descriptor and fRetIfNotOwn is set, true otherwise
+ */
+static bool pcnetDescCacheGet(PPCNETSTATE pThis, PPCNETDESCCACHE pCache, RTGCPHYS32 addr, unsigned cUntilEnd,
+                              bool fRetIfNotOwn, void *pvRaw, uint8_t *pownbyte)
+{
+    PPDMDEVINS     pDevIns = PCNETSTATE_2_DEVINS(pThis);
+    bool const     fStyle0 = BCR_SWSTYLE(pThis) == 0;
+    unsigned const cbDesc  = fStyle0 ? 8 : 16;
+    unsigned const offOwn  = fStyle0 ? 3 : 7;
+
+    if (addr >= pCache->GCPhysBase)
+    {
+        uint32_t const off = addr - pCache->GCPhysBase;
+        uint32_t const i   = off / cbDesc;
+        if (   i >= pCache->iFirst
+            && i <  pCache->cEntries
+            && !(off % cbDesc))
+        {
+            STAM_COUNTER_INC(&pCache->StatHits);
+            memcpy(pvRaw, &pCache->abDescs[off], cbDesc);
+            *pownbyte = pCache->abDescs[off + offOwn];
+            return true;
+        }
+    }
+
+    uint8_t ownbyte;
+    PDMDevHlpPhysRead(pDevIns, addr + offOwn, &ownbyte, 1);
+    *pownbyte = ownbyte;
+    if (!(ownbyte & 0x80))
+    {
+        if (fRetIfNotOwn)
+            return false;
+        PDMDevHlpPhysRead(pDevIns, addr, pvRaw, cbDesc);
+        return true;
+    }
+
+    /* A bogus SWSTYLE leaves gaps between the descriptors, don't batch then. */
+    unsigned cDescs = RT_MIN(RT_MAX(cUntilEnd, 1), PCNET_DESC_CACHE_SIZE);
+    if (RT_UNLIKELY(cbDesc != RT_BIT_32(pThis->iLog2DescSize)))
+        cDescs = 1;
+
+    PDMDevHlpPhysRead(pDevIns, addr, &pCache->abDescs[0], cDescs * cbDesc);
+    unsigned cOwned = 1;
+    while (   cOwned < cDescs
+           && (pCache->abDescs[cOwned * cbDesc + offOwn] & 0x80))
+        cOwned++;
+    if (cOwned > 1)
+    {
+        ASMReadFence();
+        PDMDevHlpPhysRead(pDevIns, addr + cbDesc, &pCache->abDescs[cbDesc], (cOwned - 1) * cbDesc);
+    }
+    STAM_COUNTER_INC(&pCache->StatFills);
+
+    pCache->GCPhysBase = addr;
+    pCache->iFirst     = 0;
+    pCache->cEntries   = (uint16_t)cOwned;
+    memcpy(pvRaw, &pCache->abDescs[0], cbDesc);
+    return true;
+}
+
+/**
+ * Drop a descriptor which is passed back to the host from a descriptor cache,
+ * together with the entries preceding it.
+ */
+DECLINLINE(void) pcnetDescCacheRelease(PPCNETSTATE pThis, PPCNETDESCCACHE pCache, RTGCPHYS32 addr)
+{
+    if (addr >= pCache->GCPhysBase)
+    {
+        uint32_t const i = (addr - pCache->GCPhysBase) / (BCR_SWSTYLE(pThis) == 0 ? 8 : 16);
+        if (i < pCache->cEntries && i >= pCache->iFirst)
+            pCache->iFirst = (uint16_t)(i + 1);
+    }
+}
+
+/**
+ * Invalidate the descriptor caches, the rings are about to be set up again.
+ */
+DECLINLINE(void) pcnetDescCachesReset(PPCNETSTATE pThis)
+{
+    pThis->RxdCache.iFirst   = pThis->TxdCache.iFirst   = 0;
+    pThis->RxdCache.cEntries = pThis->TxdCache.cEntries = 0;
+}
+
+#endif /* PCNET_WITH_DESC_CACHE */
+
 /**
  * Store transmit message descriptor and hand it over to the host (the VM guest).
  * Make sure that all data are transmitted before we clear the own flag.
@@ -722,6 +879,9 @@ DECLINLINE(void) pcnetTmdStorePassHost(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 a
 {
     STAM_PROFILE_ADV_START(&pThis->CTX_SUFF_Z(StatTmdStore), a);
     PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
+#ifdef PCNET_WITH_DESC_CACHE
+    pcnetDescCacheRelease(pThis, &pThis->TxdCache, addr);
+#endif
     if (RT_UNLIKELY(BCR_SWSTYLE(pThis) == 0))
     {
         uint16_t xda[4];
@@ -757,45 +917,32 @@ DECLINLINE(void) pcnetTmdStorePassHost(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 a
 }
 
 /**
- * Load receive message descriptor
- * Make sure we read the own flag first.
+ * Convert a receive message descriptor as stored in guest memory according
+ * to SWSTYLE.
  *
  * @param pThis         adapter private data
- * @param addr          physical address of the descriptor
- * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @param rmd           where to store the descriptor
+ * @param pvRaw         the descriptor as read from guest memory
+ * @param ownbyte       the byte holding the own flag, read before the descriptor
  * @return              true if we own the descriptor, false otherwise
  */
-DECLINLINE(bool) pcnetRmdLoad(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr, bool fRetIfNotOwn)
+DECLINLINE(bool) pcnetRmdFromRaw(PPCNETSTATE pThis, RMD *rmd, const void *pvRaw, uint8_t ownbyte)
 {
-    PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
-    uint8_t    ownbyte;
-
     if (RT_UNLIKELY(BCR_SWSTYLE(pThis) == 0))
     {
         uint16_t rda[4];
-        PDMDevHlpPhysRead(pDevIns, addr+3, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)&rda[0], sizeof(rda));
+        memcpy(rda, pvRaw, sizeof(rda));
         ((uint32_t *)rmd)[0] = (uint32_t)rda[0] | ((rda[1] & 0x00ff) << 16);
         ((uint32_t *)rmd)[1] = (uint32_t)rda[2] | ((rda[1] & 0xff00) << 16);
         ((uint32_t *)rmd)[2] = (uint32_t)rda[3];
         ((uint32_t *)rmd)[3] = 0;
     }
     else if (RT_LIKELY(BCR_SWSTYLE(pThis) != 3))
-    {
-        PDMDevHlpPhysRead(pDevIns, addr+7, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)rmd, 16);
-    }
+        memcpy(rmd, pvRaw, 16);
     else
     {
         uint32_t rda[4];
-        PDMDevHlpPhysRead(pDevIns, addr+7, &ownbyte, 1);
-        if (!(ownbyte & 0x80) && fRetIfNotOwn)
-            return false;
-        PDMDevHlpPhysRead(pDevIns, addr, (void*)&rda[0], sizeof(rda));
+        memcpy(rda, pvRaw, sizeof(rda));
         ((uint32_t *)rmd)[0] = rda[2];
         ((uint32_t *)rmd)[1] = rda[1];
         ((uint32_t *)rmd)[2] = rda[0];
@@ -812,6 +959,77 @@ DECLINLINE(bool) pcnetRmdLoad(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr, bool
     return !!rmd->rmd1.own;
 }
 
+/**
+ * Load receive message descriptor
+ * Make sure we read the own flag first.
+ *
+ * @param pThis         adapter private data
+ * @param addr          physical address of the descriptor
+ * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @return              true if we own the descriptor, false otherwise
+ */
+DECLINLINE(bool) pcnetRmdLoad(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr, bool fRetIfNotOwn)
+{
+    PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
+    bool const fStyle0 = BCR_SWSTYLE(pThis) == 0;
+    uint8_t    ownbyte;
+    uint32_t   au32Raw[4];
+
+    PDMDevHlpPhysRead(pDevIns, addr + (fStyle0 ? 3 : 7), &ownbyte, 1);
+    if (!(ownbyte & 0x80) && fRetIfNotOwn)
+        return false;
+    PDMDevHlpPhysRead(pDevIns, addr, (void*)&au32Raw[0], fStyle0 ? 8 : 16);
+    return pcnetRmdFromRaw(pThis, rmd, au32Raw, ownbyte);
+}
+
+
+/**
+ * Load transmit message descriptor for polling the ring, preferably from the
+ * transmit descriptor cache.
+ *
+ * @param pThis         adapter private data
+ * @param tmd           where to store the descriptor
+ * @param addr          physical address of the descriptor
+ * @param cUntilEnd     number of descriptors from @a addr to the end of the ring
+ * @return              true if we own the descriptor, false otherwise
+ */
+DECLINLINE(bool) pcnetTmdLoadCached(PPCNETSTATE pThis, TMD *tmd, RTGCPHYS32 addr, unsigned cUntilEnd)
+{
+#ifdef PCNET_WITH_DESC_CACHE
+    uint32_t au32Raw[4];
+    uint8_t  ownbyte;
+    if (!pcnetDescCacheGet(pThis, &pThis->TxdCache, addr, cUntilEnd, true, au32Raw, &ownbyte))
+        return false;
+    return pcnetTmdFromRaw(pThis, tmd, au32Raw, ownbyte);
+#else
+    RT_NOREF(cUntilEnd);
+    return pcnetTmdLoad(pThis, tmd, addr, true);
+#endif
+}
+
+/**
+ * Load receive message descriptor, preferably from the receive descriptor cache.
+ *
+ * @param pThis         adapter private data
+ * @param rmd           where to store the descriptor
+ * @param addr          physical address of the descriptor
+ * @param cUntilEnd     number of descriptors from @a addr to the end of the ring
+ * @param fRetIfNotOwn  return immediately after reading the own flag if we don't own the descriptor
+ * @return              true if we own the descriptor, false otherwise
+ */
+DECLINLINE(bool) pcnetRmdLoadCached(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr, unsigned cUntilEnd, bool fRetIfNotOwn)
+{
+#ifdef PCNET_WITH_DESC_CACHE
+    uint32_t au32Raw[4];
+    uint8_t  ownbyte;
+    if (!pcnetDescCacheGet(pThis, &pThis->RxdCache, addr, cUntilEnd, fRetIfNotOwn, au32Raw, &ownbyte))
+        return false;
+    return pcnetRmdFromRaw(pThis, rmd, au32Raw, ownbyte);
+#else
+    RT_NOREF(cUntilEnd);
+    return pcnetRmdLoad(pThis, rmd, addr, fRetIfNotOwn);
+#endif
+}
 
 /**
  * Store receive message descriptor and hand it over to the host (the VM guest).
@@ -820,6 +1038,9 @@ DECLINLINE(bool) pcnetRmdLoad(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr, bool
 DECLINLINE(void) pcnetRmdStorePassHost(PPCNETSTATE pThis, RMD *rmd, RTGCPHYS32 addr)
 {
     PPDMDEVINS pDevIns = PCNETSTATE_2_DEVINS(pThis);
+#ifdef PCNET_WITH_DESC_CACHE
+    pcnetDescCacheRelease(pThis, &pThis->RxdCache, addr);
+#endif
     if (RT_UNLIKELY(BCR_SWSTYLE(pThis) == 0))
     {
         uint16_t rda[4];
@@ -1234,6 +1455,9 @@ static void pcnetSoftReset(PPCNETSTATE pThis)
     pThis->aCSR[114] = 0x0000;
     pThis->aCSR[122] = 0x0000;
     pThis->aCSR[124] = 0x0000;
+#ifdef PCNET_WITH_DESC_CACHE
+    pcnetDescCachesReset(pThis);
+#endif
 }
 
 /**
@@ -1457,6 +1681,10 @@ static void pcnetInit(PPCNETSTATE pThis)
 
 #undef PCNET_INIT
 
+#ifdef PCNET_WITH_DESC_CACHE
+    pcnetDescCachesReset(pThis);
+#endif
+
     size_t cbRxBuffers = 0;
     for (int i = CSR_RCVRL(pThis); i >= 1; i--)
     {
@@ -1539,6 +1767,9 @@ static void pcnetStop(PPCNETSTATE pThis)
     pThis->aCSR[0]  =  0x0004;
     pThis->aCSR[4] &= ~0x02c2;
     pThis->aCSR[5] &= ~0x0011;
+#ifdef PCNET_WITH_DESC_CACHE
+    pcnetDescCachesReset(pThis);
+#endif
     pcnetPollTimer(pThis);
 }
 
@@ -1592,7 +1823,7 @@ static void pcnetRdtePoll(PPCNETSTATE pThis, bool fSkipCurrent=false)
             addr = pcnetRdraAddr(pThis, i);
             CSR_CRDA(pThis) = CSR_CRBA(pThis) = 0;
             CSR_CRBC(pThis) = CSR_CRST(pThis) = 0;
-            if (!pcnetRmdLoad(pThis, &rmd, PHYSADDR(pThis, addr), true))
+            if (!pcnetRmdLoadCached(pThis, &rmd, PHYSADDR(pThis, addr), i, true))
             {
                 STAM_PROFILE_ADV_STOP(&pThis->CTX_SUFF_Z(StatRdtePoll), a);
                 return;
@@ -1636,7 +1867,7 @@ static void pcnetRdtePoll(PPCNETSTATE pThis, bool fSkipCurrent=false)
         addr = pcnetRdraAddr(pThis, i);
         CSR_NRDA(pThis) = CSR_NRBA(pThis) = 0;
         CSR_NRBC(pThis) = 0;
-        if (!pcnetRmdLoad(pThis, &rmd, PHYSADDR(pThis, addr), true))
+        if (!pcnetRmdLoadCached(pThis, &rmd, PHYSADDR(pThis, addr), i, true))
         {
             STAM_PROFILE_ADV_STOP(&pThis->CTX_SUFF_Z(StatRdtePoll), a);
             return;
@@ -1684,7 +1915,7 @@ static int pcnetTdtePoll(PPCNETSTATE pThis, TMD *tmd)
     {
         RTGCPHYS32 cxda = pcnetTdraAddr(pThis, CSR_XMTRC(pThis));
 
-        if (!pcnetTmdLoad(pThis, tmd, PHYSADDR(pThis, cxda), true))
+        if (!pcnetTmdLoadCached(pThis, tmd, PHYSADDR(pThis, cxda), CSR_XMTRC(pThis)))
         {
             STAM_PROFILE_ADV_STOP(&pThis->CTX_SUFF_Z(StatTdtePoll), a);
             return 0;
@@ -1881,7 +2112,7 @@ static void pcnetReceiveNoSync(PPCNETSTATE pThis, const uint8_t *buf, size_t cbT
             PRINT_PKTHDR(buf);
 #endif
 
-            pcnetRmdLoad(pThis, &rmd, PHYSADDR(pThis, crda), false);
+            pcnetRmdLoadCached(pThis, &rmd, PHYSADDR(pThis, crda), CSR_RCVRC(pThis), false);
             /*if (!CSR_LAPPEN(pThis))*/
                 rmd.rmd1.stp = 1;
 
@@ -1932,7 +2163,7 @@ static void pcnetReceiveNoSync(PPCNETSTATE pThis, const uint8_t *buf, size_t cbT
                 /* Check next descriptor's own bit. If we don't own it, we have
                  * to quit and write error status into the last descriptor we own.
                  */
-                if (!pcnetRmdLoad(pThis, &next_rmd, PHYSADDR(pThis, next_crda), true))
+                if (!pcnetRmdLoadCached(pThis, &next_rmd, PHYSADDR(pThis, next_crda), iRxDesc, true))
                     break;
 
                 /* Write back current descriptor, clear the own bit. */
@@ -2529,7 +2760,7 @@ static int pcnetAsyncTransmit(PPCNETSTATE pThis, bool fOnWorkerThread)
 #ifdef VBOX_WITH_STATISTICS
                 cBuffers++;
 #endif
-                pcnetTmdLoad(pThis, &tmd, PHYSADDR(pThis, CSR_CXDA(pThis)), false);
+                tmd = dummy; /* pcnetTdtePoll just loaded it */
                 cb = 4096 - tmd.tmd1.bcnt;
                 if (   !fDropFrame
                     && pSgBuf->cbUsed + cb <= MAX_FRAME) /** @todo this used to be ... + cb < MAX_FRAME. */
@@ -2768,6 +2999,11 @@ static int pcnetCSRWriteU16(PPCNETSTATE pThis, uint32_t u32RAP, uint32_t val)
     int      rc  = VINF_SUCCESS;
 #ifdef PCNET_DEBUG_CSR
     Log(("#%d pcnetCSRWriteU16: rap=%d val=%#06x\n", PCNET_INST_NR, u32RAP, val));
+#endif
+#ifdef PCNET_WITH_DESC_CACHE
+    /* Anything but CSR0 may move the rings or change the ring counters. */
+    if (u32RAP != 0)
+        pcnetDescCachesReset(pThis);
 #endif
     switch (u32RAP)
     {
@@ -3045,6 +3281,9 @@ static int pcnetBCRWriteU16(PPCNETSTATE pThis, uint32_t u32RAP, uint32_t val)
             }
             Log(("#%d BCR_SWS=%#06x\n", PCNET_INST_NR, val));
             pThis->aCSR[58] = val;
+#ifdef PCNET_WITH_DESC_CACHE
+            pcnetDescCachesReset(pThis);
+#endif
             RT_FALL_THRU();
         case BCR_LNKST:
         case BCR_LED1:
@@ -4386,6 +4625,9 @@ static DECLCALLBACK(int) pcnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint
         pThis->iLog2DescSize = BCR_SWSTYLE(pThis)
                              ? 4
                              : 3;
+#ifdef PCNET_WITH_DESC_CACHE
+        pcnetDescCachesReset(pThis);
+#endif
         pThis->GCUpperPhys   = BCR_SSIZE32(pThis)
                              ? 0
                              : (0xff00 & (uint32_t)pThis->aCSR[2]) << 16;
@@ -5164,6 +5406,12 @@ static DECLCALLBACK(int) pcnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTdtePollR3,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling PCNet TdtePoll in R3",     "/Devices/PCNet%d/TdtePollR3", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatRdtePollRZ,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling PCNet RdtePoll in RZ",     "/Devices/PCNet%d/RdtePollRZ", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatRdtePollR3,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling PCNet RdtePoll in R3",     "/Devices/PCNet%d/RdtePollR3", iInstance);
+# ifdef PCNET_WITH_DESC_CACHE
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->RxdCache.StatFills,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "RX descriptor batches read",         "/Devices/PCNet%d/RxdCache/Fills", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->RxdCache.StatHits,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "RX descriptors found in the cache",  "/Devices/PCNet%d/RxdCache/Hits", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->TxdCache.StatFills,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "TX descriptor batches read",         "/Devices/PCNet%d/TxdCache/Fills", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->TxdCache.StatHits,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "TX descriptors found in the cache",  "/Devices/PCNet%d/TxdCache/Hits", iInstance);
+# endif
 
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTmdStoreRZ,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling PCNet TmdStore in RZ",     "/Devices/PCNet%d/TmdStoreRZ", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTmdStoreR3,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling PCNet TmdStore in R3",     "/Devices/PCNet%d/TmdStoreR3", iInstance);
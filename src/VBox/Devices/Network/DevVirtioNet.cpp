@@ -49,13 +49,11 @@
 #ifdef IN_RING3
 
 #define VNET_PCI_CLASS               0x0200
-#define VNET_N_QUEUES                3
 #define VNET_NAME_FMT                "VNet%d"
 
 #if 0
 /* Virtio Block Device */
 #define VNET_PCI_CLASS               0x0180
-#define VNET_N_QUEUES                2
 #define VNET_NAME_FMT                "VBlk%d"
 #endif
 
@@ -71,6 +69,12 @@
 #define VNET_MAX_FRAME_SIZE     65535 + 18  /**< Max IP packet size + Ethernet header with VLAN tag */
 #define VNET_MAC_FILTER_LEN     32
 #define VNET_MAX_VID            (1 << 12)
+/** Maximum number of RX/TX queue pairs, the control queue comes on top. */
+#define VNET_MAX_QUEUE_PAIRS    ((VIRTIO_MAX_NQUEUES - 1) / 2)
+/** Number of entries in the receive flow steering table, must be a power of two. */
+#define VNET_FLOW_TABLE_SIZE    256
+/** Flow steering table entry which was not assigned to a queue pair yet. */
+#define VNET_FLOW_UNASSIGNED    UINT8_MAX
 
 /** @name Virtio net features
  * @{  */
@@ -91,6 +95,7 @@
 #define VNET_F_CTRL_VQ    0x00020000  /**< Control channel available */
 #define VNET_F_CTRL_RX    0x00040000  /**< Control channel RX mode support */
 #define VNET_F_CTRL_VLAN  0x00080000  /**< Control channel VLAN filtering */
+#define VNET_F_MQ         0x00400000  /**< Device supports multiple TX and RX queue pairs */
 /** @} */
 
 #define VNET_S_LINK_UP    1
@@ -107,8 +112,36 @@ struct __attribute__ ((__packed__)) VNetPCIConfig /** @todo r=bird: Use #pragma
 {
     RTMAC    mac;
     uint16_t uStatus;
+    uint16_t uMaxVirtqueuePairs;
 };
 AssertCompileMemberOffset(struct VNetPCIConfig, uStatus, 6);
+AssertCompileMemberOffset(struct VNetPCIConfig, uMaxVirtqueuePairs, 8);
+
+/**
+ * RX/TX queue pair state.
+ */
+typedef struct VNETQUEUEPAIR
+{
+    R3PTRTYPE(PVQUEUE)              pRxQueue;
+    R3PTRTYPE(PVQUEUE)              pTxQueue;
+#ifndef VNET_TX_DELAY
+    /** The event semaphore the TX thread of this pair waits on. */
+    SUPSEMEVENT                     hTxEvent;
+    R3PTRTYPE(PPDMTHREAD)           pTxThread;
+#endif /* !VNET_TX_DELAY */
+    /** Indicates transmission in progress -- only one thread is allowed per pair. */
+    uint32_t volatile               uIsTransmitting;
+    /** Set if the driver turned the pair away because another pair held the
+     * transmit session, the holder kicks the pair when it is done. */
+    bool volatile                   fXmitRetry;
+    /** Index of the pair. */
+    uint32_t                        iPair;
+    /** Queue names, the queues only store a pointer. */
+    char                            szRxName[8];
+    char                            szTxName[8];
+} VNETQUEUEPAIR;
+/** Pointer to a RX/TX queue pair. */
+typedef VNETQUEUEPAIR *PVNETQUEUEPAIR;
 
 /**
  * Device state structure. Holds the current state of device.
@@ -159,14 +192,8 @@ typedef struct VNetState_st
 #else /* !VNET_TX_DELAY */
     /** The support driver session handle. */
     R3R0PTRTYPE(PSUPDRVSESSION)     pSupDrvSession;
-    /** The event semaphore TX thread waits on. */
-    SUPSEMEVENT                     hTxEvent;
-    R3PTRTYPE(PPDMTHREAD)           pTxThread;
 #endif /* !VNET_TX_DELAY */
 
-    /** Indicates transmission in progress -- only one thread is allowed. */
-    uint32_t                uIsTransmitting;
-
     /** PCI config area holding MAC address as well as TBD. */
     struct VNetPCIConfig    config;
     /** MAC address obtained from the configuration. */
@@ -195,9 +222,16 @@ typedef struct VNetState_st
     /** Bit array of VLAN filter, one bit per VLAN ID. */
     uint8_t                 aVlanFilter[VNET_MAX_VID / sizeof(uint8_t)];
 
-    R3PTRTYPE(PVQUEUE)      pRxQueue;
-    R3PTRTYPE(PVQUEUE)      pTxQueue;
-    R3PTRTYPE(PVQUEUE)      pCtlQueue;
+    /** Number of RX/TX queue pairs the device was configured with. */
+    uint32_t                cQueuePairs;
+    /** Number of RX/TX queue pairs the guest enabled (VNET_CTRL_CMD_MQ_VQ_PAIRS_SET). */
+    uint32_t volatile       cQueuePairsActive;
+    /** The RX/TX queue pairs. */
+    VNETQUEUEPAIR           aQueuePairs[VNET_MAX_QUEUE_PAIRS];
+    /** Queue pair index of the last transmitted packet of a flow, indexed by the
+     * flow hash. Used to steer received packets to the matching RX queue. */
+    uint8_t volatile        abFlowSteer[VNET_FLOW_TABLE_SIZE];
+
     /* Receive-blocking-related fields ***************************************/
 
     /** EMT: Gets signalled when more RX descriptors become available. */
@@ -273,6 +307,9 @@ typedef uint8_t VNETCTLACK;
 #define VNET_CTRL_CMD_VLAN_ADD         0
 #define VNET_CTRL_CMD_VLAN_DEL         1
 
+#define VNET_CTRL_CLS_MQ               4
+#define VNET_CTRL_CMD_MQ_VQ_PAIRS_SET  0
+
 
 struct VNetCtlHdr
 {
@@ -291,6 +328,29 @@ DECLINLINE(bool) vnetMergeableRxBuffers(PVNETSTATE pThis)
     return !!(pThis->VPCI.uGuestFeatures & VNET_F_MRG_RXBUF);
 }
 
+/**
+ * Returns the index of the control queue.
+ *
+ * Guests which did not negotiate VNET_F_MQ expect it right after the first
+ * RX/TX pair, otherwise it comes after all the pairs. With more than one pair
+ * configured the legacy control queue is the RX queue of the second pair, see
+ * vnetQueueReceive(), and the queue named "CTL" stays unused.
+ */
+DECLINLINE(uint32_t) vnetCtlQueueIndex(PVNETSTATE pThis)
+{
+    if (pThis->VPCI.uGuestFeatures & VNET_F_MQ)
+        return 2 * pThis->cQueuePairs;
+    return 2;
+}
+
+/** Returns the queue pair a RX or TX queue belongs to. */
+DECLINLINE(PVNETQUEUEPAIR) vnetQueuePairFromQueue(PVNETSTATE pThis, PVQUEUE pQueue)
+{
+    uint32_t idxQueue = (uint32_t)(pQueue - &pThis->VPCI.Queues[0]);
+    Assert(idxQueue / 2 < pThis->cQueuePairs);
+    return &pThis->aQueuePairs[idxQueue / 2];
+}
+
 DECLINLINE(int) vnetCsEnter(PVNETSTATE pThis, int rcBusy)
 {
     return vpciCsEnter(&pThis->VPCI, rcBusy);
@@ -377,7 +437,8 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
         { VNET_F_STATUS,     "virtio_net_config.status available" },
         { VNET_F_CTRL_VQ,    "control channel available" },
         { VNET_F_CTRL_RX,    "control channel RX mode support" },
-        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" }
+        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" },
+        { VNET_F_MQ,         "multiple queue pairs" }
     };
 
     Log3(("%s %s:\n", INSTANCE(pThis), pcszText));
@@ -393,7 +454,6 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
 
 static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
 {
-    RT_NOREF_PV(pvState);
 
     /* We support:
      * - Host-provided MAC address
@@ -402,8 +462,13 @@ static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
      * - RX mode setting
      * - MAC filter table
      * - VLAN filter
+     * - Multiple queue pairs if configured
+     * - Event index based notification suppression
      */
-    return VNET_F_MAC
+    PVNETSTATE pThis = (PVNETSTATE)pvState;
+    return (pThis->cQueuePairs > 1 ? VNET_F_MQ : 0)
+        | VPCI_F_RING_EVENT_IDX
+        | VNET_F_MAC
         | VNET_F_STATUS
         | VNET_F_CTRL_VQ
         | VNET_F_CTRL_RX
@@ -500,7 +565,14 @@ static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
     pThis->nMacFilterEntries = 0;
     memset(pThis->aMacFilter,  0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
     memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
-    pThis->uIsTransmitting   = 0;
+    for (uint32_t i = 0; i < pThis->cQueuePairs; i++)
+    {
+        ASMAtomicWriteU32(&pThis->aQueuePairs[i].uIsTransmitting, 0);
+        ASMAtomicWriteBool(&pThis->aQueuePairs[i].fXmitRetry, false);
+    }
+    /* The guest has to enable the additional pairs explicitly. */
+    pThis->cQueuePairsActive = 1;
+    memset((void *)&pThis->abFlowSteer[0], VNET_FLOW_UNASSIGNED, sizeof(pThis->abFlowSteer));
 #ifndef IN_RING3
     return VINF_IOM_R3_IOPORT_WRITE;
 #else
@@ -670,10 +742,10 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port
  * This must be called before the pfnRecieve() method is called.
  *
  * @remarks As a side effect this function enables queue notification
- *          if it cannot receive because the queue is empty.
- *          It disables notification if it can receive.
+ *          on every active RX queue which is empty, and disables it on
+ *          the ones which have buffers.
  *
- * @returns VERR_NET_NO_BUFFER_SPACE if it cannot.
+ * @returns VERR_NET_NO_BUFFER_SPACE if it cannot receive on any RX queue.
  * @param   pInterface      Pointer to the interface structure containing the called function pointer.
  * @thread  RX
  */
@@ -683,19 +755,23 @@ static int vnetCanReceive(PVNETSTATE pThis)
     AssertRCReturn(rc, rc);
 
     LogFlow(("%s vnetCanReceive\n", INSTANCE(pThis)));
-    if (!(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK))
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (!vqueueIsReady(&pThis->VPCI, pThis->pRxQueue))
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (vqueueIsEmpty(&pThis->VPCI, pThis->pRxQueue))
-    {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, true);
-        rc = VERR_NET_NO_BUFFER_SPACE;
-    }
-    else
+    rc = VERR_NET_NO_BUFFER_SPACE;
+    if (pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK)
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, false);
-        rc = VINF_SUCCESS;
+        uint32_t cQueuePairsActive = ASMAtomicReadU32(&pThis->cQueuePairsActive);
+        for (uint32_t i = 0; i < cQueuePairsActive; i++)
+        {
+            PVQUEUE pRxQueue = pThis->aQueuePairs[i].pRxQueue;
+            if (!vqueueIsReady(&pThis->VPCI, pRxQueue))
+                continue;
+            if (vqueueIsEmpty(&pThis->VPCI, pRxQueue))
+                vringSetNotification(&pThis->VPCI, &pRxQueue->VRing, true);
+            else
+            {
+                vringSetNotification(&pThis->VPCI, &pRxQueue->VRing, false);
+                rc = VINF_SUCCESS;
+            }
+        }
     }
 
     LogFlow(("%s vnetCanReceive -> %Rrc\n", INSTANCE(pThis), rc));
@@ -822,6 +898,105 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
     return false;
 }
 
+/**
+ * Calculates a hash of the flow an ethernet frame belongs to.
+ *
+ * The hash is symmetric, i.e. both directions of a connection end up with the
+ * same value so the receive path can look up the queue pair the guest used to
+ * transmit the last packet of the flow.
+ *
+ * @returns Index into VNETSTATE::abFlowSteer.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         Size of the frame.
+ */
+static uint32_t vnetFlowHash(const uint8_t *pbFrame, size_t cbFrame)
+{
+    size_t   offL3 = sizeof(RTNETETHERHDR);
+    uint16_t uEtherType;
+    uint32_t uHash = 0;
+    uint8_t  bProto;
+    size_t   offL4;
+
+    if (cbFrame < offL3)
+        return 0;
+    uEtherType = RT_BE2H_U16(((PCRTNETETHERHDR)pbFrame)->EtherType);
+    if (uEtherType == RTNET_ETHERTYPE_VLAN && cbFrame >= offL3 + 4)
+    {
+        uEtherType = RT_MAKE_U16(pbFrame[offL3 + 3], pbFrame[offL3 + 2]);
+        offL3 += 4;
+    }
+
+    if (uEtherType == RTNET_ETHERTYPE_IPV4 && cbFrame >= offL3 + RTNETIPV4_MIN_LEN)
+    {
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pbFrame + offL3);
+        uHash  = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+        bProto = pIpHdr->ip_p;
+        offL4  = offL3 + pIpHdr->ip_hl * 4;
+        /* Only the first fragment has the ports. */
+        if (RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | UINT16_C(0x1fff) /* fragment offset */))
+            bProto = 0;
+    }
+    else if (uEtherType == RTNET_ETHERTYPE_IPV6 && cbFrame >= offL3 + sizeof(RTNETIPV6))
+    {
+        PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)(pbFrame + offL3);
+        for (unsigned i = 0; i < RT_ELEMENTS(pIpHdr->ip6_src.au32); i++)
+            uHash ^= pIpHdr->ip6_src.au32[i] ^ pIpHdr->ip6_dst.au32[i];
+        bProto = pIpHdr->ip6_nxt; /* Extension headers are not worth the trouble. */
+        offL4  = offL3 + sizeof(RTNETIPV6);
+    }
+    else
+        return 0;
+
+    if (   (bProto == RTNETIPV4_PROT_TCP || bProto == RTNETIPV4_PROT_UDP)
+        && cbFrame >= offL4 + 2 * sizeof(uint16_t))
+    {
+        const uint16_t *pu16Ports = (const uint16_t *)(pbFrame + offL4);
+        uHash ^= (uint32_t)pu16Ports[0] ^ (uint32_t)pu16Ports[1];
+    }
+    uHash ^= bProto;
+
+    /* Mix the bits a little as the low bits of addresses tend to be alike. */
+    uHash *= UINT32_C(0x9e3779b1);
+    return (uHash >> 24) & (VNET_FLOW_TABLE_SIZE - 1);
+}
+
+/**
+ * Selects the RX queue to place a packet in.
+ *
+ * Packets go to the queue pair the guest last transmitted a packet of the same
+ * flow on. If that queue has no buffers any other active queue with buffers is
+ * used instead of dropping the packet.
+ *
+ * @returns The RX queue, NULL if no active queue has any buffers.
+ * @param   pThis           The device state structure.
+ * @param   pvBuf           The packet.
+ * @param   cb              Size of the packet.
+ * @thread  RX
+ */
+static PVQUEUE vnetRxQueueSelect(PVNETSTATE pThis, const void *pvBuf, size_t cb)
+{
+    uint32_t cQueuePairsActive = ASMAtomicReadU32(&pThis->cQueuePairsActive);
+    uint32_t iPair = 0;
+
+    if (cQueuePairsActive > 1)
+    {
+        uint32_t idxFlow = vnetFlowHash((const uint8_t *)pvBuf, cb);
+        iPair = ASMAtomicUoReadU8(&pThis->abFlowSteer[idxFlow]);
+        if (iPair >= cQueuePairsActive)
+            iPair = idxFlow % cQueuePairsActive;
+    }
+
+    for (uint32_t i = 0; i < cQueuePairsActive; i++)
+    {
+        PVQUEUE pRxQueue = pThis->aQueuePairs[(iPair + i) % cQueuePairsActive].pRxQueue;
+        if (   vqueueIsReady(&pThis->VPCI, pRxQueue)
+            && !vqueueIsEmpty(&pThis->VPCI, pRxQueue))
+            return pRxQueue;
+    }
+
+    return NULL;
+}
+
 /**
  * Pad and store received packet.
  *
@@ -834,7 +1009,7 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
  * @param   cb              Number of bytes available in the buffer.
  * @thread  RX
  */
-static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
+static int vnetHandleRxPacket(PVNETSTATE pThis, PVQUEUE pRxQueue, const void *pvBuf, size_t cb,
                               PCPDMNETWORKGSO pGso)
 {
     VNETHDRMRX   Hdr;
@@ -888,7 +1063,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
         VQUEUEELEM elem;
         unsigned int nSeg = 0, uElemSize = 0, cbReserved = 0;
 
-        if (!vqueueGet(&pThis->VPCI, pThis->pRxQueue, &elem))
+        if (!vqueueGet(&pThis->VPCI, pRxQueue, &elem))
         {
             /*
              * @todo: It is possible to run out of RX buffers if only a few
@@ -932,7 +1107,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             uElemSize += uSize;
         }
         STAM_PROFILE_START(&pThis->StatReceiveStore, a);
-        vqueuePut(&pThis->VPCI, pThis->pRxQueue, &elem, uElemSize, cbReserved);
+        vqueuePut(&pThis->VPCI, pRxQueue, &elem, uElemSize, cbReserved);
         STAM_PROFILE_STOP(&pThis->StatReceiveStore, a);
         if (!vnetMergeableRxBuffers(pThis))
             break;
@@ -949,7 +1124,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             return rc;
         }
     }
-    vqueueSync(&pThis->VPCI, pThis->pRxQueue);
+    vqueueSync(&pThis->VPCI, pRxQueue);
     if (uOffset < cb)
     {
         Log(("%s vnetHandleRxPacket: Packet did not fit into RX queue (packet size=%u)!\n", INSTANCE(pThis), cb));
@@ -1014,8 +1189,14 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
         rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
         if (RT_SUCCESS(rc))
         {
-            rc = vnetHandleRxPacket(pThis, pvBuf, cb, pGso);
-            STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
+            PVQUEUE pRxQueue = vnetRxQueueSelect(pThis, pvBuf, cb);
+            if (pRxQueue)
+            {
+                rc = vnetHandleRxPacket(pThis, pRxQueue, pvBuf, cb, pGso);
+                STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
+            }
+            else
+                rc = VERR_NET_NO_BUFFER_SPACE;
             vnetCsRxLeave(pThis);
         }
     }
@@ -1114,10 +1295,19 @@ static DECLCALLBACK(int) vnetSetLinkState(PPDMINETWORKCONFIG pInterface, PDMNETW
     return VINF_SUCCESS;
 }
 
+static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue);
+
 static DECLCALLBACK(void) vnetQueueReceive(void *pvState, PVQUEUE pQueue)
 {
-    RT_NOREF(pQueue);
     PVNETSTATE pThis = (PVNETSTATE)pvState;
+
+    /* The third queue is the control queue unless the guest negotiated multiple queue pairs. */
+    if ((uint32_t)(pQueue - &pThis->VPCI.Queues[0]) == vnetCtlQueueIndex(pThis))
+    {
+        vnetQueueControl(pvState, pQueue);
+        return;
+    }
+
     Log(("%s Receive buffers has been added, waking up receive thread.\n", INSTANCE(pThis)));
     vnetWakeupReceive(pThis->VPCI.CTX_SUFF(pDevIns));
 }
@@ -1284,28 +1474,67 @@ static int vnetTransmitFrame(PVNETSTATE pThis, PPDMSCATTERGATHER pSgBuf, PPDMNET
     return pThis->pDrv->pfnSendBuf(pThis->pDrv, pSgBuf, false);
 }
 
-static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fOnWorkerThread)
+/**
+ * Kicks the queue pairs which were turned away while another pair held the
+ * transmit session of the driver.
+ *
+ * @param   pThis           The device state structure.
+ */
+static void vnetTransmitKickWaiting(PVNETSTATE pThis)
 {
-    /*
-     * Only one thread is allowed to transmit at a time, others should skip
-     * transmission as the packets will be picked up by the transmitting
-     * thread.
-     */
-    if (!ASMAtomicCmpXchgU32(&pThis->uIsTransmitting, 1, 0))
-        return;
+#ifndef VNET_TX_DELAY
+    uint32_t cQueuePairsActive = ASMAtomicReadU32(&pThis->cQueuePairsActive);
+    for (uint32_t i = 0; i < cQueuePairsActive; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        if (   ASMAtomicXchgBool(&pPair->fXmitRetry, false)
+            && pPair->hTxEvent != NIL_SUPSEMEVENT)
+            SUPSemEventSignal(pThis->pSupDrvSession, pPair->hTxEvent);
+    }
+#else
+    RT_NOREF(pThis); /* There is only one pair which can't turn itself away. */
+#endif
+}
+
+/**
+ * Transmits the pending packets of one queue pair.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_SUCCESS if the ring was drained or another thread is busy
+ *          transmitting on the pair.
+ * @retval  VERR_TRY_AGAIN if nothing could be transmitted for now, the pair
+ *          gets kicked by the driver (PDMINETWORKDOWN::pfnXmitPending) or by
+ *          the pair holding the transmit session.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair.
+ * @param   fOnWorkerThread Whether this is called on a worker thread, see
+ *                          PDMINETWORKUP::pfnBeginXmit.
+ */
+static int vnetTransmitPendingPackets(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
+{
+    PVQUEUE pQueue = pPair->pTxQueue;
+    int rcRet = VINF_SUCCESS;
 
     if ((pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0)
     {
         Log(("%s Ignoring transmit requests from non-existent driver (status=0x%x).\n", INSTANCE(pThis), pThis->VPCI.uStatus));
-        return;
+        return VERR_INVALID_STATE;
     }
 
     if (!pThis->fCableConnected)
     {
         Log(("%s Ignoring transmit requests while cable is disconnected.\n", INSTANCE(pThis)));
-        return;
+        return VERR_NET_DOWN;
     }
 
+    /*
+     * Only one thread is allowed to transmit on a queue at a time, others
+     * should skip transmission as the packets will be picked up by the
+     * transmitting thread.
+     */
+    if (!ASMAtomicCmpXchgU32(&pPair->uIsTransmitting, 1, 0))
+        return VINF_SUCCESS;
+
     PPDMINETWORKUP pDrv = pThis->pDrv;
     if (pDrv)
     {
@@ -1313,8 +1542,19 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
         if (rc == VERR_TRY_AGAIN)
         {
-            ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
-            return;
+            /*
+             * Nobody kicks us if another pair holds the transmit session, so ask
+             * the holder to do it. Try once more in case it finished before it
+             * could see the request.
+             */
+            ASMAtomicWriteBool(&pPair->fXmitRetry, true);
+            rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+            if (rc == VERR_TRY_AGAIN)
+            {
+                ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+                return VERR_TRY_AGAIN;
+            }
+            ASMAtomicWriteBool(&pPair->fXmitRetry, false);
         }
     }
 
@@ -1324,8 +1564,8 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
     else
         uHdrLen = sizeof(VNETHDR);
 
-    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets\n",
-          INSTANCE(pThis), vringReadAvailIndex(&pThis->VPCI, &pThis->pTxQueue->VRing) - pThis->pTxQueue->uNextAvailIndex));
+    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets on %s\n",
+          INSTANCE(pThis), vringReadAvailIndex(&pThis->VPCI, &pQueue->VRing) - pQueue->uNextAvailIndex, pPair->szTxName));
 
     vpciSetWriteLed(&pThis->VPCI, true);
 
@@ -1341,6 +1581,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         {
             Log(("%s vnetQueueTransmit: The first segment is not the header! (%u < 2 || %u != %u).\n",
                  INSTANCE(pThis), elem.nOut, elem.aSegsOut[0].cb, uHdrLen));
+            rcRet = VERR_INVALID_PARAMETER;
             break; /* For now we simply ignore the header, but it must be there anyway! */
         }
         RT_UNTRUSTED_VALIDATED_FENCE();
@@ -1361,6 +1602,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         if (pThis->pDrv && vnetReadHeader(pThis, elem.aSegsOut[0].addr, &Hdr, uSize))
         {
             RT_UNTRUSTED_VALIDATED_FENCE();
+            /* The transmit session is held by one pair at a time, so the shared counters need no atomics. */
             STAM_REL_COUNTER_INC(&pThis->StatTransmitPackets);
             STAM_PROFILE_START(&pThis->StatTransmitSend, a);
 
@@ -1385,6 +1627,12 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                     uOffset += cbSegment;
                     uSize -= cbSegment;
                 }
+
+                /* Remember the pair so that replies of this flow are received on it as well. */
+                if (ASMAtomicUoReadU32(&pThis->cQueuePairsActive) > 1)
+                    ASMAtomicUoWriteU8(&pThis->abFlowSteer[vnetFlowHash((uint8_t *)pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed)],
+                                       (uint8_t)pPair->iPair);
+
                 rc = vnetTransmitFrame(pThis, pSgBuf, pGso, &Hdr);
             }
             else
@@ -1393,6 +1641,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                 STAM_PROFILE_STOP(&pThis->StatTransmitSend, a);
                 STAM_PROFILE_ADV_STOP(&pThis->StatTransmit, a);
                 /* Stop trying to fetch TX descriptors until we get more bandwidth. */
+                rcRet = VERR_TRY_AGAIN;
                 break;
             }
 
@@ -1409,8 +1658,12 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
     vpciSetWriteLed(&pThis->VPCI, false);
 
     if (pDrv)
+    {
         pDrv->pfnEndXmit(pDrv);
-    ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
+        vnetTransmitKickWaiting(pThis);
+    }
+    ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+    return rcRet;
 }
 
 /**
@@ -1419,7 +1672,9 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
 static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterface)
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+    uint32_t cQueuePairsActive = ASMAtomicReadU32(&pThis->cQueuePairsActive);
+    for (uint32_t i = 0; i < cQueuePairsActive; i++)
+        vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[i], false /*fOnWorkerThread*/);
 }
 
 #ifdef VNET_TX_DELAY
@@ -1432,12 +1687,12 @@ static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
     {
         TMTimerStop(pThis->CTX_SUFF(pTxTimer));
         Log3(("%s vnetQueueTransmit: Got kicked with notification disabled, re-enable notification and flush TX queue\n", INSTANCE(pThis)));
-        vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
+        vnetTransmitPendingPackets(pThis, vnetQueuePairFromQueue(pThis, pQueue), false /*fOnWorkerThread*/);
         if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
             LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
+            vringSetNotification(&pThis->VPCI, &pQueue->VRing, true);
             vnetCsLeave(pThis);
         }
     }
@@ -1447,7 +1702,7 @@ static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
             LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, false);
+            vringSetNotification(&pThis->VPCI, &pQueue->VRing, false);
             TMTimerSetMicro(pThis->CTX_SUFF(pTxTimer), VNET_TX_DELAY);
             pThis->u64NanoTS = RTTimeNanoTS();
             vnetCsLeave(pThis);
@@ -1474,13 +1729,13 @@ static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void
           u32MicroDiff, pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
 
 //    Log3(("%s vnetTxTimer: Expired\n", INSTANCE(pThis)));
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+    vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
     if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
     {
         LogRel(("vnetTxTimer: Failed to enter critical section!/n"));
         return;
     }
-    vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
+    vringSetNotification(&pThis->VPCI, &pThis->aQueuePairs[0].pTxQueue->VRing, true);
     vnetCsLeave(pThis);
 }
 
@@ -1496,10 +1751,13 @@ inline void vnetDestroyTxThreadAndEvent(PVNETSTATE pThis)
 }
 #else /* !VNET_TX_DELAY */
 
+/**
+ * TX worker thread, there is one for every queue pair.
+ */
 static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 {
-    RT_NOREF(pDevIns);
-    PVNETSTATE pThis = (PVNETSTATE)pThread->pvUser;
+    PVNETSTATE     pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
     int rc = VINF_SUCCESS;
 
     if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
@@ -1507,12 +1765,25 @@ static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 
     while (pThread->enmState == PDMTHREADSTATE_RUNNING)
     {
-        rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pThis->hTxEvent, RT_INDEFINITE_WAIT);
+        rc = SUPSemEventWaitNoResume(pThis->pSupDrvSession, pPair->hTxEvent, RT_INDEFINITE_WAIT);
         if (RT_UNLIKELY(pThread->enmState != PDMTHREADSTATE_RUNNING))
             break;
-        vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/); /// @todo shouldn't it be true instead?
-        Log(("vnetTxThread: enable kicking and get to sleep\n"));
-        vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
+
+        /*
+         * The guest does not kick us for packets queued before the notification
+         * is enabled again (with event indexes it may have moved past the event
+         * index already), so check the ring once more before going to sleep.
+         * Nothing can be done when we were turned away, we get kicked later.
+         */
+        int rcXmit;
+        do
+        {
+            rcXmit = vnetTransmitPendingPackets(pThis, pPair, false /*fOnWorkerThread*/); /// @todo shouldn't it be true instead?
+            Log(("vnetTxThread: enable kicking on %s and get to sleep\n", pPair->szTxName));
+            vringSetNotification(&pThis->VPCI, &pPair->pTxQueue->VRing, true);
+        } while (   rcXmit == VINF_SUCCESS
+                 && !vqueueIsEmpty(&pThis->VPCI, pPair->pTxQueue)
+                 && pThread->enmState == PDMTHREADSTATE_RUNNING);
     }
 
     return rc;
@@ -1527,50 +1798,65 @@ static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
  */
 static DECLCALLBACK(int) vnetTxThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 {
-    RT_NOREF(pDevIns);
-    PVNETSTATE pThis = (PVNETSTATE)pThread->pvUser;
-    return SUPSemEventSignal(pThis->pSupDrvSession, pThis->hTxEvent);
+    PVNETSTATE     pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    return SUPSemEventSignal(pThis->pSupDrvSession, pPair->hTxEvent);
 }
 
 static int vnetCreateTxThreadAndEvent(PPDMDEVINS pDevIns, PVNETSTATE pThis)
 {
-    int rc = SUPSemEventCreate(pThis->pSupDrvSession, &pThis->hTxEvent);
-    if (RT_FAILURE(rc))
-        return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
-                                   N_("VNET: Failed to create SUP event semaphore"));
-    rc = PDMDevHlpThreadCreate(pDevIns, &pThis->pTxThread, pThis, vnetTxThread,
-                               vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, INSTANCE(pThis));
-    if (RT_FAILURE(rc))
-        return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
-                                   N_("VNET: Failed to create worker thread %s"), INSTANCE(pThis));
+    for (uint32_t i = 0; i < pThis->cQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+
+        int rc = SUPSemEventCreate(pThis->pSupDrvSession, &pPair->hTxEvent);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VNET: Failed to create SUP event semaphore"));
+
+        char szName[16];
+        RTStrPrintf(szName, sizeof(szName), "%sTx%u", INSTANCE(pThis), i);
+        rc = PDMDevHlpThreadCreate(pDevIns, &pPair->pTxThread, pPair, vnetTxThread,
+                                   vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, szName);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VNET: Failed to create worker thread %s"), szName);
+    }
     return VINF_SUCCESS;
 }
 
 static void vnetDestroyTxThreadAndEvent(PVNETSTATE pThis)
 {
-    if (pThis->pTxThread)
+    for (uint32_t i = 0; i < pThis->cQueuePairs; i++)
     {
-        int rcThread;
-        /* Destroy the thread. */
-        int rc = PDMR3ThreadDestroy(pThis->pTxThread, &rcThread);
-        if (RT_FAILURE(rc) || RT_FAILURE(rcThread))
-            AssertMsgFailed(("%s Failed to destroy async IO thread rc=%Rrc rcThread=%Rrc\n", __FUNCTION__, rc, rcThread));
-        pThis->pTxThread = NULL;
-    }
-    if (pThis->hTxEvent != NIL_SUPSEMEVENT)
-    {
-        SUPSemEventClose(pThis->pSupDrvSession, pThis->hTxEvent);
-        pThis->hTxEvent = NIL_SUPSEMEVENT;
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+
+        if (pPair->pTxThread)
+        {
+            int rcThread;
+            /* Destroy the thread. */
+            int rc = PDMR3ThreadDestroy(pPair->pTxThread, &rcThread);
+            if (RT_FAILURE(rc) || RT_FAILURE(rcThread))
+                AssertMsgFailed(("%s Failed to destroy async IO thread rc=%Rrc rcThread=%Rrc\n", __FUNCTION__, rc, rcThread));
+            pPair->pTxThread = NULL;
+        }
+        if (pPair->hTxEvent != NIL_SUPSEMEVENT)
+        {
+            SUPSemEventClose(pThis->pSupDrvSession, pPair->hTxEvent);
+            pPair->hTxEvent = NIL_SUPSEMEVENT;
+        }
     }
 }
 
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
+    PVNETSTATE     pThis = (PVNETSTATE)pvState;
+    PVNETQUEUEPAIR pPair = vnetQueuePairFromQueue(pThis, pQueue);
 
-    Log(("vnetQueueTransmit: disable kicking and wake up TX thread\n"));
+    Log(("vnetQueueTransmit: disable kicking and wake up TX thread of %s\n", pPair->szTxName));
     vringSetNotification(&pThis->VPCI, &pQueue->VRing, false);
-    SUPSemEventSignal(pThis->pSupDrvSession, pThis->hTxEvent);
+    if (pPair->hTxEvent != NIL_SUPSEMEVENT)
+        SUPSemEventSignal(pThis->pSupDrvSession, pPair->hTxEvent);
 }
 
 #endif /* !VNET_TX_DELAY */
@@ -1722,11 +2008,51 @@ static uint8_t vnetControlVlan(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELE
 }
 
 
+static uint8_t vnetControlMq(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
+{
+    uint16_t cPairs;
+
+    if (   !(pThis->VPCI.uGuestFeatures & VNET_F_MQ)
+        || pCtlHdr->u8Command != VNET_CTRL_CMD_MQ_VQ_PAIRS_SET
+        || pElem->nOut != 2
+        || pElem->aSegsOut[1].cb != sizeof(cPairs))
+    {
+        Log(("%s vnetControlMq: Segment layout is wrong (u8Command=%u nOut=%u cb=%u)\n",
+             INSTANCE(pThis), pCtlHdr->u8Command, pElem->nOut, pElem->aSegsOut[1].cb));
+        return VNET_ERROR;
+    }
+
+    PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns),
+                      pElem->aSegsOut[1].addr,
+                      &cPairs, sizeof(cPairs));
+
+    if (cPairs < 1 || cPairs > pThis->cQueuePairs)
+    {
+        Log(("%s vnetControlMq: Number of queue pairs is out of range (cPairs=%u)\n", INSTANCE(pThis), cPairs));
+        return VNET_ERROR;
+    }
+
+    Log(("%s vnetControlMq: Using %u queue pairs\n", INSTANCE(pThis), cPairs));
+    ASMAtomicWriteU32(&pThis->cQueuePairsActive, cPairs);
+    /* Queues may have buffers now which the receive thread does not know about yet. */
+    vnetWakeupReceive(pThis->VPCI.CTX_SUFF(pDevIns));
+    return VNET_OK;
+}
+
+
 static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 {
     PVNETSTATE pThis = (PVNETSTATE)pvState;
     uint8_t u8Ack;
     VQUEUEELEM elem;
+
+    /* The "CTL" queue is not the control queue of guests without VNET_F_MQ, ignore it. */
+    if ((uint32_t)(pQueue - &pThis->VPCI.Queues[0]) != vnetCtlQueueIndex(pThis))
+    {
+        Log(("%s vnetQueueControl: Ignoring notification of the inactive control queue.\n", INSTANCE(pThis)));
+        return;
+    }
+
     while (vqueueGet(&pThis->VPCI, pQueue, &elem))
     {
         if (elem.nOut < 1 || elem.aSegsOut[0].cb < sizeof(VNETCTLHDR))
@@ -1759,6 +2085,9 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                 case VNET_CTRL_CLS_VLAN:
                     u8Ack = vnetControlVlan(pThis, &CtlHdr, &elem);
                     break;
+                case VNET_CTRL_CLS_MQ:
+                    u8Ack = vnetControlMq(pThis, &CtlHdr, &elem);
+                    break;
                 default:
                     u8Ack = VNET_ERROR;
             }
@@ -1842,6 +2171,8 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutMem( pSSM, pThis->aVlanFilter, sizeof(pThis->aVlanFilter));
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU32( pSSM, pThis->cQueuePairsActive);
+    AssertRCReturn(rc, rc);
     Log(("%s State has been saved\n", INSTANCE(pThis)));
     return VINF_SUCCESS;
 }
@@ -1880,11 +2211,17 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
         && (uPass == 0 || !PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns)))
         LogRel(("%s: The mac address differs: config=%RTmac saved=%RTmac\n", INSTANCE(pThis), &pThis->macConfigured, &macConfigured));
 
-    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VNET_N_QUEUES);
+    uint32_t const nQueues = 2 * pThis->cQueuePairs + 1;
+    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, nQueues);
     AssertRCReturn(rc, rc);
 
     if (uPass == SSM_PASS_FINAL)
     {
+        /* Older states and states with fewer queue pairs configured only cover the first queues. */
+        AssertLogRelMsgReturn(pThis->VPCI.nQueues <= nQueues, ("nQueues=%u configured=%u\n", pThis->VPCI.nQueues, nQueues),
+                              VERR_SSM_LOAD_CONFIG_MISMATCH);
+        pThis->VPCI.nQueues = nQueues;
+
         rc = SSMR3GetMem( pSSM, pThis->config.mac.au8,
                           sizeof(pThis->config.mac));
         AssertRCReturn(rc, rc);
@@ -1909,6 +2246,18 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             rc = SSMR3GetMem(pSSM, pThis->aVlanFilter,
                              sizeof(pThis->aVlanFilter));
             AssertRCReturn(rc, rc);
+            if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MQ)
+            {
+                uint32_t cQueuePairsActive;
+                rc = SSMR3GetU32(pSSM, &cQueuePairsActive);
+                AssertRCReturn(rc, rc);
+                AssertLogRelMsgReturn(cQueuePairsActive >= 1 && cQueuePairsActive <= pThis->cQueuePairs,
+                                      ("cQueuePairsActive=%u cQueuePairs=%u\n", cQueuePairsActive, pThis->cQueuePairs),
+                                      VERR_SSM_LOAD_CONFIG_MISMATCH);
+                pThis->cQueuePairsActive = cQueuePairsActive;
+            }
+            else
+                pThis->cQueuePairsActive = 1;
         }
         else
         {
@@ -1917,6 +2266,7 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             pThis->nMacFilterEntries = 0;
             memset(pThis->aMacFilter, 0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
             memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
+            pThis->cQueuePairsActive = 1;
             if (pThis->pDrv)
                 pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv, true);
         }
@@ -2158,21 +2508,57 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
     AssertRCReturn(rc, rc);
 
+#ifndef VNET_TX_DELAY
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+    {
+        pThis->aQueuePairs[i].hTxEvent  = NIL_SUPSEMEVENT;
+        pThis->aQueuePairs[i].pTxThread = NULL;
+    }
+
+    /* The number of queue pairs determines the queue layout, so it is needed first. */
+    rc = CFGMR3QueryU32Def(pCfg, "QueuePairs", &pThis->cQueuePairs, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'QueuePairs'"));
+    if (pThis->cQueuePairs < 1 || pThis->cQueuePairs > VNET_MAX_QUEUE_PAIRS)
+        return PDMDevHlpVMSetError(pDevIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: 'QueuePairs' must be between 1 and %u"), VNET_MAX_QUEUE_PAIRS);
+#else /* VNET_TX_DELAY */
+    /* The TX timer only serves a single queue. */
+    pThis->cQueuePairs = 1;
+#endif /* VNET_TX_DELAY */
+    pThis->cQueuePairsActive = 1;
+
     /* Initialize PCI part. */
     pThis->VPCI.IBase.pfnQueryInterface    = vnetQueryInterface;
     rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance,
                        VNET_NAME_FMT, VIRTIO_NET_ID,
-                       VNET_PCI_CLASS, VNET_N_QUEUES);
-    pThis->pRxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  "RX ");
-    pThis->pTxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, "TX ");
-    pThis->pCtlQueue = vpciAddQueue(&pThis->VPCI, 16,  vnetQueueControl,  "CTL");
+                       VNET_PCI_CLASS, 2 * pThis->cQueuePairs + 1);
+    for (uint32_t i = 0; i < pThis->cQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        pPair->iPair = i;
+        RTStrPrintf(pPair->szRxName, sizeof(pPair->szRxName), "RX%u", i);
+        RTStrPrintf(pPair->szTxName, sizeof(pPair->szTxName), "TX%u", i);
+        pPair->pRxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  pPair->szRxName);
+        pPair->pTxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, pPair->szTxName);
+    }
+    /*
+     * Without VNET_F_MQ the guest uses the third queue for control messages, see
+     * vnetCtlQueueIndex(). With more than one pair that is "RX1", so such a guest
+     * sees a control queue with 256 instead of 16 entries. That only changes the
+     * size of the ring it allocates, the commands are processed one at a time.
+     */
+    Assert(pThis->cQueuePairs == 1 || pThis->VPCI.Queues[2].pfnCallback == vnetQueueReceive);
+    vpciAddQueue(&pThis->VPCI, 16, vnetQueueControl, "CTL");
+    memset((void *)pThis->abFlowSteer, VNET_FLOW_UNASSIGNED, sizeof(pThis->abFlowSteer));
 
     Log(("%s Constructing new instance\n", INSTANCE(pThis)));
 
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0" "QueuePairs\0"))
         return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES, N_("Invalid configuration for VirtioNet device"));
 
     /* Get config params */
@@ -2204,6 +2590,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     /* Initialize PCI config space */
     memcpy(pThis->config.mac.au8, pThis->macConfigured.au8, sizeof(pThis->config.mac.au8));
     pThis->config.uStatus = 0;
+    pThis->config.uMaxVirtqueuePairs = (uint16_t)pThis->cQueuePairs;
 
     /* Initialize state structure */
     pThis->u32PktNo     = 1;
@@ -2258,8 +2645,6 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
 
 #ifndef VNET_TX_DELAY
     pThis->pSupDrvSession = PDMDevHlpGetSupDrvSession(pDevIns);
-    pThis->hTxEvent       = NIL_SUPSEMEVENT;
-    pThis->pTxThread      = NULL;
 #else /* VNET_TX_DELAY */
     /* Create Transmit Delay Timer */
     rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetTxTimer, pThis,
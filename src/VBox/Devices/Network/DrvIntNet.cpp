@@ -33,6 +33,7 @@
 #include <VBox/param.h>
 #include <VBox/log.h>
 #include <iprt/asm.h>
+#include <iprt/asm-amd64-x86.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
 #include <iprt/memcache.h>
@@ -54,6 +55,11 @@
 *********************************************************************************************************************************/
 /** Enables the ring-0 part. */
 #define VBOX_WITH_DRVINTNET_IN_R0
+/** The max number of frames committed to the send ring before the switch is
+ * told about them, see DRVINTNET::cXmitPending. */
+#define DRVINTNET_XMIT_BATCH_MAX            64
+/** The receive poll time the adaptive receive polling starts out with. */
+#define DRVINTNET_RECV_POLL_START_NS        2000
 
 
 /*********************************************************************************************************************************
@@ -141,8 +147,20 @@ typedef struct DRVINTNET
     /** Set if data transmission should start immediately and deactivate
      * as late as possible. */
     bool                            fActivateEarlyDeactivateLate;
+    /** Set if sent frames are pushed thru the switch in batches. */
+    bool                            fXmitBatch;
     /** Padding. */
-    bool                            afReserved[HC_ARCH_BITS == 64 ? 3 : 3];
+    bool                            afReserved[HC_ARCH_BITS == 64 ? 2 : 2];
+    /** Number of frames committed to the send ring which the switch hasn't
+     * been told about yet.  Always accessed while owning the XmitLock. */
+    uint32_t                        cXmitPending;
+    /** The time the receive thread currently polls the ring before blocking
+     * (ns).  Adjusted by drvR3IntNetRecvAdjustPoll. */
+    uint32_t                        cNsRecvPoll;
+    /** The max receive poll time (ns), 0 if polling is disabled. */
+    uint32_t                        cNsRecvPollMax;
+    /** Alignment padding. */
+    uint32_t                        u32Padding;
     /** Scratch space for holding the ring-0 scatter / gather descriptor.
      * The PDMSCATTERGATHER::fFlags member is used to indicate whether it is in
      * use or not.  Always accessed while owning the XmitLock. */
@@ -168,6 +186,13 @@ typedef struct DRVINTNET
     STAMCOUNTER                     StatXmitWakeupR3;
     /** The times the xmit thread has been told to process the ring. */
     STAMCOUNTER                     StatXmitProcessRing;
+    /** The number of times the switch was told about new frames in the send
+     * ring, compare with Packets/Sent for the batching factor. */
+    STAMCOUNTER                     StatXmitDoorbells;
+    /** The number of times polling the receive ring avoided blocking. */
+    STAMCOUNTER                     StatRecvPollHits;
+    /** The number of times the receive thread blocked after polling. */
+    STAMCOUNTER                     StatRecvPollMisses;
 #ifdef VBOX_WITH_STATISTICS
     /** Profiling packet transmit runs. */
     STAMPROFILE                     StatTransmit;
@@ -292,6 +317,8 @@ DECLINLINE(int) drvR0IntNetSignalXmit(PDRVINTNET pThis)
 DECLINLINE(int) drvIntNetProcessXmit(PDRVINTNET pThis)
 {
     Assert(PDMCritSectIsOwner(&pThis->XmitLock));
+    pThis->cXmitPending = 0;
+    STAM_REL_COUNTER_INC(&pThis->StatXmitDoorbells);
 
 #ifdef IN_RING3
     INTNETIFSENDREQ SendReq;
@@ -504,10 +531,19 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
 
     /*
      * Commit the frame and push it thru the switch.
+     *
+     * When batching, the switch is only told about the frames when the device
+     * is done transmitting (pfnEndXmit), or when the batch or the ring fills
+     * up.  This saves a ring-0 call per frame as devices usually transmit all
+     * pending frames between pfnBeginXmit and pfnEndXmit.
      */
     PINTNETHDR pHdr = (PINTNETHDR)pSgBuf->pvAllocator;
     IntNetRingCommitFrameEx(&pThis->CTX_SUFF(pBuf)->Send, pHdr, pSgBuf->cbUsed);
-    int rc = drvIntNetProcessXmit(pThis);
+    int rc = VINF_SUCCESS;
+    if (   !pThis->fXmitBatch
+        || ++pThis->cXmitPending >= DRVINTNET_XMIT_BATCH_MAX
+        || IntNetRingGetWritable(&pThis->CTX_SUFF(pBuf)->Send) < pThis->CTX_SUFF(pBuf)->cbSend / 2)
+        rc = drvIntNetProcessXmit(pThis);
     STAM_PROFILE_STOP(&pThis->StatTransmit, a);
 
     /*
@@ -529,6 +565,8 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
 PDMBOTHCBDECL(void) drvIntNetUp_EndXmit(PPDMINETWORKUP pInterface)
 {
     PDRVINTNET pThis = RT_FROM_MEMBER(pInterface, DRVINTNET, CTX_SUFF(INetworkUp));
+    if (pThis->cXmitPending)
+        drvIntNetProcessXmit(pThis);
     ASMAtomicUoWriteBool(&pThis->fXmitOnXmitThread, false);
     PDMCritSectLeave(&pThis->XmitLock);
 }
@@ -671,6 +709,31 @@ static int drvR3IntNetRecvWaitForSpace(PDRVINTNET pThis)
 }
 
 
+/**
+ * Adjusts the receive poll time after the receive thread had to block.
+ *
+ * Polling longer would have avoided blocking if the wait was short, so the
+ * poll time is doubled.  If the wait was long, polling was a waste of CPU time
+ * and the poll time is halved (down to zero).
+ *
+ * @param   pThis       The driver instance data.
+ * @param   cNsBlocked  How long the receive thread was blocked.
+ */
+static void drvR3IntNetRecvAdjustPoll(PDRVINTNET pThis, uint64_t cNsBlocked)
+{
+    if (cNsBlocked <= pThis->cNsRecvPollMax)
+    {
+        uint32_t cNsRecvPoll = pThis->cNsRecvPoll ? pThis->cNsRecvPoll * 2 : DRVINTNET_RECV_POLL_START_NS;
+        pThis->cNsRecvPoll = RT_MIN(cNsRecvPoll, pThis->cNsRecvPollMax);
+    }
+    else if (pThis->cNsRecvPoll)
+    {
+        uint32_t cNsRecvPoll = pThis->cNsRecvPoll / 2;
+        pThis->cNsRecvPoll = cNsRecvPoll >= DRVINTNET_RECV_POLL_START_NS ? cNsRecvPoll : 0;
+    }
+}
+
+
 /**
  * Executes async I/O (RUNNING mode).
  *
@@ -842,6 +905,25 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
             }
         } /* while more received data */
 
+        /*
+         * Poll the ring for a little while before blocking, the ring-0 call
+         * and the wakeup cost more than polling when data arrives quickly.
+         */
+        if (pThis->cNsRecvPoll)
+        {
+            uint64_t const nsPollStart = RTTimeNanoTS();
+            while (   !IntNetRingHasMoreToRead(pRingBuf)
+                   && pThis->enmRecvState == RECVSTATE_RUNNING
+                   && RTTimeNanoTS() - nsPollStart < pThis->cNsRecvPoll)
+                ASMNopPause();
+            if (IntNetRingHasMoreToRead(pRingBuf))
+            {
+                STAM_REL_COUNTER_INC(&pThis->StatRecvPollHits);
+                continue;
+            }
+            STAM_REL_COUNTER_INC(&pThis->StatRecvPollMisses);
+        }
+
         /*
          * Wait for data, checking the state before we block.
          */
@@ -858,6 +940,7 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
         WaitReq.hIf          = pThis->hIf;
         WaitReq.cMillies     = 30000; /* 30s - don't wait forever, timeout now and then. */
         STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+        uint64_t const nsWaitStart = pThis->cNsRecvPollMax ? RTTimeNanoTS() : 0;
         int rc = PDMDrvHlpSUPCallVMMR0Ex(pDrvIns, VMMR0_DO_INTNET_IF_WAIT, &WaitReq, sizeof(WaitReq));
         if (    RT_FAILURE(rc)
             &&  rc != VERR_TIMEOUT
@@ -866,6 +949,8 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
             LogFlow(("drvR3IntNetRecvRun: returns %Rrc\n", rc));
             return rc;
         }
+        if (pThis->cNsRecvPollMax)
+            drvR3IntNetRecvAdjustPoll(pThis, RTTimeNanoTS() - nsWaitStart);
         STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
     }
 }
@@ -1229,6 +1314,8 @@ static DECLCALLBACK(void) drvR3IntNetDestruct(PPDMDRVINS pDrvIns)
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatYieldsNok);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatLost);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatBadFrames);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatMacLookupsHashed);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatMacLookupsScanned);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend1);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend2);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv1);
@@ -1411,6 +1498,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
                                   "|TrunkPolicyWire"
                                   "|IsService"
                                   "|IgnoreConnectFailure"
+                                  "|XmitBatch"
+                                  "|ReceivePollTime"
                                   "|Workaround1",
                                   "");
 
@@ -1627,12 +1716,16 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     AssertRCReturn(rc, rc);
 
 
-    /** @cfgm{ReceiveBufferSize, uint32_t, 318 KB}
-     * The size of the receive buffer.
+    /** @cfgm{ReceiveBufferSize, uint32_t, 318 KB or 8 GSO frames}
+     * The size of the receive buffer.  The default is scaled up to hold eight
+     * maximum sized GSO frames if the device above can receive them, 318 KB
+     * only holds a handful of those.
      */
     rc = CFGMR3QueryU32(pCfg, "ReceiveBufferSize", &OpenReq.cbRecv);
     if (rc == VERR_CFGM_VALUE_NOT_FOUND)
-        OpenReq.cbRecv = 318 * _1K ;
+        OpenReq.cbRecv = pThis->pIAboveNet->pfnReceiveGso
+                       ? RT_MAX(318 * _1K, RT_ALIGN_32(VBOX_MAX_GSO_SIZE * 8, _1K))
+                       : 318 * _1K;
     else if (RT_FAILURE(rc))
         return PDMDRV_SET_ERROR(pDrvIns, rc,
                                 N_("Configuration error: Failed to get the \"ReceiveBufferSize\" value"));
@@ -1669,6 +1762,31 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
                                 N_("Configuration error: Failed to get the \"IsService\" value"));
 
 
+    /** @cfgm{XmitBatch, boolean, true}
+     * Whether to push sent frames thru the switch in batches instead of one
+     * ring-0 call per frame.
+     */
+    rc = CFGMR3QueryBoolDef(pCfg, "XmitBatch", &pThis->fXmitBatch, true);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"XmitBatch\" value"));
+
+    /** @cfgm{ReceivePollTime, uint32_t, 50}
+     * The max time in microseconds the receive thread polls the receive ring
+     * before blocking.  The actual poll time adapts to the traffic, 0 disables
+     * polling.
+     */
+    uint32_t cUsRecvPoll;
+    rc = CFGMR3QueryU32Def(pCfg, "ReceivePollTime", &cUsRecvPoll, 50);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"ReceivePollTime\" value"));
+    if (cUsRecvPoll > 10000)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: \"ReceivePollTime\" must not exceed 10000 microseconds"));
+    pThis->cNsRecvPollMax = cUsRecvPoll * RT_NS_1US;
+    pThis->cNsRecvPoll    = 0;
+
     /** @cfgm{IgnoreConnectFailure, boolean, false}
      * When set only raise a runtime error if we cannot connect to the internal
      * network. */
@@ -1702,9 +1820,9 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     if (fWorkaround1)
         OpenReq.fFlags |= INTNET_OPEN_FLAGS_WORKAROUND_1;
 
-    LogRel(("IntNet#%u: szNetwork={%s} enmTrunkType=%d szTrunk={%s} fFlags=%#x cbRecv=%u cbSend=%u fIgnoreConnectFailure=%RTbool\n",
+    LogRel(("IntNet#%u: szNetwork={%s} enmTrunkType=%d szTrunk={%s} fFlags=%#x cbRecv=%u cbSend=%u fIgnoreConnectFailure=%RTbool fXmitBatch=%RTbool cUsRecvPoll=%u\n",
             pDrvIns->iInstance, OpenReq.szNetwork, OpenReq.enmTrunkType, OpenReq.szTrunk, OpenReq.fFlags,
-            OpenReq.cbRecv, OpenReq.cbSend, fIgnoreConnectFailure));
+            OpenReq.cbRecv, OpenReq.cbSend, fIgnoreConnectFailure, pThis->fXmitBatch, cUsRecvPoll));
 
 #ifdef RT_OS_DARWIN
     /* Temporary hack: attach to a network with the name 'if=en0' and you're hitting the wire. */
@@ -1808,6 +1926,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsNok,     "YieldOk",              "Number of times yielding helped fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsOk,      "YieldNok",             "Number of times yielding didn't help fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatBadFrames,     "BadFrames",            "Number of bad frames seed by the consumers.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatMacLookupsHashed, "MacLookupsHashed",  "Unicast destination lookups done using the MAC address hash.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatMacLookupsScanned, "MacLookupsScanned", "Unicast destination lookups which had to scan the MAC address table.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend1,          "Send1",                "Profiling IntNetR0IfSend.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend2,          "Send2",                "Profiling sending to the trunk.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatRecv1,          "Recv1",                "Reserved for future receive profiling.");
@@ -1820,6 +1940,9 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitWakeupR0,           "XmitWakeup-R0",        "Xmit thread wakeups from ring-0.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitWakeupR3,           "XmitWakeup-R3",        "Xmit thread wakeups from ring-3.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitProcessRing,        "XmitProcessRing",      "Time xmit thread was told to process the ring.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitDoorbells,          "XmitDoorbells",        "Times the switch was told about new frames in the send ring.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatRecvPollHits,           "RecvPollHits",         "Times polling the receive ring avoided blocking.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatRecvPollMisses,         "RecvPollMisses",       "Times the receive thread blocked after polling.");
 
     /*
      * Create the async I/O threads.
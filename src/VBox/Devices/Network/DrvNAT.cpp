@@ -38,6 +38,7 @@ extern "C" {
 #include <iprt/cidr.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/memcache.h>
 #include <iprt/pipe.h>
 #include <iprt/string.h>
 #include <iprt/stream.h>
@@ -135,6 +136,24 @@ do                                                      \
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+/**
+ * S/G buffer of a frame sent by the guest.
+ *
+ * These are allocated from DRVNAT::hSgCache and queued on
+ * DRVNAT::pXmitPending until the NAT thread picks them up.
+ */
+typedef struct DRVNATSGBUF
+{
+    /** The S/G buffer handed to the device, must be first. */
+    PDMSCATTERGATHER            SgBuf;
+    /** The next frame in the DRVNAT::pXmitPending list. */
+    struct DRVNATSGBUF         *pNext;
+    /** The GSO context of a GSO frame (SgBuf.pvUser points here). */
+    PDMNETWORKGSO               Gso;
+} DRVNATSGBUF;
+/** Pointer to a NAT S/G buffer. */
+typedef DRVNATSGBUF *PDRVNATSGBUF;
+
 /**
  * NAT network transport driver instance data.
  *
@@ -209,6 +228,20 @@ typedef struct DRVNAT
 
     /** Transmit lock taken by BeginXmit and released by EndXmit. */
     RTCRITSECT              XmitLock;
+    /** Cache the S/G buffers for frames sent by the guest are allocated from. */
+    RTMEMCACHE              hSgCache;
+    /** Frames sent by the guest which the NAT thread hasn't taken yet, most
+     * recent first.  Pushed by drvNATNetworkUp_SendBuf, taken by drvNATXmitFlush. */
+    PDRVNATSGBUF volatile   pXmitPending;
+    /** Set when the NAT thread must be kicked by drvNATNetworkUp_EndXmit.
+     * Only accessed while owning XmitLock. */
+    bool                    fXmitKick;
+#ifndef RT_OS_WINDOWS
+    /** The number of entries in paPolls. */
+    uint32_t                cPollsAlloc;
+    /** The poll array of the NAT thread, kept around between iterations. */
+    struct pollfd          *paPolls;
+#endif
 
     /** Request queue for the async host resolver. */
     RTREQQUEUE               hHostResQueue;
@@ -398,10 +431,9 @@ static void drvNATFreeSgBuf(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
     {
         RTMemFree(pSgBuf->aSegs[0].pvSeg);
         pSgBuf->aSegs[0].pvSeg = NULL;
-        RTMemFree(pSgBuf->pvUser);
         pSgBuf->pvUser = NULL;
     }
-    RTMemFree(pSgBuf);
+    RTMemCacheFree(pThis->hSgCache, RT_FROM_MEMBER(pSgBuf, DRVNATSGBUF, SgBuf));
 }
 
 /**
@@ -470,6 +502,42 @@ static void drvNATSendWorker(PDRVNAT pThis, PPDMSCATTERGATHER pSgBuf)
     /** @todo Implement the VERR_TRY_AGAIN drvNATNetworkUp_AllocBuf semantics. */
 }
 
+/**
+ * Feeds the frames queued by drvNATNetworkUp_SendBuf into slirp.
+ *
+ * @param   pThis               Pointer to the NAT instance.
+ * @param   fDrop               Whether to drop the frames instead (destruction).
+ * @thread  NAT
+ */
+static void drvNATXmitFlush(PDRVNAT pThis, bool fDrop)
+{
+    PDRVNATSGBUF pList = ASMAtomicXchgPtrT(&pThis->pXmitPending, NULL, PDRVNATSGBUF);
+    if (!pList)
+        return;
+
+    /* The list is LIFO, reverse it so the frames go out in the order they were sent. */
+    PDRVNATSGBUF pFifo = NULL;
+    while (pList)
+    {
+        PDRVNATSGBUF pNext = pList->pNext;
+        pList->pNext = pFifo;
+        pFifo = pList;
+        pList = pNext;
+    }
+
+    STAM_COUNTER_INC(&pThis->StatNATXmitBatches);
+    while (pFifo)
+    {
+        PDRVNATSGBUF pNext = pFifo->pNext;
+        STAM_COUNTER_INC(&pThis->StatNATXmitFrames);
+        if (!fDrop)
+            drvNATSendWorker(pThis, &pFifo->SgBuf);
+        else
+            drvNATFreeSgBuf(pThis, &pFifo->SgBuf);
+        pFifo = pNext;
+    }
+}
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
  */
@@ -507,9 +575,10 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
     /*
      * Allocate a scatter/gather buffer and an mbuf.
      */
-    PPDMSCATTERGATHER pSgBuf = (PPDMSCATTERGATHER)RTMemAlloc(sizeof(*pSgBuf));
-    if (!pSgBuf)
+    PDRVNATSGBUF pNatSgBuf = (PDRVNATSGBUF)RTMemCacheAlloc(pThis->hSgCache);
+    if (!pNatSgBuf)
         return VERR_NO_MEMORY;
+    PPDMSCATTERGATHER pSgBuf = &pNatSgBuf->SgBuf;
     if (!pGso)
     {
         /*
@@ -519,7 +588,7 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
         {
             Log(("drvNATNetowrkUp_AllocBuf: drops over-sized frame (%u bytes), returns VERR_INVALID_PARAMETER\n",
                  cbMin));
-            RTMemFree(pSgBuf);
+            RTMemCacheFree(pThis->hSgCache, pNatSgBuf);
             return VERR_INVALID_PARAMETER;
         }
 
@@ -528,7 +597,7 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
                                               &pSgBuf->aSegs[0].pvSeg, &pSgBuf->aSegs[0].cbSeg);
         if (!pSgBuf->pvAllocator)
         {
-            RTMemFree(pSgBuf);
+            RTMemCacheFree(pThis->hSgCache, pNatSgBuf);
             return VERR_TRY_AGAIN;
         }
     }
@@ -541,19 +610,18 @@ static DECLCALLBACK(int) drvNATNetworkUp_AllocBuf(PPDMINETWORKUP pInterface, siz
         {
             Log(("drvNATNetowrkUp_AllocBuf: drops over-sized frame (%u bytes), returns VERR_INVALID_PARAMETER\n",
                  pGso->cbHdrsTotal + pGso->cbMaxSeg));
-            RTMemFree(pSgBuf);
+            RTMemCacheFree(pThis->hSgCache, pNatSgBuf);
             return VERR_INVALID_PARAMETER;
         }
 
-        pSgBuf->pvUser      = RTMemDup(pGso, sizeof(*pGso));
+        pNatSgBuf->Gso      = *pGso;
+        pSgBuf->pvUser      = &pNatSgBuf->Gso;
         pSgBuf->pvAllocator = NULL;
         pSgBuf->aSegs[0].cbSeg = RT_ALIGN_Z(cbMin, 16);
         pSgBuf->aSegs[0].pvSeg = RTMemAlloc(pSgBuf->aSegs[0].cbSeg);
-        if (!pSgBuf->pvUser || !pSgBuf->aSegs[0].pvSeg)
+        if (!pSgBuf->aSegs[0].pvSeg)
         {
-            RTMemFree(pSgBuf->aSegs[0].pvSeg);
-            RTMemFree(pSgBuf->pvUser);
-            RTMemFree(pSgBuf);
+            RTMemCacheFree(pThis->hSgCache, pNatSgBuf);
             return VERR_TRY_AGAIN;
         }
     }
@@ -600,16 +668,22 @@ static DECLCALLBACK(int) drvNATNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
         /* Set an FTM checkpoint as this operation changes the state permanently. */
         PDMDrvHlpFTSetCheckpoint(pThis->pDrvIns, FTMCHECKPOINTTYPE_NETWORK);
 
-        rc = RTReqQueueCallEx(pThis->hSlirpReqQueue, NULL /*ppReq*/, 0 /*cMillies*/,
-                              RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                              (PFNRT)drvNATSendWorker, 2, pThis, pSgBuf);
-        if (RT_SUCCESS(rc))
+        /*
+         * Queue the frame for the NAT thread.  It only needs kicking when the
+         * list was empty, otherwise it has been kicked already and will take
+         * this frame along with the others.  The kick is deferred till
+         * drvNATNetworkUp_EndXmit so a burst of frames costs one wakeup.
+         */
+        PDRVNATSGBUF pNatSgBuf = RT_FROM_MEMBER(pSgBuf, DRVNATSGBUF, SgBuf);
+        PDRVNATSGBUF pHead;
+        do
         {
-            drvNATNotifyNATThread(pThis, "drvNATNetworkUp_SendBuf");
-            return VINF_SUCCESS;
-        }
-
-        rc = VERR_NET_NO_BUFFER_SPACE;
+            pHead = ASMAtomicReadPtrT(&pThis->pXmitPending, PDRVNATSGBUF);
+            pNatSgBuf->pNext = pHead;
+        } while (!ASMAtomicCmpXchgPtr(&pThis->pXmitPending, pNatSgBuf, pHead));
+        if (!pHead)
+            pThis->fXmitKick = true;
+        return VINF_SUCCESS;
     }
     else
         rc = VERR_NET_DOWN;
@@ -623,6 +697,11 @@ static DECLCALLBACK(int) drvNATNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
 static DECLCALLBACK(void) drvNATNetworkUp_EndXmit(PPDMINETWORKUP pInterface)
 {
     PDRVNAT pThis = RT_FROM_MEMBER(pInterface, DRVNAT, INetworkUp);
+    if (pThis->fXmitKick)
+    {
+        pThis->fXmitKick = false;
+        drvNATNotifyNATThread(pThis, "drvNATNetworkUp_EndXmit");
+    }
     RTCritSectLeave(&pThis->XmitLock);
 }
 
@@ -808,10 +887,17 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
          */
 #ifndef RT_OS_WINDOWS
         nFDs = slirp_get_nsock(pThis->pNATState);
-        /* allocation for all sockets + Management pipe */
-        struct pollfd *polls = (struct pollfd *)RTMemAlloc((1 + nFDs) * sizeof(struct pollfd) + sizeof(uint32_t));
-        if (polls == NULL)
-            return VERR_NO_MEMORY;
+        /* allocation for all sockets + Management pipe, only grown when needed */
+        if ((uint32_t)nFDs + 1 > pThis->cPollsAlloc)
+        {
+            uint32_t const cPollsAlloc = RT_ALIGN_32(nFDs + 1, 64);
+            struct pollfd *paPolls = (struct pollfd *)RTMemRealloc(pThis->paPolls, cPollsAlloc * sizeof(struct pollfd));
+            if (paPolls == NULL)
+                return VERR_NO_MEMORY;
+            pThis->paPolls     = paPolls;
+            pThis->cPollsAlloc = cPollsAlloc;
+        }
+        struct pollfd *polls = pThis->paPolls;
 
         /* don't pass the management pipe */
         slirp_select_fill(pThis->pNATState, &nFDs, &polls[1]);
@@ -859,9 +945,10 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
                 RTPipeRead(pThis->hPipeRead, &ch, 1, &cbRead);
             }
         }
-        /* process _all_ outstanding requests but don't wait */
+        /* feed the frames the guest sent into slirp and process _all_
+           outstanding requests but don't wait */
+        drvNATXmitFlush(pThis, false /*fDrop*/);
         RTReqQueueProcess(pThis->hSlirpReqQueue, 0);
-        RTMemFree(polls);
 
 #else /* RT_OS_WINDOWS */
         nFDs = -1;
@@ -887,7 +974,9 @@ static DECLCALLBACK(int) drvNATAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
         /* poll the sockets in any case */
         Log2(("%s: poll\n", __FUNCTION__));
         slirp_select_poll(pThis->pNATState, /* fTimeout=*/false);
-        /* process _all_ outstanding requests but don't wait */
+        /* feed the frames the guest sent into slirp and process _all_
+           outstanding requests but don't wait */
+        drvNATXmitFlush(pThis, false /*fDrop*/);
         RTReqQueueProcess(pThis->hSlirpReqQueue, 0);
 # ifdef VBOX_NAT_DELAY_HACK
         if (cBreak++ > 128)
@@ -1459,6 +1548,7 @@ static DECLCALLBACK(void) drvNATDestruct(PPDMDRVINS pDrvIns)
 
     if (pThis->pNATState)
     {
+        drvNATXmitFlush(pThis, true /*fDrop*/);
         slirp_term(pThis->pNATState);
         slirp_deregister_statistics(pThis->pNATState, pDrvIns);
 #ifdef VBOX_WITH_STATISTICS
@@ -1493,9 +1583,16 @@ static DECLCALLBACK(void) drvNATDestruct(PPDMDRVINS pDrvIns)
     if (RTCritSectIsInitialized(&pThis->XmitLock))
         RTCritSectDelete(&pThis->XmitLock);
 
+    RTMemCacheDestroy(pThis->hSgCache);
+    pThis->hSgCache = NIL_RTMEMCACHE;
+
 #ifndef RT_OS_WINDOWS
     RTPipeClose(pThis->hPipeRead);
     RTPipeClose(pThis->hPipeWrite);
+
+    RTMemFree(pThis->paPolls);
+    pThis->paPolls     = NULL;
+    pThis->cPollsAlloc = 0;
 #endif
 
 #ifdef RT_OS_DARWIN
@@ -1535,6 +1632,8 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     pThis->hHostResQueue                = NIL_RTREQQUEUE;
     pThis->EventRecv                    = NIL_RTSEMEVENT;
     pThis->EventUrgRecv                 = NIL_RTSEMEVENT;
+    pThis->hSgCache                     = NIL_RTMEMCACHE;
+    pThis->pXmitPending                 = NULL;
 #ifdef RT_OS_DARWIN
     pThis->hRunLoopSrcDnsWatcher        = NULL;
 #endif
@@ -1739,6 +1838,10 @@ static DECLCALLBACK(int) drvNATConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
             rc = RTCritSectInit(&pThis->XmitLock);
             AssertRCReturn(rc, rc);
 
+            rc = RTMemCacheCreate(&pThis->hSgCache, sizeof(DRVNATSGBUF), 0 /*cbAlignment*/, UINT32_MAX,
+                                  NULL /*pfnCtor*/, NULL /*pfnDtor*/, NULL /*pvUser*/, 0 /*fFlags*/);
+            AssertRCReturn(rc, rc);
+
             char szTmp[128];
             RTStrPrintf(szTmp, sizeof(szTmp), "nat%d", pDrvIns->iInstance);
             PDMDrvHlpDBGFInfoRegister(pDrvIns, szTmp, "NAT info.", drvNATInfo);
@@ -24,10 +24,15 @@
 #include <VBox/vmm/pdmnetifs.h>
 
 #include <VBox/log.h>
+#include <VBox/vmm/pdmnetinline.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/critsect.h>
+#include <iprt/ctype.h>
 #include <iprt/file.h>
+#include <iprt/mem.h>
 #include <iprt/process.h>
+#include <iprt/semaphore.h>
 #include <iprt/string.h>
 #include <iprt/time.h>
 #include <iprt/uuid.h>
@@ -38,9 +43,89 @@
 #include "VBoxDD.h"
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The default size of the capture ring. */
+#define DRVNETSNIFFER_RING_SIZE_DEF     (4 * _1M)
+/** The max number of filter instructions. */
+#define DRVNETSNIFFER_FILTER_MAX_INSNS  4096
+/** The number of scratch memory words available to filter programs. */
+#define DRVNETSNIFFER_FILTER_MEMWORDS   16
+
+/** @name Classic BPF instruction encoding, as printed by "tcpdump -ddd".
+ * @{ */
+#define NETSNIFF_BPF_CLASS(a_uCode)     ((a_uCode) & 0x07)
+#define NETSNIFF_BPF_LD                 0x00
+#define NETSNIFF_BPF_LDX                0x01
+#define NETSNIFF_BPF_ST                 0x02
+#define NETSNIFF_BPF_STX                0x03
+#define NETSNIFF_BPF_ALU                0x04
+#define NETSNIFF_BPF_JMP                0x05
+#define NETSNIFF_BPF_RET                0x06
+#define NETSNIFF_BPF_MISC               0x07
+
+#define NETSNIFF_BPF_SIZE(a_uCode)      ((a_uCode) & 0x18)
+#define NETSNIFF_BPF_W                  0x00
+#define NETSNIFF_BPF_H                  0x08
+#define NETSNIFF_BPF_B                  0x10
+#define NETSNIFF_BPF_MODE(a_uCode)      ((a_uCode) & 0xe0)
+#define NETSNIFF_BPF_IMM                0x00
+#define NETSNIFF_BPF_ABS                0x20
+#define NETSNIFF_BPF_IND                0x40
+#define NETSNIFF_BPF_MEM                0x60
+#define NETSNIFF_BPF_LEN                0x80
+#define NETSNIFF_BPF_MSH                0xa0
+
+#define NETSNIFF_BPF_OP(a_uCode)        ((a_uCode) & 0xf0)
+#define NETSNIFF_BPF_ADD                0x00
+#define NETSNIFF_BPF_SUB                0x10
+#define NETSNIFF_BPF_MUL                0x20
+#define NETSNIFF_BPF_DIV                0x30
+#define NETSNIFF_BPF_OR                 0x40
+#define NETSNIFF_BPF_AND                0x50
+#define NETSNIFF_BPF_LSH                0x60
+#define NETSNIFF_BPF_RSH                0x70
+#define NETSNIFF_BPF_NEG                0x80
+#define NETSNIFF_BPF_MOD                0x90
+#define NETSNIFF_BPF_XOR                0xa0
+#define NETSNIFF_BPF_JA                 0x00
+#define NETSNIFF_BPF_JEQ                0x10
+#define NETSNIFF_BPF_JGT                0x20
+#define NETSNIFF_BPF_JGE                0x30
+#define NETSNIFF_BPF_JSET               0x40
+#define NETSNIFF_BPF_SRC(a_uCode)       ((a_uCode) & 0x08)
+#define NETSNIFF_BPF_K                  0x00
+#define NETSNIFF_BPF_X                  0x08
+#define NETSNIFF_BPF_RVAL(a_uCode)      ((a_uCode) & 0x18)
+#define NETSNIFF_BPF_A                  0x10
+#define NETSNIFF_BPF_MISCOP(a_uCode)    ((a_uCode) & 0xf8)
+#define NETSNIFF_BPF_TAX                0x00
+#define NETSNIFF_BPF_TXA                0x80
+/** @} */
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+/**
+ * A classic BPF filter instruction.
+ */
+typedef struct DRVNETSNIFFERBPFINSN
+{
+    /** The opcode. */
+    uint16_t                uCode;
+    /** Relative jump target if the condition is true. */
+    uint8_t                 offTrue;
+    /** Relative jump target if the condition is false. */
+    uint8_t                 offFalse;
+    /** The constant operand. */
+    uint32_t                uK;
+} DRVNETSNIFFERBPFINSN;
+/** Pointer to a const filter instruction. */
+typedef DRVNETSNIFFERBPFINSN const *PCDRVNETSNIFFERBPFINSN;
+
+
 /**
  * Block driver instance data.
  *
@@ -67,7 +152,7 @@ typedef struct DRVNETSNIFFER
     char                    szFilename[RTPATH_MAX];
     /** The filehandle. */
     RTFILE                  hFile;
-    /** The lock serializing the file access. */
+    /** The lock serializing the producers of the capture ring. */
     RTCRITSECT              Lock;
     /** The NanoTS delta we pass to the pcap writers. */
     uint64_t                StartNanoTS;
@@ -76,10 +161,566 @@ typedef struct DRVNETSNIFFER
     /** For when we're the leaf driver. */
     RTCRITSECT              XmitLock;
 
+    /** Whether we're writing pcapng rather than libpcap records. */
+    bool                    fPcapNg;
+    /** Set by the writer thread when it's about to wait for work. */
+    bool volatile           fWriterSleeping;
+    /** The max number of bytes to capture of each frame. */
+    uint32_t                cbSnapLen;
+    /** The capture ring holding records in file format (cbRing bytes). */
+    uint8_t                *pbRing;
+    /** The size of the capture ring, power of two. */
+    uint32_t                cbRing;
+    /** The free running producer offset, updated while owning Lock. */
+    uint32_t volatile       offRingHead;
+    /** The free running consumer offset, updated by the writer thread. */
+    uint32_t volatile       offRingTail;
+    /** The writer thread draining the capture ring into the file. */
+    PPDMTHREAD              pWriterThread;
+    /** Event semaphore the writer thread waits on. */
+    RTSEMEVENT              hEvtWriter;
+
+    /** Number of instructions in the filter program, 0 if none. */
+    uint32_t                cFilterInsns;
+    /** The filter program (RTMemAlloc), validated by drvNetSnifferFilterCompile. */
+    DRVNETSNIFFERBPFINSN   *paFilterInsns;
+
+    /** Number of frames put into the capture ring. */
+    STAMCOUNTER             StatFramesCaptured;
+    /** Number of frames dropped because the capture ring was full. */
+    STAMCOUNTER             StatFramesDropped;
+    /** Number of frames rejected by the filter. */
+    STAMCOUNTER             StatFramesFiltered;
+    /** Number of bytes written to the file by the writer thread. */
+    STAMCOUNTER             StatBytesWritten;
 } DRVNETSNIFFER, *PDRVNETSNIFFER;
 
 
 
+/**
+ * Loads a big endian value from the frame for the filter program.
+ *
+ * @returns true on success, false if out of bounds.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The number of frame bytes available.
+ * @param   off             The offset of the value.
+ * @param   uSize           NETSNIFF_BPF_W, NETSNIFF_BPF_H or NETSNIFF_BPF_B.
+ * @param   puValue         Where to return the value.
+ */
+DECLINLINE(bool) drvNetSnifferFilterLoad(uint8_t const *pbFrame, size_t cbFrame, uint64_t off, uint16_t uSize, uint32_t *puValue)
+{
+    size_t const cb = uSize == NETSNIFF_BPF_W ? 4 : uSize == NETSNIFF_BPF_H ? 2 : 1;
+    if (RT_UNLIKELY(off + cb > cbFrame))
+        return false;
+    pbFrame += off;
+    switch (cb)
+    {
+        case 4:  *puValue = RT_MAKE_U32_FROM_U8(pbFrame[3], pbFrame[2], pbFrame[1], pbFrame[0]); break;
+        case 2:  *puValue = RT_MAKE_U16(pbFrame[1], pbFrame[0]); break;
+        default: *puValue = pbFrame[0]; break;
+    }
+    return true;
+}
+
+
+/**
+ * Runs the filter program on a frame.
+ *
+ * The program was validated by drvNetSnifferFilterCompile, so all jumps stay
+ * within the program, memory indexes are in range and it ends with a return.
+ *
+ * @returns The number of bytes to capture, 0 if the frame should be skipped.
+ * @param   paInsns         The filter program.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The number of frame bytes available.
+ * @param   cbWire          The size of the frame on the wire.
+ */
+static uint32_t drvNetSnifferFilterRun(PCDRVNETSNIFFERBPFINSN paInsns, uint8_t const *pbFrame, size_t cbFrame, size_t cbWire)
+{
+    uint32_t uA = 0;
+    uint32_t uX = 0;
+    uint32_t auMem[DRVNETSNIFFER_FILTER_MEMWORDS];
+    RT_ZERO(auMem);
+
+    for (PCDRVNETSNIFFERBPFINSN pInsn = paInsns; ; pInsn++)
+    {
+        uint16_t const uCode = pInsn->uCode;
+        uint32_t const uK    = pInsn->uK;
+        switch (NETSNIFF_BPF_CLASS(uCode))
+        {
+            case NETSNIFF_BPF_LD:
+            case NETSNIFF_BPF_LDX:
+            {
+                uint32_t uValue;
+                switch (NETSNIFF_BPF_MODE(uCode))
+                {
+                    case NETSNIFF_BPF_IMM: uValue = uK; break;
+                    case NETSNIFF_BPF_LEN: uValue = (uint32_t)cbWire; break;
+                    case NETSNIFF_BPF_MEM: uValue = auMem[uK]; break;
+                    case NETSNIFF_BPF_ABS:
+                        if (!drvNetSnifferFilterLoad(pbFrame, cbFrame, uK, NETSNIFF_BPF_SIZE(uCode), &uValue))
+                            return 0;
+                        break;
+                    case NETSNIFF_BPF_IND:
+                        if (!drvNetSnifferFilterLoad(pbFrame, cbFrame, (uint64_t)uK + uX, NETSNIFF_BPF_SIZE(uCode), &uValue))
+                            return 0;
+                        break;
+                    default: /* NETSNIFF_BPF_MSH */
+                        if (!drvNetSnifferFilterLoad(pbFrame, cbFrame, uK, NETSNIFF_BPF_B, &uValue))
+                            return 0;
+                        uValue = (uValue & 0xf) << 2;
+                        break;
+                }
+                if (NETSNIFF_BPF_CLASS(uCode) == NETSNIFF_BPF_LD)
+                    uA = uValue;
+                else
+                    uX = uValue;
+                break;
+            }
+
+            case NETSNIFF_BPF_ST:
+                auMem[uK] = uA;
+                break;
+
+            case NETSNIFF_BPF_STX:
+                auMem[uK] = uX;
+                break;
+
+            case NETSNIFF_BPF_ALU:
+            {
+                uint32_t const uSrc = NETSNIFF_BPF_SRC(uCode) == NETSNIFF_BPF_X ? uX : uK;
+                switch (NETSNIFF_BPF_OP(uCode))
+                {
+                    case NETSNIFF_BPF_ADD: uA += uSrc; break;
+                    case NETSNIFF_BPF_SUB: uA -= uSrc; break;
+                    case NETSNIFF_BPF_MUL: uA *= uSrc; break;
+                    case NETSNIFF_BPF_DIV:
+                        if (!uSrc)
+                            return 0;
+                        uA /= uSrc;
+                        break;
+                    case NETSNIFF_BPF_MOD:
+                        if (!uSrc)
+                            return 0;
+                        uA %= uSrc;
+                        break;
+                    case NETSNIFF_BPF_OR:  uA |= uSrc; break;
+                    case NETSNIFF_BPF_AND: uA &= uSrc; break;
+                    case NETSNIFF_BPF_XOR: uA ^= uSrc; break;
+                    case NETSNIFF_BPF_LSH: uA = uSrc < 32 ? uA << uSrc : 0; break;
+                    case NETSNIFF_BPF_RSH: uA = uSrc < 32 ? uA >> uSrc : 0; break;
+                    default: /* NETSNIFF_BPF_NEG */
+                        uA = (uint32_t)-(int32_t)uA;
+                        break;
+                }
+                break;
+            }
+
+            case NETSNIFF_BPF_JMP:
+            {
+                uint32_t const uSrc = NETSNIFF_BPF_SRC(uCode) == NETSNIFF_BPF_X ? uX : uK;
+                bool fTaken;
+                switch (NETSNIFF_BPF_OP(uCode))
+                {
+                    case NETSNIFF_BPF_JA:
+                        pInsn += uK;
+                        continue;
+                    case NETSNIFF_BPF_JEQ: fTaken = uA == uSrc; break;
+                    case NETSNIFF_BPF_JGT: fTaken = uA >  uSrc; break;
+                    case NETSNIFF_BPF_JGE: fTaken = uA >= uSrc; break;
+                    default: /* NETSNIFF_BPF_JSET */
+                        fTaken = (uA & uSrc) != 0;
+                        break;
+                }
+                pInsn += fTaken ? pInsn->offTrue : pInsn->offFalse;
+                break;
+            }
+
+            case NETSNIFF_BPF_RET:
+                return NETSNIFF_BPF_RVAL(uCode) == NETSNIFF_BPF_A ? uA : uK;
+
+            default: /* NETSNIFF_BPF_MISC */
+                if (NETSNIFF_BPF_MISCOP(uCode) == NETSNIFF_BPF_TAX)
+                    uX = uA;
+                else
+                    uA = uX;
+                break;
+        }
+    }
+}
+
+
+/**
+ * Checks that a filter instruction is one we know and that it cannot make the
+ * program leave its bounds.
+ *
+ * @returns true if valid, false if not.
+ * @param   pInsn           The instruction.
+ * @param   cInsnsLeft      The number of instructions following it.
+ */
+static bool drvNetSnifferFilterIsValidInsn(PCDRVNETSNIFFERBPFINSN pInsn, uint32_t cInsnsLeft)
+{
+    uint16_t const uCode = pInsn->uCode;
+    if (uCode > 0xff)
+        return false;
+    switch (NETSNIFF_BPF_CLASS(uCode))
+    {
+        case NETSNIFF_BPF_LD:
+        case NETSNIFF_BPF_LDX:
+            switch (NETSNIFF_BPF_MODE(uCode))
+            {
+                case NETSNIFF_BPF_IMM:
+                case NETSNIFF_BPF_LEN:
+                    return NETSNIFF_BPF_SIZE(uCode) == NETSNIFF_BPF_W;
+                case NETSNIFF_BPF_MEM:
+                    return NETSNIFF_BPF_SIZE(uCode) == NETSNIFF_BPF_W
+                        && pInsn->uK < DRVNETSNIFFER_FILTER_MEMWORDS;
+                case NETSNIFF_BPF_ABS:
+                case NETSNIFF_BPF_IND:
+                    return NETSNIFF_BPF_CLASS(uCode) == NETSNIFF_BPF_LD
+                        && NETSNIFF_BPF_SIZE(uCode) != 0x18;
+                case NETSNIFF_BPF_MSH:
+                    return uCode == (NETSNIFF_BPF_LDX | NETSNIFF_BPF_B | NETSNIFF_BPF_MSH);
+                default:
+                    return false;
+            }
+
+        case NETSNIFF_BPF_ST:
+        case NETSNIFF_BPF_STX:
+            return uCode == NETSNIFF_BPF_CLASS(uCode)
+                && pInsn->uK < DRVNETSNIFFER_FILTER_MEMWORDS;
+
+        case NETSNIFF_BPF_ALU:
+            if (NETSNIFF_BPF_OP(uCode) == NETSNIFF_BPF_NEG)
+                return uCode == (NETSNIFF_BPF_ALU | NETSNIFF_BPF_NEG);
+            if (NETSNIFF_BPF_OP(uCode) > NETSNIFF_BPF_XOR)
+                return false;
+            return (uCode & ~(NETSNIFF_BPF_ALU | 0xf0 | NETSNIFF_BPF_X)) == 0;
+
+        case NETSNIFF_BPF_JMP:
+            if (uCode & ~(NETSNIFF_BPF_JMP | 0xf0 | NETSNIFF_BPF_X))
+                return false;
+            if (NETSNIFF_BPF_OP(uCode) == NETSNIFF_BPF_JA)
+                return uCode == (NETSNIFF_BPF_JMP | NETSNIFF_BPF_JA)
+                    && pInsn->uK < cInsnsLeft;
+            return NETSNIFF_BPF_OP(uCode) <= NETSNIFF_BPF_JSET
+                && pInsn->offTrue  < cInsnsLeft
+                && pInsn->offFalse < cInsnsLeft;
+
+        case NETSNIFF_BPF_RET:
+            return uCode == (NETSNIFF_BPF_RET | NETSNIFF_BPF_K)
+                || uCode == (NETSNIFF_BPF_RET | NETSNIFF_BPF_A);
+
+        default: /* NETSNIFF_BPF_MISC */
+            return uCode == (NETSNIFF_BPF_MISC | NETSNIFF_BPF_TAX)
+                || uCode == (NETSNIFF_BPF_MISC | NETSNIFF_BPF_TXA);
+    }
+}
+
+
+/**
+ * Parses the next number of a filter program string.
+ *
+ * @returns true if a number was parsed, false if not.
+ * @param   ppsz            The string cursor, advanced.
+ * @param   puValue         Where to return the number.
+ */
+static bool drvNetSnifferFilterParseNumber(const char **ppsz, uint32_t *puValue)
+{
+    const char *psz = *ppsz;
+    while (RT_C_IS_SPACE(*psz) || *psz == ',' || *psz == ';')
+        psz++;
+    char *pszNext;
+    int rc = RTStrToUInt32Ex(psz, &pszNext, 0, puValue);
+    if (rc != VINF_SUCCESS && rc != VWRN_TRAILING_CHARS)
+        return false;
+    *ppsz = pszNext;
+    return true;
+}
+
+
+/**
+ * Compiles the filter program.
+ *
+ * The program is a classic BPF program in the decimal format printed by
+ * "tcpdump -ddd <expression>": the instruction count followed by four numbers
+ * (code, jt, jf, k) for each instruction, separated by white space, commas or
+ * semicolons.  Like with libpcap, the value returned by the program is the
+ * number of bytes to capture, zero meaning the frame is skipped.
+ *
+ * @returns VBox status code.
+ * @param   pDrvIns         The driver instance.
+ * @param   pThis           The sniffer instance data.
+ * @param   pszFilter       The filter program string.
+ */
+static int drvNetSnifferFilterCompile(PPDMDRVINS pDrvIns, PDRVNETSNIFFER pThis, const char *pszFilter)
+{
+    const char *psz = pszFilter;
+    uint32_t    cInsns;
+    if (   !drvNetSnifferFilterParseNumber(&psz, &cInsns)
+        || cInsns == 0
+        || cInsns > DRVNETSNIFFER_FILTER_MAX_INSNS)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NetSniffer: The filter must start with an instruction count between 1 and %u"),
+                                   DRVNETSNIFFER_FILTER_MAX_INSNS);
+
+    DRVNETSNIFFERBPFINSN *paInsns = (DRVNETSNIFFERBPFINSN *)RTMemAllocZ(cInsns * sizeof(paInsns[0]));
+    if (!paInsns)
+        return VERR_NO_MEMORY;
+
+    for (uint32_t i = 0; i < cInsns; i++)
+    {
+        uint32_t uCode, uTrue, uFalse, uK;
+        if (   !drvNetSnifferFilterParseNumber(&psz, &uCode)
+            || !drvNetSnifferFilterParseNumber(&psz, &uTrue)
+            || !drvNetSnifferFilterParseNumber(&psz, &uFalse)
+            || !drvNetSnifferFilterParseNumber(&psz, &uK)
+            || uCode > UINT16_MAX
+            || uTrue > UINT8_MAX
+            || uFalse > UINT8_MAX)
+        {
+            RTMemFree(paInsns);
+            return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                       N_("NetSniffer: Malformed filter instruction #%u"), i);
+        }
+        paInsns[i].uCode    = (uint16_t)uCode;
+        paInsns[i].offTrue  = (uint8_t)uTrue;
+        paInsns[i].offFalse = (uint8_t)uFalse;
+        paInsns[i].uK       = uK;
+        if (   !drvNetSnifferFilterIsValidInsn(&paInsns[i], cInsns - i - 1)
+            || (   i == cInsns - 1
+                && NETSNIFF_BPF_CLASS(uCode) != NETSNIFF_BPF_RET))
+        {
+            RTMemFree(paInsns);
+            return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                       N_("NetSniffer: Invalid filter instruction #%u (code %#x)"), i, uCode);
+        }
+    }
+
+    while (RT_C_IS_SPACE(*psz) || *psz == ',' || *psz == ';')
+        psz++;
+    if (*psz)
+    {
+        RTMemFree(paInsns);
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NetSniffer: Trailing garbage after the %u filter instructions"), cInsns);
+    }
+
+    pThis->paFilterInsns = paInsns;
+    pThis->cFilterInsns  = cInsns;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Applies the filter and snap length to a frame.
+ *
+ * @returns The max number of bytes to capture, 0 if the frame is skipped.
+ * @param   pThis           The sniffer instance data.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The number of frame bytes available.
+ * @param   cbWire          The size of the frame on the wire.
+ */
+DECLINLINE(size_t) drvNetSnifferFilter(PDRVNETSNIFFER pThis, uint8_t const *pbFrame, size_t cbFrame, size_t cbWire)
+{
+    if (!pThis->cFilterInsns)
+        return pThis->cbSnapLen;
+    uint32_t cbMax = drvNetSnifferFilterRun(pThis->paFilterInsns, pbFrame, cbFrame, cbWire);
+    if (!cbMax)
+    {
+        STAM_REL_COUNTER_INC(&pThis->StatFramesFiltered);
+        return 0;
+    }
+    return RT_MIN(cbMax, pThis->cbSnapLen);
+}
+
+
+/**
+ * Copies data into the capture ring, wrapping around at the end.
+ *
+ * @returns The new producer offset.
+ * @param   pThis           The sniffer instance data.
+ * @param   off             The free running producer offset.
+ * @param   pv              The data.
+ * @param   cb              The number of bytes to copy.
+ */
+DECLINLINE(uint32_t) drvNetSnifferRingCopy(PDRVNETSNIFFER pThis, uint32_t off, const void *pv, size_t cb)
+{
+    if (cb)
+    {
+        uint32_t const offPhys = off & (pThis->cbRing - 1);
+        size_t const   cbFirst = RT_MIN(cb, pThis->cbRing - offPhys);
+        memcpy(&pThis->pbRing[offPhys], pv, cbFirst);
+        if (cbFirst < cb)
+            memcpy(pThis->pbRing, (uint8_t const *)pv + cbFirst, cb - cbFirst);
+    }
+    return off + (uint32_t)cb;
+}
+
+
+/**
+ * Puts a frame record into the capture ring and wakes up the writer.
+ *
+ * The frame consists of headers and payload so GSO segments can be recorded
+ * without assembling them first.  The frame is dropped if the ring is full.
+ *
+ * @param   pThis           The sniffer instance data.
+ * @param   u64TS           The timestamp of the frame.
+ * @param   fEpbFlags       The pcapng direction flags, PCAPNG_EPB_FLAGS_XXX.
+ * @param   pvHdrs          The frame headers, optional.
+ * @param   cbHdrs          The size of the frame headers.
+ * @param   pvPayload       The frame payload.
+ * @param   cbPayload       The size of the frame payload.
+ * @param   cbMax           The max number of bytes to capture.
+ */
+static void drvNetSnifferCaptureFrame(PDRVNETSNIFFER pThis, uint64_t u64TS, uint32_t fEpbFlags,
+                                      const void *pvHdrs, size_t cbHdrs, const void *pvPayload, size_t cbPayload,
+                                      size_t cbMax)
+{
+    size_t const cbFrame = cbHdrs + cbPayload;
+    size_t const cbIncl  = RT_MIN(cbFrame, cbMax);
+    uint8_t      abHdr[PCAP_REC_HDR_MAX];
+    uint8_t      abTrailer[PCAP_REC_TRAILER_MAX];
+    size_t       cbHdr;
+    size_t       cbTrailer = 0;
+    if (pThis->fPcapNg)
+    {
+        cbHdr     = PcapNgRecHdr(abHdr, 0 /*idIf*/, u64TS, cbFrame, cbIncl);
+        cbTrailer = PcapNgRecTrailer(abTrailer, cbIncl, fEpbFlags);
+    }
+    else
+        cbHdr = PcapRecHdr(abHdr, u64TS, cbFrame, cbIncl);
+    size_t const cbInclHdrs = RT_MIN(cbIncl, cbHdrs);
+    size_t const cbRecord   = cbHdr + cbIncl + cbTrailer;
+
+    RTCritSectEnter(&pThis->Lock);
+    uint32_t off = pThis->offRingHead;
+    if (cbRecord <= pThis->cbRing - (off - ASMAtomicReadU32(&pThis->offRingTail)))
+    {
+        off = drvNetSnifferRingCopy(pThis, off, abHdr, cbHdr);
+        off = drvNetSnifferRingCopy(pThis, off, pvHdrs, cbInclHdrs);
+        off = drvNetSnifferRingCopy(pThis, off, pvPayload, cbIncl - cbInclHdrs);
+        off = drvNetSnifferRingCopy(pThis, off, abTrailer, cbTrailer);
+        ASMAtomicWriteU32(&pThis->offRingHead, off);
+        RTCritSectLeave(&pThis->Lock);
+
+        STAM_REL_COUNTER_INC(&pThis->StatFramesCaptured);
+        if (ASMAtomicReadBool(&pThis->fWriterSleeping))
+            RTSemEventSignal(pThis->hEvtWriter);
+    }
+    else
+    {
+        RTCritSectLeave(&pThis->Lock);
+        STAM_REL_COUNTER_INC(&pThis->StatFramesDropped);
+    }
+}
+
+
+/**
+ * Captures a frame (or the segments of a GSO frame) passing through.
+ *
+ * @param   pThis           The sniffer instance data.
+ * @param   fEpbFlags       The pcapng direction flags, PCAPNG_EPB_FLAGS_XXX.
+ * @param   pGso            The GSO context, NULL if not a GSO frame.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The number of frame bytes available.
+ * @param   cbWire          The size of the frame.
+ */
+static void drvNetSnifferCapture(PDRVNETSNIFFER pThis, uint32_t fEpbFlags, PCPDMNETWORKGSO pGso,
+                                 uint8_t const *pbFrame, size_t cbFrame, size_t cbWire)
+{
+    size_t const cbMax = drvNetSnifferFilter(pThis, pbFrame, cbFrame, cbWire);
+    if (!cbMax)
+        return;
+
+    uint64_t const u64TS = RTTimeNanoTS() - pThis->StartNanoTS;
+    if (!pGso)
+        drvNetSnifferCaptureFrame(pThis, u64TS, fEpbFlags, NULL, 0, pbFrame, cbWire, RT_MIN(cbMax, cbFrame));
+    else
+    {
+        uint8_t         abHdrs[256];
+        uint32_t const  cSegs = PDMNetGsoCalcSegmentCount(pGso, cbWire);
+        for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+        {
+            uint32_t cbSegPayload, cbHdrs;
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(pGso, pbFrame, cbWire, iSeg, cSegs, abHdrs, &cbHdrs, &cbSegPayload);
+            drvNetSnifferCaptureFrame(pThis, u64TS, fEpbFlags, abHdrs, cbHdrs, pbFrame + offSegPayload, cbSegPayload, cbMax);
+        }
+    }
+}
+
+
+/**
+ * Writes the records in the capture ring to the file.
+ *
+ * @returns true if anything was written, false if the ring was empty.
+ * @param   pThis           The sniffer instance data.
+ * @thread  The writer thread, or the destructor after it has stopped.
+ */
+static bool drvNetSnifferRingFlush(PDRVNETSNIFFER pThis)
+{
+    uint32_t const offHead = ASMAtomicReadU32(&pThis->offRingHead);
+    uint32_t       offTail = pThis->offRingTail;
+    if (offHead == offTail)
+        return false;
+
+    while (offTail != offHead)
+    {
+        uint32_t const offPhys = offTail & (pThis->cbRing - 1);
+        uint32_t const cb      = RT_MIN(offHead - offTail, pThis->cbRing - offPhys);
+        int rc = RTFileWrite(pThis->hFile, &pThis->pbRing[offPhys], cb, NULL);
+        if (RT_SUCCESS(rc))
+            STAM_REL_COUNTER_ADD(&pThis->StatBytesWritten, cb);
+        else
+            LogRelMax(10, ("NetSniffer#%u: Writing to '%s' failed: %Rrc\n", pThis->pDrvIns->iInstance, pThis->szFilename, rc));
+        offTail += cb;
+    }
+
+    ASMAtomicWriteU32(&pThis->offRingTail, offTail);
+    return true;
+}
+
+
+/**
+ * @callback_method_impl{FNPDMTHREADDRV, Drains the capture ring.}
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        if (drvNetSnifferRingFlush(pThis))
+            continue;
+
+        ASMAtomicWriteBool(&pThis->fWriterSleeping, true);
+        if (   ASMAtomicReadU32(&pThis->offRingHead) == pThis->offRingTail
+            && pThread->enmState == PDMTHREADSTATE_RUNNING)
+            RTSemEventWait(pThis->hEvtWriter, RT_INDEFINITE_WAIT);
+        ASMAtomicWriteBool(&pThis->fWriterSleeping, false);
+    }
+
+    /* Write out what's left so the file is complete while we're suspended. */
+    drvNetSnifferRingFlush(pThis);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDRV}
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    RT_NOREF(pThread);
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+    return RTSemEventSignal(pThis->hEvtWriter);
+}
+
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
  */
@@ -132,18 +773,10 @@ static DECLCALLBACK(int) drvNetSnifferUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
         return VERR_NET_DOWN;
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    if (!pSgBuf->pvUser)
-        PcapFileFrame(pThis->hFile, pThis->StartNanoTS,
-                      pSgBuf->aSegs[0].pvSeg,
-                      pSgBuf->cbUsed,
-                      RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    else
-        PcapFileGsoFrame(pThis->hFile, pThis->StartNanoTS, (PCPDMNETWORKGSO)pSgBuf->pvUser,
-                         pSgBuf->aSegs[0].pvSeg,
-                         pSgBuf->cbUsed,
-                         RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    RTCritSectLeave(&pThis->Lock);
+    drvNetSnifferCapture(pThis, PCAPNG_EPB_FLAGS_OUTBOUND, (PCPDMNETWORKGSO)pSgBuf->pvUser,
+                         (uint8_t const *)pSgBuf->aSegs[0].pvSeg,
+                         RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg),
+                         pSgBuf->cbUsed);
 
     return pThis->pIBelowNet->pfnSendBuf(pThis->pIBelowNet, pSgBuf, fOnWorkerThread);
 }
@@ -205,9 +838,7 @@ static DECLCALLBACK(int) drvNetSnifferDown_Receive(PPDMINETWORKDOWN pInterface,
     PDRVNETSNIFFER pThis = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkDown);
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    PcapFileFrame(pThis->hFile, pThis->StartNanoTS, pvBuf, cb, cb);
-    RTCritSectLeave(&pThis->Lock);
+    drvNetSnifferCapture(pThis, PCAPNG_EPB_FLAGS_INBOUND, NULL, (uint8_t const *)pvBuf, cb, cb);
 
     /* pass up */
     int rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvBuf, cb);
@@ -353,6 +984,37 @@ static DECLCALLBACK(void) drvNetSnifferDestruct(PPDMDRVINS pDrvIns)
     PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
     PDMDRV_CHECK_VERSIONS_RETURN_VOID(pDrvIns);
 
+    /*
+     * Stop the writer and write out whatever is left in the ring.
+     */
+    if (pThis->pWriterThread)
+    {
+        int rc = PDMR3ThreadDestroy(pThis->pWriterThread, NULL);
+        AssertRC(rc);
+        pThis->pWriterThread = NULL;
+    }
+
+    if (pThis->pbRing)
+    {
+        if (pThis->hFile != NIL_RTFILE)
+            drvNetSnifferRingFlush(pThis);
+        if (pThis->StatFramesDropped.c)
+            LogRel(("NetSniffer#%u: %RU64 frames were dropped because the capture ring was full\n",
+                    pDrvIns->iInstance, pThis->StatFramesDropped.c));
+        RTMemFree(pThis->pbRing);
+        pThis->pbRing = NULL;
+    }
+
+    if (pThis->hEvtWriter != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hEvtWriter);
+        pThis->hEvtWriter = NIL_RTSEMEVENT;
+    }
+
+    RTMemFree(pThis->paFilterInsns);
+    pThis->paFilterInsns = NULL;
+    pThis->cFilterInsns  = 0;
+
     if (RTCritSectIsInitialized(&pThis->Lock))
         RTCritSectDelete(&pThis->Lock);
 
@@ -382,6 +1044,7 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
      */
     pThis->pDrvIns                                  = pDrvIns;
     pThis->hFile                                    = NIL_RTFILE;
+    pThis->hEvtWriter                               = NIL_RTSEMEVENT;
     /* The pcap file *must* start at time offset 0,0. */
     pThis->StartNanoTS                              = RTTimeNanoTS() - RTTimeProgramNanoTS();
     /* IBase */
@@ -414,22 +1077,70 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     /*
      * Validate the config.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "File\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "File\0"
+                                    "Format\0"
+                                    "SnapLen\0"
+                                    "RingSize\0"
+                                    "Filter\0"))
         return VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES;
 
     if (CFGMR3GetFirstChild(pCfg))
         LogRel(("NetSniffer: Found child config entries -- are you trying to redirect ports?\n"));
 
+    /*
+     * Get the capture format, the snap length and the size of the capture ring.
+     */
+    char szFormat[16];
+    rc = CFGMR3QueryStringDef(pCfg, "Format", szFormat, sizeof(szFormat), "pcap");
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"Format\" value"));
+    if (!RTStrICmp(szFormat, "pcapng"))
+        pThis->fPcapNg = true;
+    else if (RTStrICmp(szFormat, "pcap"))
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("NetSniffer: Unknown capture format '%s', expected 'pcap' or 'pcapng'"), szFormat);
+
+    rc = CFGMR3QueryU32Def(pCfg, "SnapLen", &pThis->cbSnapLen, 0xffff);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"SnapLen\" value"));
+    if (pThis->cbSnapLen < 14 || pThis->cbSnapLen > 0xffff)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("NetSniffer: \"SnapLen\" must be between 14 and 65535, not %u"), pThis->cbSnapLen);
+
+    rc = CFGMR3QueryU32Def(pCfg, "RingSize", &pThis->cbRing, DRVNETSNIFFER_RING_SIZE_DEF);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"RingSize\" value"));
+    if (pThis->cbRing < _256K || pThis->cbRing > _1G)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("NetSniffer: \"RingSize\" must be between 256KB and 1GB, not %u"), pThis->cbRing);
+    pThis->cbRing = RT_BIT_32(ASMBitLastSetU32(pThis->cbRing - 1));
+
+    /*
+     * Compile the filter.
+     */
+    char *pszFilter;
+    rc = CFGMR3QueryStringAlloc(pCfg, "Filter", &pszFilter);
+    if (RT_SUCCESS(rc))
+    {
+        rc = drvNetSnifferFilterCompile(pDrvIns, pThis, pszFilter);
+        MMR3HeapFree(pszFilter);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    else if (rc != VERR_CFGM_VALUE_NOT_FOUND)
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"Filter\" value"));
+
     /*
      * Get the filename.
      */
     rc = CFGMR3QueryString(pCfg, "File", pThis->szFilename, sizeof(pThis->szFilename));
     if (rc == VERR_CFGM_VALUE_NOT_FOUND)
     {
+        const char *pszExt = pThis->fPcapNg ? "pcapng" : "pcap";
         if (pDrvIns->iInstance > 0)
-            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x-%u.pcap", RTProcSelf(), pDrvIns->iInstance);
+            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x-%u.%s", RTProcSelf(), pDrvIns->iInstance, pszExt);
         else
-            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x.pcap", RTProcSelf());
+            RTStrPrintf(pThis->szFilename, sizeof(pThis->szFilename), "./VBox-%x.%s", RTProcSelf(), pszExt);
     }
 
     else if (RT_FAILURE(rc))
@@ -504,7 +1215,42 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
      * Some time has gone by since capturing pThis->StartNanoTS so get the
      * current time again.
      */
-    PcapFileHdr(pThis->hFile, RTTimeNanoTS());
+    if (!pThis->fPcapNg)
+        PcapFileHdr(pThis->hFile, RTTimeNanoTS());
+    else
+    {
+        char szIfName[32];
+        RTStrPrintf(szIfName, sizeof(szIfName), "NetSniffer#%u", pDrvIns->iInstance);
+        rc = PcapNgFileHdr(pThis->hFile, "VirtualBox");
+        if (RT_SUCCESS(rc))
+            rc = PcapNgFileIfDesc(pThis->hFile, szIfName, pThis->cbSnapLen);
+        if (RT_FAILURE(rc))
+            return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS, N_("Netsniffer cannot write to '%s'"), pThis->szFilename);
+    }
+
+    /*
+     * Set up the capture ring and the thread writing it to the file, so the
+     * I/O threads only have to copy the frames.
+     */
+    pThis->pbRing = (uint8_t *)RTMemAlloc(pThis->cbRing);
+    if (!pThis->pbRing)
+        return VERR_NO_MEMORY;
+
+    rc = RTSemEventCreate(&pThis->hEvtWriter);
+    AssertRCReturn(rc, rc);
+
+    rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pWriterThread, pThis, drvNetSnifferWriterThread,
+                               drvNetSnifferWriterWakeup, 0, RTTHREADTYPE_IO, "NetSniff");
+    AssertRCReturn(rc, rc);
+
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatFramesCaptured, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Number of frames put into the capture ring.", "/Drivers/NetSniffer%u/FramesCaptured", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatFramesDropped,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Number of frames dropped because the capture ring was full.", "/Drivers/NetSniffer%u/FramesDropped", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatFramesFiltered, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                           "Number of frames rejected by the filter.", "/Drivers/NetSniffer%u/FramesFiltered", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatBytesWritten,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                           "Number of bytes written to the capture file.", "/Drivers/NetSniffer%u/BytesWritten", pDrvIns->iInstance);
 
     return VINF_SUCCESS;
 }
@@ -28,8 +28,10 @@
 #include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
+#include <iprt/err.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/net.h>
 #include <iprt/path.h>
 #include <iprt/pipe.h>
 #include <iprt/semaphore.h>
@@ -43,6 +45,7 @@
 
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/uio.h>
 #ifdef RT_OS_SOLARIS
 # include <sys/stat.h>
 # include <sys/ethernet.h>
@@ -61,15 +64,57 @@
 #else
 # include <sys/fcntl.h>
 #endif
+#ifdef RT_OS_LINUX
+# include <net/if.h>
+# include <linux/if_tun.h>
+#endif
 #include <errno.h>
 #include <unistd.h>
 
 #include "VBoxDD.h"
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** Maximum number of frames read from the device before polling again. */
+#define DRVTAP_RECV_BATCH               64
+/** Size of the receive buffer without host offloads. */
+#define DRVTAP_RECV_BUF_SIZE            16384
+/** Size of the receive buffer when the host may hand us GSO frames. */
+#define DRVTAP_RECV_BUF_SIZE_GSO        (_64K + 64)
+
+/** @name Virtio-net header flags and GSO types (IFF_VNET_HDR).
+ * @{ */
+#define DRVTAP_VNETHDR_F_NEEDS_CSUM     1
+#define DRVTAP_VNETHDR_GSO_NONE         0
+#define DRVTAP_VNETHDR_GSO_TCPV4        1
+#define DRVTAP_VNETHDR_GSO_UDP          3
+#define DRVTAP_VNETHDR_GSO_TCPV6        4
+#define DRVTAP_VNETHDR_GSO_ECN          0x80
+/** @} */
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+/**
+ * The virtio-net header in front of every frame when the TAP device was set
+ * up with IFF_VNET_HDR (struct virtio_net_hdr, host endian).
+ */
+typedef struct DRVTAPVNETHDR
+{
+    uint8_t                 fFlags;
+    uint8_t                 u8GsoType;
+    uint16_t                cbHdrs;
+    uint16_t                cbGsoSize;
+    uint16_t                offCSumStart;
+    uint16_t                offCSum;
+} DRVTAPVNETHDR;
+AssertCompileSize(DRVTAPVNETHDR, 10);
+typedef DRVTAPVNETHDR *PDRVTAPVNETHDR;
+typedef DRVTAPVNETHDR const *PCDRVTAPVNETHDR;
+
 /**
  * TAP driver instance data.
  *
@@ -108,6 +153,15 @@ typedef struct DRVTAP
     /** Transmit lock used by drvTAPNetworkUp_BeginXmit. */
     RTCRITSECT              XmitLock;
 
+    /** Set if every frame is prefixed by a DRVTAPVNETHDR (IFF_VNET_HDR). */
+    bool                    fVNetHdr;
+    /** Set if the host may hand us GSO and partially checksummed frames. */
+    bool                    fRecvOffload;
+    /** The receive buffer. */
+    uint8_t                *pbRecvBuf;
+    /** The size of the receive buffer. */
+    size_t                  cbRecvBuf;
+
 #ifdef VBOX_WITH_STATISTICS
     /** Number of sent packets. */
     STAMCOUNTER             StatPktSent;
@@ -117,6 +171,12 @@ typedef struct DRVTAP
     STAMCOUNTER             StatPktRecv;
     /** Number of received bytes. */
     STAMCOUNTER             StatPktRecvBytes;
+    /** Number of GSO frames handed to the host. */
+    STAMCOUNTER             StatPktSentGso;
+    /** Number of GSO frames received from the host. */
+    STAMCOUNTER             StatPktRecvGso;
+    /** Number of frames received per batch. */
+    STAMCOUNTER             StatRecvBatches;
     /** Profiling packet transmit runs. */
     STAMPROFILE             StatTransmit;
     /** Profiling packet receive runs. */
@@ -144,6 +204,126 @@ static int              SolarisTAPAttach(PDRVTAP pThis);
 #endif
 
 
+/**
+ * Fills in the virtio-net header for handing a GSO frame to the host.
+ *
+ * @returns true if the host can do the segmentation, false if we have to.
+ * @param   pGso            The GSO context of the frame.
+ * @param   pHdr            The header to fill in.
+ */
+static bool drvTAPGsoToVNetHdr(PCPDMNETWORKGSO pGso, PDRVTAPVNETHDR pHdr)
+{
+    switch ((PDMNETWORKGSOTYPE)pGso->u8Type)
+    {
+        case PDMNETWORKGSOTYPE_IPV4_TCP:
+            pHdr->u8GsoType = DRVTAP_VNETHDR_GSO_TCPV4;
+            break;
+        case PDMNETWORKGSOTYPE_IPV6_TCP:
+            pHdr->u8GsoType = DRVTAP_VNETHDR_GSO_TCPV6;
+            break;
+        default:
+            /* UFO was dropped from the TAP driver and tunneled frames can't be expressed. */
+            return false;
+    }
+    pHdr->fFlags       = DRVTAP_VNETHDR_F_NEEDS_CSUM;
+    pHdr->cbHdrs       = pGso->cbHdrsTotal;
+    pHdr->cbGsoSize    = pGso->cbMaxSeg;
+    pHdr->offCSumStart = pGso->offHdr2;
+    pHdr->offCSum      = RT_OFFSETOF(RTNETTCP, th_sum);
+    return true;
+}
+
+
+/**
+ * Sets up the GSO context for a GSO frame received from the host.
+ *
+ * The header length in the virtio-net header is only a hint (it is the size of
+ * the linear part of the host buffer), so it is taken from the TCP header.
+ *
+ * @returns true if the context is valid, false if the frame must be dropped.
+ * @param   pHdr            The virtio-net header of the frame.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   pGso            The GSO context to set up.
+ */
+static bool drvTAPVNetHdrToGso(PCDRVTAPVNETHDR pHdr, uint8_t const *pbFrame, size_t cbFrame, PPDMNETWORKGSO pGso)
+{
+    switch (pHdr->u8GsoType)
+    {
+        case DRVTAP_VNETHDR_GSO_TCPV4:
+            pGso->u8Type = PDMNETWORKGSOTYPE_IPV4_TCP;
+            break;
+        case DRVTAP_VNETHDR_GSO_TCPV6:
+            pGso->u8Type = PDMNETWORKGSOTYPE_IPV6_TCP;
+            break;
+        default:
+            return false;
+    }
+    if (   !(pHdr->fFlags & DRVTAP_VNETHDR_F_NEEDS_CSUM)
+        || cbFrame < sizeof(RTNETETHERHDR)
+        || pHdr->offCSumStart > UINT8_MAX - 60 /* max TCP header */
+        || (size_t)pHdr->offCSumStart + sizeof(RTNETTCP) > cbFrame)
+        return false;
+
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+    pGso->offHdr1     = pEthHdr->EtherType == RT_H2N_U16_C(RTNET_ETHERTYPE_VLAN)
+                      ? sizeof(RTNETETHERHDR) + 4 : sizeof(RTNETETHERHDR);
+    pGso->offHdr2     = (uint8_t)pHdr->offCSumStart;
+    pGso->cbHdrsTotal = (uint8_t)(pHdr->offCSumStart + ((PCRTNETTCP)(pbFrame + pHdr->offCSumStart))->th_off * 4);
+    pGso->cbHdrsSeg   = pGso->cbHdrsTotal;
+    pGso->cbMaxSeg    = pHdr->cbGsoSize;
+    pGso->u8Unused    = 0;
+    return PDMNetGsoIsValid(pGso, sizeof(*pGso), cbFrame);
+}
+
+
+/**
+ * Completes the checksum of a frame the host left partially checksummed.
+ *
+ * @param   pHdr            The virtio-net header of the frame.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ */
+static void drvTAPCompleteChecksum(PCDRVTAPVNETHDR pHdr, uint8_t *pbFrame, size_t cbFrame)
+{
+    size_t const offCSum = (size_t)pHdr->offCSumStart + pHdr->offCSum;
+    AssertReturnVoid(pHdr->offCSumStart < cbFrame && offCSum + sizeof(uint16_t) <= cbFrame);
+
+    /* The checksum field holds the pseudo header sum. */
+    bool     fOdd   = false;
+    uint32_t u32Sum = RTNetIPv4AddDataChecksum(pbFrame + pHdr->offCSumStart, cbFrame - pHdr->offCSumStart, 0, &fOdd);
+    *(uint16_t *)(pbFrame + offCSum) = RTNetIPv4FinalizeChecksum(u32Sum);
+}
+
+
+/**
+ * Writes a frame to the TAP device, prefixing it with the virtio-net header
+ * if the device expects one.
+ *
+ * @returns IPRT status code.
+ * @param   pThis           The instance data.
+ * @param   pHdr            The virtio-net header, NULL for a frame without
+ *                          offloads.
+ * @param   pvFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ */
+static int drvTAPWriteFrame(PDRVTAP pThis, PCDRVTAPVNETHDR pHdr, const void *pvFrame, size_t cbFrame)
+{
+    if (!pThis->fVNetHdr)
+        return RTFileWrite(pThis->hFileDevice, pvFrame, cbFrame, NULL);
+
+    static const DRVTAPVNETHDR s_HdrNone = { 0, DRVTAP_VNETHDR_GSO_NONE, 0, 0, 0, 0 };
+    struct iovec aIov[2];
+    aIov[0].iov_base = (void *)(pHdr ? pHdr : &s_HdrNone);
+    aIov[0].iov_len  = sizeof(DRVTAPVNETHDR);
+    aIov[1].iov_base = (void *)pvFrame;
+    aIov[1].iov_len  = cbFrame;
+    if (writev(RTFileToNative(pThis->hFileDevice), &aIov[0], RT_ELEMENTS(aIov)) < 0)
+        return RTErrConvertFromErrno(errno);
+    return VINF_SUCCESS;
+}
+
+
 
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
@@ -263,23 +443,37 @@ static DECLCALLBACK(int) drvTAPNetworkUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
               "%.*Rhxd\n",
               pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, pSgBuf->cbUsed, pSgBuf->aSegs[0].pvSeg));
 
-        rc = RTFileWrite(pThis->hFileDevice, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, NULL);
+        rc = drvTAPWriteFrame(pThis, NULL, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
     }
     else
     {
-        uint8_t         abHdrScratch[256];
-        uint8_t const  *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
-        PCPDMNETWORKGSO pGso    = (PCPDMNETWORKGSO)pSgBuf->pvUser;
-        uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
-        rc = VINF_SUCCESS;
-        for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
+        DRVTAPVNETHDR   Hdr;
+        PCPDMNETWORKGSO pGso = (PCPDMNETWORKGSO)pSgBuf->pvUser;
+        if (pThis->fVNetHdr && drvTAPGsoToVNetHdr(pGso, &Hdr))
         {
-            uint32_t cbSegFrame;
-            void *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)pbFrame, pSgBuf->cbUsed, abHdrScratch,
-                                                       iSeg, cSegs, &cbSegFrame);
-            rc = RTFileWrite(pThis->hFileDevice, pvSegFrame, cbSegFrame, NULL);
-            if (RT_FAILURE(rc))
-                break;
+            /*
+             * Let the host do the segmentation, it expects the pseudo header
+             * checksum in the TCP header.
+             */
+            STAM_COUNTER_INC(&pThis->StatPktSentGso);
+            PDMNetGsoPrepForDirectUse(pGso, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed, PDMNETCSUMTYPE_PSEUDO);
+            rc = drvTAPWriteFrame(pThis, &Hdr, pSgBuf->aSegs[0].pvSeg, pSgBuf->cbUsed);
+        }
+        else
+        {
+            uint8_t         abHdrScratch[256];
+            uint8_t const  *pbFrame = (uint8_t const *)pSgBuf->aSegs[0].pvSeg;
+            uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, pSgBuf->cbUsed);  Assert(cSegs > 1);
+            rc = VINF_SUCCESS;
+            for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
+            {
+                uint32_t cbSegFrame;
+                void *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)pbFrame, pSgBuf->cbUsed, abHdrScratch,
+                                                           iSeg, cSegs, &cbSegFrame);
+                rc = drvTAPWriteFrame(pThis, NULL, pvSegFrame, cbSegFrame);
+                if (RT_FAILURE(rc))
+                    break;
+            }
         }
     }
 
@@ -330,6 +524,158 @@ static DECLCALLBACK(void) drvTAPNetworkUp_NotifyLinkChanged(PPDMINETWORKUP pInte
 }
 
 
+/**
+ * Passes a frame received from the host up to the device.
+ *
+ * GSO frames are handed up as a whole if the device can take them, otherwise
+ * they are segmented here.
+ *
+ * @param   pThis           The instance data.
+ * @param   pHdr            The virtio-net header of the frame, NULL if the
+ *                          TAP device does not use one.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ */
+static void drvTAPRecvFrame(PDRVTAP pThis, PCDRVTAPVNETHDR pHdr, uint8_t *pbFrame, size_t cbFrame)
+{
+    /*
+     * Wait for the device to have space for this frame.
+     * Most guests use frame-sized receive buffers, hence non-zero cbMax
+     * automatically means there is enough room for entire frame. Some
+     * guests (eg. Solaris) use large chains of small receive buffers
+     * (each 128 or so bytes large). We will still start receiving as soon
+     * as cbMax is non-zero because:
+     *  - it would be quite expensive for pfnCanReceive to accurately
+     *    determine free receive buffer space
+     *  - if we were waiting for enough free buffers, there is a risk
+     *    of deadlocking because the guest could be waiting for a receive
+     *    overflow error to allocate more receive buffers
+     */
+    STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+    int rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
+    STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+
+    /*
+     * A return code != VINF_SUCCESS means that we were woken up during a VM
+     * state transition. Drop the packet and wait for the next one.
+     */
+    if (RT_FAILURE(rc))
+        return;
+
+    /*
+     * Pass the data up.
+     */
+#ifdef LOG_ENABLED
+    uint64_t u64Now = RTTimeProgramNanoTS();
+    LogFlow(("drvTAPAsyncIoThread: %-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
+             cbFrame, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
+    pThis->u64LastReceiveTS = u64Now;
+#endif
+    Log2(("drvTAPAsyncIoThread: cbRead=%#x\n" "%.*Rhxd\n", cbFrame, cbFrame, pbFrame));
+    STAM_COUNTER_INC(&pThis->StatPktRecv);
+    STAM_COUNTER_ADD(&pThis->StatPktRecvBytes, cbFrame);
+
+    if (pHdr && pHdr->u8GsoType != DRVTAP_VNETHDR_GSO_NONE)
+    {
+        PDMNETWORKGSO Gso;
+        if (!drvTAPVNetHdrToGso(pHdr, pbFrame, cbFrame, &Gso))
+        {
+            Log(("drvTAPAsyncIoThread: Dropping GSO frame with bad header: fFlags=%#x u8GsoType=%#x cbGsoSize=%#x offCSumStart=%#x\n",
+                 pHdr->fFlags, pHdr->u8GsoType, pHdr->cbGsoSize, pHdr->offCSumStart));
+            return;
+        }
+        STAM_COUNTER_INC(&pThis->StatPktRecvGso);
+        if (   pThis->pIAboveNet->pfnReceiveGso
+            && RT_SUCCESS(pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pbFrame, cbFrame, &Gso)))
+            return;
+
+        /*
+         * This is where we do the offloading since this NIC does not
+         * support large receive offload (LRO).
+         */
+        uint8_t         abHdrScratch[256];
+        uint32_t const  cSegs = PDMNetGsoCalcSegmentCount(&Gso, cbFrame);
+        for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+        {
+            uint32_t cbSegFrame;
+            void    *pvSegFrame = PDMNetGsoCarveSegmentQD(&Gso, pbFrame, cbFrame, abHdrScratch, iSeg, cSegs, &cbSegFrame);
+            if (iSeg > 0)
+            {
+                STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+                rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
+                STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+                if (RT_FAILURE(rc))
+                    break; /* we drop the rest. */
+            }
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvSegFrame, cbSegFrame);
+            AssertRC(rc);
+        }
+        return;
+    }
+
+    if (pHdr && (pHdr->fFlags & DRVTAP_VNETHDR_F_NEEDS_CSUM))
+        drvTAPCompleteChecksum(pHdr, pbFrame, cbFrame);
+
+    rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pbFrame, cbFrame);
+    AssertRC(rc);
+}
+
+
+/**
+ * Reads the pending frames and passes them up.
+ *
+ * @returns IPRT status code of the last read, VERR_TRY_AGAIN when the device
+ *          was drained.
+ * @param   pThis           The instance data.
+ * @param   pThread         The receive thread.
+ */
+static int drvTAPRecvFrames(PDRVTAP pThis, PPDMTHREAD pThread)
+{
+    int      rc      = VINF_SUCCESS;
+    uint32_t cFrames = 0;
+    while (   cFrames < DRVTAP_RECV_BATCH
+           && pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        /*
+         * Read the frame, with the virtio-net header in front of it if the
+         * TAP device uses one.
+         */
+        DRVTAPVNETHDR Hdr;
+        struct iovec  aIov[2];
+        unsigned      iIov = 0;
+        if (pThis->fVNetHdr)
+        {
+            aIov[iIov].iov_base = &Hdr;
+            aIov[iIov].iov_len  = sizeof(Hdr);
+            iIov++;
+        }
+        aIov[iIov].iov_base = pThis->pbRecvBuf;
+        aIov[iIov].iov_len  = pThis->cbRecvBuf;
+        iIov++;
+
+        ssize_t cbRead = readv(RTFileToNative(pThis->hFileDevice), &aIov[0], iIov);
+        if (cbRead < 0)
+        {
+            rc = RTErrConvertFromErrno(errno);
+            break;
+        }
+        if (pThis->fVNetHdr)
+        {
+            if ((size_t)cbRead < sizeof(Hdr))
+                continue;
+            cbRead -= sizeof(Hdr);
+        }
+
+        cFrames++;
+        drvTAPRecvFrame(pThis, pThis->fVNetHdr ? &Hdr : NULL, pThis->pbRecvBuf, (size_t)cbRead);
+    }
+
+    if (cFrames)
+        STAM_COUNTER_INC(&pThis->StatRecvBatches);
+    return rc;
+}
+
+
 /**
  * Asynchronous I/O thread for handling receive.
  *
@@ -376,58 +722,13 @@ static DECLCALLBACK(int) drvTAPAsyncIoThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThr
             &&  !aFDs[1].revents)
         {
             /*
-             * Read the frame.
+             * Drain the device a batch at a time so the control pipe is
+             * checked regularly.
              */
-            char achBuf[16384];
-            size_t cbRead = 0;
-            /** @note At least on Linux we will never receive more than one network packet
-             *        after poll() returned successfully. I don't know why but a second
-             *        RTFileRead() operation will return with VERR_TRY_AGAIN in any case. */
-            rc = RTFileRead(pThis->hFileDevice, achBuf, sizeof(achBuf), &cbRead);
-            if (RT_SUCCESS(rc))
+            rc = drvTAPRecvFrames(pThis, pThread);
+            if (RT_FAILURE(rc) && rc != VERR_TRY_AGAIN)
             {
-                /*
-                 * Wait for the device to have space for this frame.
-                 * Most guests use frame-sized receive buffers, hence non-zero cbMax
-                 * automatically means there is enough room for entire frame. Some
-                 * guests (eg. Solaris) use large chains of small receive buffers
-                 * (each 128 or so bytes large). We will still start receiving as soon
-                 * as cbMax is non-zero because:
-                 *  - it would be quite expensive for pfnCanReceive to accurately
-                 *    determine free receive buffer space
-                 *  - if we were waiting for enough free buffers, there is a risk
-                 *    of deadlocking because the guest could be waiting for a receive
-                 *    overflow error to allocate more receive buffers
-                 */
-                STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
-                int rc1 = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, RT_INDEFINITE_WAIT);
-                STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
-
-                /*
-                 * A return code != VINF_SUCCESS means that we were woken up during a VM
-                 * state transition. Drop the packet and wait for the next one.
-                 */
-                if (RT_FAILURE(rc1))
-                    continue;
-
-                /*
-                 * Pass the data up.
-                 */
-#ifdef LOG_ENABLED
-                uint64_t u64Now = RTTimeProgramNanoTS();
-                LogFlow(("drvTAPAsyncIoThread: %-4d bytes at %llu ns  deltas: r=%llu t=%llu\n",
-                         cbRead, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS));
-                pThis->u64LastReceiveTS = u64Now;
-#endif
-                Log2(("drvTAPAsyncIoThread: cbRead=%#x\n" "%.*Rhxd\n", cbRead, cbRead, achBuf));
-                STAM_COUNTER_INC(&pThis->StatPktRecv);
-                STAM_COUNTER_ADD(&pThis->StatPktRecvBytes, cbRead);
-                rc1 = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, achBuf, cbRead);
-                AssertRC(rc1);
-            }
-            else
-            {
-                LogFlow(("drvTAPAsyncIoThread: RTFileRead -> %Rrc\n", rc));
+                LogFlow(("drvTAPAsyncIoThread: readv -> %Rrc\n", rc));
                 if (rc == VERR_INVALID_HANDLE)
                     break;
                 RTThreadYield();
@@ -750,6 +1051,69 @@ static DECLCALLBACK(int) SolarisTAPAttach(PDRVTAP pThis)
 
 #endif  /* RT_OS_SOLARIS */
 
+
+#ifdef RT_OS_LINUX
+/**
+ * Sets up the virtio-net header size and host offloads of the TAP device.
+ *
+ * @returns IPRT status code.
+ * @param   pThis           The instance data.
+ */
+static int drvTAPLinuxSetupVNetHdr(PDRVTAP pThis)
+{
+    int cbHdr = sizeof(DRVTAPVNETHDR);
+    if (ioctl(RTFileToNative(pThis->hFileDevice), TUNSETVNETHDRSZ, &cbHdr) == -1)
+        return RTErrConvertFromErrno(errno);
+
+    /* Tell the host which GSO frames and unfinished checksums we can take. */
+    unsigned long fOffloads = pThis->fRecvOffload ? TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 : 0;
+    if (ioctl(RTFileToNative(pThis->hFileDevice), TUNSETOFFLOAD, fOffloads) == -1)
+        return RTErrConvertFromErrno(errno);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Enables the virtio-net header and the host offloads if the TAP device was
+ * set up for them (IFF_VNET_HDR).
+ *
+ * @returns VBox status code.
+ * @param   pThis           The instance data.
+ */
+static int drvTAPLinuxSetup(PDRVTAP pThis)
+{
+    PPDMDRVINS pDrvIns = pThis->pDrvIns;
+
+    struct ifreq IfReq;
+    RT_ZERO(IfReq);
+    if (ioctl(RTFileToNative(pThis->hFileDevice), TUNGETIFF, &IfReq) == -1)
+    {
+        LogRel(("TAP#%d: TUNGETIFF failed (errno=%d), not using host offloads\n", pDrvIns->iInstance, errno));
+        return VINF_SUCCESS;
+    }
+
+    if (IfReq.ifr_flags & IFF_VNET_HDR)
+    {
+        /* Only devices taking GSO frames benefit from getting them from the host. */
+        pThis->fVNetHdr     = true;
+        pThis->fRecvOffload = pThis->pIAboveNet->pfnReceiveGso != NULL;
+        int rc = drvTAPLinuxSetupVNetHdr(pThis);
+        if (RT_FAILURE(rc) && pThis->fRecvOffload)
+        {
+            pThis->fRecvOffload = false;
+            rc = drvTAPLinuxSetupVNetHdr(pThis);
+        }
+        if (RT_FAILURE(rc))
+            return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                       N_("Failed to set up the virtio-net header of the TAP device '%s'"), IfReq.ifr_name);
+    }
+
+    LogRel(("TAP#%d: '%s': virtio-net header=%RTbool host offloads=%RTbool\n",
+            pDrvIns->iInstance, IfReq.ifr_name, pThis->fVNetHdr, pThis->fRecvOffload));
+    return VINF_SUCCESS;
+}
+#endif /* RT_OS_LINUX */
+
 /* -=-=-=-=- PDMIBASE -=-=-=-=- */
 
 /**
@@ -796,6 +1160,9 @@ static DECLCALLBACK(void) drvTAPDestruct(PPDMDRVINS pDrvIns)
         pThis->hPipeRead = NIL_RTPIPE;
     }
 
+    RTMemFree(pThis->pbRecvBuf);
+    pThis->pbRecvBuf = NULL;
+
 #ifdef RT_OS_SOLARIS
     /** @todo r=bird: This *does* need checking against ConsoleImpl2.cpp if used on non-solaris systems. */
     if (pThis->hFileDevice != NIL_RTFILE)
@@ -841,6 +1208,9 @@ static DECLCALLBACK(void) drvTAPDestruct(PPDMDRVINS pDrvIns)
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktSentBytes);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecv);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvBytes);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktSentGso);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatPktRecvGso);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvBatches);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatTransmit);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
 #endif /* VBOX_WITH_STATISTICS */
@@ -872,6 +1242,10 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
 #endif
     pThis->pszSetupApplication          = NULL;
     pThis->pszTerminateApplication      = NULL;
+    pThis->fVNetHdr                     = false;
+    pThis->fRecvOffload                 = false;
+    pThis->pbRecvBuf                    = NULL;
+    pThis->cbRecvBuf                    = 0;
 
     /* IBase */
     pDrvIns->IBase.pfnQueryInterface    = drvTAPQueryInterface;
@@ -892,6 +1266,9 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktSentBytes,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,             "Number of sent bytes.",            "/Drivers/TAP%d/Bytes/Sent", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecv,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of received packets.",      "/Drivers/TAP%d/Packets/Received", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvBytes,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,             "Number of received bytes.",        "/Drivers/TAP%d/Bytes/Received", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktSentGso,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "GSO frames handed to the host.",   "/Drivers/TAP%d/Packets/SentGso", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatPktRecvGso,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "GSO frames from the host.",        "/Drivers/TAP%d/Packets/ReceivedGso", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatRecvBatches,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,        "Number of receive batches.",       "/Drivers/TAP%d/ReceiveBatches", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatTransmit,      STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet transmit runs.",  "/Drivers/TAP%d/Transmit", pDrvIns->iInstance);
     PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatReceive,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,    "Profiling packet receive runs.",   "/Drivers/TAP%d/Receive", pDrvIns->iInstance);
 #endif /* VBOX_WITH_STATISTICS */
@@ -974,7 +1351,6 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
         return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_HANDLE, RT_SRC_POS,
                                    N_("The TAP file handle %RTfile is not valid"), pThis->hFileDevice);
 #endif /* !RT_OS_SOLARIS */
-
     /*
      * Create the transmit lock.
      */
@@ -994,6 +1370,20 @@ static DECLCALLBACK(int) drvTAPConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uin
     Log(("drvTAPContruct: %d (from fd)\n", (intptr_t)pThis->hFileDevice));
     rc = VINF_SUCCESS;
 
+#ifdef RT_OS_LINUX
+    /*
+     * Use the host offloads if the device was set up for it.
+     */
+    rc = drvTAPLinuxSetup(pThis);
+    if (RT_FAILURE(rc))
+        return rc;
+#endif
+
+    pThis->cbRecvBuf = pThis->fRecvOffload ? DRVTAP_RECV_BUF_SIZE_GSO : DRVTAP_RECV_BUF_SIZE;
+    pThis->pbRecvBuf = (uint8_t *)RTMemAlloc(pThis->cbRecvBuf);
+    if (!pThis->pbRecvBuf)
+        return VERR_NO_MEMORY;
+
     /*
      * Create the control pipe.
      */
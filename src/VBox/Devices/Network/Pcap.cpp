@@ -1,6 +1,6 @@
 /* $Id$ */
 /** @file
- * Helpers for writing libpcap files.
+ * Helpers for writing libpcap and pcapng files.
  */
 
 /*
@@ -21,8 +21,10 @@
 *********************************************************************************************************************************/
 #include "Pcap.h"
 
+#include <iprt/assert.h>
 #include <iprt/file.h>
 #include <iprt/stream.h>
+#include <iprt/string.h>
 #include <iprt/time.h>
 #include <iprt/err.h>
 #include <VBox/vmm/pdmnetinline.h>
@@ -61,6 +63,70 @@ struct pcaprec_hdr_init
     struct pcap_hdr     pcap;
 };
 
+/* "pcapng" block types. */
+#define PCAPNG_BT_SHB               UINT32_C(0x0a0d0d0a)
+#define PCAPNG_BT_IDB               UINT32_C(0x00000001)
+#define PCAPNG_BT_EPB               UINT32_C(0x00000006)
+/* "pcapng" byte order magic. */
+#define PCAPNG_BYTE_ORDER_MAGIC     UINT32_C(0x1a2b3c4d)
+/* "pcapng" option codes. */
+#define PCAPNG_OPT_ENDOFOPT         0
+#define PCAPNG_OPT_SHB_USERAPPL     4
+#define PCAPNG_OPT_IF_NAME          2
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_OPT_EPB_FLAGS        2
+
+/* "pcapng" block header. */
+struct pcapng_block_hdr
+{
+    uint32_t    block_type;     /* PCAPNG_BT_XXX */
+    uint32_t    block_len;      /* total block length, repeated in the trailer */
+};
+
+/* "pcapng" section header block body. */
+struct pcapng_shb
+{
+    uint32_t    byte_order;     /* PCAPNG_BYTE_ORDER_MAGIC */
+    uint16_t    version_major;  /* major version number                         = 1 */
+    uint16_t    version_minor;  /* minor version number                         = 0 */
+    int64_t     section_len;    /* section length, -1 if not specified */
+};
+
+/* "pcapng" interface description block body. */
+struct pcapng_idb
+{
+    uint16_t    link_type;      /* data link type                               = 01 */
+    uint16_t    reserved;       /*                                              = 0 */
+    uint32_t    snaplen;        /* max length of captured packets, in octets */
+};
+
+/* "pcapng" enhanced packet block header (block header included). */
+struct pcapng_epb_hdr
+{
+    uint32_t    block_type;     /* PCAPNG_BT_EPB */
+    uint32_t    block_len;      /* total block length, repeated in the trailer */
+    uint32_t    if_id;          /* interface ID (IDB index) */
+    uint32_t    ts_high;        /* timestamp, upper 32 bits */
+    uint32_t    ts_low;         /* timestamp, lower 32 bits */
+    uint32_t    incl_len;       /* number of octets of packet saved in file */
+    uint32_t    orig_len;       /* actual length of packet */
+};
+AssertCompile(sizeof(struct pcapng_epb_hdr) <= PCAP_REC_HDR_MAX);
+AssertCompile(sizeof(struct pcaprec_hdr) <= PCAP_REC_HDR_MAX);
+
+/* "pcapng" option header. */
+struct pcapng_opt_hdr
+{
+    uint16_t    code;           /* PCAPNG_OPT_XXX */
+    uint16_t    len;            /* length of the value, excluding padding */
+};
+
+/** The size of the fixed enhanced packet block trailer: the epb_flags option,
+ * the end of options marker and the repeated block length. */
+#define PCAPNG_EPB_TRAILER_FIXED    (  sizeof(struct pcapng_opt_hdr) + sizeof(uint32_t) \
+                                     + sizeof(struct pcapng_opt_hdr) + sizeof(uint32_t))
+AssertCompile(PCAPNG_EPB_TRAILER_FIXED + 3 <= PCAP_REC_TRAILER_MAX);
+
 
 /*********************************************************************************************************************************
 *   Global Variables                                                                                                             *
@@ -255,3 +321,199 @@ int PcapFileGsoFrame(RTFILE File, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
     return VINF_SUCCESS;
 }
 
+
+/**
+ * Builds a libpcap record header in memory.
+ *
+ * The record header is followed by @a cbIncl bytes of frame data, there is no
+ * trailer.
+ *
+ * @returns The size of the header (at most PCAP_REC_HDR_MAX).
+ *
+ * @param   pvHdr           Where to build the header, PCAP_REC_HDR_MAX bytes.
+ * @param   u64TS           The timestamp of the frame in nanoseconds.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbIncl          The number of bytes of the frame to include in the
+ *                          file, not larger than @a cbFrame.
+ */
+size_t PcapRecHdr(void *pvHdr, uint64_t u64TS, size_t cbFrame, size_t cbIncl)
+{
+    struct pcaprec_hdr *pHdr = (struct pcaprec_hdr *)pvHdr;
+    pHdr->ts_sec   = (uint32_t)(u64TS / 1000000000);
+    pHdr->ts_usec  = (uint32_t)((u64TS / 1000) % 1000000);
+    pcapUpdateHeader(pHdr, cbFrame, cbIncl);
+    return sizeof(*pHdr);
+}
+
+
+/**
+ * Writes a pcapng option to a buffer, padding the value to 32 bits.
+ *
+ * @returns Number of bytes written.
+ * @param   pb              Where to write the option.
+ * @param   uCode           The option code.
+ * @param   pvValue         The option value.
+ * @param   cbValue         The size of the option value.
+ */
+static size_t pcapngPutOption(uint8_t *pb, uint16_t uCode, const void *pvValue, size_t cbValue)
+{
+    struct pcapng_opt_hdr Opt;
+    Opt.code = uCode;
+    Opt.len  = (uint16_t)cbValue;
+    memcpy(pb, &Opt, sizeof(Opt));
+    memcpy(pb + sizeof(Opt), pvValue, cbValue);
+    size_t const cbPadded = RT_ALIGN_Z(cbValue, 4);
+    memset(pb + sizeof(Opt) + cbValue, 0, cbPadded - cbValue);
+    return sizeof(Opt) + cbPadded;
+}
+
+
+/**
+ * Completes a pcapng block built in @a pbBlock and writes it to the file.
+ *
+ * @returns IPRT status code, @see RTFileWrite.
+ * @param   File            The file handle.
+ * @param   pbBlock         The block, starting with the block header.
+ * @param   cb              The size of the block so far, the end of options
+ *                          marker and the trailer are appended.
+ */
+static int pcapngFileWriteBlock(RTFILE File, uint8_t *pbBlock, size_t cb)
+{
+    memset(&pbBlock[cb], 0, sizeof(struct pcapng_opt_hdr));
+    cb += sizeof(struct pcapng_opt_hdr);
+
+    uint32_t const cbBlock = (uint32_t)(cb + sizeof(uint32_t));
+    ((struct pcapng_block_hdr *)pbBlock)->block_len = cbBlock;
+    memcpy(&pbBlock[cb], &cbBlock, sizeof(cbBlock));
+    return RTFileWrite(File, pbBlock, cbBlock, NULL);
+}
+
+
+/**
+ * Writes the pcapng section header block.
+ *
+ * Unlike PcapFileHdr this doesn't write any dummy frame, but at least one
+ * interface must be described by PcapNgFileIfDesc before writing frames.
+ *
+ * @returns IPRT status code, @see RTFileWrite.
+ *
+ * @param   File            The file handle.
+ * @param   pszAppl         The name of the application creating the file,
+ *                          optional.
+ */
+int PcapNgFileHdr(RTFILE File, const char *pszAppl)
+{
+    union
+    {
+        struct pcapng_block_hdr Hdr;
+        uint8_t                 ab[256];
+    } uBlock;
+    struct pcapng_shb Shb;
+    Shb.byte_order    = PCAPNG_BYTE_ORDER_MAGIC;
+    Shb.version_major = 1;
+    Shb.version_minor = 0;
+    Shb.section_len   = -1;
+
+    uBlock.Hdr.block_type = PCAPNG_BT_SHB;
+    size_t cb = sizeof(uBlock.Hdr);
+    memcpy(&uBlock.ab[cb], &Shb, sizeof(Shb));
+    cb += sizeof(Shb);
+    if (pszAppl)
+        cb += pcapngPutOption(&uBlock.ab[cb], PCAPNG_OPT_SHB_USERAPPL, pszAppl, RT_MIN(strlen(pszAppl), 128));
+    return pcapngFileWriteBlock(File, uBlock.ab, cb);
+}
+
+
+/**
+ * Writes a pcapng interface description block.
+ *
+ * Interfaces are numbered in the order they are described, starting at 0.  The
+ * timestamps of the interface have nanosecond resolution and the link type is
+ * always ethernet.
+ *
+ * @returns IPRT status code, @see RTFileWrite.
+ *
+ * @param   File            The file handle.
+ * @param   pszIfName       The name of the interface, optional.
+ * @param   cbSnapLen       The max number of bytes included for each frame.
+ */
+int PcapNgFileIfDesc(RTFILE File, const char *pszIfName, uint32_t cbSnapLen)
+{
+    union
+    {
+        struct pcapng_block_hdr Hdr;
+        uint8_t                 ab[256];
+    } uBlock;
+    struct pcapng_idb Idb;
+    Idb.link_type = 1;
+    Idb.reserved  = 0;
+    Idb.snaplen   = cbSnapLen;
+
+    uBlock.Hdr.block_type = PCAPNG_BT_IDB;
+    size_t cb = sizeof(uBlock.Hdr);
+    memcpy(&uBlock.ab[cb], &Idb, sizeof(Idb));
+    cb += sizeof(Idb);
+    if (pszIfName)
+        cb += pcapngPutOption(&uBlock.ab[cb], PCAPNG_OPT_IF_NAME, pszIfName, RT_MIN(strlen(pszIfName), 128));
+    uint8_t const bTsResol = 9; /* 10^-9 */
+    cb += pcapngPutOption(&uBlock.ab[cb], PCAPNG_OPT_IF_TSRESOL, &bTsResol, sizeof(bTsResol));
+    return pcapngFileWriteBlock(File, uBlock.ab, cb);
+}
+
+
+/**
+ * Builds a pcapng enhanced packet block header in memory.
+ *
+ * The header is followed by @a cbIncl bytes of frame data and the trailer
+ * built by PcapNgRecTrailer.
+ *
+ * @returns The size of the header (at most PCAP_REC_HDR_MAX).
+ *
+ * @param   pvHdr           Where to build the header, PCAP_REC_HDR_MAX bytes.
+ * @param   idIf            The interface ID, see PcapNgFileIfDesc.
+ * @param   u64TS           The timestamp of the frame in nanoseconds.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbIncl          The number of bytes of the frame to include in the
+ *                          file, not larger than @a cbFrame.
+ */
+size_t PcapNgRecHdr(void *pvHdr, uint32_t idIf, uint64_t u64TS, size_t cbFrame, size_t cbIncl)
+{
+    struct pcapng_epb_hdr *pHdr = (struct pcapng_epb_hdr *)pvHdr;
+    pHdr->block_type = PCAPNG_BT_EPB;
+    pHdr->block_len  = (uint32_t)(sizeof(*pHdr) + RT_ALIGN_Z(cbIncl, 4) + PCAPNG_EPB_TRAILER_FIXED);
+    pHdr->if_id      = idIf;
+    pHdr->ts_high    = (uint32_t)(u64TS >> 32);
+    pHdr->ts_low     = (uint32_t)u64TS;
+    pHdr->incl_len   = (uint32_t)cbIncl;
+    pHdr->orig_len   = (uint32_t)cbFrame;
+    return sizeof(*pHdr);
+}
+
+
+/**
+ * Builds a pcapng enhanced packet block trailer in memory.
+ *
+ * This consists of the padding of the frame data, the epb_flags option and
+ * the repeated block length.
+ *
+ * @returns The size of the trailer (at most PCAP_REC_TRAILER_MAX).
+ *
+ * @param   pvTrailer       Where to build the trailer, PCAP_REC_TRAILER_MAX
+ *                          bytes.
+ * @param   cbIncl          The number of frame bytes passed to PcapNgRecHdr.
+ * @param   fEpbFlags       The epb_flags option value, PCAPNG_EPB_FLAGS_XXX.
+ */
+size_t PcapNgRecTrailer(void *pvTrailer, size_t cbIncl, uint32_t fEpbFlags)
+{
+    uint8_t     *pb    = (uint8_t *)pvTrailer;
+    size_t const cbPad = RT_ALIGN_Z(cbIncl, 4) - cbIncl;
+    memset(pb, 0, cbPad);
+    size_t cb = cbPad;
+    cb += pcapngPutOption(&pb[cb], PCAPNG_OPT_EPB_FLAGS, &fEpbFlags, sizeof(fEpbFlags));
+    memset(&pb[cb], 0, sizeof(struct pcapng_opt_hdr));
+    cb += sizeof(struct pcapng_opt_hdr);
+    uint32_t const cbBlock = (uint32_t)(sizeof(struct pcapng_epb_hdr) + cbIncl + cb + sizeof(uint32_t));
+    memcpy(&pb[cb], &cbBlock, sizeof(cbBlock));
+    return cb + sizeof(uint32_t);
+}
+
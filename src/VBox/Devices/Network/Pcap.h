@@ -33,6 +33,25 @@ int PcapFileFrame(RTFILE File, uint64_t StartNanoTS, const void *pvFrame, size_t
 int PcapFileGsoFrame(RTFILE File, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
                      const void *pvFrame, size_t cbFrame, size_t cbSegMax);
 
+/** @name Building records in memory (e.g. for capture rings).
+ * @{ */
+/** The max size of a record header built by PcapRecHdr or PcapNgRecHdr. */
+#define PCAP_REC_HDR_MAX        28
+/** The max size of a record trailer built by PcapNgRecTrailer. */
+#define PCAP_REC_TRAILER_MAX    20
+/** pcapng enhanced packet block flags: inbound (host to guest). */
+#define PCAPNG_EPB_FLAGS_INBOUND    UINT32_C(0x00000001)
+/** pcapng enhanced packet block flags: outbound (guest to host). */
+#define PCAPNG_EPB_FLAGS_OUTBOUND   UINT32_C(0x00000002)
+
+size_t PcapRecHdr(void *pvHdr, uint64_t u64TS, size_t cbFrame, size_t cbIncl);
+size_t PcapNgRecHdr(void *pvHdr, uint32_t idIf, uint64_t u64TS, size_t cbFrame, size_t cbIncl);
+size_t PcapNgRecTrailer(void *pvTrailer, size_t cbIncl, uint32_t fEpbFlags);
+/** @} */
+
+int PcapNgFileHdr(RTFILE File, const char *pszAppl);
+int PcapNgFileIfDesc(RTFILE File, const char *pszIfName, uint32_t cbSnapLen);
+
 RT_C_DECLS_END
 
 #endif
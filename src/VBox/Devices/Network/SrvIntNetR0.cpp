@@ -62,6 +62,11 @@
 # define INTNET_GROW_DSTTAB_SIZE    1
 #endif
 
+/** The minimum number of slots in the MAC address hash, see INTNETMACTAB::paiHash. */
+#define INTNET_MACTAB_HASH_MIN_SLOTS 16
+/** Unused MAC address hash slot marker. */
+#define INTNET_MACTAB_HASH_FREE     UINT16_MAX
+
 /** The wakeup bit in the INTNETIF::cBusy and INTNETRUNKIF::cBusy counters. */
 #define INTNET_BUSY_WAKEUP_MASK     RT_BIT_32(30)
 
@@ -106,6 +111,20 @@ typedef struct INTNETMACTAB
     /** Table entries. */
     PINTNETMACTABENTRY      paEntries;
 
+    /** Open addressing hash of the entries keyed by MAC address (linear
+     * probing).  Each slot holds an index into paEntries or
+     * INTNET_MACTAB_HASH_FREE.  Lives in the same heap block as paEntries and
+     * is updated whenever an entry is added, removed or changes its address
+     * (only rebuilt when the table grows).  Entries with dummy addresses are
+     * not hashed. */
+    uint16_t               *paiHash;
+    /** The hash slot mask (number of slots - 1). */
+    uint32_t                fHashMask;
+    /** The number of entries with dummy MAC addresses (see
+     * intnetR0IsMacAddrDummy).  Since these receive all unicast traffic, the hash
+     * can only be used when there are none. */
+    uint32_t                cDummyEntries;
+
     /** The number of interface entries currently in promicuous mode. */
     uint32_t                cPromiscuousEntries;
     /** The number of interface entries currently in promicuous mode that
@@ -1655,6 +1674,230 @@ DECL_FORCE_INLINE(bool) intnetR0AreMacAddrsEqual(PCRTMAC pDstAddr1, PCRTMAC pDst
 }
 
 
+/**
+ * Calculates the number of hash slots for a MAC address table.
+ *
+ * @returns Number of slots, a power of two at least twice the entry count so
+ *          the probing always finds a free slot.
+ * @param   cEntriesAllocated   The number of table entries.
+ */
+static uint32_t intnetR0MacTabCalcHashSlots(uint32_t cEntriesAllocated)
+{
+    uint32_t cSlots = INTNET_MACTAB_HASH_MIN_SLOTS;
+    while (cSlots < cEntriesAllocated * 2)
+        cSlots <<= 1;
+    return cSlots;
+}
+
+
+/**
+ * Allocates the MAC address table entries along with the hash.
+ *
+ * @returns Pointer to the entries (free with RTMemFree), NULL on failure.
+ * @param   cEntriesAllocated   The number of table entries.
+ * @param   ppaiHash            Where to return the hash slot array.
+ * @param   pfHashMask          Where to return the hash slot mask.
+ */
+static PINTNETMACTABENTRY intnetR0MacTabAlloc(uint32_t cEntriesAllocated, uint16_t **ppaiHash, uint32_t *pfHashMask)
+{
+    uint32_t const     cSlots    = intnetR0MacTabCalcHashSlots(cEntriesAllocated);
+    size_t const       cbEntries = RT_ALIGN_Z(sizeof(INTNETMACTABENTRY) * cEntriesAllocated, sizeof(uint64_t));
+    PINTNETMACTABENTRY paEntries = (PINTNETMACTABENTRY)RTMemAlloc(cbEntries + cSlots * sizeof(uint16_t));
+    if (paEntries)
+    {
+        *ppaiHash   = (uint16_t *)((uint8_t *)paEntries + cbEntries);
+        *pfHashMask = cSlots - 1;
+        memset(*ppaiHash, 0xff, cSlots * sizeof(uint16_t));
+    }
+    return paEntries;
+}
+
+
+/**
+ * Gets the first hash slot to probe for a MAC address.
+ *
+ * @returns Slot index.
+ * @param   pTab                The MAC address table.
+ * @param   pMacAddr            The address.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabHashSlot(PINTNETMACTAB pTab, PCRTMAC pMacAddr)
+{
+    /* The last three bytes (NIC specific) vary the most, so they go into the upper bits. */
+    uint32_t uHash = ((uint32_t)pMacAddr->au16[2] << 16 | pMacAddr->au16[1]) ^ pMacAddr->au16[0];
+    uHash *= UINT32_C(0x9e3779b1);
+    return (uHash >> 16) & pTab->fHashMask;
+}
+
+
+/**
+ * Looks up the next entry with the given MAC address in the hash.
+ *
+ * The caller must own the network spinlock.
+ *
+ * @returns Index into INTNETMACTAB::paEntries, UINT32_MAX if no more matches.
+ * @param   pTab                The MAC address table.
+ * @param   pMacAddr            The address to look for.
+ * @param   piSlot              The probe cursor, initialize it using
+ *                              intnetR0MacTabHashSlot.
+ */
+DECLINLINE(uint32_t) intnetR0MacTabHashNext(PINTNETMACTAB pTab, PCRTMAC pMacAddr, uint32_t *piSlot)
+{
+    for (;;)
+    {
+        uint32_t const iSlot  = *piSlot;
+        uint32_t const iEntry = pTab->paiHash[iSlot];
+        if (iEntry == INTNET_MACTAB_HASH_FREE)
+            return UINT32_MAX;
+        *piSlot = (iSlot + 1) & pTab->fHashMask;
+        if (intnetR0AreMacAddrsEqual(&pTab->paEntries[iEntry].MacAddr, pMacAddr))
+            return iEntry;
+    }
+}
+
+
+/**
+ * Adds an entry to the MAC address hash.
+ *
+ * The caller must own the network spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The index of the entry, with its address set.
+ */
+static void intnetR0MacTabHashInsert(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    if (intnetR0IsMacAddrDummy(&pTab->paEntries[iEntry].MacAddr))
+        pTab->cDummyEntries++;
+    else
+    {
+        uint32_t iSlot = intnetR0MacTabHashSlot(pTab, &pTab->paEntries[iEntry].MacAddr);
+        while (pTab->paiHash[iSlot] != INTNET_MACTAB_HASH_FREE)
+            iSlot = (iSlot + 1) & pTab->fHashMask;
+        pTab->paiHash[iSlot] = (uint16_t)iEntry;
+    }
+}
+
+
+/**
+ * Finds the hash slot of an entry.
+ *
+ * @returns Slot index.
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The index of the entry, with the address it
+ *                              was hashed with.
+ */
+static uint32_t intnetR0MacTabHashFindSlot(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    uint32_t iSlot = intnetR0MacTabHashSlot(pTab, &pTab->paEntries[iEntry].MacAddr);
+    while (pTab->paiHash[iSlot] != iEntry)
+    {
+        Assert(pTab->paiHash[iSlot] != INTNET_MACTAB_HASH_FREE);
+        iSlot = (iSlot + 1) & pTab->fHashMask;
+    }
+    return iSlot;
+}
+
+
+/**
+ * Removes an entry from the MAC address hash.
+ *
+ * The slots following it in the probe sequence are shifted back, so no
+ * tombstones are needed.  The caller must own the network spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The index of the entry, with the address it
+ *                              was hashed with.
+ */
+static void intnetR0MacTabHashRemove(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    if (intnetR0IsMacAddrDummy(&pTab->paEntries[iEntry].MacAddr))
+    {
+        Assert(pTab->cDummyEntries > 0);
+        pTab->cDummyEntries--;
+        return;
+    }
+
+    uint32_t iHole = intnetR0MacTabHashFindSlot(pTab, iEntry);
+    uint32_t iSlot = iHole;
+    for (;;)
+    {
+        iSlot = (iSlot + 1) & pTab->fHashMask;
+        uint32_t const iOther = pTab->paiHash[iSlot];
+        if (iOther == INTNET_MACTAB_HASH_FREE)
+            break;
+
+        /* Move the entry into the hole unless its home slot lies cyclically in (iHole, iSlot]. */
+        uint32_t const iHome = intnetR0MacTabHashSlot(pTab, &pTab->paEntries[iOther].MacAddr);
+        if (((iSlot - iHome) & pTab->fHashMask) >= ((iSlot - iHole) & pTab->fHashMask))
+        {
+            pTab->paiHash[iHole] = (uint16_t)iOther;
+            iHole = iSlot;
+        }
+    }
+    pTab->paiHash[iHole] = INTNET_MACTAB_HASH_FREE;
+}
+
+
+/**
+ * Changes the MAC address of an entry and updates the hash accordingly.
+ *
+ * The caller must own the network spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ * @param   pEntry              The entry.
+ * @param   pMacAddr            The new address.
+ */
+static void intnetR0MacTabSetMacAddr(PINTNETMACTAB pTab, PINTNETMACTABENTRY pEntry, PCRTMAC pMacAddr)
+{
+    uint32_t const iEntry = (uint32_t)(pEntry - pTab->paEntries);
+    Assert(iEntry < pTab->cEntries);
+    intnetR0MacTabHashRemove(pTab, iEntry);
+    pEntry->MacAddr = *pMacAddr;
+    intnetR0MacTabHashInsert(pTab, iEntry);
+}
+
+
+/**
+ * Removes an entry from the MAC address table.
+ *
+ * The last entry is moved into its place, so only the hash slot of that one
+ * needs updating.  The caller must own the network spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ * @param   iEntry              The index of the entry to remove.
+ */
+static void intnetR0MacTabRemoveEntry(PINTNETMACTAB pTab, uint32_t iEntry)
+{
+    uint32_t const iLast = pTab->cEntries - 1;
+    Assert(iEntry <= iLast);
+
+    intnetR0MacTabHashRemove(pTab, iEntry);
+    if (iEntry != iLast)
+    {
+        if (!intnetR0IsMacAddrDummy(&pTab->paEntries[iLast].MacAddr))
+            pTab->paiHash[intnetR0MacTabHashFindSlot(pTab, iLast)] = (uint16_t)iEntry;
+        pTab->paEntries[iEntry] = pTab->paEntries[iLast];
+    }
+    pTab->cEntries = iLast;
+}
+
+
+/**
+ * Rebuilds the MAC address hash and recounts the dummy entries.
+ *
+ * This must be called after the hash was reallocated.  The caller must own
+ * the network spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ */
+static void intnetR0MacTabRehash(PINTNETMACTAB pTab)
+{
+    memset(pTab->paiHash, 0xff, (pTab->fHashMask + 1) * sizeof(pTab->paiHash[0]));
+    pTab->cDummyEntries = 0;
+    for (uint32_t iEntry = 0; iEntry < pTab->cEntries; iEntry++)
+        intnetR0MacTabHashInsert(pTab, iEntry);
+}
+
+
 /**
  * Switch a unicast frame based on the network layer address (OSI level 3) and
  * return a destination table.
@@ -1787,6 +2030,37 @@ static INTNETSWDECISION intnetR0NetworkPreSwitchUnicast(PINTNETNETWORK pNetwork,
     PINTNETMACTAB       pTab            = &pNetwork->MacTab;
     RTSpinlockAcquire(pNetwork->hAddrSpinlock);
 
+    /* Without dummy entries only exact matches matter and the hash can be
+       used.  The scan below stops at the highest indexed match, so mimic that
+       when both the source and destination addresses are found. */
+    if (!pTab->cDummyEntries)
+    {
+        uint32_t iDst  = UINT32_MAX;
+        uint32_t iSlot = intnetR0MacTabHashSlot(pTab, pDstAddr);
+        uint32_t iEntry;
+        while ((iEntry = intnetR0MacTabHashNext(pTab, pDstAddr, &iSlot)) != UINT32_MAX)
+            if (   pTab->paEntries[iEntry].fActive
+                && (iDst == UINT32_MAX || iEntry > iDst))
+                iDst = iEntry;
+        if (iDst != UINT32_MAX)
+        {
+            if (pSrcAddr)
+            {
+                iSlot = intnetR0MacTabHashSlot(pTab, pSrcAddr);
+                while ((iEntry = intnetR0MacTabHashNext(pTab, pSrcAddr, &iSlot)) != UINT32_MAX)
+                    if (   pTab->paEntries[iEntry].fActive
+                        && iEntry >= iDst)
+                        break;
+            }
+            if (!pSrcAddr || iEntry == UINT32_MAX)
+                enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
+                              ? INTNETSWDECISION_BROADCAST
+                              : INTNETSWDECISION_INTNET;
+        }
+        RTSpinlockRelease(pNetwork->hAddrSpinlock);
+        return enmSwDecision;
+    }
+
     /* Iterate the internal network interfaces and look for matching source and
        destination addresses. */
     uint32_t iIfMac = pTab->cEntries;
@@ -1847,21 +2121,18 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
     pDstTab->pTrunk     = 0;
     pDstTab->cIfs       = 0;
 
-    /* Find exactly matching or promiscuous interfaces. */
     uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    if (   !pTab->cPromiscuousEntries
+        && !pTab->cDummyEntries)
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        /* Only exact matches can be destinations, use the hash. */
+        uint32_t iSlot = intnetR0MacTabHashSlot(pTab, pDstAddr);
+        uint32_t iIfMac;
+        while ((iIfMac = intnetR0MacTabHashNext(pTab, pDstAddr, &iSlot)) != UINT32_MAX)
         {
-            bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
-            if (   fExact
-                || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
-                || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                    || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
-               )
+            if (pTab->paEntries[iIfMac].fActive)
             {
-                cExactHits += fExact;
+                cExactHits++;
 
                 PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;        AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
                 if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
@@ -1873,29 +2144,62 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
                 }
             }
         }
+        if (pIfSender)
+            STAM_REL_COUNTER_INC(&pIfSender->pIntBuf->cStatMacLookupsHashed);
     }
-
-    /* Network only promicuous mode ifs should see related trunk traffic. */
-    if (   cExactHits
-        && fSrc
-        && pNetwork->MacTab.cPromiscuousNoTrunkEntries)
+    else
     {
-        iIfMac = pTab->cEntries;
+        /* Find exactly matching or promiscuous interfaces. */
+        uint32_t iIfMac     = pTab->cEntries;
         while (iIfMac-- > 0)
         {
-            if (   pTab->paEntries[iIfMac].fPromiscuousEff
-                && !pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                && pTab->paEntries[iIfMac].fActive
-                && !intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr)
-                && !intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr) )
+            if (pTab->paEntries[iIfMac].fActive)
             {
-                PINTNETIF pIf    = pTab->paEntries[iIfMac].pIf;     AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
-                uint32_t  iIfDst = pDstTab->cIfs++;
-                pDstTab->aIfs[iIfDst].pIf            = pIf;
-                pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
-                intnetR0BusyIncIf(pIf);
+                bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
+                if (   fExact
+                    || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
+                    || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
+                        || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
+                   )
+                {
+                    cExactHits += fExact;
+
+                    PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;        AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                    if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
+                    {
+                        uint32_t iIfDst = pDstTab->cIfs++;
+                        pDstTab->aIfs[iIfDst].pIf            = pIf;
+                        pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                        intnetR0BusyIncIf(pIf);
+                    }
+                }
+            }
+        }
+
+        /* Network only promicuous mode ifs should see related trunk traffic. */
+        if (   cExactHits
+            && fSrc
+            && pNetwork->MacTab.cPromiscuousNoTrunkEntries)
+        {
+            iIfMac = pTab->cEntries;
+            while (iIfMac-- > 0)
+            {
+                if (   pTab->paEntries[iIfMac].fPromiscuousEff
+                    && !pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
+                    && pTab->paEntries[iIfMac].fActive
+                    && !intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr)
+                    && !intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr) )
+                {
+                    PINTNETIF pIf    = pTab->paEntries[iIfMac].pIf;     AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                    uint32_t  iIfDst = pDstTab->cIfs++;
+                    pDstTab->aIfs[iIfDst].pIf            = pIf;
+                    pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                    intnetR0BusyIncIf(pIf);
+                }
             }
         }
+        if (pIfSender)
+            STAM_REL_COUNTER_INC(&pIfSender->pIntBuf->cStatMacLookupsScanned);
     }
 
     /* Does it match the host, or is the host promiscuous? */
@@ -2202,7 +2506,9 @@ static int intnetR0NetworkEnsureTabSpace(PINTNETNETWORK pNetwork)
              */
             if (RT_SUCCESS(rc))
             {
-                PINTNETMACTABENTRY paNew = (PINTNETMACTABENTRY)RTMemAlloc(sizeof(INTNETMACTABENTRY) * cAllocated);
+                uint16_t          *paiHash;
+                uint32_t           fHashMask;
+                PINTNETMACTABENTRY paNew = intnetR0MacTabAlloc(cAllocated, &paiHash, &fHashMask);
                 if (paNew)
                 {
                     RTSpinlockAcquire(pNetwork->hAddrSpinlock);
@@ -2219,6 +2525,9 @@ static int intnetR0NetworkEnsureTabSpace(PINTNETNETWORK pNetwork)
 
                     pTab->paEntries         = paNew;
                     pTab->cEntriesAllocated = cAllocated;
+                    pTab->paiHash           = paiHash;
+                    pTab->fHashMask         = fHashMask;
+                    intnetR0MacTabRehash(pTab);
 
                     RTSpinlockRelease(pNetwork->hAddrSpinlock);
 
@@ -2835,7 +3144,16 @@ static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PC
     if (RT_SUCCESS(rc))
     {
         pIf->cYields = 0;
-        RTSemEventSignal(pIf->hRecvEvent);
+
+        /*
+         * Only ring the doorbell when someone is (about to be) waiting on it,
+         * a receiver which is busy draining or polling the ring will find the
+         * frame without it.  The fence orders the ring write before the
+         * cSleepers read, IntNetR0IfWait does the opposite to avoid lost wakeups.
+         */
+        ASMMemoryFence();
+        if (ASMAtomicReadU32(&pIf->cSleepers))
+            RTSemEventSignal(pIf->hRecvEvent);
         return;
     }
 
@@ -3971,7 +4289,7 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 
         PINTNETMACTABENTRY pIfEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIfSender);
         if (pIfEntry)
-            pIfEntry->MacAddr = EthHdr.SrcMac;
+            intnetR0MacTabSetMacAddr(&pNetwork->MacTab, pIfEntry, &EthHdr.SrcMac);
         pIfSender->MacAddr    = EthHdr.SrcMac;
 
         RTSpinlockRelease(pNetwork->hAddrSpinlock);
@@ -4419,7 +4737,7 @@ INTNETR0DECL(int) IntNetR0IfSetMacAddress(INTNETIFHANDLE hIf, PSUPDRVSESSION pSe
             /* Update the two copies. */
             PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
             if (RT_LIKELY(pEntry))
-                pEntry->MacAddr = *pMac;
+                intnetR0MacTabSetMacAddr(&pNetwork->MacTab, pEntry, pMac);
             pIf->MacAddr        = *pMac;
             pIf->fMacSet        = true;
 
@@ -4680,7 +4998,10 @@ INTNETR0DECL(int) IntNetR0IfWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, ui
          * code must be aligned with the waiting code in intnetR0IfDestruct.
          */
         ASMAtomicIncU32(&pIf->cSleepers);
-        rc = RTSemEventWaitNoResume(hRecvEvent, cMillies);
+        if (!IntNetRingHasMoreToRead(&pIf->pIntBuf->Recv))
+            rc = RTSemEventWaitNoResume(hRecvEvent, cMillies);
+        else
+            rc = VINF_SUCCESS; /* intnetR0IfSend may have seen cSleepers == 0 and skipped the signal. */
         if (pIf->hRecvEvent == hRecvEvent)
         {
             ASMAtomicDecU32(&pIf->cSleepers);
@@ -4939,11 +5260,7 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
                 Assert(pNetwork->MacTab.cPromiscuousEntries        < pNetwork->MacTab.cEntries);
                 Assert(pNetwork->MacTab.cPromiscuousNoTrunkEntries < pNetwork->MacTab.cEntries);
 
-                if (iIf + 1 < pNetwork->MacTab.cEntries)
-                    memmove(&pNetwork->MacTab.paEntries[iIf],
-                            &pNetwork->MacTab.paEntries[iIf + 1],
-                            (pNetwork->MacTab.cEntries - iIf - 1) * sizeof(pNetwork->MacTab.paEntries[0]));
-                pNetwork->MacTab.cEntries--;
+                intnetR0MacTabRemoveEntry(&pNetwork->MacTab, iIf);
                 break;
             }
 
@@ -5182,6 +5499,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
                     pNetwork->MacTab.paEntries[iIf].pIf                  = pIf;
 
                     pNetwork->MacTab.cEntries = iIf + 1;
+                    intnetR0MacTabHashInsert(&pNetwork->MacTab, iIf);
                     pIf->pNetwork = pNetwork;
 
                     /*
@@ -5967,7 +6285,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
             && pIf->cBusy)
         {
             pIf->pNetwork = NULL;
-            pNetwork->MacTab.cEntries--;
+            intnetR0MacTabRemoveEntry(&pNetwork->MacTab, iIf - 1);
         }
     }
 
@@ -6010,6 +6328,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
     pNetwork->hAddrSpinlock = NIL_RTSPINLOCK;
     RTMemFree(pNetwork->MacTab.paEntries);
     pNetwork->MacTab.paEntries = NULL;
+    pNetwork->MacTab.paiHash   = NULL;
     for (int i = kIntNetAddrType_Invalid + 1; i < kIntNetAddrType_End; i++)
         intnetR0IfAddrCacheDestroy(&pNetwork->aAddrBlacklist[i]);
     RTMemFree(pNetwork);
@@ -6355,6 +6674,9 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     //pNetwork->MacTab.cPromiscuousEntries  = 0;
     //pNetwork->MacTab.cPromiscuousNoTrunkEntries = 0;
     pNetwork->MacTab.paEntries              = NULL;
+    pNetwork->MacTab.paiHash                = NULL;
+    //pNetwork->MacTab.fHashMask            = 0;
+    //pNetwork->MacTab.cDummyEntries        = 0;
     pNetwork->MacTab.fHostPromiscuousReal   = false;
     pNetwork->MacTab.fHostPromiscuousEff    = false;
     pNetwork->MacTab.fHostActive            = false;
@@ -6388,7 +6710,8 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
         rc = RTSpinlockCreate(&pNetwork->hAddrSpinlock, RTSPINLOCK_FLAGS_INTERRUPT_SAFE, "hAddrSpinlock");
     if (RT_SUCCESS(rc))
     {
-        pNetwork->MacTab.paEntries = (PINTNETMACTABENTRY)RTMemAlloc(sizeof(INTNETMACTABENTRY) * pNetwork->MacTab.cEntriesAllocated);
+        pNetwork->MacTab.paEntries = intnetR0MacTabAlloc(pNetwork->MacTab.cEntriesAllocated,
+                                                         &pNetwork->MacTab.paiHash, &pNetwork->MacTab.fHashMask);
         if (!pNetwork->MacTab.paEntries)
             rc = VERR_NO_MEMORY;
     }
@@ -6445,6 +6768,7 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     pNetwork->hAddrSpinlock = NIL_RTSPINLOCK;
     RTMemFree(pNetwork->MacTab.paEntries);
     pNetwork->MacTab.paEntries = NULL;
+    pNetwork->MacTab.paiHash   = NULL;
     RTMemFree(pNetwork);
 
     LogFlow(("intnetR0CreateNetwork: returns %Rrc\n", rc));
@@ -0,0 +1,1128 @@
+/* $Id$ */
+/** @file
+ * tstDevNetBench - Throughput and latency benchmark for the network devices (tstDevice plugin).
+ *
+ * Run with "tstDevice --plugin tstDevNetBench --module VBoxDD". Every testcase
+ * instantiates one network device, attaches a synthetic network driver to it
+ * and pushes frames through descriptor rings it sets up in the emulated guest
+ * RAM, like a guest driver would do.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_DEFAULT
+#include <VBox/types.h>
+#include <VBox/err.h>
+#include <VBox/vmm/pdmifs.h>
+#include <VBox/vmm/pdmnetifs.h>
+
+#include <iprt/asm.h>
+#include <iprt/mem.h>
+#include <iprt/sort.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+#include <iprt/uuid.h>
+
+#include "../../testcase/tstDevicePlugin.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+
+/** The MAC address of the device under test as a hex string for the configuration. */
+#define TSTDEVNET_MAC_CFG               "080027a1b2c3"
+/** Number of descriptors in each ring. */
+#define TSTDEVNET_RING_SIZE             256
+/** Size of the buffer behind every descriptor. */
+#define TSTDEVNET_BUF_SIZE              2048
+/** Number of frames posted before the device is kicked. */
+#define TSTDEVNET_BATCH                 32
+/** Number of frames sent in every run. */
+#define TSTDEVNET_PACKETS               _128K
+/** Number of timestamp slots for frames in flight, must be a power of two. */
+#define TSTDEVNET_TS_SLOTS              _4K
+/** Number of frames the loopback queue of the driver can hold. */
+#define TSTDEVNET_LOOPBACK_SLOTS        512
+/** How long to wait for a run to complete before giving up. */
+#define TSTDEVNET_TIMEOUT_NS            (UINT64_C(30) * RT_NS_1SEC)
+
+/** @name Guest physical memory layout.
+ * @{ */
+#define TSTDEVNET_GCPHYS_INIT_BLOCK     UINT32_C(0x00010000)
+#define TSTDEVNET_GCPHYS_TX_RING        UINT32_C(0x00020000)
+#define TSTDEVNET_GCPHYS_RX_RING        UINT32_C(0x00030000)
+#define TSTDEVNET_GCPHYS_TX_BUFS        UINT32_C(0x00100000)
+#define TSTDEVNET_GCPHYS_RX_BUFS        UINT32_C(0x00200000)
+#define TSTDEVNET_GCPHYS_END            UINT32_C(0x00300000)
+/** Where the MMIO BAR is mapped. */
+#define TSTDEVNET_GCPHYS_MMIO           UINT32_C(0xf0000000)
+/** Where the I/O BAR is mapped. */
+#define TSTDEVNET_IOPORT_BASE           0xd000
+/** @} */
+
+/** The ethertype of the frames (IEEE local experimental). */
+#define TSTDEVNET_ETHERTYPE             UINT16_C(0x88b5)
+/** Offset of the sequence number in the frames. */
+#define TSTDEVNET_OFF_SEQ               14
+
+/** @name E1000 registers and bits (82540EM).
+ * @{ */
+#define E1K_REG_CTRL                    0x0000
+#define E1K_REG_STATUS                  0x0008
+#define E1K_REG_IMC                     0x00d8
+#define E1K_REG_RCTL                    0x0100
+#define E1K_REG_TCTL                    0x0400
+#define E1K_REG_RDBAL                   0x2800
+#define E1K_REG_RDBAH                   0x2804
+#define E1K_REG_RDLEN                   0x2808
+#define E1K_REG_RDH                     0x2810
+#define E1K_REG_RDT                     0x2818
+#define E1K_REG_TDBAL                   0x3800
+#define E1K_REG_TDBAH                   0x3804
+#define E1K_REG_TDLEN                   0x3808
+#define E1K_REG_TDH                     0x3810
+#define E1K_REG_TDT                     0x3818
+#define E1K_CTRL_SLU                    RT_BIT_32(6)
+#define E1K_STATUS_LU                   RT_BIT_32(1)
+#define E1K_RCTL_EN                     RT_BIT_32(1)
+#define E1K_RCTL_UPE                    RT_BIT_32(3)
+#define E1K_RCTL_MPE                    RT_BIT_32(4)
+#define E1K_RCTL_BAM                    RT_BIT_32(15)
+#define E1K_TCTL_EN                     RT_BIT_32(1)
+#define E1K_TCTL_PSP                    RT_BIT_32(3)
+#define E1K_TXD_CMD_EOP                 RT_BIT(0)
+#define E1K_TXD_CMD_IFCS                RT_BIT(1)
+#define E1K_TXD_CMD_RS                  RT_BIT(3)
+#define E1K_RXD_STATUS_DD               RT_BIT(0)
+/** @} */
+
+/** @name PCnet registers and bits (word I/O mode, software style 2).
+ * @{ */
+#define PCNET_IO_RDP                    0x10
+#define PCNET_IO_RAP                    0x12
+#define PCNET_IO_RESET                  0x14
+#define PCNET_IO_BDP                    0x16
+#define PCNET_BCR_SWS                   20
+#define PCNET_CSR0_INIT                 RT_BIT(0)
+#define PCNET_CSR0_STRT                 RT_BIT(1)
+#define PCNET_CSR0_TDMD                 RT_BIT(3)
+#define PCNET_CSR0_IDON                 RT_BIT(8)
+#define PCNET_CSR0_TINT                 RT_BIT(9)
+#define PCNET_CSR0_RINT                 RT_BIT(10)
+#define PCNET_MODE_PROM                 RT_BIT(15)
+#define PCNET_DESC_OWN                  RT_BIT_32(31)
+#define PCNET_DESC_STP                  RT_BIT_32(25)
+#define PCNET_DESC_ENP                  RT_BIT_32(24)
+#define PCNET_DESC_ONES                 UINT32_C(0x0000f000)
+/** @} */
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+
+/**
+ * E1000 legacy transmit descriptor.
+ */
+typedef struct E1KTXDLEGACY
+{
+    uint64_t        u64BufAddr;
+    uint16_t        u16Length;
+    uint8_t         u8Cso;
+    uint8_t         u8Cmd;
+    uint8_t         u8Status;
+    uint8_t         u8Css;
+    uint16_t        u16Special;
+} E1KTXDLEGACY;
+AssertCompileSize(E1KTXDLEGACY, 16);
+
+/**
+ * E1000 receive descriptor.
+ */
+typedef struct E1KRXD
+{
+    uint64_t        u64BufAddr;
+    uint16_t        u16Length;
+    uint16_t        u16Checksum;
+    uint8_t         u8Status;
+    uint8_t         u8Errors;
+    uint16_t        u16Special;
+} E1KRXD;
+AssertCompileSize(E1KRXD, 16);
+
+/**
+ * PCnet descriptor in software style 2, same layout for receive and transmit.
+ */
+typedef struct PCNETDESC
+{
+    uint32_t        u32Addr;
+    uint32_t        u32Ctl;
+    uint32_t        u32Misc;
+    uint32_t        u32User;
+} PCNETDESC;
+AssertCompileSize(PCNETDESC, 16);
+
+/**
+ * PCnet 32-bit initialization block.
+ */
+#pragma pack(1)
+typedef struct PCNETINITBLK32
+{
+    uint16_t        u16Mode;
+    uint8_t         u8RLen;
+    uint8_t         u8TLen;
+    uint8_t         abPadr[6];
+    uint16_t        u16Reserved;
+    uint32_t        au32Ladrf[2];
+    uint32_t        u32Rdra;
+    uint32_t        u32Tdra;
+} PCNETINITBLK32;
+#pragma pack()
+AssertCompileSize(PCNETINITBLK32, 28);
+
+/**
+ * A frame queued by the driver for looping it back into the device.
+ */
+typedef struct TSTDEVNETFRAME
+{
+    /** Size of the frame. */
+    size_t          cb;
+    /** The frame data. */
+    uint8_t         ab[TSTDEVNET_BUF_SIZE];
+} TSTDEVNETFRAME;
+/** Pointer to a loopback frame. */
+typedef TSTDEVNETFRAME *PTSTDEVNETFRAME;
+
+/** Pointer to the benchmark state. */
+typedef struct TSTDEVNETBENCH *PTSTDEVNETBENCH;
+
+/**
+ * Device specific guest driver callbacks.
+ */
+typedef struct TSTDEVNETNIC
+{
+    /** Maps the device and sets up the rings, the link is up afterwards. */
+    DECLCALLBACKMEMBER(int, pfnInit)(PTSTDEVNETBENCH pThis);
+    /** Puts a frame into the next free transmit slot, returns false if the ring is full. */
+    DECLCALLBACKMEMBER(bool, pfnTxPost)(PTSTDEVNETBENCH pThis, uint32_t uSeq, size_t cbFrame);
+    /** Hands all posted frames to the device. */
+    DECLCALLBACKMEMBER(int, pfnTxKick)(PTSTDEVNETBENCH pThis);
+    /** Frees the transmit slots the device is done with. */
+    DECLCALLBACKMEMBER(void, pfnTxReap)(PTSTDEVNETBENCH pThis);
+    /** Processes received frames and gives the descriptors back to the device. */
+    DECLCALLBACKMEMBER(void, pfnRxReap)(PTSTDEVNETBENCH pThis);
+} TSTDEVNETNIC;
+/** Pointer to a const device specific callback table. */
+typedef const TSTDEVNETNIC *PCTSTDEVNETNIC;
+
+/**
+ * The benchmark state, also the synthetic network driver attached to the device.
+ */
+typedef struct TSTDEVNETBENCH
+{
+    /** The device under test. */
+    TSTDEVDUT           hDut;
+    /** The helpers to access the device under test. */
+    PCTSTDEVDUTHLP      pHlp;
+    /** The device specific callbacks. */
+    PCTSTDEVNETNIC      pNic;
+    /** The base interface of the status driver. */
+    PDMIBASE            IBaseStatus;
+    /** The base interface of the network driver. */
+    PDMIBASE            IBase;
+    /** The network interface of the driver. */
+    PDMINETWORKUP       INetworkUp;
+    /** The network interface of the device. */
+    PPDMINETWORKDOWN    pDown;
+    /** The last link state reported by the device. */
+    PDMNETWORKLINKSTATE enmLinkState;
+
+    /** Pointer to the guest RAM used for rings and buffers. */
+    uint8_t             *pbRam;
+    /** Next transmit descriptor to fill. */
+    uint32_t            iTxTail;
+    /** Oldest transmit descriptor not yet completed. */
+    uint32_t            iTxClean;
+    /** Next receive descriptor to check. */
+    uint32_t            iRxNext;
+    /** Current receive descriptor tail (E1000 only). */
+    uint32_t            iRxTail;
+
+    /** Whether the frames are looped back into the device or dropped. */
+    bool                fLoopback;
+    /** The loopback queue. */
+    PTSTDEVNETFRAME     paLoopback;
+    /** Producer index of the loopback queue. */
+    uint32_t            iLoopbackHead;
+    /** Consumer index of the loopback queue. */
+    uint32_t            iLoopbackTail;
+
+    /** Number of frames the driver got from the device. */
+    uint64_t            cFramesXmit;
+    /** Number of bytes the driver got from the device. */
+    uint64_t            cbXmit;
+    /** Number of frames received from the device. */
+    uint64_t            cFramesRecv;
+    /** Number of bytes received from the device. */
+    uint64_t            cbRecv;
+    /** Number of frames the driver dropped. */
+    uint64_t            cFramesDropped;
+    /** Timestamp of every frame in flight when it was posted, indexed by sequence number. */
+    uint64_t            au64TsPosted[TSTDEVNET_TS_SLOTS];
+    /** The per frame latencies of the current run. */
+    uint64_t            *pau64Latency;
+    /** Number of valid latency entries. */
+    uint32_t            cLatencies;
+} TSTDEVNETBENCH;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The benchmark state, there is only one device under test at a time. */
+static TSTDEVNETBENCH g_NetBench;
+/** MAC address matching TSTDEVNET_MAC_CFG. */
+static const RTMAC g_MacDut   = {{ 0x08, 0x00, 0x27, 0xa1, 0xb2, 0xc3 }};
+/** Source MAC address of the frames. */
+static const RTMAC g_MacPeer  = {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }};
+
+
+/*********************************************************************************************************************************
+*   Frame bookkeeping                                                                                                            *
+*********************************************************************************************************************************/
+
+/**
+ * Builds a frame with the given sequence number.
+ *
+ * @param   pbFrame     Where to build the frame.
+ * @param   uSeq        The sequence number.
+ * @param   cbFrame     Size of the frame.
+ */
+static void tstDevNetBenchFrameBuild(uint8_t *pbFrame, uint32_t uSeq, size_t cbFrame)
+{
+    memcpy(&pbFrame[0], &g_MacDut, sizeof(g_MacDut));
+    memcpy(&pbFrame[6], &g_MacPeer, sizeof(g_MacPeer));
+    pbFrame[12] = (uint8_t)(TSTDEVNET_ETHERTYPE >> 8);
+    pbFrame[13] = (uint8_t)TSTDEVNET_ETHERTYPE;
+    memcpy(&pbFrame[TSTDEVNET_OFF_SEQ], &uSeq, sizeof(uSeq));
+}
+
+
+/**
+ * Records the timestamp a frame was posted at.
+ *
+ * @param   pThis       The benchmark state.
+ * @param   uSeq        The sequence number of the frame.
+ */
+DECLINLINE(void) tstDevNetBenchFramePosted(PTSTDEVNETBENCH pThis, uint32_t uSeq)
+{
+    pThis->au64TsPosted[uSeq & (TSTDEVNET_TS_SLOTS - 1)] = RTTimeNanoTS();
+}
+
+
+/**
+ * Records the latency of a frame which reached the end of its path.
+ *
+ * @param   pThis       The benchmark state.
+ * @param   pbFrame     The frame.
+ * @param   cbFrame     Size of the frame.
+ */
+static void tstDevNetBenchFrameDone(PTSTDEVNETBENCH pThis, const uint8_t *pbFrame, size_t cbFrame)
+{
+    uint32_t uSeq;
+    if (cbFrame < TSTDEVNET_OFF_SEQ + sizeof(uSeq))
+        return;
+
+    memcpy(&uSeq, &pbFrame[TSTDEVNET_OFF_SEQ], sizeof(uSeq));
+    if (pThis->cLatencies < TSTDEVNET_PACKETS)
+        pThis->pau64Latency[pThis->cLatencies++] = RTTimeNanoTS() - pThis->au64TsPosted[uSeq & (TSTDEVNET_TS_SLOTS - 1)];
+}
+
+
+/*********************************************************************************************************************************
+*   Synthetic network driver                                                                                                     *
+*********************************************************************************************************************************/
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface, Status LUN}
+ */
+static DECLCALLBACK(void *) tstDevNetBenchStatus_QueryInterface(PPDMIBASE pInterface, const char *pszIID)
+{
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, pInterface);
+    return NULL;
+}
+
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface}
+ */
+static DECLCALLBACK(void *) tstDevNetBench_QueryInterface(PPDMIBASE pInterface, const char *pszIID)
+{
+    PTSTDEVNETBENCH pThis = RT_FROM_MEMBER(pInterface, TSTDEVNETBENCH, IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pThis->IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKUP, &pThis->INetworkUp);
+    return NULL;
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
+ */
+static DECLCALLBACK(int) tstDevNetBenchUp_BeginXmit(PPDMINETWORKUP pInterface, bool fOnWorkerThread)
+{
+    RT_NOREF(pInterface, fOnWorkerThread);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnAllocBuf}
+ */
+static DECLCALLBACK(int) tstDevNetBenchUp_AllocBuf(PPDMINETWORKUP pInterface, size_t cbMin,
+                                                   PCPDMNETWORKGSO pGso, PPPDMSCATTERGATHER ppSgBuf)
+{
+    RT_NOREF(pInterface);
+
+    PPDMSCATTERGATHER pSgBuf = (PPDMSCATTERGATHER)RTMemAlloc(  RT_ALIGN_Z(sizeof(*pSgBuf), 16)
+                                                             + RT_ALIGN_Z(cbMin, 16)
+                                                             + (pGso ? RT_ALIGN_Z(sizeof(*pGso), 16) : 0));
+    if (!pSgBuf)
+        return VERR_NO_MEMORY;
+
+    pSgBuf->fFlags         = PDMSCATTERGATHER_FLAGS_MAGIC | PDMSCATTERGATHER_FLAGS_OWNER_1;
+    pSgBuf->cbUsed         = 0;
+    pSgBuf->cbAvailable    = RT_ALIGN_Z(cbMin, 16);
+    pSgBuf->pvAllocator    = NULL;
+    if (!pGso)
+        pSgBuf->pvUser     = NULL;
+    else
+    {
+        pSgBuf->pvUser     = (uint8_t *)(pSgBuf + 1) + pSgBuf->cbAvailable;
+        *(PPDMNETWORKGSO)pSgBuf->pvUser = *pGso;
+    }
+    pSgBuf->cSegs          = 1;
+    pSgBuf->aSegs[0].cbSeg = pSgBuf->cbAvailable;
+    pSgBuf->aSegs[0].pvSeg = pSgBuf + 1;
+
+    *ppSgBuf = pSgBuf;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnFreeBuf}
+ */
+static DECLCALLBACK(int) tstDevNetBenchUp_FreeBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf)
+{
+    RT_NOREF(pInterface);
+    if (pSgBuf)
+    {
+        Assert((pSgBuf->fFlags & PDMSCATTERGATHER_FLAGS_MAGIC_MASK) == PDMSCATTERGATHER_FLAGS_MAGIC);
+        pSgBuf->fFlags = 0;
+        RTMemFree(pSgBuf);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSendBuf}
+ */
+static DECLCALLBACK(int) tstDevNetBenchUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGATHER pSgBuf, bool fOnWorkerThread)
+{
+    RT_NOREF(fOnWorkerThread);
+    PTSTDEVNETBENCH pThis = RT_FROM_MEMBER(pInterface, TSTDEVNETBENCH, INetworkUp);
+    Assert(pSgBuf->cSegs == 1);
+
+    const uint8_t *pbFrame = (const uint8_t *)pSgBuf->aSegs[0].pvSeg;
+    size_t const   cbFrame = pSgBuf->cbUsed;
+
+    pThis->cFramesXmit++;
+    pThis->cbXmit += cbFrame;
+
+    if (!pThis->fLoopback)
+        tstDevNetBenchFrameDone(pThis, pbFrame, cbFrame);
+    else if (   pSgBuf->pvUser /* GSO */
+             || cbFrame > TSTDEVNET_BUF_SIZE
+             || pThis->iLoopbackHead - pThis->iLoopbackTail >= TSTDEVNET_LOOPBACK_SLOTS)
+        pThis->cFramesDropped++;
+    else
+    {
+        /* Queue it, the frames are fed back into the device outside of its transmit path. */
+        PTSTDEVNETFRAME pFrame = &pThis->paLoopback[pThis->iLoopbackHead % TSTDEVNET_LOOPBACK_SLOTS];
+        memcpy(pFrame->ab, pbFrame, cbFrame);
+        pFrame->cb = cbFrame;
+        pThis->iLoopbackHead++;
+    }
+
+    return tstDevNetBenchUp_FreeBuf(pInterface, pSgBuf);
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnEndXmit}
+ */
+static DECLCALLBACK(void) tstDevNetBenchUp_EndXmit(PPDMINETWORKUP pInterface)
+{
+    RT_NOREF(pInterface);
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnSetPromiscuousMode}
+ */
+static DECLCALLBACK(void) tstDevNetBenchUp_SetPromiscuousMode(PPDMINETWORKUP pInterface, bool fPromiscuous)
+{
+    RT_NOREF(pInterface, fPromiscuous);
+}
+
+
+/**
+ * @interface_method_impl{PDMINETWORKUP,pfnNotifyLinkChanged}
+ */
+static DECLCALLBACK(void) tstDevNetBenchUp_NotifyLinkChanged(PPDMINETWORKUP pInterface, PDMNETWORKLINKSTATE enmLinkState)
+{
+    PTSTDEVNETBENCH pThis = RT_FROM_MEMBER(pInterface, TSTDEVNETBENCH, INetworkUp);
+    pThis->enmLinkState = enmLinkState;
+}
+
+
+/**
+ * Feeds the frames in the loopback queue into the receive path of the device.
+ *
+ * @param   pThis       The benchmark state.
+ */
+static void tstDevNetBenchLoopbackFlush(PTSTDEVNETBENCH pThis)
+{
+    while (pThis->iLoopbackTail != pThis->iLoopbackHead)
+    {
+        int rc = pThis->pDown->pfnWaitReceiveAvail(pThis->pDown, 0 /*cMillies*/);
+        if (RT_FAILURE(rc))
+        {
+            /* Give the processed descriptors back and try again. */
+            pThis->pNic->pfnRxReap(pThis);
+            rc = pThis->pDown->pfnWaitReceiveAvail(pThis->pDown, 0 /*cMillies*/);
+            if (RT_FAILURE(rc))
+                break;
+        }
+
+        PTSTDEVNETFRAME pFrame = &pThis->paLoopback[pThis->iLoopbackTail % TSTDEVNET_LOOPBACK_SLOTS];
+        rc = pThis->pDown->pfnReceive(pThis->pDown, pFrame->ab, pFrame->cb);
+        if (RT_FAILURE(rc))
+            break;
+        pThis->iLoopbackTail++;
+    }
+}
+
+
+/*********************************************************************************************************************************
+*   E1000 guest driver                                                                                                           *
+*********************************************************************************************************************************/
+
+DECLINLINE(uint32_t) tstDevNetE1kRegRead(PTSTDEVNETBENCH pThis, uint32_t offReg)
+{
+    uint32_t u32 = 0;
+    int rc = pThis->pHlp->pfnMmioRead(pThis->hDut, TSTDEVNET_GCPHYS_MMIO + offReg, &u32, sizeof(u32));
+    AssertRC(rc);
+    return u32;
+}
+
+
+DECLINLINE(void) tstDevNetE1kRegWrite(PTSTDEVNETBENCH pThis, uint32_t offReg, uint32_t u32)
+{
+    int rc = pThis->pHlp->pfnMmioWrite(pThis->hDut, TSTDEVNET_GCPHYS_MMIO + offReg, &u32, sizeof(u32));
+    AssertRC(rc);
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnInit}
+ */
+static DECLCALLBACK(int) tstDevNetE1kInit(PTSTDEVNETBENCH pThis)
+{
+    int rc = pThis->pHlp->pfnPciRegionMap(pThis->hDut, 0, TSTDEVNET_GCPHYS_MMIO);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    tstDevNetE1kRegWrite(pThis, E1K_REG_IMC, UINT32_MAX);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_CTRL, tstDevNetE1kRegRead(pThis, E1K_REG_CTRL) | E1K_CTRL_SLU);
+
+    /* The hard reset during construction brings the link up through a timer. */
+    uint64_t const nsStart = RTTimeNanoTS();
+    while (!(tstDevNetE1kRegRead(pThis, E1K_REG_STATUS) & E1K_STATUS_LU))
+    {
+        if (RTTimeNanoTS() - nsStart > TSTDEVNET_TIMEOUT_NS)
+            return VERR_TIMEOUT;
+        uint64_t cNsNext = pThis->pHlp->pfnTimersRun(pThis->hDut);
+        RTThreadSleep(RT_MIN(cNsNext / RT_NS_1MS, 10));
+    }
+
+    /* Transmit ring, empty. */
+    E1KTXDLEGACY *paTxD = (E1KTXDLEGACY *)&pThis->pbRam[TSTDEVNET_GCPHYS_TX_RING];
+    RT_BZERO(paTxD, TSTDEVNET_RING_SIZE * sizeof(*paTxD));
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDBAL, TSTDEVNET_GCPHYS_TX_RING);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDBAH, 0);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDLEN, TSTDEVNET_RING_SIZE * sizeof(*paTxD));
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDH, 0);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDT, 0);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TCTL, E1K_TCTL_EN | E1K_TCTL_PSP);
+
+    /* Receive ring, everything but one descriptor belongs to the device. */
+    E1KRXD *paRxD = (E1KRXD *)&pThis->pbRam[TSTDEVNET_GCPHYS_RX_RING];
+    RT_BZERO(paRxD, TSTDEVNET_RING_SIZE * sizeof(*paRxD));
+    for (uint32_t i = 0; i < TSTDEVNET_RING_SIZE; i++)
+        paRxD[i].u64BufAddr = TSTDEVNET_GCPHYS_RX_BUFS + i * TSTDEVNET_BUF_SIZE;
+    pThis->iRxTail = TSTDEVNET_RING_SIZE - 1;
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RDBAL, TSTDEVNET_GCPHYS_RX_RING);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RDBAH, 0);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RDLEN, TSTDEVNET_RING_SIZE * sizeof(*paRxD));
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RDH, 0);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RDT, pThis->iRxTail);
+    tstDevNetE1kRegWrite(pThis, E1K_REG_RCTL, E1K_RCTL_EN | E1K_RCTL_UPE | E1K_RCTL_MPE | E1K_RCTL_BAM);
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxPost}
+ */
+static DECLCALLBACK(bool) tstDevNetE1kTxPost(PTSTDEVNETBENCH pThis, uint32_t uSeq, size_t cbFrame)
+{
+    uint32_t const iNext = (pThis->iTxTail + 1) % TSTDEVNET_RING_SIZE;
+    if (iNext == pThis->iTxClean)
+        return false;
+
+    RTGCPHYS GCPhysBuf = TSTDEVNET_GCPHYS_TX_BUFS + pThis->iTxTail * TSTDEVNET_BUF_SIZE;
+    tstDevNetBenchFrameBuild(&pThis->pbRam[GCPhysBuf], uSeq, cbFrame);
+
+    E1KTXDLEGACY *pTxD = &((E1KTXDLEGACY *)&pThis->pbRam[TSTDEVNET_GCPHYS_TX_RING])[pThis->iTxTail];
+    pTxD->u64BufAddr = GCPhysBuf;
+    pTxD->u16Length  = (uint16_t)cbFrame;
+    pTxD->u8Cso      = 0;
+    pTxD->u8Cmd      = E1K_TXD_CMD_EOP | E1K_TXD_CMD_IFCS | E1K_TXD_CMD_RS;
+    pTxD->u8Status   = 0;
+    pTxD->u8Css      = 0;
+    pTxD->u16Special = 0;
+
+    pThis->iTxTail = iNext;
+    return true;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxKick}
+ */
+static DECLCALLBACK(int) tstDevNetE1kTxKick(PTSTDEVNETBENCH pThis)
+{
+    tstDevNetE1kRegWrite(pThis, E1K_REG_TDT, pThis->iTxTail);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxReap}
+ */
+static DECLCALLBACK(void) tstDevNetE1kTxReap(PTSTDEVNETBENCH pThis)
+{
+    /* Everything before the head was processed. */
+    pThis->iTxClean = tstDevNetE1kRegRead(pThis, E1K_REG_TDH) % TSTDEVNET_RING_SIZE;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnRxReap}
+ */
+static DECLCALLBACK(void) tstDevNetE1kRxReap(PTSTDEVNETBENCH pThis)
+{
+    E1KRXD *paRxD = (E1KRXD *)&pThis->pbRam[TSTDEVNET_GCPHYS_RX_RING];
+    uint32_t cReaped = 0;
+
+    while (paRxD[pThis->iRxNext].u8Status & E1K_RXD_STATUS_DD)
+    {
+        E1KRXD *pRxD = &paRxD[pThis->iRxNext];
+        pThis->cFramesRecv++;
+        pThis->cbRecv += pRxD->u16Length;
+        tstDevNetBenchFrameDone(pThis, &pThis->pbRam[pRxD->u64BufAddr], pRxD->u16Length);
+
+        pRxD->u8Status = 0;
+        pRxD->u8Errors = 0;
+        pRxD->u16Length = 0;
+        pThis->iRxNext = (pThis->iRxNext + 1) % TSTDEVNET_RING_SIZE;
+        cReaped++;
+    }
+
+    /* The descriptor at the tail is always a processed one, so the tail just moves on. */
+    if (cReaped)
+    {
+        pThis->iRxTail = (pThis->iRxTail + cReaped) % TSTDEVNET_RING_SIZE;
+        tstDevNetE1kRegWrite(pThis, E1K_REG_RDT, pThis->iRxTail);
+    }
+}
+
+
+/**
+ * The E1000 guest driver.
+ */
+static const TSTDEVNETNIC g_NicE1k =
+{
+    tstDevNetE1kInit,
+    tstDevNetE1kTxPost,
+    tstDevNetE1kTxKick,
+    tstDevNetE1kTxReap,
+    tstDevNetE1kRxReap
+};
+
+
+/*********************************************************************************************************************************
+*   PCnet guest driver                                                                                                           *
+*********************************************************************************************************************************/
+
+DECLINLINE(uint16_t) tstDevNetPcnetCsrRead(PTSTDEVNETBENCH pThis, uint32_t iCsr)
+{
+    uint32_t u32 = 0;
+    pThis->pHlp->pfnIoPortWrite(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RAP, iCsr, sizeof(uint16_t));
+    pThis->pHlp->pfnIoPortRead(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RDP, &u32, sizeof(uint16_t));
+    return (uint16_t)u32;
+}
+
+
+DECLINLINE(void) tstDevNetPcnetCsrWrite(PTSTDEVNETBENCH pThis, uint32_t iCsr, uint16_t u16)
+{
+    pThis->pHlp->pfnIoPortWrite(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RAP, iCsr, sizeof(uint16_t));
+    pThis->pHlp->pfnIoPortWrite(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RDP, u16, sizeof(uint16_t));
+}
+
+
+DECLINLINE(void) tstDevNetPcnetBcrWrite(PTSTDEVNETBENCH pThis, uint32_t iBcr, uint16_t u16)
+{
+    pThis->pHlp->pfnIoPortWrite(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RAP, iBcr, sizeof(uint16_t));
+    pThis->pHlp->pfnIoPortWrite(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_BDP, u16, sizeof(uint16_t));
+}
+
+
+/**
+ * Gives a receive descriptor to the device.
+ */
+DECLINLINE(void) tstDevNetPcnetRxDescArm(PCNETDESC *pRxD)
+{
+    pRxD->u32Misc = 0;
+    ASMAtomicWriteU32(&pRxD->u32Ctl,
+                      PCNET_DESC_OWN | PCNET_DESC_ONES | ((uint32_t)-TSTDEVNET_BUF_SIZE & 0xfff));
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnInit}
+ */
+static DECLCALLBACK(int) tstDevNetPcnetInit(PTSTDEVNETBENCH pThis)
+{
+    int rc = pThis->pHlp->pfnPciRegionMap(pThis->hDut, 0, TSTDEVNET_IOPORT_BASE);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Software reset and switch to the 32-bit software style 2. */
+    uint32_t u32Dummy;
+    pThis->pHlp->pfnIoPortRead(pThis->hDut, TSTDEVNET_IOPORT_BASE + PCNET_IO_RESET, &u32Dummy, sizeof(uint16_t));
+    tstDevNetPcnetBcrWrite(pThis, PCNET_BCR_SWS, 2);
+
+    PCNETDESC *paTxD = (PCNETDESC *)&pThis->pbRam[TSTDEVNET_GCPHYS_TX_RING];
+    RT_BZERO(paTxD, TSTDEVNET_RING_SIZE * sizeof(*paTxD));
+    PCNETDESC *paRxD = (PCNETDESC *)&pThis->pbRam[TSTDEVNET_GCPHYS_RX_RING];
+    for (uint32_t i = 0; i < TSTDEVNET_RING_SIZE; i++)
+    {
+        paRxD[i].u32Addr = TSTDEVNET_GCPHYS_RX_BUFS + i * TSTDEVNET_BUF_SIZE;
+        paRxD[i].u32User = 0;
+        tstDevNetPcnetRxDescArm(&paRxD[i]);
+    }
+
+    PCNETINITBLK32 *pInitBlk = (PCNETINITBLK32 *)&pThis->pbRam[TSTDEVNET_GCPHYS_INIT_BLOCK];
+    RT_ZERO(*pInitBlk);
+    pInitBlk->u16Mode = PCNET_MODE_PROM;
+    pInitBlk->u8RLen  = (uint8_t)(ASMBitFirstSetU32(TSTDEVNET_RING_SIZE) - 1) << 4;
+    pInitBlk->u8TLen  = (uint8_t)(ASMBitFirstSetU32(TSTDEVNET_RING_SIZE) - 1) << 4;
+    memcpy(pInitBlk->abPadr, &g_MacDut, sizeof(g_MacDut));
+    pInitBlk->u32Rdra = TSTDEVNET_GCPHYS_RX_RING;
+    pInitBlk->u32Tdra = TSTDEVNET_GCPHYS_TX_RING;
+
+    tstDevNetPcnetCsrWrite(pThis, 1, RT_LO_U16(TSTDEVNET_GCPHYS_INIT_BLOCK));
+    tstDevNetPcnetCsrWrite(pThis, 2, RT_HI_U16(TSTDEVNET_GCPHYS_INIT_BLOCK));
+    tstDevNetPcnetCsrWrite(pThis, 0, PCNET_CSR0_INIT);
+
+    uint64_t const nsStart = RTTimeNanoTS();
+    while (!(tstDevNetPcnetCsrRead(pThis, 0) & PCNET_CSR0_IDON))
+    {
+        if (RTTimeNanoTS() - nsStart > TSTDEVNET_TIMEOUT_NS)
+            return VERR_TIMEOUT;
+        uint64_t cNsNext = pThis->pHlp->pfnTimersRun(pThis->hDut);
+        RTThreadSleep(RT_MIN(cNsNext / RT_NS_1MS, 10));
+    }
+
+    /* Acknowledge IDON and start, interrupts stay disabled. */
+    tstDevNetPcnetCsrWrite(pThis, 0, PCNET_CSR0_IDON | PCNET_CSR0_STRT);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxPost}
+ */
+static DECLCALLBACK(bool) tstDevNetPcnetTxPost(PTSTDEVNETBENCH pThis, uint32_t uSeq, size_t cbFrame)
+{
+    uint32_t const iNext = (pThis->iTxTail + 1) % TSTDEVNET_RING_SIZE;
+    if (iNext == pThis->iTxClean)
+        return false;
+
+    uint32_t GCPhysBuf = TSTDEVNET_GCPHYS_TX_BUFS + pThis->iTxTail * TSTDEVNET_BUF_SIZE;
+    tstDevNetBenchFrameBuild(&pThis->pbRam[GCPhysBuf], uSeq, cbFrame);
+
+    PCNETDESC *pTxD = &((PCNETDESC *)&pThis->pbRam[TSTDEVNET_GCPHYS_TX_RING])[pThis->iTxTail];
+    pTxD->u32Addr = GCPhysBuf;
+    pTxD->u32Misc = 0;
+    ASMAtomicWriteU32(&pTxD->u32Ctl,   PCNET_DESC_OWN | PCNET_DESC_STP | PCNET_DESC_ENP | PCNET_DESC_ONES
+                                     | ((uint32_t)-(int32_t)cbFrame & 0xfff));
+
+    pThis->iTxTail = iNext;
+    return true;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxKick}
+ */
+static DECLCALLBACK(int) tstDevNetPcnetTxKick(PTSTDEVNETBENCH pThis)
+{
+    /* Acknowledge the pending interrupt causes while at it. */
+    tstDevNetPcnetCsrRead(pThis, 0);
+    tstDevNetPcnetCsrWrite(pThis, 0, PCNET_CSR0_TDMD | PCNET_CSR0_TINT | PCNET_CSR0_RINT);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnTxReap}
+ */
+static DECLCALLBACK(void) tstDevNetPcnetTxReap(PTSTDEVNETBENCH pThis)
+{
+    PCNETDESC *paTxD = (PCNETDESC *)&pThis->pbRam[TSTDEVNET_GCPHYS_TX_RING];
+    while (   pThis->iTxClean != pThis->iTxTail
+           && !(ASMAtomicReadU32(&paTxD[pThis->iTxClean].u32Ctl) & PCNET_DESC_OWN))
+        pThis->iTxClean = (pThis->iTxClean + 1) % TSTDEVNET_RING_SIZE;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVNETNIC,pfnRxReap}
+ */
+static DECLCALLBACK(void) tstDevNetPcnetRxReap(PTSTDEVNETBENCH pThis)
+{
+    PCNETDESC *paRxD = (PCNETDESC *)&pThis->pbRam[TSTDEVNET_GCPHYS_RX_RING];
+    while (!(ASMAtomicReadU32(&paRxD[pThis->iRxNext].u32Ctl) & PCNET_DESC_OWN))
+    {
+        PCNETDESC *pRxD = &paRxD[pThis->iRxNext];
+        size_t cbFrame = pRxD->u32Misc & 0xfff;
+        pThis->cFramesRecv++;
+        pThis->cbRecv += cbFrame;
+        tstDevNetBenchFrameDone(pThis, &pThis->pbRam[pRxD->u32Addr], cbFrame);
+
+        tstDevNetPcnetRxDescArm(pRxD);
+        pThis->iRxNext = (pThis->iRxNext + 1) % TSTDEVNET_RING_SIZE;
+    }
+}
+
+
+/**
+ * The PCnet guest driver.
+ */
+static const TSTDEVNETNIC g_NicPcnet =
+{
+    tstDevNetPcnetInit,
+    tstDevNetPcnetTxPost,
+    tstDevNetPcnetTxKick,
+    tstDevNetPcnetTxReap,
+    tstDevNetPcnetRxReap
+};
+
+
+/*********************************************************************************************************************************
+*   The benchmark                                                                                                                *
+*********************************************************************************************************************************/
+
+/**
+ * @callback_method_impl{FNRTSORTCMP}
+ */
+static DECLCALLBACK(int) tstDevNetBenchCmpU64(void const *pvElement1, void const *pvElement2, void *pvUser)
+{
+    RT_NOREF(pvUser);
+    uint64_t const u64First  = *(uint64_t const *)pvElement1;
+    uint64_t const u64Second = *(uint64_t const *)pvElement2;
+    return u64First < u64Second ? -1 : u64First > u64Second ? 1 : 0;
+}
+
+
+/**
+ * Pushes TSTDEVNET_PACKETS frames through the device and reports the results.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The benchmark state.
+ * @param   pszDev      The device name for the report.
+ * @param   fLoopback   Whether the frames are looped back into the device
+ *                      (transmit and receive path) or dropped by the driver
+ *                      (transmit path only).
+ * @param   cbFrame     Size of the frames.
+ */
+static int tstDevNetBenchRun(PTSTDEVNETBENCH pThis, const char *pszDev, bool fLoopback, size_t cbFrame)
+{
+    const char *pszMode = fLoopback ? "loopback" : "tx";
+    RTTestIPrintf(RTTESTLVL_ALWAYS, "%s: %s, %u frames of %zu bytes\n", pszDev, pszMode, TSTDEVNET_PACKETS, cbFrame);
+
+    pThis->fLoopback      = fLoopback;
+    pThis->cFramesXmit    = 0;
+    pThis->cbXmit         = 0;
+    pThis->cFramesRecv    = 0;
+    pThis->cbRecv         = 0;
+    pThis->cFramesDropped = 0;
+    pThis->cLatencies     = 0;
+    pThis->pHlp->pfnStatsReset(pThis->hDut, NULL);
+
+    uint64_t * const pcFramesDone = fLoopback ? &pThis->cFramesRecv : &pThis->cFramesXmit;
+    uint32_t uSeq = 0;
+    uint64_t const nsStart = RTTimeNanoTS();
+    while (*pcFramesDone + pThis->cFramesDropped < TSTDEVNET_PACKETS)
+    {
+        uint32_t cPosted = 0;
+        while (   cPosted < TSTDEVNET_BATCH
+               && uSeq < TSTDEVNET_PACKETS
+               && pThis->pNic->pfnTxPost(pThis, uSeq, cbFrame))
+        {
+            tstDevNetBenchFramePosted(pThis, uSeq);
+            uSeq++;
+            cPosted++;
+        }
+
+        if (cPosted)
+            pThis->pNic->pfnTxKick(pThis);
+        pThis->pNic->pfnTxReap(pThis);
+        if (fLoopback)
+            tstDevNetBenchLoopbackFlush(pThis);
+        pThis->pNic->pfnRxReap(pThis);
+        pThis->pHlp->pfnTimersRun(pThis->hDut);
+
+        if (RTTimeNanoTS() - nsStart > TSTDEVNET_TIMEOUT_NS)
+        {
+            RTTestIFailed("%s: %s run timed out after %RU64 of %u frames", pszDev, pszMode, *pcFramesDone, TSTDEVNET_PACKETS);
+            return VERR_TIMEOUT;
+        }
+    }
+    uint64_t const cNsElapsed = RT_MAX(RTTimeNanoTS() - nsStart, 1);
+
+    uint64_t const cFrames = *pcFramesDone;
+    uint64_t const cbTotal = fLoopback ? pThis->cbRecv : pThis->cbXmit;
+    RTTestIValueF(cFrames * RT_NS_1SEC / cNsElapsed, RTTESTUNIT_PACKETS_PER_SEC, "%s/%s/%zu throughput", pszDev, pszMode, cbFrame);
+    RTTestIValueF(cbTotal * RT_NS_1SEC / cNsElapsed, RTTESTUNIT_BYTES_PER_SEC,   "%s/%s/%zu bandwidth", pszDev, pszMode, cbFrame);
+    RTTestIValueF(cNsElapsed / RT_MAX(cFrames, 1),   RTTESTUNIT_NS_PER_PACKET,   "%s/%s/%zu cost", pszDev, pszMode, cbFrame);
+    if (pThis->cFramesDropped)
+        RTTestIValueF(pThis->cFramesDropped, RTTESTUNIT_PACKETS, "%s/%s/%zu dropped", pszDev, pszMode, cbFrame);
+
+    if (pThis->cLatencies)
+    {
+        RTSortShell(pThis->pau64Latency, pThis->cLatencies, sizeof(pThis->pau64Latency[0]), tstDevNetBenchCmpU64, NULL);
+        uint32_t const c = pThis->cLatencies;
+        RTTestIValueF(pThis->pau64Latency[c / 2],               RTTESTUNIT_NS, "%s/%s/%zu latency p50",  pszDev, pszMode, cbFrame);
+        RTTestIValueF(pThis->pau64Latency[(c * 99) / 100],      RTTESTUNIT_NS, "%s/%s/%zu latency p99",  pszDev, pszMode, cbFrame);
+        RTTestIValueF(pThis->pau64Latency[(c * 999) / 1000],    RTTESTUNIT_NS, "%s/%s/%zu latency p999", pszDev, pszMode, cbFrame);
+        RTTestIValueF(pThis->pau64Latency[c - 1],               RTTESTUNIT_NS, "%s/%s/%zu latency max",  pszDev, pszMode, cbFrame);
+    }
+
+    if (RTTestIErrorCount() == 0 && cFrames != TSTDEVNET_PACKETS)
+        RTTestIFailed("%s: %s run completed only %RU64 of %u frames", pszDev, pszMode, cFrames, TSTDEVNET_PACKETS);
+
+    pThis->pHlp->pfnStatsDump(pThis->hDut, NULL);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Common testcase entry point.
+ *
+ * @returns VBox status code.
+ * @param   hDut        The device under test.
+ * @param   pHlp        The helpers to access the device.
+ * @param   pNic        The device specific guest driver.
+ * @param   pszDev      The device name for the report.
+ */
+static int tstDevNetBenchEntry(TSTDEVDUT hDut, PCTSTDEVDUTHLP pHlp, PCTSTDEVNETNIC pNic, const char *pszDev)
+{
+    PTSTDEVNETBENCH pThis = &g_NetBench;
+    if (!pThis->pDown)
+    {
+        RTTestIFailed("%s: The device did not attach to the network driver", pszDev);
+        return VERR_PDM_MISSING_INTERFACE_ABOVE;
+    }
+
+    pThis->hDut = hDut;
+    pThis->pHlp = pHlp;
+    pThis->pNic = pNic;
+
+    void *pvRam = NULL;
+    int rc = pHlp->pfnPhysGetPtr(hDut, 0, TSTDEVNET_GCPHYS_END, &pvRam);
+    if (RT_FAILURE(rc))
+        return rc;
+    pThis->pbRam = (uint8_t *)pvRam;
+
+    pThis->paLoopback   = (PTSTDEVNETFRAME)RTMemAllocZ(TSTDEVNET_LOOPBACK_SLOTS * sizeof(TSTDEVNETFRAME));
+    pThis->pau64Latency = (uint64_t *)RTMemAllocZ(TSTDEVNET_PACKETS * sizeof(uint64_t));
+    if (pThis->paLoopback && pThis->pau64Latency)
+    {
+        rc = pNic->pfnInit(pThis);
+        if (RT_SUCCESS(rc))
+        {
+            static const size_t s_acbFrames[] = { 60, 1514 };
+            for (unsigned i = 0; i < RT_ELEMENTS(s_acbFrames) && RT_SUCCESS(rc); i++)
+            {
+                rc = tstDevNetBenchRun(pThis, pszDev, false /*fLoopback*/, s_acbFrames[i]);
+                if (RT_SUCCESS(rc))
+                    rc = tstDevNetBenchRun(pThis, pszDev, true /*fLoopback*/, s_acbFrames[i]);
+            }
+        }
+        else
+            RTTestIFailed("%s: Initializing the device failed with %Rrc", pszDev, rc);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    RTMemFree(pThis->pau64Latency);
+    RTMemFree(pThis->paLoopback);
+    RT_ZERO(*pThis);
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVTESTCASEREG,pfnDrvAttach}
+ */
+static DECLCALLBACK(int) tstDevNetBenchDrvAttach(TSTDEVDUT hDut, uint32_t iLun, PPDMIBASE pDevBase, PPDMIBASE *ppDrvBase)
+{
+    RT_NOREF(hDut);
+    PTSTDEVNETBENCH pThis = &g_NetBench;
+
+    if (iLun == PDM_STATUS_LUN)
+    {
+        pThis->IBaseStatus.pfnQueryInterface = tstDevNetBenchStatus_QueryInterface;
+        *ppDrvBase = &pThis->IBaseStatus;
+        return VINF_SUCCESS;
+    }
+
+    if (iLun != 0)
+        return VERR_PDM_NO_ATTACHED_DRIVER;
+
+    pThis->pDown = PDMIBASE_QUERY_INTERFACE(pDevBase, PDMINETWORKDOWN);
+    if (!pThis->pDown)
+        return VERR_PDM_MISSING_INTERFACE_ABOVE;
+
+    pThis->IBase.pfnQueryInterface              = tstDevNetBench_QueryInterface;
+    pThis->INetworkUp.pfnBeginXmit              = tstDevNetBenchUp_BeginXmit;
+    pThis->INetworkUp.pfnAllocBuf               = tstDevNetBenchUp_AllocBuf;
+    pThis->INetworkUp.pfnFreeBuf                = tstDevNetBenchUp_FreeBuf;
+    pThis->INetworkUp.pfnSendBuf                = tstDevNetBenchUp_SendBuf;
+    pThis->INetworkUp.pfnEndXmit                = tstDevNetBenchUp_EndXmit;
+    pThis->INetworkUp.pfnSetPromiscuousMode     = tstDevNetBenchUp_SetPromiscuousMode;
+    pThis->INetworkUp.pfnNotifyLinkChanged      = tstDevNetBenchUp_NotifyLinkChanged;
+    pThis->enmLinkState                         = PDMNETWORKLINKSTATE_UP;
+    *ppDrvBase = &pThis->IBase;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVTESTCASEREG,pfnTestEntry, E1000}
+ */
+static DECLCALLBACK(int) tstDevNetBenchE1kEntry(TSTDEVDUT hDut, PCTSTDEVDUTHLP pHlp)
+{
+    return tstDevNetBenchEntry(hDut, pHlp, &g_NicE1k, "e1000");
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVTESTCASEREG,pfnTestEntry, PCnet}
+ */
+static DECLCALLBACK(int) tstDevNetBenchPcnetEntry(TSTDEVDUT hDut, PCTSTDEVDUTHLP pHlp)
+{
+    return tstDevNetBenchEntry(hDut, pHlp, &g_NicPcnet, "pcnet");
+}
+
+
+/** E1000 configuration, no R0/RC code and no link up delay. */
+static const TSTDEVCFGITEM g_aCfgE1k[] =
+{
+    {"MAC",            TSTDEVCFGITEMTYPE_BYTES,   TSTDEVNET_MAC_CFG },
+    {"CableConnected", TSTDEVCFGITEMTYPE_INTEGER, "1"               },
+    {"AdapterType",    TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {"GCEnabled",      TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {"R0Enabled",      TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {"LinkUpDelay",    TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {NULL,             TSTDEVCFGITEMTYPE_INVALID, NULL              }
+};
+
+/** PCnet configuration. */
+static const TSTDEVCFGITEM g_aCfgPcnet[] =
+{
+    {"MAC",            TSTDEVCFGITEMTYPE_BYTES,   TSTDEVNET_MAC_CFG },
+    {"CableConnected", TSTDEVCFGITEMTYPE_INTEGER, "1"               },
+    {"GCEnabled",      TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {"R0Enabled",      TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {"LinkUpDelay",    TSTDEVCFGITEMTYPE_INTEGER, "0"               },
+    {NULL,             TSTDEVCFGITEMTYPE_INVALID, NULL              }
+};
+
+/** The testcases. */
+static const TSTDEVTESTCASEREG g_aTestcases[] =
+{
+    {
+        "e1000",
+        "E1000 throughput and latency",
+        "e1000",
+        0,
+        &g_aCfgE1k[0],
+        tstDevNetBenchDrvAttach,
+        tstDevNetBenchE1kEntry
+    },
+    {
+        "pcnet",
+        "PCnet throughput and latency",
+        "pcnet",
+        0,
+        &g_aCfgPcnet[0],
+        tstDevNetBenchDrvAttach,
+        tstDevNetBenchPcnetEntry
+    }
+};
+
+
+/**
+ * @copydoc FNTSTDEVPLUGINLOAD
+ */
+extern "C" DECLEXPORT(int) TSTDevPluginLoad(void *pvUser, PTSTDEVPLUGINREGISTER pRegisterCallbacks)
+{
+    int rc = VINF_SUCCESS;
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aTestcases) && RT_SUCCESS(rc); i++)
+        rc = pRegisterCallbacks->pfnRegisterTestcase(pvUser, &g_aTestcases[i]);
+    return rc;
+}
@@ -216,6 +216,9 @@ AssertCompileSize(CmdHdr, 32);
 /** Pointer to a task state. */
 typedef struct AHCIREQ *PAHCIREQ;
 
+/** Maximum number of guest pages which can be mapped for a request (1MB with 4K pages). */
+#define AHCI_REQ_MAPPED_PAGES_MAX 256
+
 /** Task encountered a buffer overflow. */
 #define AHCI_REQ_OVERFLOW    RT_BIT_32(0)
 /** Request is a PIO data command, if this flag is not set it either is
@@ -262,10 +265,13 @@ typedef struct AHCIREQ
     uint32_t                   fFlags;
     /** SCSI status code. */
     uint8_t                    u8ScsiSts;
-    /** Flag when the buffer is mapped. */
-    bool                       fMapped;
-    /** Page lock when the buffer is mapped. */
-    PGMPAGEMAPLOCK             PgLck;
+    /** Number of guest pages mapped for the buffer. */
+    uint32_t                   cPgLcks;
+    /** Page locks when the buffer is mapped, allocated together with paSegs
+     * when the buffer is queried and freed when the request completes. */
+    PPGMPAGEMAPLOCK            paPgLcks;
+    /** Segments describing the mapped buffer. */
+    PRTSGSEG                   paSegs;
 } AHCIREQ;
 
 /**
@@ -3678,8 +3684,10 @@ static PAHCIREQ ahciR3ReqAlloc(PAHCIPort pAhciPort, uint32_t uTag)
                                                    uTag, PDMIMEDIAEX_F_SUSPEND_ON_RECOVERABLE_ERR);
     if (RT_SUCCESS(rc))
     {
-        pAhciReq->hIoReq  = hIoReq;
-        pAhciReq->fMapped = false;
+        pAhciReq->hIoReq   = hIoReq;
+        pAhciReq->cPgLcks  = 0;
+        pAhciReq->paPgLcks = NULL;
+        pAhciReq->paSegs   = NULL;
     }
     else
         pAhciReq = NULL;
@@ -3722,9 +3730,15 @@ static bool ahciTransferComplete(PAHCIPort pAhciPort, PAHCIREQ pAhciReq, int rcR
 
     VBOXDD_AHCI_REQ_COMPLETED(pAhciReq, rcReq, pAhciReq->uOffset, pAhciReq->cbTransfer);
 
-    if (pAhciReq->fMapped)
-        PDMDevHlpPhysReleasePageMappingLock(pAhciPort->CTX_SUFF(pAhci)->CTX_SUFF(pDevIns),
-                                            &pAhciReq->PgLck);
+    if (pAhciReq->paPgLcks)
+    {
+        while (pAhciReq->cPgLcks > 0)
+            PDMDevHlpPhysReleasePageMappingLock(pAhciPort->CTX_SUFF(pAhci)->CTX_SUFF(pDevIns),
+                                                &pAhciReq->paPgLcks[--pAhciReq->cPgLcks]);
+        RTMemFree(pAhciReq->paPgLcks);
+        pAhciReq->paPgLcks = NULL;
+        pAhciReq->paSegs   = NULL;
+    }
 
     if (rcReq != VERR_PDM_MEDIAEX_IOREQ_CANCELED)
     {
@@ -3948,39 +3962,121 @@ static DECLCALLBACK(int) ahciR3IoReqCopyToBuf(PPDMIMEDIAEXPORT pInterface, PDMME
  * @interface_method_impl{PDMIMEDIAEXPORT,pfnIoReqQueryBuf}
  */
 static DECLCALLBACK(int) ahciR3IoReqQueryBuf(PPDMIMEDIAEXPORT pInterface, PDMMEDIAEXIOREQ hIoReq,
-                                             void *pvIoReqAlloc, void **ppvBuf, size_t *pcbBuf)
+                                             void *pvIoReqAlloc, PCRTSGSEG *ppaSegs, unsigned *pcSegs,
+                                             size_t *pcbBuf)
 {
     RT_NOREF(hIoReq);
-    int rc              = VERR_NOT_SUPPORTED;
+    int rc              = VINF_SUCCESS;
     PAHCIPort pAhciPort = RT_FROM_MEMBER(pInterface, AHCIPort, IMediaExPort);
     PAHCIREQ pIoReq     = (PAHCIREQ)pvIoReqAlloc;
     PAHCI pThis         = pAhciPort->CTX_SUFF(pAhci);
+    RTGCPHYS GCPhysPrdtl = pIoReq->GCPhysPrdtl;
+    unsigned cPrdtlEntries = pIoReq->cPrdtlEntries;
+    size_t cbLeft = pIoReq->cbTransfer;
+    unsigned cSegs = 0;
 
-    /* Only allow single 4KB page aligned buffers at the moment. */
-    if (   pIoReq->cPrdtlEntries == 1
-        && pIoReq->cbTransfer    == _4K)
-    {
-        RTGCPHYS GCPhysPrdt = pIoReq->GCPhysPrdtl;
-        SGLEntry PrdtEntry;
+    Assert(!pIoReq->cPgLcks && !pIoReq->paPgLcks);
 
-        PDMDevHlpPhysRead(pThis->pDevInsR3, GCPhysPrdt, &PrdtEntry, sizeof(SGLEntry));
+    /*
+     * Only plain reads and writes have a known direction, reads from the medium need
+     * writable mappings and writes to the medium get read-only ones.
+     */
+    if (   pIoReq->enmType != PDMMEDIAEXIOREQTYPE_READ
+        && pIoReq->enmType != PDMMEDIAEXIOREQTYPE_WRITE)
+        return VERR_NOT_SUPPORTED;
+
+    /*
+     * Each PRDTL entry covers at most two partial pages in addition to the full
+     * ones, size the arrays accordingly. Requests mapping more pages than allowed
+     * fall back to copying.
+     */
+    size_t cSegsMax = (pIoReq->cbTransfer >> PAGE_SHIFT) + 2 * (size_t)cPrdtlEntries;
+    cSegsMax = RT_MIN(cSegsMax, AHCI_REQ_MAPPED_PAGES_MAX);
+    pIoReq->paPgLcks = (PPGMPAGEMAPLOCK)RTMemAlloc(cSegsMax * (sizeof(PGMPAGEMAPLOCK) + sizeof(RTSGSEG)));
+    if (!pIoReq->paPgLcks)
+        return VERR_NOT_SUPPORTED;
+    pIoReq->paSegs = (PRTSGSEG)&pIoReq->paPgLcks[cSegsMax];
+
+    /*
+     * Map every guest page of the PRDTL, each page becomes one segment.
+     * Pages are only mapped if the whole transfer can be covered.
+     */
+    while (   cPrdtlEntries
+           && cbLeft
+           && RT_SUCCESS(rc))
+    {
+        SGLEntry aPrdtlEntries[32];
+        uint32_t cPrdtlEntriesRead = RT_MIN(cPrdtlEntries, RT_ELEMENTS(aPrdtlEntries));
 
-        RTGCPHYS GCPhysAddrDataBase = AHCI_RTGCPHYS_FROM_U32(PrdtEntry.u32DBAUp, PrdtEntry.u32DBA);
-        uint32_t cbData = (PrdtEntry.u32DescInf & SGLENTRY_DESCINF_DBC) + 1;
+        PDMDevHlpPhysRead(pThis->pDevInsR3, GCPhysPrdtl, &aPrdtlEntries[0],
+                          cPrdtlEntriesRead * sizeof(SGLEntry));
 
-        if (   cbData >= _4K
-            && !(GCPhysAddrDataBase & (_4K - 1)))
+        for (uint32_t i = 0; i < cPrdtlEntriesRead && cbLeft && RT_SUCCESS(rc); i++)
         {
-            rc = PDMDevHlpPhysGCPhys2CCPtr(pThis->pDevInsR3, GCPhysAddrDataBase,
-                                           0, ppvBuf, &pIoReq->PgLck);
-            if (RT_SUCCESS(rc))
+            RTGCPHYS GCPhys = AHCI_RTGCPHYS_FROM_U32(aPrdtlEntries[i].u32DBAUp, aPrdtlEntries[i].u32DBA);
+            size_t cbEntry = RT_MIN((aPrdtlEntries[i].u32DescInf & SGLENTRY_DESCINF_DBC) + 1, cbLeft);
+
+            while (cbEntry)
             {
-                pIoReq->fMapped = true;
-                *pcbBuf = cbData;
+                size_t cbThisPage = RT_MIN(cbEntry, PAGE_SIZE - (GCPhys & PAGE_OFFSET_MASK));
+
+                if (cSegs == cSegsMax)
+                {
+                    rc = VERR_BUFFER_OVERFLOW;
+                    break;
+                }
+
+                if (pIoReq->enmType == PDMMEDIAEXIOREQTYPE_READ)
+                {
+                    void *pv = NULL;
+                    rc = PDMDevHlpPhysGCPhys2CCPtr(pThis->pDevInsR3, GCPhys, 0, &pv,
+                                                   &pIoReq->paPgLcks[pIoReq->cPgLcks]);
+                    pIoReq->paSegs[cSegs].pvSeg = pv;
+                }
+                else
+                {
+                    /* The caller only reads from the segments of a write (see the interface description). */
+                    void const *pv = NULL;
+                    rc = PDMDevHlpPhysGCPhys2CCPtrReadOnly(pThis->pDevInsR3, GCPhys, 0, &pv,
+                                                           &pIoReq->paPgLcks[pIoReq->cPgLcks]);
+                    pIoReq->paSegs[cSegs].pvSeg = (void *)pv;
+                }
+                if (RT_FAILURE(rc))
+                {
+                    rc = VERR_NOT_SUPPORTED;
+                    break;
+                }
+                pIoReq->cPgLcks++;
+
+                pIoReq->paSegs[cSegs].cbSeg = cbThisPage;
+                cSegs++;
+
+                GCPhys  += cbThisPage;
+                cbEntry -= cbThisPage;
+                cbLeft  -= cbThisPage;
             }
-            else
-                rc = VERR_NOT_SUPPORTED;
         }
+
+        GCPhysPrdtl   += cPrdtlEntriesRead * sizeof(SGLEntry);
+        cPrdtlEntries -= cPrdtlEntriesRead;
+    }
+
+    if (   RT_SUCCESS(rc)
+        && !cbLeft)
+    {
+        *ppaSegs = pIoReq->paSegs;
+        *pcSegs  = cSegs;
+        *pcbBuf  = pIoReq->cbTransfer;
+    }
+    else
+    {
+        /* The PRDTL is too small for the transfer or could not be mapped, the caller falls back to copying. */
+        while (pIoReq->cPgLcks > 0)
+            PDMDevHlpPhysReleasePageMappingLock(pThis->pDevInsR3, &pIoReq->paPgLcks[--pIoReq->cPgLcks]);
+        RTMemFree(pIoReq->paPgLcks);
+        pIoReq->paPgLcks = NULL;
+        pIoReq->paSegs   = NULL;
+        rc = VERR_NOT_SUPPORTED;
     }
 
     return rc;
@@ -4693,7 +4789,9 @@ static DECLCALLBACK(int) ahciAsyncIOLoop(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
                 AHCIREQ Req;
                 Req.uTag       = idx;
                 Req.fFlags     = AHCI_REQ_IS_ON_STACK;
-                Req.fMapped    = false;
+                Req.cPgLcks    = 0;
+                Req.paPgLcks   = NULL;
+                Req.paSegs     = NULL;
                 Req.cbTransfer = 0;
                 Req.uOffset    = 0;
                 Req.enmType    = PDMMEDIAEXIOREQTYPE_INVALID;
@@ -41,6 +41,7 @@
 #include <iprt/memsafer.h>
 #include <iprt/memcache.h>
 #include <iprt/list.h>
+#include <iprt/path.h>
 
 #ifdef VBOX_WITH_INIP
 /* All lwip header files are not C++ safe. So hack around this. */
@@ -101,6 +102,28 @@ extern bool DevINIPConfigured(void);
 #define DRVVD_IOREQ_SAVED_STATE_VERSION UINT32_C(1)
 /** Maximum number of request errors in the release log before muting. */
 #define DRVVD_MAX_LOG_REL_ERRORS        100
+/** Magic of the online merge checkpoint file ('MRGE'). */
+#define DRVVD_MERGE_CHECKPOINT_MAGIC    UINT32_C(0x4d524745)
+/** Version of the online merge checkpoint file. */
+#define DRVVD_MERGE_CHECKPOINT_VERSION  UINT32_C(1)
+/** Suffix appended to the merge target filename for the checkpoint file. */
+#define DRVVD_MERGE_CHECKPOINT_SUFFIX   ".merge"
+
+/**
+ * Online merge checkpoint as stored next to the merge target.
+ */
+typedef struct DRVVDMERGECHECKPOINT
+{
+    /** Magic value (DRVVD_MERGE_CHECKPOINT_MAGIC). */
+    uint32_t                 u32Magic;
+    /** Version (DRVVD_MERGE_CHECKPOINT_VERSION). */
+    uint32_t                 u32Version;
+    /** Modification UUID of the merge source the checkpoint is valid for. */
+    RTUUID                   UuidModification;
+    /** Disk offset to resume the merge at. */
+    uint64_t                 offResume;
+} DRVVDMERGECHECKPOINT;
+AssertCompileSize(DRVVDMERGECHECKPOINT, 32);
 
 /** Forward declaration for the dis kcontainer. */
 typedef struct VBOXDISK *PVBOXDISK;
@@ -211,11 +234,9 @@ typedef struct PDMMEDIAEXIOREQINT
             /** Buffer management data based on the fDirectBuf flag. */
             union
             {
-                /** Direct buffer. */
+                /** Direct buffer, the segments are owned by the device above. */
                 struct
                 {
-                    /** Segment for the data buffer. */
-                    RTSGSEG               Seg;
                     /** S/G buffer structure. */
                     RTSGBUF               SgBuf;
                 } Direct;
@@ -301,6 +322,14 @@ typedef struct VBOXDISK
     unsigned                 uMergeSource;
     /** Target image index for merging. */
     unsigned                 uMergeTarget;
+    /** Flag whether a running merge should stop at the next chunk (power off). */
+    volatile bool            fMergeCancel;
+    /** Maximum bandwidth of the merge in bytes per second, 0 for unlimited. */
+    uint64_t                 cbMergeMaxBandwidth;
+    /** Number of milliseconds without guest I/O before the merge continues. */
+    uint32_t                 cMsMergeIdle;
+    /** Path of the checkpoint file while a merge is running. */
+    char                    *pszMergeCheckpoint;
 
     /** Flag whether boot acceleration is enabled. */
     bool                     fBootAccelEnabled;
@@ -413,6 +442,9 @@ typedef struct VBOXDISK
     RTCRITSECT               CritSectIoReqRedo;
     /** Number of errors logged so far. */
     unsigned                 cErrors;
+    /** Flag whether the buffers of the device above may be used directly for I/O,
+     * false if a filter which modifies the data in place is attached. */
+    bool                     fDirectBufs;
     /** @} */
 
     /** @name Statistics.
@@ -442,10 +474,20 @@ typedef struct VBOXDISK
     STAMCOUNTER              StatReqsDiscard;
     /** Release statistics: Number of I/O requests processed per second. */
     STAMCOUNTER              StatReqsPerSec;
+    /** Flag whether this instance holds a reference to the shared table cache statistics. */
+    bool                     fTblCacheStats;
     /** @} */
 } VBOXDISK;
 
 
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+
+/** Number of driver instances referencing the table cache statistics of the VD library. */
+static volatile uint32_t g_cTblCacheStatsRefs = 0;
+
+
 /*********************************************************************************************************************************
 *   Internal Functions                                                                                                           *
 *********************************************************************************************************************************/
@@ -894,6 +936,81 @@ static DECLCALLBACK(int) drvvdThreadFinishWrite(void *pvUser)
 }
 
 
+/*********************************************************************************************************************************
+*   VD Background operation interface implementation                                                                             *
+*********************************************************************************************************************************/
+
+static DECLCALLBACK(int) drvvdBgOpQueryLimits(void *pvUser, uint64_t *pcbPerSecMax, uint32_t *pcMsIdle)
+{
+    PVBOXDISK pThis = (PVBOXDISK)pvUser;
+
+    if (ASMAtomicReadBool(&pThis->fMergeCancel))
+        return VERR_CANCELLED;
+
+    *pcbPerSecMax = pThis->cbMergeMaxBandwidth;
+    *pcMsIdle     = pThis->cMsMergeIdle;
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) drvvdBgOpCheckpointLoad(void *pvUser, PRTUUID pUuidModification, uint64_t *poffResume)
+{
+    PVBOXDISK pThis = (PVBOXDISK)pvUser;
+    DRVVDMERGECHECKPOINT Checkpoint;
+    RTFILE hFile;
+
+    if (!pThis->pszMergeCheckpoint)
+        return VERR_NOT_FOUND;
+
+    int rc = RTFileOpen(&hFile, pThis->pszMergeCheckpoint, RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTFileRead(hFile, &Checkpoint, sizeof(Checkpoint), NULL);
+        RTFileClose(hFile);
+    }
+    if (RT_FAILURE(rc))
+        return VERR_NOT_FOUND;
+
+    if (   RT_LE2H_U32(Checkpoint.u32Magic) != DRVVD_MERGE_CHECKPOINT_MAGIC
+        || RT_LE2H_U32(Checkpoint.u32Version) != DRVVD_MERGE_CHECKPOINT_VERSION)
+        return VERR_NOT_FOUND;
+
+    *pUuidModification = Checkpoint.UuidModification;
+    *poffResume        = RT_LE2H_U64(Checkpoint.offResume);
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) drvvdBgOpCheckpointSave(void *pvUser, PCRTUUID pUuidModification, uint64_t offResume)
+{
+    PVBOXDISK pThis = (PVBOXDISK)pvUser;
+    DRVVDMERGECHECKPOINT Checkpoint;
+    RTFILE hFile;
+
+    if (!pThis->pszMergeCheckpoint)
+        return VINF_SUCCESS;
+
+    Checkpoint.u32Magic         = RT_H2LE_U32(DRVVD_MERGE_CHECKPOINT_MAGIC);
+    Checkpoint.u32Version       = RT_H2LE_U32(DRVVD_MERGE_CHECKPOINT_VERSION);
+    Checkpoint.UuidModification = *pUuidModification;
+    Checkpoint.offResume        = RT_H2LE_U64(offResume);
+
+    int rc = RTFileOpen(&hFile, pThis->pszMergeCheckpoint,
+                        RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_NONE);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTFileWrite(hFile, &Checkpoint, sizeof(Checkpoint), NULL);
+        if (RT_SUCCESS(rc))
+            rc = RTFileFlush(hFile);
+        RTFileClose(hFile);
+    }
+
+    /* Not being able to save a checkpoint is not fatal, the merge just can't be resumed. */
+    if (RT_FAILURE(rc))
+        LogRel(("VD#%u: Failed to save the merge checkpoint to '%s' (%Rrc)\n",
+                pThis->pDrvIns->iInstance, pThis->pszMergeCheckpoint, rc));
+    return VINF_SUCCESS;
+}
+
+
 /*********************************************************************************************************************************
 *   VD Configuration interface implementation                                                                                    *
 *********************************************************************************************************************************/
@@ -2157,9 +2274,36 @@ static DECLCALLBACK(int) drvvdMerge(PPDMIMEDIA pInterface,
         rc2 = VDInterfaceAdd(&VDIfProgress.Core, "DrvVD_VDIProgress", VDINTERFACETYPE_PROGRESS,
                              pvUser, sizeof(VDINTERFACEPROGRESS), &pVDIfsOperation);
         AssertRC(rc2);
+
+        /* Run the merge in the background, throttled and resumable using
+         * a checkpoint file next to the merge target. */
+        char szTarget[RTPATH_MAX];
+        VDINTERFACEBGOP VDIfBgOp;
+        VDIfBgOp.pfnQueryLimits    = drvvdBgOpQueryLimits;
+        VDIfBgOp.pfnCheckpointLoad = drvvdBgOpCheckpointLoad;
+        VDIfBgOp.pfnCheckpointSave = drvvdBgOpCheckpointSave;
+        rc2 = VDGetFilename(pThis->pDisk, pThis->uMergeTarget, szTarget, sizeof(szTarget));
+        if (RT_SUCCESS(rc2))
+            pThis->pszMergeCheckpoint = RTStrAPrintf2("%s" DRVVD_MERGE_CHECKPOINT_SUFFIX, szTarget);
+        rc2 = VDInterfaceAdd(&VDIfBgOp.Core, "DrvVD_VDIBgOp", VDINTERFACETYPE_BGOP,
+                             pThis, sizeof(VDINTERFACEBGOP), &pVDIfsOperation);
+        AssertRC(rc2);
+
         pThis->fMergePending = false;
         rc = VDMerge(pThis->pDisk, pThis->uMergeSource,
                      pThis->uMergeTarget, pVDIfsOperation);
+
+        if (pThis->pszMergeCheckpoint)
+        {
+            /* Keep the checkpoint only if the merge was interrupted by powering off the VM,
+             * it is stale after a successful merge and a failed or cancelled merge starts
+             * from scratch the next time. */
+            if (   rc != VERR_CANCELLED
+                || !ASMAtomicReadBool(&pThis->fMergeCancel))
+                RTFileDelete(pThis->pszMergeCheckpoint);
+            RTStrFree(pThis->pszMergeCheckpoint);
+            pThis->pszMergeCheckpoint = NULL;
+        }
     }
     rc2 = RTSemFastMutexRelease(pThis->MergeCompleteMutex);
     AssertRC(rc2);
@@ -3115,34 +3259,32 @@ DECLINLINE(int) drvvdMediaExIoReqBufAlloc(PVBOXDISK pThis, PPDMMEDIAEXIOREQINT p
     int rc = VERR_NOT_SUPPORTED;
     LogFlowFunc(("pThis=%#p pIoReq=%#p cb=%zu\n", pThis, pIoReq, cb));
 
-/** @todo This does not work at all with encryption enabled because the encryption plugin
- *         encrypts the data in place trashing guest memory and causing data corruption later on!
- *
- * DO NOT ENABLE UNLESS YOU WANT YOUR DATA SHREDDED!!!
- */
-#if 0
-    if (   cb == _4K
+    /*
+     * The encryption filter (and any other filter) transforms the data in place which would trash
+     * guest memory, so the direct buffer is only used without any filter attached.
+     */
+    if (   pThis->fDirectBufs
+        && !pThis->pCfgCrypto
         && pThis->pDrvMediaExPort->pfnIoReqQueryBuf)
     {
-        /* Try to get a direct pointer to the buffer first. */
-        void *pvBuf = NULL;
+        /* Try to get the guest buffer directly first, saves copying the data between buffers. */
+        PCRTSGSEG paSegs = NULL;
+        unsigned cSegs = 0;
         size_t cbBuf = 0;
 
         STAM_COUNTER_INC(&pThis->StatQueryBufAttempts);
         rc = pThis->pDrvMediaExPort->pfnIoReqQueryBuf(pThis->pDrvMediaExPort, pIoReq, &pIoReq->abAlloc[0],
-                                                      &pvBuf, &cbBuf);
+                                                      &paSegs, &cSegs, &cbBuf);
         if (RT_SUCCESS(rc))
         {
+            AssertMsg(cbBuf >= cb, ("Direct buffer is too small (cbBuf=%zu cb=%zu)\n", cbBuf, cb));
             STAM_COUNTER_INC(&pThis->StatQueryBufSuccess);
-            pIoReq->ReadWrite.cbIoBuf           = cbBuf;
-            pIoReq->ReadWrite.fDirectBuf        = true;
-            pIoReq->ReadWrite.Direct.Seg.pvSeg  = pvBuf;
-            pIoReq->ReadWrite.Direct.Seg.cbSeg  = cbBuf;
-            RTSgBufInit(&pIoReq->ReadWrite.Direct.SgBuf, &pIoReq->ReadWrite.Direct.Seg, 1);
+            pIoReq->ReadWrite.cbIoBuf    = cb;
+            pIoReq->ReadWrite.fDirectBuf = true;
+            RTSgBufInit(&pIoReq->ReadWrite.Direct.SgBuf, paSegs, cSegs);
             pIoReq->ReadWrite.pSgBuf = &pIoReq->ReadWrite.Direct.SgBuf;
         }
     }
-#endif
 
     if (RT_FAILURE(rc))
     {
@@ -3365,6 +3507,13 @@ static int drvvdMediaExIoReqReadWriteProcess(PVBOXDISK pThis, PPDMMEDIAEXIOREQIN
 
     rc = drvvdKeyCheckPrereqs(pThis, false /* fSetError */);
 
+    if (pIoReq->ReadWrite.fDirectBuf)
+    {
+        /* Position the direct buffer at the current offset, this might be a redo of the request. */
+        RTSgBufReset(&pIoReq->ReadWrite.Direct.SgBuf);
+        RTSgBufAdvance(&pIoReq->ReadWrite.Direct.SgBuf, pIoReq->ReadWrite.cbReq - pIoReq->ReadWrite.cbReqLeft);
+    }
+
     while (   pIoReq->ReadWrite.cbReqLeft
            && rc == VINF_SUCCESS)
     {
@@ -4422,6 +4571,8 @@ static int drvvdSetupFilters(PVBOXDISK pThis, PCFGMNODE pCfg)
             AssertRC(rc);
 
             rc = VDFilterAdd(pThis->pDisk, pszFilterName, VD_FILTER_FLAGS_DEFAULT, pVDIfsFilter);
+            if (RT_SUCCESS(rc))
+                pThis->fDirectBufs = false; /* The filter might transform the data in place. */
 
             MMR3HeapFree(pszFilterName);
         }
@@ -4521,6 +4672,24 @@ static int drvvdStatsRegister(PVBOXDISK pThis)
     uint32_t iInstance, iLUN;
     const char *pcszController;
 
+    /* The metadata table cache is shared by all disks, the first instance registers it. */
+    pThis->fTblCacheStats = true;
+    if (ASMAtomicIncU32(&g_cTblCacheStatsRefs) == 1)
+    {
+        PVDTBLCACHESTATS pTblCacheStats = (PVDTBLCACHESTATS)VDTblCacheGetStats();
+
+        PDMDrvHlpSTAMRegister(pDrvIns, (void *)&pTblCacheStats->cHits, STAMTYPE_U64, "/Devices/VD/TblCache/Hits",
+                              STAMUNIT_OCCURENCES, "Number of image metadata table lookups satisfied from the cache.");
+        PDMDrvHlpSTAMRegister(pDrvIns, (void *)&pTblCacheStats->cMisses, STAMTYPE_U64, "/Devices/VD/TblCache/Misses",
+                              STAMUNIT_OCCURENCES, "Number of image metadata table lookups which had to read the table.");
+        PDMDrvHlpSTAMRegister(pDrvIns, (void *)&pTblCacheStats->cEvictions, STAMTYPE_U64, "/Devices/VD/TblCache/Evictions",
+                              STAMUNIT_OCCURENCES, "Number of image metadata tables evicted from the cache.");
+        PDMDrvHlpSTAMRegister(pDrvIns, (void *)&pTblCacheStats->cbUsed, STAMTYPE_U64, "/Devices/VD/TblCache/Used",
+                              STAMUNIT_BYTES, "Amount of memory used by all image metadata table caches.");
+        PDMDrvHlpSTAMRegister(pDrvIns, (void *)&pTblCacheStats->cbMax, STAMTYPE_U64, "/Devices/VD/TblCache/Max",
+                              STAMUNIT_BYTES, "Amount of memory all image metadata table caches are allowed to use.");
+    }
+
     int rc = pThis->pDrvMediaPort->pfnQueryDeviceLocation(pThis->pDrvMediaPort, &pcszController,
                                                           &iInstance, &iLUN);
     if (RT_SUCCESS(rc))
@@ -4593,6 +4762,19 @@ static void drvvdStatsDeregister(PVBOXDISK pThis)
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReqsRead);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReqsDiscard);
     PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReqsPerSec);
+
+    if (   pThis->fTblCacheStats
+        && ASMAtomicDecU32(&g_cTblCacheStatsRefs) == 0)
+    {
+        PVDTBLCACHESTATS pTblCacheStats = (PVDTBLCACHESTATS)VDTblCacheGetStats();
+
+        PDMDrvHlpSTAMDeregister(pDrvIns, (void *)&pTblCacheStats->cHits);
+        PDMDrvHlpSTAMDeregister(pDrvIns, (void *)&pTblCacheStats->cMisses);
+        PDMDrvHlpSTAMDeregister(pDrvIns, (void *)&pTblCacheStats->cEvictions);
+        PDMDrvHlpSTAMDeregister(pDrvIns, (void *)&pTblCacheStats->cbUsed);
+        PDMDrvHlpSTAMDeregister(pDrvIns, (void *)&pTblCacheStats->cbMax);
+    }
+    pThis->fTblCacheStats = false;
 }
 
 
@@ -4667,6 +4849,10 @@ static void drvvdPowerOffOrDestructOrUnmount(PPDMDRVINS pDrvIns)
     ASMAtomicXchgHandle(&pThis->MergeCompleteMutex, NIL_RTSEMFASTMUTEX, &mutex);
     if (mutex != NIL_RTSEMFASTMUTEX)
     {
+        /* Stop a running merge at the next chunk, it saves a checkpoint and
+         * can be resumed later. */
+        ASMAtomicWriteBool(&pThis->fMergeCancel, true);
+
         /* Request the semaphore to wait until a potentially running merge
          * operation has been finished. */
         int rc = RTSemFastMutexRequest(mutex);
@@ -4954,6 +5140,10 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     pThis->MergeLock                    = NIL_RTSEMRW;
     pThis->uMergeSource                 = VD_LAST_IMAGE;
     pThis->uMergeTarget                 = VD_LAST_IMAGE;
+    pThis->fMergeCancel                 = false;
+    pThis->cbMergeMaxBandwidth          = 0;
+    pThis->cMsMergeIdle                 = 0;
+    pThis->pszMergeCheckpoint           = NULL;
     pThis->pCfgCrypto                   = NULL;
     pThis->pIfSecKey                    = NULL;
     pThis->hIoReqCache                  = NIL_RTMEMCACHE;
@@ -5096,11 +5286,12 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                           "Format\0Path\0"
                                           "ReadOnly\0MaybeReadOnly\0TempReadOnly\0Shareable\0HonorZeroWrites\0"
                                           "HostIPStack\0UseNewIo\0BootAcceleration\0BootAccelerationBuffer\0"
-                                          "SetupMerge\0MergeSource\0MergeTarget\0BwGroup\0Type\0BlockCache\0"
+                                          "SetupMerge\0MergeSource\0MergeTarget\0MergeMaxBandwidth\0MergeIdleInterval\0"
+                                          "BwGroup\0Type\0BlockCache\0"
                                           "CachePath\0CacheFormat\0Discard\0InformAboutZeroBlocks\0"
                                           "SkipConsistencyChecks\0"
                                           "Locked\0BIOSVisible\0Cylinders\0Heads\0Sectors\0Mountable\0"
-                                          "EmptyDrive\0IoBufMax\0NonRotationalMedium\0"
+                                          "EmptyDrive\0IoBufMax\0NonRotationalMedium\0DirectBuffers\0"
 #if defined(VBOX_PERIODIC_FLUSH) || defined(VBOX_IGNORE_FLUSH)
                                           "FlushInterval\0IgnoreFlush\0IgnoreFlushAsync\0"
 #endif /* !(VBOX_PERIODIC_FLUSH || VBOX_IGNORE_FLUSH) */
@@ -5196,6 +5387,20 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                       N_("DrvVD: Configuration error: Both \"ReadOnly\" and \"MergePending\" are set"));
                 break;
             }
+            rc = CFGMR3QueryU64Def(pCurNode, "MergeMaxBandwidth", &pThis->cbMergeMaxBandwidth, 0);
+            if (RT_FAILURE(rc))
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"MergeMaxBandwidth\" as integer failed"));
+                break;
+            }
+            rc = CFGMR3QueryU32Def(pCurNode, "MergeIdleInterval", &pThis->cMsMergeIdle, 10);
+            if (RT_FAILURE(rc))
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"MergeIdleInterval\" as integer failed"));
+                break;
+            }
             rc = CFGMR3QueryBoolDef(pCurNode, "BootAcceleration", &pThis->fBootAccelEnabled, false);
             if (RT_FAILURE(rc))
             {
@@ -5379,6 +5584,11 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
             if (RT_FAILURE(rc))
                 return PDMDRV_SET_ERROR(pDrvIns, rc,
                                         N_("DrvVD configuration error: Querying \"NonRotationalMedium\" as boolean failed"));
+
+            rc = CFGMR3QueryBoolDef(pCfg, "DirectBuffers", &pThis->fDirectBufs, true);
+            if (RT_FAILURE(rc))
+                return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                        N_("DrvVD configuration error: Querying \"DirectBuffers\" as boolean failed"));
         }
 
         PCFGMNODE pParent = CFGMR3GetChild(pCurNode, "Parent");
@@ -49,6 +49,7 @@ static void vqueueReset(PVQUEUE pQueue)
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
     pQueue->uPageNumber           = 0;
+    pQueue->fSignalledUsedValid   = false;
 }
 
 static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
@@ -61,6 +62,7 @@ static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
         PAGE_SIZE); /* The used ring must start from the next page. */
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
+    pQueue->fSignalledUsedValid   = false;
 }
 
 // void vqueueElemFree(PVQUEUEELEM pElem)
@@ -95,10 +97,59 @@ uint16_t vringReadAvailFlags(PVPCISTATE pState, PVRING pVRing)
     return tmp;
 }
 
+/**
+ * Reads the used event index the guest wants to be interrupted at
+ * (VPCI_F_RING_EVENT_IDX).
+ */
+static uint16_t vringReadUsedEvent(PVPCISTATE pState, PVRING pVRing)
+{
+    uint16_t tmp;
+
+    PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns),
+                      pVRing->addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pVRing->uSize]),
+                      &tmp, sizeof(tmp));
+    return tmp;
+}
+
+/**
+ * Tells the guest at which available index it has to notify us next
+ * (VPCI_F_RING_EVENT_IDX).
+ */
+static void vringWriteAvailEvent(PVPCISTATE pState, PVRING pVRing, uint16_t u16Value)
+{
+    PDMDevHlpPCIPhysWrite(pState->CTX_SUFF(pDevIns),
+                          pVRing->addrUsed + RT_OFFSETOF(VRINGUSED, aRing[pVRing->uSize]),
+                          &u16Value, sizeof(u16Value));
+}
+
+/**
+ * Checks whether the index moved past the event index between the old and
+ * the new index, the vring_need_event() from the virtio specification.
+ */
+DECLINLINE(bool) vringNeedEvent(uint16_t uEventIdx, uint16_t uNewIdx, uint16_t uOldIdx)
+{
+    return (uint16_t)(uNewIdx - uEventIdx - 1) < (uint16_t)(uNewIdx - uOldIdx);
+}
+
 void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled)
 {
     uint16_t tmp;
 
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+    {
+        /*
+         * With event indexes the guest does not look at the flags. Notifications
+         * get suppressed by not moving the available event index forward, so
+         * there is nothing to do when disabling them.
+         */
+        if (fEnabled)
+        {
+            vringWriteAvailEvent(pState, pVRing, vringReadAvailIndex(pState, pVRing));
+            ASMMemoryFence();
+        }
+        return;
+    }
+
     PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns),
                       pVRing->addrUsed + RT_OFFSETOF(VRINGUSED, uFlags),
                       &tmp, sizeof(tmp));
@@ -286,8 +337,22 @@ void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
              INSTANCE(pState), QUEUENAME(pState, pQueue),
              vringReadAvailFlags(pState, &pQueue->VRing),
              pState->uGuestFeatures, vqueueIsEmpty(pState, pQueue)?"":"not "));
-    if (!(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT)
-        || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue)))
+    bool fNotify;
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+    {
+        /* The used index must be visible before we look at the event index. */
+        ASMMemoryFence();
+        uint16_t uOld = pQueue->uSignalledUsedIndex;
+        uint16_t uNew = pQueue->uNextUsedIndex;
+        fNotify = !pQueue->fSignalledUsedValid
+               || vringNeedEvent(vringReadUsedEvent(pState, &pQueue->VRing), uNew, uOld);
+        pQueue->uSignalledUsedIndex = uNew;
+        pQueue->fSignalledUsedValid = true;
+    }
+    else
+        fNotify =    !(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT)
+                  || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue));
+    if (fNotify)
     {
         int rc = vpciRaiseInterrupt(pState, VERR_INTERNAL_ERROR, VPCI_ISR_QUEUE);
         if (RT_FAILURE(rc))
@@ -338,7 +403,11 @@ int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
     LogFlow(("%s vpciRaiseInterrupt: u8IntCause=%x\n",
              INSTANCE(pState), u8IntCause));
 
-    pState->uISR |= u8IntCause;
+    /* The queues raise interrupts from several threads without the critical section. */
+    uint8_t uISROld;
+    do
+        uISROld = ASMAtomicReadU8(&pState->uISR);
+    while (!ASMAtomicCmpXchgU8(&pState->uISR, uISROld | u8IntCause, uISROld));
     PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
     // vpciCsLeave(pState);
     return VINF_SUCCESS;
@@ -437,9 +506,11 @@ int vpciIOPortIn(PPDMDEVINS         pDevIns,
 
         case VPCI_ISR:
             Assert(cb == 1);
-            *(uint8_t*)pu32 = pState->uISR;
-            pState->uISR = 0; /* read clears all interrupts */
+            *(uint8_t*)pu32 = ASMAtomicXchgU8(&pState->uISR, 0); /* read clears all interrupts */
             vpciLowerInterrupt(pState);
+            /* Don't lose an interrupt raised between clearing and lowering. */
+            if (ASMAtomicReadU8(&pState->uISR))
+                PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
             break;
 
         default:
@@ -791,7 +862,7 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
         AssertRCReturn(rc, rc);
         rc = SSMR3GetU8( pSSM, &pState->uStatus);
         AssertRCReturn(rc, rc);
-        rc = SSMR3GetU8( pSSM, &pState->uISR);
+        rc = SSMR3GetU8( pSSM, (uint8_t *)&pState->uISR);
         AssertRCReturn(rc, rc);
 
         /* Restore queues */
@@ -28,7 +28,8 @@
  * for example.
  */
 #define VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1 1
-#define VIRTIO_SAVEDSTATE_VERSION           2
+#define VIRTIO_SAVEDSTATE_VERSION_PRE_MQ    2
+#define VIRTIO_SAVEDSTATE_VERSION           3
 /** @} */
 
 #define DEVICE_PCI_VENDOR_ID                0x1AF4
@@ -36,7 +37,8 @@
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 #define DEVICE_PCI_SUBSYSTEM_BASE_ID       1
 
-#define VIRTIO_MAX_NQUEUES                  3
+/** Enough for 8 queue pairs and a control queue in the network device. */
+#define VIRTIO_MAX_NQUEUES                  17
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
@@ -83,6 +85,7 @@ typedef struct VRingAvail
     uint16_t uFlags;
     uint16_t uNextFreeIndex;
     uint16_t auRing[1];
+    /* uint16_t uUsedEvent; - follows auRing[uSize] if VPCI_F_RING_EVENT_IDX was negotiated. */
 } VRINGAVAIL;
 
 typedef struct VRingUsedElem
@@ -98,6 +101,7 @@ typedef struct VRingUsed
     uint16_t      uFlags;
     uint16_t      uIndex;
     VRINGUSEDELEM aRing[1];
+    /* uint16_t   uAvailEvent; - follows aRing[uSize] if VPCI_F_RING_EVENT_IDX was negotiated. */
 } VRINGUSED;
 typedef VRINGUSED *PVRINGUSED;
 
@@ -129,6 +133,11 @@ typedef struct VQueue
     uint16_t uNextAvailIndex;
     uint16_t uNextUsedIndex;
     uint32_t uPageNumber;
+    /** The used index at the time the guest was interrupted last (VPCI_F_RING_EVENT_IDX). */
+    uint16_t uSignalledUsedIndex;
+    /** Whether uSignalledUsedIndex is valid, cleared when the ring is (re-)initialized. */
+    bool     fSignalledUsedValid;
+    bool     afPadding[5];
     R3PTRTYPE(PFNVPCIQUEUECALLBACK) pfnCallback;
     R3PTRTYPE(const char *)         pcszName;
 } VQUEUE;
@@ -202,7 +211,7 @@ typedef struct VPCIState_st
     uint32_t               uGuestFeatures;
     uint16_t               uQueueSelector;         /**< An index in aQueues array. */
     uint8_t                uStatus; /**< Device Status (bits are device-specific). */
-    uint8_t                uISR;                   /**< Interrupt Status Register. */
+    uint8_t volatile       uISR;                   /**< Interrupt Status Register. */
 
 #if HC_ARCH_BITS != 64
     uint32_t               padding3;
@@ -23,6 +23,7 @@
 #include <VBox/types.h>
 #include <VBox/sup.h>
 #include <VBox/version.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
 #include <iprt/getopt.h>
@@ -33,8 +34,10 @@
 #include <iprt/mem.h>
 #include <iprt/once.h>
 #include <iprt/path.h>
+#include <iprt/process.h>
 #include <iprt/string.h>
 #include <iprt/stream.h>
+#include <iprt/test.h>
 #include <iprt/trace.h>
 
 #include "tstDeviceInternal.h"
@@ -261,37 +264,6 @@ static const TSTDEVPDMR0IMPORTS g_aPdmR0Imports[] =
 *   Internal Functions                                                                                                           *
 *********************************************************************************************************************************/
 
-#if 0
-/**
- * Parses the options given to the testcase.
- *
- * @returns Process status code.
- * @param   cArgs       Number of arguments given.
- * @param   paszArgs    Pointer to the argument vector.
- */
-static RTEXITCODE tstDevParseOptions(int cArgs, char *paszArgs[])
-{
-    static RTGETOPTDEF const s_aOptions[] =
-    {
-    };
-
-
-    int ch;
-    RTGETOPTUNION Value;
-    RTGETOPTSTATE GetState;
-    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
-    while ((ch = RTGetOpt(&GetState, &Value)))
-    {
-        switch (ch)
-        {
-            default:
-                return RTGetOptPrintError(ch, &Value);
-        }
-    }
-}
-#endif
-
-
 /**
  * Checks whether the given testcase name is already existing.
  *
@@ -812,107 +784,591 @@ DECLHIDDEN(int) tstDevPdmLdrGetSymbol(PTSTDEVDUTINT pThis, const char *pszMod, T
 }
 
 
-static TSTDEVCFGITEM s_aTestcaseCfg[] =
+/**
+ * Looks up the I/O port handler covering the given port.
+ *
+ * @returns Pointer to the handler or NULL if not found.
+ * @param   pThis                   The device under test instance.
+ * @param   Port                    The port to look up.
+ */
+static PCRTDEVDUTIOPORT tstDevDutIoPortFind(PTSTDEVDUTINT pThis, RTIOPORT Port)
 {
-    {"CtrlMemBufSize", TSTDEVCFGITEMTYPE_INTEGER, "0"  },
-    {NULL,             TSTDEVCFGITEMTYPE_INVALID, NULL }
-};
+    PCRTDEVDUTIOPORT pIoPort = NULL;
+
+    tstDevDutLockShared(pThis);
+    PCRTDEVDUTIOPORT pIt;
+    RTListForEach(&pThis->LstIoPorts, pIt, RTDEVDUTIOPORT, NdIoPorts)
+    {
+        if (   Port >= pIt->PortStart
+            && Port - pIt->PortStart < pIt->cPorts)
+        {
+            pIoPort = pIt;
+            break;
+        }
+    }
+    tstDevDutUnlockShared(pThis);
+
+    return pIoPort;
+}
+
+
+/**
+ * Looks up the MMIO region covering the given access.
+ *
+ * @returns Pointer to the region or NULL if not found.
+ * @param   pThis                   The device under test instance.
+ * @param   GCPhys                  Start address of the access.
+ * @param   cb                      Size of the access.
+ */
+static PCRTDEVDUTMMIO tstDevDutMmioFind(PTSTDEVDUTINT pThis, RTGCPHYS GCPhys, unsigned cb)
+{
+    PCRTDEVDUTMMIO pMmio = NULL;
+
+    tstDevDutLockShared(pThis);
+    PCRTDEVDUTMMIO pIt;
+    RTListForEach(&pThis->LstMmio, pIt, RTDEVDUTMMIO, NdMmio)
+    {
+        if (   GCPhys >= pIt->GCPhysStart
+            && GCPhys - pIt->GCPhysStart + cb <= pIt->cbRegion)
+        {
+            pMmio = pIt;
+            break;
+        }
+    }
+    tstDevDutUnlockShared(pThis);
+
+    return pMmio;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnIoPortRead}
+ */
+static DECLCALLBACK(int) tstDevDutIoPortRead(TSTDEVDUT hDut, RTIOPORT Port, uint32_t *pu32, unsigned cb)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    PCRTDEVDUTIOPORT pIoPort = tstDevDutIoPortFind(pThis, Port);
+    if (!pIoPort || !pIoPort->pfnInR3)
+        return VERR_IOM_IOPORT_RANGE_NOT_FOUND;
+
+    PPDMDEVINS pDevIns = pThis->pDevIns;
+    PDMCritSectEnter(pDevIns->pCritSectRoR3, VERR_IGNORED);
+    int rc = pIoPort->pfnInR3(pDevIns, pIoPort->pvUserR3, Port, pu32, cb);
+    PDMCritSectLeave(pDevIns->pCritSectRoR3);
+    return rc;
+}
+
 
-static TSTDEVTESTCASEREG s_TestcaseDef =
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnIoPortWrite}
+ */
+static DECLCALLBACK(int) tstDevDutIoPortWrite(TSTDEVDUT hDut, RTIOPORT Port, uint32_t u32, unsigned cb)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    PCRTDEVDUTIOPORT pIoPort = tstDevDutIoPortFind(pThis, Port);
+    if (!pIoPort || !pIoPort->pfnOutR3)
+        return VERR_IOM_IOPORT_RANGE_NOT_FOUND;
+
+    PPDMDEVINS pDevIns = pThis->pDevIns;
+    PDMCritSectEnter(pDevIns->pCritSectRoR3, VERR_IGNORED);
+    int rc = pIoPort->pfnOutR3(pDevIns, pIoPort->pvUserR3, Port, u32, cb);
+    PDMCritSectLeave(pDevIns->pCritSectRoR3);
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnMmioRead}
+ */
+static DECLCALLBACK(int) tstDevDutMmioRead(TSTDEVDUT hDut, RTGCPHYS GCPhys, void *pv, unsigned cb)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    PCRTDEVDUTMMIO pMmio = tstDevDutMmioFind(pThis, GCPhys, cb);
+    if (!pMmio || !pMmio->pfnReadR3)
+        return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+
+    PPDMDEVINS pDevIns = pThis->pDevIns;
+    PDMCritSectEnter(pDevIns->pCritSectRoR3, VERR_IGNORED);
+    int rc = pMmio->pfnReadR3(pDevIns, pMmio->pvUserR3, GCPhys, pv, cb);
+    PDMCritSectLeave(pDevIns->pCritSectRoR3);
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnMmioWrite}
+ */
+static DECLCALLBACK(int) tstDevDutMmioWrite(TSTDEVDUT hDut, RTGCPHYS GCPhys, const void *pv, unsigned cb)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    PCRTDEVDUTMMIO pMmio = tstDevDutMmioFind(pThis, GCPhys, cb);
+    if (!pMmio || !pMmio->pfnWriteR3)
+        return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+
+    PPDMDEVINS pDevIns = pThis->pDevIns;
+    PDMCritSectEnter(pDevIns->pCritSectRoR3, VERR_IGNORED);
+    int rc = pMmio->pfnWriteR3(pDevIns, pMmio->pvUserR3, GCPhys, pv, cb);
+    PDMCritSectLeave(pDevIns->pCritSectRoR3);
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnPciRegionMap}
+ */
+static DECLCALLBACK(int) tstDevDutPciRegionMap(TSTDEVDUT hDut, uint32_t iRegion, RTGCPHYS GCPhys)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    AssertReturn(iRegion < VBOX_PCI_NUM_REGIONS, VERR_INVALID_PARAMETER);
+
+    PCTSTDEVDUTPCIREGION pRegion = &pThis->aPciRegions[iRegion];
+    if (!pRegion->pfnRegionMap || !pThis->pPciDev)
+        return VERR_NOT_FOUND;
+
+    return pRegion->pfnRegionMap(pThis->pDevIns, pThis->pPciDev, iRegion, GCPhys, pRegion->cbRegion, pRegion->enmType);
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnPhysGetPtr}
+ */
+static DECLCALLBACK(int) tstDevDutPhysGetPtr(TSTDEVDUT hDut, RTGCPHYS GCPhys, size_t cb, void **ppv)
 {
-    "test",
-    "Testcase during implementation",
-    "nvme",
-    0,
-    &s_aTestcaseCfg[0],
-    NULL,
+    PTSTDEVDUTINT pThis = hDut;
+    if (   GCPhys >= pThis->cbPhysMem
+        || cb > pThis->cbPhysMem - GCPhys)
+        return VERR_OUT_OF_RANGE;
+
+    *ppv = &pThis->pbPhysMem[GCPhys];
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnIrqQuery}
+ */
+static DECLCALLBACK(int) tstDevDutIrqQuery(TSTDEVDUT hDut, uint64_t *pcRaised)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    if (pcRaised)
+        *pcRaised = ASMAtomicReadU64(&pThis->cIrqsRaised);
+    return ASMAtomicReadS32(&pThis->iIrqLevel);
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnTimersRun}
+ */
+static DECLCALLBACK(uint64_t) tstDevDutTimersRun(TSTDEVDUT hDut)
+{
+    PTSTDEVDUTINT pThis = hDut;
+    uint64_t cNsNext = UINT64_MAX;
+
+    /* Never 0 so timers which did not run yet never match. */
+    uint32_t uTimersRun = ++pThis->uTimersRun;
+    if (!uTimersRun)
+        uTimersRun = pThis->uTimersRun = 1;
+
+    /*
+     * The callbacks may arm, stop or destroy timers, so the list is rescanned
+     * from the beginning after every expired timer.  Every timer runs at most
+     * once per call, a callback re-arming its timer at or before the current
+     * time would keep us here forever otherwise.
+     */
+    for (;;)
+    {
+        PTMTIMER pExpired = NULL;
+        cNsNext = UINT64_MAX;
+
+        tstDevDutLockShared(pThis);
+        PTMTIMER pIt;
+        RTListForEach(&pThis->LstTimers, pIt, TMTIMER, NdDevTimers)
+        {
+            if (!TMTimerIsActive(pIt))
+                continue;
+
+            uint64_t u64Now = TMTimerGet(pIt);
+            if (pIt->u64Expire <= u64Now)
+            {
+                if (pIt->uTimersRunLast != uTimersRun)
+                {
+                    pExpired = pIt;
+                    break;
+                }
+
+                /* Already ran during this call, the caller has to come back right away. */
+                cNsNext = 0;
+                continue;
+            }
+
+            uint64_t cNs = (pIt->u64Expire - u64Now) * (RT_NS_1SEC / TMTimerGetFreq(pIt));
+            cNsNext = RT_MIN(cNsNext, cNs);
+        }
+        tstDevDutUnlockShared(pThis);
+
+        if (!pExpired)
+            break;
+
+        /* Like TM the timer is deactivated before the callback is invoked. */
+        pExpired->uTimersRunLast = uTimersRun;
+        TMTimerStop(pExpired);
+        if (pExpired->pCritSect)
+            PDMCritSectEnter(pExpired->pCritSect, VERR_IGNORED);
+        pExpired->pfnCallbackDev(pExpired->pDevIns, pExpired, pExpired->pvUser);
+        if (pExpired->pCritSect)
+            PDMCritSectLeave(pExpired->pCritSect);
+    }
+
+    return cNsNext;
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnStatsDump}
+ */
+static DECLCALLBACK(void) tstDevDutStatsDump(TSTDEVDUT hDut, const char *pszPat)
+{
+    PTSTDEVDUTINT pThis = hDut;
+
+    tstDevDutLockShared(pThis);
+    PCTSTDEVDUTSTAMSAMPLE pIt;
+    RTListForEach(&pThis->LstStam, pIt, TSTDEVDUTSTAMSAMPLE, NdStam)
+    {
+        if (pszPat && !RTStrSimplePatternMultiMatch(pszPat, RTSTR_MAX, pIt->szName, RTSTR_MAX, NULL))
+            continue;
+
+        switch (pIt->enmType)
+        {
+            case STAMTYPE_COUNTER:
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU64\n", pIt->szName, ((PCSTAMCOUNTER)pIt->pvSample)->c);
+                break;
+
+            case STAMTYPE_PROFILE:
+            case STAMTYPE_PROFILE_ADV:
+            {
+                PCSTAMPROFILE pProf = (PCSTAMPROFILE)pIt->pvSample;
+                if (pProf->cPeriods)
+                    RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU64 ticks/call (%RU64 calls, min %RU64, max %RU64)\n",
+                                  pIt->szName, pProf->cTicks / pProf->cPeriods, pProf->cPeriods,
+                                  pProf->cTicksMin, pProf->cTicksMax);
+                else
+                    RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12s\n", pIt->szName, "no calls");
+                break;
+            }
+
+            case STAMTYPE_U8:
+            case STAMTYPE_U8_RESET:
+            case STAMTYPE_X8:
+            case STAMTYPE_X8_RESET:
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU8\n", pIt->szName, *(uint8_t *)pIt->pvSample);
+                break;
+
+            case STAMTYPE_U16:
+            case STAMTYPE_U16_RESET:
+            case STAMTYPE_X16:
+            case STAMTYPE_X16_RESET:
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU16\n", pIt->szName, *(uint16_t *)pIt->pvSample);
+                break;
+
+            case STAMTYPE_U32:
+            case STAMTYPE_U32_RESET:
+            case STAMTYPE_X32:
+            case STAMTYPE_X32_RESET:
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU32\n", pIt->szName, *(uint32_t *)pIt->pvSample);
+                break;
+
+            case STAMTYPE_U64:
+            case STAMTYPE_U64_RESET:
+            case STAMTYPE_X64:
+            case STAMTYPE_X64_RESET:
+                RTTestIPrintf(RTTESTLVL_ALWAYS, "%-50s %12RU64\n", pIt->szName, *(uint64_t *)pIt->pvSample);
+                break;
+
+            default:
+                break;
+        }
+    }
+    tstDevDutUnlockShared(pThis);
+}
+
+
+/**
+ * @interface_method_impl{TSTDEVDUTHLP,pfnStatsReset}
+ */
+static DECLCALLBACK(void) tstDevDutStatsReset(TSTDEVDUT hDut, const char *pszPat)
+{
+    PTSTDEVDUTINT pThis = hDut;
+
+    tstDevDutLockShared(pThis);
+    PCTSTDEVDUTSTAMSAMPLE pIt;
+    RTListForEach(&pThis->LstStam, pIt, TSTDEVDUTSTAMSAMPLE, NdStam)
+    {
+        if (pszPat && !RTStrSimplePatternMultiMatch(pszPat, RTSTR_MAX, pIt->szName, RTSTR_MAX, NULL))
+            continue;
+
+        switch (pIt->enmType)
+        {
+            case STAMTYPE_COUNTER:
+                ASMAtomicWriteU64(&((PSTAMCOUNTER)pIt->pvSample)->c, 0);
+                break;
+
+            case STAMTYPE_PROFILE:
+            case STAMTYPE_PROFILE_ADV:
+            {
+                PSTAMPROFILE pProf = (PSTAMPROFILE)pIt->pvSample;
+                pProf->cPeriods  = 0;
+                pProf->cTicks    = 0;
+                pProf->cTicksMax = 0;
+                pProf->cTicksMin = UINT64_MAX;
+                break;
+            }
+
+            case STAMTYPE_U8_RESET:
+            case STAMTYPE_X8_RESET:
+                *(uint8_t *)pIt->pvSample = 0;
+                break;
+
+            case STAMTYPE_U16_RESET:
+            case STAMTYPE_X16_RESET:
+                *(uint16_t *)pIt->pvSample = 0;
+                break;
+
+            case STAMTYPE_U32_RESET:
+            case STAMTYPE_X32_RESET:
+                *(uint32_t *)pIt->pvSample = 0;
+                break;
+
+            case STAMTYPE_U64_RESET:
+            case STAMTYPE_X64_RESET:
+                *(uint64_t *)pIt->pvSample = 0;
+                break;
+
+            default:
+                /* Plain values reflect device state and are left alone, like STAMR3Reset does. */
+                break;
+        }
+    }
+    tstDevDutUnlockShared(pThis);
+}
+
+
+/**
+ * The helpers given to the testcases to drive the device under test.
+ */
+const TSTDEVDUTHLP g_tstDevDutHlp =
+{
+    tstDevDutIoPortRead,
+    tstDevDutIoPortWrite,
+    tstDevDutMmioRead,
+    tstDevDutMmioWrite,
+    tstDevDutPciRegionMap,
+    tstDevDutPhysGetPtr,
+    tstDevDutIrqQuery,
+    tstDevDutTimersRun,
+    tstDevDutStatsDump,
+    tstDevDutStatsReset
 };
 
+
 /**
- * Create a new PDM device with default config.
+ * Frees everything the device under test left behind after it was destructed.
+ *
+ * @returns nothing.
+ * @param   pThis                   The device under test instance.
+ */
+static void tstDevDutDestroy(PTSTDEVDUTINT pThis)
+{
+    PRTDEVDUTIOPORT pIoPort, pIoPortNext;
+    RTListForEachSafe(&pThis->LstIoPorts, pIoPort, pIoPortNext, RTDEVDUTIOPORT, NdIoPorts)
+        RTMemFree(pIoPort);
+
+    PRTDEVDUTMMIO pMmio, pMmioNext;
+    RTListForEachSafe(&pThis->LstMmio, pMmio, pMmioNext, RTDEVDUTMMIO, NdMmio)
+        RTMemFree(pMmio);
+
+    PTMTIMER pTimer, pTimerNext;
+    RTListForEachSafe(&pThis->LstTimers, pTimer, pTimerNext, TMTIMER, NdDevTimers)
+        RTMemFree(pTimer);
+
+    PPDMQUEUE pQueue, pQueueNext;
+    RTListForEachSafe(&pThis->LstPdmQueues, pQueue, pQueueNext, PDMQUEUE, NdPdmQueues)
+        RTMemFree(pQueue);
+
+    PTSTDEVDUTSTAMSAMPLE pSample, pSampleNext;
+    RTListForEachSafe(&pThis->LstStam, pSample, pSampleNext, TSTDEVDUTSTAMSAMPLE, NdStam)
+        RTMemFree(pSample);
+
+    PTSTDEVMMHEAPALLOC pHeapAlloc, pHeapAllocNext;
+    RTListForEachSafe(&pThis->LstMmHeap, pHeapAlloc, pHeapAllocNext, TSTDEVMMHEAPALLOC, NdMmHeap)
+        RTMemFree(pHeapAlloc);
+
+    if (RTCritSectIsInitialized(&pThis->CritSectDev.s.CritSect))
+        RTCritSectDelete(&pThis->CritSectDev.s.CritSect);
+    if (RTCritSectIsInitialized(&pThis->CritSectNop.s.CritSect))
+        RTCritSectDelete(&pThis->CritSectNop.s.CritSect);
+    RTCritSectRwDelete(&pThis->CritSectLists);
+
+    RTMemPageFree(pThis->pbPhysMem, pThis->cbPhysMem);
+    RTMemFree(pThis->pDevIns);
+    RTMemFree(pThis);
+}
+
+
+/**
+ * Creates the device the given testcase is for and runs the testcase on it.
  *
  * @returns VBox status code.
- * @param   pszName                 Name of the device to create.
+ * @param   pTestcase               The testcase to run.
  */
-static int tstDevPdmDevCreate(const char *pszName)
+static int tstDevTestcaseRun(PCTSTDEVTESTCASE pTestcase)
 {
-    int rc = VINF_SUCCESS;
-    PCTSTDEVPDMDEV pPdmDev = tstDevPdmDeviceFind(pszName);
-    if (RT_LIKELY(pPdmDev))
+    PCTSTDEVTESTCASEREG pTestcaseReg = pTestcase->pTestcaseReg;
+    PCTSTDEVPDMDEV pPdmDev = tstDevPdmDeviceFind(pTestcaseReg->szDevName);
+    if (RT_UNLIKELY(!pPdmDev))
+        return VERR_NOT_FOUND;
+
+    PTSTDEVDUTINT pDut = (PTSTDEVDUTINT)RTMemAllocZ(sizeof(*pDut));
+    if (RT_UNLIKELY(!pDut))
+        return VERR_NO_MEMORY;
+
+    pDut->pTestcaseReg    = pTestcaseReg;
+    pDut->enmCtx          = TSTDEVDUTCTX_R3;
+    pDut->pVm             = NULL;
+    pDut->SupSession.pDut = pDut;
+    RTListInit(&pDut->LstIoPorts);
+    RTListInit(&pDut->LstTimers);
+    RTListInit(&pDut->LstMmio);
+    RTListInit(&pDut->LstMmHeap);
+    RTListInit(&pDut->LstPdmThreads);
+    RTListInit(&pDut->LstPdmQueues);
+    RTListInit(&pDut->LstStam);
+    RTListInit(&pDut->SupSession.LstSupSem);
+
+    int rc = RTCritSectRwInit(&pDut->CritSectLists);
+    if (RT_SUCCESS(rc))
+        rc = RTCritSectInit(&pDut->CritSectDev.s.CritSect);
+    if (RT_SUCCESS(rc))
+        rc = RTCritSectInitEx(&pDut->CritSectNop.s.CritSect, RTCRITSECT_FLAGS_NOP, NIL_RTLOCKVALCLASS,
+                              RTLOCKVAL_SUB_CLASS_NONE, NULL);
+    if (RT_SUCCESS(rc))
     {
-        TSTDEVDUTINT Dut;
-        Dut.pTestcaseReg    = &s_TestcaseDef;
-        Dut.enmCtx          = TSTDEVDUTCTX_R3;
-        Dut.pVm             = NULL;
-        Dut.SupSession.pDut = &Dut;
-        RTListInit(&Dut.LstIoPorts);
-        RTListInit(&Dut.LstTimers);
-        RTListInit(&Dut.LstMmHeap);
-        RTListInit(&Dut.LstPdmThreads);
-        RTListInit(&Dut.SupSession.LstSupSem);
-        CFGMNODE Cfg;
-        Cfg.pVmmCallbacks = &g_tstDevVmmCallbacks;
-        Cfg.pDut = &Dut;
-
-        rc = RTCritSectRwInit(&Dut.CritSectLists);
-        AssertRC(rc);
+        pDut->CritSectDev.s.pVmmCallbacks = &g_tstDevVmmCallbacks;
+        pDut->CritSectNop.s.pVmmCallbacks = &g_tstDevVmmCallbacks;
 
+        pDut->cbPhysMem = TSTDEV_PHYS_MEM_SIZE;
+        pDut->pbPhysMem = (uint8_t *)RTMemPageAllocZ(pDut->cbPhysMem);
         PPDMDEVINS pDevIns = (PPDMDEVINS)RTMemAllocZ(RT_OFFSETOF(PDMDEVINS, achInstanceData[pPdmDev->pReg->cbInstance]));
-        pDevIns->u32Version               = PDM_DEVINS_VERSION;
-        pDevIns->iInstance                = 0;
-        pDevIns->pReg                     = pPdmDev->pReg;
-        pDevIns->pvInstanceDataR3         = &pDevIns->achInstanceData[0];
-        pDevIns->pHlpR3                   = &g_tstDevPdmDevHlpR3;
-        pDevIns->pCfg                     = &Cfg;
-        pDevIns->Internal.s.pVmmCallbacks = &g_tstDevVmmCallbacks;
-        pDevIns->Internal.s.pDut          = &Dut;
-        rc = pPdmDev->pReg->pfnConstruct(pDevIns, 0, &Cfg);
-        if (RT_SUCCESS(rc))
+        if (pDut->pbPhysMem && pDevIns)
         {
-            PRTDEVDUTIOPORT pIoPort = RTListGetFirst(&Dut.LstIoPorts, RTDEVDUTIOPORT, NdIoPorts);
-            uint32_t uVal = 0;
-            PDMCritSectEnter(pDevIns->pCritSectRoR3, VERR_IGNORED);
-            pIoPort->pfnInR0(pDevIns, pIoPort->pvUserR0, pIoPort->PortStart, &uVal, sizeof(uint8_t));
-            PDMCritSectLeave(pDevIns->pCritSectRoR3);
+            CFGMNODE Cfg;
+            Cfg.pVmmCallbacks = &g_tstDevVmmCallbacks;
+            Cfg.pDut          = pDut;
+
+            pDevIns->u32Version               = PDM_DEVINS_VERSION;
+            pDevIns->iInstance                = 0;
+            pDevIns->pReg                     = pPdmDev->pReg;
+            pDevIns->pvInstanceDataR3         = &pDevIns->achInstanceData[0];
+            pDevIns->pHlpR3                   = &g_tstDevPdmDevHlpR3;
+            pDevIns->pCfg                     = &Cfg;
+            pDevIns->pCritSectRoR3            = &pDut->CritSectDev;
+            pDevIns->Internal.s.pVmmCallbacks = &g_tstDevVmmCallbacks;
+            pDevIns->Internal.s.pDut          = pDut;
+            pDut->pDevIns                     = pDevIns;
+
+            rc = pPdmDev->pReg->pfnConstruct(pDevIns, 0, &Cfg);
+            if (RT_SUCCESS(rc))
+                rc = pTestcaseReg->pfnTestEntry(pDut, &g_tstDevDutHlp);
+            else
+                RTTestIFailed("Constructing device '%s' failed with %Rrc", pTestcaseReg->szDevName, rc);
+
+            /* Like PDM the destructor is called even if the constructor failed. */
+            if (pPdmDev->pReg->pfnDestruct)
+                pPdmDev->pReg->pfnDestruct(pDevIns);
+        }
+        else
+        {
+            RTMemFree(pDevIns);
+            rc = VERR_NO_MEMORY;
         }
     }
-    else
-        rc = VERR_NOT_FOUND;
 
+    tstDevDutDestroy(pDut);
     return rc;
 }
 
+
 int main(int argc, char *argv[])
 {
     /*
      * Init the runtime and parse the arguments.
      */
-    RTEXITCODE rcExit = RTEXITCODE_SUCCESS;
-    int rc = RTR3InitExe(argc, &argv, 0);
-    if (RT_SUCCESS(rc))
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitExAndCreate(argc, &argv, 0, "tstDevice", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    RTListInit(&g_LstPlugins);
+    RTListInit(&g_LstTestcases);
+    RTListInit(&g_LstPdmMods);
+    RTListInit(&g_LstPdmDevs);
+
+    static RTGETOPTDEF const s_aOptions[] =
     {
-        RTListInit(&g_LstPlugins);
-        RTListInit(&g_LstTestcases);
-        RTListInit(&g_LstPdmMods);
-        RTListInit(&g_LstPdmDevs);
+        { "--plugin",   'p', RTGETOPT_REQ_STRING },
+        { "--module",   'm', RTGETOPT_REQ_STRING },
+        { "--testcase", 't', RTGETOPT_REQ_STRING }
+    };
 
-        rc = tstDevLoadPlugin("TSTDevTestcases");
-        if (RT_SUCCESS(rc) || true)
+    const char *pszTestcase = NULL;
+    int ch;
+    RTGETOPTUNION Value;
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /* fFlags */);
+    while ((ch = RTGetOpt(&GetState, &Value)))
+    {
+        int rc = VINF_SUCCESS;
+        switch (ch)
         {
-            rc = tstDevPdmLoadMod(argv[1], TSTDEVPDMMODTYPE_R3);
-            if (RT_SUCCESS(rc))
-                rc = tstDevPdmDevCreate("nvme");
-            else
-                rcExit = RTEXITCODE_FAILURE;
+            case 'p':
+                rc = tstDevLoadPlugin(Value.psz);
+                if (RT_FAILURE(rc))
+                    RTTestIFailed("Loading plugin '%s' failed with %Rrc", Value.psz, rc);
+                break;
+            case 'm':
+                rc = tstDevPdmLoadMod(Value.psz, TSTDEVPDMMODTYPE_R3);
+                if (RT_FAILURE(rc))
+                    RTTestIFailed("Loading module '%s' failed with %Rrc", Value.psz, rc);
+                break;
+            case 't':
+                pszTestcase = Value.psz;
+                break;
+            case 'h':
+                RTPrintf("Usage: %s --plugin <testcases> --module <devices> [--testcase <name>]\n", RTProcShortName());
+                return RTEXITCODE_SUCCESS;
+            default:
+                return RTGetOptPrintError(ch, &Value);
         }
-        else
-            rcExit = RTEXITCODE_FAILURE;
 
-        //rcExit = tstDevParseOptions(argc, argv);
+        if (RT_FAILURE(rc))
+            return RTTestSummaryAndDestroy(hTest);
     }
-    else
-        rcExit = RTEXITCODE_FAILURE;
 
-    return rcExit;
-}
+    /*
+     * Run all registered testcases or only the one given.
+     */
+    PCTSTDEVTESTCASE pTestcase;
+    RTListForEach(&g_LstTestcases, pTestcase, TSTDEVTESTCASE, NdTestcases)
+    {
+        if (   pszTestcase
+            && RTStrCmp(pszTestcase, pTestcase->pTestcaseReg->szName))
+            continue;
 
+        RTTestSub(hTest, pTestcase->pTestcaseReg->szName);
+        int rc = tstDevTestcaseRun(pTestcase);
+        if (RT_FAILURE(rc))
+            RTTestFailed(hTest, "Testcase '%s' failed with %Rrc", pTestcase->pTestcaseReg->szName, rc);
+        RTTestSubDone(hTest);
+    }
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -99,6 +99,54 @@ typedef RTDEVDUTIOPORT *PRTDEVDUTIOPORT;
 /** Pointer to a const I/O port handler. */
 typedef const RTDEVDUTIOPORT *PCRTDEVDUTIOPORT;
 
+/**
+ * Registered MMIO region.
+ */
+typedef struct RTDEVDUTMMIO
+{
+    /** Node for the list of registered regions. */
+    RTLISTNODE                      NdMmio;
+    /** Start address of the region. */
+    RTGCPHYS                        GCPhysStart;
+    /** Size of the region. */
+    RTGCPHYS                        cbRegion;
+    /** IOMMMIO_FLAGS_XXX given at registration. */
+    uint32_t                        fFlags;
+    /** Opaque user data - R3. */
+    void                            *pvUserR3;
+    /** Write handler - R3. */
+    PFNIOMMMIOWRITE                 pfnWriteR3;
+    /** Read handler - R3. */
+    PFNIOMMMIOREAD                  pfnReadR3;
+    /** Fill handler - R3. */
+    PFNIOMMMIOFILL                  pfnFillR3;
+} RTDEVDUTMMIO;
+/** Pointer to a registered MMIO region. */
+typedef RTDEVDUTMMIO *PRTDEVDUTMMIO;
+/** Pointer to a const MMIO region. */
+typedef const RTDEVDUTMMIO *PCRTDEVDUTMMIO;
+
+/**
+ * Registered statistics sample.
+ */
+typedef struct TSTDEVDUTSTAMSAMPLE
+{
+    /** Node for the list of samples. */
+    RTLISTNODE                      NdStam;
+    /** Pointer to the sample data. */
+    void                            *pvSample;
+    /** Sample type. */
+    STAMTYPE                        enmType;
+    /** Sample unit. */
+    STAMUNIT                        enmUnit;
+    /** The sample name, variable length. */
+    char                            szName[RT_FLEXIBLE_ARRAY];
+} TSTDEVDUTSTAMSAMPLE;
+/** Pointer to a registered statistics sample. */
+typedef TSTDEVDUTSTAMSAMPLE *PTSTDEVDUTSTAMSAMPLE;
+/** Pointer to a const statistics sample. */
+typedef const TSTDEVDUTSTAMSAMPLE *PCTSTDEVDUTSTAMSAMPLE;
+
 /**
  * The Support Driver session state.
  */
@@ -192,12 +240,18 @@ typedef struct TSTDEVDUTINT
     RTLISTANCHOR                    LstIoPorts;
     /** List of timers registered. */
     RTLISTANCHOR                    LstTimers;
+    /** Number of TSTDEVDUTHLP::pfnTimersRun calls so far, see TMTIMER::uTimersRunLast. */
+    uint32_t                        uTimersRun;
     /** List of registered MMIO regions. */
     RTLISTANCHOR                    LstMmio;
     /** List of MM Heap allocations. */
     RTLISTANCHOR                    LstMmHeap;
     /** List of PDM threads. */
     RTLISTANCHOR                    LstPdmThreads;
+    /** List of PDM queues. */
+    RTLISTANCHOR                    LstPdmQueues;
+    /** List of registered statistics samples. */
+    RTLISTANCHOR                    LstStam;
     /** The SUP session we emulate. */
     TSTDEVSUPDRVSESSION             SupSession;
     /** The VM state assoicated with this device. */
@@ -206,8 +260,25 @@ typedef struct TSTDEVDUTINT
     PPDMPCIDEV                      pPciDev;
     /** PCI Region descriptors. */
     TSTDEVDUTPCIREGION              aPciRegions[VBOX_PCI_NUM_REGIONS];
+    /** Current level of the interrupt line. */
+    volatile int32_t                iIrqLevel;
+    /** Number of times the interrupt line was raised. */
+    volatile uint64_t               cIrqsRaised;
+    /** The emulated guest RAM starting at physical address 0. */
+    uint8_t                         *pbPhysMem;
+    /** Size of the emulated guest RAM. */
+    size_t                          cbPhysMem;
+    /** The default critical section of the device. */
+    PDMCRITSECT                     CritSectDev;
+    /** The NOP critical section handed out by pfnCritSectGetNop. */
+    PDMCRITSECT                     CritSectNop;
 } TSTDEVDUTINT;
 
+/** Size of the guest RAM emulated for every device under test. */
+#define TSTDEV_PHYS_MEM_SIZE        _32M
+
+
+extern const TSTDEVDUTHLP g_tstDevDutHlp;
 
 DECLHIDDEN(int) tstDevPdmLdrGetSymbol(PTSTDEVDUTINT pThis, const char *pszMod, TSTDEVPDMMODTYPE enmModType,
                                       const char *pszSymbol, PFNRT *ppfn);
@@ -24,8 +24,10 @@
 #include <VBox/version.h>
 #include <VBox/vmm/pdmpci.h>
 
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/mem.h>
+#include <iprt/string.h>
 
 #include "tstDeviceInternal.h"
 
@@ -65,6 +67,35 @@
 *   Internal Functions                                                                                                           *
 *********************************************************************************************************************************/
 
+/**
+ * Records a statistics sample registered by the device under test.
+ *
+ * @param   pThis       The device under test.
+ * @param   pvSample    Pointer to the sample.
+ * @param   enmType     Sample type.
+ * @param   enmUnit     Sample unit.
+ * @param   pszName     Name format string.
+ * @param   va          Format arguments.
+ */
+static void tstDevDutStamRegisterV(PTSTDEVDUTINT pThis, void *pvSample, STAMTYPE enmType, STAMUNIT enmUnit,
+                                   const char *pszName, va_list va)
+{
+    char szName[256];
+    size_t cchName = RTStrPrintfV(szName, sizeof(szName), pszName, va);
+    PTSTDEVDUTSTAMSAMPLE pSample = (PTSTDEVDUTSTAMSAMPLE)RTMemAllocZ(RT_UOFFSETOF(TSTDEVDUTSTAMSAMPLE, szName[cchName + 1]));
+    if (RT_LIKELY(pSample))
+    {
+        pSample->pvSample = pvSample;
+        pSample->enmType  = enmType;
+        pSample->enmUnit  = enmUnit;
+        memcpy(&pSample->szName[0], szName, cchName + 1);
+
+        tstDevDutLockExcl(pThis);
+        RTListAppend(&pThis->LstStam, &pSample->NdStam);
+        tstDevDutUnlockExcl(pThis);
+    }
+}
+
 
 
 /** @interface_method_impl{PDMDEVHLPR3,pfnIOPortRegister} */
@@ -161,8 +192,22 @@ static DECLCALLBACK(int) pdmR3DevHlp_IOPortDeregister(PPDMDEVINS pDevIns, RTIOPO
     LogFlow(("pdmR3DevHlp_IOPortDeregister: caller='%s'/%d: Port=%#x cPorts=%#x\n",
              pDevIns->pReg->szName, pDevIns->iInstance, Port, cPorts));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    PRTDEVDUTIOPORT pIoPort;
+    int rc = VERR_IOM_IOPORT_RANGE_NOT_FOUND;
+    tstDevDutLockExcl(pThis);
+    RTListForEach(&pThis->LstIoPorts, pIoPort, RTDEVDUTIOPORT, NdIoPorts)
+    {
+        if (   pIoPort->PortStart == Port
+            && pIoPort->cPorts == cPorts)
+        {
+            RTListNodeRemove(&pIoPort->NdIoPorts);
+            RTMemFree(pIoPort);
+            rc = VINF_SUCCESS;
+            break;
+        }
+    }
+    tstDevDutUnlockExcl(pThis);
 
     LogFlow(("pdmR3DevHlp_IOPortDeregister: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -178,8 +223,27 @@ static DECLCALLBACK(int) pdmR3DevHlp_MMIORegister(PPDMDEVINS pDevIns, RTGCPHYS G
     LogFlow(("pdmR3DevHlp_MMIORegister: caller='%s'/%d: GCPhysStart=%RGp cbRange=%RGp pvUser=%p pfnWrite=%p pfnRead=%p pfnFill=%p fFlags=%#x pszDesc=%p:{%s}\n",
              pDevIns->pReg->szName, pDevIns->iInstance, GCPhysStart, cbRange, pvUser, pfnWrite, pfnRead, pfnFill, pszDesc, fFlags, pszDesc));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    /** @todo Verify there is no overlapping. */
+
+    RT_NOREF(pszDesc);
+    int rc = VINF_SUCCESS;
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    PRTDEVDUTMMIO pMmio = (PRTDEVDUTMMIO)RTMemAllocZ(sizeof(RTDEVDUTMMIO));
+    if (RT_LIKELY(pMmio))
+    {
+        pMmio->GCPhysStart = GCPhysStart;
+        pMmio->cbRegion    = cbRange;
+        pMmio->fFlags      = fFlags;
+        pMmio->pvUserR3    = pvUser;
+        pMmio->pfnWriteR3  = pfnWrite;
+        pMmio->pfnReadR3   = pfnRead;
+        pMmio->pfnFillR3   = pfnFill;
+        tstDevDutLockExcl(pThis);
+        RTListAppend(&pThis->LstMmio, &pMmio->NdMmio);
+        tstDevDutUnlockExcl(pThis);
+    }
+    else
+        rc = VERR_NO_MEMORY;
 
     LogFlow(("pdmR3DevHlp_MMIORegister: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -224,8 +288,22 @@ static DECLCALLBACK(int) pdmR3DevHlp_MMIODeregister(PPDMDEVINS pDevIns, RTGCPHYS
     LogFlow(("pdmR3DevHlp_MMIODeregister: caller='%s'/%d: GCPhysStart=%RGp cbRange=%RGp\n",
              pDevIns->pReg->szName, pDevIns->iInstance, GCPhysStart, cbRange));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    PRTDEVDUTMMIO pMmio;
+    int rc = VERR_IOM_MMIO_RANGE_NOT_FOUND;
+    tstDevDutLockExcl(pThis);
+    RTListForEach(&pThis->LstMmio, pMmio, RTDEVDUTMMIO, NdMmio)
+    {
+        if (   pMmio->GCPhysStart == GCPhysStart
+            && pMmio->cbRegion == cbRange)
+        {
+            RTListNodeRemove(&pMmio->NdMmio);
+            RTMemFree(pMmio);
+            rc = VINF_SUCCESS;
+            break;
+        }
+    }
+    tstDevDutUnlockExcl(pThis);
 
     LogFlow(("pdmR3DevHlp_MMIODeregister: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -475,6 +553,9 @@ static DECLCALLBACK(int) pdmR3DevHlp_TMTimerCreate(PPDMDEVINS pDevIns, TMCLOCK e
         pTimer->pfnCallbackDev = pfnCallback;
         pTimer->pvUser         = pvUser;
         pTimer->fFlags         = fFlags;
+        pTimer->pDevIns        = pDevIns;
+        /* Like TM, the callback runs with the device critical section held unless told otherwise. */
+        pTimer->pCritSect      = (fFlags & TMTIMER_FLAGS_NO_CRIT_SECT) ? NULL : pDevIns->pCritSectRoR3;
         RTListAppend(&pDevIns->Internal.s.pDut->LstTimers, &pTimer->NdDevTimers);
         *ppTimer = pTimer;
     }
@@ -582,8 +663,17 @@ static DECLCALLBACK(int) pdmR3DevHlp_PhysRead(PPDMDEVINS pDevIns, RTGCPHYS GCPhy
     LogFlow(("pdmR3DevHlp_PhysRead: caller='%s'/%d: GCPhys=%RGp pvBuf=%p cbRead=%#x\n",
              pDevIns->pReg->szName, pDevIns->iInstance, GCPhys, pvBuf, cbRead));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    int rc = VINF_SUCCESS;
+    if (RT_LIKELY(   GCPhys < pThis->cbPhysMem
+                  && cbRead <= pThis->cbPhysMem - GCPhys))
+        memcpy(pvBuf, &pThis->pbPhysMem[GCPhys], cbRead);
+    else
+    {
+        /* Reads from unassigned memory return all ones. */
+        memset(pvBuf, 0xff, cbRead);
+        rc = VERR_PGM_INVALID_GC_PHYSICAL_ADDRESS;
+    }
 
     Log(("pdmR3DevHlp_PhysRead: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -597,8 +687,13 @@ static DECLCALLBACK(int) pdmR3DevHlp_PhysWrite(PPDMDEVINS pDevIns, RTGCPHYS GCPh
     LogFlow(("pdmR3DevHlp_PhysWrite: caller='%s'/%d: GCPhys=%RGp pvBuf=%p cbWrite=%#x\n",
              pDevIns->pReg->szName, pDevIns->iInstance, GCPhys, pvBuf, cbWrite));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    int rc = VINF_SUCCESS;
+    if (RT_LIKELY(   GCPhys < pThis->cbPhysMem
+                  && cbWrite <= pThis->cbPhysMem - GCPhys))
+        memcpy(&pThis->pbPhysMem[GCPhys], pvBuf, cbWrite);
+    else
+        rc = VERR_PGM_INVALID_GC_PHYSICAL_ADDRESS;
 
     Log(("pdmR3DevHlp_PhysWrite: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -760,8 +855,8 @@ static DECLCALLBACK(VMSTATE) pdmR3DevHlp_VMState(PPDMDEVINS pDevIns)
 {
     PDMDEV_ASSERT_DEVINS(pDevIns);
 
-    VMSTATE enmVMState = VMSTATE_CREATING;
-    AssertFailed();
+    /* The device under test is always considered to be running. */
+    VMSTATE enmVMState = VMSTATE_RUNNING;
 
     LogFlow(("pdmR3DevHlp_VMState: caller='%s'/%d: returns %d\n", pDevIns->pReg->szName, pDevIns->iInstance,
              enmVMState));
@@ -775,7 +870,6 @@ static DECLCALLBACK(bool) pdmR3DevHlp_VMTeleportedAndNotFullyResumedYet(PPDMDEVI
     PDMDEV_ASSERT_DEVINS(pDevIns);
 
     bool fRc = false;
-    AssertFailed();
 
     LogFlow(("pdmR3DevHlp_VMState: caller='%s'/%d: returns %RTbool\n", pDevIns->pReg->szName, pDevIns->iInstance,
              fRc));
@@ -854,8 +948,9 @@ static DECLCALLBACK(int) pdmR3DevHlp_DBGFInfoRegister(PPDMDEVINS pDevIns, const
     LogFlow(("pdmR3DevHlp_DBGFInfoRegister: caller='%s'/%d: pszName=%p:{%s} pszDesc=%p:{%s} pfnHandler=%p\n",
              pDevIns->pReg->szName, pDevIns->iInstance, pszName, pszName, pszDesc, pszDesc, pfnHandler));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    /* There is no debugger to show the info, ignore. */
+    RT_NOREF(pszName, pszDesc, pfnHandler);
+    int rc = VINF_SUCCESS;
 
     LogFlow(("pdmR3DevHlp_DBGFInfoRegister: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -893,8 +988,7 @@ static DECLCALLBACK(void) pdmR3DevHlp_STAMRegister(PPDMDEVINS pDevIns, void *pvS
                                                    STAMUNIT enmUnit, const char *pszDesc)
 {
     PDMDEV_ASSERT_DEVINS(pDevIns);
-    RT_NOREF(pvSample, enmType, pszName, enmUnit, pszDesc);
-    AssertFailed();
+    pDevIns->pHlpR3->pfnSTAMRegisterF(pDevIns, pvSample, enmType, STAMVISIBILITY_ALWAYS, enmUnit, pszDesc, "%s", pszName);
 }
 
 
@@ -904,8 +998,12 @@ static DECLCALLBACK(void) pdmR3DevHlp_STAMRegisterF(PPDMDEVINS pDevIns, void *pv
                                                     STAMUNIT enmUnit, const char *pszDesc, const char *pszName, ...)
 {
     PDMDEV_ASSERT_DEVINS(pDevIns);
-    RT_NOREF(pvSample, enmType, enmVisibility, enmUnit, pszDesc, pszName);
-    AssertFailed();
+    RT_NOREF(enmVisibility, pszDesc);
+
+    va_list va;
+    va_start(va, pszName);
+    tstDevDutStamRegisterV(TSTDEV_PDMDEVINS_2_DUT(pDevIns), pvSample, enmType, enmUnit, pszName, va);
+    va_end(va);
 }
 
 
@@ -914,8 +1012,8 @@ static DECLCALLBACK(void) pdmR3DevHlp_STAMRegisterV(PPDMDEVINS pDevIns, void *pv
                                                     STAMUNIT enmUnit, const char *pszDesc, const char *pszName, va_list args)
 {
     PDMDEV_ASSERT_DEVINS(pDevIns);
-    RT_NOREF(pvSample, enmType, enmVisibility, enmUnit, pszDesc, pszName, args);
-    AssertFailed();
+    RT_NOREF(enmVisibility, pszDesc);
+    tstDevDutStamRegisterV(TSTDEV_PDMDEVINS_2_DUT(pDevIns), pvSample, enmType, enmUnit, pszName, args);
 }
 
 
@@ -1048,7 +1146,20 @@ static DECLCALLBACK(void) pdmR3DevHlp_PCISetIrq(PPDMDEVINS pDevIns, PPDMPCIDEV p
     LogFlow(("pdmR3DevHlp_PCISetIrq: caller='%s'/%d: pPciDev=%p:{%#x} iIrq=%d iLevel=%d\n",
              pDevIns->pReg->szName, pDevIns->iInstance, pPciDev, pPciDev->uDevFn, iIrq, iLevel));
 
-    AssertFailed();
+    RT_NOREF(iIrq);
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    if ((iLevel & PDM_IRQ_LEVEL_FLIP_FLOP) == PDM_IRQ_LEVEL_FLIP_FLOP)
+    {
+        /* Edge triggered, counts as raised once and leaves the line low. */
+        ASMAtomicIncU64(&pThis->cIrqsRaised);
+        ASMAtomicWriteS32(&pThis->iIrqLevel, 0);
+    }
+    else
+    {
+        int32_t iLevelOld = ASMAtomicXchgS32(&pThis->iIrqLevel, iLevel & PDM_IRQ_LEVEL_HIGH);
+        if (!iLevelOld && (iLevel & PDM_IRQ_LEVEL_HIGH))
+            ASMAtomicIncU64(&pThis->cIrqsRaised);
+    }
 
     LogFlow(("pdmR3DevHlp_PCISetIrq: caller='%s'/%d: returns void\n", pDevIns->pReg->szName, pDevIns->iInstance));
 }
@@ -1104,9 +1215,10 @@ static DECLCALLBACK(int) pdmR3DevHlp_DriverAttach(PPDMDEVINS pDevIns, uint32_t i
     LogFlow(("pdmR3DevHlp_DriverAttach: caller='%s'/%d: iLun=%d pBaseInterface=%p ppBaseInterface=%p pszDesc=%p:{%s}\n",
              pDevIns->pReg->szName, pDevIns->iInstance, iLun, pBaseInterface, ppBaseInterface, pszDesc, pszDesc));
 
-    /** @todo */
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
     int rc = VERR_PDM_NO_ATTACHED_DRIVER;
-    //AssertFailed();
+    if (pThis->pTestcaseReg->pfnDrvAttach)
+        rc = pThis->pTestcaseReg->pfnDrvAttach(pThis, iLun, pBaseInterface, ppBaseInterface);
 
     LogFlow(("pdmR3DevHlp_DriverAttach: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
     return rc;
@@ -1137,8 +1249,30 @@ static DECLCALLBACK(int) pdmR3DevHlp_QueueCreate(PPDMDEVINS pDevIns, size_t cbIt
     LogFlow(("pdmR3DevHlp_QueueCreate: caller='%s'/%d: cbItem=%#x cItems=%#x cMilliesInterval=%u pfnCallback=%p fRZEnabled=%RTbool pszName=%p:{%s} ppQueue=%p\n",
              pDevIns->pReg->szName, pDevIns->iInstance, cbItem, cItems, cMilliesInterval, pfnCallback, fRZEnabled, pszName, pszName, ppQueue));
 
-    int rc = VERR_NOT_IMPLEMENTED;
-    AssertFailed();
+    /*
+     * Items are handed to the consumer right when they are inserted because
+     * everything runs in ring-3 here, so the item count and the polling interval
+     * don't matter.
+     */
+    RT_NOREF(cItems, cMilliesInterval, fRZEnabled, pszName);
+    AssertReturn(cbItem >= sizeof(PDMQUEUEITEMCORE), VERR_INVALID_PARAMETER);
+
+    int rc = VINF_SUCCESS;
+    PTSTDEVDUTINT pThis = TSTDEV_PDMDEVINS_2_DUT(pDevIns);
+    PPDMQUEUE pQueue = (PPDMQUEUE)RTMemAllocZ(sizeof(PDMQUEUE));
+    if (RT_LIKELY(pQueue))
+    {
+        pQueue->pVmmCallbacks  = pDevIns->Internal.s.pVmmCallbacks;
+        pQueue->pDevIns        = pDevIns;
+        pQueue->pfnCallbackDev = pfnCallback;
+        pQueue->cbItem         = cbItem;
+        tstDevDutLockExcl(pThis);
+        RTListAppend(&pThis->LstPdmQueues, &pQueue->NdPdmQueues);
+        tstDevDutUnlockExcl(pThis);
+        *ppQueue = pQueue;
+    }
+    else
+        rc = VERR_NO_MEMORY;
 
     LogFlow(("pdmR3DevHlp_QueueCreate: caller='%s'/%d: returns %Rrc *ppQueue=%p\n", pDevIns->pReg->szName, pDevIns->iInstance, rc, *ppQueue));
     return rc;
@@ -1168,8 +1302,7 @@ static DECLCALLBACK(PPDMCRITSECT) pdmR3DevHlp_CritSectGetNop(PPDMDEVINS pDevIns)
 {
     PDMDEV_ASSERT_DEVINS(pDevIns);
 
-    AssertFailed();
-    PPDMCRITSECT pCritSect = NULL;
+    PPDMCRITSECT pCritSect = &TSTDEV_PDMDEVINS_2_DUT(pDevIns)->CritSectNop;
 
     LogFlow(("pdmR3DevHlp_CritSectGetNop: caller='%s'/%d: return %p\n",
              pDevIns->pReg->szName, pDevIns->iInstance, pCritSect));
@@ -61,6 +61,127 @@ typedef const TSTDEVCFGITEM *PCTSTDEVCFGITEM;
 /** Device under test handle. */
 typedef struct TSTDEVDUTINT *TSTDEVDUT;
 
+/**
+ * Helper callbacks the framework gives a testcase to drive the device under test.
+ *
+ * All accesses are dispatched to the ring-3 handlers of the device with the
+ * device critical section held, like IOM and TM would do.
+ */
+typedef struct TSTDEVDUTHLP
+{
+    /**
+     * Reads from an I/O port of the device under test.
+     *
+     * @returns VBox status code.
+     * @param   hDut        Handle of the device under test.
+     * @param   Port        The I/O port to read from.
+     * @param   pu32        Where to store the value read.
+     * @param   cb          Access size in bytes (1, 2 or 4).
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIoPortRead, (TSTDEVDUT hDut, RTIOPORT Port, uint32_t *pu32, unsigned cb));
+
+    /**
+     * Writes to an I/O port of the device under test.
+     *
+     * @returns VBox status code.
+     * @param   hDut        Handle of the device under test.
+     * @param   Port        The I/O port to write to.
+     * @param   u32         The value to write.
+     * @param   cb          Access size in bytes (1, 2 or 4).
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIoPortWrite, (TSTDEVDUT hDut, RTIOPORT Port, uint32_t u32, unsigned cb));
+
+    /**
+     * Reads from a MMIO region of the device under test.
+     *
+     * @returns VBox status code.
+     * @param   hDut        Handle of the device under test.
+     * @param   GCPhys      The physical address to read from.
+     * @param   pv          Where to store the data read.
+     * @param   cb          Access size in bytes.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnMmioRead, (TSTDEVDUT hDut, RTGCPHYS GCPhys, void *pv, unsigned cb));
+
+    /**
+     * Writes to a MMIO region of the device under test.
+     *
+     * @returns VBox status code.
+     * @param   hDut        Handle of the device under test.
+     * @param   GCPhys      The physical address to write to.
+     * @param   pv          The data to write.
+     * @param   cb          Access size in bytes.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnMmioWrite, (TSTDEVDUT hDut, RTGCPHYS GCPhys, const void *pv, unsigned cb));
+
+    /**
+     * Maps a PCI region of the device under test by calling the registered
+     * region mapping callback, like the PCI bus would do when the guest
+     * programs the BAR.
+     *
+     * @returns VBox status code.
+     * @param   hDut        Handle of the device under test.
+     * @param   iRegion     The PCI region to map.
+     * @param   GCPhys      The address (I/O port for I/O regions) to map the region at.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnPciRegionMap, (TSTDEVDUT hDut, uint32_t iRegion, RTGCPHYS GCPhys));
+
+    /**
+     * Returns a pointer to the emulated guest RAM for the given range so the
+     * testcase can set up descriptor rings and buffers directly.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_OUT_OF_RANGE if the range is not backed by guest RAM.
+     * @param   hDut        Handle of the device under test.
+     * @param   GCPhys      Start of the range.
+     * @param   cb          Size of the range.
+     * @param   ppv         Where to store the pointer to the range.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnPhysGetPtr, (TSTDEVDUT hDut, RTGCPHYS GCPhys, size_t cb, void **ppv));
+
+    /**
+     * Queries the interrupt line state of the device under test.
+     *
+     * @returns Current interrupt level, 0 if deasserted.
+     * @param   hDut        Handle of the device under test.
+     * @param   pcRaised    Where to store the number of times the interrupt
+     *                      was raised so far, optional.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIrqQuery, (TSTDEVDUT hDut, uint64_t *pcRaised));
+
+    /**
+     * Runs the callbacks of all expired timers of the device under test.
+     *
+     * Each timer runs at most once per call, so a timer which got re-armed to
+     * expire right away is only run on the next call.
+     *
+     * @returns Number of nanoseconds until the next timer expires, 0 if a timer
+     *          is expired already, UINT64_MAX if no timer is active.
+     * @param   hDut        Handle of the device under test.
+     */
+    DECLR3CALLBACKMEMBER(uint64_t, pfnTimersRun, (TSTDEVDUT hDut));
+
+    /**
+     * Dumps the statistics samples the device under test registered.
+     *
+     * @param   hDut        Handle of the device under test.
+     * @param   pszPat      Simple pattern (RTStrSimplePatternMultiMatch) selecting
+     *                      the samples to dump, NULL for all.
+     */
+    DECLR3CALLBACKMEMBER(void, pfnStatsDump, (TSTDEVDUT hDut, const char *pszPat));
+
+    /**
+     * Resets the statistics samples the device under test registered.
+     *
+     * @param   hDut        Handle of the device under test.
+     * @param   pszPat      Simple pattern selecting the samples to reset, NULL for all.
+     */
+    DECLR3CALLBACKMEMBER(void, pfnStatsReset, (TSTDEVDUT hDut, const char *pszPat));
+} TSTDEVDUTHLP;
+/** Pointer to the device under test helpers. */
+typedef TSTDEVDUTHLP *PTSTDEVDUTHLP;
+/** Pointer to the constant device under test helpers. */
+typedef const TSTDEVDUTHLP *PCTSTDEVDUTHLP;
+
 /**
  * Testcase registration structure.
  */
@@ -77,13 +198,29 @@ typedef struct TSTDEVTESTCASEREG
     /** CFGM configuration for the device to be instantiated. */
     PCTSTDEVCFGITEM     paDevCfg;
 
+    /**
+     * Returns the driver to attach to the given LUN of the device under test, optional.
+     *
+     * Called while the device is constructed. Without this callback nothing is
+     * attached to any LUN.
+     *
+     * @returns VBox status code.
+     * @retval  VERR_PDM_NO_ATTACHED_DRIVER if nothing should be attached to the LUN.
+     * @param   hDut      Handle of the device under test.
+     * @param   iLun      The LUN the device wants to attach a driver to.
+     * @param   pDevBase  The base interface of the device for the LUN.
+     * @param   ppDrvBase Where to store the base interface of the driver.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnDrvAttach, (TSTDEVDUT hDut, uint32_t iLun, PPDMIBASE pDevBase, PPDMIBASE *ppDrvBase));
+
     /**
      * Testcase entry point.
      *
      * @returns VBox status code.
      * @param   hDut      Handle of the device under test.
+     * @param   pHlp      Helpers to access the device under test.
      */
-    DECLR3CALLBACKMEMBER(int, pfnTestEntry, (TSTDEVDUT hDut));
+    DECLR3CALLBACKMEMBER(int, pfnTestEntry, (TSTDEVDUT hDut, PCTSTDEVDUTHLP pHlp));
 } TSTDEVTESTCASEREG;
 /** Pointer to a testcase registration structure. */
 typedef TSTDEVTESTCASEREG *PTSTDEVTESTCASEREG;
@@ -1606,9 +1606,11 @@ int main()
     GEN_CHECK_OFF(VNETSTATE, u32PktNo);
     GEN_CHECK_OFF(VNETSTATE, fPromiscuous);
     GEN_CHECK_OFF(VNETSTATE, fAllMulti);
-    GEN_CHECK_OFF(VNETSTATE, pRxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pTxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
+    GEN_CHECK_OFF(VNETSTATE, cQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, cQueuePairsActive);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1]);
+    GEN_CHECK_OFF(VNETSTATE, abFlowSteer);
     GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
     GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
 #endif /* VBOX_WITH_VIRTIO */
@@ -24,7 +24,10 @@
 #include <VBox/version.h>
 #include <VBox/vmm/pdmpci.h>
 
+#include <iprt/asm.h>
 #include <iprt/mem.h>
+#include <iprt/string.h>
+#include <iprt/time.h>
 
 #include "tstDeviceInternal.h"
 
@@ -217,9 +220,26 @@ static DECLCALLBACK(int) tstDevVmm_CFGMR3InsertString(PCFGMNODE pNode, const cha
 
 static DECLCALLBACK(int) tstDevVmm_CFGMR3QueryBytes(PCFGMNODE pNode, const char *pszName, void *pvData, size_t cbData)
 {
-    RT_NOREF(pNode, pszName, pvData, cbData);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    if (!pNode)
+        return VERR_CFGM_NO_PARENT;
+
+    PCTSTDEVCFGITEM pCfgItem;
+    int rc = tstDev_CfgmR3ResolveItem(pNode->pDut->pTestcaseReg->paDevCfg, pszName, &pCfgItem);
+    if (RT_SUCCESS(rc))
+    {
+        if (pCfgItem->enmType == TSTDEVCFGITEMTYPE_BYTES)
+        {
+            /* Byte values are given as a hex string in the testcase configuration. */
+            if (strlen(pCfgItem->pszVal) / 2 <= cbData)
+                rc = RTStrConvertHexBytes(pCfgItem->pszVal, pvData, cbData, 0 /*fFlags*/);
+            else
+                rc = VERR_CFGM_NOT_ENOUGH_SPACE;
+        }
+        else
+            rc = VERR_CFGM_NOT_BYTES;
+    }
+
+    return rc;
 }
 
 
@@ -262,7 +282,7 @@ static DECLCALLBACK(int) tstDevVmm_CFGMR3QuerySize(PCFGMNODE pNode, const char *
                 break;
 
             case TSTDEVCFGITEMTYPE_BYTES:
-                AssertFailed();
+                *pcb = strlen(pCfgItem->pszVal) / 2;
                 break;
 
             default:
@@ -455,9 +475,7 @@ static DECLCALLBACK(int) tstDevVmm_PDMCritSectEnterDebug(PPDMCRITSECT pCritSect,
 
 static DECLCALLBACK(bool) tstDevVmm_PDMCritSectIsInitialized(PCPDMCRITSECT pCritSect)
 {
-    RT_NOREF(pCritSect);
-    AssertFailed();
-    return false;
+    return RTCritSectIsInitialized(&pCritSect->s.CritSect);
 }
 
 
@@ -499,31 +517,33 @@ static DECLCALLBACK(bool) tstDevVmm_PDMNsAllocateBandwidth(PPDMNSFILTER pFilter,
 
 static DECLCALLBACK(PPDMQUEUEITEMCORE) tstDevVmm_PDMQueueAlloc(PPDMQUEUE pQueue)
 {
-    RT_NOREF(pQueue);
-    AssertFailed();
-    return NULL;
+    return (PPDMQUEUEITEMCORE)RTMemAllocZ(pQueue->cbItem);
 }
 
 
 static DECLCALLBACK(bool) tstDevVmm_PDMQueueFlushIfNecessary(PPDMQUEUE pQueue)
 {
     RT_NOREF(pQueue);
-    AssertFailed();
-    return false;
+    return false; /* Items are consumed when inserted, there is never anything pending. */
 }
 
 
 static DECLCALLBACK(void) tstDevVmm_PDMQueueInsert(PPDMQUEUE pQueue, PPDMQUEUEITEMCORE pItem)
 {
-    RT_NOREF(pQueue, pItem);
-    AssertFailed();
+    /*
+     * There is no EMT to defer the work to, so the consumer is called right
+     * away. An item the consumer refuses is dropped instead of being retried.
+     */
+    bool fConsumed = pQueue->pfnCallbackDev(pQueue->pDevIns, pItem);
+    if (!fConsumed)
+        LogRel(("tstDevVmm_PDMQueueInsert: Queue %p refused item %p, dropping\n", pQueue, pItem));
+    RTMemFree(pItem);
 }
 
 
 static DECLCALLBACK(R0PTRTYPE(PPDMQUEUE)) tstDevVmm_PDMQueueR0Ptr(PPDMQUEUE pQueue)
 {
     RT_NOREF(pQueue);
-    AssertFailed();
     return NIL_RTR0PTR;
 }
 
@@ -531,7 +551,6 @@ static DECLCALLBACK(R0PTRTYPE(PPDMQUEUE)) tstDevVmm_PDMQueueR0Ptr(PPDMQUEUE pQue
 static DECLCALLBACK(RCPTRTYPE(PPDMQUEUE)) tstDevVmm_PDMQueueRCPtr(PPDMQUEUE pQueue)
 {
     RT_NOREF(pQueue);
-    AssertFailed();
     return NIL_RTRCPTR;
 }
 
@@ -748,9 +767,14 @@ static DECLCALLBACK(uint64_t) tstDevVmm_TMCpuTicksPerSecond(PVM pVM)
 
 static DECLCALLBACK(int) tstDevVmm_TMR3TimerDestroy(PTMTIMER pTimer)
 {
-    RT_NOREF(pTimer);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    PTSTDEVDUTINT pThis = pTimer->pDevIns->Internal.s.pDut;
+
+    tstDevDutLockExcl(pThis);
+    RTListNodeRemove(&pTimer->NdDevTimers);
+    tstDevDutUnlockExcl(pThis);
+
+    RTMemFree(pTimer);
+    return VINF_SUCCESS;
 }
 
 
@@ -772,33 +796,62 @@ static DECLCALLBACK(int) tstDevVmm_TMR3TimerSave(PTMTIMERR3 pTimer, PSSMHANDLE p
 
 static DECLCALLBACK(int) tstDevVmm_TMR3TimerSetCritSect(PTMTIMERR3 pTimer, PPDMCRITSECT pCritSect)
 {
-    RT_NOREF(pTimer, pCritSect);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    pTimer->pCritSect = pCritSect;
+    return VINF_SUCCESS;
 }
 
 
 static DECLCALLBACK(uint64_t) tstDevVmm_TMTimerFromMilli(PTMTIMER pTimer, uint64_t cMilliSecs)
 {
-    RT_NOREF(pTimer, cMilliSecs);
-    AssertFailed();
-    return 0;
+    switch (pTimer->enmClock)
+    {
+        case TMCLOCK_VIRTUAL:
+        case TMCLOCK_VIRTUAL_SYNC:
+            return cMilliSecs * RT_NS_1MS;
+
+        case TMCLOCK_REAL:
+            return cMilliSecs;
+
+        default:
+            AssertMsgFailed(("Invalid enmClock=%d\n", pTimer->enmClock));
+            return 0;
+    }
 }
 
 
 static DECLCALLBACK(uint64_t) tstDevVmm_TMTimerFromNano(PTMTIMER pTimer, uint64_t cNanoSecs)
 {
-    RT_NOREF(pTimer, cNanoSecs);
-    AssertFailed();
-    return 0;
+    switch (pTimer->enmClock)
+    {
+        case TMCLOCK_VIRTUAL:
+        case TMCLOCK_VIRTUAL_SYNC:
+            return cNanoSecs;
+
+        case TMCLOCK_REAL:
+            return cNanoSecs / RT_NS_1MS;
+
+        default:
+            AssertMsgFailed(("Invalid enmClock=%d\n", pTimer->enmClock));
+            return 0;
+    }
 }
 
 
 static DECLCALLBACK(uint64_t) tstDevVmm_TMTimerGet(PTMTIMER pTimer)
 {
-    RT_NOREF(pTimer);
-    AssertFailed();
-    return 0;
+    switch (pTimer->enmClock)
+    {
+        case TMCLOCK_VIRTUAL:
+        case TMCLOCK_VIRTUAL_SYNC:
+            return RTTimeNanoTS();
+
+        case TMCLOCK_REAL:
+            return RTTimeMilliTS();
+
+        default:
+            AssertMsgFailed(("Invalid enmClock=%d\n", pTimer->enmClock));
+            return 0;
+    }
 }
 
 
@@ -822,33 +875,40 @@ static DECLCALLBACK(uint64_t) tstDevVmm_TMTimerGetFreq(PTMTIMER pTimer)
 
 static DECLCALLBACK(uint64_t) tstDevVmm_TMTimerGetNano(PTMTIMER pTimer)
 {
-    RT_NOREF(pTimer);
-    AssertFailed();
-    return 0;
+    switch (pTimer->enmClock)
+    {
+        case TMCLOCK_VIRTUAL:
+        case TMCLOCK_VIRTUAL_SYNC:
+            return RTTimeNanoTS();
+
+        case TMCLOCK_REAL:
+            return RTTimeMilliTS() * RT_NS_1MS;
+
+        default:
+            AssertMsgFailed(("Invalid enmClock=%d\n", pTimer->enmClock));
+            return 0;
+    }
 }
 
 
 static DECLCALLBACK(bool) tstDevVmm_TMTimerIsActive(PTMTIMER pTimer)
 {
-    RT_NOREF(pTimer);
-    AssertFailed();
-    return false;
+    return ASMAtomicReadBool(&pTimer->fActive);
 }
 
 
 static DECLCALLBACK(bool) tstDevVmm_TMTimerIsLockOwner(PTMTIMER pTimer)
 {
     RT_NOREF(pTimer);
-    AssertFailed();
-    return false;
+    /* There is no separate timer lock, the virtual sync clock is not serialized. */
+    return true;
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerLock(PTMTIMER pTimer, int rcBusy)
 {
     RT_NOREF(pTimer, rcBusy);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    return VINF_SUCCESS;
 }
 
 
@@ -868,56 +928,48 @@ static DECLCALLBACK(PTMTIMERRC) tstDevVmm_TMTimerRCPtr(PTMTIMER pTimer)
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerSet(PTMTIMER pTimer, uint64_t u64Expire)
 {
-    RT_NOREF(pTimer, u64Expire);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    pTimer->u64Expire = u64Expire;
+    ASMAtomicWriteBool(&pTimer->fActive, true);
+    return VINF_SUCCESS;
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerSetFrequencyHint(PTMTIMER pTimer, uint32_t uHz)
 {
     RT_NOREF(pTimer, uHz);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    return VINF_SUCCESS;
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerSetMicro(PTMTIMER pTimer, uint64_t cMicrosToNext)
 {
-    RT_NOREF(pTimer, cMicrosToNext);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    return tstDevVmm_TMTimerSet(pTimer, tstDevVmm_TMTimerGet(pTimer)
+                                        + tstDevVmm_TMTimerFromNano(pTimer, cMicrosToNext * RT_NS_1US));
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerSetMillies(PTMTIMER pTimer, uint32_t cMilliesToNext)
 {
-    RT_NOREF(pTimer, cMilliesToNext);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    return tstDevVmm_TMTimerSet(pTimer, tstDevVmm_TMTimerGet(pTimer) + tstDevVmm_TMTimerFromMilli(pTimer, cMilliesToNext));
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerSetNano(PTMTIMER pTimer, uint64_t cNanosToNext)
 {
-    RT_NOREF(pTimer, cNanosToNext);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    return tstDevVmm_TMTimerSet(pTimer, tstDevVmm_TMTimerGet(pTimer) + tstDevVmm_TMTimerFromNano(pTimer, cNanosToNext));
 }
 
 
 static DECLCALLBACK(int) tstDevVmm_TMTimerStop(PTMTIMER pTimer)
 {
-    RT_NOREF(pTimer);
-    AssertFailed();
-    return VERR_NOT_IMPLEMENTED;
+    ASMAtomicWriteBool(&pTimer->fActive, false);
+    return VINF_SUCCESS;
 }
 
 
 static DECLCALLBACK(void) tstDevVmm_TMTimerUnlock(PTMTIMER pTimer)
 {
     RT_NOREF(pTimer);
-    AssertFailed();
 }
 
 
@@ -65,7 +65,14 @@ typedef struct PDMQUEUE
 {
     /** Pointer to the callback table. */
     PCTSTDEVVMMCALLBACKS pVmmCallbacks;
-    /** @todo: */
+    /** Node for the list of queues of the device. */
+    RTLISTNODE           NdPdmQueues;
+    /** The device instance owning the queue. */
+    PPDMDEVINS           pDevIns;
+    /** Consumer callback (PFNPDMQUEUEDEV, the header isn't included yet). */
+    DECLR3CALLBACKMEMBER(bool, pfnCallbackDev, (PPDMDEVINS pDevIns, struct PDMQUEUEITEMCORE *pItem));
+    /** Size of a queue item. */
+    size_t               cbItem;
 } PDMQUEUE;
 
 /**
@@ -85,7 +92,16 @@ typedef struct TMTIMER
     void                 *pvUser;
     /** Flags. */
     uint32_t             fFlags;
-    /** @todo: */
+    /** The device instance owning the timer. */
+    PPDMDEVINS           pDevIns;
+    /** The critical section to enter when the timer fires, NULL for none. */
+    PPDMCRITSECT         pCritSect;
+    /** Absolute expiration time in clock ticks, valid when active. */
+    uint64_t             u64Expire;
+    /** Flag whether the timer is armed. */
+    bool                 fActive;
+    /** Number of the TSTDEVDUTHLP::pfnTimersRun call which ran the callback last. */
+    uint32_t             uTimersRunLast;
 } TMTIMER;
 
 /**
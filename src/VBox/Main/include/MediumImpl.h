@@ -168,7 +168,8 @@ public:
                                 MediumLockList *pMediumLockList,
                                 ComObjPtr<Progress> *aProgress,
                                 bool aWait);
-    Utf8Str i_getPreferredDiffFormat();
+    Utf8Str i_getPreferredDiffFormat(bool fLinkedClone = false);
+    Utf8Str i_getDedupStore();
     MediumVariant_T i_getPreferredDiffVariant();
 
     HRESULT i_close(AutoCaller &autoCaller);
@@ -221,7 +222,8 @@ public:
 
     HRESULT i_cloneToEx(const ComObjPtr<Medium> &aTarget, ULONG aVariant,
                         const ComObjPtr<Medium> &aParent, IProgress **aProgress,
-                        uint32_t idxSrcImageSame, uint32_t idxDstImageSame);
+                        uint32_t idxSrcImageSame, uint32_t idxDstImageSame,
+                        uint32_t cReadAhead = 0);
 
     const Utf8Str& i_getKeyId();
 
@@ -141,6 +141,7 @@ private:
                                 BOOL aPauseVM,
                                 BOOL *aLeftPaused);
     HRESULT cancelSaveStateWithReason();
+    HRESULT completeSaveStateWithReason();
 
 
     HRESULT i_unlockMachine(bool aFinalRelease, bool aFromServer, AutoWriteLock &aLockW);
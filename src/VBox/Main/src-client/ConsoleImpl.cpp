@@ -6399,6 +6399,18 @@ HRESULT Console::i_onlineMergeMedium(IMediumAttachment *aMediumAttachment,
 
     /* Finally trigger the merge. */
     vrc = pIMedium->pfnMerge(pIMedium, onlineMergeMediumProgress, aProgress);
+    if (vrc == VERR_CANCELLED)
+    {
+        /* The merge is stopped at the next chunk when the VM is powered off, the
+         * progress is saved and the snapshot stays intact so it can be resumed. */
+        VMSTATE enmVMState = VMR3GetStateU(ptrVM.rawUVM());
+        if (   enmVMState == VMSTATE_POWERING_OFF
+            || enmVMState == VMSTATE_POWERING_OFF_LS
+            || enmVMState == VMSTATE_OFF
+            || enmVMState == VMSTATE_OFF_LS)
+            return setError(VBOX_E_INVALID_VM_STATE,
+                            tr("The online medium merge was interrupted by powering off the VM, the snapshot was kept and can be deleted again"));
+    }
     if (RT_FAILURE(vrc))
         return setError(E_FAIL, tr("Failed to perform an online medium merge (%Rrc)"), vrc);
 
@@ -6752,6 +6764,17 @@ HRESULT Console::i_saveState(Reason_T aReason, const ComPtr<IProgress> &aProgres
     if (aReason != Reason_Unspecified)
         LogRel(("Saving state of VM, reason '%s'\n", Global::stringifyReason(aReason)));
 
+    /* Snapshots of a running VM can have the memory saved after the VM has
+       been resumed, the server completes the save via i_completeSaveState(). */
+    bool fSaveInBackground = false;
+    if (   aReason == Reason_Snapshot
+        && fContinueAfterwards)
+    {
+        Bstr strSaveInBackground;
+        mMachine->GetExtraData(Bstr("VBoxInternal2/SnapshotSaveStateInBackground").raw(), strSaveInBackground.asOutParam());
+        fSaveInBackground = strSaveInBackground == "1";
+    }
+
     /* ensure the directory for the saved state file exists */
     {
         Utf8Str dir = aStateFilePath;
@@ -6794,7 +6817,15 @@ HRESULT Console::i_saveState(Reason_T aReason, const ComPtr<IProgress> &aProgres
     mpVmm2UserMethods->pISnapshot = aSnapshot;
     mptrCancelableProgress = aProgress;
     alock.release();
-    int vrc = VMR3Save(ptrVM.rawUVM(),
+    int vrc;
+    if (fSaveInBackground)
+        vrc = VMR3SaveCow(ptrVM.rawUVM(),
+                          aStateFilePath.c_str(),
+                          Console::i_stateProgressCallback,
+                          static_cast<IProgress *>(aProgress),
+                          &aLeftPaused);
+    else
+        vrc = VMR3Save(ptrVM.rawUVM(),
                        aStateFilePath.c_str(),
                        fContinueAfterwards,
                        Console::i_stateProgressCallback,
@@ -6866,6 +6897,34 @@ HRESULT Console::i_cancelSaveState()
     return S_OK;
 }
 
+/**
+ * Internal entry point for completing a VM save state which i_saveState()
+ * left to finish while the VM is running.  This method is completely
+ * synchronous and does nothing if there is nothing left to save.
+ *
+ * @note Does not lock this object, the VM is running and saving may take a
+ *       while.
+ */
+HRESULT Console::i_completeSaveState()
+{
+    LogFlowThisFuncEnter();
+
+    AutoCaller autoCaller(this);
+    if (FAILED(autoCaller.rc())) return autoCaller.rc();
+
+    /* Get the VM handle. */
+    SafeVMPtr ptrVM(this);
+    if (!ptrVM.isOk())
+        return ptrVM.rc();
+
+    int vrc = VMR3SaveCowComplete(ptrVM.rawUVM());
+    if (RT_FAILURE(vrc))
+        return setError(VBOX_E_VM_ERROR, tr("Failed to complete saving the machine state (%Rrc)"), vrc);
+
+    LogFlowFuncLeave();
+    return S_OK;
+}
+
 #ifdef VBOX_WITH_AUDIO_VIDEOREC
 /**
  * Sends audio (frame) data to the display's video capturing routines.
@@ -9302,6 +9361,14 @@ HRESULT Console::i_attachToTapInterface(INetworkAdapter *networkAdapter)
             Utf8Str str(tapDeviceName);
             RTStrCopy(IfReq.ifr_name, sizeof(IfReq.ifr_name), str.c_str()); /** @todo bitch about names which are too long... */
             IfReq.ifr_flags = IFF_TAP | IFF_NO_PI;
+
+            /*
+             * Ask for the virtio-net header if the kernel has it, the driver uses
+             * it for offloads.
+             */
+            unsigned int fFeatures = 0;
+            if (ioctl(RTFileToNative(maTapFD[slot]), TUNGETFEATURES, &fFeatures) == 0)
+                IfReq.ifr_flags |= fFeatures & IFF_VNET_HDR;
             rcVBox = ioctl(RTFileToNative(maTapFD[slot]), TUNSETIFF, &IfReq);
             if (rcVBox != 0)
             {
@@ -4740,6 +4740,17 @@ int Console::i_configMedium(PCFGMNODE pLunL0,
                         InsertConfigInteger(pCfg, "MergeSource", 1);
                     else if (uImage == uMergeTarget)
                         InsertConfigInteger(pCfg, "MergeTarget", 1);
+
+                    /* Limits for the merge running in the background. */
+                    ComPtr<IMachine> pMachine = i_machine();
+                    hrc = pMachine->GetExtraData(Bstr("VBoxInternal2/MergeMaxBandwidth").raw(),
+                                                 bstr.asOutParam());                        H();
+                    if (!bstr.isEmpty())
+                        InsertConfigInteger(pCfg, "MergeMaxBandwidth", Utf8Str(bstr).toUInt64());
+                    hrc = pMachine->GetExtraData(Bstr("VBoxInternal2/MergeIdleInterval").raw(),
+                                                 bstr.asOutParam());                        H();
+                    if (!bstr.isEmpty())
+                        InsertConfigInteger(pCfg, "MergeIdleInterval", Utf8Str(bstr).toUInt32());
                 }
 
                 if (pcszBwGroup)
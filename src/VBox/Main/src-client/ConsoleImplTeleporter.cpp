@@ -31,12 +31,15 @@
 
 #include <iprt/asm.h>
 #include <iprt/err.h>
+#include <iprt/mem.h>
 #include <iprt/rand.h>
+#include <iprt/semaphore.h>
 #include <iprt/socket.h>
 #include <iprt/tcp.h>
 #include <iprt/timer.h>
 
 #include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/pgm.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/err.h>
 #include <VBox/version.h>
@@ -106,6 +109,9 @@ public:
     MachineState_T      menmOldMachineState;
     bool                mfSuspendedByUs;
     bool                mfUnlockedMedia;
+    /** Whether to hand over the VM before all memory has been transferred
+     * (VBoxInternal2/TeleporterPostCopy). */
+    bool                mfPostCopy;
 
     TeleporterStateSrc(Console *pConsole, PUVM pUVM, Progress *pProgress, MachineState_T enmOldMachineState)
         : TeleporterState(pConsole, pUVM, pProgress, true /*fIsSource*/)
@@ -114,6 +120,7 @@ public:
         , menmOldMachineState(enmOldMachineState)
         , mfSuspendedByUs(false)
         , mfUnlockedMedia(false)
+        , mfPostCopy(false)
     {
     }
 };
@@ -130,6 +137,14 @@ public:
     PRTTCPSERVER                mhServer;
     PRTTIMERLR                  mphTimerLR;
     bool                        mfLockedMedia;
+    /** Set when the source requested post-copy mode. */
+    bool                        mfPostCopy;
+    /** Serializes writes to the socket during the post-copy phase (demand
+     * requests from EMTs vs. the receive thread). */
+    RTSEMFASTMUTEX              mhPostCopyWriteMtx;
+    /** The number of page requests sent to the source, protected by
+     * mhPostCopyWriteMtx. */
+    uint32_t                    mcPostCopyRequests;
     int                         mRc;
     Utf8Str                     mErrorText;
 
@@ -142,6 +157,9 @@ public:
         , mhServer(NULL)
         , mphTimerLR(phTimerLR)
         , mfLockedMedia(false)
+        , mfPostCopy(false)
+        , mhPostCopyWriteMtx(NIL_RTSEMFASTMUTEX)
+        , mcPostCopyRequests(0)
         , mRc(VINF_SUCCESS)
         , mErrorText()
     {
@@ -171,6 +189,40 @@ typedef struct TELEPORTERTCPHDR
 #define TELEPORTERTCPHDR_MAX_SIZE    UINT32_C(0x00fffff8)
 
 
+/**
+ * Post-copy page message header.
+ *
+ * After a post-copy hand-over the source sends the missing pages using this
+ * header followed by the page content, while the target uses it for
+ * requesting pages it needs right away.
+ */
+typedef struct TELEPORTERPOSTCOPYHDR
+{
+    /** Magic value (TELEPORTERPOSTCOPYHDR_MAGIC). */
+    uint32_t    u32Magic;
+    /** TELEPORTERPOSTCOPYHDR_F_XXX. */
+    uint32_t    fFlags;
+    /** The guest physical address of the page. */
+    RTGCPHYS    GCPhys;
+} TELEPORTERPOSTCOPYHDR;
+AssertCompileSize(TELEPORTERPOSTCOPYHDR, 16);
+/** Magic value for TELEPORTERPOSTCOPYHDR::u32Magic. (Hermeto Pascoal) */
+#define TELEPORTERPOSTCOPYHDR_MAGIC         UINT32_C(0x19360622)
+/** Source: Page follows. */
+#define TELEPORTERPOSTCOPYHDR_F_PAGE        UINT32_C(0x00000001)
+/** Source: Page filled with zeros, nothing follows. */
+#define TELEPORTERPOSTCOPYHDR_F_ZERO        UINT32_C(0x00000002)
+/** Target: Request for the page.
+ * Source: Set together with TELEPORTERPOSTCOPYHDR_F_PAGE or
+ * TELEPORTERPOSTCOPYHDR_F_ZERO when answering a request. */
+#define TELEPORTERPOSTCOPYHDR_F_REQUEST     UINT32_C(0x00000004)
+/** Both: The end of the post-copy phase.  The source sends this after the
+ * last page and the target answers with it when it has got everything.  The
+ * source may still answer requests after sending it, the target consumes
+ * these answers after its own end message. */
+#define TELEPORTERPOSTCOPYHDR_F_END         UINT32_C(0x00000008)
+
+
 /*********************************************************************************************************************************
 *   Global Variables                                                                                                             *
 *********************************************************************************************************************************/
@@ -679,6 +731,25 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * Negotiate post-copy mode if configured.  The target NACKs it if it
+     * doesn't know the command, which is taken as a failure since the user
+     * asked for it.
+     */
+    Bstr bstrPostCopy;
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterPostCopy").raw(), bstrPostCopy.asOutParam());
+    if (SUCCEEDED(hrc) && bstrPostCopy == "1")
+    {
+        hrc = i_teleporterSrcSubmitCommand(pState, "post-copy");
+        if (FAILED(hrc))
+            return hrc;
+        vrc = PGMR3PostCopyEnable(pState->mpUVM, true /*fEnable*/);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("PGMR3PostCopyEnable -> %Rrc"), vrc);
+        pState->mfPostCopy = true;
+        LogRel(("Teleporter: Post-copy mode enabled\n"));
+    }
+
     /*
      * Start loading the state.
      *
@@ -741,14 +812,25 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
     /*
      * The FINAL step is giving the target instructions how to proceed with the VM.
      */
-    if (    vrc == VINF_SSM_LIVE_SUSPENDED
-        ||  pState->menmOldMachineState == MachineState_Paused)
-        hrc = i_teleporterSrcSubmitCommand(pState, "hand-over-paused");
+    bool const fPaused = vrc == VINF_SSM_LIVE_SUSPENDED
+                      || pState->menmOldMachineState == MachineState_Paused;
+    if (pState->mfPostCopy)
+        hrc = i_teleporterSrcSubmitCommand(pState, fPaused ? "hand-over-postcopy-paused" : "hand-over-postcopy-resume");
     else
-        hrc = i_teleporterSrcSubmitCommand(pState, "hand-over-resume");
+        hrc = i_teleporterSrcSubmitCommand(pState, fPaused ? "hand-over-paused" : "hand-over-resume");
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * In post-copy mode the target is now running on our memory.
+     */
+    if (pState->mfPostCopy)
+    {
+        hrc = i_teleporterSrcPostCopy(pState);
+        if (FAILED(hrc))
+            return hrc;
+    }
+
     /*
      * teleporterSrcThreadWrapper will do the automatic power off because it
      * has to release the AutoVMCaller.
@@ -757,6 +839,122 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
 }
 
 
+/**
+ * Sends a page to the target during the post-copy phase.
+ *
+ * @returns VBox status code.
+ * @param   pState              The teleporter source state.
+ * @param   GCPhys              The guest physical address of the page.
+ * @param   pvPage              Buffer of PAGE_SIZE bytes to use.
+ * @param   fFlags              Additional TELEPORTERPOSTCOPYHDR_F_XXX flags,
+ *                              TELEPORTERPOSTCOPYHDR_F_REQUEST or zero.
+ */
+static int teleporterSrcPostCopySendPage(TeleporterStateSrc *pState, RTGCPHYS GCPhys, void *pvPage, uint32_t fFlags)
+{
+    int vrc = PGMR3PostCopySrcReadPage(pState->mpUVM, GCPhys, pvPage);
+    if (RT_FAILURE(vrc))
+    {
+        LogRel(("Teleporter: PGMR3PostCopySrcReadPage(,%RGp,) -> %Rrc\n", GCPhys, vrc));
+        return vrc;
+    }
+
+    TELEPORTERPOSTCOPYHDR Hdr;
+    Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+    Hdr.GCPhys   = GCPhys;
+    if (ASMMemIsZeroPage(pvPage))
+    {
+        Hdr.fFlags = TELEPORTERPOSTCOPYHDR_F_ZERO | fFlags;
+        return RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+    }
+    Hdr.fFlags = TELEPORTERPOSTCOPYHDR_F_PAGE | fFlags;
+    return RTTcpSgWriteL(pState->mhSocket, 2, &Hdr, sizeof(Hdr), pvPage, (size_t)PAGE_SIZE);
+}
+
+
+/**
+ * Serves the post-copy phase on the source side.
+ *
+ * This pushes all the pages which were left out of the saved state to the
+ * target, giving priority to the pages the target is requesting because the
+ * guest is blocked on them.
+ *
+ * @returns S_OK when the target has all the pages, E_FAIL+setError() on failure.
+ * @param   pState              The teleporter source state.
+ *
+ * @remarks the setError laziness forces this to be a Console member.
+ */
+HRESULT Console::i_teleporterSrcPostCopy(TeleporterStateSrc *pState)
+{
+    void *pvPage = RTMemPageAlloc(PAGE_SIZE);
+    if (!pvPage)
+        return E_OUTOFMEMORY;
+
+    uint64_t const msStart   = RTTimeMilliTS();
+    uint32_t       cPushed   = 0;
+    uint32_t       cDemanded = 0;
+    bool           fPushDone = false;
+    int            vrc;
+    for (;;)
+    {
+        /*
+         * Demand requests first, then push the next page.  Once all pages
+         * are pushed we just wait for requests that were in flight and the
+         * end-of-transfer acknowledgement.
+         */
+        vrc = RTTcpSelectOne(pState->mhSocket, fPushDone ? 60 * RT_MS_1SEC : 0);
+        if (RT_SUCCESS(vrc))
+        {
+            TELEPORTERPOSTCOPYHDR Hdr;
+            vrc = RTTcpRead(pState->mhSocket, &Hdr, sizeof(Hdr), NULL);
+            if (RT_FAILURE(vrc))
+                break;
+            if (Hdr.u32Magic != TELEPORTERPOSTCOPYHDR_MAGIC)
+            {
+                vrc = VERR_INVALID_MAGIC;
+                break;
+            }
+            if (Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_END)
+            {
+                if (!fPushDone)
+                    vrc = VERR_WRONG_ORDER;
+                break;
+            }
+            cDemanded++;
+            vrc = teleporterSrcPostCopySendPage(pState, Hdr.GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK, pvPage,
+                                                TELEPORTERPOSTCOPYHDR_F_REQUEST);
+        }
+        else if (vrc == VERR_TIMEOUT && !fPushDone)
+        {
+            RTGCPHYS GCPhys;
+            vrc = PGMR3PostCopySrcNextPage(pState->mpUVM, &GCPhys);
+            if (vrc == VINF_SUCCESS)
+            {
+                cPushed++;
+                vrc = teleporterSrcPostCopySendPage(pState, GCPhys, pvPage, 0 /*fFlags*/);
+            }
+            else if (vrc == VINF_EOF)
+            {
+                TELEPORTERPOSTCOPYHDR Hdr;
+                Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+                Hdr.fFlags   = TELEPORTERPOSTCOPYHDR_F_END;
+                Hdr.GCPhys   = NIL_RTGCPHYS;
+                vrc = RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+                fPushDone = true;
+            }
+        }
+        if (RT_FAILURE(vrc))
+            break;
+    }
+    RTMemPageFree(pvPage, PAGE_SIZE);
+
+    LogRel(("Teleporter: Post-copy phase %s after %RU64 ms: %u pages pushed, %u requested (%Rrc)\n",
+            RT_SUCCESS(vrc) ? "completed" : "failed", RTTimeMilliTS() - msStart, cPushed, cDemanded, vrc));
+    if (RT_FAILURE(vrc))
+        return setError(E_FAIL, tr("Post-copy memory transfer failed: %Rrc"), vrc);
+    return S_OK;
+}
+
+
 /**
  * Static thread method wrapper.
  *
@@ -778,8 +976,14 @@ Console::i_teleporterSrcThreadWrapper(RTTHREAD hThreadSelf, void *pvUser)
     HRESULT hrc = ptrVM.rc();
 
     if (SUCCEEDED(hrc))
+    {
         hrc = pState->mptrConsole->i_teleporterSrc(pState);
 
+        /* Drop the post-copy state whether we got that far or not. */
+        if (pState->mfPostCopy)
+            PGMR3PostCopyEnd(pState->mpUVM);
+    }
+
     /* Close the connection ASAP on so that the other side can complete. */
     if (pState->mhSocket != NIL_RTSOCKET)
     {
@@ -1253,6 +1457,120 @@ static int teleporterTcpWriteNACK(TeleporterStateTrg *pState, int32_t rc2, const
 }
 
 
+/**
+ * @callback_method_impl{FNPGMPOSTCOPYFETCH,
+ *      Requests a page the guest is blocked on from the source.}
+ */
+static DECLCALLBACK(int) teleporterTrgPostCopyFetch(PUVM pUVM, RTGCPHYS GCPhys, void *pvUser)
+{
+    RT_NOREF(pUVM);
+    TeleporterStateTrg *pState = (TeleporterStateTrg *)pvUser;
+
+    TELEPORTERPOSTCOPYHDR Hdr;
+    Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+    Hdr.fFlags   = TELEPORTERPOSTCOPYHDR_F_REQUEST;
+    Hdr.GCPhys   = GCPhys;
+    RTSemFastMutexRequest(pState->mhPostCopyWriteMtx);
+    int vrc = RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+    if (RT_SUCCESS(vrc))
+        pState->mcPostCopyRequests++;
+    RTSemFastMutexRelease(pState->mhPostCopyWriteMtx);
+    if (RT_FAILURE(vrc))
+        LogRel(("Teleporter: Failed to request page %RGp: %Rrc\n", GCPhys, vrc));
+    return vrc;
+}
+
+
+/**
+ * Receives the pages missing after a post-copy hand-over.
+ *
+ * @returns VBox status code.
+ * @param   pState      The teleporter target state.
+ */
+static int teleporterTrgPostCopyReceive(TeleporterStateTrg *pState)
+{
+    void *pvPage = RTMemPageAlloc(PAGE_SIZE);
+    if (!pvPage)
+        return VERR_NO_PAGE_MEMORY;
+
+    uint64_t const msStart   = RTTimeMilliTS();
+    uint32_t       cPages    = 0;
+    uint32_t       cAnswers  = 0;
+    uint32_t       cRequests = UINT32_MAX;
+    bool           fEnd      = false;
+    int            vrc;
+    for (;;)
+    {
+        /*
+         * After the end message from the source we keep reading until the
+         * answers to all our requests are in, the source answers requests
+         * which were in flight when it sent the end message.
+         */
+        if (fEnd && cAnswers >= cRequests)
+        {
+            vrc = VINF_SUCCESS;
+            break;
+        }
+
+        TELEPORTERPOSTCOPYHDR Hdr;
+        vrc = RTTcpRead(pState->mhSocket, &Hdr, sizeof(Hdr), NULL);
+        if (RT_FAILURE(vrc))
+            break;
+        if (   Hdr.u32Magic != TELEPORTERPOSTCOPYHDR_MAGIC
+            || !(Hdr.fFlags & (TELEPORTERPOSTCOPYHDR_F_PAGE | TELEPORTERPOSTCOPYHDR_F_ZERO | TELEPORTERPOSTCOPYHDR_F_END))
+            || ((Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_END) && fEnd))
+        {
+            LogRel(("Teleporter: Invalid post-copy header: %.*Rhxs\n", sizeof(Hdr), &Hdr));
+            vrc = VERR_INVALID_MAGIC;
+            break;
+        }
+        if (Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_END)
+        {
+            /*
+             * Check that we've got everything and tell the source it can go
+             * away.  No requests are made once all pages are present, so the
+             * request count is final when the end message has been written.
+             */
+            fEnd = true;
+            vrc = PGMR3PostCopyEnd(pState->mpUVM);
+            if (RT_FAILURE(vrc))
+                break;
+            Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+            Hdr.fFlags   = TELEPORTERPOSTCOPYHDR_F_END;
+            Hdr.GCPhys   = NIL_RTGCPHYS;
+            RTSemFastMutexRequest(pState->mhPostCopyWriteMtx);
+            vrc = RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+            cRequests = pState->mcPostCopyRequests;
+            RTSemFastMutexRelease(pState->mhPostCopyWriteMtx);
+            if (RT_FAILURE(vrc))
+                break;
+            continue;
+        }
+
+        if (Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_PAGE)
+        {
+            vrc = RTTcpRead(pState->mhSocket, pvPage, PAGE_SIZE, NULL);
+            if (RT_FAILURE(vrc))
+                break;
+        }
+        if (Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_REQUEST)
+            cAnswers++;
+        if (fEnd)
+            continue; /* late answer to a request, the page is already present */
+        vrc = PGMR3PostCopyTrgPutPage(pState->mpUVM, Hdr.GCPhys,
+                                      Hdr.fFlags & TELEPORTERPOSTCOPYHDR_F_PAGE ? pvPage : NULL, NULL);
+        if (RT_FAILURE(vrc))
+            break;
+        cPages++;
+    }
+    RTMemPageFree(pvPage, PAGE_SIZE);
+
+    LogRel(("Teleporter: Post-copy phase %s after %RU64 ms, %u pages received (%Rrc)\n",
+            RT_SUCCESS(vrc) ? "completed" : "failed", RTTimeMilliTS() - msStart, cPages, vrc));
+    return vrc;
+}
+
+
 /**
  * @copydoc FNRTTCPSERVE
  *
@@ -1380,6 +1698,20 @@ Console::i_teleporterTrgServeConnection(RTSOCKET hSocket, void *pvUser)
 
             vrc = teleporterTcpWriteACK(pState);
         }
+        else if (!strcmp(szCmd, "post-copy"))
+        {
+            /* Must come before "load" so the loader accepts the post-copy records. */
+            vrc = RTSemFastMutexCreate(&pState->mhPostCopyWriteMtx);
+            if (RT_SUCCESS(vrc))
+                vrc = PGMR3PostCopyEnable(pState->mpUVM, true /*fEnable*/);
+            if (RT_SUCCESS(vrc))
+            {
+                pState->mfPostCopy = true;
+                vrc = teleporterTcpWriteACK(pState);
+            }
+            else
+                teleporterTcpWriteNACK(pState, vrc);
+        }
         else if (!strcmp(szCmd, "cancel"))
         {
             /* Don't ACK this. */
@@ -1400,6 +1732,58 @@ Console::i_teleporterTrgServeConnection(RTSOCKET hSocket, void *pvUser)
                 teleporterTcpWriteNACK(pState, vrc);
             }
         }
+        else if (   (   !strcmp(szCmd, "hand-over-resume")
+                     || !strcmp(szCmd, "hand-over-paused"))
+                 && pState->mfPostCopy)
+        {
+            /* The memory isn't all there. */
+            vrc = VERR_WRONG_ORDER;
+            teleporterTcpWriteNACK(pState, vrc);
+        }
+        else if (   !strcmp(szCmd, "hand-over-postcopy-resume")
+                 || !strcmp(szCmd, "hand-over-postcopy-paused"))
+        {
+            /*
+             * Point of no return, post-copy edition.
+             *
+             * Cover the missing pages before ACKing and starting the VM, then
+             * receive them while the guest is running.  Failures after the ACK
+             * leave the target without parts of its memory, so the VM will be
+             * powered off by our caller.
+             */
+            if (   pState->mfPostCopy
+                && pState->mptrProgress->i_notifyPointOfNoReturn()
+                && pState->mfLockedMedia)
+            {
+                uint32_t cPages = 0;
+                vrc = PGMR3PostCopyTrgBegin(pState->mpUVM, teleporterTrgPostCopyFetch, pState, &cPages);
+                if (RT_SUCCESS(vrc))
+                {
+                    LogRel(("Teleporter: Post-copy hand-over with %u pages still missing\n", cPages));
+                    vrc = teleporterTcpWriteACK(pState);
+                    if (RT_SUCCESS(vrc))
+                    {
+                        RTSocketRetain(pState->mhSocket); /* For concurrent access by EMTs requesting pages. */
+                        if (!strcmp(szCmd, "hand-over-postcopy-resume"))
+                            vrc = VMR3Resume(pState->mpUVM, VMRESUMEREASON_TELEPORTED);
+                        else
+                            pState->mptrConsole->i_setMachineState(MachineState_Paused);
+                        if (RT_SUCCESS(vrc))
+                            vrc = teleporterTrgPostCopyReceive(pState);
+                        RTSocketRelease(pState->mhSocket);
+                        fDone = true;
+                        break;
+                    }
+                }
+                else
+                    teleporterTcpWriteNACK(pState, vrc);
+            }
+            else
+            {
+                vrc = !pState->mfPostCopy || pState->mfLockedMedia ? VERR_WRONG_ORDER : VERR_SSM_CANCELLED;
+                teleporterTcpWriteNACK(pState, vrc);
+            }
+        }
         else if (   !strcmp(szCmd, "hand-over-resume")
                  || !strcmp(szCmd, "hand-over-paused"))
         {
@@ -1450,6 +1834,12 @@ Console::i_teleporterTrgServeConnection(RTSOCKET hSocket, void *pvUser)
     if (RT_FAILURE(vrc))
         teleporterTrgUnlockMedia(pState);
 
+    /* Leaves the post-copy access handlers in place if pages are missing. */
+    if (pState->mfPostCopy && RT_FAILURE(vrc))
+        PGMR3PostCopyEnd(pState->mpUVM);
+    RTSemFastMutexDestroy(pState->mhPostCopyWriteMtx);
+    pState->mhPostCopyWriteMtx = NIL_RTSEMFASTMUTEX;
+
     pState->mRc = vrc;
     pState->mhSocket = NIL_RTSOCKET;
     LogFlowFunc(("returns mRc=%Rrc\n", vrc));
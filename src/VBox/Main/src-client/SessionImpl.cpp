@@ -1105,6 +1105,21 @@ HRESULT Session::cancelSaveStateWithReason()
 #endif
 }
 
+HRESULT Session::completeSaveStateWithReason()
+{
+    AutoReadLock alock(this COMMA_LOCKVAL_SRC_POS);
+    AssertReturn(mState == SessionState_Locked, VBOX_E_INVALID_VM_STATE);
+    AssertReturn(mType == SessionType_WriteLock, VBOX_E_INVALID_OBJECT_STATE);
+#ifndef VBOX_COM_INPROC_API_CLIENT
+    AssertReturn(mConsole, VBOX_E_INVALID_OBJECT_STATE);
+
+    return mConsole->i_completeSaveState();
+#else
+    AssertFailed();
+    return E_NOTIMPL;
+#endif
+}
+
 // private methods
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -707,7 +707,7 @@ HRESULT MachineCloneVMPrivate::createDifferencingMedium(const ComObjPtr<Machine>
         ComObjPtr<Medium> diff;
         diff.createObject();
         rc = diff->init(p->i_getVirtualBox(),
-                        pParent->i_getPreferredDiffFormat(),
+                        pParent->i_getPreferredDiffFormat(true /* fLinkedClone */),
                         Utf8StrFmt("%s%c", strSnapshotFolder.c_str(), RTPATH_DELIMITER),
                                    Guid::Empty /* empty media registry */,
                                    DeviceType_HardDisk);
@@ -1253,7 +1253,8 @@ HRESULT MachineCloneVM::run()
                                                    pNewParent,
                                                    progress2.asOutParam(),
                                                    uSrcParentIdx,
-                                                   uTrgParentIdx);
+                                                   uTrgParentIdx,
+                                                   4 /* cReadAhead */);
                         srcLock.acquire();
                         if (FAILED(rc)) throw rc;
 
@@ -405,6 +405,7 @@ public:
               Medium *aParent,
               uint32_t idxSrcImageSame,
               uint32_t idxDstImageSame,
+              uint32_t cReadAhead,
               MediumLockList *aSourceMediumLockList,
               MediumLockList *aTargetMediumLockList,
               bool fKeepSourceMediumLockList = false,
@@ -417,6 +418,7 @@ public:
           mVariant(aVariant),
           midxSrcImageSame(idxSrcImageSame),
           midxDstImageSame(idxDstImageSame),
+          mVDIfsCopy(NULL),
           mTargetCaller(aTarget),
           mParentCaller(aParent),
           mfKeepSourceMediumLockList(fKeepSourceMediumLockList),
@@ -433,6 +435,21 @@ public:
         AssertReturnVoidStmt(aSourceMediumLockList != NULL, mRC = E_FAIL);
         AssertReturnVoidStmt(aTargetMediumLockList != NULL, mRC = E_FAIL);
         m_strTaskName = "createClone";
+
+        /* Set up a per-operation copy interface if reading ahead is wanted. */
+        if (cReadAhead > 1)
+        {
+            mVDIfCopy.cReadAhead = cReadAhead;
+            int vrc = VDInterfaceAdd(&mVDIfCopy.Core,
+                                     "Medium::CloneTask::vdInterfaceCopy",
+                                     VDINTERFACETYPE_COPY,
+                                     NULL,
+                                     sizeof(mVDIfCopy),
+                                     &mVDIfsCopy);
+            AssertRC(vrc);
+            if (RT_FAILURE(vrc))
+                mRC = E_FAIL;
+        }
     }
 
     ~CloneTask()
@@ -450,9 +467,11 @@ public:
     MediumVariant_T mVariant;
     uint32_t midxSrcImageSame;
     uint32_t midxDstImageSame;
+    PVDINTERFACE mVDIfsCopy;
 
 private:
     HRESULT executeTask();
+    VDINTERFACECOPY mVDIfCopy;
     AutoCaller mTargetCaller;
     AutoCaller mParentCaller;
     bool mfKeepSourceMediumLockList;
@@ -2900,7 +2919,7 @@ HRESULT Medium::cloneTo(const ComPtr<IMedium> &aTarget,
         /* setup task object to carry out the operation asynchronously */
         pTask = new Medium::CloneTask(this, pProgress, pTarget,
                                       (MediumVariant_T)mediumVariantFlags,
-                                      pParent, UINT32_MAX, UINT32_MAX,
+                                      pParent, UINT32_MAX, UINT32_MAX, 0 /* cReadAhead */,
                                       pSourceMediumLockList, pTargetMediumLockList);
         rc = pTask->rc();
         AssertComRC(rc);
@@ -4845,12 +4864,22 @@ HRESULT Medium::i_createDiffStorage(ComObjPtr<Medium> &aTarget,
 
 /**
  * Returns a preferred format for differencing media.
+ *
+ * @param   fLinkedClone    Whether the differencing medium is created for a linked
+ *                          clone. Only those use the deduplicating format and only
+ *                          when a chunk store is configured, snapshots keep the
+ *                          format of their parent.
  */
-Utf8Str Medium::i_getPreferredDiffFormat()
+Utf8Str Medium::i_getPreferredDiffFormat(bool fLinkedClone /* = false */)
 {
     AutoCaller autoCaller(this);
     AssertComRCReturn(autoCaller.rc(), Utf8Str::Empty);
 
+    if (   fLinkedClone
+        && i_getDedupStore().isNotEmpty()
+        && !m->pVirtualBox->i_getSystemProperties()->i_mediumFormat("VDD").isNull())
+        return Utf8Str("VDD");
+
     /* check that our own format supports diffs */
     if (!(m->formatObj->i_getCapabilities() & MediumFormatCapabilities_Differencing))
     {
@@ -4864,6 +4893,21 @@ Utf8Str Medium::i_getPreferredDiffFormat()
     return m->strFormat;
 }
 
+/**
+ * Returns the directory of the host wide chunk store for deduplicated
+ * differencing media, empty if deduplication is not configured.
+ */
+Utf8Str Medium::i_getDedupStore()
+{
+    Bstr bstrStore;
+    HRESULT rc = m->pVirtualBox->GetExtraData(Bstr("VBoxInternal2/DedupStore").raw(),
+                                              bstrStore.asOutParam());
+    if (FAILED(rc))
+        return Utf8Str::Empty;
+
+    return Utf8Str(bstrStore);
+}
+
 /**
  * Returns a preferred variant for differencing media.
  */
@@ -6305,11 +6349,14 @@ HRESULT Medium::i_importFile(const char *aFilename,
  * @param idxDstImageSame    The last image in the destination chain which has the
  *                           same content as the given image in the source chain.
  *                           Use UINT32_MAX to disable this optimization.
+ * @param cReadAhead         Number of chunks to read ahead from the source while
+ *                           the target is written, 0 for the sequential copy.
  * @return
  */
 HRESULT Medium::i_cloneToEx(const ComObjPtr<Medium> &aTarget, ULONG aVariant,
                             const ComObjPtr<Medium> &aParent, IProgress **aProgress,
-                            uint32_t idxSrcImageSame, uint32_t idxDstImageSame)
+                            uint32_t idxSrcImageSame, uint32_t idxDstImageSame,
+                            uint32_t cReadAhead)
 {
     /** @todo r=klaus The code below needs to be double checked with regard
      * to lock order violations, it probably causes lock order issues related
@@ -6414,8 +6461,8 @@ HRESULT Medium::i_cloneToEx(const ComObjPtr<Medium> &aTarget, ULONG aVariant,
         pTask = new Medium::CloneTask(this, pProgress, aTarget,
                                       (MediumVariant_T)aVariant,
                                       aParent, idxSrcImageSame,
-                                      idxDstImageSame, pSourceMediumLockList,
-                                      pTargetMediumLockList);
+                                      idxDstImageSame, cReadAhead,
+                                      pSourceMediumLockList, pTargetMediumLockList);
         rc = pTask->rc();
         AssertComRC(rc);
         if (FAILED(rc))
@@ -8247,6 +8294,16 @@ HRESULT Medium::i_taskCreateDiffHandler(Medium::CreateDiffTask &task)
         Guid id = m->id;
 
         Utf8Str targetFormat(pTarget->m->strFormat);
+
+        /* Point a deduplicated target to the configured store unless the caller chose one. */
+        if (targetFormat == "VDD")
+        {
+            settings::StringsMap::iterator itStore = pTarget->m->mapProperties.find("DedupStore");
+            if (   itStore != pTarget->m->mapProperties.end()
+                && itStore->second.isEmpty())
+                itStore->second = i_getDedupStore();
+        }
+
         Utf8Str targetLocation(pTarget->m->strLocationFull);
         uint64_t capabilities = pTarget->m->formatObj->i_getCapabilities();
         ComAssertThrow(capabilities & MediumFormatCapabilities_CreateDynamic, E_FAIL);
@@ -8534,6 +8591,11 @@ HRESULT Medium::i_taskMergeHandler(Medium::MergeTask &task)
             if (RT_FAILURE(vrc))
                 throw vrc;
 
+            /* An online merge interrupted by powering off the VM leaves a
+             * checkpoint next to the target (see DrvVD), it is stale now. */
+            Utf8Str strCheckpoint = Utf8StrFmt("%s.merge", pTarget->m->strLocationFull.c_str());
+            RTFileDelete(strCheckpoint.c_str());
+
             /* update parent UUIDs */
             if (!task.mfMergeForward)
             {
@@ -8909,7 +8971,7 @@ HRESULT Medium::i_taskCloneHandler(Medium::CloneTask &task)
                                  task.mVariant & ~MediumVariant_NoCreateDir,
                                  targetId.raw(),
                                  VD_OPEN_FLAGS_NORMAL | m->uOpenFlagsDef,
-                                 NULL /* pVDIfsOperation */,
+                                 task.mVDIfsCopy,
                                  pTarget->m->vdImageIfaces,
                                  task.mVDOperationIfaces);
                 }
@@ -8927,7 +8989,7 @@ HRESULT Medium::i_taskCloneHandler(Medium::CloneTask &task)
                                    task.mVariant & ~MediumVariant_NoCreateDir,
                                    targetId.raw(),
                                    VD_OPEN_FLAGS_NORMAL | m->uOpenFlagsDef,
-                                   NULL /* pVDIfsOperation */,
+                                   task.mVDIfsCopy,
                                    pTarget->m->vdImageIfaces,
                                    task.mVDOperationIfaces);
                 }
@@ -1765,6 +1765,35 @@ void SessionMachine::i_takeSnapshotHandler(TakeSnapshotTask &task)
             alock.acquire();
             if (FAILED(rc))
                 throw rc;
+
+            // STEP 5: let the VM continue and have the VM process save the
+            // memory in the background if it was told to do so
+            Bstr value;
+            rc = GetExtraData(Bstr("VBoxInternal2/SnapshotSaveStateInBackground").raw(),
+                              value.asOutParam());
+            if (   SUCCEEDED(rc)
+                && value == "1"
+                && task.m_strStateFilePath.isNotEmpty())
+            {
+                alock.release();
+                if (fSuspendedBySave)
+                {
+                    HRESULT rc2 = task.m_pDirectControl->ResumeWithReason(Reason_Snapshot);
+                    if (SUCCEEDED(rc2))
+                        fSuspendedBySave = FALSE;
+                }
+                rc = task.m_pDirectControl->CompleteSaveStateWithReason();
+                alock.acquire();
+                if (FAILED(rc))
+                {
+                    // The disks have been switched already and the VM may be
+                    // running, so keep the snapshot, just without the state.
+                    LogRel(("Machine: failed to save the state of snapshot '%s' in the background (%Rhrc), taking it without state\n",
+                            task.m_strName.c_str(), rc));
+                    task.m_pSnapshot->i_getSnapshotMachine()->mSSData->strStateFilePath.setNull();
+                }
+            }
+            rc = S_OK;
         }
 
         /*
@@ -47,6 +47,7 @@
 #include <iprt/getopt.h>
 #include <iprt/string.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/message.h>
 #include <iprt/req.h>
 #include <iprt/file.h>
@@ -657,6 +658,7 @@ VBoxNetLwipNAT::VBoxNetLwipNAT(SOCKET icmpsock4, SOCKET icmpsock6) : VBoxNetBase
     m_src6.sin6_len = sizeof(m_src6);
 #endif
     m_ProxyOptions.nameservers = NULL;
+    m_ProxyOptions.pollmgr_threads = 1;
 
     m_LwipNetIf.name[0] = 'N';
     m_LwipNetIf.name[1] = 'T';
@@ -902,6 +904,27 @@ int VBoxNetLwipNAT::init()
         bstrSourceIpX.setNull();
     }
 
+    /*
+     * Number of poll manager threads proxied connections are spread
+     * over.  Defaults to the number of online CPUs, the proxy caps it.
+     */
+    m_ProxyOptions.pollmgr_threads = (int)RTMpGetOnlineCount();
+
+    com::Bstr bstrPollThreads;
+    com::Bstr bstrPollThreadsKey = com::BstrFmt("NAT/%s/PollThreads", networkName.c_str());
+    hrc = virtualbox->GetExtraData(bstrPollThreadsKey.raw(), bstrPollThreads.asOutParam());
+    if (SUCCEEDED(hrc) && bstrPollThreads.isNotEmpty())
+    {
+        uint32_t cThreads;
+        rc = RTStrToUInt32Full(com::Utf8Str(bstrPollThreads).c_str(), 10, &cThreads);
+        if (rc == VINF_SUCCESS && cThreads > 0)
+            m_ProxyOptions.pollmgr_threads = (int)cThreads;
+        else
+            LogRel(("Failed to parse \"%s\" poll thread count\n",
+                    com::Utf8Str(bstrPollThreads).c_str()));
+    }
+    LogRel(("Using up to %d poll manager threads\n", m_ProxyOptions.pollmgr_threads));
+
 
     if (!fDontLoadRulesOnStartup)
     {
@@ -40,6 +40,7 @@
 
 #include "lwip/sys.h"
 #include "lwip/tcpip.h"
+#include "lwip/ip.h"
 
 
 /**
@@ -218,6 +219,7 @@ fwtcp_pmgr_listen(struct pollmgr_handler *handler, SOCKET fd, int revents)
     socklen_t sslen;
     struct pxtcp *pxtcp;
     SOCKET newsock;
+    int pmidx;
     int status;
     err_t error;
 
@@ -241,18 +243,24 @@ fwtcp_pmgr_listen(struct pollmgr_handler *handler, SOCKET fd, int revents)
 
     if (ss.ss_family == PF_INET) {
         struct sockaddr_in *peer4 = (struct sockaddr_in *)&ss;
-        RT_NOREF(peer4);
         DPRINTF(("<--- TCP %RTnaipv4:%d\n",
                  peer4->sin_addr.s_addr, ntohs(peer4->sin_port)));
+        pmidx = pollmgr_flow_index(IP_PROTO_TCP,
+                                   &peer4->sin_addr, NULL,
+                                   sizeof(peer4->sin_addr),
+                                   ntohs(peer4->sin_port), 0);
     }
     else { /* PF_INET6 */
         struct sockaddr_in6 *peer6 = (struct sockaddr_in6 *)&ss;
-        RT_NOREF(peer6);
         DPRINTF(("<--- TCP %RTnaipv6:%d\n",
                  &peer6->sin6_addr, ntohs(peer6->sin6_port)));
+        pmidx = pollmgr_flow_index(IP_PROTO_TCP,
+                                   &peer6->sin6_addr, NULL,
+                                   sizeof(peer6->sin6_addr),
+                                   ntohs(peer6->sin6_port), 0);
     }
 
-    pxtcp = pxtcp_create_forwarded(newsock);
+    pxtcp = pxtcp_create_forwarded(newsock, pmidx);
     if (pxtcp == NULL) {
         proxy_reset_socket(newsock);
         return POLLIN;
@@ -28,6 +28,8 @@
 #include "lwip/sys.h"
 #include "lwip/tcpip.h"
 
+#include <iprt/thread.h>
+
 #ifndef RT_OS_WINDOWS
 #include <sys/poll.h>
 #include <sys/socket.h>
@@ -53,6 +55,7 @@
 static FNRTSTRFORMATTYPE proxy_sockerr_rtstrfmt;
 
 static SOCKET proxy_create_socket(int, int);
+static DECLCALLBACK(int) proxy_pollmgr_worker(RTTHREAD, void *);
 
 volatile struct proxy_options *g_proxy_options;
 static sys_thread_t pollmgr_tid;
@@ -70,6 +73,7 @@ void
 proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
 {
     int status;
+    int i;
 
     LWIP_ASSERT1(opts != NULL);
     LWIP_UNUSED_ARG(proxy_netif);
@@ -97,7 +101,7 @@ proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
         tftpd_init(proxy_netif, opts->tftp_root);
     }
 
-    status = pollmgr_init();
+    status = pollmgr_init(opts->pollmgr_threads);
     if (status < 0) {
         errx(EXIT_FAILURE, "failed to initialize poll manager");
         /* NOTREACHED */
@@ -120,6 +124,32 @@ proxy_init(struct netif *proxy_netif, struct proxy_options *opts)
         errx(EXIT_FAILURE, "failed to create poll manager thread");
         /* NOTREACHED */
     }
+
+    /*
+     * Additional poll manager threads for proxied flows.  They don't
+     * use lwIP timeouts, so they are plain IPRT threads and don't
+     * count against sys_arch thread limit.
+     */
+    for (i = 1; i < pollmgr_count(); ++i) {
+        RTTHREAD tid;
+
+        status = RTThreadCreateF(&tid, proxy_pollmgr_worker,
+                                 (void *)(intptr_t)i, 0,
+                                 RTTHREADTYPE_IO, 0, "pollmgr%d", i);
+        if (RT_FAILURE(status)) {
+            errx(EXIT_FAILURE, "failed to create poll manager thread %d", i);
+            /* NOTREACHED */
+        }
+    }
+}
+
+
+static DECLCALLBACK(int)
+proxy_pollmgr_worker(RTTHREAD hThreadSelf, void *pvUser)
+{
+    RT_NOREF(hThreadSelf);
+    pollmgr_thread(pvUser);
+    return VINF_SUCCESS;
 }
 
 
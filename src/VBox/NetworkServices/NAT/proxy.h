@@ -56,6 +56,7 @@ struct proxy_options {
     const struct sockaddr_in6 *src6;
     const struct ip4_lomap_desc *lomap_desc;
     const char **nameservers;
+    int pollmgr_threads;
 };
 
 extern volatile struct proxy_options *g_proxy_options;
@@ -43,6 +43,7 @@
 
 #include <iprt/req.h>
 #include <iprt/err.h>
+#include <iprt/thread.h>
 
 
 #define POLLMGR_GARBAGE (-1)
@@ -78,15 +79,38 @@ struct pollmgr {
     RTREQQUEUE queue;
     struct pollmgr_handler queue_handler;
     struct pollmgr_chan chan_handlers[POLLMGR_CHAN_COUNT];
-} pollmgr;
 
+    /* see pollmgr_udpbuf below */
+    u8_t *udpbuf;
+};
+
+
+/*
+ * Poll manager threads.  Thread 0 services channels and sockets that
+ * are not tied to a particular flow (port-forwarding listeners, dns,
+ * ping).  Proxied tcp and udp flows are spread over all threads by
+ * their address/port tuple (see pollmgr_flow_index()), so that one
+ * busy flow doesn't stall the rest.
+ */
+static struct pollmgr pollmgr_threads[POLLMGR_MAX_THREADS];
+static int pollmgr_nthreads;
+
+/* the poll manager instance of the current thread */
+static RTTLS pollmgr_tls = NIL_RTTLS;
+
+
+static int pollmgr_init_one(struct pollmgr *, u8_t *);
+static struct pollmgr *pollmgr_current(void);
+static int pollmgr_notify(struct pollmgr *);
 
 static int pollmgr_queue_callback(struct pollmgr_handler *, SOCKET, int);
-static void pollmgr_chan_call_handler(int, void *);
+static void pollmgr_chan_call_handler(struct pollmgr *, int, void *);
 
-static void pollmgr_loop(void);
+static void pollmgr_loop(struct pollmgr *);
 
-static void pollmgr_add_at(int, struct pollmgr_handler *, SOCKET, int);
+static int pollmgr_add_pm(struct pollmgr *, struct pollmgr_handler *, SOCKET, int);
+static void pollmgr_add_req(struct pollmgr *, struct pollmgr_handler *, SOCKET, int, int *);
+static void pollmgr_add_at(struct pollmgr *, int, struct pollmgr_handler *, SOCKET, int);
 static void pollmgr_refptr_delete(struct pollmgr_refptr *);
 
 
@@ -99,13 +123,77 @@ static void pollmgr_refptr_delete(struct pollmgr_refptr *);
  * fragmentation.
  *
  * We can use shared buffer here since we read from sockets
- * sequentially in a loop over pollfd.
+ * sequentially in a loop over pollfd.  This one belongs to thread 0,
+ * other threads allocate their own, see pollmgr_get_udpbuf().
  */
-u8_t pollmgr_udpbuf[64 * 1024];
+u8_t pollmgr_udpbuf[POLLMGR_UDPBUF_SIZE];
 
 
+/*
+ * Create "nthreads" poll manager instances.  The caller is expected
+ * to start pollmgr_thread() for each of them, passing the index as
+ * the argument.
+ */
 int
-pollmgr_init(void)
+pollmgr_init(int nthreads)
+{
+    int rc;
+    int i;
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    else if (nthreads > POLLMGR_MAX_THREADS) {
+        nthreads = POLLMGR_MAX_THREADS;
+    }
+
+    if (nthreads > 1) {
+        rc = RTTlsAllocEx(&pollmgr_tls, NULL);
+        if (RT_FAILURE(rc)) {
+            DPRINTF0(("%s: RTTlsAllocEx: %Rrc\n", __func__, rc));
+            nthreads = 1;
+        }
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+        u8_t *udpbuf;
+
+        if (i == 0) {
+            udpbuf = pollmgr_udpbuf;
+        }
+        else {
+            udpbuf = (u8_t *)malloc(POLLMGR_UDPBUF_SIZE);
+            if (udpbuf == NULL) {
+                DPRINTF0(("%s: Failed to allocate udp buffer\n", __func__));
+                break;
+            }
+        }
+
+        if (pollmgr_init_one(&pollmgr_threads[i], udpbuf) < 0) {
+            if (i != 0) {
+                free(udpbuf);
+            }
+            break;
+        }
+    }
+
+    if (i == 0) {
+        return -1;
+    }
+
+    /* make do with what we've got */
+    pollmgr_nthreads = i;
+    if (i < nthreads) {
+        DPRINTF0(("%s: using %d poll manager threads instead of %d\n",
+                  __func__, i, nthreads));
+    }
+
+    return 0;
+}
+
+
+static int
+pollmgr_init_one(struct pollmgr *pm, u8_t *udpbuf)
 {
     struct pollfd *newfds;
     struct pollmgr_handler **newhdls;
@@ -113,25 +201,26 @@ pollmgr_init(void)
     int rc, status;
     nfds_t i;
 
-    rc = RTReqQueueCreate(&pollmgr.queue);
+    rc = RTReqQueueCreate(&pm->queue);
     if (RT_FAILURE(rc))
         return -1;
 
-    pollmgr.fds = NULL;
-    pollmgr.handlers = NULL;
-    pollmgr.capacity = 0;
-    pollmgr.nfds = 0;
+    pm->fds = NULL;
+    pm->handlers = NULL;
+    pm->capacity = 0;
+    pm->nfds = 0;
+    pm->udpbuf = udpbuf;
 
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        pollmgr.chan[i][POLLMGR_CHFD_RD] = INVALID_SOCKET;
-        pollmgr.chan[i][POLLMGR_CHFD_WR] = INVALID_SOCKET;
+        pm->chan[i][POLLMGR_CHFD_RD] = INVALID_SOCKET;
+        pm->chan[i][POLLMGR_CHFD_WR] = INVALID_SOCKET;
     }
 
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
 #ifndef RT_OS_WINDOWS
         int j;
 
-        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pm->chan[i]);
         if (status < 0) {
             DPRINTF(("socketpair: %R[sockerr]\n", SOCKERRNO()));
             goto cleanup_close;
@@ -139,7 +228,7 @@ pollmgr_init(void)
 
         /* now manually make them O_NONBLOCK */
         for (j = 0; j < 2; ++j) {
-            int s = pollmgr.chan[i][j];
+            int s = pm->chan[i][j];
             int sflags;
 
             sflags = fcntl(s, F_GETFL, 0);
@@ -155,7 +244,7 @@ pollmgr_init(void)
             }
         }
 #else
-        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pm->chan[i]);
         if (RT_FAILURE(status)) {
             goto cleanup_close;
         }
@@ -167,71 +256,199 @@ pollmgr_init(void)
     LWIP_ASSERT1(newcap >= POLLMGR_SLOT_STATIC_COUNT);
 
     newfds = (struct pollfd *)
-        malloc(newcap * sizeof(*pollmgr.fds));
+        malloc(newcap * sizeof(*pm->fds));
     if (newfds == NULL) {
         DPRINTF(("%s: Failed to allocate fds array\n", __func__));
         goto cleanup_close;
     }
 
     newhdls = (struct pollmgr_handler **)
-        malloc(newcap * sizeof(*pollmgr.handlers));
+        malloc(newcap * sizeof(*pm->handlers));
     if (newhdls == NULL) {
         DPRINTF(("%s: Failed to allocate handlers array\n", __func__));
         free(newfds);
         goto cleanup_close;
     }
 
-    pollmgr.capacity = newcap;
-    pollmgr.fds = newfds;
-    pollmgr.handlers = newhdls;
+    pm->capacity = newcap;
+    pm->fds = newfds;
+    pm->handlers = newhdls;
 
-    pollmgr.nfds = POLLMGR_SLOT_STATIC_COUNT;
+    pm->nfds = POLLMGR_SLOT_STATIC_COUNT;
 
-    for (i = 0; i < pollmgr.capacity; ++i) {
-        pollmgr.fds[i].fd = INVALID_SOCKET;
-        pollmgr.fds[i].events = 0;
-        pollmgr.fds[i].revents = 0;
+    for (i = 0; i < pm->capacity; ++i) {
+        pm->fds[i].fd = INVALID_SOCKET;
+        pm->fds[i].events = 0;
+        pm->fds[i].revents = 0;
     }
 
     /* add request queue notification */
-    pollmgr.queue_handler.callback = pollmgr_queue_callback;
-    pollmgr.queue_handler.data = NULL;
-    pollmgr.queue_handler.slot = -1;
+    pm->queue_handler.callback = pollmgr_queue_callback;
+    pm->queue_handler.data = pm;
+    pm->queue_handler.slot = -1;
 
-    pollmgr_add_at(POLLMGR_QUEUE, &pollmgr.queue_handler,
-                   pollmgr.chan[POLLMGR_QUEUE][POLLMGR_CHFD_RD],
+    pollmgr_add_at(pm, POLLMGR_QUEUE, &pm->queue_handler,
+                   pm->chan[POLLMGR_QUEUE][POLLMGR_CHFD_RD],
                    POLLIN);
 
     return 0;
 
   cleanup_close:
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        SOCKET *chan = pollmgr.chan[i];
+        SOCKET *chan = pm->chan[i];
         if (chan[POLLMGR_CHFD_RD] != INVALID_SOCKET) {
             closesocket(chan[POLLMGR_CHFD_RD]);
             closesocket(chan[POLLMGR_CHFD_WR]);
         }
     }
 
+    RTReqQueueDestroy(pm->queue);
+    pm->queue = NIL_RTREQQUEUE;
     return -1;
 }
 
 
+/*
+ * Number of poll manager threads to start.
+ */
+int
+pollmgr_count(void)
+{
+    return pollmgr_nthreads;
+}
+
+
+/*
+ * Poll manager instance of the calling thread.  Threads other than
+ * poll manager threads (e.g. during initialization) are treated as
+ * thread 0.
+ */
+static struct pollmgr *
+pollmgr_current(void)
+{
+    struct pollmgr *pm = NULL;
+
+    if (pollmgr_tls != NIL_RTTLS) {
+        pm = (struct pollmgr *)RTTlsGet(pollmgr_tls);
+    }
+
+    return pm != NULL ? pm : &pollmgr_threads[0];
+}
+
+
+/*
+ * Pick the poll manager thread for a flow.  The addresses and ports
+ * are hashed (FNV-1a) in the order given, so callers must use the
+ * same order for all packets of the flow.  "addr2" may be NULL.
+ */
+int
+pollmgr_flow_index(int proto,
+                   const void *addr1, const void *addr2, size_t addrlen,
+                   u16_t port1, u16_t port2)
+{
+    const u8_t *p;
+    u32_t h;
+    size_t i;
+
+    if (pollmgr_nthreads <= 1) {
+        return 0;
+    }
+
+    h = 2166136261U;
+
+#define POLLMGR_FNV1A(_b) do { h ^= (u8_t)(_b); h *= 16777619U; } while (0)
+    p = (const u8_t *)addr1;
+    for (i = 0; i < addrlen; ++i) {
+        POLLMGR_FNV1A(p[i]);
+    }
+
+    if (addr2 != NULL) {
+        p = (const u8_t *)addr2;
+        for (i = 0; i < addrlen; ++i) {
+            POLLMGR_FNV1A(p[i]);
+        }
+    }
+
+    POLLMGR_FNV1A(port1 >> 8);
+    POLLMGR_FNV1A(port1);
+    POLLMGR_FNV1A(port2 >> 8);
+    POLLMGR_FNV1A(port2);
+    POLLMGR_FNV1A(proto);
+#undef POLLMGR_FNV1A
+
+    return (int)(h % (u32_t)pollmgr_nthreads);
+}
+
+
+/*
+ * Buffer for the calling poll manager thread's callbacks to receive
+ * udp datagrams into.
+ */
+u8_t *
+pollmgr_get_udpbuf(void)
+{
+    return pollmgr_current()->udpbuf;
+}
+
+
 /*
  * Add new channel.  We now implement channels with request queue, so
  * all channels get the same socket that triggers queue processing.
+ * The handler is registered with all poll manager threads, the
+ * channel is serviced by the thread it's sent to.
  *
  * Must be called before pollmgr loop is started, so no locking.
  */
 SOCKET
 pollmgr_add_chan(int slot, struct pollmgr_handler *handler)
 {
+    int i;
+
     AssertReturn(0 <= slot && slot < POLLMGR_CHAN_COUNT, INVALID_SOCKET);
     AssertReturn(handler != NULL && handler->callback != NULL, INVALID_SOCKET);
 
     handler->slot = slot;
-    pollmgr.chan_handlers[slot].handler = handler;
-    return pollmgr.chan[POLLMGR_QUEUE][POLLMGR_CHFD_WR];
+    for (i = 0; i < pollmgr_nthreads; ++i) {
+        pollmgr_threads[i].chan_handlers[slot].handler = handler;
+    }
+    return pollmgr_threads[0].chan[POLLMGR_QUEUE][POLLMGR_CHFD_WR];
+}
+
+
+/*
+ * Wake up poll manager thread to process its request queue.
+ */
+static int
+pollmgr_notify(struct pollmgr *pm)
+{
+    static const char notification = 0x5a;
+
+    SOCKET fd;
+    ssize_t nsent;
+
+    fd = pm->chan[POLLMGR_QUEUE][POLLMGR_CHFD_WR];
+    nsent = send(fd, &notification, 1, 0);
+    if (nsent == SOCKET_ERROR) {
+        DPRINTF(("send on queue chan: %R[sockerr]\n", SOCKERRNO()));
+        return -1;
+    }
+    else if ((size_t)nsent != 1) {
+        DPRINTF(("send on queue chan: datagram truncated to %u bytes",
+                 (unsigned int)nsent));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Send to the channel of poll manager thread 0.
+ */
+ssize_t
+pollmgr_chan_send(int slot, void *buf, size_t nbytes)
+{
+    return pollmgr_chan_send_to(0, slot, buf, nbytes);
 }
 
 
@@ -241,17 +458,17 @@ pollmgr_add_chan(int slot, struct pollmgr_handler *handler)
  * POLLMGR_QUEUE socket.
  */
 ssize_t
-pollmgr_chan_send(int slot, void *buf, size_t nbytes)
+pollmgr_chan_send_to(int idx, int slot, void *buf, size_t nbytes)
 {
-    static const char notification = 0x5a;
-
+    struct pollmgr *pm;
     void *ptr;
-    SOCKET fd;
-    ssize_t nsent;
     int rc;
 
+    AssertReturn(0 <= idx && idx < pollmgr_nthreads, -1);
     AssertReturn(0 <= slot && slot < POLLMGR_CHAN_COUNT, -1);
 
+    pm = &pollmgr_threads[idx];
+
     /*
      * XXX: Hack alert.  We only ever "sent" single pointer which was
      * simultaneously both the wakeup event for the poll and the
@@ -265,20 +482,14 @@ pollmgr_chan_send(int slot, void *buf, size_t nbytes)
 
     ptr = *(void **)buf;
 
-    rc = RTReqQueueCallEx(pollmgr.queue, NULL, 0,
+    rc = RTReqQueueCallEx(pm->queue, NULL, 0,
                           RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
-                          (PFNRT)pollmgr_chan_call_handler, 2,
-                          slot, ptr);
+                          (PFNRT)pollmgr_chan_call_handler, 3,
+                          pm, slot, ptr);
 
-    fd = pollmgr.chan[POLLMGR_QUEUE][POLLMGR_CHFD_WR];
-    nsent = send(fd, &notification, 1, 0);
-    if (nsent == SOCKET_ERROR) {
-        DPRINTF(("send on chan %d: %R[sockerr]\n", slot, SOCKERRNO()));
-        return -1;
-    }
-    else if ((size_t)nsent != 1) {
-        DPRINTF(("send on chan %d: datagram truncated to %u bytes",
-                 slot, (unsigned int)nsent));
+    if (pollmgr_notify(pm) < 0) {
+        DPRINTF(("%s: chan %d: failed to notify thread %d\n",
+                 __func__, slot, idx));
         return -1;
     }
 
@@ -293,14 +504,15 @@ pollmgr_chan_send(int slot, void *buf, size_t nbytes)
 static int
 pollmgr_queue_callback(struct pollmgr_handler *handler, SOCKET fd, int revents)
 {
+    struct pollmgr *pm = (struct pollmgr *)handler->data;
     ssize_t nread;
     int sockerr;
     int rc;
 
-    RT_NOREF(handler, revents);
-    Assert(pollmgr.queue != NIL_RTREQQUEUE);
+    RT_NOREF(revents);
+    Assert(pm->queue != NIL_RTREQQUEUE);
 
-    nread = recv(fd, (char *)pollmgr_udpbuf, sizeof(pollmgr_udpbuf), 0);
+    nread = recv(fd, (char *)pm->udpbuf, POLLMGR_UDPBUF_SIZE, 0);
     sockerr = SOCKERRNO();      /* save now, may be clobbered */
 
     if (nread == SOCKET_ERROR) {
@@ -313,7 +525,7 @@ pollmgr_queue_callback(struct pollmgr_handler *handler, SOCKET fd, int revents)
         return POLLIN;
     }
 
-    rc = RTReqQueueProcess(pollmgr.queue, 0);
+    rc = RTReqQueueProcess(pm->queue, 0);
     if (RT_UNLIKELY(rc != VERR_TIMEOUT && RT_FAILURE_NP(rc))) {
         DPRINTF0(("%s: RTReqQueueProcess: %Rrc\n", __func__, rc));
     }
@@ -327,19 +539,19 @@ pollmgr_queue_callback(struct pollmgr_handler *handler, SOCKET fd, int revents)
  * handler's callback.
  */
 static void
-pollmgr_chan_call_handler(int slot, void *arg)
+pollmgr_chan_call_handler(struct pollmgr *pm, int slot, void *arg)
 {
     struct pollmgr_handler *handler;
     int nevents;
 
     AssertReturnVoid(0 <= slot && slot < POLLMGR_CHAN_COUNT);
 
-    handler = pollmgr.chan_handlers[slot].handler;
+    handler = pm->chan_handlers[slot].handler;
     AssertReturnVoid(handler != NULL && handler->callback != NULL);
 
     /* arrange for pollmgr_chan_recv_ptr() to "receive" the arg */
-    pollmgr.chan_handlers[slot].arg = arg;
-    pollmgr.chan_handlers[slot].arg_valid = true;
+    pm->chan_handlers[slot].arg = arg;
+    pm->chan_handlers[slot].arg_valid = true;
 
     nevents = handler->callback(handler, INVALID_SOCKET, POLLIN);
     if (nevents != POLLIN) {
@@ -354,6 +566,7 @@ pollmgr_chan_call_handler(int slot, void *arg)
 void *
 pollmgr_chan_recv_ptr(struct pollmgr_handler *handler, SOCKET fd, int revents)
 {
+    struct pollmgr *pm;
     int slot;
     void *ptr;
 
@@ -374,13 +587,14 @@ pollmgr_chan_recv_ptr(struct pollmgr_handler *handler, SOCKET fd, int revents)
 
     LWIP_ASSERT1(revents & POLLIN);
 
-    if (!pollmgr.chan_handlers[slot].arg_valid) {
+    pm = pollmgr_current();
+    if (!pm->chan_handlers[slot].arg_valid) {
         err(EXIT_FAILURE, "chan %d: recv", (int)handler->slot);
         /* NOTREACHED */
     }
 
-    ptr = pollmgr.chan_handlers[slot].arg;
-    pollmgr.chan_handlers[slot].arg_valid = false;
+    ptr = pm->chan_handlers[slot].arg;
+    pm->chan_handlers[slot].arg_valid = false;
 
     return ptr;
 }
@@ -391,32 +605,92 @@ pollmgr_chan_recv_ptr(struct pollmgr_handler *handler, SOCKET fd, int revents)
  */
 int
 pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
+{
+    return pollmgr_add_pm(pollmgr_current(), handler, fd, events);
+}
+
+
+/*
+ * Add to the poll manager thread "idx".  If that's not the calling
+ * thread, the request is passed to the target thread and we wait for
+ * it to be processed, so that the caller can rely on the slot being
+ * set when we return.  Must not be called with the slot already
+ * registered, and two threads must not wait on each other.
+ */
+int
+pollmgr_add_to(int idx, struct pollmgr_handler *handler, SOCKET fd, int events)
+{
+    struct pollmgr *pm;
+    PRTREQ req;
+    int slot;
+    int rc;
+
+    AssertReturn(0 <= idx && idx < pollmgr_nthreads, -1);
+
+    pm = &pollmgr_threads[idx];
+    if (pm == pollmgr_current()) {
+        return pollmgr_add_pm(pm, handler, fd, events);
+    }
+
+    slot = -1;
+    rc = RTReqQueueCallEx(pm->queue, &req, 0, RTREQFLAGS_VOID,
+                          (PFNRT)pollmgr_add_req, 5,
+                          pm, handler, fd, events, &slot);
+    if (rc != VERR_TIMEOUT && RT_FAILURE(rc)) {
+        DPRINTF0(("%s: RTReqQueueCallEx: %Rrc\n", __func__, rc));
+        handler->slot = -1;
+        return -1;
+    }
+
+    pollmgr_notify(pm);
+
+    if (req != NULL) {
+        rc = RTReqWait(req, RT_INDEFINITE_WAIT);
+        AssertRC(rc);
+        RTReqRelease(req);
+    }
+
+    return slot;
+}
+
+
+static void
+pollmgr_add_req(struct pollmgr *pm, struct pollmgr_handler *handler,
+                SOCKET fd, int events, int *pslot)
+{
+    *pslot = pollmgr_add_pm(pm, handler, fd, events);
+}
+
+
+static int
+pollmgr_add_pm(struct pollmgr *pm, struct pollmgr_handler *handler,
+               SOCKET fd, int events)
 {
     int slot;
 
     DPRINTF2(("%s: new fd %d\n", __func__, fd));
 
-    if (pollmgr.nfds == pollmgr.capacity) {
+    if (pm->nfds == pm->capacity) {
         struct pollfd *newfds;
         struct pollmgr_handler **newhdls;
         nfds_t newcap;
         nfds_t i;
 
-        newcap = pollmgr.capacity * 2;
+        newcap = pm->capacity * 2;
 
         newfds = (struct pollfd *)
-            realloc(pollmgr.fds, newcap * sizeof(*pollmgr.fds));
+            realloc(pm->fds, newcap * sizeof(*pm->fds));
         if (newfds == NULL) {
             DPRINTF(("%s: Failed to reallocate fds array\n", __func__));
             handler->slot = -1;
             return -1;
         }
 
-        pollmgr.fds = newfds; /* don't crash/leak if realloc(handlers) fails */
+        pm->fds = newfds; /* don't crash/leak if realloc(handlers) fails */
         /* but don't update capacity yet! */
 
         newhdls = (struct pollmgr_handler **)
-            realloc(pollmgr.handlers, newcap * sizeof(*pollmgr.handlers));
+            realloc(pm->handlers, newcap * sizeof(*pm->handlers));
         if (newhdls == NULL) {
             DPRINTF(("%s: Failed to reallocate handlers array\n", __func__));
             /* if we failed to realloc here, then fds points to the
@@ -425,10 +699,10 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
             return -1;
         }
 
-        pollmgr.handlers = newhdls;
-        pollmgr.capacity = newcap;
+        pm->handlers = newhdls;
+        pm->capacity = newcap;
 
-        for (i = pollmgr.nfds; i < newcap; ++i) {
+        for (i = pm->nfds; i < newcap; ++i) {
             newfds[i].fd = INVALID_SOCKET;
             newfds[i].events = 0;
             newfds[i].revents = 0;
@@ -436,21 +710,22 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
         }
     }
 
-    slot = pollmgr.nfds;
-    ++pollmgr.nfds;
+    slot = pm->nfds;
+    ++pm->nfds;
 
-    pollmgr_add_at(slot, handler, fd, events);
+    pollmgr_add_at(pm, slot, handler, fd, events);
     return slot;
 }
 
 
 static void
-pollmgr_add_at(int slot, struct pollmgr_handler *handler, SOCKET fd, int events)
+pollmgr_add_at(struct pollmgr *pm, int slot, struct pollmgr_handler *handler,
+               SOCKET fd, int events)
 {
-    pollmgr.fds[slot].fd = fd;
-    pollmgr.fds[slot].events = events;
-    pollmgr.fds[slot].revents = 0;
-    pollmgr.handlers[slot] = handler;
+    pm->fds[slot].fd = fd;
+    pm->fds[slot].events = events;
+    pm->fds[slot].revents = 0;
+    pm->handlers[slot] = handler;
 
     handler->slot = slot;
 }
@@ -459,35 +734,103 @@ pollmgr_add_at(int slot, struct pollmgr_handler *handler, SOCKET fd, int events)
 void
 pollmgr_update_events(int slot, int events)
 {
+    struct pollmgr *pm = pollmgr_current();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
-    LWIP_ASSERT1((nfds_t)slot < pollmgr.nfds);
+    LWIP_ASSERT1((nfds_t)slot < pm->nfds);
 
-    pollmgr.fds[slot].events = events;
+    pm->fds[slot].events = events;
 }
 
 
 void
 pollmgr_del_slot(int slot)
 {
+    struct pollmgr *pm = pollmgr_current();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
 
     DPRINTF2(("%s(%d): fd %d ! DELETED\n",
-              __func__, slot, pollmgr.fds[slot].fd));
+              __func__, slot, pm->fds[slot].fd));
+
+    pm->fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+}
+
+
+static void
+pollmgr_del_req(struct pollmgr *pm, struct pollmgr_handler *handler)
+{
+    const int slot = handler->slot;
+
+    LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
+    LWIP_ASSERT1((nfds_t)slot < pm->nfds);
+
+    pm->fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+}
+
+
+/*
+ * Delete handler's slot of the poll manager thread "idx", waiting for
+ * the thread to do it if it's not the calling one.  The slot is read
+ * on the owning thread since the poll loop may move it around.  See
+ * pollmgr_add_to().
+ */
+void
+pollmgr_del_to(int idx, struct pollmgr_handler *handler)
+{
+    struct pollmgr *pm;
+    PRTREQ req;
+    int rc;
+
+    AssertReturnVoid(0 <= idx && idx < pollmgr_nthreads);
+
+    pm = &pollmgr_threads[idx];
+    if (pm == pollmgr_current()) {
+        pollmgr_del_slot(handler->slot);
+        return;
+    }
 
-    pollmgr.fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+    rc = RTReqQueueCallEx(pm->queue, &req, 0, RTREQFLAGS_VOID,
+                          (PFNRT)pollmgr_del_req, 2,
+                          pm, handler);
+    if (rc != VERR_TIMEOUT && RT_FAILURE(rc)) {
+        DPRINTF0(("%s: RTReqQueueCallEx: %Rrc\n", __func__, rc));
+        return;
+    }
+
+    pollmgr_notify(pm);
+
+    if (req != NULL) {
+        rc = RTReqWait(req, RT_INDEFINITE_WAIT);
+        AssertRC(rc);
+        RTReqRelease(req);
+    }
 }
 
 
+/*
+ * Thread function, the argument is the index of the poll manager
+ * instance to run (cast to a pointer).
+ */
 void
-pollmgr_thread(void *ignored)
+pollmgr_thread(void *arg)
 {
-    LWIP_UNUSED_ARG(ignored);
-    pollmgr_loop();
+    struct pollmgr *pm;
+    int idx = (int)(intptr_t)arg;
+
+    AssertReturnVoid(0 <= idx && idx < pollmgr_nthreads);
+
+    pm = &pollmgr_threads[idx];
+    if (pollmgr_tls != NIL_RTTLS) {
+        RTTlsSet(pollmgr_tls, pm);
+    }
+
+    pollmgr_loop(pm);
 }
 
 
 static void
-pollmgr_loop(void)
+pollmgr_loop(struct pollmgr *pm)
 {
     int nready;
     SOCKET delfirst;
@@ -496,9 +839,9 @@ pollmgr_loop(void)
 
     for (;;) {
 #ifndef RT_OS_WINDOWS
-        nready = poll(pollmgr.fds, pollmgr.nfds, -1);
+        nready = poll(pm->fds, pm->nfds, -1);
 #else
-        int rc = RTWinPoll(pollmgr.fds, pollmgr.nfds,RT_INDEFINITE_WAIT, &nready);
+        int rc = RTWinPoll(pm->fds, pm->nfds,RT_INDEFINITE_WAIT, &nready);
         if (RT_FAILURE(rc)) {
             err(EXIT_FAILURE, "poll"); /* XXX: what to do on error? */
             /* NOTREACHED*/
@@ -524,13 +867,13 @@ pollmgr_loop(void)
         delfirst = INVALID_SOCKET;
         pdelprev = &delfirst;
 
-        for (i = 0; (nfds_t)i < pollmgr.nfds && nready > 0; ++i) {
+        for (i = 0; (nfds_t)i < pm->nfds && nready > 0; ++i) {
             struct pollmgr_handler *handler;
             SOCKET fd;
             int revents, nevents;
 
-            fd = pollmgr.fds[i].fd;
-            revents = pollmgr.fds[i].revents;
+            fd = pm->fds[i].fd;
+            revents = pm->fds[i].revents;
 
             /*
              * Channel handlers can request deletion of dynamic slots
@@ -552,7 +895,7 @@ pollmgr_loop(void)
             }
             --nready;
 
-            handler = pollmgr.handlers[i];
+            handler = pm->handlers[i];
 
             if (handler != NULL && handler->callback != NULL) {
 #ifdef LWIP_PROXY_DEBUG
@@ -587,32 +930,32 @@ pollmgr_loop(void)
 
           update_events:
             if (nevents >= 0) {
-                if (nevents != pollmgr.fds[i].events) {
+                if (nevents != pm->fds[i].events) {
                     DPRINTF2(("%s: fd %d ! nevents 0x%x\n",
                               __func__, fd, nevents));
                 }
-                pollmgr.fds[i].events = nevents;
+                pm->fds[i].events = nevents;
             }
             else if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
                 /* Don't garbage-collect channels. */
                 DPRINTF2(("%s: fd %d ! DELETED (channel %d)\n",
                           __func__, fd, i));
-                pollmgr.fds[i].fd = INVALID_SOCKET;
-                pollmgr.fds[i].events = 0;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
+                pm->fds[i].fd = INVALID_SOCKET;
+                pm->fds[i].events = 0;
+                pm->fds[i].revents = 0;
+                pm->handlers[i] = NULL;
             }
             else {
                 DPRINTF2(("%s: fd %d ! DELETED\n", __func__, fd));
 
                 /* schedule for deletion (see g/c loop for details) */
                 *pdelprev = i;  /* make previous entry point to us */
-                pdelprev = &pollmgr.fds[i].fd;
+                pdelprev = &pm->fds[i].fd;
 
-                pollmgr.fds[i].fd = INVALID_SOCKET; /* end of list (for now) */
-                pollmgr.fds[i].events = POLLMGR_GARBAGE;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
+                pm->fds[i].fd = INVALID_SOCKET; /* end of list (for now) */
+                pm->fds[i].events = POLLMGR_GARBAGE;
+                pm->fds[i].revents = 0;
+                pm->handlers[i] = NULL;
             }
         } /* processing loop */
 
@@ -630,33 +973,33 @@ pollmgr_loop(void)
          * processing loop above.
          */
         while (delfirst != INVALID_SOCKET) {
-            const int last = pollmgr.nfds - 1;
+            const int last = pm->nfds - 1;
 
             /*
              * We want a live entry in the last slot to swap into the
              * freed slot, so make sure we have one.
              */
-            if (pollmgr.fds[last].events == POLLMGR_GARBAGE /* garbage */
-                || pollmgr.fds[last].fd == INVALID_SOCKET)  /* or killed */
+            if (pm->fds[last].events == POLLMGR_GARBAGE /* garbage */
+                || pm->fds[last].fd == INVALID_SOCKET)  /* or killed */
             {
                 /* drop garbage entry at the end of the array */
-                --pollmgr.nfds;
+                --pm->nfds;
 
                 if (delfirst == (SOCKET)last) {
-                    /* congruent to delnext >= pollmgr.nfds test below */
+                    /* congruent to delnext >= pm->nfds test below */
                     delfirst = INVALID_SOCKET; /* done */
                 }
             }
             else {
-                const SOCKET delnext = pollmgr.fds[delfirst].fd;
+                const SOCKET delnext = pm->fds[delfirst].fd;
 
                 /* copy live entry at the end to the first slot being freed */
-                pollmgr.fds[delfirst] = pollmgr.fds[last]; /* struct copy */
-                pollmgr.handlers[delfirst] = pollmgr.handlers[last];
-                pollmgr.handlers[delfirst]->slot = (int)delfirst;
-                --pollmgr.nfds;
+                pm->fds[delfirst] = pm->fds[last]; /* struct copy */
+                pm->handlers[delfirst] = pm->handlers[last];
+                pm->handlers[delfirst]->slot = (int)delfirst;
+                --pm->nfds;
 
-                if ((nfds_t)delnext >= pollmgr.nfds) {
+                if ((nfds_t)delnext >= pm->nfds) {
                     delfirst = INVALID_SOCKET; /* done */
                 }
                 else {
@@ -664,10 +1007,10 @@ pollmgr_loop(void)
                 }
             }
 
-            pollmgr.fds[last].fd = INVALID_SOCKET;
-            pollmgr.fds[last].events = 0;
-            pollmgr.fds[last].revents = 0;
-            pollmgr.handlers[last] = NULL;
+            pm->fds[last].fd = INVALID_SOCKET;
+            pm->fds[last].events = 0;
+            pm->fds[last].revents = 0;
+            pm->handlers[last] = NULL;
         }
     } /* poll loop */
 }
@@ -38,6 +38,12 @@ enum pollmgr_slot_t {
     POLLMGR_CHAN_COUNT
 };
 
+/* upper limit on the number of poll manager threads */
+#define POLLMGR_MAX_THREADS 8
+
+/* size of the udp receive buffer of each poll manager thread */
+#define POLLMGR_UDPBUF_SIZE (64 * 1024)
+
 
 struct pollmgr_handler;         /* forward */
 typedef int (*pollmgr_callback)(struct pollmgr_handler *, SOCKET, int);
@@ -55,15 +61,23 @@ struct pollmgr_refptr {
     size_t weak;
 };
 
-int pollmgr_init(void);
+int pollmgr_init(int nthreads);
+int pollmgr_count(void);
+
+/* pick poll manager thread for a flow */
+int pollmgr_flow_index(int proto,
+                       const void *addr1, const void *addr2, size_t addrlen,
+                       u16_t port1, u16_t port2);
 
 /* static named slots (aka "channels") */
 SOCKET pollmgr_add_chan(int, struct pollmgr_handler *);
 ssize_t pollmgr_chan_send(int, void *buf, size_t nbytes);
+ssize_t pollmgr_chan_send_to(int idx, int, void *buf, size_t nbytes);
 void *pollmgr_chan_recv_ptr(struct pollmgr_handler *, SOCKET, int);
 
 /* dynamic slots */
 int pollmgr_add(struct pollmgr_handler *, SOCKET, int);
+int pollmgr_add_to(int idx, struct pollmgr_handler *, SOCKET, int);
 
 /* special-purpose strong/weak references */
 struct pollmgr_refptr *pollmgr_refptr_create(struct pollmgr_handler *);
@@ -73,10 +87,14 @@ void pollmgr_refptr_unref(struct pollmgr_refptr *);
 
 void pollmgr_update_events(int, int);
 void pollmgr_del_slot(int);
+void pollmgr_del_to(int idx, struct pollmgr_handler *);
 
 void pollmgr_thread(void *);
 
 /* buffer for callbacks to receive udp without worrying about truncation */
-extern u8_t pollmgr_udpbuf[64 * 1024];
+u8_t *pollmgr_get_udpbuf(void);
+
+/* the same for thread 0, that runs everything but the proxied flows */
+extern u8_t pollmgr_udpbuf[POLLMGR_UDPBUF_SIZE];
 
 #endif /* _PROXY_POLLMGR_H_ */
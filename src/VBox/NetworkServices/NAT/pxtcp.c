@@ -117,6 +117,11 @@ struct pxtcp {
      */
     struct pollmgr_handler pmhdl;
 
+    /**
+     * Poll manager thread we are polled on, see pollmgr_flow_index().
+     */
+    int pmidx;
+
     /**
      * lwIP (internal/guest) side of the proxied connection.
      */
@@ -340,7 +345,7 @@ pxtcp_init(void)
 static ssize_t
 pxtcp_chan_send(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
-    return pollmgr_chan_send(slot, &pxtcp, sizeof(pxtcp));
+    return pollmgr_chan_send_to(pxtcp->pmidx, slot, &pxtcp, sizeof(pxtcp));
 }
 
 
@@ -352,7 +357,8 @@ static ssize_t
 pxtcp_chan_send_weak(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
     pollmgr_refptr_weak_ref(pxtcp->rp);
-    return pollmgr_chan_send(slot, &pxtcp->rp, sizeof(pxtcp->rp));
+    return pollmgr_chan_send_to(pxtcp->pmidx, slot,
+                                &pxtcp->rp, sizeof(pxtcp->rp));
 }
 
 
@@ -409,7 +415,8 @@ pxtcp_pmgr_add(struct pxtcp *pxtcp)
     LWIP_ASSERT1(pxtcp->pmhdl.data == (void *)pxtcp);
     LWIP_ASSERT1(pxtcp->pmhdl.slot < 0);
 
-    status = pollmgr_add(&pxtcp->pmhdl, pxtcp->sock, pxtcp->events);
+    status = pollmgr_add_to(pxtcp->pmidx,
+                            &pxtcp->pmhdl, pxtcp->sock, pxtcp->events);
     return status;
 }
 
@@ -425,7 +432,7 @@ pxtcp_pmgr_del(struct pxtcp *pxtcp)
 {
     LWIP_ASSERT1(pxtcp != NULL);
 
-    pollmgr_del_slot(pxtcp->pmhdl.slot);
+    pollmgr_del_to(pxtcp->pmidx, &pxtcp->pmhdl);
 }
 
 
@@ -590,6 +597,7 @@ pxtcp_allocate(void)
     pxtcp->pmhdl.callback = NULL;
     pxtcp->pmhdl.data = (void *)pxtcp;
     pxtcp->pmhdl.slot = -1;
+    pxtcp->pmidx = 0;
 
     pxtcp->pcb = NULL;
     pxtcp->sock = INVALID_SOCKET;
@@ -644,10 +652,11 @@ pxtcp_allocate(void)
 
 /**
  * Exported to fwtcp to create pxtcp for incoming port-forwarded
- * connections.  Completed with pcb in pxtcp_pcb_connect().
+ * connections.  Completed with pcb in pxtcp_pcb_connect().  The
+ * connection is polled on the poll manager thread "pmidx".
  */
 struct pxtcp *
-pxtcp_create_forwarded(SOCKET sock)
+pxtcp_create_forwarded(SOCKET sock, int pmidx)
 {
     struct pxtcp *pxtcp;
 
@@ -658,6 +667,7 @@ pxtcp_create_forwarded(SOCKET sock)
 
     pxtcp->sock = sock;
     pxtcp->pmhdl.callback = pxtcp_pmgr_pump;
+    pxtcp->pmidx = pmidx;
     pxtcp->events = 0;
 
     return pxtcp;
@@ -1064,6 +1074,11 @@ pxtcp_pcb_accept_outbound(struct tcp_pcb *newpcb, struct pbuf *p,
     pxtcp->sock = sock;
 
     pxtcp->pmhdl.callback = pxtcp_pmgr_connect;
+    pxtcp->pmidx = pollmgr_flow_index(IP_PROTO_TCP,
+                                      &newpcb->remote_ip, &newpcb->local_ip,
+                                      is_ipv6 ? sizeof(ip6_addr_t)
+                                              : sizeof(ip_addr_t),
+                                      newpcb->remote_port, newpcb->local_port);
     pxtcp->events = POLLOUT;
 
     nsent = pxtcp_chan_send(POLLMGR_CHAN_PXTCP_ADD, pxtcp);
@@ -28,7 +28,7 @@ struct fwspec;
 
 err_t pxtcp_pcb_accept_outbound(struct tcp_pcb *, struct pbuf *, int, ipX_addr_t *, u16_t);
 
-struct pxtcp *pxtcp_create_forwarded(SOCKET);
+struct pxtcp *pxtcp_create_forwarded(SOCKET, int);
 void pxtcp_cancel_forwarded(struct pxtcp *);
 
 void pxtcp_pcb_connect(struct pxtcp *, const struct fwspec *);
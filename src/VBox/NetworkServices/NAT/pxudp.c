@@ -55,6 +55,11 @@ struct pxudp {
      */
     struct pollmgr_handler pmhdl;
 
+    /**
+     * Poll manager thread we are polled on, see pollmgr_flow_index().
+     */
+    int pmidx;
+
     /**
      * lwIP ("internal") side of the proxied connection.
      */
@@ -182,7 +187,7 @@ pxudp_init(void)
 static ssize_t
 pxudp_chan_send(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
-    return pollmgr_chan_send(chan, &pxudp, sizeof(pxudp));
+    return pollmgr_chan_send_to(pxudp->pmidx, chan, &pxudp, sizeof(pxudp));
 }
 
 
@@ -194,7 +199,8 @@ static ssize_t
 pxudp_chan_send_weak(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
     pollmgr_refptr_weak_ref(pxudp->rp);
-    return pollmgr_chan_send(chan, &pxudp->rp, sizeof(pxudp->rp));
+    return pollmgr_chan_send_to(pxudp->pmidx, chan,
+                                &pxudp->rp, sizeof(pxudp->rp));
 }
 
 
@@ -300,6 +306,7 @@ pxudp_allocate(void)
     pxudp->pmhdl.callback = NULL;
     pxudp->pmhdl.data = (void *)pxudp;
     pxudp->pmhdl.slot = -1;
+    pxudp->pmidx = 0;
 
     pxudp->pcb = NULL;
     pxudp->sock = INVALID_SOCKET;
@@ -547,6 +554,11 @@ pxudp_pcb_accept(void *arg, struct udp_pcb *newpcb, struct pbuf *p,
     udp_recv(newpcb, pxudp_pcb_recv, pxudp);
 
     pxudp->pmhdl.callback = pxudp_pmgr_pump;
+    pxudp->pmidx = pollmgr_flow_index(IP_PROTO_UDP,
+                                      &newpcb->remote_ip, &newpcb->local_ip,
+                                      PCB_ISIPV6(newpcb) ? sizeof(ip6_addr_t)
+                                                         : sizeof(ip_addr_t),
+                                      newpcb->remote_port, newpcb->local_port);
     pxudp_chan_send(POLLMGR_CHAN_PXUDP_ADD, pxudp);
 
     /* dispatch directly instead of calling pxudp_pcb_recv() */
@@ -719,6 +731,7 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
 {
     struct pxudp *pxudp;
     struct pbuf *p;
+    u8_t *udpbuf;
     ssize_t nread;
     err_t error;
 
@@ -759,10 +772,11 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
         return POLLIN;
     }
 
+    udpbuf = pollmgr_get_udpbuf();
 #ifdef RT_OS_WINDOWS
-    nread = recv(pxudp->sock, (char *)pollmgr_udpbuf, sizeof(pollmgr_udpbuf), 0);
+    nread = recv(pxudp->sock, (char *)udpbuf, POLLMGR_UDPBUF_SIZE, 0);
 #else
-    nread = recv(pxudp->sock, pollmgr_udpbuf, sizeof(pollmgr_udpbuf), 0);
+    nread = recv(pxudp->sock, udpbuf, POLLMGR_UDPBUF_SIZE, 0);
 #endif
     if (nread == SOCKET_ERROR) {
         DPRINTF(("%s: %R[sockerr]\n", __func__, SOCKERRNO()));
@@ -775,7 +789,7 @@ pxudp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
         return POLLIN;
     }
 
-    error = pbuf_take(p, pollmgr_udpbuf, (u16_t)nread);
+    error = pbuf_take(p, udpbuf, (u16_t)nread);
     if (error != ERR_OK) {
         DPRINTF(("%s: pbuf_take(%d) failed\n", __func__, (int)nread));
         pbuf_free(p);
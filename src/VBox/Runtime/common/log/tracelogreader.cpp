@@ -1106,7 +1106,12 @@ static DECLCALLBACK(int) rtTraceLogRdrFileStream(void *pvUser, void *pvBuf, size
 {
     RT_NOREF(cMsTimeout);
     RTFILE hFile = (RTFILE)pvUser;
-    return RTFileRead(hFile, pvBuf, cbBuf, pcbRead);
+    int rc = RTFileRead(hFile, pvBuf, cbBuf, pcbRead);
+    if (   RT_SUCCESS(rc)
+        && !*pcbRead
+        && cbBuf)
+        rc = VERR_EOF; /* Nothing more is going to come, don't let the caller spin. */
+    return rc;
 }
 
 
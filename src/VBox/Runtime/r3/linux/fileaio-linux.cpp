@@ -40,6 +40,16 @@
  * compensated if the user of this API implements caching itself. The next
  * limitation is that data buffers must be aligned at a 512 byte boundary or the
  * request will fail.
+ *
+ * Newer kernels (5.5+) provide the io_uring interface which can be selected
+ * with RTFILEAIOCTX_FLAGS_PREFER_IO_URING when creating a context. Requests are
+ * placed into a submission queue shared with the kernel and a whole batch is
+ * handed over with a single io_uring_enter() call. Completed requests are
+ * reaped from the shared completion queue without any syscall as long as
+ * there are completions available, we only enter the kernel when we have to
+ * wait. Timeouts are implemented with a timeout request queued on the ring.
+ * If io_uring is not available (old kernel or blocked by a seccomp policy) the
+ * context silently falls back to the io_* syscalls.
  */
 /** @todo r=bird: What's this about "must be opened with O_DIRECT"? An
  *        explanation would be nice, esp. seeing what Linus is quoted saying
@@ -57,10 +67,14 @@
 #include <iprt/err.h>
 #include <iprt/log.h>
 #include <iprt/thread.h>
+#include <iprt/critsect.h>
+#include <iprt/time.h>
 #include "internal/fileaio.h"
 
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <errno.h>
 
 #include <iprt/file.h>
@@ -167,6 +181,245 @@ typedef struct LNXKAIOIOEVENT
 } LNXKAIOIOEVENT, *PLNXKAIOIOEVENT;
 
 
+/** @name io_uring interface definitions.
+ * Redefined here so we don't depend on recent kernel headers on the build host.
+ * @{ */
+#ifndef __NR_io_uring_setup
+# define __NR_io_uring_setup            425
+#endif
+#ifndef __NR_io_uring_enter
+# define __NR_io_uring_enter            426
+#endif
+
+/** mmap() offset of the submission queue ring. */
+#define LNXIOURING_MMAP_OFF_SQ          UINT32_C(0)
+/** mmap() offset of the completion queue ring. */
+#define LNXIOURING_MMAP_OFF_CQ          UINT32_C(0x8000000)
+/** mmap() offset of the submission queue entries. */
+#define LNXIOURING_MMAP_OFF_SQES        UINT32_C(0x10000000)
+
+/** The submission and completion queue rings can be mapped with a single mmap() call. */
+#define LNXIOURING_FEAT_SINGLE_MMAP     RT_BIT_32(0)
+/** The kernel never drops completion events when the completion queue overflows. */
+#define LNXIOURING_FEAT_NODROP          RT_BIT_32(1)
+
+/** io_uring_enter() flag: Wait for the given number of completions. */
+#define LNXIOURING_ENTER_GETEVENTS      RT_BIT_32(0)
+
+/** Vectored read opcode. */
+#define LNXIOURING_OP_READV             1
+/** Vectored write opcode. */
+#define LNXIOURING_OP_WRITEV            2
+/** Flush opcode. */
+#define LNXIOURING_OP_FSYNC             3
+/** Timeout opcode. */
+#define LNXIOURING_OP_TIMEOUT           11
+/** Timeout removal opcode, the address field holds the user data of the timeout request. */
+#define LNXIOURING_OP_TIMEOUT_REMOVE    12
+/** Cancel opcode, the address field holds the user data of the request to cancel. */
+#define LNXIOURING_OP_ASYNC_CANCEL      14
+
+/** Maximum number of submission queue entries, older kernels refuse more. */
+#define LNXIOURING_ENTRIES_MAX          4096
+/** Marker bit in the user data of a completion event for timeout requests
+ * (request pointers are always aligned). */
+#define LNXIOURING_USER_TIMEOUT         RT_BIT_64(0)
+/** Marker bit in the user data of a completion event for cancel requests. */
+#define LNXIOURING_USER_CANCEL          RT_BIT_64(1)
+/** Shift of the timeout generation in the user data of timeout requests. */
+#define LNXIOURING_USER_GEN_SHIFT       2
+/** @} */
+
+/**
+ * Submission queue ring offsets returned by io_uring_setup().
+ */
+typedef struct LNXIOURINGSQOFFSETS
+{
+    /** Offset of the head index. */
+    uint32_t            offHead;
+    /** Offset of the tail index. */
+    uint32_t            offTail;
+    /** Offset of the ring mask. */
+    uint32_t            offRingMask;
+    /** Offset of the number of ring entries. */
+    uint32_t            offRingEntries;
+    /** Offset of the ring flags. */
+    uint32_t            offFlags;
+    /** Offset of the dropped entries counter. */
+    uint32_t            offDropped;
+    /** Offset of the index array into the submission queue entries. */
+    uint32_t            offArray;
+    /** Reserved. */
+    uint32_t            u32Rsvd1;
+    /** Reserved. */
+    uint64_t            u64Rsvd2;
+} LNXIOURINGSQOFFSETS;
+
+/**
+ * Completion queue ring offsets returned by io_uring_setup().
+ */
+typedef struct LNXIOURINGCQOFFSETS
+{
+    /** Offset of the head index. */
+    uint32_t            offHead;
+    /** Offset of the tail index. */
+    uint32_t            offTail;
+    /** Offset of the ring mask. */
+    uint32_t            offRingMask;
+    /** Offset of the number of ring entries. */
+    uint32_t            offRingEntries;
+    /** Offset of the overflow counter. */
+    uint32_t            offOverflow;
+    /** Offset of the completion queue entries. */
+    uint32_t            offCqes;
+    /** Offset of the ring flags. */
+    uint32_t            offFlags;
+    /** Reserved. */
+    uint32_t            u32Rsvd1;
+    /** Reserved. */
+    uint64_t            u64Rsvd2;
+} LNXIOURINGCQOFFSETS;
+
+/**
+ * Parameters for io_uring_setup().
+ */
+typedef struct LNXIOURINGPARAMS
+{
+    /** Number of submission queue entries (set by the kernel). */
+    uint32_t            cSqEntries;
+    /** Number of completion queue entries (set by the kernel). */
+    uint32_t            cCqEntries;
+    /** Setup flags. */
+    uint32_t            fFlags;
+    /** CPU of the submission queue polling thread. */
+    uint32_t            idxSqThreadCpu;
+    /** Idle time of the submission queue polling thread. */
+    uint32_t            cMsSqThreadIdle;
+    /** Features supported by the kernel (LNXIOURING_FEAT_XXX). */
+    uint32_t            fFeatures;
+    /** Work queue file descriptor to share. */
+    uint32_t            uWqFd;
+    /** Reserved. */
+    uint32_t            au32Rsvd[3];
+    /** Submission queue ring offsets. */
+    LNXIOURINGSQOFFSETS SqOffsets;
+    /** Completion queue ring offsets. */
+    LNXIOURINGCQOFFSETS CqOffsets;
+} LNXIOURINGPARAMS;
+AssertCompileSize(LNXIOURINGPARAMS, 120);
+
+/**
+ * A submission queue entry.
+ */
+typedef struct LNXIOURINGSQE
+{
+    /** The opcode (LNXIOURING_OP_XXX). */
+    uint8_t             u8Opc;
+    /** Submission flags. */
+    uint8_t             u8Flags;
+    /** Request priority. */
+    uint16_t            u16IoPrio;
+    /** The file descriptor. */
+    int32_t             i32Fd;
+    /** Start offset (or completion count for timeouts). */
+    uint64_t            u64OffStart;
+    /** Buffer address, iovec array for vectored I/O. */
+    uint64_t            u64AddrBuf;
+    /** Buffer size or number of iovec entries. */
+    uint32_t            u32BufSz;
+    /** Opcode specific flags. */
+    uint32_t            uOpFlags;
+    /** Opaque user data returned in the completion event. */
+    uint64_t            u64User;
+    /** Index into the registered buffers. */
+    uint16_t            u16BufIndex;
+    /** Personality to use. */
+    uint16_t            u16Personality;
+    /** Splice input file descriptor. */
+    int32_t             i32SpliceFdIn;
+    /** Padding. */
+    uint64_t            au64Padding[2];
+} LNXIOURINGSQE;
+AssertCompileSize(LNXIOURINGSQE, 64);
+/** Pointer to a submission queue entry. */
+typedef LNXIOURINGSQE *PLNXIOURINGSQE;
+
+/**
+ * A completion queue entry.
+ */
+typedef struct LNXIOURINGCQE
+{
+    /** Opaque user data from the submission queue entry. */
+    uint64_t            u64User;
+    /** Result of the request (bytes transferred or negative errno). */
+    int32_t             rcLnx;
+    /** Flags. */
+    uint32_t            fFlags;
+} LNXIOURINGCQE;
+AssertCompileSize(LNXIOURINGCQE, 16);
+/** Pointer to a completion queue entry. */
+typedef LNXIOURINGCQE *PLNXIOURINGCQE;
+
+/**
+ * The kernel timespec structure used by the timeout request, 64bit on all architectures.
+ */
+typedef struct LNXKERNELTIMESPEC
+{
+    /** Seconds. */
+    int64_t             i64Sec;
+    /** Nanoseconds. */
+    int64_t             i64NanoSec;
+} LNXKERNELTIMESPEC;
+
+/**
+ * io_uring state of an async I/O context.
+ */
+typedef struct LNXIOURING
+{
+    /** The io_uring file descriptor. */
+    int                 iFdUring;
+    /** The mapped submission queue ring. */
+    void               *pvSqRing;
+    /** Size of the submission queue ring mapping. */
+    size_t              cbSqRing;
+    /** The mapped completion queue ring, equals pvSqRing for a single mapping. */
+    void               *pvCqRing;
+    /** Size of the completion queue ring mapping, 0 if shared with the submission queue. */
+    size_t              cbCqRing;
+    /** The mapped submission queue entries. */
+    PLNXIOURINGSQE      paSqes;
+    /** Size of the submission queue entries mapping. */
+    size_t              cbSqes;
+    /** Submission queue head index, written by the kernel. */
+    volatile uint32_t  *pidxSqHead;
+    /** Submission queue tail index. */
+    volatile uint32_t  *pidxSqTail;
+    /** Submission queue index array. */
+    volatile uint32_t  *paidxSqes;
+    /** Submission queue ring mask. */
+    uint32_t            fSqRingMask;
+    /** Number of submission queue entries. */
+    uint32_t            cSqEntries;
+    /** Completion queue head index. */
+    volatile uint32_t  *pidxCqHead;
+    /** Completion queue tail index, written by the kernel. */
+    volatile uint32_t  *pidxCqTail;
+    /** Completion queue ring mask. */
+    uint32_t            fCqRingMask;
+    /** The completion queue entries. */
+    PLNXIOURINGCQE      paCqes;
+    /** Serializes access to the submission queue between RTFileAioCtxSubmit()
+     * and arming a timeout in RTFileAioCtxWait(). */
+    RTCRITSECT          CritSectSq;
+    /** Generation of the current timeout request, used to ignore stale ones. */
+    uint64_t            uTimeoutGen;
+    /** The timeout handed to the kernel, copied by it during submission. */
+    LNXKERNELTIMESPEC   TimeoutSpec;
+} LNXIOURING;
+/** Pointer to the io_uring state. */
+typedef LNXIOURING *PLNXIOURING;
+
+
 /**
  * Async I/O completion context state.
  */
@@ -184,10 +437,14 @@ typedef struct RTFILEAIOCTXINTERNAL
     volatile bool       fWokenUp;
     /** Flag whether the thread is currently waiting in the syscall. */
     volatile bool       fWaiting;
+    /** Flag whether the io_uring interface is used instead of the io_* syscalls. */
+    bool                fIoUring;
     /** Flags given during creation. */
     uint32_t            fFlags;
     /** Magic value (RTFILEAIOCTX_MAGIC). */
     uint32_t            u32Magic;
+    /** The io_uring state, only valid if fIoUring is set. */
+    LNXIOURING          IoUring;
 } RTFILEAIOCTXINTERNAL;
 /** Pointer to an internal context structure. */
 typedef RTFILEAIOCTXINTERNAL *PRTFILEAIOCTXINTERNAL;
@@ -200,6 +457,8 @@ typedef struct RTFILEAIOREQINTERNAL
     /** The aio control block. This must be the FIRST elment in
      *  the structure! (see notes below) */
     LNXKAIOIOCB           AioCB;
+    /** The I/O vector for read and write requests submitted through io_uring. */
+    struct iovec          IoVec;
     /** Current state the request is in. */
     RTFILEAIOREQSTATE     enmState;
     /** The I/O context this request is associated with. */
@@ -293,6 +552,498 @@ DECLINLINE(int) rtFileAsyncIoLinuxGetEvents(LNXKAIOCONTEXT AioContext, long cReq
     return rc;
 }
 
+/**
+ * Unmaps the rings and closes the io_uring file descriptor.
+ *
+ * @returns nothing.
+ * @param   pIoUring    The io_uring state, can be partially initialized.
+ */
+static void rtFileAioLnxUringTerm(PLNXIOURING pIoUring)
+{
+    if (pIoUring->paSqes)
+        munmap(pIoUring->paSqes, pIoUring->cbSqes);
+    if (pIoUring->pvCqRing && pIoUring->cbCqRing)
+        munmap(pIoUring->pvCqRing, pIoUring->cbCqRing);
+    if (pIoUring->pvSqRing)
+        munmap(pIoUring->pvSqRing, pIoUring->cbSqRing);
+    if (pIoUring->iFdUring != -1)
+        close(pIoUring->iFdUring);
+
+    pIoUring->paSqes   = NULL;
+    pIoUring->pvCqRing = NULL;
+    pIoUring->pvSqRing = NULL;
+    pIoUring->iFdUring = -1;
+}
+
+/**
+ * Sets up an io_uring instance and maps the shared rings.
+ *
+ * @returns IPRT status code.
+ * @param   pIoUring    The io_uring state to initialize.
+ * @param   cReqsMax    Maximum number of requests the context should handle.
+ */
+static int rtFileAioLnxUringInit(PLNXIOURING pIoUring, uint32_t cReqsMax)
+{
+    LNXIOURINGPARAMS Params;
+    RT_ZERO(Params);
+    RT_ZERO(*pIoUring);
+    pIoUring->iFdUring = -1;
+
+    /* One extra entry for the timeout request. */
+    uint32_t cEntries = RT_MIN(cReqsMax + 1, LNXIOURING_ENTRIES_MAX);
+    int iFdUring = syscall(__NR_io_uring_setup, cEntries, &Params);
+    if (iFdUring == -1)
+        return RTErrConvertFromErrno(errno);
+    pIoUring->iFdUring = iFdUring;
+
+    /* Completion queue overflows would lose requests on older kernels. */
+    if (!(Params.fFeatures & LNXIOURING_FEAT_NODROP))
+    {
+        rtFileAioLnxUringTerm(pIoUring);
+        return VERR_NOT_SUPPORTED;
+    }
+
+    pIoUring->cbSqRing = Params.SqOffsets.offArray + Params.cSqEntries * sizeof(uint32_t);
+    pIoUring->cbCqRing = Params.CqOffsets.offCqes + Params.cCqEntries * sizeof(LNXIOURINGCQE);
+    pIoUring->cbSqes   = Params.cSqEntries * sizeof(LNXIOURINGSQE);
+    if (Params.fFeatures & LNXIOURING_FEAT_SINGLE_MMAP)
+    {
+        pIoUring->cbSqRing = RT_MAX(pIoUring->cbSqRing, pIoUring->cbCqRing);
+        pIoUring->cbCqRing = 0;
+    }
+
+    int rc = VINF_SUCCESS;
+    void *pv = mmap(NULL, pIoUring->cbSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    iFdUring, LNXIOURING_MMAP_OFF_SQ);
+    if (pv != MAP_FAILED)
+    {
+        pIoUring->pvSqRing = pv;
+        if (pIoUring->cbCqRing)
+        {
+            pv = mmap(NULL, pIoUring->cbCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      iFdUring, LNXIOURING_MMAP_OFF_CQ);
+            if (pv != MAP_FAILED)
+                pIoUring->pvCqRing = pv;
+            else
+                rc = RTErrConvertFromErrno(errno);
+        }
+        else
+            pIoUring->pvCqRing = pIoUring->pvSqRing;
+
+        if (RT_SUCCESS(rc))
+        {
+            pv = mmap(NULL, pIoUring->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      iFdUring, LNXIOURING_MMAP_OFF_SQES);
+            if (pv != MAP_FAILED)
+                pIoUring->paSqes = (PLNXIOURINGSQE)pv;
+            else
+                rc = RTErrConvertFromErrno(errno);
+        }
+    }
+    else
+        rc = RTErrConvertFromErrno(errno);
+
+    if (RT_SUCCESS(rc))
+        rc = RTCritSectInit(&pIoUring->CritSectSq);
+    if (RT_SUCCESS(rc))
+    {
+        uint8_t *pbSqRing = (uint8_t *)pIoUring->pvSqRing;
+        uint8_t *pbCqRing = (uint8_t *)pIoUring->pvCqRing;
+
+        pIoUring->pidxSqHead  = (volatile uint32_t *)(pbSqRing + Params.SqOffsets.offHead);
+        pIoUring->pidxSqTail  = (volatile uint32_t *)(pbSqRing + Params.SqOffsets.offTail);
+        pIoUring->paidxSqes   = (volatile uint32_t *)(pbSqRing + Params.SqOffsets.offArray);
+        pIoUring->fSqRingMask = *(uint32_t *)(pbSqRing + Params.SqOffsets.offRingMask);
+        pIoUring->cSqEntries  = *(uint32_t *)(pbSqRing + Params.SqOffsets.offRingEntries);
+        pIoUring->pidxCqHead  = (volatile uint32_t *)(pbCqRing + Params.CqOffsets.offHead);
+        pIoUring->pidxCqTail  = (volatile uint32_t *)(pbCqRing + Params.CqOffsets.offTail);
+        pIoUring->paCqes      = (PLNXIOURINGCQE)(pbCqRing + Params.CqOffsets.offCqes);
+        pIoUring->fCqRingMask = *(uint32_t *)(pbCqRing + Params.CqOffsets.offRingMask);
+        return VINF_SUCCESS;
+    }
+
+    rtFileAioLnxUringTerm(pIoUring);
+    return rc;
+}
+
+/**
+ * Hands the given number of queued submission queue entries over to the kernel.
+ *
+ * @returns Number of consumed entries (natural number w/ 0), IPRT error code (negative).
+ * @param   pIoUring    The io_uring state.
+ * @param   cToSubmit   Number of entries to submit.
+ */
+DECLINLINE(int) rtFileAioLnxUringEnterSubmit(PLNXIOURING pIoUring, uint32_t cToSubmit)
+{
+    int rc = syscall(__NR_io_uring_enter, pIoUring->iFdUring, cToSubmit, 0, 0, NULL, 0);
+    if (RT_UNLIKELY(rc == -1))
+        return RTErrConvertFromErrno(errno);
+
+    return rc;
+}
+
+/**
+ * Fills a submission queue entry from the given request.
+ *
+ * @returns nothing.
+ * @param   pSqe        The submission queue entry to fill.
+ * @param   pReqInt     The request.
+ */
+DECLINLINE(void) rtFileAioLnxUringSqeFromReq(PLNXIOURINGSQE pSqe, PRTFILEAIOREQINTERNAL pReqInt)
+{
+    RT_ZERO(*pSqe);
+    pSqe->i32Fd   = (int32_t)pReqInt->AioCB.uFileDesc;
+    pSqe->u64User = (uintptr_t)pReqInt;
+
+    if (pReqInt->AioCB.u16IoOpCode == LNXKAIO_IOCB_CMD_FSYNC)
+        pSqe->u8Opc = LNXIOURING_OP_FSYNC;
+    else
+    {
+        pReqInt->IoVec.iov_base = pReqInt->AioCB.pvBuf;
+        pReqInt->IoVec.iov_len  = pReqInt->AioCB.cbTransfer;
+
+        pSqe->u8Opc       =   pReqInt->AioCB.u16IoOpCode == LNXKAIO_IOCB_CMD_READ
+                            ? LNXIOURING_OP_READV
+                            : LNXIOURING_OP_WRITEV;
+        pSqe->u64OffStart = pReqInt->AioCB.off;
+        pSqe->u64AddrBuf  = (uintptr_t)&pReqInt->IoVec;
+        pSqe->u32BufSz    = 1;
+    }
+}
+
+/**
+ * Submits the given requests through the io_uring submission queue.
+ *
+ * @returns IPRT status code.
+ * @param   pCtxInt     The async I/O context, fIoUring must be set.
+ * @param   pahReqs     The already validated requests in the submitted state.
+ * @param   cReqs       Number of requests.
+ */
+static int rtFileAioLnxUringSubmit(PRTFILEAIOCTXINTERNAL pCtxInt, PRTFILEAIOREQ pahReqs, size_t cReqs)
+{
+    PLNXIOURING pIoUring = &pCtxInt->IoUring;
+    int rc = VINF_SUCCESS;
+
+    RTCritSectEnter(&pIoUring->CritSectSq);
+    while (cReqs)
+    {
+        /*
+         * The submission queue is always empty here because there is no kernel side
+         * polling thread, so io_uring_enter() consumes the entries synchronously.
+         */
+        uint32_t const idxSqTail = *pIoUring->pidxSqTail;
+        Assert(idxSqTail == ASMAtomicReadU32(pIoUring->pidxSqHead));
+        uint32_t const cBatch    = (uint32_t)RT_MIN(cReqs, pIoUring->cSqEntries);
+
+        for (uint32_t i = 0; i < cBatch; i++)
+        {
+            uint32_t idxSqe = (idxSqTail + i) & pIoUring->fSqRingMask;
+            rtFileAioLnxUringSqeFromReq(&pIoUring->paSqes[idxSqe], pahReqs[i]);
+            pIoUring->paidxSqes[idxSqe] = idxSqe;
+        }
+        ASMAtomicWriteU32(pIoUring->pidxSqTail, idxSqTail + cBatch);
+
+        rc = rtFileAioLnxUringEnterSubmit(pIoUring, cBatch);
+        int cReqsSubmitted = RT_SUCCESS(rc) ? rc : 0;
+        if (cReqsSubmitted)
+        {
+            cReqs   -= cReqsSubmitted;
+            pahReqs += cReqsSubmitted;
+            ASMAtomicAddS32(&pCtxInt->cRequests, cReqsSubmitted);
+            rc = VINF_SUCCESS;
+        }
+
+        if ((uint32_t)cReqsSubmitted < cBatch)
+        {
+            /* Drop the unconsumed entries from the ring, they get refilled below or reverted. */
+            ASMAtomicWriteU32(pIoUring->pidxSqTail, ASMAtomicReadU32(pIoUring->pidxSqHead));
+            if (!cReqsSubmitted)
+            {
+                if (RT_SUCCESS(rc) || rc == VERR_TRY_AGAIN || rc == VERR_RESOURCE_BUSY)
+                    rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+                break;
+            }
+        }
+    }
+    RTCritSectLeave(&pIoUring->CritSectSq);
+
+    if (RT_FAILURE(rc))
+    {
+        /* Revert the requests we couldn't submit, the first one completes with the error. */
+        for (size_t i = 0; i < cReqs; i++)
+        {
+            PRTFILEAIOREQINTERNAL pReqInt = pahReqs[i];
+            pReqInt->pCtxInt    = NULL;
+            pReqInt->AioContext = 0;
+            RTFILEAIOREQ_SET_STATE(pReqInt, PREPARED);
+        }
+
+        if (rc != VERR_FILE_AIO_INSUFFICIENT_RESSOURCES)
+        {
+            PRTFILEAIOREQINTERNAL pReqInt = pahReqs[0];
+            RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+            pReqInt->Rc = rc;
+            pReqInt->cbTransfered = 0;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * Queues a timeout request on the ring which produces a completion event after
+ * the given amount of time.
+ *
+ * @returns IPRT status code.
+ * @param   pIoUring        The io_uring state.
+ * @param   cMillies        The timeout in milliseconds.
+ * @param   puTimeoutGen    Where to store the generation of the timeout request.
+ */
+static int rtFileAioLnxUringArmTimeout(PLNXIOURING pIoUring, RTMSINTERVAL cMillies, uint64_t *puTimeoutGen)
+{
+    RTCritSectEnter(&pIoUring->CritSectSq);
+
+    uint64_t const uTimeoutGen = ++pIoUring->uTimeoutGen;
+    pIoUring->TimeoutSpec.i64Sec     = cMillies / 1000;
+    pIoUring->TimeoutSpec.i64NanoSec = cMillies % 1000 * 1000000;
+
+    uint32_t const idxSqTail = *pIoUring->pidxSqTail;
+    uint32_t const idxSqe    = idxSqTail & pIoUring->fSqRingMask;
+    PLNXIOURINGSQE pSqe      = &pIoUring->paSqes[idxSqe];
+    RT_ZERO(*pSqe);
+    pSqe->u8Opc      = LNXIOURING_OP_TIMEOUT;
+    pSqe->i32Fd      = -1;
+    pSqe->u64AddrBuf = (uintptr_t)&pIoUring->TimeoutSpec;
+    pSqe->u32BufSz   = 1;
+    pSqe->u64User    = (uTimeoutGen << LNXIOURING_USER_GEN_SHIFT) | LNXIOURING_USER_TIMEOUT;
+    pIoUring->paidxSqes[idxSqe] = idxSqe;
+    ASMAtomicWriteU32(pIoUring->pidxSqTail, idxSqTail + 1);
+
+    int rc = rtFileAioLnxUringEnterSubmit(pIoUring, 1);
+    if (rc == 1)
+    {
+        *puTimeoutGen = uTimeoutGen;
+        rc = VINF_SUCCESS;
+    }
+    else
+    {
+        ASMAtomicWriteU32(pIoUring->pidxSqTail, ASMAtomicReadU32(pIoUring->pidxSqHead));
+        if (RT_SUCCESS(rc))
+            rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+    }
+
+    RTCritSectLeave(&pIoUring->CritSectSq);
+    return rc;
+}
+
+/**
+ * Removes a timeout request queued by rtFileAioLnxUringArmTimeout() which didn't
+ * fire yet, so it can't end a later wait.
+ *
+ * The completion events of the removal and of the removed timeout are posted
+ * right away and skipped when reaping.
+ *
+ * @returns IPRT status code.
+ * @param   pIoUring        The io_uring state.
+ * @param   uTimeoutGen     The generation of the timeout request to remove.
+ */
+static int rtFileAioLnxUringDisarmTimeout(PLNXIOURING pIoUring, uint64_t uTimeoutGen)
+{
+    RTCritSectEnter(&pIoUring->CritSectSq);
+
+    uint32_t const idxSqTail = *pIoUring->pidxSqTail;
+    uint32_t const idxSqe    = idxSqTail & pIoUring->fSqRingMask;
+    PLNXIOURINGSQE pSqe      = &pIoUring->paSqes[idxSqe];
+    RT_ZERO(*pSqe);
+    pSqe->u8Opc      = LNXIOURING_OP_TIMEOUT_REMOVE;
+    pSqe->i32Fd      = -1;
+    pSqe->u64AddrBuf = (uTimeoutGen << LNXIOURING_USER_GEN_SHIFT) | LNXIOURING_USER_TIMEOUT;
+    pSqe->u64User    = LNXIOURING_USER_CANCEL;
+    pIoUring->paidxSqes[idxSqe] = idxSqe;
+    ASMAtomicWriteU32(pIoUring->pidxSqTail, idxSqTail + 1);
+
+    int rc = rtFileAioLnxUringEnterSubmit(pIoUring, 1);
+    if (rc == 1)
+        rc = VINF_SUCCESS;
+    else
+    {
+        ASMAtomicWriteU32(pIoUring->pidxSqTail, ASMAtomicReadU32(pIoUring->pidxSqHead));
+        if (RT_SUCCESS(rc))
+            rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+    }
+
+    RTCritSectLeave(&pIoUring->CritSectSq);
+    return rc;
+}
+
+/**
+ * Queues a cancel request for the given request on the ring.
+ *
+ * @returns IPRT status code.
+ * @param   pIoUring        The io_uring state.
+ * @param   pReqInt         The request to cancel.
+ */
+static int rtFileAioLnxUringCancel(PLNXIOURING pIoUring, PRTFILEAIOREQINTERNAL pReqInt)
+{
+    RTCritSectEnter(&pIoUring->CritSectSq);
+
+    uint32_t const idxSqTail = *pIoUring->pidxSqTail;
+    uint32_t const idxSqe    = idxSqTail & pIoUring->fSqRingMask;
+    PLNXIOURINGSQE pSqe      = &pIoUring->paSqes[idxSqe];
+    RT_ZERO(*pSqe);
+    pSqe->u8Opc      = LNXIOURING_OP_ASYNC_CANCEL;
+    pSqe->i32Fd      = -1;
+    pSqe->u64AddrBuf = (uintptr_t)pReqInt;
+    pSqe->u64User    = LNXIOURING_USER_CANCEL;
+    pIoUring->paidxSqes[idxSqe] = idxSqe;
+    ASMAtomicWriteU32(pIoUring->pidxSqTail, idxSqTail + 1);
+
+    int rc = rtFileAioLnxUringEnterSubmit(pIoUring, 1);
+    if (rc == 1)
+        rc = VINF_SUCCESS;
+    else
+    {
+        ASMAtomicWriteU32(pIoUring->pidxSqTail, ASMAtomicReadU32(pIoUring->pidxSqHead));
+        if (RT_SUCCESS(rc))
+            rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+    }
+
+    RTCritSectLeave(&pIoUring->CritSectSq);
+    return rc;
+}
+
+/**
+ * RTFileAioCtxWait() worker for contexts using io_uring.
+ *
+ * @returns IPRT status code.
+ * @param   pCtxInt     The async I/O context, fIoUring must be set.
+ * @param   cMinReqs    Minimum number of requests to wait for, at least 1.
+ * @param   cMillies    The timeout.
+ * @param   pahReqs     Where to store the completed requests.
+ * @param   cReqs       Size of the array.
+ * @param   pcReqs      Where to store the number of completed requests.
+ */
+static int rtFileAioLnxUringWait(PRTFILEAIOCTXINTERNAL pCtxInt, size_t cMinReqs, RTMSINTERVAL cMillies,
+                                 PRTFILEAIOREQ pahReqs, size_t cReqs, uint32_t *pcReqs)
+{
+    PLNXIOURING pIoUring    = &pCtxInt->IoUring;
+    uint64_t    uTimeoutGen = 0;
+    bool        fTimedOut   = false;
+    int         rc          = VINF_SUCCESS;
+
+    if (   cMillies != RT_INDEFINITE_WAIT
+        && cMillies != 0)
+    {
+        rc = rtFileAioLnxUringArmTimeout(pIoUring, cMillies, &uTimeoutGen);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    /* For the wakeup call. */
+    Assert(pCtxInt->hThreadWait == NIL_RTTHREAD);
+    ASMAtomicWriteHandle(&pCtxInt->hThreadWait, RTThreadSelf());
+
+    uint32_t cRequestsCompleted = 0;
+    while (!pCtxInt->fWokenUp)
+    {
+        /*
+         * Reap everything which is available without entering the kernel.
+         */
+        uint32_t       idxCqHead = *pIoUring->pidxCqHead;
+        uint32_t const idxCqTail = ASMAtomicReadU32(pIoUring->pidxCqTail);
+        while (   idxCqHead != idxCqTail
+               && cRequestsCompleted < cReqs)
+        {
+            PLNXIOURINGCQE pCqe    = &pIoUring->paCqes[idxCqHead & pIoUring->fCqRingMask];
+            uint64_t const u64User = pCqe->u64User;
+            int32_t  const rcLnx   = pCqe->rcLnx;
+            idxCqHead++;
+
+            if (u64User & LNXIOURING_USER_TIMEOUT)
+            {
+                /* Timeouts from previous calls are stale and ignored. */
+                if ((u64User >> LNXIOURING_USER_GEN_SHIFT) == uTimeoutGen)
+                    fTimedOut = true;
+                continue;
+            }
+
+            /* The outcome of a cancel request is reported through the completion of the canceled request. */
+            if (u64User & LNXIOURING_USER_CANCEL)
+                continue;
+
+            PRTFILEAIOREQINTERNAL pReqInt = (PRTFILEAIOREQINTERNAL)(uintptr_t)u64User;
+            AssertPtr(pReqInt);
+            Assert(pReqInt->u32Magic == RTFILEAIOREQ_MAGIC);
+
+            if (RT_UNLIKELY(rcLnx < 0))
+                pReqInt->Rc = rcLnx == -ECANCELED ? VERR_FILE_AIO_CANCELED : RTErrConvertFromErrno(-rcLnx);
+            else
+            {
+                pReqInt->Rc = VINF_SUCCESS;
+                pReqInt->cbTransfered = rcLnx;
+            }
+
+            /* Mark the request as finished. */
+            RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+
+            pahReqs[cRequestsCompleted++] = (RTFILEAIOREQ)pReqInt;
+        }
+        ASMAtomicWriteU32(pIoUring->pidxCqHead, idxCqHead);
+
+        /*
+         * Done yet? If not wait in the kernel for the missing completions.
+         */
+        if (cRequestsCompleted >= cMinReqs)
+            break;
+        if (   fTimedOut
+            || cMillies == 0)
+        {
+            rc = VERR_TIMEOUT;
+            break;
+        }
+
+        ASMAtomicXchgBool(&pCtxInt->fWaiting, true);
+        int rcLnx = syscall(__NR_io_uring_enter, pIoUring->iFdUring, 0, (uint32_t)(cMinReqs - cRequestsCompleted),
+                            LNXIOURING_ENTER_GETEVENTS, NULL, 0);
+        ASMAtomicXchgBool(&pCtxInt->fWaiting, false);
+        if (RT_UNLIKELY(rcLnx == -1))
+        {
+            rc = RTErrConvertFromErrno(errno);
+            break;
+        }
+    }
+
+    /*
+     * A timeout which didn't fire would otherwise end a later wait prematurely.
+     */
+    if (   uTimeoutGen
+        && !fTimedOut)
+    {
+        int rc2 = rtFileAioLnxUringDisarmTimeout(pIoUring, uTimeoutGen);
+        AssertRC(rc2); NOREF(rc2); /* A stale timeout is still ignored by its generation. */
+    }
+
+    /*
+     * Update the context state and set the return value.
+     */
+    *pcReqs = cRequestsCompleted;
+    ASMAtomicSubS32(&pCtxInt->cRequests, cRequestsCompleted);
+    Assert(pCtxInt->hThreadWait == RTThreadSelf());
+    ASMAtomicWriteHandle(&pCtxInt->hThreadWait, NIL_RTTHREAD);
+
+    /*
+     * Clear the wakeup flag and set rc.
+     */
+    if (    pCtxInt->fWokenUp
+        &&  RT_SUCCESS(rc))
+    {
+        ASMAtomicXchgBool(&pCtxInt->fWokenUp, false);
+        rc = VERR_INTERRUPTED;
+    }
+
+    return rc;
+}
+
 RTR3DECL(int) RTFileAioGetLimits(PRTFILEAIOLIMITS pAioLimits)
 {
     int rc = VINF_SUCCESS;
@@ -442,6 +1193,20 @@ RTDECL(int) RTFileAioReqCancel(RTFILEAIOREQ hReq)
     RTFILEAIOREQ_VALID_RETURN(pReqInt);
     RTFILEAIOREQ_STATE_RETURN_RC(pReqInt, SUBMITTED, VERR_FILE_AIO_NOT_SUBMITTED);
 
+    /*
+     * Requests on an io_uring are canceled asynchronously. If the kernel can still
+     * cancel the request it completes through RTFileAioCtxWait() with
+     * VERR_FILE_AIO_CANCELED, otherwise it completes normally. Either way the
+     * caller has to wait for the completion before touching the request again.
+     */
+    if (pReqInt->pCtxInt->fIoUring)
+    {
+        int rc = rtFileAioLnxUringCancel(&pReqInt->pCtxInt->IoUring, pReqInt);
+        if (RT_FAILURE(rc))
+            return rc;
+        return VERR_FILE_AIO_IN_PROGRESS;
+    }
+
     LNXKAIOIOEVENT AioEvent;
     int rc = rtFileAsyncIoLinuxCancel(pReqInt->AioContext, &pReqInt->AioCB, &AioEvent);
     if (RT_SUCCESS(rc))
@@ -495,8 +1260,20 @@ RTDECL(int) RTFileAioCtxCreate(PRTFILEAIOCTX phAioCtx, uint32_t cAioReqsMax,
     if (RT_UNLIKELY(!pCtxInt))
         return VERR_NO_MEMORY;
 
+    /* Try io_uring first if requested and fall back to the io_* syscalls. */
+    int rc = VERR_NOT_SUPPORTED;
+    if (fFlags & RTFILEAIOCTX_FLAGS_PREFER_IO_URING)
+    {
+        rc = rtFileAioLnxUringInit(&pCtxInt->IoUring, cAioReqsMax);
+        if (RT_SUCCESS(rc))
+            pCtxInt->fIoUring = true;
+        else
+            Log(("RTFileAioCtxCreate: io_uring not available (rc=%Rrc), using the io_* interface\n", rc));
+    }
+
     /* Init the event handle. */
-    int rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
+    if (!pCtxInt->fIoUring)
+        rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
     if (RT_SUCCESS(rc))
     {
         pCtxInt->fWokenUp     = false;
@@ -527,9 +1304,17 @@ RTDECL(int) RTFileAioCtxDestroy(RTFILEAIOCTX hAioCtx)
         return VERR_FILE_AIO_BUSY;
 
     /* The native bit first, then mark it as dead and free it. */
-    int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
-    if (RT_FAILURE(rc))
-        return rc;
+    if (pCtxInt->fIoUring)
+    {
+        RTCritSectDelete(&pCtxInt->IoUring.CritSectSq);
+        rtFileAioLnxUringTerm(&pCtxInt->IoUring);
+    }
+    else
+    {
+        int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
     ASMAtomicUoWriteU32(&pCtxInt->u32Magic, RTFILEAIOCTX_MAGIC_DEAD);
     RTMemFree(pCtxInt);
 
@@ -596,6 +1381,9 @@ RTDECL(int) RTFileAioCtxSubmit(RTFILEAIOCTX hAioCtx, PRTFILEAIOREQ pahReqs, size
         RTFILEAIOREQ_SET_STATE(pReqInt, SUBMITTED);
     }
 
+    if (pCtxInt->fIoUring)
+        return rtFileAioLnxUringSubmit(pCtxInt, pahReqs, cReqs);
+
     do
     {
         /*
@@ -673,6 +1461,9 @@ RTDECL(int) RTFileAioCtxWait(RTFILEAIOCTX hAioCtx, size_t cMinReqs, RTMSINTERVAL
         && !(pCtxInt->fFlags & RTFILEAIOCTX_FLAGS_WAIT_WITHOUT_PENDING_REQUESTS))
         return VERR_FILE_AIO_NO_REQUEST;
 
+    if (pCtxInt->fIoUring)
+        return rtFileAioLnxUringWait(pCtxInt, RT_MAX(cMinReqs, 1), cMillies, pahReqs, cReqs, pcReqs);
+
     /*
      * Convert the timeout if specified.
      */
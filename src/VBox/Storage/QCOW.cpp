@@ -29,10 +29,10 @@
 #include <iprt/string.h>
 #include <iprt/alloc.h>
 #include <iprt/path.h>
-#include <iprt/list.h>
 
 #include "VDBackends.h"
 #include "VDBackendsInline.h"
+#include "VDTblCache.h"
 
 /** @page pg_storage_qcow   QCOW Storage Backend
  * The QCOW backend implements support for the qemu copy on write format (short QCOW).
@@ -137,26 +137,6 @@ typedef QCowHeader *PQCowHeader;
 *   Constants And Macros, Structures and Typedefs                                                                                *
 *********************************************************************************************************************************/
 
-/**
- * QCOW L2 cache entry.
- */
-typedef struct QCOWL2CACHEENTRY
-{
-    /** List node for the search list. */
-    RTLISTNODE              NodeSearch;
-    /** List node for the LRU list. */
-    RTLISTNODE              NodeLru;
-    /** Reference counter. */
-    uint32_t                cRefs;
-    /** The offset of the L2 table, used as search key. */
-    uint64_t                offL2Tbl;
-    /** Pointer to the cached L2 table. */
-    uint64_t               *paL2Tbl;
-} QCOWL2CACHEENTRY, *PQCOWL2CACHEENTRY;
-
-/** Maximum amount of memory the cache is allowed to use. */
-#define QCOW_L2_CACHE_MEMORY_MAX (2*_1M)
-
 /** QCOW default cluster size for image version 2. */
 #define QCOW2_CLUSTER_SIZE_DEFAULT (64*_1K)
 /** QCOW default cluster size for image version 1. */
@@ -223,12 +203,8 @@ typedef struct QCOWIMAGE
     uint32_t            cbL2Table;
     /** Number of entries in the L2 table. */
     uint32_t            cL2TableEntries;
-    /** Memory occupied by the L2 table cache. */
-    size_t              cbL2Cache;
-    /** The sorted L2 entry list used for searching. */
-    RTLISTNODE          ListSearch;
-    /** The LRU L2 entry list used for eviction. */
-    RTLISTNODE          ListLru;
+    /** The L2 table cache. */
+    PVDTBLCACHE         pL2TblCache;
 
     /** Offset of the refcount table. */
     uint64_t            offRefcountTable;
@@ -250,7 +226,7 @@ typedef struct QCOWIMAGE
 
     /** Pointer to the L2 table we are currently allocating
      * (can be only one at a time). */
-    PQCOWL2CACHEENTRY   pL2TblAlloc;
+    PVDTBLCACHEENTRY   pL2TblAlloc;
     /** The static region list. */
     VDREGIONLIST        RegionList;
 } QCOWIMAGE, *PQCOWIMAGE;
@@ -290,7 +266,7 @@ typedef struct QCOWCLUSTERASYNCALLOC
     /** Start offset of the allocated cluster. */
     uint64_t                   offClusterNew;
     /** L2 cache entry if a L2 table is allocated. */
-    PQCOWL2CACHEENTRY          pL2Entry;
+    PVDTBLCACHEENTRY          pL2Entry;
     /** Number of bytes to write. */
     size_t                     cbToWrite;
 } QCOWCLUSTERASYNCALLOC, *PQCOWCLUSTERASYNCALLOC;
@@ -458,207 +434,31 @@ static void qcowTableConvertFromHostEndianess(uint64_t *paTblImg, uint64_t *paTb
 }
 
 /**
- * Creates the L2 table cache.
+ * Creates the L2 table cache, it is sized with qcowL2TblCacheSetTblSize() once
+ * the image geometry is known.
  *
  * @returns VBox status code.
  * @param   pImage    The image instance data.
  */
 static int qcowL2TblCacheCreate(PQCOWIMAGE pImage)
 {
-    pImage->cbL2Cache = 0;
-    RTListInit(&pImage->ListSearch);
-    RTListInit(&pImage->ListLru);
-
-    return VINF_SUCCESS;
-}
-
-/**
- * Destroys the L2 table cache.
- *
- * @returns nothing.
- * @param   pImage    The image instance data.
- */
-static void qcowL2TblCacheDestroy(PQCOWIMAGE pImage)
-{
-    PQCOWL2CACHEENTRY pL2Entry;
-    PQCOWL2CACHEENTRY pL2Next;
-    RTListForEachSafe(&pImage->ListSearch, pL2Entry, pL2Next, QCOWL2CACHEENTRY, NodeSearch)
-    {
-        Assert(!pL2Entry->cRefs);
-
-        RTListNodeRemove(&pL2Entry->NodeSearch);
-        RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbL2Table);
-        RTMemFree(pL2Entry);
-    }
-
-    pImage->cbL2Cache       = 0;
-    RTListInit(&pImage->ListSearch);
-    RTListInit(&pImage->ListLru);
-}
-
-/**
- * Returns the L2 table matching the given offset or NULL if none could be found.
- *
- * @returns Pointer to the L2 table cache entry or NULL.
- * @param   pImage    The image instance data.
- * @param   offL2Tbl  Offset of the L2 table to search for.
- */
-static PQCOWL2CACHEENTRY qcowL2TblCacheRetain(PQCOWIMAGE pImage, uint64_t offL2Tbl)
-{
-    if (   pImage->pL2TblAlloc
-        && pImage->pL2TblAlloc->offL2Tbl == offL2Tbl)
-    {
-        pImage->pL2TblAlloc->cRefs++;
-        return pImage->pL2TblAlloc;
-    }
-
-    PQCOWL2CACHEENTRY pL2Entry;
-    RTListForEach(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch)
-    {
-        if (pL2Entry->offL2Tbl == offL2Tbl)
-            break;
-    }
-
-    if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
-    {
-        /* Update LRU list. */
-        RTListNodeRemove(&pL2Entry->NodeLru);
-        RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
-        pL2Entry->cRefs++;
-        return pL2Entry;
-    }
-
-    return NULL;
-}
-
-/**
- * Releases a L2 table cache entry.
- *
- * @returns nothing.
- * @param   pL2Entry    The L2 cache entry.
- */
-static void qcowL2TblCacheEntryRelease(PQCOWL2CACHEENTRY pL2Entry)
-{
-    Assert(pL2Entry->cRefs > 0);
-    pL2Entry->cRefs--;
+    return vdTblCacheCreate(&pImage->pL2TblCache, 0 /* cbTbl */, 0 /* cbTblsTotal */);
 }
 
 /**
- * Allocates a new L2 table from the cache evicting old entries if required.
+ * Sizes the L2 table cache after the amount of L2 tables the image can have.
  *
- * @returns Pointer to the L2 cache entry or NULL.
- * @param   pImage    The image instance data.
- */
-static PQCOWL2CACHEENTRY qcowL2TblCacheEntryAlloc(PQCOWIMAGE pImage)
-{
-    PQCOWL2CACHEENTRY pL2Entry = NULL;
-
-    if (pImage->cbL2Cache + pImage->cbL2Table <= QCOW_L2_CACHE_MEMORY_MAX)
-    {
-        /* Add a new entry. */
-        pL2Entry = (PQCOWL2CACHEENTRY)RTMemAllocZ(sizeof(QCOWL2CACHEENTRY));
-        if (pL2Entry)
-        {
-            pL2Entry->paL2Tbl = (uint64_t *)RTMemPageAllocZ(pImage->cbL2Table);
-            if (RT_UNLIKELY(!pL2Entry->paL2Tbl))
-            {
-                RTMemFree(pL2Entry);
-                pL2Entry = NULL;
-            }
-            else
-            {
-                pL2Entry->cRefs    = 1;
-                pImage->cbL2Cache += pImage->cbL2Table;
-            }
-        }
-    }
-    else
-    {
-        /* Evict the last not in use entry and use it */
-        Assert(!RTListIsEmpty(&pImage->ListLru));
-
-        RTListForEachReverse(&pImage->ListLru, pL2Entry, QCOWL2CACHEENTRY, NodeLru)
-        {
-            if (!pL2Entry->cRefs)
-                break;
-        }
-
-        if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
-        {
-            RTListNodeRemove(&pL2Entry->NodeSearch);
-            RTListNodeRemove(&pL2Entry->NodeLru);
-            pL2Entry->offL2Tbl = 0;
-            pL2Entry->cRefs    = 1;
-        }
-        else
-            pL2Entry = NULL;
-    }
-
-    return pL2Entry;
-}
-
-/**
- * Frees a L2 table cache entry.
- *
- * @returns nothing.
+ * @returns VBox status code.
  * @param   pImage    The image instance data.
- * @param   pL2Entry  The L2 cache entry to free.
  */
-static void qcowL2TblCacheEntryFree(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entry)
+static int qcowL2TblCacheSetTblSize(PQCOWIMAGE pImage)
 {
-    Assert(!pL2Entry->cRefs);
-    RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbL2Table);
-    RTMemFree(pL2Entry);
-
-    pImage->cbL2Cache -= pImage->cbL2Table;
+    return vdTblCacheSetTblSize(pImage->pL2TblCache, pImage->cbL2Table,
+                                (uint64_t)pImage->cL1TableEntries * pImage->cbL2Table);
 }
 
 /**
- * Inserts an entry in the L2 table cache.
- *
- * @returns nothing.
- * @param   pImage    The image instance data.
- * @param   pL2Entry  The L2 cache entry to insert.
- */
-static void qcowL2TblCacheEntryInsert(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entry)
-{
-    Assert(pL2Entry->offL2Tbl > 0);
-
-    /* Insert at the top of the LRU list. */
-    RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
-
-    if (RTListIsEmpty(&pImage->ListSearch))
-    {
-        RTListAppend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-    }
-    else
-    {
-        /* Insert into search list. */
-        PQCOWL2CACHEENTRY pIt;
-        pIt = RTListGetFirst(&pImage->ListSearch, QCOWL2CACHEENTRY, NodeSearch);
-        if (pIt->offL2Tbl > pL2Entry->offL2Tbl)
-            RTListPrepend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-        else
-        {
-            bool fInserted = false;
-
-            RTListForEach(&pImage->ListSearch, pIt, QCOWL2CACHEENTRY, NodeSearch)
-            {
-                Assert(pIt->offL2Tbl != pL2Entry->offL2Tbl);
-                if (pIt->offL2Tbl < pL2Entry->offL2Tbl)
-                {
-                    RTListNodeInsertAfter(&pIt->NodeSearch, &pL2Entry->NodeSearch);
-                    fInserted = true;
-                    break;
-                }
-            }
-            Assert(fInserted);
-        }
-    }
-}
-
-/**
- * Fetches the L2 from the given offset trying the LRU cache first and
+ * Fetches the L2 from the given offset trying the table cache first and
  * reading it from the image after a cache miss.
  *
  * @returns VBox status code.
@@ -668,38 +468,47 @@ static void qcowL2TblCacheEntryInsert(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2En
  * @param   ppL2Entry Where to store the L2 table on success.
  */
 static int qcowL2TblCacheFetch(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, uint64_t offL2Tbl,
-                               PQCOWL2CACHEENTRY *ppL2Entry)
+                               PVDTBLCACHEENTRY *ppL2Entry)
 {
     int rc = VINF_SUCCESS;
 
-    /* Try to fetch the L2 table from the cache first. */
-    PQCOWL2CACHEENTRY pL2Entry = qcowL2TblCacheRetain(pImage, offL2Tbl);
+    /* Try to fetch the L2 table from the cache first, it might be the one we are allocating. */
+    PVDTBLCACHEENTRY pL2Entry = NULL;
+    if (   pImage->pL2TblAlloc
+        && pImage->pL2TblAlloc->offTbl == offL2Tbl)
+    {
+        pL2Entry = pImage->pL2TblAlloc;
+        vdTblCacheEntryRetain(pL2Entry);
+    }
+    else
+        pL2Entry = vdTblCacheRetain(pImage->pL2TblCache, offL2Tbl);
+
     if (!pL2Entry)
     {
-        pL2Entry = qcowL2TblCacheEntryAlloc(pImage);
+        pL2Entry = vdTblCacheEntryAlloc(pImage->pL2TblCache);
 
         if (pL2Entry)
         {
             /* Read from the image. */
             PVDMETAXFER pMetaXfer;
 
-            pL2Entry->offL2Tbl = offL2Tbl;
+            pL2Entry->offTbl = offL2Tbl;
             rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
-                                       offL2Tbl, pL2Entry->paL2Tbl,
+                                       offL2Tbl, pL2Entry->paTbl,
                                        pImage->cbL2Table, pIoCtx,
                                        &pMetaXfer, NULL, NULL);
             if (RT_SUCCESS(rc))
             {
                 vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
 #if defined(RT_LITTLE_ENDIAN)
-                qcowTableConvertToHostEndianess(pL2Entry->paL2Tbl, pImage->cL2TableEntries);
+                qcowTableConvertToHostEndianess(pL2Entry->paTbl, pImage->cL2TableEntries);
 #endif
-                qcowL2TblCacheEntryInsert(pImage, pL2Entry);
+                vdTblCacheEntryInsert(pImage->pL2TblCache, pL2Entry);
             }
             else
             {
-                qcowL2TblCacheEntryRelease(pL2Entry);
-                qcowL2TblCacheEntryFree(pImage, pL2Entry);
+                vdTblCacheEntryRelease(pL2Entry);
+                vdTblCacheEntryFree(pImage->pL2TblCache, pL2Entry);
             }
         }
         else
@@ -820,15 +629,15 @@ static int qcowConvertToImageOffset(PQCOWIMAGE pImage, PVDIOCTX pIoCtx,
 
     if (pImage->paL1Table[idxL1])
     {
-        PQCOWL2CACHEENTRY pL2Entry;
+        PVDTBLCACHEENTRY pL2Entry;
 
         rc = qcowL2TblCacheFetch(pImage, pIoCtx, pImage->paL1Table[idxL1], &pL2Entry);
         if (RT_SUCCESS(rc))
         {
             /* Get real file offset. */
-            if (pL2Entry->paL2Tbl[idxL2])
+            if (pL2Entry->paTbl[idxL2])
             {
-                uint64_t off = pL2Entry->paL2Tbl[idxL2];
+                uint64_t off = pL2Entry->paTbl[idxL2];
 
                 /* Strip flags */
                 if (pImage->uVersion == 2)
@@ -851,7 +660,7 @@ static int qcowConvertToImageOffset(PQCOWIMAGE pImage, PVDIOCTX pIoCtx,
             else
                 rc = VERR_VD_BLOCK_FREE;
 
-            qcowL2TblCacheEntryRelease(pL2Entry);
+            vdTblCacheEntryRelease(pL2Entry);
         }
     }
 
@@ -977,7 +786,8 @@ static int qcowFreeImage(PQCOWIMAGE pImage, bool fDelete)
             pImage->pszBackingFilename = NULL;
         }
 
-        qcowL2TblCacheDestroy(pImage);
+        vdTblCacheDestroy(pImage->pL2TblCache);
+        pImage->pL2TblCache = NULL;
 
         if (fDelete && pImage->pszFilename)
             vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
@@ -1228,6 +1038,15 @@ static int qcowOpenImage(PQCOWIMAGE pImage, unsigned uOpenFlags)
                        N_("Qcow: Creating the L2 table cache for image '%s' failed"),
                        pImage->pszFilename);
 
+    if (RT_SUCCESS(rc))
+    {
+        rc = qcowL2TblCacheSetTblSize(pImage);
+        if (RT_FAILURE(rc))
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           N_("QCow: Sizing the L2 table cache for image '%s' failed"),
+                           pImage->pszFilename);
+    }
+
     if (RT_SUCCESS(rc))
     {
         PVDREGIONDESC pRegion = &pImage->RegionList.aRegions[0];
@@ -1299,10 +1118,12 @@ static int qcowCreateImage(PQCOWIMAGE pImage, uint64_t cbSize,
                 pImage->paL1Table = (uint64_t *)RTMemAllocZ(pImage->cbL1Table);
                 if (RT_LIKELY(pImage->paL1Table))
                 {
+                    rc = qcowL2TblCacheSetTblSize(pImage);
                     if (RT_SUCCESS(rc))
                         vdIfProgress(pIfProgress, uPercentStart + uPercentSpan * 98 / 100);
 
-                    rc = qcowFlushImage(pImage);
+                    if (RT_SUCCESS(rc))
+                        rc = qcowFlushImage(pImage);
                     if (RT_SUCCESS(rc))
                         rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pImage->offNextCluster);
                 }
@@ -1366,18 +1187,18 @@ static int qcowAsyncClusterAllocRollback(PQCOWIMAGE pImage, PVDIOCTX pIoCtx, PQC
 
             /* Assumption right now is that the L1 table is not modified on storage if the link fails. */
             rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pClusterAlloc->offNextClusterOld);
-            qcowL2TblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
             Assert(!pClusterAlloc->pL2Entry->cRefs);
-            qcowL2TblCacheEntryFree(pImage, pClusterAlloc->pL2Entry); /* Free it, it is not in the cache yet. */
+            vdTblCacheEntryFree(pImage->pL2TblCache, pClusterAlloc->pL2Entry); /* Free it, it is not in the cache yet. */
             break;
         }
         case QCOWCLUSTERASYNCALLOCSTATE_USER_ALLOC:
         case QCOWCLUSTERASYNCALLOCSTATE_USER_LINK:
         {
             /* Assumption right now is that the L2 table is not modified if the link fails. */
-            pClusterAlloc->pL2Entry->paL2Tbl[pClusterAlloc->idxL2] = 0;
+            pClusterAlloc->pL2Entry->paTbl[pClusterAlloc->idxL2] = 0;
             rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pClusterAlloc->offNextClusterOld);
-            qcowL2TblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
             break;
         }
         default:
@@ -1414,7 +1235,7 @@ static DECLCALLBACK(int) qcowAsyncClusterAllocUpdate(void *pBackendData, PVDIOCT
         case QCOWCLUSTERASYNCALLOCSTATE_L2_ALLOC:
         {
             /* Update the link in the in memory L1 table now. */
-            pImage->paL1Table[pClusterAlloc->idxL1] = pClusterAlloc->pL2Entry->offL2Tbl;
+            pImage->paL1Table[pClusterAlloc->idxL1] = pClusterAlloc->pL2Entry->offTbl;
 
             /* Update the link in the on disk L1 table now. */
             pClusterAlloc->enmAllocState = QCOWCLUSTERASYNCALLOCSTATE_L2_LINK;
@@ -1438,7 +1259,7 @@ static DECLCALLBACK(int) qcowAsyncClusterAllocUpdate(void *pBackendData, PVDIOCT
             uint64_t offData = qcowClusterAllocate(pImage, 1);
 
             pImage->pL2TblAlloc = NULL;
-            qcowL2TblCacheEntryInsert(pImage, pClusterAlloc->pL2Entry);
+            vdTblCacheEntryInsert(pImage->pL2TblCache, pClusterAlloc->pL2Entry);
 
             pClusterAlloc->enmAllocState     = QCOWCLUSTERASYNCALLOCSTATE_USER_ALLOC;
             pClusterAlloc->offNextClusterOld = offData;
@@ -1461,11 +1282,11 @@ static DECLCALLBACK(int) qcowAsyncClusterAllocUpdate(void *pBackendData, PVDIOCT
         case QCOWCLUSTERASYNCALLOCSTATE_USER_ALLOC:
         {
             pClusterAlloc->enmAllocState = QCOWCLUSTERASYNCALLOCSTATE_USER_LINK;
-            pClusterAlloc->pL2Entry->paL2Tbl[pClusterAlloc->idxL2] = pClusterAlloc->offClusterNew;
+            pClusterAlloc->pL2Entry->paTbl[pClusterAlloc->idxL2] = pClusterAlloc->offClusterNew;
 
             /* Link L2 table and update it. */
             rc = qcowTblWrite(pImage, pIoCtx, pImage->paL1Table[pClusterAlloc->idxL1],
-                              pClusterAlloc->pL2Entry->paL2Tbl,
+                              pClusterAlloc->pL2Entry->paTbl,
                               pImage->cbL2Table, pImage->cL2TableEntries,
                               qcowAsyncClusterAllocUpdate, pClusterAlloc);
             if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
@@ -1481,7 +1302,7 @@ static DECLCALLBACK(int) qcowAsyncClusterAllocUpdate(void *pBackendData, PVDIOCT
         case QCOWCLUSTERASYNCALLOCSTATE_USER_LINK:
         {
             /* Everything done without errors, signal completion. */
-            qcowL2TblCacheEntryRelease(pClusterAlloc->pL2Entry);
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry);
             RTMemFree(pClusterAlloc);
             rc = VINF_SUCCESS;
             break;
@@ -1768,7 +1589,7 @@ static DECLCALLBACK(int) qcowWrite(void *pBackendData, uint64_t uOffset, size_t
             if (   cbToWrite == pImage->cbCluster
                 && !(fWrite & VD_WRITE_NO_ALLOC))
             {
-                PQCOWL2CACHEENTRY pL2Entry = NULL;
+                PVDTBLCACHEENTRY pL2Entry = NULL;
 
                 /* Full cluster write to previously unallocated cluster.
                  * Allocate cluster and write data. */
@@ -1790,7 +1611,7 @@ static DECLCALLBACK(int) qcowWrite(void *pBackendData, uint64_t uOffset, size_t
                             break;
                         }
 
-                        pL2Entry = qcowL2TblCacheEntryAlloc(pImage);
+                        pL2Entry = vdTblCacheEntryAlloc(pImage->pL2TblCache);
                         if (!pL2Entry)
                         {
                             rc = VERR_NO_MEMORY;
@@ -1799,8 +1620,8 @@ static DECLCALLBACK(int) qcowWrite(void *pBackendData, uint64_t uOffset, size_t
                         }
 
                         offL2Tbl = qcowClusterAllocate(pImage, qcowByte2Cluster(pImage, pImage->cbL2Table));
-                        pL2Entry->offL2Tbl = offL2Tbl;
-                        memset(pL2Entry->paL2Tbl, 0, pImage->cbL2Table);
+                        pL2Entry->offTbl = offL2Tbl;
+                        memset(pL2Entry->paTbl, 0, pImage->cbL2Table);
 
                         pL2ClusterAlloc->enmAllocState     = QCOWCLUSTERASYNCALLOCSTATE_L2_ALLOC;
                         pL2ClusterAlloc->offNextClusterOld = offL2Tbl;
@@ -1820,14 +1641,16 @@ static DECLCALLBACK(int) qcowWrite(void *pBackendData, uint64_t uOffset, size_t
                          * is a leak of some clusters.
                          */
                         rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
-                                                    offL2Tbl, pL2Entry->paL2Tbl, pImage->cbL2Table, pIoCtx,
+                                                    offL2Tbl, pL2Entry->paTbl, pImage->cbL2Table, pIoCtx,
                                                     qcowAsyncClusterAllocUpdate, pL2ClusterAlloc);
                         if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
                             break;
                         else if (RT_FAILURE(rc))
                         {
                             RTMemFree(pL2ClusterAlloc);
-                            qcowL2TblCacheEntryFree(pImage, pL2Entry);
+                            pImage->pL2TblAlloc = NULL;
+                            vdTblCacheEntryRelease(pL2Entry);
+                            vdTblCacheEntryFree(pImage->pL2TblCache, pL2Entry);
                             break;
                         }
 
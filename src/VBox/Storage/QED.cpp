@@ -29,10 +29,10 @@
 #include <iprt/string.h>
 #include <iprt/alloc.h>
 #include <iprt/path.h>
-#include <iprt/list.h>
 
 #include "VDBackends.h"
 #include "VDBackendsInline.h"
+#include "VDTblCache.h"
 
 /**
  * The QED backend implements support for the qemu enhanced disk format (short QED)
@@ -126,26 +126,6 @@ typedef QedHeader *PQedHeader;
 *   Constants And Macros, Structures and Typedefs                                                                                *
 *********************************************************************************************************************************/
 
-/**
- * QED L2 cache entry.
- */
-typedef struct QEDL2CACHEENTRY
-{
-    /** List node for the search list. */
-    RTLISTNODE              NodeSearch;
-    /** List node for the LRU list. */
-    RTLISTNODE              NodeLru;
-    /** Reference counter. */
-    uint32_t                cRefs;
-    /** The offset of the L2 table, used as search key. */
-    uint64_t                offL2Tbl;
-    /** Pointer to the cached L2 table. */
-    uint64_t               *paL2Tbl;
-} QEDL2CACHEENTRY, *PQEDL2CACHEENTRY;
-
-/** Maximum amount of memory the cache is allowed to use. */
-#define QED_L2_CACHE_MEMORY_MAX (2*_1M)
-
 /**
  * QED image data structure.
  */
@@ -209,14 +189,10 @@ typedef struct QEDIMAGE
 
     /** Pointer to the L2 table we are currently allocating
      * (can be only one at a time). */
-    PQEDL2CACHEENTRY    pL2TblAlloc;
-
-    /** Memory occupied by the L2 table cache. */
-    size_t              cbL2Cache;
-    /** The sorted L2 entry list used for searching. */
-    RTLISTNODE          ListSearch;
-    /** The LRU L2 entry list used for eviction. */
-    RTLISTNODE          ListLru;
+    PVDTBLCACHEENTRY    pL2TblAlloc;
+
+    /** The L2 table cache. */
+    PVDTBLCACHE         pL2TblCache;
     /** The static region list. */
     VDREGIONLIST        RegionList;
 } QEDIMAGE, *PQEDIMAGE;
@@ -256,7 +232,7 @@ typedef struct QEDCLUSTERASYNCALLOC
     /** Start offset of the allocated cluster. */
     uint64_t                  offClusterNew;
     /** L2 cache entry if a L2 table is allocated. */
-    PQEDL2CACHEENTRY          pL2Entry;
+    PVDTBLCACHEENTRY          pL2Entry;
     /** Number of bytes to write. */
     size_t                    cbToWrite;
 } QEDCLUSTERASYNCALLOC, *PQEDCLUSTERASYNCALLOC;
@@ -376,207 +352,33 @@ static void qedTableConvertFromHostEndianess(uint64_t *paTblImg, uint64_t *paTbl
 #endif
 
 /**
- * Creates the L2 table cache.
+ * Creates the L2 table cache, it is sized with qedL2TblCacheSetTblSize() once
+ * the image geometry is known.
  *
  * @returns VBox status code.
  * @param   pImage    The image instance data.
  */
 static int qedL2TblCacheCreate(PQEDIMAGE pImage)
 {
-    pImage->cbL2Cache = 0;
-    RTListInit(&pImage->ListSearch);
-    RTListInit(&pImage->ListLru);
-
-    return VINF_SUCCESS;
-}
-
-/**
- * Destroys the L2 table cache.
- *
- * @returns nothing.
- * @param   pImage    The image instance data.
- */
-static void qedL2TblCacheDestroy(PQEDIMAGE pImage)
-{
-    PQEDL2CACHEENTRY pL2Entry;
-    PQEDL2CACHEENTRY pL2Next;
-    RTListForEachSafe(&pImage->ListSearch, pL2Entry, pL2Next, QEDL2CACHEENTRY, NodeSearch)
-    {
-        Assert(!pL2Entry->cRefs);
-
-        RTListNodeRemove(&pL2Entry->NodeSearch);
-        RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbTable);
-        RTMemFree(pL2Entry);
-    }
-
-    pImage->cbL2Cache       = 0;
-    RTListInit(&pImage->ListSearch);
-    RTListInit(&pImage->ListLru);
-}
-
-/**
- * Returns the L2 table matching the given offset or NULL if none could be found.
- *
- * @returns Pointer to the L2 table cache entry or NULL.
- * @param   pImage    The image instance data.
- * @param   offL2Tbl  Offset of the L2 table to search for.
- */
-static PQEDL2CACHEENTRY qedL2TblCacheRetain(PQEDIMAGE pImage, uint64_t offL2Tbl)
-{
-    if (   pImage->pL2TblAlloc
-        && pImage->pL2TblAlloc->offL2Tbl == offL2Tbl)
-    {
-        pImage->pL2TblAlloc->cRefs++;
-        return pImage->pL2TblAlloc;
-    }
-
-    PQEDL2CACHEENTRY pL2Entry;
-    RTListForEach(&pImage->ListSearch, pL2Entry, QEDL2CACHEENTRY, NodeSearch)
-    {
-        if (pL2Entry->offL2Tbl == offL2Tbl)
-            break;
-    }
-
-    if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QEDL2CACHEENTRY, NodeSearch))
-    {
-        /* Update LRU list. */
-        RTListNodeRemove(&pL2Entry->NodeLru);
-        RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
-        pL2Entry->cRefs++;
-        return pL2Entry;
-    }
-    else
-        return NULL;
-}
-
-/**
- * Releases a L2 table cache entry.
- *
- * @returns nothing.
- * @param   pL2Entry    The L2 cache entry.
- */
-static void qedL2TblCacheEntryRelease(PQEDL2CACHEENTRY pL2Entry)
-{
-    Assert(pL2Entry->cRefs > 0);
-    pL2Entry->cRefs--;
-}
-
-/**
- * Allocates a new L2 table from the cache evicting old entries if required.
- *
- * @returns Pointer to the L2 cache entry or NULL.
- * @param   pImage    The image instance data.
- */
-static PQEDL2CACHEENTRY qedL2TblCacheEntryAlloc(PQEDIMAGE pImage)
-{
-    PQEDL2CACHEENTRY pL2Entry = NULL;
-
-    if (pImage->cbL2Cache + pImage->cbTable <= QED_L2_CACHE_MEMORY_MAX)
-    {
-        /* Add a new entry. */
-        pL2Entry = (PQEDL2CACHEENTRY)RTMemAllocZ(sizeof(QEDL2CACHEENTRY));
-        if (pL2Entry)
-        {
-            pL2Entry->paL2Tbl = (uint64_t *)RTMemPageAllocZ(pImage->cbTable);
-            if (RT_UNLIKELY(!pL2Entry->paL2Tbl))
-            {
-                RTMemFree(pL2Entry);
-                pL2Entry = NULL;
-            }
-            else
-            {
-                pL2Entry->cRefs    = 1;
-                pImage->cbL2Cache += pImage->cbTable;
-            }
-        }
-    }
-    else
-    {
-        /* Evict the last not in use entry and use it */
-        Assert(!RTListIsEmpty(&pImage->ListLru));
-
-        RTListForEachReverse(&pImage->ListLru, pL2Entry, QEDL2CACHEENTRY, NodeLru)
-        {
-            if (!pL2Entry->cRefs)
-                break;
-        }
-
-        if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QEDL2CACHEENTRY, NodeSearch))
-        {
-            RTListNodeRemove(&pL2Entry->NodeSearch);
-            RTListNodeRemove(&pL2Entry->NodeLru);
-            pL2Entry->offL2Tbl = 0;
-            pL2Entry->cRefs    = 1;
-        }
-        else
-            pL2Entry = NULL;
-    }
-
-    return pL2Entry;
-}
-
-/**
- * Frees a L2 table cache entry.
- *
- * @returns nothing.
- * @param   pImage    The image instance data.
- * @param   pL2Entry  The L2 cache entry to free.
- */
-static void qedL2TblCacheEntryFree(PQEDIMAGE pImage, PQEDL2CACHEENTRY pL2Entry)
-{
-    Assert(!pL2Entry->cRefs);
-    RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbTable);
-    RTMemFree(pL2Entry);
-
-    pImage->cbL2Cache -= pImage->cbTable;
+    return vdTblCacheCreate(&pImage->pL2TblCache, 0 /* cbTbl */, 0 /* cbTblsTotal */);
 }
 
 /**
- * Inserts an entry in the L2 table cache.
+ * Sizes the L2 table cache after the amount of L2 tables the image can have.
  *
- * @returns nothing.
+ * @returns VBox status code.
  * @param   pImage    The image instance data.
- * @param   pL2Entry  The L2 cache entry to insert.
  */
-static void qedL2TblCacheEntryInsert(PQEDIMAGE pImage, PQEDL2CACHEENTRY pL2Entry)
+static int qedL2TblCacheSetTblSize(PQEDIMAGE pImage)
 {
-    Assert(pL2Entry->offL2Tbl > 0);
-
-    /* Insert at the top of the LRU list. */
-    RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
+    uint64_t cbL2Covered = (uint64_t)pImage->cTableEntries * pImage->cbCluster;
+    uint64_t cL2Tbls     = (pImage->cbSize + cbL2Covered - 1) / cbL2Covered;
 
-    if (RTListIsEmpty(&pImage->ListSearch))
-    {
-        RTListAppend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-    }
-    else
-    {
-        /* Insert into search list. */
-        PQEDL2CACHEENTRY pIt;
-        pIt = RTListGetFirst(&pImage->ListSearch, QEDL2CACHEENTRY, NodeSearch);
-        if (pIt->offL2Tbl > pL2Entry->offL2Tbl)
-            RTListPrepend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-        else
-        {
-            bool fInserted = false;
-
-            RTListForEach(&pImage->ListSearch, pIt, QEDL2CACHEENTRY, NodeSearch)
-            {
-                Assert(pIt->offL2Tbl != pL2Entry->offL2Tbl);
-                if (pIt->offL2Tbl < pL2Entry->offL2Tbl)
-                {
-                    RTListNodeInsertAfter(&pIt->NodeSearch, &pL2Entry->NodeSearch);
-                    fInserted = true;
-                    break;
-                }
-            }
-            Assert(fInserted);
-        }
-    }
+    return vdTblCacheSetTblSize(pImage->pL2TblCache, pImage->cbTable, cL2Tbls * pImage->cbTable);
 }
 
 /**
- * Fetches the L2 from the given offset trying the LRU cache first and
+ * Fetches the L2 from the given offset trying the table cache first and
  * reading it from the image after a cache miss - version for async I/O.
  *
  * @returns VBox status code.
@@ -586,38 +388,47 @@ static void qedL2TblCacheEntryInsert(PQEDIMAGE pImage, PQEDL2CACHEENTRY pL2Entry
  * @param   ppL2Entry Where to store the L2 table on success.
  */
 static int qedL2TblCacheFetchAsync(PQEDIMAGE pImage, PVDIOCTX pIoCtx,
-                                   uint64_t offL2Tbl, PQEDL2CACHEENTRY *ppL2Entry)
+                                   uint64_t offL2Tbl, PVDTBLCACHEENTRY *ppL2Entry)
 {
     int rc = VINF_SUCCESS;
 
-    /* Try to fetch the L2 table from the cache first. */
-    PQEDL2CACHEENTRY pL2Entry = qedL2TblCacheRetain(pImage, offL2Tbl);
+    /* Try to fetch the L2 table from the cache first, it might be the one we are allocating. */
+    PVDTBLCACHEENTRY pL2Entry = NULL;
+    if (   pImage->pL2TblAlloc
+        && pImage->pL2TblAlloc->offTbl == offL2Tbl)
+    {
+        pL2Entry = pImage->pL2TblAlloc;
+        vdTblCacheEntryRetain(pL2Entry);
+    }
+    else
+        pL2Entry = vdTblCacheRetain(pImage->pL2TblCache, offL2Tbl);
+
     if (!pL2Entry)
     {
-        pL2Entry = qedL2TblCacheEntryAlloc(pImage);
+        pL2Entry = vdTblCacheEntryAlloc(pImage->pL2TblCache);
 
         if (pL2Entry)
         {
             /* Read from the image. */
             PVDMETAXFER pMetaXfer;
 
-            pL2Entry->offL2Tbl = offL2Tbl;
+            pL2Entry->offTbl = offL2Tbl;
             rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
-                                       offL2Tbl, pL2Entry->paL2Tbl,
+                                       offL2Tbl, pL2Entry->paTbl,
                                        pImage->cbTable, pIoCtx,
                                        &pMetaXfer, NULL, NULL);
             if (RT_SUCCESS(rc))
             {
                 vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
 #if defined(RT_BIG_ENDIAN)
-                qedTableConvertToHostEndianess(pL2Entry->paL2Tbl, pImage->cTableEntries);
+                qedTableConvertToHostEndianess(pL2Entry->paTbl, pImage->cTableEntries);
 #endif
-                qedL2TblCacheEntryInsert(pImage, pL2Entry);
+                vdTblCacheEntryInsert(pImage->pL2TblCache, pL2Entry);
             }
             else
             {
-                qedL2TblCacheEntryRelease(pL2Entry);
-                qedL2TblCacheEntryFree(pImage, pL2Entry);
+                vdTblCacheEntryRelease(pL2Entry);
+                vdTblCacheEntryFree(pImage->pL2TblCache, pL2Entry);
             }
         }
         else
@@ -758,19 +569,19 @@ static int qedConvertToImageOffset(PQEDIMAGE pImage, PVDIOCTX pIoCtx,
 
     if (pImage->paL1Table[idxL1])
     {
-        PQEDL2CACHEENTRY pL2Entry;
+        PVDTBLCACHEENTRY pL2Entry;
 
         rc = qedL2TblCacheFetchAsync(pImage, pIoCtx, pImage->paL1Table[idxL1],
                                      &pL2Entry);
         if (RT_SUCCESS(rc))
         {
             /* Get real file offset. */
-            if (pL2Entry->paL2Tbl[idxL2])
-                *poffImage = pL2Entry->paL2Tbl[idxL2] + offCluster;
+            if (pL2Entry->paTbl[idxL2])
+                *poffImage = pL2Entry->paTbl[idxL2] + offCluster;
             else
                 rc = VERR_VD_BLOCK_FREE;
 
-            qedL2TblCacheEntryRelease(pL2Entry);
+            vdTblCacheEntryRelease(pL2Entry);
         }
     }
 
@@ -1110,7 +921,8 @@ static int qedFreeImage(PQEDIMAGE pImage, bool fDelete)
             pImage->pszBackingFilename = NULL;
         }
 
-        qedL2TblCacheDestroy(pImage);
+        vdTblCacheDestroy(pImage->pL2TblCache);
+        pImage->pL2TblCache = NULL;
 
         if (fDelete && pImage->pszFilename)
             vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
@@ -1243,6 +1055,15 @@ static int qedOpenImage(PQEDIMAGE pImage, unsigned uOpenFlags)
                        N_("Qed: Creating the L2 table cache for image '%s' failed"),
                        pImage->pszFilename);
 
+    if (RT_SUCCESS(rc))
+    {
+        rc = qedL2TblCacheSetTblSize(pImage);
+        if (RT_FAILURE(rc))
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           N_("Qed: Sizing the L2 table cache for image '%s' failed"),
+                           pImage->pszFilename);
+    }
+
     if (RT_SUCCESS(rc))
     {
         PVDREGIONDESC pRegion = &pImage->RegionList.aRegions[0];
@@ -1309,8 +1130,12 @@ static int qedCreateImage(PQEDIMAGE pImage, uint64_t cbSize,
                 pImage->paL1Table = (uint64_t *)RTMemAllocZ(pImage->cbTable);
                 if (RT_LIKELY(pImage->paL1Table))
                 {
-                    vdIfProgress(pIfProgress, uPercentStart + uPercentSpan * 98 / 100);
-                    rc = qedFlushImage(pImage);
+                    rc = qedL2TblCacheSetTblSize(pImage);
+                    if (RT_SUCCESS(rc))
+                    {
+                        vdIfProgress(pIfProgress, uPercentStart + uPercentSpan * 98 / 100);
+                        rc = qedFlushImage(pImage);
+                    }
                 }
                 else
                     rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS, N_("Qed: cannot allocate memory for L1 table of image '%s'"),
@@ -1372,18 +1197,18 @@ static int qedAsyncClusterAllocRollback(PQEDIMAGE pImage, PVDIOCTX pIoCtx, PQEDC
 
             /* Assumption right now is that the L1 table is not modified on storage if the link fails. */
             rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pClusterAlloc->cbImageOld);
-            qedL2TblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
             Assert(!pClusterAlloc->pL2Entry->cRefs);
-            qedL2TblCacheEntryFree(pImage, pClusterAlloc->pL2Entry); /* Free it, it is not in the cache yet. */
+            vdTblCacheEntryFree(pImage->pL2TblCache, pClusterAlloc->pL2Entry); /* Free it, it is not in the cache yet. */
             break;
         }
         case QEDCLUSTERASYNCALLOCSTATE_USER_ALLOC:
         case QEDCLUSTERASYNCALLOCSTATE_USER_LINK:
         {
             /* Assumption right now is that the L2 table is not modified if the link fails. */
-            pClusterAlloc->pL2Entry->paL2Tbl[pClusterAlloc->idxL2] = 0;
+            pClusterAlloc->pL2Entry->paTbl[pClusterAlloc->idxL2] = 0;
             rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pClusterAlloc->cbImageOld);
-            qedL2TblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry); /* Release L2 cache entry. */
             break;
         }
         default:
@@ -1420,7 +1245,7 @@ static DECLCALLBACK(int) qedAsyncClusterAllocUpdate(void *pBackendData, PVDIOCTX
         case QEDCLUSTERASYNCALLOCSTATE_L2_ALLOC:
         {
             /* Update the link in the in memory L1 table now. */
-            pImage->paL1Table[pClusterAlloc->idxL1] = pClusterAlloc->pL2Entry->offL2Tbl;
+            pImage->paL1Table[pClusterAlloc->idxL1] = pClusterAlloc->pL2Entry->offTbl;
 
             /* Update the link in the on disk L1 table now. */
             pClusterAlloc->enmAllocState = QEDCLUSTERASYNCALLOCSTATE_L2_LINK;
@@ -1442,7 +1267,7 @@ static DECLCALLBACK(int) qedAsyncClusterAllocUpdate(void *pBackendData, PVDIOCTX
             uint64_t offData = qedClusterAllocate(pImage, 1);
 
             pImage->pL2TblAlloc = NULL;
-            qedL2TblCacheEntryInsert(pImage, pClusterAlloc->pL2Entry);
+            vdTblCacheEntryInsert(pImage->pL2TblCache, pClusterAlloc->pL2Entry);
 
             pClusterAlloc->enmAllocState = QEDCLUSTERASYNCALLOCSTATE_USER_ALLOC;
             pClusterAlloc->cbImageOld    = offData;
@@ -1465,11 +1290,11 @@ static DECLCALLBACK(int) qedAsyncClusterAllocUpdate(void *pBackendData, PVDIOCTX
         case QEDCLUSTERASYNCALLOCSTATE_USER_ALLOC:
         {
             pClusterAlloc->enmAllocState = QEDCLUSTERASYNCALLOCSTATE_USER_LINK;
-            pClusterAlloc->pL2Entry->paL2Tbl[pClusterAlloc->idxL2] = pClusterAlloc->offClusterNew;
+            pClusterAlloc->pL2Entry->paTbl[pClusterAlloc->idxL2] = pClusterAlloc->offClusterNew;
 
             /* Link L2 table and update it. */
             rc = qedTblWrite(pImage, pIoCtx, pImage->paL1Table[pClusterAlloc->idxL1],
-                             pClusterAlloc->pL2Entry->paL2Tbl,
+                             pClusterAlloc->pL2Entry->paTbl,
                              qedAsyncClusterAllocUpdate, pClusterAlloc);
             if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
                 break;
@@ -1484,7 +1309,7 @@ static DECLCALLBACK(int) qedAsyncClusterAllocUpdate(void *pBackendData, PVDIOCTX
         case QEDCLUSTERASYNCALLOCSTATE_USER_LINK:
         {
             /* Everything done without errors, signal completion. */
-            qedL2TblCacheEntryRelease(pClusterAlloc->pL2Entry);
+            vdTblCacheEntryRelease(pClusterAlloc->pL2Entry);
             RTMemFree(pClusterAlloc);
             rc = VINF_SUCCESS;
             break;
@@ -1773,7 +1598,7 @@ static DECLCALLBACK(int) qedWrite(void *pBackendData, uint64_t uOffset, size_t c
             if (   cbToWrite == pImage->cbCluster
                 && !(fWrite & VD_WRITE_NO_ALLOC))
             {
-                PQEDL2CACHEENTRY pL2Entry = NULL;
+                PVDTBLCACHEENTRY pL2Entry = NULL;
 
                 /* Full cluster write to previously unallocated cluster.
                  * Allocate cluster and write data. */
@@ -1795,7 +1620,7 @@ static DECLCALLBACK(int) qedWrite(void *pBackendData, uint64_t uOffset, size_t c
                             break;
                         }
 
-                        pL2Entry = qedL2TblCacheEntryAlloc(pImage);
+                        pL2Entry = vdTblCacheEntryAlloc(pImage->pL2TblCache);
                         if (!pL2Entry)
                         {
                             rc = VERR_NO_MEMORY;
@@ -1804,8 +1629,8 @@ static DECLCALLBACK(int) qedWrite(void *pBackendData, uint64_t uOffset, size_t c
                         }
 
                         offL2Tbl = qedClusterAllocate(pImage, qedByte2Cluster(pImage, pImage->cbTable));
-                        pL2Entry->offL2Tbl = offL2Tbl;
-                        memset(pL2Entry->paL2Tbl, 0, pImage->cbTable);
+                        pL2Entry->offTbl = offL2Tbl;
+                        memset(pL2Entry->paTbl, 0, pImage->cbTable);
 
                         pL2ClusterAlloc->enmAllocState = QEDCLUSTERASYNCALLOCSTATE_L2_ALLOC;
                         pL2ClusterAlloc->cbImageOld    = offL2Tbl;
@@ -1825,14 +1650,16 @@ static DECLCALLBACK(int) qedWrite(void *pBackendData, uint64_t uOffset, size_t c
                          * is a leak of some clusters.
                          */
                         rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
-                                                    offL2Tbl, pL2Entry->paL2Tbl, pImage->cbTable, pIoCtx,
+                                                    offL2Tbl, pL2Entry->paTbl, pImage->cbTable, pIoCtx,
                                                     qedAsyncClusterAllocUpdate, pL2ClusterAlloc);
                         if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
                             break;
                         else if (RT_FAILURE(rc))
                         {
                             RTMemFree(pL2ClusterAlloc);
-                            qedL2TblCacheEntryFree(pImage, pL2Entry);
+                            pImage->pL2TblAlloc = NULL;
+                            vdTblCacheEntryRelease(pL2Entry);
+                            vdTblCacheEntryFree(pImage->pL2TblCache, pL2Entry);
                             break;
                         }
 
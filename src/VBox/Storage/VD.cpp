@@ -35,12 +35,30 @@
 #include <iprt/path.h>
 #include <iprt/sg.h>
 #include <iprt/semaphore.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 
 #include "VDInternal.h"
 
 /** Buffer size used for merging images. */
 #define VD_MERGE_BUFFER_SIZE    (16 * _1M)
 
+/** Chunk size used for merges running in the background, kept small to
+ * minimize the time the disk is locked for the guest. */
+#define VD_BGOP_CHUNK_SIZE          _1M
+/** Number of idle intervals to wait at most for the foreground I/O to go idle
+ * before the next background chunk is processed anyway. */
+#define VD_BGOP_IDLE_WAIT_INTERVALS 8
+/** Minimum time to wait for the foreground I/O to go idle, for short idle
+ * intervals. */
+#define VD_BGOP_IDLE_WAIT_MIN_MS    250
+/** Maximum time to sleep before checking the background operation limits again. */
+#define VD_BGOP_WAIT_SLICE_MS       100
+/** Maximum latency in milliseconds the token bucket may accumulate. */
+#define VD_BGOP_MAX_LATENCY         100
+/** Amount of data processed by a background merge between two checkpoints. */
+#define VD_BGOP_CHECKPOINT_INTERVAL (256 * _1M)
+
 /** Maximum number of segments in one I/O task. */
 #define VD_IO_TASK_SEGMENTS_MAX 64
 
@@ -260,6 +278,8 @@ typedef struct VDIOCTX
  * multiple times.
  */
 #define VDIOCTX_FLAGS_WRITE_FILTER_APPLIED   RT_BIT_32(6)
+/** The I/O context is accounted for in VDISK::cLockWaiters. */
+#define VDIOCTX_FLAGS_LOCK_WAITER            RT_BIT_32(7)
 
 /** NIL I/O context pointer value. */
 #define NIL_VDIOCTX ((PVDIOCTX)0)
@@ -438,6 +458,15 @@ DECLINLINE(int) vdThreadFinishWrite(PVDISK pDisk)
     return rc;
 }
 
+/**
+ * internal: note foreground I/O for background operations yielding to it.
+ */
+DECLINLINE(void) vdFgIoNotify(PVDISK pDisk)
+{
+    if (RT_UNLIKELY(ASMAtomicReadU32(&pDisk->cBgOps)))
+        ASMAtomicWriteU64(&pDisk->tsFgIoLast, RTTimeMilliTS());
+}
+
 /**
  * internal: add image structure to the end of images list.
  */
@@ -683,6 +712,14 @@ static int vdFilterChainApplyRead(PVDISK pDisk, uint64_t uOffset, size_t cbRead,
 
 DECLINLINE(void) vdIoCtxRootComplete(PVDISK pDisk, PVDIOCTX pIoCtx)
 {
+    /* Completed with an error while it was still waiting for a lock. */
+    if (pIoCtx->fFlags & VDIOCTX_FLAGS_LOCK_WAITER)
+    {
+        Assert(pDisk->cLockWaiters);
+        pIoCtx->fFlags &= ~VDIOCTX_FLAGS_LOCK_WAITER;
+        pDisk->cLockWaiters--;
+    }
+
     if (   RT_SUCCESS(pIoCtx->rcReq)
         && pIoCtx->enmTxDir == VDIOCTXTXDIR_READ)
         pIoCtx->rcReq = vdFilterChainApplyRead(pDisk, pIoCtx->Req.Io.uOffsetXferOrig,
@@ -1592,6 +1629,42 @@ DECLINLINE(bool) vdIoCtxIsDiskLockOwner(PVDISK pDisk, PVDIOCTX pIoCtx)
     return pDisk->pIoCtxLockOwner == pIoCtx;
 }
 
+/**
+ * Defers the given I/O context because it waits for the disk lock or for an
+ * allocation range lock and accounts for it as a lock waiter.
+ *
+ * @returns nothing.
+ * @param   pDisk       The disk.
+ * @param   pIoCtx      The I/O context to defer.
+ */
+static void vdIoCtxDeferLockWaiter(PVDISK pDisk, PVDIOCTX pIoCtx)
+{
+    if (!(pIoCtx->fFlags & VDIOCTX_FLAGS_LOCK_WAITER))
+    {
+        pIoCtx->fFlags |= VDIOCTX_FLAGS_LOCK_WAITER;
+        pDisk->cLockWaiters++;
+    }
+    vdIoCtxDefer(pDisk, pIoCtx);
+}
+
+/**
+ * Removes the given I/O context from the lock waiters if it was deferred
+ * with vdIoCtxDeferLockWaiter() before.
+ *
+ * @returns nothing.
+ * @param   pDisk       The disk.
+ * @param   pIoCtx      The I/O context.
+ */
+DECLINLINE(void) vdIoCtxLockWaiterDone(PVDISK pDisk, PVDIOCTX pIoCtx)
+{
+    if (pIoCtx->fFlags & VDIOCTX_FLAGS_LOCK_WAITER)
+    {
+        Assert(pDisk->cLockWaiters);
+        pIoCtx->fFlags &= ~VDIOCTX_FLAGS_LOCK_WAITER;
+        pDisk->cLockWaiters--;
+    }
+}
+
 static int vdIoCtxLockDisk(PVDISK pDisk, PVDIOCTX pIoCtx)
 {
     int rc = VINF_SUCCESS;
@@ -1600,12 +1673,16 @@ static int vdIoCtxLockDisk(PVDISK pDisk, PVDIOCTX pIoCtx)
 
     LogFlowFunc(("pDisk=%#p pIoCtx=%#p\n", pDisk, pIoCtx));
 
-    if (!ASMAtomicCmpXchgPtr(&pDisk->pIoCtxLockOwner, pIoCtx, NIL_VDIOCTX))
+    /* The disk lock excludes any block allocations running in parallel. */
+    if (   pDisk->cAllocLocks
+        || !ASMAtomicCmpXchgPtr(&pDisk->pIoCtxLockOwner, pIoCtx, NIL_VDIOCTX))
     {
         Assert(pDisk->pIoCtxLockOwner != pIoCtx); /* No nesting allowed. */
-        vdIoCtxDefer(pDisk, pIoCtx);
+        vdIoCtxDeferLockWaiter(pDisk, pIoCtx);
         rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
     }
+    else
+        vdIoCtxLockWaiterDone(pDisk, pIoCtx);
 
     LogFlowFunc(("returns -> %Rrc\n", rc));
     return rc;
@@ -1632,6 +1709,138 @@ static void vdIoCtxUnlockDisk(PVDISK pDisk, PVDIOCTX pIoCtx, bool fProcessBlocke
     LogFlowFunc(("returns\n"));
 }
 
+/**
+ * Locks the given range for a write allocating a new block in the given image.
+ *
+ * If the image backend supports concurrent allocations an allocation range lock
+ * is taken and other block allocations can proceed in parallel, otherwise the
+ * whole disk is locked.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_ASYNC_IO_IN_PROGRESS if the I/O context was deferred.
+ * @param   pDisk       The disk.
+ * @param   pIoCtx      The I/O context to lock the range for.
+ * @param   pImage      The image the block gets allocated in.
+ * @param   offStart    Start offset of the range to lock.
+ * @param   offEnd      First offset after the range to lock.
+ */
+static int vdIoCtxLockAllocRange(PVDISK pDisk, PVDIOCTX pIoCtx, PVDIMAGE pImage,
+                                 uint64_t offStart, uint64_t offEnd)
+{
+    VD_IS_LOCKED(pDisk);
+
+    LogFlowFunc(("pDisk=%#p pIoCtx=%#p offStart=%llu offEnd=%llu\n", pDisk, pIoCtx, offStart, offEnd));
+
+    if (   (pImage->Backend->uBackendCaps & VD_CAP_CONCURRENT_ALLOC)
+        && !pDisk->pImageRelay
+        && !pDisk->pCache)
+    {
+        if (   pDisk->pIoCtxLockOwner == NIL_VDIOCTX
+            && !pDisk->cLockWaiters)
+        {
+            for (unsigned i = 0; i < RT_ELEMENTS(pDisk->aAllocLocks); i++)
+            {
+                PVDALLOCLOCK pAllocLock = &pDisk->aAllocLocks[i];
+                if (pAllocLock->pIoCtxOwner == NIL_VDIOCTX)
+                {
+                    pAllocLock->pIoCtxOwner = pIoCtx;
+                    pAllocLock->offStart    = offStart;
+                    pAllocLock->offEnd      = offEnd;
+                    pDisk->cAllocLocks++;
+                    LogFlowFunc(("returns -> VINF_SUCCESS (slot %u)\n", i));
+                    return VINF_SUCCESS;
+                }
+            }
+        }
+
+        /* Wait for the disk lock to be released or an allocation to finish. */
+        vdIoCtxDefer(pDisk, pIoCtx);
+        LogFlowFunc(("returns -> VERR_VD_ASYNC_IO_IN_PROGRESS\n"));
+        return VERR_VD_ASYNC_IO_IN_PROGRESS;
+    }
+
+    int rc = vdIoCtxLockDisk(pDisk, pIoCtx);
+    if (RT_SUCCESS(rc))
+    {
+        pDisk->uOffsetStartLocked = offStart;
+        pDisk->uOffsetEndLocked   = offEnd;
+    }
+
+    return rc;
+}
+
+/**
+ * Releases the lock taken with vdIoCtxLockAllocRange() or the disk lock.
+ *
+ * @returns nothing.
+ * @param   pDisk                The disk.
+ * @param   pIoCtx               The I/O context owning the lock.
+ * @param   fProcessBlockedReqs  Flag whether to process blocked I/O contexts.
+ */
+static void vdIoCtxUnlockAllocRange(PVDISK pDisk, PVDIOCTX pIoCtx, bool fProcessBlockedReqs)
+{
+    VD_IS_LOCKED(pDisk);
+
+    LogFlowFunc(("pDisk=%#p pIoCtx=%#p fProcessBlockedReqs=%RTbool\n",
+                 pDisk, pIoCtx, fProcessBlockedReqs));
+
+    if (pDisk->cAllocLocks)
+    {
+        for (unsigned i = 0; i < RT_ELEMENTS(pDisk->aAllocLocks); i++)
+        {
+            PVDALLOCLOCK pAllocLock = &pDisk->aAllocLocks[i];
+            if (pAllocLock->pIoCtxOwner == pIoCtx)
+            {
+                pAllocLock->pIoCtxOwner = NIL_VDIOCTX;
+                pDisk->cAllocLocks--;
+
+                if (fProcessBlockedReqs)
+                    vdDiskProcessBlockedIoCtx(pDisk);
+                return;
+            }
+        }
+    }
+
+    vdIoCtxUnlockDisk(pDisk, pIoCtx, fProcessBlockedReqs);
+}
+
+/**
+ * Checks whether the given offset lies in a range locked by another I/O context
+ * for a block allocation, flush or discard.
+ *
+ * @returns true if the I/O context interferes with the locked range and must be deferred.
+ * @param   pDisk     The disk.
+ * @param   pIoCtx    The I/O context accessing the offset.
+ * @param   uOffset   The offset to check.
+ */
+static bool vdIoCtxIsRangeLocked(PVDISK pDisk, PVDIOCTX pIoCtx, uint64_t uOffset)
+{
+    VD_IS_LOCKED(pDisk);
+
+    if (   pDisk->pIoCtxLockOwner != NIL_VDIOCTX
+        && uOffset >= pDisk->uOffsetStartLocked
+        && uOffset < pDisk->uOffsetEndLocked
+        && (   !pIoCtx->pIoCtxParent
+            || pIoCtx->pIoCtxParent != pDisk->pIoCtxLockOwner))
+        return true;
+
+    if (pDisk->cAllocLocks)
+    {
+        for (unsigned i = 0; i < RT_ELEMENTS(pDisk->aAllocLocks); i++)
+        {
+            PVDALLOCLOCK pAllocLock = &pDisk->aAllocLocks[i];
+            if (   pAllocLock->pIoCtxOwner != NIL_VDIOCTX
+                && uOffset >= pAllocLock->offStart
+                && uOffset < pAllocLock->offEnd
+                && pAllocLock->pIoCtxOwner != pIoCtx
+                && pAllocLock->pIoCtxOwner != pIoCtx->pIoCtxParent)
+                return true;
+        }
+    }
+
+    return false;
+}
+
 /**
  * Internal: Reads a given amount of data from the image chain of the disk.
  **/
@@ -1692,16 +1901,13 @@ static DECLCALLBACK(int) vdReadHelperAsync(PVDIOCTX pIoCtx)
      * Defer I/O if the range interferes but only if it does not belong to the
      * write doing the allocation.
      */
-    if (   pDisk->pIoCtxLockOwner != NIL_VDIOCTX
-        && uOffset >= pDisk->uOffsetStartLocked
-        && uOffset < pDisk->uOffsetEndLocked
-        && (   !pIoCtx->pIoCtxParent
-            || pIoCtx->pIoCtxParent != pDisk->pIoCtxLockOwner))
+    if (vdIoCtxIsRangeLocked(pDisk, pIoCtx, uOffset))
     {
         Log(("Interferring read while allocating a new block => deferring read\n"));
-        vdIoCtxDefer(pDisk, pIoCtx);
+        vdIoCtxDeferLockWaiter(pDisk, pIoCtx);
         return VERR_VD_ASYNC_IO_IN_PROGRESS;
     }
+    vdIoCtxLockWaiterDone(pDisk, pIoCtx);
 
     /* Loop until all reads started or we have a backend which needs to read metadata. */
     do
@@ -2030,32 +2236,407 @@ static int vdWriteHelper(PVDISK pDisk, PVDIMAGE pImage, uint64_t uOffset,
                            fFlags, 0);
 }
 
+/**
+ * Read ahead buffer used by the pipelined copy.
+ */
+typedef struct VDCOPYBUF
+{
+    /** Start offset of the data in the buffer. */
+    uint64_t            uOffset;
+    /** Number of bytes read. */
+    size_t              cbData;
+    /** Status code of the read, VERR_VD_BLOCK_FREE if there is nothing to write. */
+    int                 rc;
+    /** The data buffer. */
+    void               *pvBuf;
+} VDCOPYBUF;
+/** Pointer to a read ahead buffer. */
+typedef VDCOPYBUF *PVDCOPYBUF;
+
+/**
+ * State of the read ahead thread of a pipelined copy.
+ */
+typedef struct VDCOPYREADAHEAD
+{
+    /** The disk to read from. */
+    PVDISK              pDiskFrom;
+    /** The image to read from. */
+    PVDIMAGE            pImageFrom;
+    /** Number of images to read back in the source chain. */
+    unsigned            cImagesFromRead;
+    /** Flag whether the data is copied blockwise. */
+    bool                fBlockwiseCopy;
+    /** Number of bytes to copy. */
+    uint64_t            cbSize;
+    /** Flag whether the writer stopped and the read ahead thread should quit. */
+    volatile bool       fCancelled;
+    /** Number of buffers filled so far. */
+    volatile uint32_t   cBufsRead;
+    /** Number of buffers written so far. */
+    volatile uint32_t   cBufsWritten;
+    /** Signalled by the read ahead thread when a buffer was filled. */
+    RTSEMEVENT          hEvtRead;
+    /** Signalled by the writer when a buffer was written. */
+    RTSEMEVENT          hEvtWritten;
+    /** Number of buffers. */
+    unsigned            cBufs;
+    /** The buffers, used as a ring. */
+    VDCOPYBUF           aBufs[1];
+} VDCOPYREADAHEAD;
+/** Pointer to the read ahead state of a pipelined copy. */
+typedef VDCOPYREADAHEAD *PVDCOPYREADAHEAD;
+
+/**
+ * Internal: Reads the next chunk of data for the copy from the source disk.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_BLOCK_FREE if the chunk is not allocated in the images read
+ *          when copying blockwise.
+ * @param   pDiskFrom         The disk to read from.
+ * @param   pImageFrom        The image to start reading from.
+ * @param   cImagesFromRead   Number of images to read back in the chain.
+ * @param   fBlockwiseCopy    Flag whether to read from the images directly.
+ * @param   uOffset           Where to start reading.
+ * @param   pvBuf             Where to store the data, VD_MERGE_BUFFER_SIZE bytes big.
+ * @param   pcbRead           On input the number of bytes to read, on output the
+ *                            number of bytes actually read.
+ */
+static int vdCopyHelperRead(PVDISK pDiskFrom, PVDIMAGE pImageFrom, unsigned cImagesFromRead,
+                            bool fBlockwiseCopy, uint64_t uOffset, void *pvBuf, size_t *pcbRead)
+{
+    int rc;
+    int rc2;
+    size_t cbThisRead = *pcbRead;
+
+    /* Note that we don't attempt to synchronize cross-disk accesses.
+     * It wouldn't be very difficult to do, just the lock order would
+     * need to be defined somehow to prevent deadlocks. Postpone such
+     * magic as there is no use case for this. */
+
+    rc2 = vdThreadStartRead(pDiskFrom);
+    AssertRC(rc2);
+
+    if (fBlockwiseCopy)
+    {
+        RTSGSEG SegmentBuf;
+        RTSGBUF SgBuf;
+        VDIOCTX IoCtx;
+
+        SegmentBuf.pvSeg = pvBuf;
+        SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
+        RTSgBufInit(&SgBuf, &SegmentBuf, 1);
+        vdIoCtxInit(&IoCtx, pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
+                    &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
+
+        /* Read the source data. */
+        rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
+                                          uOffset, cbThisRead, &IoCtx,
+                                          &cbThisRead);
+
+        if (   rc == VERR_VD_BLOCK_FREE
+            && cImagesFromRead != 1)
+        {
+            unsigned cImagesToProcess = cImagesFromRead;
+
+            for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
+                 pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
+                 pCurrImage = pCurrImage->pPrev)
+            {
+                rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                       uOffset, cbThisRead,
+                                                       &IoCtx, &cbThisRead);
+                if (cImagesToProcess == 1)
+                    break;
+                else if (cImagesToProcess > 0)
+                    cImagesToProcess--;
+            }
+        }
+    }
+    else
+        rc = vdReadHelper(pDiskFrom, pImageFrom, uOffset, pvBuf, cbThisRead,
+                          false /* fUpdateCache */);
+
+    rc2 = vdThreadFinishRead(pDiskFrom);
+    AssertRC(rc2);
+
+    *pcbRead = cbThisRead;
+    return rc;
+}
+
+/**
+ * Internal: Writes a chunk of copied data to the destination disk.
+ *
+ * @returns VBox status code.
+ * @param   pDiskTo           The disk to write to.
+ * @param   uOffset           Where to start writing.
+ * @param   pvBuf             The data to write.
+ * @param   cbWrite           Number of bytes to write.
+ * @param   cImagesToRead     Number of images to read back in the destination
+ *                            chain for collapsed I/O, 0 to disable.
+ * @param   fSkipZeroes       Flag whether chunks containing only zeroes can be
+ *                            skipped because the destination is a new image.
+ */
+static int vdCopyHelperWrite(PVDISK pDiskTo, uint64_t uOffset, const void *pvBuf, size_t cbWrite,
+                             unsigned cImagesToRead, bool fSkipZeroes)
+{
+    int rc;
+    int rc2;
+
+    /* A new image reads as zeroes already, saves allocating blocks for unused space in the source. */
+    if (   fSkipZeroes
+        && ASMMemIsZero(pvBuf, cbWrite))
+        return VINF_SUCCESS;
+
+    rc2 = vdThreadStartWrite(pDiskTo);
+    AssertRC(rc2);
+
+    /* Only do collapsed I/O if we are copying the data blockwise. */
+    rc = vdWriteHelperEx(pDiskTo, pDiskTo->pLast, NULL, uOffset, pvBuf,
+                         cbWrite, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
+                         cImagesToRead);
+
+    rc2 = vdThreadFinishWrite(pDiskTo);
+    AssertRC(rc2);
+
+    return rc;
+}
+
+/**
+ * Internal: Reports the copy progress to the given progress interfaces.
+ *
+ * @returns VBox status code.
+ * @param   pIfProgress       The source progress interface, optional.
+ * @param   pDstIfProgress    The destination progress interface, optional.
+ * @param   uOffset           Number of bytes copied so far.
+ * @param   cbSize            Number of bytes to copy in total.
+ * @param   puProgressOld     Where the last reported percentage is kept.
+ */
+static int vdCopyHelperProgress(PVDINTERFACEPROGRESS pIfProgress, PVDINTERFACEPROGRESS pDstIfProgress,
+                                uint64_t uOffset, uint64_t cbSize, unsigned *puProgressOld)
+{
+    int rc = VINF_SUCCESS;
+    unsigned uProgressNew = uOffset * 99 / cbSize;
+
+    if (uProgressNew != *puProgressOld)
+    {
+        *puProgressOld = uProgressNew;
+
+        if (pIfProgress && pIfProgress->pfnProgress)
+            rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser, uProgressNew);
+        if (   RT_SUCCESS(rc)
+            && pDstIfProgress && pDstIfProgress->pfnProgress)
+            rc = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser, uProgressNew);
+    }
+
+    return rc;
+}
+
+/**
+ * Read ahead thread of the pipelined copy, fills the buffers in order until
+ * the end of the disk is reached, a read fails or the writer gives up.
+ *
+ * @returns VBox status code.
+ * @param   hThread    The thread handle.
+ * @param   pvUser     The read ahead state.
+ */
+static DECLCALLBACK(int) vdCopyReadAheadThread(RTTHREAD hThread, void *pvUser)
+{
+    PVDCOPYREADAHEAD pReadAhead = (PVDCOPYREADAHEAD)pvUser;
+    uint64_t uOffset = 0;
+    RT_NOREF1(hThread);
+
+    while (   uOffset < pReadAhead->cbSize
+           && !ASMAtomicReadBool(&pReadAhead->fCancelled))
+    {
+        uint32_t cBufsRead = ASMAtomicReadU32(&pReadAhead->cBufsRead);
+
+        /* Wait for a free buffer. */
+        if (cBufsRead - ASMAtomicReadU32(&pReadAhead->cBufsWritten) >= pReadAhead->cBufs)
+        {
+            RTSemEventWait(pReadAhead->hEvtWritten, RT_INDEFINITE_WAIT);
+            continue;
+        }
+
+        PVDCOPYBUF pBuf = &pReadAhead->aBufs[cBufsRead % pReadAhead->cBufs];
+        size_t cbThisRead = (size_t)RT_MIN(VD_MERGE_BUFFER_SIZE, pReadAhead->cbSize - uOffset);
+
+        pBuf->uOffset = uOffset;
+        pBuf->rc = vdCopyHelperRead(pReadAhead->pDiskFrom, pReadAhead->pImageFrom,
+                                    pReadAhead->cImagesFromRead, pReadAhead->fBlockwiseCopy,
+                                    uOffset, pBuf->pvBuf, &cbThisRead);
+        pBuf->cbData = cbThisRead;
+        uOffset += cbThisRead;
+
+        ASMAtomicIncU32(&pReadAhead->cBufsRead);
+        RTSemEventSignal(pReadAhead->hEvtRead);
+
+        if (RT_FAILURE(pBuf->rc) && pBuf->rc != VERR_VD_BLOCK_FREE)
+            break;
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal: Copies the content of one disk to another one reading the source
+ * on a separate thread while the calling thread writes to the destination.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NO_MEMORY if the read ahead state could not be set up, the
+ *          caller falls back to the sequential copy.
+ */
+static int vdCopyHelperPipelined(PVDISK pDiskFrom, PVDIMAGE pImageFrom, PVDISK pDiskTo,
+                                 uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
+                                 bool fBlockwiseCopy, bool fSkipZeroes, unsigned cReadAhead,
+                                 PVDINTERFACEPROGRESS pIfProgress, PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    int rc = VINF_SUCCESS;
+    unsigned uProgressOld = 0;
+    unsigned cBufsAlloc = 0;
+
+    PVDCOPYREADAHEAD pReadAhead = (PVDCOPYREADAHEAD)RTMemAllocZ(RT_UOFFSETOF(VDCOPYREADAHEAD, aBufs) + cReadAhead * sizeof(VDCOPYBUF));
+    if (!pReadAhead)
+        return VERR_NO_MEMORY;
+
+    pReadAhead->pDiskFrom       = pDiskFrom;
+    pReadAhead->pImageFrom      = pImageFrom;
+    pReadAhead->cImagesFromRead = cImagesFromRead;
+    pReadAhead->fBlockwiseCopy  = fBlockwiseCopy;
+    pReadAhead->cbSize          = cbSize;
+    pReadAhead->cBufs           = cReadAhead;
+    pReadAhead->hEvtRead        = NIL_RTSEMEVENT;
+    pReadAhead->hEvtWritten     = NIL_RTSEMEVENT;
+
+    for (cBufsAlloc = 0; cBufsAlloc < cReadAhead; cBufsAlloc++)
+    {
+        pReadAhead->aBufs[cBufsAlloc].pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
+        if (!pReadAhead->aBufs[cBufsAlloc].pvBuf)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pReadAhead->hEvtRead);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pReadAhead->hEvtWritten);
+
+    RTTHREAD hThread = NIL_RTTHREAD;
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&hThread, vdCopyReadAheadThread, pReadAhead, 0 /* cbStack */,
+                            RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VDCopyRead");
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t uOffset = 0;
+
+        while (uOffset < cbSize)
+        {
+            uint32_t cBufsWritten = pReadAhead->cBufsWritten;
+
+            if (ASMAtomicReadU32(&pReadAhead->cBufsRead) == cBufsWritten)
+            {
+                RTSemEventWait(pReadAhead->hEvtRead, RT_INDEFINITE_WAIT);
+                continue;
+            }
+
+            PVDCOPYBUF pBuf = &pReadAhead->aBufs[cBufsWritten % pReadAhead->cBufs];
+            Assert(pBuf->uOffset == uOffset);
+
+            rc = pBuf->rc;
+            if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
+                break;
+
+            if (rc != VERR_VD_BLOCK_FREE)
+            {
+                rc = vdCopyHelperWrite(pDiskTo, pBuf->uOffset, pBuf->pvBuf, pBuf->cbData,
+                                       fBlockwiseCopy ? cImagesToRead : 0, fSkipZeroes);
+                if (RT_FAILURE(rc))
+                    break;
+            }
+            else /* Don't propagate the error to the outside */
+                rc = VINF_SUCCESS;
+
+            uOffset += pBuf->cbData;
+
+            ASMAtomicIncU32(&pReadAhead->cBufsWritten);
+            RTSemEventSignal(pReadAhead->hEvtWritten);
+
+            rc = vdCopyHelperProgress(pIfProgress, pDstIfProgress, uOffset, cbSize, &uProgressOld);
+            if (RT_FAILURE(rc))
+                break;
+        }
+
+        ASMAtomicWriteBool(&pReadAhead->fCancelled, true);
+        RTSemEventSignal(pReadAhead->hEvtWritten);
+        int rc2 = RTThreadWait(hThread, RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc2);
+    }
+    else if (rc != VERR_NO_MEMORY)
+    {
+        LogRel(("VD: Failed to set up the read ahead thread for copying (%Rrc), copying sequentially\n", rc));
+        rc = VERR_NO_MEMORY;
+    }
+
+    if (pReadAhead->hEvtWritten != NIL_RTSEMEVENT)
+        RTSemEventDestroy(pReadAhead->hEvtWritten);
+    if (pReadAhead->hEvtRead != NIL_RTSEMEVENT)
+        RTSemEventDestroy(pReadAhead->hEvtRead);
+    for (unsigned i = 0; i < cBufsAlloc; i++)
+        RTMemTmpFree(pReadAhead->aBufs[i].pvBuf);
+    RTMemFree(pReadAhead);
+
+    return rc;
+}
+
 /**
  * Internal: Copies the content of one disk to another one applying optimizations
  * to speed up the copy process if possible.
  */
 static int vdCopyHelper(PVDISK pDiskFrom, PVDIMAGE pImageFrom, PVDISK pDiskTo,
                         uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
-                        bool fSuppressRedundantIo, PVDINTERFACEPROGRESS pIfProgress,
-                        PVDINTERFACEPROGRESS pDstIfProgress)
+                        bool fSuppressRedundantIo, bool fDstZeroed, unsigned cReadAhead,
+                        PVDINTERFACEPROGRESS pIfProgress, PVDINTERFACEPROGRESS pDstIfProgress)
 {
     int rc = VINF_SUCCESS;
-    int rc2;
     uint64_t uOffset = 0;
     uint64_t cbRemaining = cbSize;
     void *pvBuf = NULL;
-    bool fLockReadFrom = false;
-    bool fLockWriteTo = false;
     bool fBlockwiseCopy = false;
     unsigned uProgressOld = 0;
 
-    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool pIfProgress=%#p pDstIfProgress=%#p\n",
-                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, pDstIfProgress, pDstIfProgress));
+    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool cReadAhead=%u pIfProgress=%#p pDstIfProgress=%#p\n",
+                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, cReadAhead, pDstIfProgress, pDstIfProgress));
 
     if (   (fSuppressRedundantIo || (cImagesFromRead > 0))
         && RTListIsEmpty(&pDiskFrom->ListFilterChainRead))
         fBlockwiseCopy = true;
 
+    /*
+     * If the destination is a freshly created image which reads back as zeroes
+     * and the only image of the disk there is no need to write chunks which contain
+     * nothing else. fSuppressRedundantIo alone is not enough, it is set for
+     * existing destinations with known common content as well.
+     */
+    bool fSkipZeroes =    fDstZeroed
+                       && pDiskTo->cImages == 1
+                       && RTListIsEmpty(&pDiskTo->ListFilterChainWrite);
+
+    if (cReadAhead > 1)
+    {
+        rc = vdCopyHelperPipelined(pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead,
+                                   cImagesToRead, fBlockwiseCopy, fSkipZeroes, cReadAhead,
+                                   pIfProgress, pDstIfProgress);
+        if (rc != VERR_NO_MEMORY)
+        {
+            LogFlowFunc(("returns rc=%Rrc\n", rc));
+            return rc;
+        }
+
+        /* Fall back to copying sequentially. */
+        rc = VINF_SUCCESS;
+    }
+
     /* Allocate tmp buffer. */
     pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
     if (!pvBuf)
@@ -2065,78 +2646,17 @@ static int vdCopyHelper(PVDISK pDiskFrom, PVDIMAGE pImageFrom, PVDISK pDiskTo,
     {
         size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
 
-        /* Note that we don't attempt to synchronize cross-disk accesses.
-         * It wouldn't be very difficult to do, just the lock order would
-         * need to be defined somehow to prevent deadlocks. Postpone such
-         * magic as there is no use case for this. */
-
-        rc2 = vdThreadStartRead(pDiskFrom);
-        AssertRC(rc2);
-        fLockReadFrom = true;
-
-        if (fBlockwiseCopy)
-        {
-            RTSGSEG SegmentBuf;
-            RTSGBUF SgBuf;
-            VDIOCTX IoCtx;
-
-            SegmentBuf.pvSeg = pvBuf;
-            SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
-            RTSgBufInit(&SgBuf, &SegmentBuf, 1);
-            vdIoCtxInit(&IoCtx, pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
-                        &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
-
-            /* Read the source data. */
-            rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
-                                              uOffset, cbThisRead, &IoCtx,
-                                              &cbThisRead);
-
-            if (   rc == VERR_VD_BLOCK_FREE
-                && cImagesFromRead != 1)
-            {
-                unsigned cImagesToProcess = cImagesFromRead;
-
-                for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
-                     pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
-                     pCurrImage = pCurrImage->pPrev)
-                {
-                    rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                                           uOffset, cbThisRead,
-                                                           &IoCtx, &cbThisRead);
-                    if (cImagesToProcess == 1)
-                        break;
-                    else if (cImagesToProcess > 0)
-                        cImagesToProcess--;
-                }
-            }
-        }
-        else
-            rc = vdReadHelper(pDiskFrom, pImageFrom, uOffset, pvBuf, cbThisRead,
-                              false /* fUpdateCache */);
-
+        rc = vdCopyHelperRead(pDiskFrom, pImageFrom, cImagesFromRead, fBlockwiseCopy,
+                              uOffset, pvBuf, &cbThisRead);
         if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
             break;
 
-        rc2 = vdThreadFinishRead(pDiskFrom);
-        AssertRC(rc2);
-        fLockReadFrom = false;
-
         if (rc != VERR_VD_BLOCK_FREE)
         {
-            rc2 = vdThreadStartWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = true;
-
-            /* Only do collapsed I/O if we are copying the data blockwise. */
-            rc = vdWriteHelperEx(pDiskTo, pDiskTo->pLast, NULL, uOffset, pvBuf,
-                                 cbThisRead, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
-                                 fBlockwiseCopy ? cImagesToRead : 0);
+            rc = vdCopyHelperWrite(pDiskTo, uOffset, pvBuf, cbThisRead,
+                                   fBlockwiseCopy ? cImagesToRead : 0, fSkipZeroes);
             if (RT_FAILURE(rc))
                 break;
-
-            rc2 = vdThreadFinishWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = false;
         }
         else /* Don't propagate the error to the outside */
             rc = VINF_SUCCESS;
@@ -2144,42 +2664,13 @@ static int vdCopyHelper(PVDISK pDiskFrom, PVDIMAGE pImageFrom, PVDISK pDiskTo,
         uOffset += cbThisRead;
         cbRemaining -= cbThisRead;
 
-        unsigned uProgressNew = uOffset * 99 / cbSize;
-        if (uProgressNew != uProgressOld)
-        {
-            uProgressOld = uProgressNew;
-
-            if (pIfProgress && pIfProgress->pfnProgress)
-            {
-                rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
-                                              uProgressOld);
-                if (RT_FAILURE(rc))
-                    break;
-            }
-            if (pDstIfProgress && pDstIfProgress->pfnProgress)
-            {
-                rc = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser,
-                                                 uProgressOld);
-                if (RT_FAILURE(rc))
-                    break;
-            }
-        }
+        rc = vdCopyHelperProgress(pIfProgress, pDstIfProgress, uOffset, cbSize, &uProgressOld);
+        if (RT_FAILURE(rc))
+            break;
     } while (uOffset < cbSize);
 
     RTMemFree(pvBuf);
 
-    if (fLockReadFrom)
-    {
-        rc2 = vdThreadFinishRead(pDiskFrom);
-        AssertRC(rc2);
-    }
-
-    if (fLockWriteTo)
-    {
-        rc2 = vdThreadFinishWrite(pDiskTo);
-        AssertRC(rc2);
-    }
-
     LogFlowFunc(("returns rc=%Rrc\n", rc));
     return rc;
 }
@@ -2662,15 +3153,14 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
          * Check whether there is a full block write in progress which was not allocated.
          * Defer I/O if the range interferes.
          */
-        if (   pDisk->pIoCtxLockOwner != NIL_VDIOCTX
-            && uOffset >= pDisk->uOffsetStartLocked
-            && uOffset < pDisk->uOffsetEndLocked)
+        if (vdIoCtxIsRangeLocked(pDisk, pIoCtx, uOffset))
         {
             Log(("Interferring write while allocating a new block => deferring write\n"));
-            vdIoCtxDefer(pDisk, pIoCtx);
+            vdIoCtxDeferLockWaiter(pDisk, pIoCtx);
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
             break;
         }
+        vdIoCtxLockWaiterDone(pDisk, pIoCtx);
 
         fWrite =   (pImage->uOpenFlags & VD_OPEN_FLAGS_HONOR_SAME)
                  ? 0 : VD_WRITE_NO_ALLOC;
@@ -2679,8 +3169,9 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
                                        fWrite);
         if (rc == VERR_VD_BLOCK_FREE)
         {
-            /* Lock the disk .*/
-            rc = vdIoCtxLockDisk(pDisk, pIoCtx);
+            /* Lock the range of the block to allocate (or the whole disk if the backend can't do better). */
+            rc = vdIoCtxLockAllocRange(pDisk, pIoCtx, pImage, uOffset - cbPreRead,
+                                       uOffset + cbThisWrite + cbPostRead);
             if (RT_SUCCESS(rc))
             {
                 /*
@@ -2714,10 +3205,6 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
                 LogFlowFunc(("Disk is growing because of pIoCtx=%#p pIoCtxWrite=%#p\n",
                              pIoCtx, pIoCtxWrite));
 
-                /* Save the current range for the growing operation to check for intersecting requests later. */
-                pDisk->uOffsetStartLocked = uOffset - cbPreRead;
-                pDisk->uOffsetEndLocked = uOffset + cbThisWrite + cbPostRead;
-
                 pIoCtxWrite->Type.Child.cbPreRead  = cbPreRead;
                 pIoCtxWrite->Type.Child.cbPostRead = cbPostRead;
                 pIoCtxWrite->Req.Io.pImageParentOverride = pIoCtx->Req.Io.pImageParentOverride;
@@ -2727,7 +3214,7 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
 
                 if (RT_FAILURE(rc) && (rc != VERR_VD_ASYNC_IO_IN_PROGRESS))
                 {
-                    vdIoCtxUnlockDisk(pDisk, pIoCtx, false /* fProcessDeferredReqs*/ );
+                    vdIoCtxUnlockAllocRange(pDisk, pIoCtx, false /* fProcessDeferredReqs*/ );
                     vdIoCtxFree(pDisk, pIoCtxWrite);
                     break;
                 }
@@ -2739,7 +3226,7 @@ static DECLCALLBACK(int) vdWriteHelperAsync(PVDIOCTX pIoCtx)
                     Assert(cbThisWrite == (uint32_t)cbThisWrite);
                     rc = pIoCtxWrite->rcReq;
                     ASMAtomicSubU32(&pIoCtx->Req.Io.cbTransferLeft, (uint32_t)cbThisWrite);
-                    vdIoCtxUnlockDisk(pDisk, pIoCtx, false /* fProcessDeferredReqs*/ );
+                    vdIoCtxUnlockAllocRange(pDisk, pIoCtx, false /* fProcessDeferredReqs*/ );
                     vdIoCtxFree(pDisk, pIoCtxWrite);
                 }
                 else
@@ -3385,7 +3872,7 @@ static int vdIoCtxContinue(PVDIOCTX pIoCtx, int rcReq)
                  * A completed child write means that we finished growing the image.
                  * We have to process any pending writes now.
                  */
-                vdIoCtxUnlockDisk(pDisk, pIoCtxParent, false /* fProcessDeferredReqs */);
+                vdIoCtxUnlockAllocRange(pDisk, pIoCtxParent, false /* fProcessDeferredReqs */);
 
                 /* Unblock the parent */
                 pIoCtxParent->fFlags &= ~VDIOCTX_FLAGS_BLOCKED;
@@ -5310,6 +5797,8 @@ VBOXDDU_DECL(int) VDCreate(PVDINTERFACE pVDIfsDisk, VDTYPE enmType, PVDISK *ppDi
             pDisk->pInterfaceError         = NULL;
             pDisk->pInterfaceThreadSync    = NULL;
             pDisk->pIoCtxLockOwner         = NULL;
+            pDisk->cAllocLocks             = 0;
+            pDisk->cLockWaiters            = 0;
             pDisk->pIoCtxHead              = NULL;
             pDisk->fLocked                 = false;
             pDisk->hMemCacheIoCtx          = NIL_RTMEMCACHE;
@@ -6947,6 +7436,262 @@ VBOXDDU_DECL(int) VDCreateCache(PVDISK pDisk, const char *pszBackend,
     return rc;
 }
 
+/**
+ * Background operation state, used to throttle a merge running
+ * concurrently to foreground I/O and to make it resumable.
+ */
+typedef struct VDBGOP
+{
+    /** The background operation interface, NULL if the operation runs at full speed. */
+    PVDINTERFACEBGOP    pIfBgOp;
+    /** Current bandwidth limit in bytes per second, 0 if unlimited. */
+    uint64_t            cbPerSecMax;
+    /** Maximum number of tokens the bucket can hold. */
+    uint64_t            cbBucket;
+    /** Number of tokens available at the time of the last update. */
+    uint64_t            cbTokensLast;
+    /** Timestamp (RTTimeNanoTS) of the last token update. */
+    uint64_t            tsUpdatedLast;
+    /** Disk offset of the last checkpoint saved. */
+    uint64_t            offCheckpointLast;
+} VDBGOP;
+/** Pointer to a background operation state. */
+typedef VDBGOP *PVDBGOP;
+
+/**
+ * internal: flush the given image synchronously, the caller must hold the
+ * write lock.
+ */
+static int vdBgOpFlushImage(PVDISK pDisk, PVDIMAGE pImage)
+{
+    VDIOCTX IoCtx;
+    RTSEMEVENT hEventComplete = NIL_RTSEMEVENT;
+
+    int rc = RTSemEventCreate(&hEventComplete);
+    if (RT_SUCCESS(rc))
+    {
+        vdIoCtxInit(&IoCtx, pDisk, VDIOCTXTXDIR_FLUSH, 0, 0, pImage, NULL,
+                    NULL, vdFlushHelperAsync, VDIOCTX_FLAGS_SYNC | VDIOCTX_FLAGS_DONT_FREE);
+
+        IoCtx.Type.Root.pfnComplete = vdIoCtxSyncComplete;
+        IoCtx.Type.Root.pvUser1     = pDisk;
+        IoCtx.Type.Root.pvUser2     = hEventComplete;
+        rc = vdIoCtxProcessSync(&IoCtx, hEventComplete);
+
+        RTSemEventDestroy(hEventComplete);
+    }
+
+    return rc;
+}
+
+/**
+ * internal: set up the background operation state for a merge.
+ */
+static void vdBgOpInit(PVDISK pDisk, PVDBGOP pBgOp, PVDINTERFACEBGOP pIfBgOp)
+{
+    pBgOp->pIfBgOp           = pIfBgOp;
+    pBgOp->cbPerSecMax       = 0;
+    pBgOp->cbBucket          = 0;
+    pBgOp->cbTokensLast      = 0;
+    pBgOp->tsUpdatedLast     = RTTimeNanoTS();
+    pBgOp->offCheckpointLast = 0;
+
+    if (pIfBgOp)
+    {
+        ASMAtomicWriteU64(&pDisk->tsFgIoLast, 0);
+        ASMAtomicIncU32(&pDisk->cBgOps);
+    }
+}
+
+/**
+ * internal: tear down the background operation state.
+ */
+static void vdBgOpTerm(PVDISK pDisk, PVDBGOP pBgOp)
+{
+    if (pBgOp->pIfBgOp)
+        ASMAtomicDecU32(&pDisk->cBgOps);
+}
+
+/**
+ * internal: query the offset a background operation can resume at.
+ *
+ * @returns Disk offset to start at, 0 if there is no valid checkpoint.
+ * @param   pDisk       The disk.
+ * @param   pBgOp       The background operation state.
+ * @param   pImageFrom  The source image of the operation.
+ * @param   cbSize      Size of the area processed by the operation.
+ *
+ * @note The checkpoint is only used if the modification UUID of the source
+ *       still matches. Every write to the image which is not relayed to the
+ *       merge target changes it on the next flush or close, so an outdated
+ *       checkpoint is never used.
+ */
+static uint64_t vdBgOpResume(PVDISK pDisk, PVDBGOP pBgOp, PVDIMAGE pImageFrom, uint64_t cbSize)
+{
+    PVDINTERFACEBGOP pIfBgOp = pBgOp->pIfBgOp;
+    RTUUID UuidCheckpoint;
+    RTUUID UuidModification;
+    uint64_t offResume = 0;
+
+    if (!pIfBgOp)
+        return 0;
+
+    int rc = pIfBgOp->pfnCheckpointLoad(pIfBgOp->Core.pvUser, &UuidCheckpoint, &offResume);
+    if (RT_FAILURE(rc))
+        return 0;
+
+    int rc2 = vdThreadStartRead(pDisk);
+    AssertRC(rc2);
+    rc = pImageFrom->Backend->pfnGetModificationUuid(pImageFrom->pBackendData, &UuidModification);
+    rc2 = vdThreadFinishRead(pDisk);
+    AssertRC(rc2);
+
+    if (   RT_SUCCESS(rc)
+        && !RTUuidIsNull(&UuidModification)
+        && !RTUuidCompare(&UuidModification, &UuidCheckpoint)
+        && offResume <= cbSize)
+    {
+        LogRel(("VD: Resuming merge of '%s' at offset %llu\n", pImageFrom->pszFilename, offResume));
+        pBgOp->offCheckpointLast = offResume;
+        return offResume;
+    }
+
+    return 0;
+}
+
+/**
+ * internal: wait until the next chunk of a background operation can be
+ * processed.
+ *
+ * Gives priority to foreground I/O by waiting until the disk was idle for the
+ * configured interval and then limits the bandwidth with a token bucket like
+ * PDMNetShaper does. The idle wait is bounded by VD_BGOP_IDLE_WAIT_INTERVALS
+ * times the idle interval (at least VD_BGOP_IDLE_WAIT_MIN_MS) so the operation
+ * always makes progress under constant foreground I/O.
+ *
+ * @returns VBox status code, failure if the operation should be cancelled.
+ * @param   pDisk       The disk.
+ * @param   pBgOp       The background operation state.
+ * @param   cbChunk     Size of the next chunk.
+ */
+static int vdBgOpThrottle(PVDISK pDisk, PVDBGOP pBgOp, size_t cbChunk)
+{
+    PVDINTERFACEBGOP pIfBgOp = pBgOp->pIfBgOp;
+    uint64_t tsIdleWaitStart = RTTimeMilliTS();
+
+    if (!pIfBgOp)
+        return VINF_SUCCESS;
+
+    for (;;)
+    {
+        uint64_t cbPerSecMax = 0;
+        uint32_t cMsIdle = 0;
+        uint64_t cMsWait = 0;
+
+        /* Query the limits every time, they can be changed while we are running. */
+        int rc = pIfBgOp->pfnQueryLimits(pIfBgOp->Core.pvUser, &cbPerSecMax, &cMsIdle);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        if (cbPerSecMax != pBgOp->cbPerSecMax)
+        {
+            pBgOp->cbPerSecMax = cbPerSecMax;
+            pBgOp->cbBucket    = RT_MAX(VD_BGOP_CHUNK_SIZE, cbPerSecMax * VD_BGOP_MAX_LATENCY / 1000);
+            pBgOp->cbTokensLast = RT_MIN(pBgOp->cbTokensLast, pBgOp->cbBucket);
+        }
+
+        /* The foreground I/O timestamp can be newer than ours if a request
+         * arrived between reading the clock and the timestamp. */
+        uint64_t tsNow = RTTimeMilliTS();
+        uint64_t tsFgIoLast = ASMAtomicReadU64(&pDisk->tsFgIoLast);
+        uint64_t cMsSinceFgIo = tsNow > tsFgIoLast ? tsNow - tsFgIoLast : 0;
+        uint64_t cMsIdleWaitMax = RT_MAX((uint64_t)cMsIdle * VD_BGOP_IDLE_WAIT_INTERVALS, VD_BGOP_IDLE_WAIT_MIN_MS);
+        if (   cMsIdle
+            && cMsSinceFgIo < cMsIdle
+            && tsNow - tsIdleWaitStart < cMsIdleWaitMax)
+            cMsWait = cMsIdle - cMsSinceFgIo;
+        else if (cbPerSecMax)
+        {
+            uint64_t tsNowNs = RTTimeNanoTS();
+            /* The bucket never holds more than a fraction of a second worth of
+             * tokens, so limiting the elapsed time avoids overflows. */
+            uint64_t cNsElapsed = RT_MIN(tsNowNs - pBgOp->tsUpdatedLast, RT_NS_1SEC);
+            uint64_t cbTokens = pBgOp->cbTokensLast + cNsElapsed * cbPerSecMax / RT_NS_1SEC;
+
+            pBgOp->cbTokensLast  = RT_MIN(cbTokens, pBgOp->cbBucket);
+            pBgOp->tsUpdatedLast = tsNowNs;
+            if (pBgOp->cbTokensLast >= cbChunk)
+            {
+                pBgOp->cbTokensLast -= cbChunk;
+                break;
+            }
+
+            cMsWait = (cbChunk - pBgOp->cbTokensLast) * 1000 / cbPerSecMax + 1;
+        }
+        else
+            break;
+
+        RTThreadSleep((RTMSINTERVAL)RT_MIN(cMsWait, VD_BGOP_WAIT_SLICE_MS));
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * internal: save a checkpoint for a background operation.
+ *
+ * @returns VBox status code.
+ * @param   pDisk       The disk.
+ * @param   pBgOp       The background operation state.
+ * @param   pImageFrom  The source image of the operation.
+ * @param   pImageTo    The target image of the operation.
+ * @param   uOffset     Everything before this offset was processed.
+ * @param   fForce      Flag whether to save the checkpoint even if the
+ *                      interval since the last one did not elapse yet.
+ */
+static int vdBgOpCheckpoint(PVDISK pDisk, PVDBGOP pBgOp, PVDIMAGE pImageFrom,
+                            PVDIMAGE pImageTo, uint64_t uOffset, bool fForce)
+{
+    PVDINTERFACEBGOP pIfBgOp = pBgOp->pIfBgOp;
+    RTUUID UuidModification;
+
+    if (   !pIfBgOp
+        || uOffset == pBgOp->offCheckpointLast
+        || (   !fForce
+            && uOffset - pBgOp->offCheckpointLast < VD_BGOP_CHECKPOINT_INTERVAL))
+        return VINF_SUCCESS;
+
+    int rc2 = vdThreadStartWrite(pDisk);
+    AssertRC(rc2);
+
+    /*
+     * The merged data must be on the disk before the checkpoint claims so.
+     * Flushing the last image also settles its modification UUID, any later
+     * write which is not relayed to the target changes it again.
+     */
+    int rc = vdBgOpFlushImage(pDisk, pImageTo);
+    if (RT_SUCCESS(rc) && pDisk->pLast != pImageTo)
+        rc = vdBgOpFlushImage(pDisk, pDisk->pLast);
+    if (RT_SUCCESS(rc))
+        rc = pImageFrom->Backend->pfnGetModificationUuid(pImageFrom->pBackendData, &UuidModification);
+
+    rc2 = vdThreadFinishWrite(pDisk);
+    AssertRC(rc2);
+
+    /* Images without modification UUIDs can't be checkpointed. */
+    if (   RT_SUCCESS(rc)
+        && !RTUuidIsNull(&UuidModification))
+    {
+        rc = pIfBgOp->pfnCheckpointSave(pIfBgOp->Core.pvUser, &UuidModification, uOffset);
+        if (RT_SUCCESS(rc))
+            pBgOp->offCheckpointLast = uOffset;
+    }
+    else if (rc == VERR_NOT_SUPPORTED)
+        rc = VINF_SUCCESS;
+
+    return rc;
+}
+
 /**
  * Merges two images (not necessarily with direct parent/child relationship).
  * As a side effect the source image and potentially the other images which
@@ -6967,11 +7712,19 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
     int rc2;
     bool fLockWrite = false, fLockRead = false;
     void *pvBuf = NULL;
+    VDBGOP BgOp;
 
     LogFlowFunc(("pDisk=%#p nImageFrom=%u nImageTo=%u pVDIfsOperation=%#p\n",
                  pDisk, nImageFrom, nImageTo, pVDIfsOperation));
 
     PVDINTERFACEPROGRESS pIfProgress = VDIfProgressGet(pVDIfsOperation);
+    PVDINTERFACEBGOP pIfBgOp = VDIfBgOpGet(pVDIfsOperation);
+    /* Merges running in the background use smaller chunks to keep the time
+     * the disk is locked short. */
+    size_t cbChunk = pIfBgOp ? VD_BGOP_CHUNK_SIZE : VD_MERGE_BUFFER_SIZE;
+
+    /* Don't touch pDisk before the sanity check below. */
+    BgOp.pIfBgOp = NULL;
 
     do
     {
@@ -7022,6 +7775,8 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
             break;
         }
 
+        vdBgOpInit(pDisk, &BgOp, pIfBgOp);
+
         /* Merging is done directly on the images itself. This potentially
          * causes trouble if the disk is full in the middle of operation. */
         if (nImageFrom < nImageTo)
@@ -7029,15 +7784,23 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
             /* Merge parent state into child. This means writing all not
              * allocated blocks in the destination image which are allocated in
              * the images to be merged. */
-            uint64_t uOffset = 0;
-            uint64_t cbRemaining = cbSize;
-            do
+            uint64_t uOffset = vdBgOpResume(pDisk, &BgOp, pImageFrom, cbSize);
+            uint64_t cbRemaining = cbSize - uOffset;
+            while (uOffset < cbSize)
             {
-                size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
+                size_t cbThisRead = RT_MIN(cbChunk, cbRemaining);
                 RTSGSEG SegmentBuf;
                 RTSGBUF SgBuf;
                 VDIOCTX IoCtx;
 
+                /* When cancelled save a checkpoint so the merge can be resumed. */
+                rc = vdBgOpThrottle(pDisk, &BgOp, cbThisRead);
+                if (RT_FAILURE(rc))
+                {
+                    vdBgOpCheckpoint(pDisk, &BgOp, pImageFrom, pImageTo, uOffset, true /* fForce */);
+                    break;
+                }
+
                 SegmentBuf.pvSeg = pvBuf;
                 SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
                 RTSgBufInit(&SgBuf, &SegmentBuf, 1);
@@ -7091,6 +7854,10 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
                 uOffset += cbThisRead;
                 cbRemaining -= cbThisRead;
 
+                rc = vdBgOpCheckpoint(pDisk, &BgOp, pImageFrom, pImageTo, uOffset, false /* fForce */);
+                if (RT_FAILURE(rc))
+                    break;
+
                 if (pIfProgress && pIfProgress->pfnProgress)
                 {
                     /** @todo r=klaus: this can update the progress to the same
@@ -7101,7 +7868,7 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
                     if (RT_FAILURE(rc))
                         break;
                 }
-            } while (uOffset < cbSize);
+            }
         }
         else
         {
@@ -7159,15 +7926,24 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
              * which are allocated in the image up to the source image to the
              * destination image. */
             unsigned uProgressOld = 0;
-            uint64_t uOffset = 0;
-            uint64_t cbRemaining = cbSize;
-            do
+            uint64_t uOffset = vdBgOpResume(pDisk, &BgOp, pImageFrom, cbSize);
+            uint64_t cbRemaining = cbSize - uOffset;
+            while (uOffset < cbSize)
             {
-                size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
+                size_t cbThisRead = RT_MIN(cbChunk, cbRemaining);
                 RTSGSEG SegmentBuf;
                 RTSGBUF SgBuf;
                 VDIOCTX IoCtx;
 
+                /* When cancelled save a checkpoint while the writes are still
+                 * relayed to the target. */
+                rc = vdBgOpThrottle(pDisk, &BgOp, cbThisRead);
+                if (RT_FAILURE(rc))
+                {
+                    vdBgOpCheckpoint(pDisk, &BgOp, pImageFrom, pImageTo, uOffset, true /* fForce */);
+                    break;
+                }
+
                 rc = VERR_VD_BLOCK_FREE;
 
                 SegmentBuf.pvSeg = pvBuf;
@@ -7213,6 +7989,10 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
                 uOffset += cbThisRead;
                 cbRemaining -= cbThisRead;
 
+                rc = vdBgOpCheckpoint(pDisk, &BgOp, pImageFrom, pImageTo, uOffset, false /* fForce */);
+                if (RT_FAILURE(rc))
+                    break;
+
                 unsigned uProgressNew = uOffset * 99 / cbSize;
                 if (uProgressNew != uProgressOld)
                 {
@@ -7227,7 +8007,7 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
                     }
                 }
 
-            } while (uOffset < cbSize);
+            }
 
             /* In case we set up a "write proxy" image above we must clear
              * this again now to prevent stray writes. Failure or not. */
@@ -7366,6 +8146,8 @@ VBOXDDU_DECL(int) VDMerge(PVDISK pDisk, unsigned nImageFrom,
         AssertRC(rc2);
     }
 
+    vdBgOpTerm(pDisk, &BgOp);
+
     if (pvBuf)
         RTMemTmpFree(pvBuf);
 
@@ -7434,6 +8216,8 @@ VBOXDDU_DECL(int) VDCopyEx(PVDISK pDiskFrom, unsigned nImage, PVDISK pDiskTo,
 
     PVDINTERFACEPROGRESS pIfProgress    = VDIfProgressGet(pVDIfsOperation);
     PVDINTERFACEPROGRESS pDstIfProgress = VDIfProgressGet(pDstVDIfsOperation);
+    PVDINTERFACECOPY     pIfCopy        = VDIfCopyGet(pVDIfsOperation);
+    unsigned             cReadAhead     = pIfCopy ? pIfCopy->cReadAhead : 0;
 
     do {
         /* Check arguments. */
@@ -7637,10 +8421,15 @@ VBOXDDU_DECL(int) VDCopyEx(PVDISK pDiskFrom, unsigned nImage, PVDISK pDiskTo,
         else
             cImagesToReadBack = pDiskTo->cImages - nImageToSame - 1;
 
+        /* A newly created dynamic base image reads as zeroes, so zero chunks don't need to be written. */
+        bool fDstZeroed =    pszFilename != NULL
+                          && cImagesTo == 0
+                          && !(uImageFlags & VD_IMAGE_FLAGS_FIXED);
+
         /* Copy the data. */
         rc = vdCopyHelper(pDiskFrom, pImageFrom, pDiskTo, cbSize,
                           cImagesFromReadBack, cImagesToReadBack,
-                          fSuppressRedundantIo, pIfProgress, pDstIfProgress);
+                          fSuppressRedundantIo, fDstZeroed, cReadAhead, pIfProgress, pDstIfProgress);
 
         if (RT_SUCCESS(rc))
         {
@@ -8554,6 +9343,8 @@ VBOXDDU_DECL(int) VDRead(PVDISK pDisk, uint64_t uOffset, void *pvBuf,
                            ("cbRead=%zu\n", cbRead),
                            rc = VERR_INVALID_PARAMETER);
 
+        vdFgIoNotify(pDisk);
+
         rc2 = vdThreadStartRead(pDisk);
         AssertRC(rc2);
         fLockRead = true;
@@ -8623,6 +9414,8 @@ VBOXDDU_DECL(int) VDWrite(PVDISK pDisk, uint64_t uOffset, const void *pvBuf,
                            ("cbWrite=%zu\n", cbWrite),
                            rc = VERR_INVALID_PARAMETER);
 
+        vdFgIoNotify(pDisk);
+
         rc2 = vdThreadStartWrite(pDisk);
         AssertRC(rc2);
         fLockWrite = true;
@@ -10197,6 +10990,8 @@ VBOXDDU_DECL(int) VDAsyncRead(PVDISK pDisk, uint64_t uOffset, size_t cbRead,
                            ("pcSgBuf=%#p\n", pcSgBuf),
                            rc = VERR_INVALID_PARAMETER);
 
+        vdFgIoNotify(pDisk);
+
         rc2 = vdThreadStartRead(pDisk);
         AssertRC(rc2);
         fLockRead = true;
@@ -10268,6 +11063,8 @@ VBOXDDU_DECL(int) VDAsyncWrite(PVDISK pDisk, uint64_t uOffset, size_t cbWrite,
                            ("pcSgBuf=%#p\n", pcSgBuf),
                            rc = VERR_INVALID_PARAMETER);
 
+        vdFgIoNotify(pDisk);
+
         rc2 = vdThreadStartWrite(pDisk);
         AssertRC(rc2);
         fLockWrite = true;
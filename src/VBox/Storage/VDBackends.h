@@ -37,6 +37,7 @@ extern const VDIMAGEBACKEND g_ISCSIBackend;
 extern const VDIMAGEBACKEND g_QedBackend;
 extern const VDIMAGEBACKEND g_QCowBackend;
 extern const VDIMAGEBACKEND g_VhdxBackend;
+extern const VDIMAGEBACKEND g_VddBackend;
 extern const VDIMAGEBACKEND g_CueBackend;
 extern const VDIMAGEBACKEND g_VBoxIsoMakerBackend;
 
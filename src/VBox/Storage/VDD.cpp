@@ -0,0 +1,2563 @@
+/* $Id$ */
+/** @file
+ * VDD - Deduplicating disk image backed by a shared content addressed chunk store.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_VD_VDD
+#include <VBox/vd-plugin.h>
+#include <VBox/err.h>
+
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/dir.h>
+#include <iprt/file.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/once.h>
+#include <iprt/path.h>
+#include <iprt/semaphore.h>
+#include <iprt/sha.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/uuid.h>
+
+#include "VDBackends.h"
+#include "VDBackendsInline.h"
+#include "VDTblCache.h"
+
+/**
+ * The VDD backend stores the block map of a virtual disk in the image file
+ * but keeps the block contents in a chunk store shared by all VDD images on
+ * the host which are configured to use the same store directory. Chunks are
+ * keyed by the SHA-256 digest of their content and reference counted, so
+ * identical blocks of different images (typically the differencing images
+ * of linked clones installed from the same media) occupy disk space and host
+ * page cache only once.
+ *
+ * The store directory contains two files:
+ *    - VBoxDedup.idx: A header followed by an open addressing hash table
+ *                     mapping the digest to the chunk slot and reference count.
+ *    - VBoxDedup.dat: The chunks, one per slot. Unused slots are chained into
+ *                     a free list through their first 8 bytes.
+ *
+ * Modifications of the store are serialized with a file lock on the index
+ * so several processes can share a store. Reading chunk data goes through
+ * the regular I/O interface.
+ *
+ * Asynchronous block writes are handed to a worker thread per store because
+ * waiting for the file lock and the synchronous store I/O must not stall the
+ * I/O thread. The worker references the chunks of all queued writes, flushes
+ * the store and only then writes the block map entries, so the map never
+ * refers to a chunk which isn't on the disk. The references of the chunks a
+ * map entry referred to before are dropped only after the image was flushed
+ * with the new entry. A crash in between leaks chunks but never leaves map
+ * entries pointing to released ones.
+ *
+ * Missing things to implement:
+ *    - resizing
+ *    - compaction of the chunk store
+ *    - a consistency check to reclaim chunks leaked by a crash
+ */
+
+
+/*********************************************************************************************************************************
+*   Constants And Macros, Structures and Typedefs                                                                                *
+*********************************************************************************************************************************/
+
+/** The image header magic ('VDD!'). */
+#define VDD_HDR_MAGIC               UINT32_C(0x21444456)
+/** The current image header version. */
+#define VDD_HDR_VERSION             UINT32_C(1)
+/** Space reserved for the image header, the block map starts right after it. */
+#define VDD_HDR_SIZE                _4K
+/** Maximum length of the store path including the terminator. */
+#define VDD_STORE_PATH_MAX          2048
+
+/** The block size of the image and the chunk size of the store. */
+#define VDD_BLOCK_SIZE              _64K
+/** Size of a block map page loaded through the table cache. */
+#define VDD_MAP_PAGE_SIZE           _64K
+/** Number of block map entries per page. */
+#define VDD_MAP_PAGE_ENTRIES        (VDD_MAP_PAGE_SIZE / sizeof(uint64_t))
+
+/** Block map entry: Block is not allocated in this image. */
+#define VDD_MAP_ENTRY_FREE          UINT64_C(0)
+/** Block map entry: Block is allocated and contains only zeros. */
+#define VDD_MAP_ENTRY_ZERO          UINT64_MAX
+/** Creates a block map entry for the given store bucket and chunk slot. */
+#define VDD_MAP_ENTRY_MAKE(a_idxBucket, a_idxSlot) \
+    (((uint64_t)((a_idxBucket) + 1) << 32) | (a_idxSlot))
+/** Returns the store bucket index from the given chunk block map entry. */
+#define VDD_MAP_ENTRY_GET_BUCKET(a_uEntry)  ((uint32_t)((a_uEntry) >> 32) - 1)
+/** Returns the chunk slot from the given chunk block map entry. */
+#define VDD_MAP_ENTRY_GET_SLOT(a_uEntry)    ((uint32_t)(a_uEntry))
+/** Returns whether the given block map entry refers to a chunk in the store. */
+#define VDD_MAP_ENTRY_IS_CHUNK(a_uEntry) \
+    ((a_uEntry) != VDD_MAP_ENTRY_FREE && (a_uEntry) != VDD_MAP_ENTRY_ZERO)
+
+/** The store index magic ('VDDS'). */
+#define VDD_STORE_MAGIC             UINT32_C(0x53444456)
+/** The current store index version. */
+#define VDD_STORE_VERSION           UINT32_C(1)
+/** Space reserved for the store index header. */
+#define VDD_STORE_HDR_SIZE          _4K
+/** Number of hash buckets of a new store (64GB of unique data with the default chunk size). */
+#define VDD_STORE_BUCKETS_DEFAULT   _1M
+/** Name of the store index file. */
+#define VDD_STORE_IDX_NAME          "VBoxDedup.idx"
+/** Name of the store chunk data file. */
+#define VDD_STORE_DAT_NAME          "VBoxDedup.dat"
+
+/** Bucket is in use. */
+#define VDD_STORE_BUCKET_F_USED     RT_BIT_32(0)
+/** Bucket was used before, probing has to continue past it. */
+#define VDD_STORE_BUCKET_F_DELETED  RT_BIT_32(1)
+
+#pragma pack(1)
+/**
+ * Geometry as stored in the image header.
+ */
+typedef struct VddGeometry
+{
+    uint32_t    cCylinders;
+    uint32_t    cHeads;
+    uint32_t    cSectors;
+} VddGeometry;
+
+/**
+ * The image header, little endian.
+ */
+typedef struct VddHeader
+{
+    /** Magic value. */
+    uint32_t    u32Magic;
+    /** Header version. */
+    uint32_t    u32Version;
+    /** Size of the header structure. */
+    uint32_t    cbHeader;
+    /** Image flags, VD_IMAGE_FLAGS_*. */
+    uint32_t    fImageFlags;
+    /** Size of the virtual disk in bytes. */
+    uint64_t    cbDisk;
+    /** Size of a block in bytes. */
+    uint32_t    cbBlock;
+    /** Number of blocks. */
+    uint32_t    cBlocks;
+    /** Offset of the block map in the image. */
+    uint64_t    offMap;
+    /** Image UUID. */
+    RTUUID      UuidCreate;
+    /** Image modification UUID. */
+    RTUUID      UuidModify;
+    /** Parent image UUID. */
+    RTUUID      UuidParent;
+    /** Parent image modification UUID. */
+    RTUUID      UuidParentModify;
+    /** Physical geometry. */
+    VddGeometry PCHSGeometry;
+    /** Logical geometry. */
+    VddGeometry LCHSGeometry;
+    /** Absolute path of the chunk store directory, zero terminated. */
+    char        szStore[VDD_STORE_PATH_MAX];
+} VddHeader;
+AssertCompile(sizeof(VddHeader) <= VDD_HDR_SIZE);
+/** Pointer to the image header. */
+typedef VddHeader *PVddHeader;
+
+/**
+ * The store index header, little endian.
+ */
+typedef struct VddStoreHeader
+{
+    /** Magic value. */
+    uint32_t    u32Magic;
+    /** Header version. */
+    uint32_t    u32Version;
+    /** Size of a chunk in bytes. */
+    uint32_t    cbChunk;
+    /** Number of hash buckets following the header. */
+    uint32_t    cBuckets;
+    /** Number of buckets in use. */
+    uint32_t    cBucketsUsed;
+    /** Number of chunk slots in the data file. */
+    uint32_t    cSlots;
+    /** Head of the free slot list, slot index + 1 or 0 if the list is empty. */
+    uint32_t    idxSlotFreeHead;
+    /** Reserved, MBZ. */
+    uint32_t    u32Reserved;
+} VddStoreHeader;
+AssertCompile(sizeof(VddStoreHeader) <= VDD_STORE_HDR_SIZE);
+/** Pointer to the store index header. */
+typedef VddStoreHeader *PVddStoreHeader;
+
+/**
+ * A store hash bucket, little endian.
+ */
+typedef struct VddStoreBucket
+{
+    /** SHA-256 digest of the chunk content. */
+    uint8_t     abSha256[RTSHA256_HASH_SIZE];
+    /** The chunk slot in the data file. */
+    uint32_t    idxSlot;
+    /** Number of block map entries referencing the chunk. */
+    uint32_t    cRefs;
+    /** Bucket flags, VDD_STORE_BUCKET_F_*. */
+    uint32_t    fFlags;
+    /** Reserved, MBZ. */
+    uint32_t    u32Reserved;
+} VddStoreBucket;
+AssertCompileSize(VddStoreBucket, 48);
+/** Pointer to a store hash bucket. */
+typedef VddStoreBucket *PVddStoreBucket;
+#pragma pack()
+
+/**
+ * Array of chunk references waiting to be dropped.
+ */
+typedef struct VDDUNREFS
+{
+    /** Block map entries referencing the chunks. */
+    uint64_t            *paEntries;
+    /** Number of entries. */
+    uint32_t            cEntries;
+    /** Number of entries allocated. */
+    uint32_t            cEntriesMax;
+} VDDUNREFS;
+/** Pointer to an array of chunk references to drop. */
+typedef VDDUNREFS *PVDDUNREFS;
+
+/**
+ * Chunk store instance, shared by all images of the process using the same store.
+ */
+typedef struct VDDSTORE
+{
+    /** Node in the list of open stores. */
+    RTLISTNODE          NdStores;
+    /** Number of images referencing the store, protected by the store list mutex. */
+    uint32_t            cRefs;
+    /** Serializes access to the store in this process, the file lock doesn't. */
+    RTSEMFASTMUTEX      hMtx;
+    /** The index file. */
+    RTFILE              hFileIdx;
+    /** The chunk data file. */
+    RTFILE              hFileDat;
+    /** Header of the store in host endianess, valid while the store is locked. */
+    VddStoreHeader      Hdr;
+    /** The worker thread doing the store modifications of asynchronous writes. */
+    RTTHREAD            hThreadWorker;
+    /** Event semaphore to wake up the worker. */
+    RTSEMEVENT          hEvtWorker;
+    /** Flag whether the worker should terminate after processing all requests. */
+    volatile bool       fShutdown;
+    /** Protects the request list and the chunk releases below. */
+    RTSEMFASTMUTEX      hMtxReqs;
+    /** Block writes waiting for the worker, VDDBLOCKWRITE. */
+    RTLISTANCHOR        LstWrites;
+    /** Chunk references the worker drops. */
+    VDDUNREFS           Unrefs;
+    /** The store directory. */
+    char                szPath[1];
+} VDDSTORE;
+/** Pointer to a chunk store instance. */
+typedef VDDSTORE *PVDDSTORE;
+
+/**
+ * VDD image data structure.
+ */
+typedef struct VDDIMAGE
+{
+    /** Image name. */
+    const char          *pszFilename;
+    /** Storage handle. */
+    PVDIOSTORAGE        pStorage;
+    /** Storage handle of the store data file used for reading chunks. */
+    PVDIOSTORAGE        pStorageDat;
+
+    /** Pointer to the per-disk VD interface list. */
+    PVDINTERFACE        pVDIfsDisk;
+    /** Pointer to the per-image VD interface list. */
+    PVDINTERFACE        pVDIfsImage;
+    /** Error interface. */
+    PVDINTERFACEERROR   pIfError;
+    /** I/O interface. */
+    PVDINTERFACEIOINT   pIfIo;
+
+    /** Open flags passed by VBoxHD layer. */
+    unsigned            uOpenFlags;
+    /** Image flags defined during creation or determined during open. */
+    unsigned            uImageFlags;
+    /** Total size of the image. */
+    uint64_t            cbSize;
+    /** Physical geometry of this image. */
+    VDGEOMETRY          PCHSGeometry;
+    /** Logical geometry of this image. */
+    VDGEOMETRY          LCHSGeometry;
+    /** Image UUID. */
+    RTUUID              ImageUuid;
+    /** Image modification UUID. */
+    RTUUID              ModificationUuid;
+    /** Parent image UUID. */
+    RTUUID              ParentUuid;
+    /** Parent image modification UUID. */
+    RTUUID              ParentModificationUuid;
+
+    /** Number of blocks. */
+    uint32_t            cBlocks;
+    /** Offset of the block map. */
+    uint64_t            offMap;
+    /** Block map page cache. */
+    PVDTBLCACHE         pMapCache;
+
+    /** The chunk store directory. */
+    char                szStore[VDD_STORE_PATH_MAX];
+    /** The chunk store, opened when the image is opened for writing. */
+    PVDDSTORE           pStore;
+    /** Serializes block map updates and protects the members below. */
+    RTSEMFASTMUTEX      hMtxUpdate;
+    /** Chunk references to drop once the image was flushed. */
+    VDDUNREFS           Unrefs;
+    /** Block writes completed by the store worker, VDDBLOCKWRITE. */
+    RTLISTANCHOR        LstWritesDone;
+
+    /** The static region list. */
+    VDREGIONLIST        RegionList;
+} VDDIMAGE, *PVDDIMAGE;
+
+/**
+ * A block write waiting for its chunk to be referenced and the map entry to be written.
+ */
+typedef struct VDDBLOCKWRITE
+{
+    /** Node in the request list of the store or the completed list of the image. */
+    RTLISTNODE          NdWrites;
+    /** The image written to. */
+    PVDDIMAGE           pImage;
+    /** The I/O context to continue when the write completed, NULL if synchronous. */
+    PVDIOCTX            pIoCtx;
+    /** The map page containing the entry, referenced until the write was reaped. */
+    PVDTBLCACHEENTRY    pMapEntry;
+    /** The block written. */
+    uint32_t            idxBlock;
+    /** Status code of the write. */
+    int                 rcReq;
+    /** The new block map entry, VDD_MAP_ENTRY_FREE until the chunk is referenced. */
+    uint64_t            uEntry;
+    /** SHA-256 digest of the block content, valid if the block isn't zero. */
+    uint8_t             abSha256[RTSHA256_HASH_SIZE];
+    /** The block content. */
+    uint8_t             abBlock[VDD_BLOCK_SIZE];
+} VDDBLOCKWRITE;
+/** Pointer to a block write. */
+typedef VDDBLOCKWRITE *PVDDBLOCKWRITE;
+
+
+/*********************************************************************************************************************************
+*   Static Variables                                                                                                             *
+*********************************************************************************************************************************/
+
+/** NULL-terminated array of supported file extensions. */
+static const VDFILEEXTENSION s_aVddFileExtensions[] =
+{
+    {"vdd", VDTYPE_HDD},
+    {NULL,  VDTYPE_INVALID}
+};
+
+/** Configuration keys. */
+static const VDCONFIGINFO s_aVddConfigInfo[] =
+{
+    { "DedupStore",           NULL,                                      VDCFGVALUETYPE_STRING,  0 },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
+/** Initialize the store list once. */
+static RTONCE           g_VddStoreOnce = RTONCE_INITIALIZER;
+/** Protects the list of open stores. */
+static RTSEMFASTMUTEX   g_hVddStoreMtx = NIL_RTSEMFASTMUTEX;
+/** List of open stores. */
+static RTLISTANCHOR     g_VddStoreList;
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+
+/**
+ * Converts the image header to the host endianess and performs basic checks.
+ *
+ * @returns Whether the given header is valid or not.
+ * @param   pHeader    Pointer to the header to convert.
+ */
+static bool vddHdrConvertToHostEndianess(PVddHeader pHeader)
+{
+    pHeader->u32Magic                  = RT_LE2H_U32(pHeader->u32Magic);
+    pHeader->u32Version                = RT_LE2H_U32(pHeader->u32Version);
+    pHeader->cbHeader                  = RT_LE2H_U32(pHeader->cbHeader);
+    pHeader->fImageFlags               = RT_LE2H_U32(pHeader->fImageFlags);
+    pHeader->cbDisk                    = RT_LE2H_U64(pHeader->cbDisk);
+    pHeader->cbBlock                   = RT_LE2H_U32(pHeader->cbBlock);
+    pHeader->cBlocks                   = RT_LE2H_U32(pHeader->cBlocks);
+    pHeader->offMap                    = RT_LE2H_U64(pHeader->offMap);
+    pHeader->PCHSGeometry.cCylinders   = RT_LE2H_U32(pHeader->PCHSGeometry.cCylinders);
+    pHeader->PCHSGeometry.cHeads       = RT_LE2H_U32(pHeader->PCHSGeometry.cHeads);
+    pHeader->PCHSGeometry.cSectors     = RT_LE2H_U32(pHeader->PCHSGeometry.cSectors);
+    pHeader->LCHSGeometry.cCylinders   = RT_LE2H_U32(pHeader->LCHSGeometry.cCylinders);
+    pHeader->LCHSGeometry.cHeads       = RT_LE2H_U32(pHeader->LCHSGeometry.cHeads);
+    pHeader->LCHSGeometry.cSectors     = RT_LE2H_U32(pHeader->LCHSGeometry.cSectors);
+
+    if (   pHeader->u32Magic != VDD_HDR_MAGIC
+        || pHeader->u32Version != VDD_HDR_VERSION
+        || pHeader->cbHeader != sizeof(VddHeader)
+        || pHeader->cbBlock != VDD_BLOCK_SIZE
+        || pHeader->offMap < VDD_HDR_SIZE
+        || pHeader->cBlocks != (pHeader->cbDisk + pHeader->cbBlock - 1) / pHeader->cbBlock
+        || !RTStrEnd(&pHeader->szStore[0], sizeof(pHeader->szStore)))
+        return false;
+
+    return true;
+}
+
+/**
+ * Creates the on disk header from the image state.
+ *
+ * @returns nothing.
+ * @param   pImage     Image instance data.
+ * @param   pHeader    Where to store the header in little endian format.
+ */
+static void vddHdrConvertFromHostEndianess(PVDDIMAGE pImage, PVddHeader pHeader)
+{
+    RT_ZERO(*pHeader);
+    pHeader->u32Magic                  = RT_H2LE_U32(VDD_HDR_MAGIC);
+    pHeader->u32Version                = RT_H2LE_U32(VDD_HDR_VERSION);
+    pHeader->cbHeader                  = RT_H2LE_U32(sizeof(VddHeader));
+    pHeader->fImageFlags               = RT_H2LE_U32(pImage->uImageFlags);
+    pHeader->cbDisk                    = RT_H2LE_U64(pImage->cbSize);
+    pHeader->cbBlock                   = RT_H2LE_U32(VDD_BLOCK_SIZE);
+    pHeader->cBlocks                   = RT_H2LE_U32(pImage->cBlocks);
+    pHeader->offMap                    = RT_H2LE_U64(pImage->offMap);
+    pHeader->UuidCreate                = pImage->ImageUuid;
+    pHeader->UuidModify                = pImage->ModificationUuid;
+    pHeader->UuidParent                = pImage->ParentUuid;
+    pHeader->UuidParentModify          = pImage->ParentModificationUuid;
+    pHeader->PCHSGeometry.cCylinders   = RT_H2LE_U32(pImage->PCHSGeometry.cCylinders);
+    pHeader->PCHSGeometry.cHeads       = RT_H2LE_U32(pImage->PCHSGeometry.cHeads);
+    pHeader->PCHSGeometry.cSectors     = RT_H2LE_U32(pImage->PCHSGeometry.cSectors);
+    pHeader->LCHSGeometry.cCylinders   = RT_H2LE_U32(pImage->LCHSGeometry.cCylinders);
+    pHeader->LCHSGeometry.cHeads       = RT_H2LE_U32(pImage->LCHSGeometry.cHeads);
+    pHeader->LCHSGeometry.cSectors     = RT_H2LE_U32(pImage->LCHSGeometry.cSectors);
+    RTStrCopy(pHeader->szStore, sizeof(pHeader->szStore), pImage->szStore);
+}
+
+/**
+ * Returns the size of the block map in the image rounded up to full map pages.
+ *
+ * @returns Size of the block map in bytes.
+ * @param   cBlocks    Number of blocks of the image.
+ */
+DECLINLINE(uint64_t) vddMapGetSize(uint32_t cBlocks)
+{
+    return RT_ALIGN_64((uint64_t)cBlocks * sizeof(uint64_t), VDD_MAP_PAGE_SIZE);
+}
+
+/**
+ * Initializes the list of open stores.
+ *
+ * @returns IPRT status code.
+ * @param   pvUser     Opaque user data, unused.
+ */
+static DECLCALLBACK(int) vddStoreListInit(void *pvUser)
+{
+    RT_NOREF1(pvUser);
+    RTListInit(&g_VddStoreList);
+    return RTSemFastMutexCreate(&g_hVddStoreMtx);
+}
+
+/**
+ * Reads the store header, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ */
+static int vddStoreHdrRead(PVDDSTORE pStore)
+{
+    int rc = RTFileReadAt(pStore->hFileIdx, 0, &pStore->Hdr, sizeof(pStore->Hdr), NULL);
+    if (RT_SUCCESS(rc))
+    {
+        pStore->Hdr.u32Magic        = RT_LE2H_U32(pStore->Hdr.u32Magic);
+        pStore->Hdr.u32Version      = RT_LE2H_U32(pStore->Hdr.u32Version);
+        pStore->Hdr.cbChunk         = RT_LE2H_U32(pStore->Hdr.cbChunk);
+        pStore->Hdr.cBuckets        = RT_LE2H_U32(pStore->Hdr.cBuckets);
+        pStore->Hdr.cBucketsUsed    = RT_LE2H_U32(pStore->Hdr.cBucketsUsed);
+        pStore->Hdr.cSlots          = RT_LE2H_U32(pStore->Hdr.cSlots);
+        pStore->Hdr.idxSlotFreeHead = RT_LE2H_U32(pStore->Hdr.idxSlotFreeHead);
+    }
+    return rc;
+}
+
+/**
+ * Locks the given store against concurrent modifications by this and other
+ * processes.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store to lock.
+ * @param   fLoadHdr   Flag whether to load the current store header.
+ */
+static int vddStoreLock(PVDDSTORE pStore, bool fLoadHdr)
+{
+    RTSemFastMutexRequest(pStore->hMtx);
+    int rc = RTFileLock(pStore->hFileIdx, RTFILE_LOCK_WRITE | RTFILE_LOCK_WAIT, 0, VDD_STORE_HDR_SIZE);
+    if (RT_SUCCESS(rc))
+    {
+        if (fLoadHdr)
+            rc = vddStoreHdrRead(pStore);
+        if (RT_SUCCESS(rc))
+            return VINF_SUCCESS;
+
+        RTFileUnlock(pStore->hFileIdx, 0, VDD_STORE_HDR_SIZE);
+    }
+
+    RTSemFastMutexRelease(pStore->hMtx);
+    return rc;
+}
+
+/**
+ * Unlocks the given store.
+ *
+ * @returns nothing.
+ * @param   pStore     The store to unlock.
+ */
+static void vddStoreUnlock(PVDDSTORE pStore)
+{
+    RTFileUnlock(pStore->hFileIdx, 0, VDD_STORE_HDR_SIZE);
+    RTSemFastMutexRelease(pStore->hMtx);
+}
+
+/**
+ * Writes the store header, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ */
+static int vddStoreHdrWrite(PVDDSTORE pStore)
+{
+    VddStoreHeader Hdr;
+
+    Hdr.u32Magic        = RT_H2LE_U32(pStore->Hdr.u32Magic);
+    Hdr.u32Version      = RT_H2LE_U32(pStore->Hdr.u32Version);
+    Hdr.cbChunk         = RT_H2LE_U32(pStore->Hdr.cbChunk);
+    Hdr.cBuckets        = RT_H2LE_U32(pStore->Hdr.cBuckets);
+    Hdr.cBucketsUsed    = RT_H2LE_U32(pStore->Hdr.cBucketsUsed);
+    Hdr.cSlots          = RT_H2LE_U32(pStore->Hdr.cSlots);
+    Hdr.idxSlotFreeHead = RT_H2LE_U32(pStore->Hdr.idxSlotFreeHead);
+    Hdr.u32Reserved     = 0;
+    return RTFileWriteAt(pStore->hFileIdx, 0, &Hdr, sizeof(Hdr), NULL);
+}
+
+/**
+ * Reads a hash bucket from the store index, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ * @param   idxBucket  The bucket to read.
+ * @param   pBucket    Where to store the bucket in host endianess.
+ */
+static int vddStoreBucketRead(PVDDSTORE pStore, uint32_t idxBucket, PVddStoreBucket pBucket)
+{
+    int rc = RTFileReadAt(pStore->hFileIdx, VDD_STORE_HDR_SIZE + (uint64_t)idxBucket * sizeof(VddStoreBucket),
+                          pBucket, sizeof(*pBucket), NULL);
+    if (RT_SUCCESS(rc))
+    {
+        pBucket->idxSlot = RT_LE2H_U32(pBucket->idxSlot);
+        pBucket->cRefs   = RT_LE2H_U32(pBucket->cRefs);
+        pBucket->fFlags  = RT_LE2H_U32(pBucket->fFlags);
+    }
+    return rc;
+}
+
+/**
+ * Writes a hash bucket to the store index, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ * @param   idxBucket  The bucket to write.
+ * @param   pBucket    The bucket in host endianess.
+ */
+static int vddStoreBucketWrite(PVDDSTORE pStore, uint32_t idxBucket, const VddStoreBucket *pBucket)
+{
+    VddStoreBucket Bucket = *pBucket;
+
+    Bucket.idxSlot     = RT_H2LE_U32(Bucket.idxSlot);
+    Bucket.cRefs       = RT_H2LE_U32(Bucket.cRefs);
+    Bucket.fFlags      = RT_H2LE_U32(Bucket.fFlags);
+    Bucket.u32Reserved = 0;
+    return RTFileWriteAt(pStore->hFileIdx, VDD_STORE_HDR_SIZE + (uint64_t)idxBucket * sizeof(VddStoreBucket),
+                         &Bucket, sizeof(Bucket), NULL);
+}
+
+/**
+ * Creates or validates the store index after it was opened, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ */
+static int vddStoreInit(PVDDSTORE pStore)
+{
+    uint64_t cbIdx = 0;
+    int rc = RTFileGetSize(pStore->hFileIdx, &cbIdx);
+    if (RT_SUCCESS(rc))
+    {
+        if (!cbIdx)
+        {
+            /* Fresh store, the bucket array stays sparse until it is populated. */
+            pStore->Hdr.u32Magic        = VDD_STORE_MAGIC;
+            pStore->Hdr.u32Version      = VDD_STORE_VERSION;
+            pStore->Hdr.cbChunk         = VDD_BLOCK_SIZE;
+            pStore->Hdr.cBuckets        = VDD_STORE_BUCKETS_DEFAULT;
+            pStore->Hdr.cBucketsUsed    = 0;
+            pStore->Hdr.cSlots          = 0;
+            pStore->Hdr.idxSlotFreeHead = 0;
+            rc = RTFileSetSize(pStore->hFileIdx, VDD_STORE_HDR_SIZE + (uint64_t)pStore->Hdr.cBuckets * sizeof(VddStoreBucket));
+            if (RT_SUCCESS(rc))
+                rc = vddStoreHdrWrite(pStore);
+        }
+        else
+        {
+            rc = vddStoreHdrRead(pStore);
+            if (   RT_SUCCESS(rc)
+                && (   pStore->Hdr.u32Magic != VDD_STORE_MAGIC
+                    || pStore->Hdr.u32Version != VDD_STORE_VERSION
+                    || pStore->Hdr.cbChunk != VDD_BLOCK_SIZE
+                    || !pStore->Hdr.cBuckets
+                    || cbIdx < VDD_STORE_HDR_SIZE + (uint64_t)pStore->Hdr.cBuckets * sizeof(VddStoreBucket)))
+                rc = VERR_VD_GEN_INVALID_HEADER;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * Looks up the chunk with the given content in the store, adding it if it is not
+ * there yet, and references it, the store must be locked.
+ *
+ * The chunk data is written before the bucket referring to it but neither is
+ * flushed, that is up to the caller.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_DISK_FULL if the store index has no room for another chunk.
+ * @param   pStore     The store.
+ * @param   pabHash    SHA-256 digest of the chunk content.
+ * @param   pvChunk    The chunk content.
+ * @param   puEntry    Where to store the block map entry referencing the chunk.
+ */
+static int vddStoreChunkRef(PVDDSTORE pStore, const uint8_t *pabHash, const void *pvChunk, uint64_t *puEntry)
+{
+    int            rc        = VINF_SUCCESS;
+    uint32_t const cBuckets  = pStore->Hdr.cBuckets;
+    uint32_t       idxBucket = RT_MAKE_U32_FROM_U8(pabHash[0], pabHash[1], pabHash[2], pabHash[3]) % cBuckets;
+    uint32_t       idxFree   = UINT32_MAX;
+    VddStoreBucket Bucket;
+
+    for (uint32_t cProbes = 0; cProbes < cBuckets; cProbes++)
+    {
+        rc = vddStoreBucketRead(pStore, idxBucket, &Bucket);
+        if (RT_FAILURE(rc))
+            break;
+
+        if (Bucket.fFlags & VDD_STORE_BUCKET_F_USED)
+        {
+            if (!memcmp(&Bucket.abSha256[0], pabHash, sizeof(Bucket.abSha256)))
+            {
+                /* Found an identical chunk, just reference it. */
+                if (Bucket.cRefs < UINT32_MAX)
+                {
+                    Bucket.cRefs++;
+                    rc = vddStoreBucketWrite(pStore, idxBucket, &Bucket);
+                    if (RT_SUCCESS(rc))
+                        *puEntry = VDD_MAP_ENTRY_MAKE(idxBucket, Bucket.idxSlot);
+                }
+                else
+                    rc = VERR_OUT_OF_RANGE;
+                return rc;
+            }
+        }
+        else
+        {
+            if (idxFree == UINT32_MAX)
+                idxFree = idxBucket;
+            if (!(Bucket.fFlags & VDD_STORE_BUCKET_F_DELETED))
+                break; /* End of the probe sequence, the chunk is not in the store. */
+        }
+
+        idxBucket = (idxBucket + 1) % cBuckets;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        /* Keep the load factor below 15/16 so probe sequences stay short. */
+        if (   idxFree != UINT32_MAX
+            && pStore->Hdr.cBucketsUsed < cBuckets - cBuckets / 16)
+        {
+            /*
+             * Allocate a slot and commit the store header before anything refers
+             * to the slot so a crash can leak it at worst.
+             */
+            uint32_t idxSlot;
+            if (pStore->Hdr.idxSlotFreeHead)
+            {
+                uint64_t idxSlotNext = 0;
+
+                idxSlot = pStore->Hdr.idxSlotFreeHead - 1;
+                rc = RTFileReadAt(pStore->hFileDat, (uint64_t)idxSlot * pStore->Hdr.cbChunk,
+                                  &idxSlotNext, sizeof(idxSlotNext), NULL);
+                if (RT_SUCCESS(rc))
+                    pStore->Hdr.idxSlotFreeHead = (uint32_t)RT_LE2H_U64(idxSlotNext);
+            }
+            else if (pStore->Hdr.cSlots < UINT32_MAX)
+                idxSlot = pStore->Hdr.cSlots++;
+            else
+                rc = VERR_DISK_FULL;
+
+            if (RT_SUCCESS(rc))
+            {
+                pStore->Hdr.cBucketsUsed++;
+                rc = vddStoreHdrWrite(pStore);
+            }
+            if (RT_SUCCESS(rc))
+                rc = RTFileWriteAt(pStore->hFileDat, (uint64_t)idxSlot * pStore->Hdr.cbChunk,
+                                   pvChunk, pStore->Hdr.cbChunk, NULL);
+            if (RT_SUCCESS(rc))
+            {
+                memcpy(&Bucket.abSha256[0], pabHash, sizeof(Bucket.abSha256));
+                Bucket.idxSlot = idxSlot;
+                Bucket.cRefs   = 1;
+                Bucket.fFlags  = VDD_STORE_BUCKET_F_USED;
+                rc = vddStoreBucketWrite(pStore, idxFree, &Bucket);
+                if (RT_SUCCESS(rc))
+                    *puEntry = VDD_MAP_ENTRY_MAKE(idxFree, idxSlot);
+            }
+        }
+        else
+            rc = VERR_DISK_FULL;
+    }
+
+    return rc;
+}
+
+/**
+ * Drops a reference to the chunk the given block map entry refers to, freeing
+ * the chunk slot if it was the last one, the store must be locked.
+ *
+ * @returns VBox status code.
+ * @param   pStore     The store.
+ * @param   uEntry     The block map entry referencing the chunk.
+ */
+static int vddStoreChunkUnref(PVDDSTORE pStore, uint64_t uEntry)
+{
+    Assert(VDD_MAP_ENTRY_IS_CHUNK(uEntry));
+
+    int rc;
+    uint32_t idxBucket = VDD_MAP_ENTRY_GET_BUCKET(uEntry);
+    VddStoreBucket Bucket;
+
+    if (idxBucket < pStore->Hdr.cBuckets)
+        rc = vddStoreBucketRead(pStore, idxBucket, &Bucket);
+    else
+        rc = VERR_OUT_OF_RANGE;
+
+    if (RT_SUCCESS(rc))
+    {
+        if (   (Bucket.fFlags & VDD_STORE_BUCKET_F_USED)
+            && Bucket.idxSlot == VDD_MAP_ENTRY_GET_SLOT(uEntry)
+            && Bucket.cRefs > 0)
+        {
+            Bucket.cRefs--;
+            if (!Bucket.cRefs)
+                Bucket.fFlags = VDD_STORE_BUCKET_F_DELETED;
+            rc = vddStoreBucketWrite(pStore, idxBucket, &Bucket);
+            if (   RT_SUCCESS(rc)
+                && !Bucket.cRefs)
+            {
+                /* Put the slot onto the free list, the bucket doesn't point to it anymore. */
+                uint64_t idxSlotNext = RT_H2LE_U64(pStore->Hdr.idxSlotFreeHead);
+                rc = RTFileWriteAt(pStore->hFileDat, (uint64_t)Bucket.idxSlot * pStore->Hdr.cbChunk,
+                                   &idxSlotNext, sizeof(idxSlotNext), NULL);
+                if (RT_SUCCESS(rc))
+                {
+                    pStore->Hdr.idxSlotFreeHead = Bucket.idxSlot + 1;
+                    pStore->Hdr.cBucketsUsed--;
+                    rc = vddStoreHdrWrite(pStore);
+                }
+            }
+        }
+        else
+            rc = VERR_VD_GEN_INVALID_HEADER; /* The block map doesn't match the store. */
+    }
+
+    return rc;
+}
+
+/**
+ * Drops the references of the chunks the given block map entries refer to.
+ *
+ * Failing to release a chunk only leaks it, so the function doesn't stop at
+ * the first error.
+ *
+ * @returns VBox status code of the first failure.
+ * @param   pStore     The store.
+ * @param   paEntries  The block map entries referencing the chunks.
+ * @param   cEntries   Number of entries.
+ */
+static int vddStoreChunksUnref(PVDDSTORE pStore, const uint64_t *paEntries, uint32_t cEntries)
+{
+    int rc = vddStoreLock(pStore, true /* fLoadHdr */);
+    if (RT_SUCCESS(rc))
+    {
+        for (uint32_t i = 0; i < cEntries; i++)
+        {
+            int rc2 = vddStoreChunkUnref(pStore, paEntries[i]);
+            if (RT_FAILURE(rc2))
+            {
+                LogRel(("VDD: Failed to release chunk %#llx of store '%s' (%Rrc), the chunk leaks\n",
+                        paEntries[i], pStore->szPath, rc2));
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
+            }
+        }
+
+        vddStoreUnlock(pStore);
+    }
+    else
+        LogRel(("VDD: Failed to lock store '%s' (%Rrc), %u chunks leak\n", pStore->szPath, rc, cEntries));
+
+    return rc;
+}
+
+/**
+ * Appends the given block map entries to the array of chunk references to drop.
+ *
+ * @returns VBox status code.
+ * @param   pUnrefs    The array to append to.
+ * @param   paEntries  The block map entries to append.
+ * @param   cEntries   Number of entries.
+ */
+static int vddUnrefsAdd(PVDDUNREFS pUnrefs, const uint64_t *paEntries, uint32_t cEntries)
+{
+    if (pUnrefs->cEntries + cEntries > pUnrefs->cEntriesMax)
+    {
+        uint32_t cEntriesNew = RT_MAX(pUnrefs->cEntriesMax * 2, pUnrefs->cEntries + cEntries);
+        cEntriesNew = RT_ALIGN_32(cEntriesNew, 64);
+        uint64_t *paEntriesNew = (uint64_t *)RTMemRealloc(pUnrefs->paEntries, cEntriesNew * sizeof(uint64_t));
+        if (!paEntriesNew)
+            return VERR_NO_MEMORY;
+
+        pUnrefs->paEntries   = paEntriesNew;
+        pUnrefs->cEntriesMax = cEntriesNew;
+    }
+
+    memcpy(&pUnrefs->paEntries[pUnrefs->cEntries], paEntries, cEntries * sizeof(uint64_t));
+    pUnrefs->cEntries += cEntries;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Writes the block map entry of a block write whose chunk is referenced and on
+ * the disk already.
+ *
+ * The reference of the chunk the entry referred to before is dropped after the
+ * next flush of the image. If writing the entry fails the new chunk leaks because
+ * it is unknown whether the entry made it to the disk.
+ *
+ * @returns nothing.
+ * @param   pWrite     The block write.
+ */
+static void vddBlockWriteCommit(PVDDBLOCKWRITE pWrite)
+{
+    PVDDIMAGE pImage   = pWrite->pImage;
+    uint64_t *puEntry  = &pWrite->pMapEntry->paTbl[pWrite->idxBlock % VDD_MAP_PAGE_ENTRIES];
+    uint64_t  uEntryLE = RT_H2LE_U64(pWrite->uEntry);
+
+    RTSemFastMutexRequest(pImage->hMtxUpdate);
+
+    uint64_t uEntryOld = ASMAtomicReadU64(puEntry);
+    ASMAtomicWriteU64(puEntry, pWrite->uEntry);
+    int rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage,
+                                    pImage->offMap + (uint64_t)pWrite->idxBlock * sizeof(uint64_t),
+                                    &uEntryLE, sizeof(uEntryLE));
+    if (RT_SUCCESS(rc))
+    {
+        if (   VDD_MAP_ENTRY_IS_CHUNK(uEntryOld)
+            && RT_FAILURE(vddUnrefsAdd(&pImage->Unrefs, &uEntryOld, 1)))
+            LogRel(("VDD: Out of memory releasing chunk %#llx of image '%s', the chunk leaks\n",
+                    uEntryOld, pImage->pszFilename));
+    }
+    else
+    {
+        ASMAtomicWriteU64(puEntry, uEntryOld);
+        pWrite->rcReq = rc;
+    }
+
+    RTSemFastMutexRelease(pImage->hMtxUpdate);
+}
+
+/**
+ * Processes the given list of block writes.
+ *
+ * The chunks of all writes are referenced under a single store lock and made
+ * durable with a single flush before any block map entry refers to them.
+ *
+ * @returns nothing.
+ * @param   pStore     The store.
+ * @param   pLstWrites The list of block writes, VDDBLOCKWRITE.
+ */
+static void vddStoreWritesProcess(PVDDSTORE pStore, PRTLISTANCHOR pLstWrites)
+{
+    PVDDBLOCKWRITE pWrite;
+    bool           fChunks = false;
+
+    RTListForEach(pLstWrites, pWrite, VDDBLOCKWRITE, NdWrites)
+    {
+        if (pWrite->uEntry == VDD_MAP_ENTRY_FREE)
+        {
+            fChunks = true;
+            break;
+        }
+    }
+
+    if (fChunks)
+    {
+        int rc = vddStoreLock(pStore, true /* fLoadHdr */);
+        if (RT_SUCCESS(rc))
+        {
+            RTListForEach(pLstWrites, pWrite, VDDBLOCKWRITE, NdWrites)
+            {
+                if (pWrite->uEntry == VDD_MAP_ENTRY_FREE)
+                    pWrite->rcReq = vddStoreChunkRef(pStore, pWrite->abSha256, pWrite->abBlock, &pWrite->uEntry);
+            }
+            vddStoreUnlock(pStore);
+
+            /* The barrier between the chunks and the block map entries referring to them. */
+            rc = RTFileFlush(pStore->hFileDat);
+            if (RT_SUCCESS(rc))
+                rc = RTFileFlush(pStore->hFileIdx);
+        }
+
+        if (RT_FAILURE(rc))
+        {
+            /* Chunks which might not be on the disk must not be referenced, they leak. */
+            RTListForEach(pLstWrites, pWrite, VDDBLOCKWRITE, NdWrites)
+            {
+                if (   RT_SUCCESS(pWrite->rcReq)
+                    && pWrite->uEntry != VDD_MAP_ENTRY_ZERO)
+                    pWrite->rcReq = rc;
+            }
+        }
+    }
+
+    RTListForEach(pLstWrites, pWrite, VDDBLOCKWRITE, NdWrites)
+    {
+        if (RT_SUCCESS(pWrite->rcReq))
+            vddBlockWriteCommit(pWrite);
+    }
+}
+
+/**
+ * The store worker thread.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hThreadSelf    The thread handle.
+ * @param   pvUser         The store.
+ */
+static DECLCALLBACK(int) vddStoreWorker(RTTHREAD hThreadSelf, void *pvUser)
+{
+    RT_NOREF1(hThreadSelf);
+    PVDDSTORE pStore = (PVDDSTORE)pvUser;
+
+    for (;;)
+    {
+        RTLISTANCHOR LstWrites;
+        VDDUNREFS    Unrefs;
+
+        RTSemFastMutexRequest(pStore->hMtxReqs);
+        RTListMove(&LstWrites, &pStore->LstWrites);
+        Unrefs = pStore->Unrefs;
+        RT_ZERO(pStore->Unrefs);
+        bool fShutdown = ASMAtomicReadBool(&pStore->fShutdown);
+        RTSemFastMutexRelease(pStore->hMtxReqs);
+
+        if (   RTListIsEmpty(&LstWrites)
+            && !Unrefs.cEntries)
+        {
+            RTMemFree(Unrefs.paEntries);
+            if (fShutdown)
+                break;
+            RTSemEventWait(pStore->hEvtWorker, RT_INDEFINITE_WAIT);
+            continue;
+        }
+
+        if (!RTListIsEmpty(&LstWrites))
+        {
+            vddStoreWritesProcess(pStore, &LstWrites);
+
+            /* Hand the writes back to their images and continue the I/O contexts. */
+            PVDDBLOCKWRITE pWrite, pWriteNext;
+            RTListForEachSafe(&LstWrites, pWrite, pWriteNext, VDDBLOCKWRITE, NdWrites)
+            {
+                PVDDIMAGE         pImage = pWrite->pImage;
+                PVDINTERFACEIOINT pIfIo  = pImage->pIfIo;
+                PVDIOCTX          pIoCtx = pWrite->pIoCtx;
+                int               rcReq  = pWrite->rcReq;
+
+                RTListNodeRemove(&pWrite->NdWrites);
+                RTSemFastMutexRequest(pImage->hMtxUpdate);
+                RTListAppend(&pImage->LstWritesDone, &pWrite->NdWrites);
+                RTSemFastMutexRelease(pImage->hMtxUpdate);
+
+                /* The block data was consumed when the write was queued. */
+                pIfIo->pfnIoCtxCompleted(pIfIo->Core.pvUser, pIoCtx, rcReq, 0);
+            }
+        }
+
+        if (Unrefs.cEntries)
+            vddStoreChunksUnref(pStore, Unrefs.paEntries, Unrefs.cEntries);
+        RTMemFree(Unrefs.paEntries);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Queues chunk references for the store worker to drop.
+ *
+ * @returns nothing.
+ * @param   pStore     The store.
+ * @param   pUnrefs    The chunk references to drop, the array is empty on return.
+ */
+static void vddStoreUnrefsQueue(PVDDSTORE pStore, PVDDUNREFS pUnrefs)
+{
+    RTSemFastMutexRequest(pStore->hMtxReqs);
+    int rc = VINF_SUCCESS;
+    if (!pStore->Unrefs.cEntries)
+    {
+        /* Just take over the array. */
+        RTMemFree(pStore->Unrefs.paEntries);
+        pStore->Unrefs = *pUnrefs;
+        RT_ZERO(*pUnrefs);
+    }
+    else
+        rc = vddUnrefsAdd(&pStore->Unrefs, pUnrefs->paEntries, pUnrefs->cEntries);
+    RTSemFastMutexRelease(pStore->hMtxReqs);
+
+    if (RT_FAILURE(rc))
+        LogRel(("VDD: Out of memory releasing %u chunks of store '%s', the chunks leak\n",
+                pUnrefs->cEntries, pStore->szPath));
+    RTMemFree(pUnrefs->paEntries);
+    RT_ZERO(*pUnrefs);
+
+    RTSemEventSignal(pStore->hEvtWorker);
+}
+
+/**
+ * Opens the chunk store in the given directory or retains the already opened
+ * instance, creating the store if it doesn't exist.
+ *
+ * @returns VBox status code.
+ * @param   pszPath    The store directory.
+ * @param   ppStore    Where to store the store instance on success.
+ */
+static int vddStoreRetain(const char *pszPath, PVDDSTORE *ppStore)
+{
+    int rc = RTOnce(&g_VddStoreOnce, vddStoreListInit, NULL);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    RTSemFastMutexRequest(g_hVddStoreMtx);
+
+    PVDDSTORE pStore;
+    RTListForEach(&g_VddStoreList, pStore, VDDSTORE, NdStores)
+    {
+        if (RTPathCompare(pStore->szPath, pszPath) == 0)
+        {
+            pStore->cRefs++;
+            RTSemFastMutexRelease(g_hVddStoreMtx);
+            *ppStore = pStore;
+            return VINF_SUCCESS;
+        }
+    }
+
+    size_t cchPath = strlen(pszPath);
+    pStore = (PVDDSTORE)RTMemAllocZ(RT_UOFFSETOF(VDDSTORE, szPath[cchPath + 1]));
+    if (pStore)
+    {
+        memcpy(&pStore->szPath[0], pszPath, cchPath + 1);
+        pStore->cRefs         = 1;
+        pStore->hFileIdx      = NIL_RTFILE;
+        pStore->hFileDat      = NIL_RTFILE;
+        pStore->hThreadWorker = NIL_RTTHREAD;
+        pStore->hEvtWorker    = NIL_RTSEMEVENT;
+        pStore->hMtxReqs      = NIL_RTSEMFASTMUTEX;
+        RTListInit(&pStore->LstWrites);
+
+        char szFile[RTPATH_MAX];
+        rc = RTSemFastMutexCreate(&pStore->hMtx);
+        if (RT_SUCCESS(rc))
+            rc = RTSemFastMutexCreate(&pStore->hMtxReqs);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pStore->hEvtWorker);
+        if (RT_SUCCESS(rc))
+            rc = RTDirCreateFullPath(pszPath, 0700);
+        if (RT_SUCCESS(rc))
+            rc = RTPathJoin(szFile, sizeof(szFile), pszPath, VDD_STORE_IDX_NAME);
+        if (RT_SUCCESS(rc))
+            rc = RTFileOpen(&pStore->hFileIdx, szFile, RTFILE_O_READWRITE | RTFILE_O_OPEN_CREATE | RTFILE_O_DENY_NONE);
+        if (RT_SUCCESS(rc))
+            rc = RTPathJoin(szFile, sizeof(szFile), pszPath, VDD_STORE_DAT_NAME);
+        if (RT_SUCCESS(rc))
+            rc = RTFileOpen(&pStore->hFileDat, szFile, RTFILE_O_READWRITE | RTFILE_O_OPEN_CREATE | RTFILE_O_DENY_NONE);
+        if (RT_SUCCESS(rc))
+        {
+            /* Whoever comes first initializes a new store. */
+            rc = vddStoreLock(pStore, false /* fLoadHdr */);
+            if (RT_SUCCESS(rc))
+            {
+                rc = vddStoreInit(pStore);
+                vddStoreUnlock(pStore);
+            }
+        }
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreate(&pStore->hThreadWorker, vddStoreWorker, pStore, 0,
+                                RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VDDStore");
+
+        if (RT_SUCCESS(rc))
+        {
+            RTListAppend(&g_VddStoreList, &pStore->NdStores);
+            *ppStore = pStore;
+        }
+        else
+        {
+            if (pStore->hFileDat != NIL_RTFILE)
+                RTFileClose(pStore->hFileDat);
+            if (pStore->hFileIdx != NIL_RTFILE)
+                RTFileClose(pStore->hFileIdx);
+            if (pStore->hEvtWorker != NIL_RTSEMEVENT)
+                RTSemEventDestroy(pStore->hEvtWorker);
+            if (pStore->hMtxReqs != NIL_RTSEMFASTMUTEX)
+                RTSemFastMutexDestroy(pStore->hMtxReqs);
+            if (pStore->hMtx != NIL_RTSEMFASTMUTEX)
+                RTSemFastMutexDestroy(pStore->hMtx);
+            RTMemFree(pStore);
+        }
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    RTSemFastMutexRelease(g_hVddStoreMtx);
+    return rc;
+}
+
+/**
+ * Releases a reference to the given store, closing it when the last image
+ * using it goes away.
+ *
+ * @returns nothing.
+ * @param   pStore     The store to release.
+ */
+static void vddStoreRelease(PVDDSTORE pStore)
+{
+    RTSemFastMutexRequest(g_hVddStoreMtx);
+    Assert(pStore->cRefs > 0);
+    if (!--pStore->cRefs)
+    {
+        RTListNodeRemove(&pStore->NdStores);
+
+        /* The worker drops all queued chunk references before it terminates. */
+        ASMAtomicWriteBool(&pStore->fShutdown, true);
+        RTSemEventSignal(pStore->hEvtWorker);
+        int rc = RTThreadWait(pStore->hThreadWorker, RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc);
+        Assert(RTListIsEmpty(&pStore->LstWrites));
+
+        RTFileClose(pStore->hFileDat);
+        RTFileClose(pStore->hFileIdx);
+        RTSemEventDestroy(pStore->hEvtWorker);
+        RTSemFastMutexDestroy(pStore->hMtxReqs);
+        RTSemFastMutexDestroy(pStore->hMtx);
+        RTMemFree(pStore->Unrefs.paEntries);
+        RTMemFree(pStore);
+    }
+    RTSemFastMutexRelease(g_hVddStoreMtx);
+}
+
+/**
+ * Makes sure the chunk store of the image is open.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ */
+static int vddStoreEnsureOpen(PVDDIMAGE pImage)
+{
+    if (pImage->pStore)
+        return VINF_SUCCESS;
+
+    int rc = vddStoreRetain(pImage->szStore, &pImage->pStore);
+    if (RT_FAILURE(rc))
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                       N_("VDD: Opening the chunk store '%s' of image '%s' failed"),
+                       pImage->szStore, pImage->pszFilename);
+    return rc;
+}
+
+/**
+ * Creates the block map cache of the image.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ */
+static int vddMapCacheCreate(PVDDIMAGE pImage)
+{
+    return vdTblCacheCreate(&pImage->pMapCache, VDD_MAP_PAGE_SIZE, vddMapGetSize(pImage->cBlocks));
+}
+
+/**
+ * Fetches the block map page containing the given block trying the table cache
+ * first and reading it from the image after a cache miss.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ * @param   pIoCtx     The I/O context.
+ * @param   idxBlock   The block whose map page to fetch.
+ * @param   ppMapEntry Where to store the referenced map page on success.
+ */
+static int vddMapPageFetch(PVDDIMAGE pImage, PVDIOCTX pIoCtx, uint32_t idxBlock,
+                           PVDTBLCACHEENTRY *ppMapEntry)
+{
+    int rc = VINF_SUCCESS;
+    uint64_t offPage = pImage->offMap + (uint64_t)(idxBlock / VDD_MAP_PAGE_ENTRIES) * VDD_MAP_PAGE_SIZE;
+
+    PVDTBLCACHEENTRY pMapEntry = vdTblCacheRetain(pImage->pMapCache, offPage);
+    if (!pMapEntry)
+    {
+        pMapEntry = vdTblCacheEntryAlloc(pImage->pMapCache);
+        if (pMapEntry)
+        {
+            PVDMETAXFER pMetaXfer;
+
+            pMapEntry->offTbl = offPage;
+            rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
+                                       offPage, pMapEntry->paTbl, VDD_MAP_PAGE_SIZE,
+                                       pIoCtx, &pMetaXfer, NULL, NULL);
+            if (RT_SUCCESS(rc))
+            {
+                vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+#if defined(RT_BIG_ENDIAN)
+                for (unsigned i = 0; i < VDD_MAP_PAGE_ENTRIES; i++)
+                    pMapEntry->paTbl[i] = RT_LE2H_U64(pMapEntry->paTbl[i]);
+#endif
+                vdTblCacheEntryInsert(pImage->pMapCache, pMapEntry);
+            }
+            else
+            {
+                vdTblCacheEntryRelease(pMapEntry);
+                vdTblCacheEntryFree(pImage->pMapCache, pMapEntry);
+            }
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+        *ppMapEntry = pMapEntry;
+
+    return rc;
+}
+
+/**
+ * Releases the block writes the store worker completed.
+ *
+ * @returns nothing.
+ * @param   pImage     Image instance data.
+ */
+static void vddWritesReap(PVDDIMAGE pImage)
+{
+    RTLISTANCHOR LstWritesDone;
+
+    RTSemFastMutexRequest(pImage->hMtxUpdate);
+    RTListMove(&LstWritesDone, &pImage->LstWritesDone);
+    RTSemFastMutexRelease(pImage->hMtxUpdate);
+
+    PVDDBLOCKWRITE pWrite, pWriteNext;
+    RTListForEachSafe(&LstWritesDone, pWrite, pWriteNext, VDDBLOCKWRITE, NdWrites)
+    {
+        RTListNodeRemove(&pWrite->NdWrites);
+        vdTblCacheEntryRelease(pWrite->pMapEntry);
+        RTMemFree(pWrite);
+    }
+}
+
+/**
+ * Writes a full block, deduplicating the content against the chunk store.
+ *
+ * Asynchronous writes are handed to the store worker and the I/O context is
+ * halted until the worker wrote the block map entry.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_IOCTX_HALT if the write was queued for the store worker.
+ * @param   pImage     Image instance data.
+ * @param   pIoCtx     The I/O context containing the block data.
+ * @param   idxBlock   The block to write.
+ */
+static int vddBlockWrite(PVDDIMAGE pImage, PVDIOCTX pIoCtx, uint32_t idxBlock)
+{
+    PVDTBLCACHEENTRY pMapEntry = NULL;
+    int rc = vddMapPageFetch(pImage, pIoCtx, idxBlock, &pMapEntry);
+    if (RT_FAILURE(rc))
+        return rc; /* Includes VERR_VD_NOT_ENOUGH_METADATA, the write is retried once the map page arrived. */
+
+    PVDDBLOCKWRITE pWrite = (PVDDBLOCKWRITE)RTMemAlloc(sizeof(VDDBLOCKWRITE));
+    if (pWrite)
+    {
+        pWrite->pImage    = pImage;
+        pWrite->pMapEntry = pMapEntry;
+        pWrite->idxBlock  = idxBlock;
+        pWrite->rcReq     = VINF_SUCCESS;
+        pWrite->uEntry    = VDD_MAP_ENTRY_FREE;
+
+        vdIfIoIntIoCtxCopyFrom(pImage->pIfIo, pIoCtx, &pWrite->abBlock[0], VDD_BLOCK_SIZE);
+        if (!ASMMemIsZero(&pWrite->abBlock[0], VDD_BLOCK_SIZE))
+            RTSha256(&pWrite->abBlock[0], VDD_BLOCK_SIZE, pWrite->abSha256);
+        else
+            pWrite->uEntry = VDD_MAP_ENTRY_ZERO;
+
+        if (!vdIfIoIntIoCtxIsSynchronous(pImage->pIfIo, pIoCtx))
+        {
+            PVDDSTORE pStore = pImage->pStore;
+
+            pWrite->pIoCtx = pIoCtx;
+            RTSemFastMutexRequest(pStore->hMtxReqs);
+            RTListAppend(&pStore->LstWrites, &pWrite->NdWrites);
+            RTSemFastMutexRelease(pStore->hMtxReqs);
+            RTSemEventSignal(pStore->hEvtWorker);
+            return VERR_VD_IOCTX_HALT;
+        }
+
+        /* Synchronous I/O may block, do the work right here. */
+        RTLISTANCHOR LstWrites;
+
+        pWrite->pIoCtx = NULL;
+        RTListInit(&LstWrites);
+        RTListAppend(&LstWrites, &pWrite->NdWrites);
+        vddStoreWritesProcess(pImage->pStore, &LstWrites);
+        rc = pWrite->rcReq;
+        RTMemFree(pWrite);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    vdTblCacheEntryRelease(pMapEntry);
+    return rc;
+}
+
+/**
+ * Drops the references of all chunks used by the image, used when the image is deleted.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ */
+static int vddReleaseAllChunks(PVDDIMAGE pImage)
+{
+    int rc = vddStoreEnsureOpen(pImage);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint64_t *paMap = (uint64_t *)RTMemTmpAlloc(VDD_MAP_PAGE_SIZE);
+    if (!paMap)
+        return VERR_NO_MEMORY;
+
+    for (uint32_t idxBlock = 0; idxBlock < pImage->cBlocks && RT_SUCCESS(rc); idxBlock += VDD_MAP_PAGE_ENTRIES)
+    {
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage,
+                                   pImage->offMap + (uint64_t)idxBlock * sizeof(uint64_t),
+                                   paMap, VDD_MAP_PAGE_SIZE);
+        if (RT_SUCCESS(rc))
+        {
+            uint32_t cEntries = RT_MIN(pImage->cBlocks - idxBlock, VDD_MAP_PAGE_ENTRIES);
+            uint32_t cChunks  = 0;
+            for (uint32_t i = 0; i < cEntries; i++)
+            {
+                uint64_t uEntry = RT_LE2H_U64(paMap[i]);
+                if (VDD_MAP_ENTRY_IS_CHUNK(uEntry))
+                    paMap[cChunks++] = uEntry;
+            }
+
+            if (cChunks)
+                vddStoreChunksUnref(pImage->pStore, paMap, cChunks);
+        }
+    }
+
+    RTMemTmpFree(paMap);
+    return rc;
+}
+
+/**
+ * Writes the image header synchronously.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ */
+static int vddFlushImage(PVDDIMAGE pImage)
+{
+    int rc = VINF_SUCCESS;
+
+    if (   pImage->pStorage
+        && !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        VddHeader Header;
+
+        vddHdrConvertFromHostEndianess(pImage, &Header);
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pImage->pStorage, 0, &Header, sizeof(Header));
+        if (RT_SUCCESS(rc))
+            rc = vdIfIoIntFileFlushSync(pImage->pIfIo, pImage->pStorage);
+    }
+
+    return rc;
+}
+
+/**
+ * Internal. Free all allocated space for representing an image except pImage,
+ * and optionally delete the image from disk.
+ */
+static int vddFreeImage(PVDDIMAGE pImage, bool fDelete)
+{
+    int rc = VINF_SUCCESS;
+
+    /* Freeing a never allocated image (e.g. because the open failed) is
+     * not signalled as an error. After all nothing bad happens. */
+    if (pImage)
+    {
+        if (pImage->pStorage)
+        {
+            vddWritesReap(pImage);
+
+            /* No point updating the file that is deleted anyway. */
+            if (!fDelete)
+            {
+                /* The chunks replaced since the last flush can be released once the map is on the disk. */
+                int rc2 = vddFlushImage(pImage);
+                if (   RT_SUCCESS(rc2)
+                    && pImage->Unrefs.cEntries)
+                    vddStoreChunksUnref(pImage->pStore, pImage->Unrefs.paEntries, pImage->Unrefs.cEntries);
+            }
+            else if (   !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+                     && pImage->szStore[0])
+            {
+                int rc2 = vddReleaseAllChunks(pImage);
+                if (   RT_SUCCESS(rc2)
+                    && pImage->Unrefs.cEntries)
+                    vddStoreChunksUnref(pImage->pStore, pImage->Unrefs.paEntries, pImage->Unrefs.cEntries);
+            }
+
+            rc = vdIfIoIntFileClose(pImage->pIfIo, pImage->pStorage);
+            pImage->pStorage = NULL;
+        }
+
+        RTMemFree(pImage->Unrefs.paEntries);
+        RT_ZERO(pImage->Unrefs);
+
+        if (pImage->hMtxUpdate != NIL_RTSEMFASTMUTEX)
+        {
+            RTSemFastMutexDestroy(pImage->hMtxUpdate);
+            pImage->hMtxUpdate = NIL_RTSEMFASTMUTEX;
+        }
+
+        if (pImage->pStorageDat)
+        {
+            vdIfIoIntFileClose(pImage->pIfIo, pImage->pStorageDat);
+            pImage->pStorageDat = NULL;
+        }
+
+        if (pImage->pStore)
+        {
+            vddStoreRelease(pImage->pStore);
+            pImage->pStore = NULL;
+        }
+
+        vdTblCacheDestroy(pImage->pMapCache);
+        pImage->pMapCache = NULL;
+
+        if (fDelete && pImage->pszFilename)
+            vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Opens the store data file for reading chunks through the I/O interface.
+ *
+ * @returns VBox status code.
+ * @param   pImage     Image instance data.
+ */
+static int vddOpenStoreData(PVDDIMAGE pImage)
+{
+    char szFile[RTPATH_MAX];
+    int rc = RTPathJoin(szFile, sizeof(szFile), pImage->szStore, VDD_STORE_DAT_NAME);
+    if (RT_SUCCESS(rc))
+        rc = vdIfIoIntFileOpen(pImage->pIfIo, szFile,
+                               VDOpenFlagsToFileOpenFlags(VD_OPEN_FLAGS_READONLY,
+                                                          false /* fCreate */),
+                               &pImage->pStorageDat);
+    if (RT_FAILURE(rc))
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                       N_("VDD: Opening the chunk store '%s' of image '%s' failed"),
+                       pImage->szStore, pImage->pszFilename);
+    return rc;
+}
+
+/**
+ * Internal: Init the region list of the image.
+ */
+static void vddRegionListInit(PVDDIMAGE pImage)
+{
+    PVDREGIONDESC pRegion = &pImage->RegionList.aRegions[0];
+    pImage->RegionList.fFlags   = 0;
+    pImage->RegionList.cRegions = 1;
+
+    pRegion->offRegion            = 0; /* Disk start. */
+    pRegion->cbBlock              = 512;
+    pRegion->enmDataForm          = VDREGIONDATAFORM_RAW;
+    pRegion->enmMetadataForm      = VDREGIONMETADATAFORM_NONE;
+    pRegion->cbData               = 512;
+    pRegion->cbMetadata           = 0;
+    pRegion->cRegionBlocksOrBytes = pImage->cbSize;
+}
+
+/**
+ * Internal: Open an image, constructing all necessary data structures.
+ */
+static int vddOpenImage(PVDDIMAGE pImage, unsigned uOpenFlags)
+{
+    pImage->uOpenFlags = uOpenFlags;
+
+    pImage->pIfError = VDIfErrorGet(pImage->pVDIfsDisk);
+    pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
+    AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
+
+    RTListInit(&pImage->LstWritesDone);
+    int rc = RTSemFastMutexCreate(&pImage->hMtxUpdate);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Open the image. */
+    rc = vdIfIoIntFileOpen(pImage->pIfIo, pImage->pszFilename,
+                               VDOpenFlagsToFileOpenFlags(uOpenFlags,
+                                                          false /* fCreate */),
+                               &pImage->pStorage);
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t cbFile;
+        rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+        if (   RT_SUCCESS(rc)
+            && cbFile >= sizeof(VddHeader))
+        {
+            VddHeader Header;
+
+            rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, 0, &Header, sizeof(Header));
+            if (   RT_SUCCESS(rc)
+                && vddHdrConvertToHostEndianess(&Header)
+                && Header.offMap + vddMapGetSize(Header.cBlocks) <= cbFile)
+            {
+                pImage->uImageFlags            = Header.fImageFlags;
+                pImage->cbSize                 = Header.cbDisk;
+                pImage->cBlocks                = Header.cBlocks;
+                pImage->offMap                 = Header.offMap;
+                pImage->ImageUuid              = Header.UuidCreate;
+                pImage->ModificationUuid       = Header.UuidModify;
+                pImage->ParentUuid             = Header.UuidParent;
+                pImage->ParentModificationUuid = Header.UuidParentModify;
+                pImage->PCHSGeometry.cCylinders = Header.PCHSGeometry.cCylinders;
+                pImage->PCHSGeometry.cHeads     = Header.PCHSGeometry.cHeads;
+                pImage->PCHSGeometry.cSectors   = Header.PCHSGeometry.cSectors;
+                pImage->LCHSGeometry.cCylinders = Header.LCHSGeometry.cCylinders;
+                pImage->LCHSGeometry.cHeads     = Header.LCHSGeometry.cHeads;
+                pImage->LCHSGeometry.cSectors   = Header.LCHSGeometry.cSectors;
+                RTStrCopy(pImage->szStore, sizeof(pImage->szStore), Header.szStore);
+
+                rc = vddMapCacheCreate(pImage);
+                if (RT_SUCCESS(rc))
+                    rc = vddOpenStoreData(pImage);
+                else
+                    rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                                   N_("VDD: Creating the block map cache for image '%s' failed"),
+                                   pImage->pszFilename);
+
+                /* Opening the store takes the store lock, don't do that on the I/O path. */
+                if (   RT_SUCCESS(rc)
+                    && !(uOpenFlags & VD_OPEN_FLAGS_READONLY))
+                    rc = vddStoreEnsureOpen(pImage);
+            }
+            else if (RT_SUCCESS(rc))
+                rc = VERR_VD_GEN_INVALID_HEADER;
+        }
+        else if (RT_SUCCESS(rc))
+            rc = VERR_VD_GEN_INVALID_HEADER;
+    }
+    /* else: Do NOT signal an appropriate error here, as the VD layer has the
+     *       choice of retrying the open if it failed. */
+
+    if (RT_SUCCESS(rc))
+        vddRegionListInit(pImage);
+    else
+        vddFreeImage(pImage, false);
+    return rc;
+}
+
+/**
+ * Internal: Create a VDD image.
+ */
+static int vddCreateImage(PVDDIMAGE pImage, uint64_t cbSize,
+                          unsigned uImageFlags, PCRTUUID pUuid,
+                          PCVDGEOMETRY pPCHSGeometry,
+                          PCVDGEOMETRY pLCHSGeometry, unsigned uOpenFlags,
+                          PVDINTERFACEPROGRESS pIfProgress,
+                          unsigned uPercentStart, unsigned uPercentSpan)
+{
+    int rc;
+
+    pImage->pIfError = VDIfErrorGet(pImage->pVDIfsDisk);
+    pImage->pIfIo = VDIfIoIntGet(pImage->pVDIfsImage);
+    AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
+
+    if (uImageFlags & VD_IMAGE_FLAGS_FIXED)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_TYPE, RT_SRC_POS,
+                         N_("VDD: cannot create fixed image '%s'"), pImage->pszFilename);
+    if (cbSize > (uint64_t)UINT32_MAX * VDD_BLOCK_SIZE)
+        return vdIfError(pImage->pIfError, VERR_VD_INVALID_SIZE, RT_SRC_POS,
+                         N_("VDD: Disk size of image '%s' is too big"), pImage->pszFilename);
+
+    RTListInit(&pImage->LstWritesDone);
+    rc = RTSemFastMutexCreate(&pImage->hMtxUpdate);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    pImage->uOpenFlags   = uOpenFlags & ~VD_OPEN_FLAGS_READONLY;
+    pImage->uImageFlags  = uImageFlags;
+    pImage->PCHSGeometry = *pPCHSGeometry;
+    pImage->LCHSGeometry = *pLCHSGeometry;
+    pImage->cbSize       = cbSize;
+    pImage->cBlocks      = (uint32_t)((cbSize + VDD_BLOCK_SIZE - 1) / VDD_BLOCK_SIZE);
+    pImage->offMap       = VDD_HDR_SIZE;
+    pImage->ImageUuid    = *pUuid;
+    RTUuidCreate(&pImage->ModificationUuid);
+    RTUuidClear(&pImage->ParentUuid);
+    RTUuidClear(&pImage->ParentModificationUuid);
+
+    /* The store defaults to the directory containing the image. */
+    char *pszStore = NULL;
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pImage->pVDIfsImage);
+    if (pIfConfig)
+        rc = VDCFGQueryStringAlloc(pIfConfig, "DedupStore", &pszStore);
+    if (pszStore && *pszStore)
+        rc = RTPathAbs(pszStore, pImage->szStore, sizeof(pImage->szStore));
+    else
+    {
+        rc = RTPathAbs(pImage->pszFilename, pImage->szStore, sizeof(pImage->szStore));
+        if (RT_SUCCESS(rc))
+            RTPathStripFilename(pImage->szStore);
+    }
+    if (pszStore)
+        RTMemFree(pszStore);
+
+    if (RT_SUCCESS(rc))
+        rc = vddStoreEnsureOpen(pImage);
+    else
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                       N_("VDD: Invalid chunk store path for image '%s'"), pImage->pszFilename);
+
+    if (RT_SUCCESS(rc))
+    {
+        /* Create image file. */
+        uint32_t fOpen = VDOpenFlagsToFileOpenFlags(pImage->uOpenFlags, true /* fCreate */);
+        rc = vdIfIoIntFileOpen(pImage->pIfIo, pImage->pszFilename, fOpen, &pImage->pStorage);
+        if (RT_SUCCESS(rc))
+        {
+            /* The block map starts out empty, a sparse file takes care of that. */
+            rc = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage,
+                                      pImage->offMap + vddMapGetSize(pImage->cBlocks));
+            if (RT_SUCCESS(rc))
+            {
+                vdIfProgress(pIfProgress, uPercentStart + uPercentSpan * 98 / 100);
+                rc = vddFlushImage(pImage);
+            }
+            if (RT_SUCCESS(rc))
+                rc = vddMapCacheCreate(pImage);
+            if (RT_SUCCESS(rc))
+                rc = vddOpenStoreData(pImage);
+            else
+                rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VDD: cannot initialize image '%s'"),
+                               pImage->pszFilename);
+        }
+        else
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VDD: cannot create image '%s'"), pImage->pszFilename);
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        vddRegionListInit(pImage);
+        vdIfProgress(pIfProgress, uPercentStart + uPercentSpan);
+    }
+    else
+        vddFreeImage(pImage, rc != VERR_ALREADY_EXISTS && pImage->pStorage);
+
+    return rc;
+}
+
+
+/** @copydoc VDIMAGEBACKEND::pfnProbe */
+static DECLCALLBACK(int) vddProbe(const char *pszFilename, PVDINTERFACE pVDIfsDisk,
+                                  PVDINTERFACE pVDIfsImage, VDTYPE *penmType)
+{
+    RT_NOREF1(pVDIfsDisk);
+    LogFlowFunc(("pszFilename=\"%s\" pVDIfsDisk=%#p pVDIfsImage=%#p\n", pszFilename, pVDIfsDisk, pVDIfsImage));
+    PVDIOSTORAGE pStorage = NULL;
+    int rc = VINF_SUCCESS;
+
+    /* Get I/O interface. */
+    PVDINTERFACEIOINT pIfIo = VDIfIoIntGet(pVDIfsImage);
+    AssertPtrReturn(pIfIo, VERR_INVALID_PARAMETER);
+    AssertReturn((VALID_PTR(pszFilename) && *pszFilename), VERR_INVALID_PARAMETER);
+
+    /*
+     * Open the file and read the header.
+     */
+    rc = vdIfIoIntFileOpen(pIfIo, pszFilename,
+                           VDOpenFlagsToFileOpenFlags(VD_OPEN_FLAGS_READONLY,
+                                                      false /* fCreate */),
+                           &pStorage);
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t cbFile;
+
+        rc = vdIfIoIntFileGetSize(pIfIo, pStorage, &cbFile);
+        if (   RT_SUCCESS(rc)
+            && cbFile >= sizeof(VddHeader))
+        {
+            VddHeader Header;
+
+            rc = vdIfIoIntFileReadSync(pIfIo, pStorage, 0, &Header, sizeof(Header));
+            if (   RT_SUCCESS(rc)
+                && vddHdrConvertToHostEndianess(&Header))
+                *penmType = VDTYPE_HDD;
+            else
+                rc = VERR_VD_GEN_INVALID_HEADER;
+        }
+        else
+            rc = VERR_VD_GEN_INVALID_HEADER;
+    }
+
+    if (pStorage)
+        vdIfIoIntFileClose(pIfIo, pStorage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnOpen */
+static DECLCALLBACK(int) vddOpen(const char *pszFilename, unsigned uOpenFlags,
+                                 PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                                 VDTYPE enmType, void **ppBackendData)
+{
+    RT_NOREF1(enmType);
+
+    LogFlowFunc(("pszFilename=\"%s\" uOpenFlags=%#x pVDIfsDisk=%#p pVDIfsImage=%#p enmType=%u ppBackendData=%#p\n",
+                 pszFilename, uOpenFlags, pVDIfsDisk, pVDIfsImage, enmType, ppBackendData));
+    int rc;
+
+    /* Check open flags. All valid flags are supported. */
+    AssertReturn(!(uOpenFlags & ~VD_OPEN_FLAGS_MASK), VERR_INVALID_PARAMETER);
+    AssertReturn((VALID_PTR(pszFilename) && *pszFilename), VERR_INVALID_PARAMETER);
+
+    PVDDIMAGE pImage = (PVDDIMAGE)RTMemAllocZ(RT_UOFFSETOF(VDDIMAGE, RegionList.aRegions[1]));
+    if (RT_LIKELY(pImage))
+    {
+        pImage->pszFilename = pszFilename;
+        pImage->pStorage = NULL;
+        pImage->pVDIfsDisk = pVDIfsDisk;
+        pImage->pVDIfsImage = pVDIfsImage;
+
+        rc = vddOpenImage(pImage, uOpenFlags);
+        if (RT_SUCCESS(rc))
+            *ppBackendData = pImage;
+        else
+            RTMemFree(pImage);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnCreate */
+static DECLCALLBACK(int) vddCreate(const char *pszFilename, uint64_t cbSize,
+                                   unsigned uImageFlags, const char *pszComment,
+                                   PCVDGEOMETRY pPCHSGeometry, PCVDGEOMETRY pLCHSGeometry,
+                                   PCRTUUID pUuid, unsigned uOpenFlags,
+                                   unsigned uPercentStart, unsigned uPercentSpan,
+                                   PVDINTERFACE pVDIfsDisk, PVDINTERFACE pVDIfsImage,
+                                   PVDINTERFACE pVDIfsOperation, VDTYPE enmType,
+                                   void **ppBackendData)
+{
+    RT_NOREF1(pszComment);
+    LogFlowFunc(("pszFilename=\"%s\" cbSize=%llu uImageFlags=%#x pszComment=\"%s\" pPCHSGeometry=%#p pLCHSGeometry=%#p Uuid=%RTuuid uOpenFlags=%#x uPercentStart=%u uPercentSpan=%u pVDIfsDisk=%#p pVDIfsImage=%#p pVDIfsOperation=%#p enmType=%d ppBackendData=%#p",
+                 pszFilename, cbSize, uImageFlags, pszComment, pPCHSGeometry, pLCHSGeometry, pUuid, uOpenFlags, uPercentStart, uPercentSpan, pVDIfsDisk, pVDIfsImage, pVDIfsOperation, enmType, ppBackendData));
+    int rc;
+
+    /* Check the VD container type. */
+    if (enmType != VDTYPE_HDD)
+        return VERR_VD_INVALID_TYPE;
+
+    /* Check open flags. All valid flags are supported. */
+    AssertReturn(!(uOpenFlags & ~VD_OPEN_FLAGS_MASK), VERR_INVALID_PARAMETER);
+    AssertReturn(   VALID_PTR(pszFilename)
+                 && *pszFilename
+                 && VALID_PTR(pPCHSGeometry)
+                 && VALID_PTR(pLCHSGeometry)
+                 && VALID_PTR(pUuid), VERR_INVALID_PARAMETER);
+
+    PVDDIMAGE pImage = (PVDDIMAGE)RTMemAllocZ(RT_UOFFSETOF(VDDIMAGE, RegionList.aRegions[1]));
+    if (RT_LIKELY(pImage))
+    {
+        PVDINTERFACEPROGRESS pIfProgress = VDIfProgressGet(pVDIfsOperation);
+
+        pImage->pszFilename = pszFilename;
+        pImage->pStorage = NULL;
+        pImage->pVDIfsDisk = pVDIfsDisk;
+        pImage->pVDIfsImage = pVDIfsImage;
+
+        rc = vddCreateImage(pImage, cbSize, uImageFlags, pUuid,
+                            pPCHSGeometry, pLCHSGeometry, uOpenFlags,
+                            pIfProgress, uPercentStart, uPercentSpan);
+        if (RT_SUCCESS(rc))
+        {
+            /* So far the image is opened in read/write mode. Make sure the
+             * image is opened in read-only mode if the caller requested that. */
+            if (uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            {
+                vddFreeImage(pImage, false);
+                rc = vddOpenImage(pImage, uOpenFlags);
+            }
+
+            if (RT_SUCCESS(rc))
+                *ppBackendData = pImage;
+        }
+
+        if (RT_FAILURE(rc))
+            RTMemFree(pImage);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    LogFlowFunc(("returns %Rrc (pBackendData=%#p)\n", rc, *ppBackendData));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnRename */
+static DECLCALLBACK(int) vddRename(void *pBackendData, const char *pszFilename)
+{
+    LogFlowFunc(("pBackendData=%#p pszFilename=%#p\n", pBackendData, pszFilename));
+    int rc = VINF_SUCCESS;
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    /* Check arguments. */
+    AssertReturn((pImage && pszFilename && *pszFilename), VERR_INVALID_PARAMETER);
+
+    /* Close the image. */
+    rc = vddFreeImage(pImage, false);
+    if (RT_SUCCESS(rc))
+    {
+        /* Rename the file, the chunk store stays where it is. */
+        rc = vdIfIoIntFileMove(pImage->pIfIo, pImage->pszFilename, pszFilename, 0);
+        if (RT_SUCCESS(rc))
+        {
+            /* Update pImage with the new information. */
+            pImage->pszFilename = pszFilename;
+
+            /* Open the old image with new name. */
+            rc = vddOpenImage(pImage, pImage->uOpenFlags);
+        }
+        else
+        {
+            /* The move failed, try to reopen the original image. */
+            int rc2 = vddOpenImage(pImage, pImage->uOpenFlags);
+            if (RT_FAILURE(rc2))
+                rc = rc2;
+        }
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnClose */
+static DECLCALLBACK(int) vddClose(void *pBackendData, bool fDelete)
+{
+    LogFlowFunc(("pBackendData=%#p fDelete=%d\n", pBackendData, fDelete));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    int rc = vddFreeImage(pImage, fDelete);
+    RTMemFree(pImage);
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnRead */
+static DECLCALLBACK(int) vddRead(void *pBackendData, uint64_t uOffset, size_t cbToRead,
+                                 PVDIOCTX pIoCtx, size_t *pcbActuallyRead)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu pIoCtx=%#p cbToRead=%zu pcbActuallyRead=%#p\n",
+                 pBackendData, uOffset, pIoCtx, cbToRead, pcbActuallyRead));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    PVDTBLCACHEENTRY pMapEntry = NULL;
+
+    AssertPtr(pImage);
+    Assert(uOffset % 512 == 0);
+    Assert(cbToRead % 512 == 0);
+    AssertReturn((VALID_PTR(pIoCtx) && cbToRead), VERR_INVALID_PARAMETER);
+    AssertReturn(uOffset + cbToRead <= pImage->cbSize, VERR_INVALID_PARAMETER);
+    AssertReturn(pImage->pStorageDat, VERR_VD_NOT_OPENED);
+
+    uint32_t idxBlock = (uint32_t)(uOffset / VDD_BLOCK_SIZE);
+    uint32_t offBlock = (uint32_t)(uOffset % VDD_BLOCK_SIZE);
+
+    /* Clip read size to remain in the block. */
+    cbToRead = RT_MIN(cbToRead, VDD_BLOCK_SIZE - offBlock);
+
+    vddWritesReap(pImage);
+
+    int rc = vddMapPageFetch(pImage, pIoCtx, idxBlock, &pMapEntry);
+    if (RT_SUCCESS(rc))
+    {
+        /* The store worker might update the entry concurrently. */
+        uint64_t uEntry = ASMAtomicReadU64(&pMapEntry->paTbl[idxBlock % VDD_MAP_PAGE_ENTRIES]);
+        vdTblCacheEntryRelease(pMapEntry);
+
+        if (uEntry == VDD_MAP_ENTRY_FREE)
+            rc = VERR_VD_BLOCK_FREE;
+        else if (uEntry == VDD_MAP_ENTRY_ZERO)
+            vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+        else
+            rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorageDat,
+                                       (uint64_t)VDD_MAP_ENTRY_GET_SLOT(uEntry) * VDD_BLOCK_SIZE + offBlock,
+                                       pIoCtx, cbToRead);
+    }
+
+    if (   (   RT_SUCCESS(rc)
+            || rc == VERR_VD_BLOCK_FREE
+            || rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+        && pcbActuallyRead)
+        *pcbActuallyRead = cbToRead;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnWrite */
+static DECLCALLBACK(int) vddWrite(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
+                                  PVDIOCTX pIoCtx, size_t *pcbWriteProcess, size_t *pcbPreRead,
+                                  size_t *pcbPostRead, unsigned fWrite)
+{
+    LogFlowFunc(("pBackendData=%#p uOffset=%llu pIoCtx=%#p cbToWrite=%zu pcbWriteProcess=%#p pcbPreRead=%#p pcbPostRead=%#p\n",
+                 pBackendData, uOffset, pIoCtx, cbToWrite, pcbWriteProcess, pcbPreRead, pcbPostRead));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+    Assert(!(uOffset % 512));
+    Assert(!(cbToWrite % 512));
+    AssertReturn((VALID_PTR(pIoCtx) && cbToWrite), VERR_INVALID_PARAMETER);
+    AssertReturn(uOffset < (uint64_t)pImage->cBlocks * VDD_BLOCK_SIZE, VERR_INVALID_PARAMETER);
+
+    if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        uint32_t idxBlock = (uint32_t)(uOffset / VDD_BLOCK_SIZE);
+        uint32_t offBlock = (uint32_t)(uOffset % VDD_BLOCK_SIZE);
+
+        /* Clip write size to remain in the block. */
+        cbToWrite = RT_MIN(cbToWrite, VDD_BLOCK_SIZE - offBlock);
+
+        vddWritesReap(pImage);
+
+        /*
+         * Chunks are immutable, so every block write replaces the whole block.
+         * Let the upper layer assemble the full block (reading the rest from this
+         * image or its parents) unless it hands us a full block for real already.
+         * This also makes it skip writes which don't change anything.
+         */
+        if (   cbToWrite == VDD_BLOCK_SIZE
+            && !(fWrite & VD_WRITE_NO_ALLOC))
+        {
+            rc = vddBlockWrite(pImage, pIoCtx, idxBlock);
+            *pcbPreRead  = 0;
+            *pcbPostRead = 0;
+        }
+        else
+        {
+            rc = VERR_VD_BLOCK_FREE;
+            *pcbPreRead  = offBlock;
+            *pcbPostRead = VDD_BLOCK_SIZE - cbToWrite - offBlock;
+        }
+
+        if (pcbWriteProcess)
+            *pcbWriteProcess = cbToWrite;
+    }
+    else
+        rc = VERR_VD_IMAGE_READ_ONLY;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Completes an image flush, handing the references of the chunks the flushed
+ * block map doesn't refer to anymore to the store worker.
+ *
+ * @returns VBox status code.
+ * @param   pBackendData    Image instance data.
+ * @param   pIoCtx          The I/O context.
+ * @param   pvUser          The chunk references to drop, VDDUNREFS, optional.
+ * @param   rcReq           Status code of the flush.
+ */
+static DECLCALLBACK(int) vddFlushComplete(void *pBackendData, PVDIOCTX pIoCtx, void *pvUser, int rcReq)
+{
+    RT_NOREF1(pIoCtx);
+    PVDDIMAGE  pImage  = (PVDDIMAGE)pBackendData;
+    PVDDUNREFS pUnrefs = (PVDDUNREFS)pvUser;
+
+    if (pUnrefs)
+    {
+        if (RT_SUCCESS(rcReq))
+            vddStoreUnrefsQueue(pImage->pStore, pUnrefs);
+        else
+        {
+            /* Keep them for the next flush. */
+            RTSemFastMutexRequest(pImage->hMtxUpdate);
+            int rc = vddUnrefsAdd(&pImage->Unrefs, pUnrefs->paEntries, pUnrefs->cEntries);
+            RTSemFastMutexRelease(pImage->hMtxUpdate);
+            if (RT_FAILURE(rc))
+                LogRel(("VDD: Out of memory releasing %u chunks of image '%s', the chunks leak\n",
+                        pUnrefs->cEntries, pImage->pszFilename));
+            RTMemFree(pUnrefs->paEntries);
+        }
+        RTMemFree(pUnrefs);
+    }
+
+    return rcReq;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnFlush */
+static DECLCALLBACK(int) vddFlush(void *pBackendData, PVDIOCTX pIoCtx)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtr(pImage);
+    AssertPtrReturn(pIoCtx, VERR_INVALID_PARAMETER);
+
+    if (   pImage->pStorage
+        && !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+    {
+        vddWritesReap(pImage);
+
+        /*
+         * The chunks of the map entries written so far are on the disk already, the
+         * flush makes the entries durable. Only the chunks replaced by the entries
+         * written so far can be released once it completes.
+         */
+        PVDDUNREFS pUnrefs = NULL;
+        RTSemFastMutexRequest(pImage->hMtxUpdate);
+        if (pImage->Unrefs.cEntries)
+        {
+            pUnrefs = (PVDDUNREFS)RTMemAlloc(sizeof(VDDUNREFS));
+            if (pUnrefs)
+            {
+                *pUnrefs = pImage->Unrefs;
+                RT_ZERO(pImage->Unrefs);
+            }
+            /* else: Try again with the next flush. */
+        }
+        RTSemFastMutexRelease(pImage->hMtxUpdate);
+
+        VddHeader Header;
+
+        vddHdrConvertFromHostEndianess(pImage, &Header);
+        rc = vdIfIoIntFileWriteMeta(pImage->pIfIo, pImage->pStorage,
+                                    0, &Header, sizeof(Header),
+                                    pIoCtx, NULL, NULL);
+        if (RT_SUCCESS(rc) || rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+        {
+            rc = vdIfIoIntFileFlush(pImage->pIfIo, pImage->pStorage,
+                                    pIoCtx, vddFlushComplete, pUnrefs);
+            if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+                rc = vddFlushComplete(pImage, pIoCtx, pUnrefs, rc);
+        }
+        else
+            vddFlushComplete(pImage, pIoCtx, pUnrefs, rc);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetVersion */
+static DECLCALLBACK(unsigned) vddGetVersion(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, 0);
+
+    return VDD_HDR_VERSION;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetFileSize */
+static DECLCALLBACK(uint64_t) vddGetFileSize(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    uint64_t cb = 0;
+
+    AssertPtrReturn(pImage, 0);
+
+    /* Only the image itself, the chunks are shared with other images. */
+    uint64_t cbFile;
+    if (pImage->pStorage)
+    {
+        int rc = vdIfIoIntFileGetSize(pImage->pIfIo, pImage->pStorage, &cbFile);
+        if (RT_SUCCESS(rc))
+            cb += cbFile;
+    }
+
+    LogFlowFunc(("returns %lld\n", cb));
+    return cb;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetPCHSGeometry */
+static DECLCALLBACK(int) vddGetPCHSGeometry(void *pBackendData,
+                                            PVDGEOMETRY pPCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pPCHSGeometry=%#p\n", pBackendData, pPCHSGeometry));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (pImage->PCHSGeometry.cCylinders)
+        *pPCHSGeometry = pImage->PCHSGeometry;
+    else
+        rc = VERR_VD_GEOMETRY_NOT_SET;
+
+    LogFlowFunc(("returns %Rrc (PCHS=%u/%u/%u)\n", rc, pPCHSGeometry->cCylinders, pPCHSGeometry->cHeads, pPCHSGeometry->cSectors));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetPCHSGeometry */
+static DECLCALLBACK(int) vddSetPCHSGeometry(void *pBackendData,
+                                            PCVDGEOMETRY pPCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pPCHSGeometry=%#p PCHS=%u/%u/%u\n",
+                 pBackendData, pPCHSGeometry, pPCHSGeometry->cCylinders, pPCHSGeometry->cHeads, pPCHSGeometry->cSectors));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        rc = VERR_VD_IMAGE_READ_ONLY;
+    else
+        pImage->PCHSGeometry = *pPCHSGeometry;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetLCHSGeometry */
+static DECLCALLBACK(int) vddGetLCHSGeometry(void *pBackendData, PVDGEOMETRY pLCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pLCHSGeometry=%#p\n", pBackendData, pLCHSGeometry));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (pImage->LCHSGeometry.cCylinders)
+        *pLCHSGeometry = pImage->LCHSGeometry;
+    else
+        rc = VERR_VD_GEOMETRY_NOT_SET;
+
+    LogFlowFunc(("returns %Rrc (LCHS=%u/%u/%u)\n", rc, pLCHSGeometry->cCylinders,
+                 pLCHSGeometry->cHeads, pLCHSGeometry->cSectors));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetLCHSGeometry */
+static DECLCALLBACK(int) vddSetLCHSGeometry(void *pBackendData, PCVDGEOMETRY pLCHSGeometry)
+{
+    LogFlowFunc(("pBackendData=%#p pLCHSGeometry=%#p LCHS=%u/%u/%u\n", pBackendData,
+                 pLCHSGeometry, pLCHSGeometry->cCylinders, pLCHSGeometry->cHeads, pLCHSGeometry->cSectors));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+        rc = VERR_VD_IMAGE_READ_ONLY;
+    else
+        pImage->LCHSGeometry = *pLCHSGeometry;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnQueryRegions */
+static DECLCALLBACK(int) vddQueryRegions(void *pBackendData, PCVDREGIONLIST *ppRegionList)
+{
+    LogFlowFunc(("pBackendData=%#p ppRegionList=%#p\n", pBackendData, ppRegionList));
+    PVDDIMAGE pThis = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pThis, VERR_VD_NOT_OPENED);
+
+    *ppRegionList = &pThis->RegionList;
+    LogFlowFunc(("returns %Rrc\n", VINF_SUCCESS));
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnRegionListRelease */
+static DECLCALLBACK(void) vddRegionListRelease(void *pBackendData, PCVDREGIONLIST pRegionList)
+{
+    RT_NOREF1(pRegionList);
+    LogFlowFunc(("pBackendData=%#p pRegionList=%#p\n", pBackendData, pRegionList));
+    PVDDIMAGE pThis = (PVDDIMAGE)pBackendData;
+    AssertPtr(pThis); RT_NOREF(pThis);
+
+    /* Nothing to do here. */
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetImageFlags */
+static DECLCALLBACK(unsigned) vddGetImageFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, 0);
+
+    LogFlowFunc(("returns %#x\n", pImage->uImageFlags));
+    return pImage->uImageFlags;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetOpenFlags */
+static DECLCALLBACK(unsigned) vddGetOpenFlags(void *pBackendData)
+{
+    LogFlowFunc(("pBackendData=%#p\n", pBackendData));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, 0);
+
+    LogFlowFunc(("returns %#x\n", pImage->uOpenFlags));
+    return pImage->uOpenFlags;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetOpenFlags */
+static DECLCALLBACK(int) vddSetOpenFlags(void *pBackendData, unsigned uOpenFlags)
+{
+    LogFlowFunc(("pBackendData=%#p\n uOpenFlags=%#x", pBackendData, uOpenFlags));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    /* Image must be opened and the new flags must be valid. */
+    if (!pImage || (uOpenFlags & ~(  VD_OPEN_FLAGS_READONLY | VD_OPEN_FLAGS_INFO
+                                   | VD_OPEN_FLAGS_ASYNC_IO | VD_OPEN_FLAGS_SHAREABLE
+                                   | VD_OPEN_FLAGS_SEQUENTIAL | VD_OPEN_FLAGS_SKIP_CONSISTENCY_CHECKS)))
+        rc = VERR_INVALID_PARAMETER;
+    else
+    {
+        /* Implement this operation via reopening the image. */
+        rc = vddFreeImage(pImage, false);
+        if (RT_SUCCESS(rc))
+            rc = vddOpenImage(pImage, uOpenFlags);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetComment */
+VD_BACKEND_CALLBACK_GET_COMMENT_DEF_NOT_SUPPORTED(vddGetComment);
+
+/** @copydoc VDIMAGEBACKEND::pfnSetComment */
+VD_BACKEND_CALLBACK_SET_COMMENT_DEF_NOT_SUPPORTED(vddSetComment, PVDDIMAGE);
+
+/** @copydoc VDIMAGEBACKEND::pfnGetUuid */
+static DECLCALLBACK(int) vddGetUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    *pUuid = pImage->ImageUuid;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", VINF_SUCCESS, pUuid));
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetUuid */
+static DECLCALLBACK(int) vddSetUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        pImage->ImageUuid = *pUuid;
+    else
+        rc = VERR_VD_IMAGE_READ_ONLY;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetModificationUuid */
+static DECLCALLBACK(int) vddGetModificationUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    *pUuid = pImage->ModificationUuid;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", VINF_SUCCESS, pUuid));
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetModificationUuid */
+static DECLCALLBACK(int) vddSetModificationUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        pImage->ModificationUuid = *pUuid;
+    else
+        rc = VERR_VD_IMAGE_READ_ONLY;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetParentUuid */
+static DECLCALLBACK(int) vddGetParentUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    *pUuid = pImage->ParentUuid;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", VINF_SUCCESS, pUuid));
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetParentUuid */
+static DECLCALLBACK(int) vddSetParentUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        pImage->ParentUuid = *pUuid;
+    else
+        rc = VERR_VD_IMAGE_READ_ONLY;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnGetParentModificationUuid */
+static DECLCALLBACK(int) vddGetParentModificationUuid(void *pBackendData, PRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p pUuid=%#p\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    *pUuid = pImage->ParentModificationUuid;
+
+    LogFlowFunc(("returns %Rrc (%RTuuid)\n", VINF_SUCCESS, pUuid));
+    return VINF_SUCCESS;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnSetParentModificationUuid */
+static DECLCALLBACK(int) vddSetParentModificationUuid(void *pBackendData, PCRTUUID pUuid)
+{
+    LogFlowFunc(("pBackendData=%#p Uuid=%RTuuid\n", pBackendData, pUuid));
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+    int rc = VINF_SUCCESS;
+
+    AssertPtrReturn(pImage, VERR_VD_NOT_OPENED);
+
+    if (!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY))
+        pImage->ParentModificationUuid = *pUuid;
+    else
+        rc = VERR_VD_IMAGE_READ_ONLY;
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
+/** @copydoc VDIMAGEBACKEND::pfnDump */
+static DECLCALLBACK(void) vddDump(void *pBackendData)
+{
+    PVDDIMAGE pImage = (PVDDIMAGE)pBackendData;
+
+    AssertPtrReturnVoid(pImage);
+    vdIfErrorMessage(pImage->pIfError, "Header: Geometry PCHS=%u/%u/%u LCHS=%u/%u/%u cbSector=%llu\n",
+                     pImage->PCHSGeometry.cCylinders, pImage->PCHSGeometry.cHeads, pImage->PCHSGeometry.cSectors,
+                     pImage->LCHSGeometry.cCylinders, pImage->LCHSGeometry.cHeads, pImage->LCHSGeometry.cSectors,
+                     pImage->cbSize / 512);
+    vdIfErrorMessage(pImage->pIfError, "Header: cBlocks=%u cbBlock=%u offMap=%llu Store=%s\n",
+                     pImage->cBlocks, VDD_BLOCK_SIZE, pImage->offMap, pImage->szStore);
+    vdIfErrorMessage(pImage->pIfError, "Header: uuidCreation={%RTuuid}\n", &pImage->ImageUuid);
+    vdIfErrorMessage(pImage->pIfError, "Header: uuidModification={%RTuuid}\n", &pImage->ModificationUuid);
+    vdIfErrorMessage(pImage->pIfError, "Header: uuidParent={%RTuuid}\n", &pImage->ParentUuid);
+    vdIfErrorMessage(pImage->pIfError, "Header: uuidParentModification={%RTuuid}\n", &pImage->ParentModificationUuid);
+}
+
+
+const VDIMAGEBACKEND g_VddBackend =
+{
+    /* u32Version */
+    VD_IMGBACKEND_VERSION,
+    /* pszBackendName */
+    "VDD",
+    /* uBackendCaps */
+    VD_CAP_UUID | VD_CAP_CREATE_DYNAMIC | VD_CAP_DIFF | VD_CAP_FILE | VD_CAP_ASYNC | VD_CAP_CONFIG,
+    /* paFileExtensions */
+    s_aVddFileExtensions,
+    /* paConfigInfo */
+    s_aVddConfigInfo,
+    /* pfnProbe */
+    vddProbe,
+    /* pfnOpen */
+    vddOpen,
+    /* pfnCreate */
+    vddCreate,
+    /* pfnRename */
+    vddRename,
+    /* pfnClose */
+    vddClose,
+    /* pfnRead */
+    vddRead,
+    /* pfnWrite */
+    vddWrite,
+    /* pfnFlush */
+    vddFlush,
+    /* pfnDiscard */
+    NULL,
+    /* pfnGetVersion */
+    vddGetVersion,
+    /* pfnGetFileSize */
+    vddGetFileSize,
+    /* pfnGetPCHSGeometry */
+    vddGetPCHSGeometry,
+    /* pfnSetPCHSGeometry */
+    vddSetPCHSGeometry,
+    /* pfnGetLCHSGeometry */
+    vddGetLCHSGeometry,
+    /* pfnSetLCHSGeometry */
+    vddSetLCHSGeometry,
+    /* pfnQueryRegions */
+    vddQueryRegions,
+    /* pfnRegionListRelease */
+    vddRegionListRelease,
+    /* pfnGetImageFlags */
+    vddGetImageFlags,
+    /* pfnGetOpenFlags */
+    vddGetOpenFlags,
+    /* pfnSetOpenFlags */
+    vddSetOpenFlags,
+    /* pfnGetComment */
+    vddGetComment,
+    /* pfnSetComment */
+    vddSetComment,
+    /* pfnGetUuid */
+    vddGetUuid,
+    /* pfnSetUuid */
+    vddSetUuid,
+    /* pfnGetModificationUuid */
+    vddGetModificationUuid,
+    /* pfnSetModificationUuid */
+    vddSetModificationUuid,
+    /* pfnGetParentUuid */
+    vddGetParentUuid,
+    /* pfnSetParentUuid */
+    vddSetParentUuid,
+    /* pfnGetParentModificationUuid */
+    vddGetParentModificationUuid,
+    /* pfnSetParentModificationUuid */
+    vddSetParentModificationUuid,
+    /* pfnDump */
+    vddDump,
+    /* pfnGetTimestamp */
+    NULL,
+    /* pfnGetParentTimestamp */
+    NULL,
+    /* pfnSetParentTimestamp */
+    NULL,
+    /* pfnGetParentFilename */
+    NULL,
+    /* pfnSetParentFilename */
+    NULL,
+    /* pfnComposeLocation */
+    genericFileComposeLocation,
+    /* pfnComposeName */
+    genericFileComposeName,
+    /* pfnCompact */
+    NULL,
+    /* pfnResize */
+    NULL,
+    /* pfnRepair */
+    NULL,
+    /* pfnTraverseMetadata */
+    NULL,
+    /* u32Version */
+    VD_IMGBACKEND_VERSION
+};
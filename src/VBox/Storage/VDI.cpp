@@ -30,6 +30,7 @@
 #include <iprt/uuid.h>
 #include <iprt/string.h>
 #include <iprt/asm.h>
+#include <iprt/param.h>
 
 #include "VDBackends.h"
 
@@ -208,6 +209,124 @@ static void vdiFlushImage(PVDIIMAGEDESC pImage)
     }
 }
 
+/**
+ * Internal: Frees the block array.
+ *
+ * @returns nothing.
+ * @param   pImage          The VDI image descriptor.
+ */
+static void vdiBlocksFree(PVDIIMAGEDESC pImage)
+{
+    if (pImage->paBlocks)
+    {
+        if (pImage->cbBlocksPageAlloc)
+            RTMemPageFree(pImage->paBlocks, pImage->cbBlocksPageAlloc);
+        else
+            RTMemFree(pImage->paBlocks);
+        pImage->paBlocks = NULL;
+    }
+    pImage->cbBlocksPageAlloc = 0;
+
+    if (pImage->pbmBlocksLoaded)
+    {
+        RTMemFree(pImage->pbmBlocksLoaded);
+        pImage->pbmBlocksLoaded = NULL;
+    }
+}
+
+/**
+ * Internal: Reads one segment of the block array from the image if it is
+ * loaded on demand.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_NOT_ENOUGH_METADATA if the segment is being read asynchronously,
+ *          the I/O context is continued once it arrived.
+ * @param   pImage          The VDI image descriptor.
+ * @param   idxSeg          The segment to load.
+ * @param   pIoCtx          The I/O context the segment is needed for, NULL to read
+ *                          it synchronously.
+ */
+static int vdiBlocksSegLoad(PVDIIMAGEDESC pImage, unsigned idxSeg, PVDIOCTX pIoCtx)
+{
+    unsigned idxFirst = idxSeg * VDI_BLOCKS_SEG_ENTRIES;
+    unsigned cEntries = RT_MIN(VDI_BLOCKS_SEG_ENTRIES, getImageBlocks(&pImage->Header) - idxFirst);
+    PVDMETAXFER pMetaXfer = NULL;
+
+    int rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
+                                   pImage->offStartBlocks + (uint64_t)idxFirst * sizeof(VDIIMAGEBLOCKPOINTER),
+                                   &pImage->paBlocks[idxFirst], cEntries * sizeof(VDIIMAGEBLOCKPOINTER),
+                                   pIoCtx, pIoCtx ? &pMetaXfer : NULL, NULL, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        if (pMetaXfer)
+            vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+        vdiConvBlocksEndianess(VDIECONV_F2H, &pImage->paBlocks[idxFirst], cEntries);
+        ASMBitSet(pImage->pbmBlocksLoaded, idxSeg);
+    }
+    else if (rc != VERR_VD_NOT_ENOUGH_METADATA)
+        LogRel(("VDI: Reading block array segment %u of '%s' failed with %Rrc\n",
+                idxSeg, pImage->pszFilename, rc));
+
+    return rc;
+}
+
+/**
+ * Internal: Makes sure the block array entry of the given block is in memory.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_NOT_ENOUGH_METADATA if the entry is being read asynchronously.
+ * @param   pImage          The VDI image descriptor.
+ * @param   uBlock          The block which is going to be accessed.
+ * @param   pIoCtx          The I/O context accessing the block.
+ */
+DECLINLINE(int) vdiBlocksEnsureLoaded(PVDIIMAGEDESC pImage, unsigned uBlock, PVDIOCTX pIoCtx)
+{
+    if (RT_LIKELY(   !pImage->pbmBlocksLoaded
+                  || ASMBitTest(pImage->pbmBlocksLoaded, uBlock / VDI_BLOCKS_SEG_ENTRIES)))
+        return VINF_SUCCESS;
+
+    return vdiBlocksSegLoad(pImage, uBlock / VDI_BLOCKS_SEG_ENTRIES, pIoCtx);
+}
+
+/**
+ * Internal: Loads the complete block array for operations working on all blocks.
+ *
+ * The block array is moved to the heap afterwards, it can be resized from there
+ * and there is nothing to gain from the page allocation anymore.
+ *
+ * @returns VBox status code.
+ * @param   pImage          The VDI image descriptor.
+ */
+static int vdiBlocksLoadAll(PVDIIMAGEDESC pImage)
+{
+    int rc = VINF_SUCCESS;
+
+    if (pImage->pbmBlocksLoaded)
+    {
+        unsigned cBlocks = getImageBlocks(&pImage->Header);
+        unsigned cSegs = (cBlocks + VDI_BLOCKS_SEG_ENTRIES - 1) / VDI_BLOCKS_SEG_ENTRIES;
+
+        for (unsigned idxSeg = 0; idxSeg < cSegs && RT_SUCCESS(rc); idxSeg++)
+            if (!ASMBitTest(pImage->pbmBlocksLoaded, idxSeg))
+                rc = vdiBlocksSegLoad(pImage, idxSeg, NULL /* pIoCtx */);
+
+        if (RT_SUCCESS(rc))
+        {
+            PVDIIMAGEBLOCKPOINTER paBlocks = (PVDIIMAGEBLOCKPOINTER)RTMemAlloc(sizeof(VDIIMAGEBLOCKPOINTER) * cBlocks);
+            if (RT_LIKELY(paBlocks))
+            {
+                memcpy(paBlocks, pImage->paBlocks, sizeof(VDIIMAGEBLOCKPOINTER) * cBlocks);
+                vdiBlocksFree(pImage);
+                pImage->paBlocks = paBlocks;
+            }
+            else
+                rc = VERR_NO_MEMORY;
+        }
+    }
+
+    return rc;
+}
+
 /**
  * Internal: Free all allocated space for representing an image, and optionally
  * delete the image from disk.
@@ -230,11 +349,7 @@ static int vdiFreeImage(PVDIIMAGEDESC pImage, bool fDelete)
             pImage->pStorage = NULL;
         }
 
-        if (pImage->paBlocks)
-        {
-            RTMemFree(pImage->paBlocks);
-            pImage->paBlocks = NULL;
-        }
+        vdiBlocksFree(pImage);
 
         if (pImage->paBlocksRev)
         {
@@ -242,6 +357,14 @@ static int vdiFreeImage(PVDIIMAGEDESC pImage, bool fDelete)
             pImage->paBlocksRev = NULL;
         }
 
+        if (pImage->paBlocksFree)
+        {
+            RTMemFree(pImage->paBlocksFree);
+            pImage->paBlocksFree = NULL;
+            pImage->cBlocksFree = 0;
+            pImage->cBlocksFreeMax = 0;
+        }
+
         if (fDelete && pImage->pszFilename)
         {
             int rc2 = vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
@@ -954,26 +1077,50 @@ static int vdiOpenImage(PVDIIMAGEDESC pImage, unsigned uOpenFlags)
         rc = vdiImageReadHeader(pImage);
         if (RT_SUCCESS(rc))
         {
-            /* Allocate memory for blocks array. */
-            pImage->paBlocks = (PVDIIMAGEBLOCKPOINTER)RTMemAlloc(sizeof(VDIIMAGEBLOCKPOINTER) * getImageBlocks(&pImage->Header));
-            if (RT_LIKELY(pImage->paBlocks))
+            unsigned cBlocks = getImageBlocks(&pImage->Header);
+            size_t cbBlocks = sizeof(VDIIMAGEBLOCKPOINTER) * cBlocks;
+            bool fLazyLoad = false;
+
+            /*
+             * The block array of huge images is loaded on demand, saves reading it at open time
+             * and only the parts being accessed take up memory. Discarding needs the back
+             * resolving table and therefore the whole block array.
+             */
+            if (   cbBlocks >= VDI_BLOCKS_LAZY_LOAD_MIN
+                && !(uOpenFlags & VD_OPEN_FLAGS_DISCARD))
             {
-                /* Read blocks array. */
-                rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, pImage->offStartBlocks, pImage->paBlocks,
-                                           getImageBlocks(&pImage->Header) * sizeof(VDIIMAGEBLOCKPOINTER));
-                if (RT_SUCCESS(rc))
+                unsigned cSegs = (cBlocks + VDI_BLOCKS_SEG_ENTRIES - 1) / VDI_BLOCKS_SEG_ENTRIES;
+
+                fLazyLoad = true;
+                pImage->pbmBlocksLoaded   = (uint32_t *)RTMemAllocZ(RT_ALIGN_32(cSegs, 32) / 8);
+                pImage->cbBlocksPageAlloc = RT_ALIGN_Z(cbBlocks, PAGE_SIZE);
+                pImage->paBlocks          = (PVDIIMAGEBLOCKPOINTER)RTMemPageAlloc(pImage->cbBlocksPageAlloc);
+            }
+            else
+                pImage->paBlocks = (PVDIIMAGEBLOCKPOINTER)RTMemAlloc(cbBlocks);
+
+            if (RT_LIKELY(   pImage->paBlocks
+                          && (!fLazyLoad || pImage->pbmBlocksLoaded)))
+            {
+                if (!fLazyLoad)
                 {
-                    vdiConvBlocksEndianess(VDIECONV_F2H, pImage->paBlocks, getImageBlocks(&pImage->Header));
+                    /* Read blocks array. */
+                    rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, pImage->offStartBlocks, pImage->paBlocks,
+                                               cbBlocks);
+                    if (RT_SUCCESS(rc))
+                    {
+                        vdiConvBlocksEndianess(VDIECONV_F2H, pImage->paBlocks, cBlocks);
 
-                    if (uOpenFlags & VD_OPEN_FLAGS_DISCARD)
-                        rc = vdiImageBackResolvTblCreate(pImage);
+                        if (uOpenFlags & VD_OPEN_FLAGS_DISCARD)
+                            rc = vdiImageBackResolvTblCreate(pImage);
+                    }
+                    else
+                        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VDI: Error reading the block table in '%s'"), pImage->pszFilename);
                 }
-                else
-                    rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VDI: Error reading the block table in '%s'"), pImage->pszFilename);
             }
             else
                 rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS,
-                               N_("VDI: Error allocating memory for the block table in '%s'"), pImage->pszFilename);;
+                               N_("VDI: Error allocating memory for the block table in '%s'"), pImage->pszFilename);
         }
     }
     /* else: Do NOT signal an appropriate error here, as the VD layer has the
@@ -1151,6 +1298,102 @@ static int vdiFlushImageIoCtx(PVDIIMAGEDESC pImage, PVDIOCTX pIoCtx)
     return rc;
 }
 
+/**
+ * Removes the given slot from the list of free block slots if it is in there.
+ *
+ * @returns true if the slot was found and removed, false otherwise.
+ * @param   pImage          The VDI image descriptor.
+ * @param   idxSlot         The block slot to remove.
+ */
+static bool vdiBlockSlotFreeListRemove(PVDIIMAGEDESC pImage, unsigned idxSlot)
+{
+    for (unsigned i = 0; i < pImage->cBlocksFree; i++)
+        if (pImage->paBlocksFree[i] == idxSlot)
+        {
+            pImage->paBlocksFree[i] = pImage->paBlocksFree[--pImage->cBlocksFree];
+            return true;
+        }
+
+    return false;
+}
+
+/**
+ * Reserves a block slot in the image for a new block.
+ *
+ * The slot is only accounted for in memory so that allocations which are in
+ * flight at the same time never end up with the same slot, the header is
+ * updated when the block data was written (see vdiBlockAllocUpdate()).
+ * Slots left behind by failed allocations are reused first.
+ *
+ * @returns Index of the reserved block slot.
+ * @param   pImage          The VDI image descriptor.
+ */
+static unsigned vdiBlockSlotReserve(PVDIIMAGEDESC pImage)
+{
+    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+
+    /*
+     * Nothing in flight, resync with the header which might have been changed by
+     * a discard, compaction or resize in the meantime.
+     */
+    if (!pImage->cBlockAllocsPending)
+    {
+        pImage->cBlockSlots = cBlocksAllocated;
+        for (unsigned i = 0; i < pImage->cBlocksFree; i++)
+            if (pImage->paBlocksFree[i] >= cBlocksAllocated)
+                pImage->paBlocksFree[i--] = pImage->paBlocksFree[--pImage->cBlocksFree];
+    }
+
+    pImage->cBlockAllocsPending++;
+    if (pImage->cBlocksFree)
+        return pImage->paBlocksFree[--pImage->cBlocksFree];
+
+    return pImage->cBlockSlots++;
+}
+
+/**
+ * Releases a block slot reserved with vdiBlockSlotReserve() after the
+ * allocation failed.
+ *
+ * @param   pImage          The VDI image descriptor.
+ * @param   idxSlot         The block slot to release.
+ */
+static void vdiBlockSlotRelease(PVDIIMAGEDESC pImage, unsigned idxSlot)
+{
+    Assert(pImage->cBlockAllocsPending);
+    pImage->cBlockAllocsPending--;
+
+    if (   idxSlot + 1 == pImage->cBlockSlots
+        && idxSlot >= getImageBlocksAllocated(&pImage->Header))
+    {
+        /* Last slot, shrink and drop any free slots which are now at the end. */
+        pImage->cBlockSlots--;
+        while (   pImage->cBlockSlots > getImageBlocksAllocated(&pImage->Header)
+               && vdiBlockSlotFreeListRemove(pImage, pImage->cBlockSlots - 1))
+            pImage->cBlockSlots--;
+    }
+    else
+    {
+        if (pImage->cBlocksFree == pImage->cBlocksFreeMax)
+        {
+            unsigned cBlocksFreeMaxNew = pImage->cBlocksFreeMax ? pImage->cBlocksFreeMax * 2 : 16;
+            unsigned *paBlocksFreeNew = (unsigned *)RTMemRealloc(pImage->paBlocksFree,
+                                                                 cBlocksFreeMaxNew * sizeof(unsigned));
+            if (!paBlocksFreeNew)
+            {
+                /* The slot is leaked until the image is compacted, no harm done otherwise. */
+                LogRel(("VDI: Leaking block slot %u of image '%s'\n", idxSlot, pImage->pszFilename));
+                return;
+            }
+
+            pImage->paBlocksFree   = paBlocksFreeNew;
+            pImage->cBlocksFreeMax = cBlocksFreeMaxNew;
+        }
+
+        pImage->paBlocksFree[pImage->cBlocksFree++] = idxSlot;
+    }
+}
+
 /**
  * Completion callback for meta/userdata reads or writes.
  *
@@ -1224,7 +1467,7 @@ static DECLCALLBACK(int) vdiDiscardBlockAsyncUpdate(void *pBackendData, PVDIOCTX
                 && rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
                 break;
 
-            pImage->cbImage -= pImage->cbTotalBlockData;
+            pImage->cbImage = (uint64_t)pDiscardAsync->idxLastBlock * pImage->cbTotalBlockData + pImage->offStartData;
             LogFlowFunc(("Set new size %llu\n", pImage->cbImage));
             rc2 = vdIfIoIntFileSetSize(pImage->pIfIo, pImage->pStorage, pImage->cbImage);
             if (RT_FAILURE(rc2))
@@ -1272,7 +1515,22 @@ static int vdiDiscardBlockAsync(PVDIIMAGEDESC pImage, PVDIOCTX pIoCtx,
     pDiscardAsync->uBlock  = uBlock;
     pDiscardAsync->pvBlock = pvBlock;
     pDiscardAsync->ptrBlockDiscard = pImage->paBlocks[uBlock];
-    pDiscardAsync->idxLastBlock = getImageBlocksAllocated(&pImage->Header) - 1;
+
+    /*
+     * Drop slots at the end of the image which no block refers to. They are left
+     * behind by failed allocations or by allocations which were in flight when
+     * the image was not closed properly.
+     */
+    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+    while (   cBlocksAllocated > pDiscardAsync->ptrBlockDiscard + 1
+           && pImage->paBlocksRev[cBlocksAllocated - 1] == VDI_IMAGE_BLOCK_FREE)
+    {
+        vdiBlockSlotFreeListRemove(pImage, cBlocksAllocated - 1);
+        cBlocksAllocated--;
+    }
+    setImageBlocksAllocated(&pImage->Header, cBlocksAllocated);
+
+    pDiscardAsync->idxLastBlock = cBlocksAllocated - 1;
     pDiscardAsync->uBlockLast = pImage->paBlocksRev[pDiscardAsync->idxLastBlock];
 
     /*
@@ -1359,17 +1617,28 @@ static DECLCALLBACK(int) vdiBlockAllocUpdate(void *pBackendData, PVDIOCTX pIoCtx
 
     if (RT_SUCCESS(rcReq))
     {
-        pImage->cbImage += pImage->cbTotalBlockData;
+        /*
+         * Account for the slot in the header now that the data is there.
+         * Allocations can complete out of order, so both are the maximum.
+         */
+        Assert(pImage->cBlockAllocsPending);
+        pImage->cBlockAllocsPending--;
+        if (pBlockAlloc->cBlocksAllocated >= getImageBlocksAllocated(&pImage->Header))
+            setImageBlocksAllocated(&pImage->Header, pBlockAlloc->cBlocksAllocated + 1);
+
+        uint64_t cbImageMin = (uint64_t)(pBlockAlloc->cBlocksAllocated + 1) * pImage->cbTotalBlockData
+                            + pImage->offStartData;
+        pImage->cbImage = RT_MAX(pImage->cbImage, cbImageMin);
         pImage->paBlocks[pBlockAlloc->uBlock] = pBlockAlloc->cBlocksAllocated;
 
         if (pImage->paBlocksRev)
             pImage->paBlocksRev[pBlockAlloc->cBlocksAllocated] = pBlockAlloc->uBlock;
 
-        setImageBlocksAllocated(&pImage->Header, pBlockAlloc->cBlocksAllocated + 1);
         rc = vdiUpdateBlockInfoAsync(pImage, pBlockAlloc->uBlock, pIoCtx,
                                      true /* fUpdateHdr */);
     }
-    /* else: I/O error don't update the block table. */
+    else /* I/O error don't update the block table. */
+        vdiBlockSlotRelease(pImage, pBlockAlloc->cBlocksAllocated);
 
     RTMemFree(pBlockAlloc);
     return rc;
@@ -1591,30 +1860,34 @@ static DECLCALLBACK(int) vdiRead(void *pBackendData, uint64_t uOffset, size_t cb
     cbToRead = RT_MIN(cbToRead, getImageBlockSize(&pImage->Header) - offRead);
     Assert(!(cbToRead % 512));
 
-    if (pImage->paBlocks[uBlock] == VDI_IMAGE_BLOCK_FREE)
-        rc = VERR_VD_BLOCK_FREE;
-    else if (pImage->paBlocks[uBlock] == VDI_IMAGE_BLOCK_ZERO)
-    {
-        size_t cbSet;
-
-        cbSet = vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
-        Assert(cbSet == cbToRead);
-    }
-    else
+    rc = vdiBlocksEnsureLoaded(pImage, uBlock, pIoCtx);
+    if (RT_SUCCESS(rc))
     {
-        /* Block present in image file, read relevant data. */
-        uint64_t u64Offset = (uint64_t)pImage->paBlocks[uBlock] * pImage->cbTotalBlockData
-                           + (pImage->offStartData + pImage->offStartBlockData + offRead);
+        if (pImage->paBlocks[uBlock] == VDI_IMAGE_BLOCK_FREE)
+            rc = VERR_VD_BLOCK_FREE;
+        else if (pImage->paBlocks[uBlock] == VDI_IMAGE_BLOCK_ZERO)
+        {
+            size_t cbSet;
 
-        if (u64Offset + cbToRead <= pImage->cbImage)
-            rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage, u64Offset,
-                                       pIoCtx, cbToRead);
+            cbSet = vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+            Assert(cbSet == cbToRead);
+        }
         else
         {
-            LogRel(("VDI: Out of range access (%llu) in image %s, image size %llu\n",
-                    u64Offset, pImage->pszFilename, pImage->cbImage));
-            vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
-            rc = VERR_VD_READ_OUT_OF_RANGE;
+            /* Block present in image file, read relevant data. */
+            uint64_t u64Offset = (uint64_t)pImage->paBlocks[uBlock] * pImage->cbTotalBlockData
+                               + (pImage->offStartData + pImage->offStartBlockData + offRead);
+
+            if (u64Offset + cbToRead <= pImage->cbImage)
+                rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage, u64Offset,
+                                           pIoCtx, cbToRead);
+            else
+            {
+                LogRel(("VDI: Out of range access (%llu) in image %s, image size %llu\n",
+                        u64Offset, pImage->pszFilename, pImage->cbImage));
+                vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+                rc = VERR_VD_READ_OUT_OF_RANGE;
+            }
         }
     }
 
@@ -1657,6 +1930,10 @@ static DECLCALLBACK(int) vdiWrite(void *pBackendData, uint64_t uOffset, size_t c
 
         do
         {
+            rc = vdiBlocksEnsureLoaded(pImage, uBlock, pIoCtx);
+            if (RT_FAILURE(rc))
+                break;
+
             if (!IS_VDI_IMAGE_BLOCK_ALLOCATED(pImage->paBlocks[uBlock]))
             {
                 /* Block is either free or zero. */
@@ -1690,7 +1967,7 @@ static DECLCALLBACK(int) vdiWrite(void *pBackendData, uint64_t uOffset, size_t c
                         break;
                     }
 
-                    unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header);
+                    unsigned cBlocksAllocated = vdiBlockSlotReserve(pImage);
                     uint64_t u64Offset = (uint64_t)cBlocksAllocated * pImage->cbTotalBlockData
                                        + (pImage->offStartData + pImage->offStartBlockData);
 
@@ -1707,6 +1984,7 @@ static DECLCALLBACK(int) vdiWrite(void *pBackendData, uint64_t uOffset, size_t c
                         break;
                     else if (RT_FAILURE(rc))
                     {
+                        vdiBlockSlotRelease(pImage, cBlocksAllocated);
                         RTMemFree(pBlockAlloc);
                         break;
                     }
@@ -2244,6 +2522,13 @@ static DECLCALLBACK(void) vdiDump(void *pBackendData)
                      pImage->uShiftOffset2Index,
                      pImage->offStartBlockData);
 
+    int rc = vdiBlocksLoadAll(pImage);
+    if (RT_FAILURE(rc))
+    {
+        vdIfErrorMessage(pImage->pIfError, "!! WARNING: Loading the block table failed with %Rrc !!\n", rc);
+        return;
+    }
+
     unsigned uBlock, cBlocksNotFree, cBadBlocks, cBlocks = getImageBlocks(&pImage->Header);
     for (uBlock=0, cBlocksNotFree=0, cBadBlocks=0; uBlock<cBlocks; uBlock++)
     {
@@ -2296,6 +2581,10 @@ static DECLCALLBACK(int) vdiCompact(void *pBackendData, unsigned uPercentStart,
         AssertBreakStmt(!(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY),
                         rc = VERR_VD_IMAGE_READ_ONLY);
 
+        rc = vdiBlocksLoadAll(pImage);
+        if (RT_FAILURE(rc))
+            break;
+
         unsigned cBlocks;
         unsigned cBlocksToMove = 0;
         size_t cbBlock;
@@ -2476,8 +2765,9 @@ static DECLCALLBACK(int) vdiCompact(void *pBackendData, unsigned uPercentStart,
         if (RT_FAILURE(rc))
             break;
 
-        /* Update image header. */
+        /* Update image header, any free block slots were filled up. */
         setImageBlocksAllocated(&pImage->Header, uBlockUsedPos);
+        pImage->cBlocksFree = 0;
         vdiUpdateHeader(pImage);
 
         /* Truncate the image to the proper size to finish compacting. */
@@ -2531,6 +2821,10 @@ static DECLCALLBACK(int) vdiResize(void *pBackendData, uint64_t cbSize,
         || pImage->uImageFlags & VD_IMAGE_FLAGS_FIXED)
         rc = VERR_NOT_SUPPORTED;
     else if (cbSize > getImageDiskSize(&pImage->Header))
+        rc = vdiBlocksLoadAll(pImage); /* The block array is relocated and rewritten completely. */
+
+    if (   RT_SUCCESS(rc)
+        && cbSize > getImageDiskSize(&pImage->Header))
     {
         unsigned cBlocksAllocated = getImageBlocksAllocated(&pImage->Header); /** < Blocks currently allocated, doesn't change during resize */
         uint32_t cBlocksNew = cbSize / getImageBlockSize(&pImage->Header);    /** < New number of blocks in the image after the resize */
@@ -2762,6 +3056,10 @@ static DECLCALLBACK(int) vdiDiscard(void *pBackendData, PVDIOCTX pIoCtx,
         if (pcbPostAllocated)
             *pcbPostAllocated = 0;
 
+        rc = vdiBlocksEnsureLoaded(pImage, uBlock, pIoCtx);
+        if (RT_FAILURE(rc))
+            break;
+
         if (IS_VDI_IMAGE_BLOCK_ALLOCATED(pImage->paBlocks[uBlock]))
         {
             uint8_t *pbBlockData;
@@ -3126,7 +3424,7 @@ const VDIMAGEBACKEND g_VDIBackend =
     /* uBackendCaps */
       VD_CAP_UUID | VD_CAP_CREATE_FIXED | VD_CAP_CREATE_DYNAMIC
     | VD_CAP_DIFF | VD_CAP_FILE | VD_CAP_ASYNC | VD_CAP_VFS | VD_CAP_DISCARD
-    | VD_CAP_PREFERRED,
+    | VD_CAP_PREFERRED | VD_CAP_CONCURRENT_ALLOC,
     /* paFileExtensions */
     s_aVdiFileExtensions,
     /* paConfigInfo */
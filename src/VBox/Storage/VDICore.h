@@ -264,6 +264,11 @@ typedef VDIIMAGEBLOCKPOINTER *PVDIIMAGEBLOCKPOINTER;
 #define VDI_IMAGE_BLOCK_UNALLOCATED   (VDI_IMAGE_BLOCK_ZERO)
 #define IS_VDI_IMAGE_BLOCK_ALLOCATED(bp)   (bp < VDI_IMAGE_BLOCK_UNALLOCATED)
 
+/** Number of block array entries loaded at once if the block array is loaded on demand (64KB). */
+#define VDI_BLOCKS_SEG_ENTRIES         _16K
+/** Minimum size of the block array in bytes before it is loaded on demand. */
+#define VDI_BLOCKS_LAZY_LOAD_MIN       _256K
+
 #define GET_MAJOR_HEADER_VERSION(ph) (VDI_GET_VERSION_MAJOR((ph)->uVersion))
 #define GET_MINOR_HEADER_VERSION(ph) (VDI_GET_VERSION_MINOR((ph)->uVersion))
 
@@ -533,6 +538,12 @@ typedef struct VDIIMAGEDESC
     VDIHEADER               Header;
     /** Pointer to a block array. */
     PVDIIMAGEBLOCKPOINTER   paBlocks;
+    /** Bitmap of block array segments (VDI_BLOCKS_SEG_ENTRIES each) which were
+     * loaded already, NULL if the whole block array is in memory. The block array
+     * is page allocated in that case so unloaded segments don't take up memory. */
+    uint32_t               *pbmBlocksLoaded;
+    /** Size of the page allocation backing paBlocks, 0 if allocated from the heap. */
+    size_t                  cbBlocksPageAlloc;
     /** Pointer to the block array for back resolving (used if discarding is enabled). */
     unsigned               *paBlocksRev;
     /** fFlags copy from image header, for speed optimization. */
@@ -563,6 +574,18 @@ typedef struct VDIIMAGEDESC
     PVDINTERFACEIOINT       pIfIo;
     /** Current size of the image (used for range validation when reading). */
     uint64_t                cbImage;
+    /** Array of block slots which were reserved for an allocation that failed
+     * and are not referenced by any block, reused before growing the image. */
+    unsigned               *paBlocksFree;
+    /** Number of entries in paBlocksFree. */
+    unsigned                cBlocksFree;
+    /** Number of entries paBlocksFree has room for. */
+    unsigned                cBlocksFreeMax;
+    /** Number of block slots used or reserved by allocations in flight, the
+     * header only accounts for slots once the block data was written. */
+    unsigned                cBlockSlots;
+    /** Number of block allocations in flight. */
+    unsigned                cBlockAllocsPending;
     /** The static region list. */
     VDREGIONLIST            RegionList;
 } VDIIMAGEDESC, *PVDIIMAGEDESC;
@@ -608,7 +631,7 @@ typedef struct VDIBLOCKDISCARDASYNC
  */
 typedef struct VDIASYNCBLOCKALLOC
 {
-    /** Number of blocks allocated. */
+    /** The block slot in the image reserved for the allocation. */
     unsigned                cBlocksAllocated;
     /** Block index to allocate. */
     unsigned                uBlock;
@@ -170,6 +170,25 @@ typedef struct VDFILTER
 /** Pointer to a VD filter instance. */
 typedef VDFILTER *PVDFILTER;
 
+/** Maximum number of block allocating writes which can be in flight at the same time. */
+#define VD_ALLOC_LOCKS_MAX      16
+
+/**
+ * Range lock held by a growing write while it allocates a block in an image
+ * whose backend supports concurrent allocations (VD_CAP_CONCURRENT_ALLOC).
+ */
+typedef struct VDALLOCLOCK
+{
+    /** The I/O context holding the lock - NIL_VDIOCTX if the slot is free. */
+    PVDIOCTX               pIoCtxOwner;
+    /** Start offset of the locked range. */
+    uint64_t               offStart;
+    /** First offset not affected by the lock. */
+    uint64_t               offEnd;
+} VDALLOCLOCK;
+/** Pointer to an allocation range lock. */
+typedef VDALLOCLOCK *PVDALLOCLOCK;
+
 /**
  * Virtual disk container main structure, private part.
  */
@@ -198,6 +217,13 @@ struct VDISK
     /** Flags representing the modification state. */
     unsigned               uModified;
 
+    /** Number of background operations (merges) running which want to
+     * yield to foreground I/O. */
+    volatile uint32_t      cBgOps;
+    /** Timestamp (RTTimeMilliTS) of the last foreground I/O request,
+     * only updated while cBgOps is not 0. */
+    volatile uint64_t      tsFgIoLast;
+
     /** Cached size of this disk. */
     uint64_t               cbSize;
     /** Cached PCHS geometry for this disk. */
@@ -240,6 +266,16 @@ struct VDISK
     /** If the disk was locked by a growing write, flush or discard request this contains
      * the first non affected offset to check for interfering I/O while it is in progress. */
     uint64_t               uOffsetEndLocked;
+    /** Number of allocation range locks held, the disk lock can't be taken while
+     * this is not 0. */
+    uint32_t               cAllocLocks;
+    /** Number of I/O contexts deferred because they wait for the disk lock or
+     * for an allocation range lock covering their range to be released. No new
+     * allocation range locks are handed out while this is not 0 so a stream of
+     * block allocations can't starve reads, writes, flushes or discards. */
+    uint32_t               cLockWaiters;
+    /** Allocation range locks held by growing writes running in parallel. */
+    VDALLOCLOCK            aAllocLocks[VD_ALLOC_LOCKS_MAX];
 
     /** Pointer to the L2 disk cache if any. */
     PVDCACHE               pCache;
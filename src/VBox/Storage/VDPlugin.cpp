@@ -83,6 +83,7 @@ static PCVDIMAGEBACKEND aStaticBackends[] =
     &g_QedBackend,
     &g_QCowBackend,
     &g_VhdxBackend,
+    &g_VddBackend,
     &g_RawBackend,
     &g_CueBackend,
     &g_VBoxIsoMakerBackend,
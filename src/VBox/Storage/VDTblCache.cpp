@@ -0,0 +1,430 @@
+/* $Id$ */
+/** @file
+ * VD - Metadata table cache shared by the image backends.
+ *
+ * Image formats like QCOW, QED and VHDX use a two level translation scheme
+ * where the second level tables are loaded on demand. This cache keeps
+ * recently used tables in memory. Lookups go through a hash table and
+ * eviction uses the CLOCK algorithm (second chance) which approximates LRU
+ * without touching any list on a cache hit.
+ *
+ * Every image gets a budget derived from the total size of its tables so
+ * small images don't waste memory while big ones aren't limited to a few
+ * tables. On top of that all caches share a global budget; once it is
+ * exhausted a cache only grows up to VD_TBL_CACHE_ENTRIES_MIN and recycles
+ * its own tables afterwards.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_VD
+#include <VBox/vd.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/mem.h>
+
+#include "VDTblCache.h"
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+
+/**
+ * Metadata table cache instance.
+ */
+typedef struct VDTBLCACHE
+{
+    /** Size of a single table in bytes. */
+    size_t              cbTbl;
+    /** Maximum number of tables this cache may hold. */
+    uint32_t            cEntriesMax;
+    /** Number of tables currently allocated. */
+    uint32_t            cEntries;
+    /** Position of the clock hand. */
+    uint32_t            idxHand;
+    /** Hash bucket mask. */
+    uint32_t            fHashMask;
+    /** Number of hits for this cache. */
+    uint64_t            cHits;
+    /** Number of misses for this cache. */
+    uint64_t            cMisses;
+    /** Number of evictions for this cache. */
+    uint64_t            cEvictions;
+    /** The hash buckets. */
+    PVDTBLCACHEENTRY   *papHash;
+    /** The CLOCK ring, cEntries valid entries. */
+    PVDTBLCACHEENTRY   *papClock;
+} VDTBLCACHE;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+
+/** Statistics and global memory accounting for all table caches. */
+static VDTBLCACHESTATS g_VDTblCacheStats = { 0, 0, 0, 0, VD_TBL_CACHE_GLOBAL_MAX };
+
+
+/**
+ * Returns the hash bucket index for the given table offset.
+ *
+ * @returns Bucket index.
+ * @param   pTblCache   The table cache.
+ * @param   offTbl      The table offset.
+ */
+DECLINLINE(uint32_t) vdTblCacheHash(PVDTBLCACHE pTblCache, uint64_t offTbl)
+{
+    /* Tables are at least sector aligned, mix the remaining bits (Fibonacci hashing). */
+    return (uint32_t)(((offTbl >> 9) * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & pTblCache->fHashMask;
+}
+
+/**
+ * Tries to reserve memory for one table in the global budget.
+ *
+ * @returns true if the memory could be reserved, false if the budget is exhausted.
+ * @param   cbTbl       Size of the table.
+ */
+static bool vdTblCacheGlobalReserve(size_t cbTbl)
+{
+    uint64_t cbUsed = ASMAtomicAddU64(&g_VDTblCacheStats.cbUsed, cbTbl) + cbTbl;
+    if (cbUsed <= ASMAtomicReadU64(&g_VDTblCacheStats.cbMax))
+        return true;
+
+    ASMAtomicSubU64(&g_VDTblCacheStats.cbUsed, cbTbl);
+    return false;
+}
+
+/**
+ * Unlinks the given entry from the hash table.
+ *
+ * @returns nothing.
+ * @param   pTblCache   The table cache.
+ * @param   pEntry      The entry to unlink.
+ */
+static void vdTblCacheHashRemove(PVDTBLCACHE pTblCache, PVDTBLCACHEENTRY pEntry)
+{
+    PVDTBLCACHEENTRY *ppPrev = &pTblCache->papHash[vdTblCacheHash(pTblCache, pEntry->offTbl)];
+    while (*ppPrev != pEntry)
+    {
+        Assert(*ppPrev);
+        ppPrev = &(*ppPrev)->pHashNext;
+    }
+
+    *ppPrev = pEntry->pHashNext;
+    pEntry->pHashNext = NULL;
+    pEntry->fCached   = false;
+}
+
+/**
+ * Runs the clock hand until an unreferenced entry without the accessed bit
+ * set is found.
+ *
+ * @returns Pointer to the evicted entry or NULL if all entries are in use.
+ * @param   pTblCache   The table cache.
+ */
+static PVDTBLCACHEENTRY vdTblCacheEvict(PVDTBLCACHE pTblCache)
+{
+    /* Two rounds at most, the first one clears all accessed bits. */
+    for (uint32_t i = 0; i < 2 * pTblCache->cEntries; i++)
+    {
+        PVDTBLCACHEENTRY pEntry = pTblCache->papClock[pTblCache->idxHand];
+
+        pTblCache->idxHand++;
+        if (pTblCache->idxHand >= pTblCache->cEntries)
+            pTblCache->idxHand = 0;
+
+        if (   pEntry->cRefs
+            || !pEntry->fCached)
+            continue;
+
+        if (pEntry->fAccessed)
+        {
+            pEntry->fAccessed = false;
+            continue;
+        }
+
+        vdTblCacheHashRemove(pTblCache, pEntry);
+        pTblCache->cEvictions++;
+        ASMAtomicIncU64(&g_VDTblCacheStats.cEvictions);
+        return pEntry;
+    }
+
+    return NULL;
+}
+
+/**
+ * Creates a new table cache.
+ *
+ * @returns VBox status code.
+ * @param   ppTblCache      Where to store the cache instance on success.
+ * @param   cbTbl           Size of a single table in bytes, 0 if not known yet.
+ *                          The cache must be sized with vdTblCacheSetTblSize()
+ *                          before it is used in that case.
+ * @param   cbTblsTotal     Combined size of all tables of the image, used to size
+ *                          the per image budget.
+ */
+DECLHIDDEN(int) vdTblCacheCreate(PVDTBLCACHE *ppTblCache, size_t cbTbl, uint64_t cbTblsTotal)
+{
+    AssertPtrReturn(ppTblCache, VERR_INVALID_POINTER);
+
+    int rc = VINF_SUCCESS;
+    PVDTBLCACHE pTblCache = (PVDTBLCACHE)RTMemAllocZ(sizeof(VDTBLCACHE));
+    if (RT_LIKELY(pTblCache))
+    {
+        if (cbTbl)
+            rc = vdTblCacheSetTblSize(pTblCache, cbTbl, cbTblsTotal);
+        if (RT_SUCCESS(rc))
+            *ppTblCache = pTblCache;
+        else
+            RTMemFree(pTblCache);
+    }
+    else
+        rc = VERR_NO_MEMORY;
+
+    return rc;
+}
+
+/**
+ * Sizes a table cache created without knowing the table size.
+ *
+ * @returns VBox status code.
+ * @param   pTblCache       The table cache.
+ * @param   cbTbl           Size of a single table in bytes.
+ * @param   cbTblsTotal     Combined size of all tables of the image, used to size
+ *                          the per image budget.
+ */
+DECLHIDDEN(int) vdTblCacheSetTblSize(PVDTBLCACHE pTblCache, size_t cbTbl, uint64_t cbTblsTotal)
+{
+    AssertPtrReturn(pTblCache, VERR_INVALID_POINTER);
+    AssertReturn(cbTbl > 0, VERR_INVALID_PARAMETER);
+    AssertReturn(!pTblCache->cbTbl, VERR_INVALID_STATE);
+
+    uint64_t cEntriesMax = RT_MIN(cbTblsTotal, VD_TBL_CACHE_IMAGE_MAX) / cbTbl;
+    cEntriesMax = RT_MAX(cEntriesMax, VD_TBL_CACHE_ENTRIES_MIN);
+
+    uint32_t cBuckets = 16;
+    while (cBuckets < cEntriesMax)
+        cBuckets <<= 1;
+
+    PVDTBLCACHEENTRY *papHash  = (PVDTBLCACHEENTRY *)RTMemAllocZ(cBuckets * sizeof(PVDTBLCACHEENTRY));
+    PVDTBLCACHEENTRY *papClock = (PVDTBLCACHEENTRY *)RTMemAllocZ(cEntriesMax * sizeof(PVDTBLCACHEENTRY));
+    if (RT_UNLIKELY(   !papHash
+                    || !papClock))
+    {
+        RTMemFree(papHash);
+        RTMemFree(papClock);
+        return VERR_NO_MEMORY;
+    }
+
+    pTblCache->cbTbl       = cbTbl;
+    pTblCache->cEntriesMax = (uint32_t)cEntriesMax;
+    pTblCache->fHashMask   = cBuckets - 1;
+    pTblCache->papHash     = papHash;
+    pTblCache->papClock    = papClock;
+    return VINF_SUCCESS;
+}
+
+/**
+ * Destroys the given table cache freeing all tables.
+ *
+ * @returns nothing.
+ * @param   pTblCache   The table cache to destroy.
+ */
+DECLHIDDEN(void) vdTblCacheDestroy(PVDTBLCACHE pTblCache)
+{
+    if (!pTblCache)
+        return;
+
+    LogFlowFunc(("pTblCache=%#p cHits=%llu cMisses=%llu cEvictions=%llu cEntries=%u/%u\n",
+                 pTblCache, pTblCache->cHits, pTblCache->cMisses, pTblCache->cEvictions,
+                 pTblCache->cEntries, pTblCache->cEntriesMax));
+
+    for (uint32_t i = 0; i < pTblCache->cEntries; i++)
+    {
+        PVDTBLCACHEENTRY pEntry = pTblCache->papClock[i];
+
+        Assert(!pEntry->cRefs);
+        RTMemPageFree(pEntry->paTbl, pTblCache->cbTbl);
+        RTMemFree(pEntry);
+    }
+
+    ASMAtomicSubU64(&g_VDTblCacheStats.cbUsed, (uint64_t)pTblCache->cEntries * pTblCache->cbTbl);
+    RTMemFree(pTblCache->papHash);
+    RTMemFree(pTblCache->papClock);
+    RTMemFree(pTblCache);
+}
+
+/**
+ * Returns the table at the given offset with a reference or NULL if it is not cached.
+ *
+ * @returns Pointer to the table cache entry or NULL.
+ * @param   pTblCache   The table cache.
+ * @param   offTbl      Offset of the table to search for.
+ */
+DECLHIDDEN(PVDTBLCACHEENTRY) vdTblCacheRetain(PVDTBLCACHE pTblCache, uint64_t offTbl)
+{
+    PVDTBLCACHEENTRY pEntry = pTblCache->papHash[vdTblCacheHash(pTblCache, offTbl)];
+    while (   pEntry
+           && pEntry->offTbl != offTbl)
+        pEntry = pEntry->pHashNext;
+
+    if (pEntry)
+    {
+        pEntry->fAccessed = true;
+        pEntry->cRefs++;
+        pTblCache->cHits++;
+        ASMAtomicIncU64(&g_VDTblCacheStats.cHits);
+    }
+    else
+    {
+        pTblCache->cMisses++;
+        ASMAtomicIncU64(&g_VDTblCacheStats.cMisses);
+    }
+
+    return pEntry;
+}
+
+/**
+ * Allocates a new table from the cache evicting old entries if required.
+ *
+ * The returned entry has one reference and is not visible to lookups until
+ * vdTblCacheEntryInsert() is called.
+ *
+ * @returns Pointer to the table cache entry or NULL if out of memory.
+ * @param   pTblCache   The table cache.
+ */
+DECLHIDDEN(PVDTBLCACHEENTRY) vdTblCacheEntryAlloc(PVDTBLCACHE pTblCache)
+{
+    PVDTBLCACHEENTRY pEntry = NULL;
+    bool fGrow = false;
+
+    if (pTblCache->cEntries < pTblCache->cEntriesMax)
+    {
+        if (pTblCache->cEntries < VD_TBL_CACHE_ENTRIES_MIN)
+        {
+            ASMAtomicAddU64(&g_VDTblCacheStats.cbUsed, pTblCache->cbTbl);
+            fGrow = true;
+        }
+        else
+            fGrow = vdTblCacheGlobalReserve(pTblCache->cbTbl);
+    }
+
+    if (!fGrow)
+    {
+        pEntry = vdTblCacheEvict(pTblCache);
+        if (pEntry)
+        {
+            pEntry->offTbl    = 0;
+            pEntry->fAccessed = false;
+            pEntry->cRefs     = 1;
+            return pEntry;
+        }
+
+        /* Everything is in use, exceed the global budget rather than failing the request. */
+        if (pTblCache->cEntries < pTblCache->cEntriesMax)
+        {
+            ASMAtomicAddU64(&g_VDTblCacheStats.cbUsed, pTblCache->cbTbl);
+            fGrow = true;
+        }
+    }
+
+    if (fGrow)
+    {
+        pEntry = (PVDTBLCACHEENTRY)RTMemAllocZ(sizeof(VDTBLCACHEENTRY));
+        if (RT_LIKELY(pEntry))
+        {
+            pEntry->paTbl = (uint64_t *)RTMemPageAllocZ(pTblCache->cbTbl);
+            if (RT_LIKELY(pEntry->paTbl))
+            {
+                pEntry->cRefs    = 1;
+                pEntry->idxClock = pTblCache->cEntries;
+                pTblCache->papClock[pTblCache->cEntries++] = pEntry;
+                return pEntry;
+            }
+
+            RTMemFree(pEntry);
+            pEntry = NULL;
+        }
+
+        ASMAtomicSubU64(&g_VDTblCacheStats.cbUsed, pTblCache->cbTbl);
+    }
+
+    return pEntry;
+}
+
+/**
+ * Inserts an entry into the table cache making it visible to lookups.
+ *
+ * @returns nothing.
+ * @param   pTblCache   The table cache.
+ * @param   pEntry      The entry to insert, the offset must be set.
+ */
+DECLHIDDEN(void) vdTblCacheEntryInsert(PVDTBLCACHE pTblCache, PVDTBLCACHEENTRY pEntry)
+{
+    Assert(pEntry->offTbl > 0);
+    Assert(!pEntry->fCached);
+
+    uint32_t idxBucket = vdTblCacheHash(pTblCache, pEntry->offTbl);
+#ifdef VBOX_STRICT
+    for (PVDTBLCACHEENTRY pIt = pTblCache->papHash[idxBucket]; pIt; pIt = pIt->pHashNext)
+        Assert(pIt->offTbl != pEntry->offTbl);
+#endif
+
+    pEntry->pHashNext = pTblCache->papHash[idxBucket];
+    pEntry->fCached   = true;
+    pEntry->fAccessed = true;
+    pTblCache->papHash[idxBucket] = pEntry;
+}
+
+/**
+ * Frees a table cache entry which is not inserted into the cache.
+ *
+ * @returns nothing.
+ * @param   pTblCache   The table cache.
+ * @param   pEntry      The entry to free.
+ */
+DECLHIDDEN(void) vdTblCacheEntryFree(PVDTBLCACHE pTblCache, PVDTBLCACHEENTRY pEntry)
+{
+    Assert(!pEntry->cRefs);
+    Assert(!pEntry->fCached);
+    Assert(pTblCache->papClock[pEntry->idxClock] == pEntry);
+
+    /* Keep the ring compact by moving the last entry into the free slot. */
+    uint32_t idxLast = --pTblCache->cEntries;
+    if (pEntry->idxClock != idxLast)
+    {
+        PVDTBLCACHEENTRY pLast = pTblCache->papClock[idxLast];
+        pLast->idxClock = pEntry->idxClock;
+        pTblCache->papClock[pEntry->idxClock] = pLast;
+    }
+    pTblCache->papClock[idxLast] = NULL;
+    if (pTblCache->idxHand >= pTblCache->cEntries)
+        pTblCache->idxHand = 0;
+
+    ASMAtomicSubU64(&g_VDTblCacheStats.cbUsed, pTblCache->cbTbl);
+    RTMemPageFree(pEntry->paTbl, pTblCache->cbTbl);
+    RTMemFree(pEntry);
+}
+
+VBOXDDU_DECL(PCVDTBLCACHESTATS) VDTblCacheGetStats(void)
+{
+    return &g_VDTblCacheStats;
+}
@@ -0,0 +1,89 @@
+/* $Id$ */
+/** @file
+ * VD - Metadata table cache shared by the image backends, internal header.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___VDTblCache_h
+#define ___VDTblCache_h
+
+#include <iprt/types.h>
+#include <iprt/assert.h>
+
+/** Minimum number of tables each cache can hold regardless of the global budget. */
+#define VD_TBL_CACHE_ENTRIES_MIN    8
+/** Maximum amount of memory a single image cache is allowed to use. */
+#define VD_TBL_CACHE_IMAGE_MAX      (32 * _1M)
+/** Default amount of memory all image caches together are allowed to use. */
+#define VD_TBL_CACHE_GLOBAL_MAX     (128 * _1M)
+
+/**
+ * Metadata table cache entry.
+ */
+typedef struct VDTBLCACHEENTRY
+{
+    /** Next entry in the hash bucket chain. */
+    struct VDTBLCACHEENTRY *pHashNext;
+    /** Index of the entry in the CLOCK ring. */
+    uint32_t                idxClock;
+    /** Reference counter. */
+    uint32_t                cRefs;
+    /** Flag whether the entry was accessed since the clock hand passed it the last time. */
+    bool                    fAccessed;
+    /** Flag whether the entry is linked into the hash table. */
+    bool                    fCached;
+    /** The offset of the table in the image, used as search key. */
+    uint64_t                offTbl;
+    /** Pointer to the cached table. */
+    uint64_t               *paTbl;
+} VDTBLCACHEENTRY;
+/** Pointer to a metadata table cache entry. */
+typedef VDTBLCACHEENTRY *PVDTBLCACHEENTRY;
+
+/** Opaque metadata table cache instance. */
+typedef struct VDTBLCACHE *PVDTBLCACHE;
+
+DECLHIDDEN(int)              vdTblCacheCreate(PVDTBLCACHE *ppTblCache, size_t cbTbl, uint64_t cbTblsTotal);
+DECLHIDDEN(int)              vdTblCacheSetTblSize(PVDTBLCACHE pTblCache, size_t cbTbl, uint64_t cbTblsTotal);
+DECLHIDDEN(void)             vdTblCacheDestroy(PVDTBLCACHE pTblCache);
+DECLHIDDEN(PVDTBLCACHEENTRY) vdTblCacheRetain(PVDTBLCACHE pTblCache, uint64_t offTbl);
+DECLHIDDEN(PVDTBLCACHEENTRY) vdTblCacheEntryAlloc(PVDTBLCACHE pTblCache);
+DECLHIDDEN(void)             vdTblCacheEntryInsert(PVDTBLCACHE pTblCache, PVDTBLCACHEENTRY pEntry);
+DECLHIDDEN(void)             vdTblCacheEntryFree(PVDTBLCACHE pTblCache, PVDTBLCACHEENTRY pEntry);
+
+/**
+ * Retains an already referenced table cache entry.
+ *
+ * @returns nothing.
+ * @param   pEntry      The cache entry.
+ */
+DECLINLINE(void) vdTblCacheEntryRetain(PVDTBLCACHEENTRY pEntry)
+{
+    Assert(pEntry->cRefs > 0);
+    pEntry->cRefs++;
+}
+
+/**
+ * Releases a table cache entry.
+ *
+ * @returns nothing.
+ * @param   pEntry      The cache entry.
+ */
+DECLINLINE(void) vdTblCacheEntryRelease(PVDTBLCACHEENTRY pEntry)
+{
+    Assert(pEntry->cRefs > 0);
+    pEntry->cRefs--;
+}
+
+#endif
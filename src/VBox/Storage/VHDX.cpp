@@ -33,6 +33,7 @@
 
 #include "VDBackends.h"
 #include "VDBackendsInline.h"
+#include "VDTblCache.h"
 
 
 /*********************************************************************************************************************************
@@ -510,6 +511,11 @@ typedef struct VHDXMETADATAITEMPROPS
     VHDXMETADATAITEM     enmMetadataItem;
 } VHDXMETADATAITEMPROPS;
 
+/** Size of a BAT page kept in the table cache. */
+#define VHDX_BAT_PAGE_SIZE          _64K
+/** Number of BAT entries in a single page. */
+#define VHDX_BAT_PAGE_ENTRIES       (VHDX_BAT_PAGE_SIZE / sizeof(VhdxBatEntry))
+
 /**
  * VHDX image data structure.
  */
@@ -546,8 +552,12 @@ typedef struct VHDXIMAGE
     /** Logical geometry of this image. */
     VDGEOMETRY          LCHSGeometry;
 
-    /** The BAT. */
-    PVhdxBatEntry       paBat;
+    /** Start offset of the BAT region in the image. */
+    uint64_t            offBat;
+    /** Size of the BAT region in bytes. */
+    size_t              cbBat;
+    /** Cache for the BAT pages, loaded on demand. */
+    PVDTBLCACHE         pBatCache;
     /** Chunk ratio. */
     uint32_t            uChunkRatio;
     /** The static region list. */
@@ -1000,11 +1010,8 @@ static int vhdxFreeImage(PVHDXIMAGE pImage, bool fDelete)
             pImage->pStorage = NULL;
         }
 
-        if (pImage->paBat)
-        {
-            RTMemFree(pImage->paBat);
-            pImage->paBat = NULL;
-        }
+        vdTblCacheDestroy(pImage->pBatCache);
+        pImage->pBatCache = NULL;
 
         if (fDelete && pImage->pszFilename)
             vdIfIoIntFileDelete(pImage->pIfIo, pImage->pszFilename);
@@ -1148,7 +1155,7 @@ static int vhdxFindAndLoadCurrentHeader(PVHDXIMAGE pImage)
 }
 
 /**
- * Loads the BAT region.
+ * Validates the BAT region and sets up the cache for the BAT pages.
  *
  * @returns VBox status code.
  * @param   pImage    Image instance data.
@@ -1187,22 +1194,50 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
     if (cbBatEntries <= cbRegion)
     {
         /*
-         * Load the complete BAT region first, convert to host endianess and process
-         * it afterwards. The SB entries can be removed because they are not needed yet.
+         * Validate the complete BAT page by page. The pages are read into the table
+         * cache and stay there until they are evicted, everything else is loaded on
+         * demand when accessed.
          */
-        paBatEntries = (PVhdxBatEntry)RTMemAlloc(cbBatEntries);
-        if (paBatEntries)
+        rc = vdTblCacheCreate(&pImage->pBatCache, VHDX_BAT_PAGE_SIZE,
+                              RT_ALIGN_64(cbBatEntries, VHDX_BAT_PAGE_SIZE));
+        if (RT_SUCCESS(rc))
         {
-            rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, offRegion,
-                                       paBatEntries, cbBatEntries);
-            if (RT_SUCCESS(rc))
+            for (uint32_t idxStart = 0; idxStart < cBatEntries && RT_SUCCESS(rc); idxStart += VHDX_BAT_PAGE_ENTRIES)
             {
+                uint32_t cPageEntries = RT_MIN(cBatEntries - idxStart, (uint32_t)VHDX_BAT_PAGE_ENTRIES);
+                uint64_t offPage = offRegion + (uint64_t)idxStart * sizeof(VhdxBatEntry);
+                size_t cbPage = RT_MIN(VHDX_BAT_PAGE_SIZE, offRegion + cbRegion - offPage);
+
+                PVDTBLCACHEENTRY pBatPage = vdTblCacheEntryAlloc(pImage->pBatCache);
+                if (!pBatPage)
+                {
+                    rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS,
+                                   "VHDX: Out of memory allocating memory for %u BAT entries of image \'%s\'",
+                                   (uint32_t)VHDX_BAT_PAGE_ENTRIES, pImage->pszFilename);
+                    break;
+                }
+
+                paBatEntries = (PVhdxBatEntry)pBatPage->paTbl;
+                rc = vdIfIoIntFileReadSync(pImage->pIfIo, pImage->pStorage, offPage,
+                                           paBatEntries, cbPage);
+                if (RT_FAILURE(rc))
+                {
+                    vdTblCacheEntryRelease(pBatPage);
+                    vdTblCacheEntryFree(pImage->pBatCache, pBatPage);
+                    rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                                   "VHDX: Error reading the BAT from image \'%s\'",
+                                   pImage->pszFilename);
+                    break;
+                }
+
                 vhdxConvBatTableEndianess(VHDXECONV_F2H, paBatEntries, paBatEntries,
-                                          cBatEntries);
+                                          (uint32_t)(cbPage / sizeof(VhdxBatEntry)));
 
-                /* Go through the table and validate it. */
-                for (unsigned i = 0; i < cBatEntries; i++)
+                /* Go through the page and validate it. */
+                for (uint32_t i = idxStart; i < idxStart + cPageEntries; i++)
                 {
+                    uint64_t u64BatEntry = paBatEntries[i - idxStart].u64BatEntry;
+
                     if (   i != 0
                         && (i % uChunkRatio) == 0)
                     {
@@ -1213,7 +1248,7 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
  */
 #if 0
                         /* Sector bitmap block. */
-                        if (   VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
+                        if (   VHDX_BAT_ENTRY_GET_STATE(u64BatEntry)
                             != VHDX_BAT_ENTRY_SB_BLOCK_NOT_PRESENT)
                         {
                             rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
@@ -1226,7 +1261,7 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
                     else
                     {
                         /* Payload block. */
-                        if (   VHDX_BAT_ENTRY_GET_STATE(paBatEntries[i].u64BatEntry)
+                        if (   VHDX_BAT_ENTRY_GET_STATE(u64BatEntry)
                             == VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT)
                         {
                             rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
@@ -1239,33 +1274,94 @@ static int vhdxLoadBatRegion(PVHDXIMAGE pImage, uint64_t offRegion,
 
                 if (RT_SUCCESS(rc))
                 {
-                    pImage->paBat       = paBatEntries;
-                    pImage->uChunkRatio = uChunkRatio;
+                    pBatPage->offTbl = offPage;
+                    vdTblCacheEntryInsert(pImage->pBatCache, pBatPage);
+                    vdTblCacheEntryRelease(pBatPage);
+                }
+                else
+                {
+                    vdTblCacheEntryRelease(pBatPage);
+                    vdTblCacheEntryFree(pImage->pBatCache, pBatPage);
                 }
             }
-            else
-                rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
-                               "VHDX: Error reading the BAT from image \'%s\'",
-                               pImage->pszFilename);
+
+            if (RT_SUCCESS(rc))
+            {
+                pImage->offBat      = offRegion;
+                pImage->cbBat       = cbRegion;
+                pImage->uChunkRatio = uChunkRatio;
+            }
         }
         else
-            rc = vdIfError(pImage->pIfError, VERR_NO_MEMORY, RT_SRC_POS,
-                           "VHDX: Out of memory allocating memory for %u BAT entries of image \'%s\'",
-                           cBatEntries, pImage->pszFilename);
+            rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                           "VHDX: Failed to create the BAT cache for image \'%s\'",
+                           pImage->pszFilename);
     }
     else
         rc = vdIfError(pImage->pIfError, VERR_VD_GEN_INVALID_HEADER, RT_SRC_POS,
                        "VHDX: Mismatch between calculated number of BAT entries and region size (expected %u got %u) for image \'%s\'",
                        cbBatEntries, cbRegion, pImage->pszFilename);
 
-    if (   RT_FAILURE(rc)
-        && paBatEntries)
-        RTMemFree(paBatEntries);
-
     LogFlowFunc(("returns rc=%Rrc\n", rc));
     return rc;
 }
 
+/**
+ * Queries the given BAT entry, reading the BAT page containing it into the cache
+ * if required.
+ *
+ * @returns VBox status code.
+ * @param   pImage          Image instance data.
+ * @param   pIoCtx          The I/O context.
+ * @param   idxBat          Index of the BAT entry to query.
+ * @param   pu64BatEntry    Where to store the BAT entry on success.
+ */
+static int vhdxBatQueryEntry(PVHDXIMAGE pImage, PVDIOCTX pIoCtx, uint32_t idxBat, uint64_t *pu64BatEntry)
+{
+    int rc = VINF_SUCCESS;
+    uint64_t offPage = pImage->offBat + (uint64_t)(idxBat / VHDX_BAT_PAGE_ENTRIES) * VHDX_BAT_PAGE_SIZE;
+
+    PVDTBLCACHEENTRY pBatPage = vdTblCacheRetain(pImage->pBatCache, offPage);
+    if (!pBatPage)
+    {
+        pBatPage = vdTblCacheEntryAlloc(pImage->pBatCache);
+        if (pBatPage)
+        {
+            /* Read from the image. */
+            PVDMETAXFER pMetaXfer;
+            size_t cbPage = RT_MIN(VHDX_BAT_PAGE_SIZE, pImage->offBat + pImage->cbBat - offPage);
+
+            pBatPage->offTbl = offPage;
+            rc = vdIfIoIntFileReadMeta(pImage->pIfIo, pImage->pStorage,
+                                       offPage, pBatPage->paTbl, cbPage, pIoCtx,
+                                       &pMetaXfer, NULL, NULL);
+            if (RT_SUCCESS(rc))
+            {
+                vdIfIoIntMetaXferRelease(pImage->pIfIo, pMetaXfer);
+                vhdxConvBatTableEndianess(VHDXECONV_F2H, (PVhdxBatEntry)pBatPage->paTbl,
+                                          (PVhdxBatEntry)pBatPage->paTbl,
+                                          (uint32_t)(cbPage / sizeof(VhdxBatEntry)));
+                vdTblCacheEntryInsert(pImage->pBatCache, pBatPage);
+            }
+            else
+            {
+                vdTblCacheEntryRelease(pBatPage);
+                vdTblCacheEntryFree(pImage->pBatCache, pBatPage);
+            }
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        *pu64BatEntry = pBatPage->paTbl[idxBat % VHDX_BAT_PAGE_ENTRIES];
+        vdTblCacheEntryRelease(pBatPage);
+    }
+
+    return rc;
+}
+
 /**
  * Load the file parameters metadata item from the file.
  *
@@ -1961,34 +2057,36 @@ static DECLCALLBACK(int) vhdxRead(void *pBackendData, uint64_t uOffset, size_t c
     {
         uint32_t idxBat = (uint32_t)(uOffset / pImage->cbBlock); Assert(idxBat == uOffset / pImage->cbBlock);
         uint32_t offRead = uOffset % pImage->cbBlock;
-        uint64_t uBatEntry;
+        uint64_t uBatEntry = 0;
 
         idxBat += idxBat / pImage->uChunkRatio; /* Add interleaving sector bitmap entries. */
-        uBatEntry = pImage->paBat[idxBat].u64BatEntry;
-
         cbToRead = RT_MIN(cbToRead, pImage->cbBlock - offRead);
 
-        switch (VHDX_BAT_ENTRY_GET_STATE(uBatEntry))
+        rc = vhdxBatQueryEntry(pImage, pIoCtx, idxBat, &uBatEntry);
+        if (RT_SUCCESS(rc))
         {
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_NOT_PRESENT:
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNDEFINED:
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_ZERO:
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNMAPPED:
+            switch (VHDX_BAT_ENTRY_GET_STATE(uBatEntry))
             {
-                vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
-                break;
-            }
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT:
-            {
-                uint64_t offFile = VHDX_BAT_ENTRY_GET_FILE_OFFSET(uBatEntry) + offRead;
-                rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage, offFile,
-                                           pIoCtx, cbToRead);
-                break;
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_NOT_PRESENT:
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNDEFINED:
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_ZERO:
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_UNMAPPED:
+                {
+                    vdIfIoIntIoCtxSet(pImage->pIfIo, pIoCtx, 0, cbToRead);
+                    break;
+                }
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_FULLY_PRESENT:
+                {
+                    uint64_t offFile = VHDX_BAT_ENTRY_GET_FILE_OFFSET(uBatEntry) + offRead;
+                    rc = vdIfIoIntFileReadUser(pImage->pIfIo, pImage->pStorage, offFile,
+                                               pIoCtx, cbToRead);
+                    break;
+                }
+                case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT:
+                default:
+                    rc = VERR_INVALID_PARAMETER;
+                    break;
             }
-            case VHDX_BAT_ENTRY_PAYLOAD_BLOCK_PARTIALLY_PRESENT:
-            default:
-                rc = VERR_INVALID_PARAMETER;
-                break;
         }
 
         if (pcbActuallyRead)
@@ -163,6 +163,25 @@ typedef enum TSTVDIOREQTXDIR
     TSTVDIOREQTXDIR_DISCARD
 } TSTVDIOREQTXDIR;
 
+/** Number of linear buckets at the start of the latency histogram. */
+#define TSTVDIO_LATENCY_BUCKETS_LINEAR  8
+/** Number of buckets in the latency histogram, every power of two above the
+ * linear part is split into 8 buckets giving a resolution of 12.5%. */
+#define TSTVDIO_LATENCY_BUCKETS         (TSTVDIO_LATENCY_BUCKETS_LINEAR + 61 * 8)
+
+/**
+ * Latency histogram for one type of request.
+ */
+typedef struct TSTVDIOLATENCY
+{
+    /** Number of requests recorded. */
+    volatile uint64_t cReqs;
+    /** Sum of all latencies in nanoseconds. */
+    volatile uint64_t cNsTotal;
+    /** Number of requests in each bucket. */
+    volatile uint64_t acReqs[TSTVDIO_LATENCY_BUCKETS];
+} TSTVDIOLATENCY, *PTSTVDIOLATENCY;
+
 /**
  * I/O request.
  */
@@ -186,6 +205,10 @@ typedef struct TSTVDIOREQ
     void             *pvBuf;
     /** Opaque user data. */
     void             *pvUser;
+    /** Timestamp when the request was submitted (RTTimeNanoTS). */
+    uint64_t         tsStart;
+    /** Latency histograms to record the request in, indexed by transfer type. */
+    PTSTVDIOLATENCY  paLatency;
     /** Number of segments used for the data buffer. */
     uint32_t         cSegs;
     /** Array of data segments. */
@@ -209,6 +232,12 @@ typedef struct VDIOTEST
     uint64_t    cbIo;
     /** Chance in percent to get a write. */
     unsigned    uWriteChance;
+    /** Number of data requests between two flushes, 0 for no flushes. */
+    uint32_t    cFlushInterval;
+    /** Number of data requests since the last flush. */
+    uint32_t    cReqsSinceFlush;
+    /** Latency histograms for reads, writes and flushes. */
+    TSTVDIOLATENCY aLatency[TSTVDIOREQTXDIR_FLUSH + 1];
     /** Maximum number of segments to create for one request. */
     uint32_t    cSegsMax;
     /** Pointer to the I/O data generator. */
@@ -236,6 +265,7 @@ typedef struct VDIOTEST
 static DECLCALLBACK(int) vdScriptHandlerCreate(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerOpen(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerIoBench(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerFlush(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerMerge(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerCompact(PVDSCRIPTARG paScriptArgs, void *pvUser);
@@ -304,6 +334,22 @@ const VDSCRIPTTYPE g_aArgIo[] =
     VDSCRIPTTYPE_STRING  /* pattern */
 };
 
+/* I/O benchmark action */
+const VDSCRIPTTYPE g_aArgIoBench[] =
+{
+    VDSCRIPTTYPE_STRING, /* disk */
+    VDSCRIPTTYPE_BOOL,   /* async */
+    VDSCRIPTTYPE_UINT32, /* max-reqs */
+    VDSCRIPTTYPE_STRING, /* mode */
+    VDSCRIPTTYPE_UINT64, /* blocksize */
+    VDSCRIPTTYPE_UINT64, /* offStart */
+    VDSCRIPTTYPE_UINT64, /* offEnd */
+    VDSCRIPTTYPE_UINT64, /* size */
+    VDSCRIPTTYPE_UINT32, /* writes */
+    VDSCRIPTTYPE_STRING, /* pattern */
+    VDSCRIPTTYPE_UINT32  /* flush interval */
+};
+
 /* flush action */
 const VDSCRIPTTYPE g_aArgFlush[] =
 {
@@ -345,7 +391,8 @@ const VDSCRIPTTYPE g_aArgCopy[] =
     VDSCRIPTTYPE_BOOL,   /* movebyrename */
     VDSCRIPTTYPE_UINT64, /* size */
     VDSCRIPTTYPE_UINT32, /* fromsame */
-    VDSCRIPTTYPE_UINT32  /* tosame */
+    VDSCRIPTTYPE_UINT32, /* tosame */
+    VDSCRIPTTYPE_UINT32  /* readahead */
 };
 
 /* close action */
@@ -481,6 +528,7 @@ const VDSCRIPTCALLBACK g_aScriptActions[] =
     {"create",                     VDSCRIPTTYPE_VOID, g_aArgCreate,                      RT_ELEMENTS(g_aArgCreate),                     vdScriptHandlerCreate},
     {"open",                       VDSCRIPTTYPE_VOID, g_aArgOpen,                        RT_ELEMENTS(g_aArgOpen),                       vdScriptHandlerOpen},
     {"io",                         VDSCRIPTTYPE_VOID, g_aArgIo,                          RT_ELEMENTS(g_aArgIo),                         vdScriptHandlerIo},
+    {"iobench",                    VDSCRIPTTYPE_VOID, g_aArgIoBench,                     RT_ELEMENTS(g_aArgIoBench),                    vdScriptHandlerIoBench},
     {"flush",                      VDSCRIPTTYPE_VOID, g_aArgFlush,                       RT_ELEMENTS(g_aArgFlush),                      vdScriptHandlerFlush},
     {"close",                      VDSCRIPTTYPE_VOID, g_aArgClose,                       RT_ELEMENTS(g_aArgClose),                      vdScriptHandlerClose},
     {"printfilesize",              VDSCRIPTTYPE_VOID, g_aArgPrintFileSize,               RT_ELEMENTS(g_aArgPrintFileSize),              vdScriptHandlerPrintFileSize},
@@ -537,12 +585,15 @@ static DECLCALLBACK(int) tstVDMessage(void *pvUser, const char *pszFormat, va_li
 
 static int tstVDIoTestInit(PVDIOTEST pIoTest, PVDTESTGLOB pGlob, bool fRandomAcc, uint32_t cSegsMax,
                            uint64_t cbIo, size_t cbBlkSize, uint64_t offStart, uint64_t offEnd,
-                           unsigned uWriteChance, PVDPATTERN pPattern);
+                           unsigned uWriteChance, uint32_t cFlushInterval, PVDPATTERN pPattern);
 static bool tstVDIoTestRunning(PVDIOTEST pIoTest);
 static void tstVDIoTestDestroy(PVDIOTEST pIoTest);
 static bool tstVDIoTestReqOutstanding(PTSTVDIOREQ pIoReq);
 static int  tstVDIoTestReqInit(PVDIOTEST pIoTest, PTSTVDIOREQ pIoReq, void *pvUser);
 static DECLCALLBACK(void) tstVDIoTestReqComplete(void *pvUser1, void *pvUser2, int rcReq);
+static void tstVDIoTestReqLatencyRecord(PTSTVDIOREQ pIoReq);
+static void tstVDIoLatencyRecord(PTSTVDIOLATENCY pLatency, uint64_t cNs);
+static void tstVDIoLatencyReport(RTTEST hTest, PTSTVDIOLATENCY paLatency);
 
 static PVDDISK tstVDIoGetDiskByName(PVDTESTGLOB pGlob, const char *pcszDisk);
 static PVDPATTERN tstVDIoGetPatternByName(PVDTESTGLOB pGlob, const char *pcszName);
@@ -693,10 +744,18 @@ static uint64_t tstVDIoGetSpeedKBs(uint64_t cbIo, uint64_t tsNano)
     return uSpeedKBs;
 }
 
-static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUser)
+/**
+ * Runs an I/O workload on a disk, common worker for the io and iobench actions.
+ *
+ * @returns VBox status code.
+ * @param   pGlob           Global test state.
+ * @param   paScriptArgs    The script arguments, see g_aArgIo.
+ * @param   cFlushInterval  Number of data requests between two flushes, 0 for no flushes.
+ * @param   pszTest         Name of the sub test.
+ */
+static int tstVDIoWorkloadRun(PVDTESTGLOB pGlob, PVDSCRIPTARG paScriptArgs, uint32_t cFlushInterval, const char *pszTest)
 {
     int rc = VINF_SUCCESS;
-    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
     bool fRandomAcc = false;
     PVDDISK pDisk = NULL;
     PVDPATTERN pPattern = NULL;
@@ -758,8 +817,9 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
     {
         VDIOTEST IoTest;
 
-        RTTestSub(pGlob->hTest, "Basic I/O");
-        rc = tstVDIoTestInit(&IoTest, pGlob, fRandomAcc, 5, cbIo, cbBlkSize, offStart, offEnd, uWriteChance, pPattern);
+        RTTestSub(pGlob->hTest, pszTest);
+        rc = tstVDIoTestInit(&IoTest, pGlob, fRandomAcc, 5, cbIo, cbBlkSize, offStart, offEnd, uWriteChance,
+                             cFlushInterval, pPattern);
         if (RT_SUCCESS(rc))
         {
             PTSTVDIOREQ paIoReq = NULL;
@@ -845,6 +905,8 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
                                             AssertMsgFailed(("Invalid\n"));
                                     }
 
+                                    if (RT_SUCCESS(rc))
+                                        tstVDIoTestReqLatencyRecord(&paIoReq[idx]);
                                     ASMAtomicXchgBool(&paIoReq[idx].fOutstanding, false);
                                     if (RT_SUCCESS(rc))
                                         idx++;
@@ -922,6 +984,7 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
                                                 AssertMsgFailed(("Invalid\n"));
                                         }
 
+                                        tstVDIoTestReqLatencyRecord(&paIoReq[idx]);
                                         ASMAtomicXchgBool(&paIoReq[idx].fOutstanding, false);
                                         if (rc != VERR_INVALID_STATE)
                                             rc = VINF_SUCCESS;
@@ -971,6 +1034,7 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
                 NanoTS = RTTimeNanoTS() - NanoTS;
                 uint64_t SpeedKBs = tstVDIoGetSpeedKBs(cbIo, NanoTS);
                 RTTestValue(pGlob->hTest, "Throughput", SpeedKBs, RTTESTUNIT_KILOBYTES_PER_SEC);
+                tstVDIoLatencyReport(pGlob->hTest, &IoTest.aLatency[0]);
 
                 for (unsigned i = 0; i < cMaxTasksOutstanding; i++)
                 {
@@ -998,6 +1062,21 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
     return rc;
 }
 
+static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+
+    return tstVDIoWorkloadRun(pGlob, paScriptArgs, 0 /* cFlushInterval */, "Basic I/O");
+}
+
+static DECLCALLBACK(int) vdScriptHandlerIoBench(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    uint32_t cFlushInterval = (uint32_t)paScriptArgs[10].u64;
+
+    return tstVDIoWorkloadRun(pGlob, paScriptArgs, cFlushInterval, "I/O benchmark");
+}
+
 static DECLCALLBACK(int) vdScriptHandlerFlush(PVDSCRIPTARG paScriptArgs, void *pvUser)
 {
     int rc = VINF_SUCCESS;
@@ -1315,6 +1394,7 @@ static DECLCALLBACK(int) vdScriptHandlerCopy(PVDSCRIPTARG paScriptArgs, void *pv
     uint64_t    cbSize         = paScriptArgs[6].u64;
     unsigned    nImageFromSame = paScriptArgs[7].u32;
     unsigned    nImageToSame   = paScriptArgs[8].u32;
+    unsigned    cReadAhead     = paScriptArgs[9].u32;
 
     pDiskFrom = tstVDIoGetDiskByName(pGlob, pcszDiskFrom);
     pDiskTo = tstVDIoGetDiskByName(pGlob, pcszDiskTo);
@@ -1322,13 +1402,24 @@ static DECLCALLBACK(int) vdScriptHandlerCopy(PVDSCRIPTARG paScriptArgs, void *pv
         rc = VERR_NOT_FOUND;
     else
     {
+        VDINTERFACECOPY VDIfCopy;
+        PVDINTERFACE    pVDIfsOperation = NULL;
+
+        if (cReadAhead)
+        {
+            VDIfCopy.cReadAhead = cReadAhead;
+            rc = VDInterfaceAdd(&VDIfCopy.Core, "tstVDIo_Copy", VDINTERFACETYPE_COPY,
+                                NULL, sizeof(VDINTERFACECOPY), &pVDIfsOperation);
+            AssertRC(rc);
+        }
+
         /** @todo Provide progress interface to test that cancelation
          * works as intended.
          */
         rc = VDCopyEx(pDiskFrom->pVD, nImageFrom, pDiskTo->pVD, pcszBackend, pcszFilename,
                       fMoveByRename, cbSize, nImageFromSame, nImageToSame,
                       VD_IMAGE_FLAGS_NONE, NULL, VD_OPEN_FLAGS_ASYNC_IO,
-                      NULL, pGlob->pInterfacesImages, NULL);
+                      pVDIfsOperation, pGlob->pInterfacesImages, NULL);
     }
 
     return rc;
@@ -1406,12 +1497,19 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
     const char *pcszIoLog = paScriptArgs[1].psz;
     size_t cbBuf = 0;
     void *pvBuf = NULL;
+    uint64_t cbTotal = 0;
+    uint64_t cNsTotal = 0;
+    PTSTVDIOLATENCY paLatency = NULL;
 
     pDisk = tstVDIoGetDiskByName(pGlob, pcszDisk);
     if (pDisk)
+        paLatency = (PTSTVDIOLATENCY)RTMemAllocZ((TSTVDIOREQTXDIR_FLUSH + 1) * sizeof(TSTVDIOLATENCY));
+    if (paLatency)
     {
         RTTRACELOGRDR hIoLogRdr = NIL_RTTRACELOGRDR;
 
+        RTTestSub(pGlob->hTest, "I/O log replay");
+
         rc = RTTraceLogRdrCreateFromFile(&hIoLogRdr, pcszIoLog);
         if (RT_SUCCESS(rc))
         {
@@ -1447,7 +1545,6 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
                                 && aVals[1].pItemDesc->enmType == RTTRACELOGTYPE_UINT64
                                 && aVals[2].pItemDesc->enmType == RTTRACELOGTYPE_SIZE)
                             {
-                                bool     fAsync = aVals[0].u.f;
                                 uint64_t off    = aVals[1].u.u64;
                                 size_t   cbIo   = (size_t)aVals[2].u.sz;
 
@@ -1460,11 +1557,17 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
                                         rc = VERR_NO_MEMORY;
                                 }
 
-                                if (   RT_SUCCESS(rc)
-                                    && !fAsync)
+                                /* Asynchronous requests are replayed synchronously as well. */
+                                if (RT_SUCCESS(rc))
+                                {
+                                    uint64_t tsStart = RTTimeNanoTS();
                                     rc = VDRead(pDisk->pVD, off, pvBuf, cbIo);
-                                else if (RT_SUCCESS(rc))
-                                    rc = VERR_NOT_SUPPORTED;
+                                    uint64_t cNs = RTTimeNanoTS() - tsStart;
+
+                                    tstVDIoLatencyRecord(&paLatency[TSTVDIOREQTXDIR_READ], cNs);
+                                    cNsTotal += cNs;
+                                    cbTotal  += cbIo;
+                                }
                             }
                         }
                         else if (!RTStrCmp(pEvtDesc->pszId, "Write"))
@@ -1478,7 +1581,6 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
                                 && aVals[1].pItemDesc->enmType == RTTRACELOGTYPE_UINT64
                                 && aVals[2].pItemDesc->enmType == RTTRACELOGTYPE_SIZE)
                             {
-                                bool     fAsync = aVals[0].u.f;
                                 uint64_t off    = aVals[1].u.u64;
                                 size_t   cbIo   = (size_t)aVals[2].u.sz;
 
@@ -1491,11 +1593,16 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
                                         rc = VERR_NO_MEMORY;
                                 }
 
-                                if (   RT_SUCCESS(rc)
-                                    && !fAsync)
+                                if (RT_SUCCESS(rc))
+                                {
+                                    uint64_t tsStart = RTTimeNanoTS();
                                     rc = VDWrite(pDisk->pVD, off, pvBuf, cbIo);
-                                else if (RT_SUCCESS(rc))
-                                    rc = VERR_NOT_SUPPORTED;
+                                    uint64_t cNs = RTTimeNanoTS() - tsStart;
+
+                                    tstVDIoLatencyRecord(&paLatency[TSTVDIOREQTXDIR_WRITE], cNs);
+                                    cNsTotal += cNs;
+                                    cbTotal  += cbIo;
+                                }
                             }
                         }
                         else if (!RTStrCmp(pEvtDesc->pszId, "Flush"))
@@ -1507,38 +1614,24 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
                                 && cVals == 1
                                 && Val.pItemDesc->enmType == RTTRACELOGTYPE_BOOL)
                             {
-                                bool fAsync = Val.u.f;
+                                uint64_t tsStart = RTTimeNanoTS();
+                                rc = VDFlush(pDisk->pVD);
+                                uint64_t cNs = RTTimeNanoTS() - tsStart;
 
-                                if (   RT_SUCCESS(rc)
-                                    && !fAsync)
-                                    rc = VDFlush(pDisk->pVD);
-                                else if (RT_SUCCESS(rc))
-                                    rc = VERR_NOT_SUPPORTED;
+                                tstVDIoLatencyRecord(&paLatency[TSTVDIOREQTXDIR_FLUSH], cNs);
+                                cNsTotal += cNs;
                             }
                         }
-                        else if (!RTStrCmp(pEvtDesc->pszId, "Discard"))
-                        {}
-                        else
-                            AssertMsgFailed(("Invalid event ID: %s\n", pEvtDesc->pszId));
-
-                        if (RT_SUCCESS(rc))
+                        else if (   !RTStrCmp(pEvtDesc->pszId, "Discard")
+                                 || !RTStrCmp(pEvtDesc->pszId, "Complete"))
                         {
-                            rc = RTTraceLogRdrEvtPoll(hIoLogRdr, &enmEvt, RT_INDEFINITE_WAIT);
-                            if (RT_SUCCESS(rc))
-                            {
-                                AssertMsg(enmEvt == RTTRACELOGRDRPOLLEVT_TRACE_EVENT_RECVD,
-                                          ("Expected a trace event received event but got: %#x\n", enmEvt));
-
-                                hEvt = NIL_RTTRACELOGRDREVT;
-                                rc = RTTraceLogRdrQueryLastEvt(hIoLogRdr, &hEvt);
-                                if (RT_SUCCESS(rc))
-                                {
-                                    pEvtDesc = RTTraceLogRdrEvtGetDesc(hEvt);
-                                    AssertMsg(!RTStrCmp(pEvtDesc->pszId, "Complete"),
-                                              ("Expected a completion event but got: %s\n", pEvtDesc->pszId));
-                                }
-                            }
+                            /*
+                             * Completions of asynchronous requests can be interleaved with other
+                             * requests in the log. Everything is replayed synchronously, so skip them.
+                             */
                         }
+                        else
+                            AssertMsgFailed(("Invalid event ID: %s\n", pEvtDesc->pszId));
                     }
 
                     if (RT_FAILURE(rc))
@@ -1550,9 +1643,22 @@ static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, v
 
             RTTraceLogRdrDestroy(hIoLogRdr);
         }
+
+        /* Reaching the end of the log is the expected way out of the loop above. */
+        if (rc == VERR_EOF)
+            rc = VINF_SUCCESS;
+        if (RT_SUCCESS(rc))
+        {
+            RTTestValue(pGlob->hTest, "Throughput", tstVDIoGetSpeedKBs(cbTotal, cNsTotal), RTTESTUNIT_KILOBYTES_PER_SEC);
+            tstVDIoLatencyReport(pGlob->hTest, paLatency);
+        }
+        RTTestSubDone(pGlob->hTest);
+        RTMemFree(paLatency);
     }
-    else
+    else if (!pDisk)
         rc = VERR_NOT_FOUND;
+    else
+        rc = VERR_NO_MEMORY;
 
     if (pvBuf)
         RTMemFree(pvBuf);
@@ -2398,7 +2504,7 @@ static DECLCALLBACK(int) tstVDIoFileFlushAsync(void *pvUser, void *pStorage, voi
 
 static int tstVDIoTestInit(PVDIOTEST pIoTest, PVDTESTGLOB pGlob, bool fRandomAcc, uint32_t cSegsMax,
                            uint64_t cbIo, size_t cbBlkSize, uint64_t offStart, uint64_t offEnd,
-                           unsigned uWriteChance, PVDPATTERN pPattern)
+                           unsigned uWriteChance, uint32_t cFlushInterval, PVDPATTERN pPattern)
 {
     int rc = VINF_SUCCESS;
 
@@ -2409,6 +2515,7 @@ static int tstVDIoTestInit(PVDIOTEST pIoTest, PVDTESTGLOB pGlob, bool fRandomAcc
     pIoTest->offStart      = offStart;
     pIoTest->offEnd        = offEnd;
     pIoTest->uWriteChance  = uWriteChance;
+    pIoTest->cFlushInterval = cFlushInterval;
     pIoTest->cSegsMax      = cSegsMax;
     pIoTest->pIoRnd        = pGlob->pIoRnd;
     pIoTest->pPattern      = pPattern;
@@ -2497,8 +2604,26 @@ static int tstVDIoTestReqInit(PVDIOTEST pIoTest, PTSTVDIOREQ pIoReq, void *pvUse
 {
     int rc = VINF_SUCCESS;
 
-    if (pIoTest->cbIo)
+    if (   pIoTest->cbIo
+        && pIoTest->cFlushInterval
+        && pIoTest->cReqsSinceFlush == pIoTest->cFlushInterval)
     {
+        /* Time for a flush, doesn't count towards the amount of data to transfer. */
+        pIoTest->cReqsSinceFlush = 0;
+        pIoReq->enmTxDir  = TSTVDIOREQTXDIR_FLUSH;
+        pIoReq->off       = 0;
+        pIoReq->cbReq     = 0;
+        pIoReq->pvBuf     = NULL;
+        pIoReq->cSegs     = 0;
+        pIoReq->pvUser    = pvUser;
+        pIoReq->paLatency = &pIoTest->aLatency[0];
+        pIoReq->tsStart   = RTTimeNanoTS();
+        pIoReq->fOutstanding = true;
+    }
+    else if (pIoTest->cbIo)
+    {
+        pIoTest->cReqsSinceFlush++;
+
         /* Read or Write? */
         pIoReq->enmTxDir = tstVDIoTestIsTrue(pIoTest, pIoTest->uWriteChance) ? TSTVDIOREQTXDIR_WRITE : TSTVDIOREQTXDIR_READ;
         pIoReq->cbReq = RT_MIN(pIoTest->cbBlkIo, pIoTest->cbIo);
@@ -2582,6 +2707,8 @@ static int tstVDIoTestReqInit(PVDIOTEST pIoTest, PTSTVDIOREQ pIoReq, void *pvUse
                 }
             }
             pIoReq->pvUser = pvUser;
+            pIoReq->paLatency = &pIoTest->aLatency[0];
+            pIoReq->tsStart = RTTimeNanoTS();
             pIoReq->fOutstanding = true;
         }
     }
@@ -2642,11 +2769,118 @@ static DECLCALLBACK(void) tstVDIoTestReqComplete(void *pvUser1, void *pvUser2, i
         }
     }
 
+    tstVDIoTestReqLatencyRecord(pIoReq);
     ASMAtomicXchgBool(&pIoReq->fOutstanding, false);
     RTSemEventSignal(hEventSem);
     return;
 }
 
+/**
+ * Records the latency of a completed request.
+ *
+ * @returns nothing.
+ * @param   pIoReq      The completed request.
+ */
+static void tstVDIoTestReqLatencyRecord(PTSTVDIOREQ pIoReq)
+{
+    if (   pIoReq->paLatency
+        && pIoReq->enmTxDir <= TSTVDIOREQTXDIR_FLUSH)
+        tstVDIoLatencyRecord(&pIoReq->paLatency[pIoReq->enmTxDir], RTTimeNanoTS() - pIoReq->tsStart);
+}
+
+/**
+ * Returns the histogram bucket for the given latency.
+ *
+ * @returns Bucket index.
+ * @param   cNs         The latency in nanoseconds.
+ */
+static unsigned tstVDIoLatencyBucketFromNs(uint64_t cNs)
+{
+    if (cNs < TSTVDIO_LATENCY_BUCKETS_LINEAR)
+        return (unsigned)cNs;
+
+    unsigned iExp = ASMBitLastSetU64(cNs) - 1; /* >= 3 */
+    unsigned iSub = (unsigned)(cNs >> (iExp - 3)) & 7;
+    return TSTVDIO_LATENCY_BUCKETS_LINEAR + (iExp - 3) * 8 + iSub;
+}
+
+/**
+ * Returns the highest latency falling into the given histogram bucket.
+ *
+ * @returns Latency in nanoseconds.
+ * @param   idxBucket   The bucket index.
+ */
+static uint64_t tstVDIoLatencyBucketToNs(unsigned idxBucket)
+{
+    if (idxBucket < TSTVDIO_LATENCY_BUCKETS_LINEAR)
+        return idxBucket;
+
+    unsigned iExp = (idxBucket - TSTVDIO_LATENCY_BUCKETS_LINEAR) / 8 + 3;
+    unsigned iSub = (idxBucket - TSTVDIO_LATENCY_BUCKETS_LINEAR) % 8;
+    return ((uint64_t)(8 + iSub) << (iExp - 3)) + (RT_BIT_64(iExp - 3) - 1);
+}
+
+/**
+ * Records a latency sample, can be called from any thread.
+ *
+ * @returns nothing.
+ * @param   pLatency    The latency histogram.
+ * @param   cNs         The latency in nanoseconds.
+ */
+static void tstVDIoLatencyRecord(PTSTVDIOLATENCY pLatency, uint64_t cNs)
+{
+    ASMAtomicIncU64(&pLatency->acReqs[tstVDIoLatencyBucketFromNs(cNs)]);
+    ASMAtomicAddU64(&pLatency->cNsTotal, cNs);
+    ASMAtomicIncU64(&pLatency->cReqs);
+}
+
+/**
+ * Returns the latency below which the given fraction of requests completed.
+ *
+ * @returns Latency in nanoseconds.
+ * @param   pLatency    The latency histogram.
+ * @param   uPerMille   The percentile in per mille.
+ */
+static uint64_t tstVDIoLatencyPercentile(PTSTVDIOLATENCY pLatency, unsigned uPerMille)
+{
+    uint64_t cReqsTarget = (pLatency->cReqs * uPerMille + 999) / 1000;
+    uint64_t cReqs = 0;
+
+    for (unsigned i = 0; i < RT_ELEMENTS(pLatency->acReqs); i++)
+    {
+        cReqs += pLatency->acReqs[i];
+        if (cReqs >= cReqsTarget)
+            return tstVDIoLatencyBucketToNs(i);
+    }
+
+    return 0;
+}
+
+/**
+ * Reports the latency percentiles for reads, writes and flushes.
+ *
+ * @returns nothing.
+ * @param   hTest       The test handle.
+ * @param   paLatency   The latency histograms indexed by transfer type.
+ */
+static void tstVDIoLatencyReport(RTTEST hTest, PTSTVDIOLATENCY paLatency)
+{
+    static const char * const s_apszTxDir[] = { "Read", "Write", "Flush" };
+
+    for (unsigned i = 0; i < RT_ELEMENTS(s_apszTxDir); i++)
+    {
+        PTSTVDIOLATENCY pLatency = &paLatency[i];
+        if (!pLatency->cReqs)
+            continue;
+
+        RTTestValueF(hTest, pLatency->cReqs, RTTESTUNIT_OCCURRENCES, "%s requests", s_apszTxDir[i]);
+        RTTestValueF(hTest, pLatency->cNsTotal / pLatency->cReqs, RTTESTUNIT_NS, "%s latency avg", s_apszTxDir[i]);
+        RTTestValueF(hTest, tstVDIoLatencyPercentile(pLatency, 500), RTTESTUNIT_NS, "%s latency p50", s_apszTxDir[i]);
+        RTTestValueF(hTest, tstVDIoLatencyPercentile(pLatency, 990), RTTESTUNIT_NS, "%s latency p99", s_apszTxDir[i]);
+        RTTestValueF(hTest, tstVDIoLatencyPercentile(pLatency, 999), RTTESTUNIT_NS, "%s latency p999", s_apszTxDir[i]);
+    }
+}
+
 /**
  * Returns the disk handle by name or NULL if not found
  *
@@ -68,6 +68,7 @@ static void printUsage(PRTSTREAM pStrm)
                  "                [--srcformat VDI|VMDK|VHD|RAW|..]\n"
                  "                [--dstformat VDI|VMDK|VHD|RAW|..]\n"
                  "                [--variant Standard,Fixed,Split2G,Stream,ESX]\n"
+                 "                [--read-ahead <number of buffers>]\n"
                  "\n"
                  "   info         --filename <filename>\n"
                  "\n"
@@ -1037,13 +1038,16 @@ static int handleConvert(HandlerArg *a)
     VDTYPE enmSrcType = VDTYPE_HDD;
     const char *pszDstFormat = NULL;
     const char *pszVariant = NULL;
+    unsigned cReadAhead = 0;
     PVDISK pSrcDisk = NULL;
     PVDISK pDstDisk = NULL;
     unsigned uImageFlags = VD_IMAGE_FLAGS_NONE;
     PVDINTERFACE pIfsImageInput = NULL;
     PVDINTERFACE pIfsImageOutput = NULL;
+    PVDINTERFACE pIfsCopy = NULL;
     VDINTERFACEIO IfsInputIO;
     VDINTERFACEIO IfsOutputIO;
+    VDINTERFACECOPY IfCopy;
     int rc = VINF_SUCCESS;
 
     /* Parse the command line. */
@@ -1056,7 +1060,8 @@ static int handleConvert(HandlerArg *a)
         { "--srcformat", 's', RTGETOPT_REQ_STRING },
         { "--dstformat", 'd', RTGETOPT_REQ_STRING },
         { "--variant", 'v', RTGETOPT_REQ_STRING },
-        { "--create-sparse", 'c', RTGETOPT_REQ_NOTHING }
+        { "--create-sparse", 'c', RTGETOPT_REQ_NOTHING },
+        { "--read-ahead", 'r', RTGETOPT_REQ_UINT32 }
     };
     int ch;
     RTGETOPTUNION ValueUnion;
@@ -1090,6 +1095,9 @@ static int handleConvert(HandlerArg *a)
             case 'c':   // --create-sparse
                 fCreateSparse = true;
                 break;
+            case 'r':   // --read-ahead
+                cReadAhead = ValueUnion.u32;
+                break;
 
             default:
                 ch = RTGetOptPrintError(ch, &ValueUnion);
@@ -1172,6 +1180,12 @@ static int handleConvert(HandlerArg *a)
         VDInterfaceAdd(&IfsOutputIO.Core, "fileout", VDINTERFACETYPE_IO,
                        NULL, sizeof(VDINTERFACEIO), &pIfsImageOutput);
     }
+    if (cReadAhead)
+    {
+        IfCopy.cReadAhead = cReadAhead;
+        VDInterfaceAdd(&IfCopy.Core, "readahead", VDINTERFACETYPE_COPY,
+                       NULL, sizeof(VDINTERFACECOPY), &pIfsCopy);
+    }
 
     /* check the variant parameter */
     if (pszVariant)
@@ -1253,7 +1267,7 @@ static int handleConvert(HandlerArg *a)
         /* Create the output image */
         rc = VDCopy(pSrcDisk, VD_LAST_IMAGE, pDstDisk, pszDstFormat,
                     pszDstFilename, false, 0, uImageFlags, NULL,
-                    VD_OPEN_FLAGS_NORMAL | VD_OPEN_FLAGS_SEQUENTIAL, NULL,
+                    VD_OPEN_FLAGS_NORMAL | VD_OPEN_FLAGS_SEQUENTIAL, pIfsCopy,
                     pIfsImageOutput, NULL);
         if (RT_FAILURE(rc))
         {
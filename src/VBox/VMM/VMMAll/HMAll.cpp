@@ -356,6 +356,25 @@ VMM_INT_DECL(bool) HMAreNestedPagingAndFullGuestExecEnabled(PVM pVM)
 }
 
 
+/**
+ * Checks if the hardware maintains dirty flags in the nested page tables.
+ *
+ * AMD-V always updates the accessed and dirty bits of the nested page table
+ * entries, VT-x only does it when the EPT accessed and dirty flags are
+ * enabled.
+ *
+ * @returns true if the dirty flags are maintained, otherwise false.
+ * @param   pVM         The cross context VM structure.
+ */
+VMM_INT_DECL(bool) HMAreNestedPagingDirtyBitsEnabled(PVM pVM)
+{
+    return HMIsEnabled(pVM)
+        && pVM->hm.s.fNestedPaging
+        && (   pVM->hm.s.vmx.fEptAccessDirty
+            || pVM->hm.s.svm.fSupported);
+}
+
+
 /**
  * Checks if this VM is using HM and is long-mode capable.
  *
@@ -1691,6 +1691,34 @@ DECLINLINE(void) PGM_BTH_NAME(SyncHandlerPte)(PVM pVM, PCPGMPAGE pPage, uint64_t
 }
 
 
+#if !PGM_WITH_PAGING(PGM_GST_TYPE, PGM_SHW_TYPE)
+/**
+ * Preserves the dirty flag of a nested page table entry SyncPageWorker is
+ * about to replace while a live save is harvesting them.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pPteDst     The shadow page table entry.
+ * @param   GCPhysPage  The guest physical address of the page.
+ */
+DECLINLINE(void) PGM_BTH_NAME(SyncPageWorkerDirtyLog)(PVM pVM, PSHWPTE pPteDst, RTGCPHYS GCPhysPage)
+{
+# if PGM_SHW_TYPE == PGM_TYPE_NESTED || PGM_SHW_TYPE == PGM_TYPE_EPT
+#  if PGM_SHW_TYPE == PGM_TYPE_EPT
+    uint64_t const fDirty = EPT_E_DIRTY;
+#  else
+    uint64_t const fDirty = X86_PTE_D;
+#  endif
+    if (   pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS
+        && SHW_PTE_IS_P(*pPteDst)
+        && (SHW_PTE_GET_U(*pPteDst) & fDirty))
+        pgmPoolTrackDirtyLogDiscard(pVM->pgm.s.CTX_SUFF(pPool), GCPhysPage);
+# else
+    RT_NOREF(pVM, pPteDst, GCPhysPage);
+# endif
+}
+#endif
+
+
 /**
  * Creates a 4K shadow page for a guest page.
  *
@@ -1796,6 +1824,11 @@ static void PGM_BTH_NAME(SyncPageWorker)(PVMCPU pVCpu, PSHWPTE pPteDst, RTGCPHYS
             uint64_t fGstShwPteFlags = GST_GET_PTE_SHW_FLAGS(pVCpu, PteSrc);
 # else
             uint64_t fGstShwPteFlags = X86_PTE_P | X86_PTE_RW | X86_PTE_US | X86_PTE_A | X86_PTE_D;
+#  if PGM_SHW_TYPE == PGM_TYPE_NESTED
+            /* A live save harvesting the dirty flags needs the CPU to set them. */
+            if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                fGstShwPteFlags &= ~(uint64_t)X86_PTE_D;
+#  endif
 # endif
             if (PGM_PAGE_HAS_ACTIVE_HANDLERS(pPage))
                 PGM_BTH_NAME(SyncHandlerPte)(pVM, pPage, fGstShwPteFlags, &PteDst);
@@ -1881,6 +1914,8 @@ static void PGM_BTH_NAME(SyncPageWorker)(PVMCPU pVCpu, PSHWPTE pPteDst, RTGCPHYS
 #if PGM_WITH_PAGING(PGM_GST_TYPE, PGM_SHW_TYPE)
             if (!PteSrc.n.u1Global)
                 pShwPage->fSeenNonGlobal = true;
+#else
+            PGM_BTH_NAME(SyncPageWorkerDirtyLog)(pVM, pPteDst, GCPhysPage);
 #endif
             SHW_PTE_ATOMIC_SET2(*pPteDst, PteDst);
             return;
@@ -1905,6 +1940,9 @@ static void PGM_BTH_NAME(SyncPageWorker)(PVMCPU pVCpu, PSHWPTE pPteDst, RTGCPHYS
         Log2(("SyncPageWorker: deref! *pPteDst=%RX64\n", SHW_PTE_LOG64(*pPteDst)));
         PGM_BTH_NAME(SyncPageWorkerTrackDeref)(pVCpu, pShwPage, SHW_PTE_GET_HCPHYS(*pPteDst), iPTDst, GCPhysOldPage);
     }
+#if !PGM_WITH_PAGING(PGM_GST_TYPE, PGM_SHW_TYPE)
+    PGM_BTH_NAME(SyncPageWorkerDirtyLog)(pVM, pPteDst, GCPhysPage);
+#endif
     SHW_PTE_ATOMIC_SET(*pPteDst, 0);
 }
 
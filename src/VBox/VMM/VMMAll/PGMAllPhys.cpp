@@ -1808,6 +1808,8 @@ int pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys
  * @retval  VINF_SUCCESS on success.
  * @retval  VERR_PGM_PHYS_PAGE_RESERVED it it's a valid page but has no physical backing.
  * @retval  VERR_PGM_INVALID_GC_PHYSICAL_ADDRESS if it's not a valid physical address.
+ * @retval  VERR_PGM_POST_COPY_ABORTED or VERR_PGM_POST_COPY_PAGE_MISSING if the
+ *          page hasn't arrived from the post-copy source and can't be fetched.
  *
  * @param   pVM         The cross context VM structure.
  * @param   GCPhys      The guest physical address of the page that should be
@@ -1828,6 +1830,17 @@ int pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys
  */
 VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEMAPLOCK pLock)
 {
+#ifdef IN_RING3
+    /* The caller bypasses the access handlers, so a page which is yet to
+       arrive from the post-copy source must be fetched first. */
+    if (RT_UNLIKELY(pVM->pgm.s.LiveSave.pPostCopyR3))
+    {
+        int rc2 = pgmR3PostCopyTrgEnsurePage(pVM, GCPhys);
+        if (RT_FAILURE(rc2))
+            return rc2;
+    }
+#endif
+
     int rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
@@ -1876,6 +1889,21 @@ VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGM
          * it must be converted to a page that's writable if possible.
          */
         PPGMPAGE pPage = pTlbe->pPage;
+#ifdef IN_RING3
+        /* The caller bypasses the access handlers, so a copy-on-write save
+           must get hold of the content before it's modified. */
+        if (   RT_UNLIKELY(pVM->pgm.s.LiveSave.pSaveCowR3)
+            && PGM_PAGE_HAS_ACTIVE_HANDLERS(pPage))
+            pgmR3SaveCowPreservePage(pVM, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+#else
+        /* The content can only be preserved in ring-3, so fail the
+           copy-on-write save rather than saving the modified page.  RAM
+           pages with other handlers aren't saved copy-on-write, they merely
+           cause a false alarm here. */
+        if (   RT_UNLIKELY(pVM->pgm.s.LiveSave.pSaveCowR3)
+            && PGM_PAGE_HAS_ACTIVE_HANDLERS(pPage))
+            ASMAtomicWriteBool(&pVM->pgm.s.LiveSave.fSaveCowBypassed, true);
+#endif
         if (RT_UNLIKELY(PGM_PAGE_GET_STATE(pPage) != PGM_PAGE_STATE_ALLOCATED))
         {
             rc = pgmPhysPageMakeWritable(pVM, pPage, GCPhys);
@@ -1912,6 +1940,8 @@ VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGM
  * @retval  VINF_SUCCESS on success.
  * @retval  VERR_PGM_PHYS_PAGE_RESERVED it it's a valid page but has no physical backing.
  * @retval  VERR_PGM_INVALID_GC_PHYSICAL_ADDRESS if it's not a valid physical address.
+ * @retval  VERR_PGM_POST_COPY_ABORTED or VERR_PGM_POST_COPY_PAGE_MISSING if the
+ *          page hasn't arrived from the post-copy source and can't be fetched.
  *
  * @param   pVM         The cross context VM structure.
  * @param   GCPhys      The guest physical address of the page that should be
@@ -1931,6 +1961,16 @@ VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGM
  */
 VMM_INT_DECL(int) PGMPhysGCPhys2CCPtrReadOnly(PVM pVM, RTGCPHYS GCPhys, void const **ppv, PPGMPAGEMAPLOCK pLock)
 {
+#ifdef IN_RING3
+    /* Same as in PGMPhysGCPhys2CCPtr, the content must be there before it's read. */
+    if (RT_UNLIKELY(pVM->pgm.s.LiveSave.pPostCopyR3))
+    {
+        int rc2 = pgmR3PostCopyTrgEnsurePage(pVM, GCPhys);
+        if (RT_FAILURE(rc2))
+            return rc2;
+    }
+#endif
+
     int rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
@@ -3272,6 +3272,55 @@ DECLINLINE(unsigned) pgmPoolTrackGetGuestEntrySize(PGMPOOLKIND enmKind)
 #endif /* unused */
 
 
+/**
+ * Preserves the dirty flag of a nested page table entry that is being
+ * discarded while a live save is harvesting them.
+ *
+ * The page is made writable again, which the live save RAM scan picks up as
+ * a modification the same way as a write monitoring fault.
+ *
+ * @param   pPool       The pool.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+void pgmPoolTrackDirtyLogDiscard(PPGMPOOL pPool, RTGCPHYS GCPhys)
+{
+    PVM      pVM       = pPool->CTX_SUFF(pVM);
+    PPGMPAGE pPhysPage = pgmPhysGetPage(pVM, GCPhys);
+    if (   pPhysPage
+        && PGM_PAGE_GET_STATE(pPhysPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+        pgmPhysPageMakeWriteMonitoredWritable(pVM, pPhysPage, GCPhys);
+}
+
+
+/**
+ * Preserves the dirty flag of a nested page table entry that is being cleared
+ * while a live save is harvesting them.
+ *
+ * Only the page tables of the PHYS kinds are looked at, as only these are
+ * nested page tables with the dirty flags maintained by the CPU.
+ *
+ * @param   pPool       The pool.
+ * @param   pPage       The shadow page table.
+ * @param   uPte        The entry before it is cleared.
+ * @param   iPte        The index of the entry.
+ */
+static void pgmPoolTrackDirtyLogDiscardPte(PPGMPOOL pPool, PPGMPOOLPAGE pPage, uint64_t uPte, unsigned iPte)
+{
+    uint64_t fDirty;
+    if (pPage->enmKind == PGMPOOLKIND_EPT_PT_FOR_PHYS)
+        fDirty = EPT_E_DIRTY;
+    else if (pPage->enmKind == PGMPOOLKIND_PAE_PT_FOR_PHYS)
+        fDirty = X86_PTE_D;
+    else
+        return;
+    if (uPte & fDirty)
+    {
+        RTGCPHYS const GCPhysA20Mask = pPage->fA20Enabled ? UINT64_MAX : ~RT_BIT_64(20);
+        pgmPoolTrackDirtyLogDiscard(pPool, (pPage->GCPhys + ((RTGCPHYS)iPte << PAGE_SHIFT)) & GCPhysA20Mask);
+    }
+}
+
+
 /**
  * Checks one shadow page table entry for a mapping of a physical page.
  *
@@ -3426,8 +3475,12 @@ static bool pgmPoolTrackFlushGCPhysPTInt(PVM pVM, PCPGMPAGE pPhysPage, bool fFlu
                 X86PTEPAE Pte;
 
                 Log4(("pgmPoolTrackFlushGCPhysPTs: i=%d pte=%RX64\n", iPte, PGMSHWPTEPAE_GET_LOG(pPT->a[iPte])));
+                if (   !u64AndMask
+                    && pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                    pgmPoolTrackDirtyLogDiscardPte(pPool, pPage, PGMSHWPTEPAE_GET_U(pPT->a[iPte]), iPte);
                 Pte.u = (PGMSHWPTEPAE_GET_U(pPT->a[iPte]) & u64AndMask) | u64OrMask;
-                if (Pte.u & PGM_PTFLAGS_TRACK_DIRTY)
+                if (   (Pte.u & PGM_PTFLAGS_TRACK_DIRTY)
+                    && pPage->enmKind != PGMPOOLKIND_EPT_PT_FOR_PHYS) /* same bit as EPT_E_DIRTY */
                     Pte.n.u1Write = 0;    /* need to disallow writes when dirty bit tracking is still active. */
 
                 PGMSHWPTEPAE_ATOMIC_SET(pPT->a[iPte], Pte.u);
@@ -3810,6 +3863,8 @@ int pgmPoolTrackFlushGCPhysPTsSlow(PVM pVM, PPGMPAGE pPhysPage)
                             if ((PGMSHWPTEPAE_GET_U(pPT->a[i]) & (X86_PTE_PAE_PG_MASK | X86_PTE_P)) == u64)
                             {
                                 //Log4(("pgmPoolTrackFlushGCPhysPTsSlow: idx=%d i=%d pte=%RX64\n", iPage, i, pPT->a[i]));
+                                if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                                    pgmPoolTrackDirtyLogDiscardPte(pPool, pPage, PGMSHWPTEPAE_GET_U(pPT->a[i]), i);
                                 PGMSHWPTEPAE_SET(pPT->a[i], 0); /// @todo why not atomic?
 
                                 /* Update the counter as we're removing references. */
@@ -3835,6 +3890,8 @@ int pgmPoolTrackFlushGCPhysPTsSlow(PVM pVM, PPGMPAGE pPhysPage)
                             if ((pPT->a[i].u & (EPT_PTE_PG_MASK | X86_PTE_P)) == u64)
                             {
                                 //Log4(("pgmPoolTrackFlushGCPhysPTsSlow: idx=%d i=%d pte=%RX64\n", iPage, i, pPT->a[i]));
+                                if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                                    pgmPoolTrackDirtyLogDiscardPte(pPool, pPage, pPT->a[i].u, i);
                                 pPT->a[i].u = 0;
 
                                 /* Update the counter as we're removing references. */
@@ -4574,6 +4631,10 @@ DECLINLINE(void) pgmPoolTrackDerefPTPaeBig(PPGMPOOL pPool, PPGMPOOLPAGE pPage, P
         {
             Log4(("pgmPoolTrackDerefPTPaeBig: i=%d pte=%RX64 hint=%RGp\n",
                   i, PGMSHWPTEPAE_GET_HCPHYS(pShwPT->a[i]), GCPhys));
+            if (   PGMSHWPTEPAE_IS_D(pShwPT->a[i])
+                && pPage->enmKind == PGMPOOLKIND_PAE_PT_FOR_PHYS
+                && pPool->CTX_SUFF(pVM)->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                pgmPoolTrackDirtyLogDiscard(pPool, GCPhys & GCPhysA20Mask);
             pgmPoolTracDerefGCPhys(pPool, pPage, PGMSHWPTEPAE_GET_HCPHYS(pShwPT->a[i]), GCPhys & GCPhysA20Mask, i);
             if (!pPage->cPresent)
                 break;
@@ -4596,11 +4657,14 @@ DECLINLINE(void) pgmPoolTrackDerefPTEPT(PPGMPOOL pPool, PPGMPOOLPAGE pPage, PEPT
     RTGCPHYS        GCPhys        = pPage->GCPhys + PAGE_SIZE * pPage->iFirstPresent;
     for (unsigned i = pPage->iFirstPresent; i < RT_ELEMENTS(pShwPT->a); i++, GCPhys += PAGE_SIZE)
     {
-        Assert((pShwPT->a[i].u & UINT64_C(0xfff0000000000f80)) == 0);
+        Assert((pShwPT->a[i].u & UINT64_C(0xfff0000000000c80)) == 0); /* bits 8 & 9 are the EPT A/D flags */
         if (pShwPT->a[i].n.u1Present)
         {
             Log4(("pgmPoolTrackDerefPTEPT: i=%d pte=%RX64 GCPhys=%RX64\n",
                   i, pShwPT->a[i].u & EPT_PTE_PG_MASK, pPage->GCPhys));
+            if (   (pShwPT->a[i].u & EPT_E_DIRTY)
+                && pPool->CTX_SUFF(pVM)->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                pgmPoolTrackDirtyLogDiscard(pPool, GCPhys & GCPhysA20Mask);
             pgmPoolTracDerefGCPhys(pPool, pPage, pShwPT->a[i].u & EPT_PTE_PG_MASK, GCPhys & GCPhysA20Mask, i);
             if (!pPage->cPresent)
                 break;
@@ -4760,7 +4824,7 @@ DECLINLINE(void) pgmPoolTrackDerefPDEPT(PPGMPOOL pPool, PPGMPOOLPAGE pPage, PEPT
 {
     for (unsigned i = 0; i < RT_ELEMENTS(pShwPD->a); i++)
     {
-        Assert((pShwPD->a[i].u & UINT64_C(0xfff0000000000f80)) == 0);
+        Assert((pShwPD->a[i].u & UINT64_C(0xfff0000000000c80)) == 0); /* bits 8 & 9 are the EPT A/D flags */
         if (pShwPD->a[i].n.u1Present)
         {
 #ifdef PGM_WITH_LARGE_PAGES
@@ -4798,7 +4862,7 @@ DECLINLINE(void) pgmPoolTrackDerefPDPTEPT(PPGMPOOL pPool, PPGMPOOLPAGE pPage, PE
 {
     for (unsigned i = 0; i < RT_ELEMENTS(pShwPDPT->a); i++)
     {
-        Assert((pShwPDPT->a[i].u & UINT64_C(0xfff0000000000f80)) == 0);
+        Assert((pShwPDPT->a[i].u & UINT64_C(0xfff0000000000c80)) == 0); /* bits 8 & 9 are the EPT A/D flags */
         if (pShwPDPT->a[i].n.u1Present)
         {
             PPGMPOOLPAGE pSubPage = (PPGMPOOLPAGE)RTAvloHCPhysGet(&pPool->HCPhysTree, pShwPDPT->a[i].u & EPT_PDPTE_PG_MASK);
@@ -5469,6 +5533,12 @@ void pgmR3PoolReset(PVM pVM)
         return;
     }
 
+    /*
+     * Harvest the nested page table dirty flags for a live save in progress.
+     */
+    if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+        pgmR3PoolHarvestDirtyBits(pVM);
+
     /*
      * Exit the shadow mode since we're going to clear everything,
      * including the root page.
@@ -464,6 +464,7 @@ VMMR3_INT_DECL(int) HMR3Init(PVM pVM)
                               "|FallbackToNEM"
                               "|EnableNestedPaging"
                               "|EnableUX"
+                              "|EnableEptAccessDirty"
                               "|EnableLargePages"
                               "|EnableVPID"
                               "|IBPBOnVMExit"
@@ -533,6 +534,13 @@ VMMR3_INT_DECL(int) HMR3Init(PVM pVM)
     rc = CFGMR3QueryBoolDef(pCfgHm, "EnableUX", &pVM->hm.s.vmx.fAllowUnrestricted, true);
     AssertRCReturn(rc, rc);
 
+    /** @cfgm{/HM/EnableEptAccessDirty, bool, true}
+     * Enables the VT-x EPT accessed and dirty flags when the CPU supports them.
+     * PGM uses the dirty flags for tracking guest RAM modifications during
+     * live saving and teleportation instead of write-monitoring faults. */
+    rc = CFGMR3QueryBoolDef(pCfgHm, "EnableEptAccessDirty", &pVM->hm.s.vmx.fEptAccessDirty, true);
+    AssertRCReturn(rc, rc);
+
     /** @cfgm{/HM/EnableLargePages, bool, false}
      * Enables using large pages (2 MB) for guest memory, thus saving on (nested)
      * page table walking and maybe better TLB hit rate in some cases. */
@@ -1624,6 +1632,13 @@ static int hmR3InitFinalizeR0Intel(PVM pVM)
             ? "HM: Guest support: 32-bit and 64-bit\n"
             : "HM: Guest support: 32-bit only\n"));
 
+    /*
+     * The EPT accessed and dirty flags are only of use with nested paging.
+     */
+    if (   !pVM->hm.s.fNestedPaging
+        || !(pVM->hm.s.vmx.Msrs.u64EptVpidCaps & MSR_IA32_VMX_EPT_VPID_CAP_EPT_ACCESS_DIRTY))
+        pVM->hm.s.vmx.fEptAccessDirty = false;
+
     /*
      * Call ring-0 to set up the VM.
      */
@@ -1689,6 +1704,9 @@ static int hmR3InitFinalizeR0Intel(PVM pVM)
         if (pVM->hm.s.vmx.fUnrestrictedGuest)
             LogRel(("HM: Enabled unrestricted guest execution\n"));
 
+        if (pVM->hm.s.vmx.fEptAccessDirty)
+            LogRel(("HM: Enabled EPT accessed and dirty flags\n"));
+
 #if HC_ARCH_BITS == 64
         if (pVM->hm.s.fLargePages)
         {
@@ -471,6 +471,8 @@ int pdmacFileAioMgrCreate(PPDMASYNCCOMPLETIONEPCLASSFILE pEpClass, PPPDMACEPFILE
                                              "AioMgr%d-%s", pEpClass->cAioMgrs,
                                              pAioMgrNew->enmMgrType == PDMACEPFILEMGRTYPE_SIMPLE
                                              ? "F"
+                                             : pAioMgrNew->enmMgrType == PDMACEPFILEMGRTYPE_ASYNC_IO_URING
+                                             ? "U"
                                              : "N");
                         if (RT_SUCCESS(rc))
                         {
@@ -553,6 +555,8 @@ static int pdmacFileMgrTypeFromName(const char *pszVal, PPDMACEPFILEMGRTYPE penm
         *penmMgrType = PDMACEPFILEMGRTYPE_SIMPLE;
     else if (!RTStrCmp(pszVal, "Async"))
         *penmMgrType = PDMACEPFILEMGRTYPE_ASYNC;
+    else if (!RTStrCmp(pszVal, "IoUring"))
+        *penmMgrType = PDMACEPFILEMGRTYPE_ASYNC_IO_URING;
     else
         rc = VERR_CFGM_CONFIG_UNKNOWN_VALUE;
 
@@ -565,6 +569,8 @@ static const char *pdmacFileMgrTypeToName(PDMACEPFILEMGRTYPE enmMgrType)
         return "Simple";
     if (enmMgrType == PDMACEPFILEMGRTYPE_ASYNC)
         return "Async";
+    if (enmMgrType == PDMACEPFILEMGRTYPE_ASYNC_IO_URING)
+        return "IoUring";
 
     return NULL;
 }
@@ -838,7 +844,7 @@ static DECLCALLBACK(int) pdmacFileInitialize(PPDMASYNCCOMPLETIONEPCLASS pClassGl
             LogRel(("AIOMgr: Default file backend is '%s'\n", pdmacFileBackendTypeToName(pEpClassFile->enmEpBackendDefault)));
 
 #ifdef RT_OS_LINUX
-            if (   pEpClassFile->enmMgrTypeOverride == PDMACEPFILEMGRTYPE_ASYNC
+            if (   pEpClassFile->enmMgrTypeOverride != PDMACEPFILEMGRTYPE_SIMPLE
                 && pEpClassFile->enmEpBackendDefault == PDMACFILEEPBACKEND_BUFFERED)
             {
                 LogRel(("AIOMgr: Linux does not support buffered async I/O, changing to non buffered\n"));
@@ -929,7 +935,7 @@ static DECLCALLBACK(int) pdmacFileEpInitialize(PPDMASYNCCOMPLETIONENDPOINT pEndp
             fFileFlags |= RTFILE_O_DENY_WRITE;
     }
 
-    if (enmMgrType == PDMACEPFILEMGRTYPE_ASYNC)
+    if (enmMgrType != PDMACEPFILEMGRTYPE_SIMPLE)
         fFileFlags |= RTFILE_O_ASYNC_IO;
 
     int rc;
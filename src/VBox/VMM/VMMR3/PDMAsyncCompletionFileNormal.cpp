@@ -51,13 +51,28 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
                                                int rc, size_t cbTransfered);
 
 
+/**
+ * Returns the flags to create the async I/O context of the given manager with.
+ *
+ * @returns RTFILEAIOCTX_FLAGS_XXX.
+ * @param   pAioMgr    The I/O manager.
+ */
+DECLINLINE(uint32_t) pdmacFileAioMgrNormalGetCtxFlags(PPDMACEPFILEMGR pAioMgr)
+{
+    return   pAioMgr->enmMgrType == PDMACEPFILEMGRTYPE_ASYNC_IO_URING
+           ? RTFILEAIOCTX_FLAGS_PREFER_IO_URING
+           : 0;
+}
+
+
 int pdmacFileAioMgrNormalInit(PPDMACEPFILEMGR pAioMgr)
 {
     pAioMgr->cRequestsActiveMax = PDMACEPFILEMGR_REQS_STEP;
 
-    int rc = RTFileAioCtxCreate(&pAioMgr->hAioCtx, RTFILEAIO_UNLIMITED_REQS, 0 /* fFlags */);
+    uint32_t fFlags = pdmacFileAioMgrNormalGetCtxFlags(pAioMgr);
+    int rc = RTFileAioCtxCreate(&pAioMgr->hAioCtx, RTFILEAIO_UNLIMITED_REQS, fFlags);
     if (rc == VERR_OUT_OF_RANGE)
-        rc = RTFileAioCtxCreate(&pAioMgr->hAioCtx, pAioMgr->cRequestsActiveMax, 0 /* fFlags */);
+        rc = RTFileAioCtxCreate(&pAioMgr->hAioCtx, pAioMgr->cRequestsActiveMax, fFlags);
 
     if (RT_SUCCESS(rc))
     {
@@ -259,7 +274,7 @@ static void pdmacFileAioMgrNormalBalanceLoad(PPDMACEPFILEMGR pAioMgr)
         PPDMASYNCCOMPLETIONEPCLASSFILE  pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pAioMgr->pEndpointsHead->Core.pEpClass;
         PPDMACEPFILEMGR                 pAioMgrNew = NULL;
 
-        int rc = pdmacFileAioMgrCreate(pEpClassFile, &pAioMgrNew, PDMACEPFILEMGRTYPE_ASYNC);
+        int rc = pdmacFileAioMgrCreate(pEpClassFile, &pAioMgrNew, pAioMgr->enmMgrType);
         if (RT_SUCCESS(rc))
         {
             /* We will sort the list by request count per second. */
@@ -355,9 +370,10 @@ static int pdmacFileAioMgrNormalGrow(PPDMACEPFILEMGR pAioMgr)
     pAioMgr->cRequestsActiveMax += PDMACEPFILEMGR_REQS_STEP;
 
     RTFILEAIOCTX hAioCtxNew = NIL_RTFILEAIOCTX;
-    int rc = RTFileAioCtxCreate(&hAioCtxNew, RTFILEAIO_UNLIMITED_REQS, 0 /* fFlags */);
+    uint32_t fFlags = pdmacFileAioMgrNormalGetCtxFlags(pAioMgr);
+    int rc = RTFileAioCtxCreate(&hAioCtxNew, RTFILEAIO_UNLIMITED_REQS, fFlags);
     if (rc == VERR_OUT_OF_RANGE)
-        rc = RTFileAioCtxCreate(&hAioCtxNew, pAioMgr->cRequestsActiveMax, 0 /* fFlags */);
+        rc = RTFileAioCtxCreate(&hAioCtxNew, pAioMgr->cRequestsActiveMax, fFlags);
 
     if (RT_SUCCESS(rc))
     {
@@ -124,47 +124,102 @@ DECLINLINE(void) pdmBlkCacheEntryRef(PPDMBLKCACHEENTRY pEntry)
 }
 
 #ifdef VBOX_STRICT
-static void pdmBlkCacheValidate(PPDMBLKCACHEGLOBAL pCache)
+static void pdmBlkCacheValidate(PPDMBLKCACHESHARD pShard)
 {
     /* Amount of cached data should never exceed the maximum amount. */
-    AssertMsg(pCache->cbCached <= pCache->cbMax,
+    AssertMsg(pShard->cbCached <= pShard->cbMax,
               ("Current amount of cached data exceeds maximum\n"));
 
     /* The amount of cached data in the LRU and FRU list should match cbCached */
-    AssertMsg(pCache->LruRecentlyUsedIn.cbCached + pCache->LruFrequentlyUsed.cbCached == pCache->cbCached,
+    AssertMsg(pShard->LruRecentlyUsedIn.cbCached + pShard->LruFrequentlyUsed.cbCached == pShard->cbCached,
               ("Amount of cached data doesn't match\n"));
 
-    AssertMsg(pCache->LruRecentlyUsedOut.cbCached <= pCache->cbRecentlyUsedOutMax,
-              ("Paged out list exceeds maximum\n"));
+    AssertMsg(pShard->LruRecentlyUsedOut.cbCached + pShard->LruFrequentlyUsedOut.cbCached <= pShard->cbGhostMax,
+              ("Paged out lists exceed maximum\n"));
 }
 #endif
 
 DECLINLINE(void) pdmBlkCacheLockEnter(PPDMBLKCACHEGLOBAL pCache)
 {
     RTCritSectEnter(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+{
+    RTCritSectLeave(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheShardLockEnter(PPDMBLKCACHESHARD pShard)
+{
+    RTCritSectEnter(&pShard->CritSect);
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheValidate(pShard);
 #endif
 }
 
-DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+DECLINLINE(void) pdmBlkCacheShardLockLeave(PPDMBLKCACHESHARD pShard)
 {
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheValidate(pShard);
 #endif
-    RTCritSectLeave(&pCache->CritSect);
+    RTCritSectLeave(&pShard->CritSect);
 }
 
-DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+/**
+ * Enters the global lock and the locks of all shards, in that order.
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheLockEnterAll(PPDMBLKCACHEGLOBAL pCache)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached -= cbAmount;
+    pdmBlkCacheLockEnter(pCache);
+    for (uint32_t i = 0; i < pCache->cShards; i++)
+        pdmBlkCacheShardLockEnter(&pCache->aShards[i]);
 }
 
-DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+/**
+ * Leaves all locks entered with pdmBlkCacheLockEnterAll().
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheLockLeaveAll(PPDMBLKCACHEGLOBAL pCache)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached += cbAmount;
+    for (uint32_t i = pCache->cShards; i > 0; i--)
+        pdmBlkCacheShardLockLeave(&pCache->aShards[i - 1]);
+    pdmBlkCacheLockLeave(pCache);
+}
+
+/**
+ * Returns the shard a new entry at the given offset is accounted in.
+ *
+ * Consecutive regions of PDMBLKCACHE_SHARD_REGION_SHIFT size of an endpoint
+ * map to the same shard, different regions and endpoints are spread over all
+ * shards.
+ *
+ * @returns Pointer to the shard.
+ * @param   pBlkCache    The endpoint cache.
+ * @param   off          The start offset of the entry.
+ */
+DECLINLINE(PPDMBLKCACHESHARD) pdmBlkCacheShardGet(PPDMBLKCACHE pBlkCache, uint64_t off)
+{
+    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
+    uint64_t uHash = (pBlkCache->uShardHash ^ (off >> PDMBLKCACHE_SHARD_REGION_SHIFT)) * UINT64_C(0x9e3779b97f4a7c15);
+
+    return &pCache->aShards[(uint32_t)(uHash >> 32) % pCache->cShards];
+}
+
+DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached -= cbAmount;
+}
+
+DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached += cbAmount;
 }
 
 DECLINLINE(void) pdmBlkCacheListAdd(PPDMBLKLRULIST pList, uint32_t cbAmount)
@@ -327,16 +382,92 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
     }
 }
 
+/**
+ * Frees the least recently used entry of the given ghost list which is not
+ * referenced.
+ *
+ * @returns Flag whether an entry was freed.
+ * @param   pShard    The cache shard.
+ * @param   pList     The ghost list to free the entry from.
+ */
+static bool pdmBlkCacheGhostEntryFree(PPDMBLKCACHESHARD pShard, PPDMBLKLRULIST pList)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    PPDMBLKCACHEENTRY pGhostEntFree = pList->pTail;
+    while (pGhostEntFree)
+    {
+        PPDMBLKCACHEENTRY pFree = pGhostEntFree;
+        PPDMBLKCACHE pBlkCacheFree = pFree->pBlkCache;
+
+        pGhostEntFree = pGhostEntFree->pPrev;
+
+        RTSemRWRequestWrite(pBlkCacheFree->SemRWEntries, RT_INDEFINITE_WAIT);
+
+        if (ASMAtomicReadU32(&pFree->cRefs) == 0)
+        {
+            pdmBlkCacheEntryRemoveFromList(pFree);
+
+            STAM_PROFILE_ADV_START(&pBlkCacheFree->pCache->StatTreeRemove, Cache);
+            RTAvlrU64Remove(pBlkCacheFree->pTree, pFree->Core.Key);
+            STAM_PROFILE_ADV_STOP(&pBlkCacheFree->pCache->StatTreeRemove, Cache);
+
+            RTSemRWReleaseWrite(pBlkCacheFree->SemRWEntries);
+            RTMemFree(pFree);
+            return true;
+        }
+
+        RTSemRWReleaseWrite(pBlkCacheFree->SemRWEntries);
+    }
+
+    return false;
+}
+
+/**
+ * Trims the ghost lists of the given shard to their ARC limits.
+ *
+ * The recently used list and its ghost list together never cover more than the
+ * shard and both ghost lists together never cover more than cbGhostMax (which
+ * is at most the size of the shard). Needs to be called whenever one of the
+ * lists grew.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard.
+ */
+static void pdmBlkCacheGhostListsTrim(PPDMBLKCACHESHARD pShard)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    for (;;)
+    {
+        PPDMBLKLRULIST pList;
+        if (   pShard->LruRecentlyUsedOut.pTail
+            &&   (uint64_t)pShard->LruRecentlyUsedIn.cbCached + pShard->LruRecentlyUsedOut.cbCached
+               > pShard->cbMax)
+            pList = &pShard->LruRecentlyUsedOut;
+        else if (  (uint64_t)pShard->LruRecentlyUsedOut.cbCached + pShard->LruFrequentlyUsedOut.cbCached
+                 > pShard->cbGhostMax)
+            pList = pShard->LruFrequentlyUsedOut.pTail
+                  ? &pShard->LruFrequentlyUsedOut
+                  : &pShard->LruRecentlyUsedOut;
+        else
+            break;
+
+        /* Stop if everything left in the list is referenced, the next call will continue. */
+        if (!pdmBlkCacheGhostEntryFree(pShard, pList))
+            break;
+    }
+}
+
 /**
  * Tries to remove the given amount of bytes from a given list in the cache
  * moving the entries to one of the given ghosts lists
  *
  * @returns Amount of data which could be freed.
- * @param    pCache           Pointer to the global cache data.
+ * @param    pShard           The cache shard to evict from.
  * @param    cbData           The amount of the data to free.
  * @param    pListSrc         The source list to evict data from.
- * @param    pGhostListDst    Where the ghost list removed entries should be
- *                            moved to, NULL if the entry should be freed.
+ * @param    pGhostListDst    The ghost list removed entries should be moved to.
  * @param    fReuseBuffer     Flag whether a buffer should be reused if it has
  *                            the same size
  * @param    ppbBuffer        Where to store the address of the buffer if an
@@ -347,18 +478,20 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
  *          may be marked as non evictable if they are used for I/O at the
  *          moment.
  */
-static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData,
+static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHESHARD pShard, size_t cbData,
                                         PPDMBLKLRULIST pListSrc, PPDMBLKLRULIST pGhostListDst,
                                         bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbEvicted = 0;
 
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
 
     AssertMsg(cbData > 0, ("Evicting 0 bytes not possible\n"));
-    AssertMsg(   !pGhostListDst
-              || (pGhostListDst == &pCache->LruRecentlyUsedOut),
-              ("Destination list must be NULL or the recently used but paged out list\n"));
+    AssertMsg(   (   pListSrc == &pShard->LruRecentlyUsedIn
+                  && pGhostListDst == &pShard->LruRecentlyUsedOut)
+              || (   pListSrc == &pShard->LruFrequentlyUsed
+                  && pGhostListDst == &pShard->LruFrequentlyUsedOut),
+              ("Destination list must be the ghost list of the source list\n"));
 
     if (fReuseBuffer)
     {
@@ -382,6 +515,7 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
             /* Ok eviction candidate. Grab the endpoint semaphore and check again
              * because somebody else might have raced us. */
             PPDMBLKCACHE pBlkCache = pCurr->pBlkCache;
+            PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
             RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
 
             if (!(pCurr->fFlags & PDMBLKCACHE_NOT_EVICTABLE)
@@ -401,61 +535,13 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                 cbEvicted += pCurr->cbData;
 
                 pdmBlkCacheEntryRemoveFromList(pCurr);
-                pdmBlkCacheSub(pCache, pCurr->cbData);
-
-                if (pGhostListDst)
-                {
-                    RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
-
-                    PPDMBLKCACHEENTRY pGhostEntFree = pGhostListDst->pTail;
-
-                    /* We have to remove the last entries from the paged out list. */
-                    while (   pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax
-                           && pGhostEntFree)
-                    {
-                        PPDMBLKCACHEENTRY pFree = pGhostEntFree;
-                        PPDMBLKCACHE pBlkCacheFree = pFree->pBlkCache;
-
-                        pGhostEntFree = pGhostEntFree->pPrev;
-
-                        RTSemRWRequestWrite(pBlkCacheFree->SemRWEntries, RT_INDEFINITE_WAIT);
-
-                        if (ASMAtomicReadU32(&pFree->cRefs) == 0)
-                        {
-                            pdmBlkCacheEntryRemoveFromList(pFree);
+                pdmBlkCacheSub(pShard, pCurr->cbData);
 
-                            STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
-                            RTAvlrU64Remove(pBlkCacheFree->pTree, pFree->Core.Key);
-                            STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
-
-                            RTMemFree(pFree);
-                        }
-
-                        RTSemRWReleaseWrite(pBlkCacheFree->SemRWEntries);
-                    }
-
-                    if (pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax)
-                    {
-                        /* Couldn't remove enough entries. Delete */
-                        STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
-                        RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                        STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
-
-                        RTMemFree(pCurr);
-                    }
-                    else
-                        pdmBlkCacheEntryAddToList(pGhostListDst, pCurr);
-                }
-                else
-                {
-                    /* Delete the entry from the AVL tree it is assigned to. */
-                    STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
-                    RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                    STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
-                    RTMemFree(pCurr);
-                }
+                /* Remember the entry in the ghost list, trimming it (and maybe the entry itself) to the limits. */
+                pdmBlkCacheEntryAddToList(pGhostListDst, pCurr);
+                pdmBlkCacheGhostListsTrim(pShard);
             }
 
         }
@@ -466,43 +552,105 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
     return cbEvicted;
 }
 
-static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+/**
+ * Adapts the target size of the recently used list after a hit in one of the
+ * ghost lists (ARC).
+ *
+ * A hit in the recently used ghost list means the recently used list would
+ * have needed more space and the target grows, a hit in the frequently used
+ * ghost list shrinks it.
+ *
+ * @returns nothing.
+ * @param   pShard    The cache shard.
+ * @param   pEntry    The ghost entry which got accessed.
+ */
+static void pdmBlkCacheGhostHit(PPDMBLKCACHESHARD pShard, PPDMBLKCACHEENTRY pEntry)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    uint64_t cbRecentlyUsedOut   = RT_MAX(pShard->LruRecentlyUsedOut.cbCached, 1);
+    uint64_t cbFrequentlyUsedOut = RT_MAX(pShard->LruFrequentlyUsedOut.cbCached, 1);
+
+    if (pEntry->pList == &pShard->LruRecentlyUsedOut)
+    {
+        uint64_t cbDelta = RT_MAX((uint64_t)pEntry->cbData * cbFrequentlyUsedOut / cbRecentlyUsedOut, pEntry->cbData);
+        pShard->cbRecentlyUsedInTarget = (uint32_t)RT_MIN(pShard->cbRecentlyUsedInTarget + cbDelta, pShard->cbMax);
+        STAM_COUNTER_INC(&pShard->StatGhostHitsRecentlyUsed);
+    }
+    else
+    {
+        Assert(pEntry->pList == &pShard->LruFrequentlyUsedOut);
+        uint64_t cbDelta = RT_MAX((uint64_t)pEntry->cbData * cbRecentlyUsedOut / cbFrequentlyUsedOut, pEntry->cbData);
+        pShard->cbRecentlyUsedInTarget = pShard->cbRecentlyUsedInTarget > cbDelta
+                                       ? pShard->cbRecentlyUsedInTarget - (uint32_t)cbDelta
+                                       : 0;
+        STAM_COUNTER_INC(&pShard->StatGhostHitsFrequentlyUsed);
+    }
+}
+
+/**
+ * Makes room for the given amount of data in the given shard.
+ *
+ * Entries are evicted from the recently used list while it exceeds its
+ * adaptive target size and from the frequently used list otherwise (ARC).
+ * A sequential scan thus only displaces entries which were accessed once.
+ *
+ * @returns Flag whether enough room could be made.
+ * @param   pShard              The cache shard.
+ * @param   cbData              Number of bytes required.
+ * @param   fGhostFrequentlyUsed Flag whether the room is needed for an entry
+ *                              from the frequently used ghost list.
+ * @param   fReuseBuffer        Flag whether a buffer should be reused if it has
+ *                              the same size
+ * @param   ppbBuffer           Where to store the address of the buffer if an
+ *                              entry with the same size was found and
+ *                              fReuseBuffer is true.
+ */
+static bool pdmBlkCacheReclaim(PPDMBLKCACHESHARD pShard, size_t cbData, bool fGhostFrequentlyUsed,
+                               bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbRemoved = 0;
 
-    if ((pCache->cbCached + cbData) < pCache->cbMax)
+    if ((pShard->cbCached + cbData) < pShard->cbMax)
         return true;
-    else if ((pCache->LruRecentlyUsedIn.cbCached + cbData) > pCache->cbRecentlyUsedInMax)
-    {
-        /* Try to evict as many bytes as possible from A1in */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruRecentlyUsedIn,
-                                                 &pCache->LruRecentlyUsedOut, fReuseBuffer, ppbBuffer);
 
-        /*
-         * If it was not possible to remove enough entries
-         * try the frequently accessed cache.
-         */
-        if (cbRemoved < cbData)
-        {
-            Assert(!fReuseBuffer || !*ppbBuffer); /* It is not possible that we got a buffer with the correct size but we didn't freed enough data. */
+    PPDMBLKLRULIST pListFirst       = &pShard->LruFrequentlyUsed;
+    PPDMBLKLRULIST pGhostListFirst  = &pShard->LruFrequentlyUsedOut;
+    PPDMBLKLRULIST pListSecond      = &pShard->LruRecentlyUsedIn;
+    PPDMBLKLRULIST pGhostListSecond = &pShard->LruRecentlyUsedOut;
 
-            /*
-             * If we removed something we can't pass the reuse buffer flag anymore because
-             * we don't need to evict that much data
-             */
-            if (!cbRemoved)
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
-                                                          NULL, fReuseBuffer, ppbBuffer);
-            else
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData - cbRemoved, &pCache->LruFrequentlyUsed,
-                                                          NULL, false, NULL);
-        }
+    if (   pShard->LruRecentlyUsedIn.cbCached
+        && (   pShard->LruRecentlyUsedIn.cbCached > pShard->cbRecentlyUsedInTarget
+            || (   fGhostFrequentlyUsed
+                && pShard->LruRecentlyUsedIn.cbCached == pShard->cbRecentlyUsedInTarget)))
+    {
+        pListFirst       = &pShard->LruRecentlyUsedIn;
+        pGhostListFirst  = &pShard->LruRecentlyUsedOut;
+        pListSecond      = &pShard->LruFrequentlyUsed;
+        pGhostListSecond = &pShard->LruFrequentlyUsedOut;
     }
-    else
+
+    cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, pListFirst, pGhostListFirst,
+                                          fReuseBuffer, ppbBuffer);
+
+    /*
+     * If it was not possible to remove enough entries
+     * try the other list.
+     */
+    if (cbRemoved < cbData)
     {
-        /* We have to remove entries from frequently access list. */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
-                                                 NULL, fReuseBuffer, ppbBuffer);
+        Assert(!fReuseBuffer || !*ppbBuffer); /* It is not possible that we got a buffer with the correct size but we didn't freed enough data. */
+
+        /*
+         * If we removed something we can't pass the reuse buffer flag anymore because
+         * we don't need to evict that much data
+         */
+        if (!cbRemoved)
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData, pListSecond, pGhostListSecond,
+                                                   fReuseBuffer, ppbBuffer);
+        else
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData - cbRemoved, pListSecond, pGhostListSecond,
+                                                   false, NULL);
     }
 
     LogFlowFunc((": removed %u bytes, requested %u\n", cbRemoved, cbData));
@@ -881,8 +1029,8 @@ static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
             AssertMsg(pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY, ("Entry is not dirty\n"));
             AssertMsg(!(pEntry->fFlags & ~PDMBLKCACHE_ENTRY_IS_DIRTY), ("Invalid flags set\n"));
             AssertMsg(!pEntry->pWaitingHead && !pEntry->pWaitingTail, ("There are waiting requests\n"));
-            AssertMsg(   pEntry->pList == &pBlkCacheGlobal->LruRecentlyUsedIn
-                      || pEntry->pList == &pBlkCacheGlobal->LruFrequentlyUsed,
+            AssertMsg(   pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn
+                      || pEntry->pList == &pEntry->pShard->LruFrequentlyUsed,
                       ("Invalid list\n"));
             AssertMsg(pEntry->cbData == pEntry->Core.KeyLast - pEntry->Core.Key + 1,
                       ("Size and range do not match\n"));
@@ -910,7 +1058,7 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
     NOREF(uPass);
     AssertPtr(pBlkCacheGlobal);
 
-    pdmBlkCacheLockEnter(pBlkCacheGlobal);
+    pdmBlkCacheLockEnterAll(pBlkCacheGlobal);
 
     if (uVersion != PDM_BLK_CACHE_SAVED_STATE_VERSION)
         return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
@@ -993,9 +1141,10 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
             Assert(fInserted); NOREF(fInserted);
 
             /* Add to the dirty list. */
+            pEntry->pShard = pdmBlkCacheShardGet(pBlkCache, off);
             pdmBlkCacheAddDirtyEntry(pBlkCache, pEntry);
-            pdmBlkCacheEntryAddToList(&pBlkCacheGlobal->LruRecentlyUsedIn, pEntry);
-            pdmBlkCacheAdd(pBlkCacheGlobal, cbEntry);
+            pdmBlkCacheEntryAddToList(&pEntry->pShard->LruRecentlyUsedIn, pEntry);
+            pdmBlkCacheAdd(pEntry->pShard, cbEntry);
             pdmBlkCacheEntryRelease(pEntry);
             cEntries--;
         }
@@ -1010,7 +1159,7 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
         rc = SSMR3SetCfgError(pSSM, RT_SRC_POS,
                               N_("Unexpected error while restoring state. Please make sure the source and target VMs have compatible storage configurations"));
 
-    pdmBlkCacheLockLeave(pBlkCacheGlobal);
+    pdmBlkCacheLockLeaveAll(pBlkCacheGlobal);
 
     if (RT_SUCCESS(rc))
     {
@@ -1043,32 +1192,70 @@ int pdmR3BlkCacheInit(PVM pVM)
     RTListInit(&pBlkCacheGlobal->ListUsers);
     pBlkCacheGlobal->pVM = pVM;
     pBlkCacheGlobal->cRefs = 0;
-    pBlkCacheGlobal->cbCached  = 0;
     pBlkCacheGlobal->fCommitInProgress = false;
 
-    /* Initialize members */
-    pBlkCacheGlobal->LruRecentlyUsedIn.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.cbCached = 0;
-
-    pBlkCacheGlobal->LruRecentlyUsedOut.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.cbCached = 0;
-
-    pBlkCacheGlobal->LruFrequentlyUsed.pHead    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.pTail    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.cbCached = 0;
-
+    uint32_t cShardsInit = 0;
     do
     {
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheSize", &pBlkCacheGlobal->cbMax, 5 * _1M);
         AssertLogRelRCBreak(rc);
         LogFlowFunc(("Maximum number of bytes cached %u\n", pBlkCacheGlobal->cbMax));
 
-        pBlkCacheGlobal->cbRecentlyUsedInMax  = (pBlkCacheGlobal->cbMax / 100) * 25; /* 25% of the buffer size */
-        pBlkCacheGlobal->cbRecentlyUsedOutMax = (pBlkCacheGlobal->cbMax / 100) * 50; /* 50% of the buffer size */
-        LogFlowFunc(("cbRecentlyUsedInMax=%u cbRecentlyUsedOutMax=%u\n",
-                     pBlkCacheGlobal->cbRecentlyUsedInMax, pBlkCacheGlobal->cbRecentlyUsedOutMax));
+        /* One shard per 16MB of cache by default, a shard must be able to hold large requests. */
+        uint32_t cShardsDef = RT_MIN(RT_MAX(pBlkCacheGlobal->cbMax / (16 * _1M), 1), PDMBLKCACHE_SHARDS_MAX);
+        rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheShards", &pBlkCacheGlobal->cShards, cShardsDef);
+        AssertLogRelRCBreak(rc);
+        if (   !pBlkCacheGlobal->cShards
+            || pBlkCacheGlobal->cShards > PDMBLKCACHE_SHARDS_MAX)
+        {
+            rc = VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                            N_("Configuration error: \"CacheShards\" must be between 1 and %u"), PDMBLKCACHE_SHARDS_MAX);
+            break;
+        }
+
+        /* Both ghost lists together cover at most the cache size (ARC keeps the directory at twice the cache size). */
+        uint32_t uGhostSizePercent = 0;
+        rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheGhostSizePercent", &uGhostSizePercent, 100);
+        AssertLogRelRCBreak(rc);
+
+        if (uGhostSizePercent > 100)
+        {
+            rc = VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                            N_("Configuration error: \"CacheGhostSizePercent\" must not exceed 100"));
+            break;
+        }
+
+        uint32_t cbShardMax = pBlkCacheGlobal->cbMax / pBlkCacheGlobal->cShards;
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->aShards[i];
+
+            pShard->cbMax                  = cbShardMax;
+            pShard->cbCached               = 0;
+            pShard->cbRecentlyUsedInTarget = (cbShardMax / 100) * 25; /* Start with 25% like 2Q did, adapts from there. */
+            pShard->cbGhostMax             = (uint32_t)((uint64_t)cbShardMax * uGhostSizePercent / 100);
+            pShard->LruRecentlyUsedIn.pHead       = NULL;
+            pShard->LruRecentlyUsedIn.pTail       = NULL;
+            pShard->LruRecentlyUsedIn.cbCached    = 0;
+            pShard->LruRecentlyUsedOut.pHead      = NULL;
+            pShard->LruRecentlyUsedOut.pTail      = NULL;
+            pShard->LruRecentlyUsedOut.cbCached   = 0;
+            pShard->LruFrequentlyUsed.pHead       = NULL;
+            pShard->LruFrequentlyUsed.pTail       = NULL;
+            pShard->LruFrequentlyUsed.cbCached    = 0;
+            pShard->LruFrequentlyUsedOut.pHead    = NULL;
+            pShard->LruFrequentlyUsedOut.pTail    = NULL;
+            pShard->LruFrequentlyUsedOut.cbCached = 0;
+
+            rc = RTCritSectInit(&pShard->CritSect);
+            AssertLogRelRCBreak(rc);
+            cShardsInit++;
+        }
+        if (RT_FAILURE(rc))
+            break;
+
+        LogFlowFunc(("cShards=%u cbShardMax=%u uGhostSizePercent=%u\n",
+                     pBlkCacheGlobal->cShards, cbShardMax, uGhostSizePercent));
 
         /** @todo r=aeichner: Experiment to find optimal default values */
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheCommitIntervalMs", &pBlkCacheGlobal->u32CommitTimeoutMs, 10000 /* 10sec */);
@@ -1084,27 +1271,46 @@ int pdmR3BlkCacheInit(PVM pVM)
                        "/PDM/BlkCache/cbMax",
                        STAMUNIT_BYTES,
                        "Maximum cache size");
-        STAMR3Register(pVM, &pBlkCacheGlobal->cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCached",
-                       STAMUNIT_BYTES,
-                       "Currently used cache");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedIn.cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedMruIn",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in MRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedOut.cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedMruOut",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in FRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruFrequentlyUsed.cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedFru",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in FRU ghost list");
 
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->aShards[i];
+
+            STAMR3RegisterF(pVM, &pShard->cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Currently used cache",
+                            "/PDM/BlkCache/Shard%u/cbCached", i);
+            STAMR3RegisterF(pVM, &pShard->cbRecentlyUsedInTarget,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Adaptive target size of the MRU list",
+                            "/PDM/BlkCache/Shard%u/cbTargetMruIn", i);
+            STAMR3RegisterF(pVM, &pShard->LruRecentlyUsedIn.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Number of bytes cached in MRU list",
+                            "/PDM/BlkCache/Shard%u/cbCachedMruIn", i);
+            STAMR3RegisterF(pVM, &pShard->LruRecentlyUsedOut.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Number of bytes referenced by the MRU ghost list",
+                            "/PDM/BlkCache/Shard%u/cbCachedMruOut", i);
+            STAMR3RegisterF(pVM, &pShard->LruFrequentlyUsed.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Number of bytes cached in FRU list",
+                            "/PDM/BlkCache/Shard%u/cbCachedFru", i);
+            STAMR3RegisterF(pVM, &pShard->LruFrequentlyUsedOut.cbCached,
+                            STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_BYTES, "Number of bytes referenced by the FRU ghost list",
+                            "/PDM/BlkCache/Shard%u/cbCachedFruOut", i);
+#ifdef VBOX_WITH_STATISTICS
+            STAMR3RegisterF(pVM, &pShard->StatGhostHitsRecentlyUsed,
+                            STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_COUNT, "Number of hits in the MRU ghost list",
+                            "/PDM/BlkCache/Shard%u/GhostHitsMru", i);
+            STAMR3RegisterF(pVM, &pShard->StatGhostHitsFrequentlyUsed,
+                            STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                            STAMUNIT_COUNT, "Number of hits in the FRU ghost list",
+                            "/PDM/BlkCache/Shard%u/GhostHitsFru", i);
+#endif
+        }
 #ifdef VBOX_WITH_STATISTICS
         STAMR3Register(pVM, &pBlkCacheGlobal->cHits,
                        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
@@ -1178,6 +1384,9 @@ int pdmR3BlkCacheInit(PVM pVM)
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
     }
 
+    for (uint32_t i = 0; i < cShardsInit; i++)
+        RTCritSectDelete(&pBlkCacheGlobal->aShards[i].CritSect);
+
     if (pBlkCacheGlobal)
         RTMemFree(pBlkCacheGlobal);
 
@@ -1192,15 +1401,23 @@ void pdmR3BlkCacheTerm(PVM pVM)
     if (pBlkCacheGlobal)
     {
         /* Make sure no one else uses the cache now */
-        pdmBlkCacheLockEnter(pBlkCacheGlobal);
+        pdmBlkCacheLockEnterAll(pBlkCacheGlobal);
 
         /* Cleanup deleting all cache entries waiting for in progress entries to finish. */
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedIn);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedOut);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruFrequentlyUsed);
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->aShards[i];
+
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedIn);
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedOut);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsed);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsedOut);
+        }
 
-        pdmBlkCacheLockLeave(pBlkCacheGlobal);
+        pdmBlkCacheLockLeaveAll(pBlkCacheGlobal);
 
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+            RTCritSectDelete(&pBlkCacheGlobal->aShards[i].CritSect);
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
         RTMemFree(pBlkCacheGlobal);
         pVM->pUVM->pdm.s.pBlkCacheGlobal = NULL;
@@ -1253,6 +1470,7 @@ static int pdmR3BlkCacheRetain(PVM pVM, PPPDMBLKCACHE ppBlkCache, const char *pc
             pBlkCache->fSuspended = false;
             pBlkCache->cIoXfersActive = 0;
             pBlkCache->pCache = pBlkCacheGlobal;
+            pBlkCache->uShardHash = RTStrHash1(pcszId);
             RTListInit(&pBlkCache->ListDirtyNotCommitted);
 
             rc = RTSpinlockCreate(&pBlkCache->LockList, RTSPINLOCK_FLAGS_INTERRUPT_UNSAFE, "pdmR3BlkCacheRetain");
@@ -1422,12 +1640,12 @@ static DECLCALLBACK(int) pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *p
         /* Leave the locks to let the I/O thread make progress but reference the entry to prevent eviction. */
         pdmBlkCacheEntryRef(pEntry);
         RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheLockLeaveAll(pCache);
 
         RTThreadSleep(250);
 
         /* Re-enter all locks */
-        pdmBlkCacheLockEnter(pCache);
+        pdmBlkCacheLockEnterAll(pCache);
         RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
         pdmBlkCacheEntryRelease(pEntry);
     }
@@ -1435,13 +1653,14 @@ static DECLCALLBACK(int) pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *p
     AssertMsg(!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
                 ("Entry is dirty and/or still in progress fFlags=%#x\n", pEntry->fFlags));
 
-    bool fUpdateCache =    pEntry->pList == &pCache->LruFrequentlyUsed
-                        || pEntry->pList == &pCache->LruRecentlyUsedIn;
+    PPDMBLKCACHESHARD pShard = pEntry->pShard;
+    bool fUpdateCache =    pEntry->pList == &pShard->LruFrequentlyUsed
+                        || pEntry->pList == &pShard->LruRecentlyUsedIn;
 
     pdmBlkCacheEntryRemoveFromList(pEntry);
 
     if (fUpdateCache)
-        pdmBlkCacheSub(pCache, pEntry->cbData);
+        pdmBlkCacheSub(pShard, pEntry->cbData);
 
     RTMemPageFree(pEntry->pbData, pEntry->cbData);
     RTMemFree(pEntry);
@@ -1468,7 +1687,7 @@ VMMR3DECL(void) PDMR3BlkCacheRelease(PPDMBLKCACHE pBlkCache)
         pdmBlkCacheCommit(pBlkCache);
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
-    pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
@@ -1478,7 +1697,7 @@ VMMR3DECL(void) PDMR3BlkCacheRelease(PPDMBLKCACHE pBlkCache)
     pCache->cRefs--;
     RTListNodeRemove(&pBlkCache->NodeCacheUser);
 
-    pdmBlkCacheLockLeave(pCache);
+    pdmBlkCacheLockLeaveAll(pCache);
 
     RTMemFree(pBlkCache->pTree);
     pBlkCache->pTree = NULL;
@@ -1659,6 +1878,7 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryAlloc(PPDMBLKCACHE pBlkCache, uint64_t
     pEntryNew->fFlags        = 0;
     pEntryNew->cRefs         = 1; /* We are using it now. */
     pEntryNew->pList         = NULL;
+    pEntryNew->pShard        = NULL;
     pEntryNew->cbData        = (uint32_t)cbData;
     pEntryNew->pWaitingHead  = NULL;
     pEntryNew->pWaitingTail  = NULL;
@@ -1852,12 +2072,12 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache, uint64_t
     *pcbData = pdmBlkCacheEntryBoundariesCalc(pBlkCache, off, (uint32_t)cb, &cbEntry);
     AssertReturn(cb <= UINT32_MAX, NULL);
 
-    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
-    pdmBlkCacheLockEnter(pCache);
+    PPDMBLKCACHESHARD pShard = pdmBlkCacheShardGet(pBlkCache, off);
+    pdmBlkCacheShardLockEnter(pShard);
 
     PPDMBLKCACHEENTRY pEntryNew = NULL;
     uint8_t          *pbBuffer  = NULL;
-    bool fEnough = pdmBlkCacheReclaim(pCache, cbEntry, true, &pbBuffer);
+    bool fEnough = pdmBlkCacheReclaim(pShard, cbEntry, false /* fGhostFrequentlyUsed */, true, &pbBuffer);
     if (fEnough)
     {
         LogFlow(("Evicted enough bytes (%u requested). Creating new cache entry\n", cbEntry));
@@ -1865,9 +2085,11 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache, uint64_t
         pEntryNew = pdmBlkCacheEntryAlloc(pBlkCache, off, cbEntry, pbBuffer);
         if (RT_LIKELY(pEntryNew))
         {
-            pdmBlkCacheEntryAddToList(&pCache->LruRecentlyUsedIn, pEntryNew);
-            pdmBlkCacheAdd(pCache, cbEntry);
-            pdmBlkCacheLockLeave(pCache);
+            pEntryNew->pShard = pShard;
+            pdmBlkCacheEntryAddToList(&pShard->LruRecentlyUsedIn, pEntryNew);
+            pdmBlkCacheAdd(pShard, cbEntry);
+            pdmBlkCacheGhostListsTrim(pShard);
+            pdmBlkCacheShardLockLeave(pShard);
 
             pdmBlkCacheInsertEntry(pBlkCache, pEntryNew);
 
@@ -1876,10 +2098,10 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache, uint64_t
                       ("Overflow in calculation off=%llu\n", off));
         }
         else
-            pdmBlkCacheLockLeave(pCache);
+            pdmBlkCacheShardLockLeave(pShard);
     }
     else
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheShardLockLeave(pShard);
 
     return pEntryNew;
 }
@@ -2021,8 +2243,9 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
             STAM_COUNTER_ADD(&pCache->StatRead, cbToRead);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            PPDMBLKCACHESHARD pShard = pEntry->pShard;
+            if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pShard->LruFrequentlyUsed))
             {
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
                                                               PDMBLKCACHE_ENTRY_IO_IN_PROGRESS,
@@ -2040,13 +2263,10 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                     RTSgBufCopyFromBuf(&SgBuf, pEntry->pbData + offDiff, cbToRead);
                 }
 
-                /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                /* Second access, move this entry to the top position of the frequently used list. */
+                pdmBlkCacheShardLockEnter(pShard);
+                pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+                pdmBlkCacheShardLockLeave(pShard);
                 /* Release the entry */
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2056,16 +2276,18 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
 
                 LogFlow(("Fetching data for ghost entry %#p from file\n", pEntry));
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pShard);
+                bool fGhostFrequentlyUsed = pEntry->pList == &pShard->LruFrequentlyUsedOut;
+                pdmBlkCacheGhostHit(pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pShard, pEntry->cbData, fGhostFrequentlyUsed, true, &pbBuffer);
 
                 /* Move the entry to Am and fetch it to the cache. */
                 if (fEnough)
                 {
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+                    pdmBlkCacheAdd(pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2088,7 +2310,7 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
 
@@ -2222,8 +2444,9 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off, PCRTSGBU
             STAM_COUNTER_ADD(&pCache->StatWritten, cbToWrite);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            PPDMBLKCACHESHARD pShard = pEntry->pShard;
+            if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pShard->LruFrequentlyUsed))
             {
                 /* Check if the entry is dirty. */
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2271,13 +2494,10 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off, PCRTSGBU
                     }
                 } /* Dirty bit not set */
 
-                /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                /* Second access, move this entry to the top position of the frequently used list. */
+                pdmBlkCacheShardLockEnter(pShard);
+                pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+                pdmBlkCacheShardLockLeave(pShard);
 
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2285,16 +2505,18 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off, PCRTSGBU
             {
                 uint8_t *pbBuffer = NULL;
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pShard);
+                bool fGhostFrequentlyUsed = pEntry->pList == &pShard->LruFrequentlyUsedOut;
+                pdmBlkCacheGhostHit(pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pShard, pEntry->cbData, fGhostFrequentlyUsed, true, &pbBuffer);
 
                 if (fEnough)
                 {
                     /* Move the entry to Am and fetch it to the cache. */
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+                    pdmBlkCacheAdd(pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2319,7 +2541,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off, PCRTSGBU
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
                     pdmBlkCacheRequestPassthrough(pBlkCache, pReq,
@@ -2476,8 +2698,9 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 cbThisDiscard = RT_MIN(pEntry->cbData - offDiff, cbLeft);
 
                 /* Ghost lists contain no data. */
-                if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                    || (pEntry->pList == &pCache->LruFrequentlyUsed))
+                PPDMBLKCACHESHARD pShard = pEntry->pShard;
+                if (   (pEntry->pList == &pShard->LruRecentlyUsedIn)
+                    || (pEntry->pList == &pShard->LruFrequentlyUsed))
                 {
                     /* Check if the entry is dirty. */
                     if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2487,14 +2710,15 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         /* If it is dirty but not yet in progress remove it. */
                         if (!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS))
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
+                            pdmBlkCacheSub(pShard, pEntry->cbData);
 
                             STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
                             STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2533,8 +2757,9 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         }
                         else /* I/O in progress flag not set */
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
+                            pdmBlkCacheSub(pShard, pEntry->cbData);
 
                             RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
                             STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
@@ -2542,7 +2767,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                             STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                             RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2550,7 +2775,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 }
                 else /* Entry is on the ghost list just remove cache entry. */
                 {
-                    pdmBlkCacheLockEnter(pCache);
+                    pdmBlkCacheShardLockEnter(pShard);
                     pdmBlkCacheEntryRemoveFromList(pEntry);
 
                     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
@@ -2559,7 +2784,7 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pShard);
 
                     RTMemFree(pEntry);
                 }
@@ -2794,12 +3019,12 @@ VMMR3DECL(int) PDMR3BlkCacheClear(PPDMBLKCACHE pBlkCache)
         pdmBlkCacheCommit(pBlkCache);
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
-    pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-    pdmBlkCacheLockLeave(pCache);
+    pdmBlkCacheLockLeaveAll(pCache);
     return rc;
 }
 
@@ -1369,6 +1369,33 @@ VMMR3DECL(int) PGMR3Init(PVM pVM)
     rc = CFGMR3QueryBoolDef(pCfgPGM, "ZeroRamPagesOnReset", &pVM->pgm.s.fZeroRamPagesOnReset, true);
     AssertLogRelRCReturn(rc, rc);
 
+    /** @cfgm{/PGM/SaveDedup, boolean, true}
+     * Whether to save RAM pages identical to one saved earlier in the same pass
+     * as a reference to that page. */
+    rc = CFGMR3QueryBoolDef(pCfgPGM, "SaveDedup", &pVM->pgm.s.fSaveDedup, true);
+    AssertLogRelRCReturn(rc, rc);
+
+    /** @cfgm{/PGM/LiveSaveXbzrleCacheSize, uint64_t, 64M, 0, 4G}
+     * The size of the cache of previously saved RAM page contents used for
+     * delta encoding re-dirtied pages during live save and teleportation.
+     * Zero disables the delta encoding. */
+    uint64_t cbXbzrleCache;
+    rc = CFGMR3QueryU64Def(pCfgPGM, "LiveSaveXbzrleCacheSize", &cbXbzrleCache, _64M);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(cbXbzrleCache <= _4G, ("LiveSaveXbzrleCacheSize=%#RX64\n", cbXbzrleCache), VERR_OUT_OF_RANGE);
+    pVM->pgm.s.LiveSave.cXbzrleCachePages = (uint32_t)(cbXbzrleCache >> PAGE_SHIFT);
+
+    /** @cfgm{/PGM/LiveSaveCowBufferSize, uint64_t, 64M, 0, 4G}
+     * How much memory a copy-on-write save (VMR3SaveCow) may use for holding
+     * the original content of pages the guest writes to before they have been
+     * saved.  The guest is throttled when this is used up.  Zero disables
+     * copy-on-write saving, making VMR3SaveCow behave like VMR3Save. */
+    uint64_t cbSaveCowBuffer;
+    rc = CFGMR3QueryU64Def(pCfgPGM, "LiveSaveCowBufferSize", &cbSaveCowBuffer, _64M);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(cbSaveCowBuffer <= _4G, ("LiveSaveCowBufferSize=%#RX64\n", cbSaveCowBuffer), VERR_OUT_OF_RANGE);
+    pVM->pgm.s.LiveSave.cSaveCowMaxQueued = (uint32_t)(cbSaveCowBuffer >> PAGE_SHIFT);
+
 #ifdef VBOX_WITH_STATISTICS
     /*
      * Allocate memory for the statistics before someone tries to use them.
@@ -2674,6 +2701,10 @@ VMMR3_INT_DECL(void) PGMR3MemSetup(PVM pVM, bool fAtReset)
     {
         pgmLock(pVM);
 
+        /* A copy-on-write save in progress needs the pre-reset content. */
+        if (pVM->pgm.s.LiveSave.pSaveCowR3)
+            pgmR3SaveCowPreserveAll(pVM);
+
         int rc = pgmR3PhysRamZeroAll(pVM);
         AssertReleaseRC(rc);
 
@@ -2715,6 +2746,9 @@ VMMR3_INT_DECL(void) PGMR3ResetNoMorePhysWritesFlag(PVM pVM)
  */
 VMMR3DECL(int) PGMR3Term(PVM pVM)
 {
+    pgmR3PostCopyTerm(pVM);
+    pgmR3SaveCowTerm(pVM);
+
     /* Must free shared pages here. */
     pgmLock(pVM);
     pgmR3PhysRamTerm(pVM);
@@ -540,6 +540,14 @@ VMMR3DECL(int) PGMR3PhysGCPhys2CCPtrExternal(PVM pVM, RTGCPHYS GCPhys, void **pp
  */
 VMMR3DECL(int) PGMR3PhysGCPhys2CCPtrReadOnlyExternal(PVM pVM, RTGCPHYS GCPhys, void const **ppv, PPGMPAGEMAPLOCK pLock)
 {
+    /* ALL access handlers are ignored below, so get post-copy pages in first. */
+    if (RT_UNLIKELY(pVM->pgm.s.LiveSave.pPostCopyR3))
+    {
+        int rc2 = pgmR3PostCopyTrgEnsurePage(pVM, GCPhys);
+        if (RT_FAILURE(rc2))
+            return rc2;
+    }
+
     int rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
@@ -984,6 +992,10 @@ static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysChangeMemBalloonRendezvous(PVM pVM, P
             /* Flush the shadow PT if this page was previously used as a guest page table. */
             pgmPoolFlushPageByGCPhys(pVM, paPhysPage[i]);
 
+            /* A copy-on-write save in progress still needs the content. */
+            if (pVM->pgm.s.LiveSave.pSaveCowR3)
+                pgmR3SaveCowPreservePage(pVM, paPhysPage[i]);
+
             rc = pgmPhysFreePage(pVM, pReq, &cPendingPages, pPage, paPhysPage[i], (PGMPAGETYPE)PGM_PAGE_GET_TYPE(pPage));
             if (RT_FAILURE(rc))
             {
@@ -564,6 +564,13 @@ DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolClearAllRendezvous(PVM pVM, PVMCPU pVCpu, vo
     pgmLock(pVM);
     Log(("pgmR3PoolClearAllRendezvous: cUsedPages=%d fpvFlushRemTlb=%RTbool\n", pPool->cUsedPages, !!fpvFlushRemTlb));
 
+    /*
+     * Don't lose the dirty flags of the nested page tables we're about to
+     * zap when a live save is tracking them.
+     */
+    if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+        pgmR3PoolHarvestDirtyBits(pVM);
+
     /*
      * Iterate all the pages until we've encountered all that are in use.
      * This is a simple but not quite optimal solution.
@@ -608,7 +615,7 @@ DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolClearAllRendezvous(PVM pVM, PVMCPU pVCpu, vo
                         PEPTPD pShwPD = (PEPTPD)PGMPOOL_PAGE_2_PTR_V2(pPool->CTX_SUFF(pVM), pVCpu, pPage);
                         for (unsigned i = 0; i < RT_ELEMENTS(pShwPD->a); i++)
                         {
-                            Assert((pShwPD->a[i].u & UINT64_C(0xfff0000000000f80)) == 0);
+                            Assert((pShwPD->a[i].u & UINT64_C(0xfff0000000000c80)) == 0); /* bits 8 & 9 are the EPT A/D flags */
                             if (    pShwPD->a[i].n.u1Present
                                 &&  pShwPD->a[i].b.u1Size)
                             {
@@ -877,6 +884,163 @@ void pgmR3PoolWriteProtectPages(PVM pVM)
     }
 }
 
+/**
+ * @callback_method_impl{FNVMMEMTRENDEZVOUS,
+ *      Worker for pgmR3PoolWriteProtectAll.}
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolWriteProtectAllRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    RT_NOREF(pVCpu, pvUser);
+
+    pgmLock(pVM);
+    pgmPoolResetDirtyPages(pVM);
+    pgmR3PoolWriteProtectPages(pVM);
+    PGM_INVL_ALL_VCPU_TLBS(pVM);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        CPUMSetChangedFlags(&pVM->aCpus[idCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+    pgmUnlock(pVM);
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Write protects all shadow page table entries in place.
+ *
+ * This is a cheaper alternative to pgmR3PoolClearAll for getting the guest to
+ * fault on writes to newly write monitored pages, as the shadow page tables
+ * are kept and only the write accesses have to be resynced.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void pgmR3PoolWriteProtectAll(PVM pVM)
+{
+    int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PoolWriteProtectAllRendezvous, NULL);
+    AssertRC(rc);
+}
+
+
+/**
+ * Harvests the hardware dirty flags of the nested page tables into the live
+ * save dirty page bitmap.
+ *
+ * The dirty flags of the EPT and AMD-V nested page table entries are cleared
+ * and the bits of the pages they map are set in LiveSave.pbmHwDirtyR3.  All
+ * TLBs are flushed if anything was found, so the CPUs set the dirty flags
+ * again on the next write.
+ *
+ * @returns The number of dirty flags harvested.
+ * @param   pVM         The cross context VM structure.
+ *
+ * @remarks The caller must own the PGM lock and make sure none of the EMTs is
+ *          executing guest code, i.e. be in a rendezvous or have the VM
+ *          suspended.
+ */
+uint32_t pgmR3PoolHarvestDirtyBits(PVM pVM)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    Assert(pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS);
+    uint64_t       *pbmDirty  = pVM->pgm.s.LiveSave.pbmHwDirtyR3;
+    uint32_t const  cBits     = pVM->pgm.s.LiveSave.cHwDirtyBits;
+    uint32_t        cHarvested = 0;
+
+    PPGMPOOL pPool = pVM->pgm.s.CTX_SUFF(pPool);
+    unsigned cLeft = pPool->cUsedPages;
+    unsigned iPage = pPool->cCurPages;
+    while (--iPage >= PGMPOOL_IDX_FIRST)
+    {
+        PPGMPOOLPAGE pPage = &pPool->aPages[iPage];
+        if (pPage->GCPhys != NIL_RTGCPHYS)
+        {
+            if (pPage->cPresent)
+            {
+                RTGCPHYS const GCPhysA20Mask = pPage->fA20Enabled ? UINT64_MAX : ~RT_BIT_64(20);
+                switch (pPage->enmKind)
+                {
+                    /*
+                     * Only the nested page tables have their dirty flags set by the CPU.
+                     */
+                    case PGMPOOLKIND_EPT_PT_FOR_PHYS:
+                    {
+                        PEPTPT pPT = (PEPTPT)PGMPOOL_PAGE_2_PTR(pVM, pPage);
+                        for (unsigned iShw = pPage->iFirstPresent; iShw < RT_ELEMENTS(pPT->a); iShw++)
+                            if (   pPT->a[iShw].n.u1Present
+                                && (pPT->a[iShw].u & EPT_E_DIRTY))
+                            {
+                                uint64_t const iBit = ((pPage->GCPhys + ((RTGCPHYS)iShw << PAGE_SHIFT)) & GCPhysA20Mask) >> PAGE_SHIFT;
+                                if (iBit < cBits)
+                                {
+                                    ASMAtomicWriteU64(&pPT->a[iShw].u, pPT->a[iShw].u & ~EPT_E_DIRTY);
+                                    ASMBitSet(pbmDirty, (int32_t)iBit);
+                                    cHarvested++;
+                                }
+                            }
+                        break;
+                    }
+
+                    case PGMPOOLKIND_PAE_PT_FOR_PHYS:
+                    {
+                        PPGMSHWPTPAE pPT = (PPGMSHWPTPAE)PGMPOOL_PAGE_2_PTR(pVM, pPage);
+                        for (unsigned iShw = pPage->iFirstPresent; iShw < RT_ELEMENTS(pPT->a); iShw++)
+                            if (   PGMSHWPTEPAE_IS_P(pPT->a[iShw])
+                                && PGMSHWPTEPAE_IS_D(pPT->a[iShw]))
+                            {
+                                uint64_t const iBit = ((pPage->GCPhys + ((RTGCPHYS)iShw << PAGE_SHIFT)) & GCPhysA20Mask) >> PAGE_SHIFT;
+                                if (iBit < cBits)
+                                {
+                                    PGMSHWPTEPAE_ATOMIC_SET(pPT->a[iShw], PGMSHWPTEPAE_GET_U(pPT->a[iShw]) & ~(X86PGPAEUINT)X86_PTE_D);
+                                    ASMBitSet(pbmDirty, (int32_t)iBit);
+                                    cHarvested++;
+                                }
+                            }
+                        break;
+                    }
+
+                    default:
+                        break;
+                }
+            }
+            if (!--cLeft)
+                break;
+        }
+    }
+
+    if (cHarvested)
+        PGM_INVL_ALL_VCPU_TLBS(pVM);
+    pVM->pgm.s.LiveSave.cHwDirtyHarvested += cHarvested;
+    return cHarvested;
+}
+
+
+/**
+ * @callback_method_impl{FNVMMEMTRENDEZVOUS,
+ *      Worker for pgmR3PoolHarvestDirtyBitsAll.}
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolHarvestDirtyBitsRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    RT_NOREF(pVCpu, pvUser);
+
+    pgmLock(pVM);
+    pgmR3PoolHarvestDirtyBits(pVM);
+    pgmUnlock(pVM);
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Harvests the hardware dirty flags of the nested page tables while the VM is
+ * running, see pgmR3PoolHarvestDirtyBits.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+int pgmR3PoolHarvestDirtyBitsAll(PVM pVM)
+{
+    return VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PoolHarvestDirtyBitsRendezvous, NULL);
+}
+
+
 #ifdef VBOX_WITH_DEBUGGER
 /**
  * @callback_method_impl{FNDBGCCMD, The '.pgmpoolcheck' command.}
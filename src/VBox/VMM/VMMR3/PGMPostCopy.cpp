@@ -0,0 +1,1034 @@
+/* $Id$ */
+/** @file
+ * PGM - Page Manager and Monitor, Post-copy live migration.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_pgm_post_copy  PGM Post-copy Live Migration
+ *
+ * The normal live save (pgmR3LiveExec / pgmR3LiveVote) is a pure pre-copy
+ * algorithm: RAM is sent while the VM is running until the dirty set is small
+ * enough to be sent within the maximum downtime.  A guest which dirties memory
+ * faster than the link can carry it never converges and the final pass ends
+ * up sending gigabytes while the VM is suspended.
+ *
+ * In post-copy mode (PGMR3PostCopyEnable on both sides) the live save only
+ * does a couple of passes to get the bulk of the memory over.  The final pass
+ * then records each RAM page that is still dirty as a
+ * PGM_STATE_REC_RAM_POST_COPY record without any content and the source keeps
+ * a bitmap of these pages.  The target marks the same pages in its bitmap
+ * while loading, which means the CPU and device state can be handed over
+ * after only transfering the page addresses.
+ *
+ * Before the target VM is resumed, PGMR3PostCopyTrgBegin covers the missing
+ * pages with ring-3 only ALL access handlers (pgmR3PostCopyTrgHandler),
+ * disabling the handler for pages in the covered runs which are present.  The
+ * caller then feeds pages into PGMR3PostCopyTrgPutPage as they arrive from
+ * the source, which both answers demand requests made by the handler and
+ * pushes the remainder of the pages in the background
+ * (PGMR3PostCopySrcNextPage).  Each page that arrives gets its access
+ * handler disabled, and when all have arrived PGMR3PostCopyEnd deregisters the
+ * handlers.
+ *
+ * Pages arriving on the receiving thread are copied directly when they are
+ * already backed by a private page.  Pages which require allocation (zero and
+ * shared pages) can only be installed on an EMT and are queued on a deferred
+ * list, which is drained by the EMTs waiting in the access handler and by a
+ * no-wait request for pages nobody is waiting on.
+ *
+ * Threads other than EMTs (device I/O threads doing DMA) wait on one of a
+ * few extra waiter slots and rely on the no-wait request for getting deferred
+ * pages installed.  PGMPhysGCPhys2CCPtr and friends bypass the access handlers,
+ * so they call pgmR3PostCopyTrgEnsurePage to get the page before mapping it.
+ *
+ * If the post-copy phase fails (connection lost), the target cannot continue
+ * since parts of its memory are lost for good.  The access handlers are left
+ * in place, any waiting EMTs are released with dummy data and the caller is
+ * expected to power off the VM.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_PGM
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/nem.h>
+#include <VBox/vmm/vmm.h>
+#include <VBox/vmm/uvm.h>
+#include "PGMInternal.h"
+#include <VBox/vmm/vm.h>
+#include "PGMInline.h"
+
+#include <VBox/param.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The number of waiter slots for threads other than EMTs. */
+#define PGM_POST_COPY_OTHER_WAITERS     8
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * A page received from the source which could not be installed by the
+ * receiving thread because the page needs allocating.
+ */
+typedef struct PGMPOSTCOPYDEFERRED
+{
+    /** Node in PGMPOSTCOPY::DeferredList. */
+    RTLISTNODE          ListEntry;
+    /** The guest physical address of the page. */
+    RTGCPHYS            GCPhys;
+    /** The page content. */
+    uint8_t             abPage[PAGE_SIZE];
+} PGMPOSTCOPYDEFERRED;
+/** Pointer to a deferred post-copy page. */
+typedef PGMPOSTCOPYDEFERRED *PPGMPOSTCOPYDEFERRED;
+
+
+/**
+ * State for a thread waiting on a missing page.
+ *
+ * There is one per virtual CPU followed by PGM_POST_COPY_OTHER_WAITERS slots
+ * for other threads.
+ */
+typedef struct PGMPOSTCOPYWAITER
+{
+    /** The page the thread is waiting for, NIL_RTGCPHYS if not waiting. */
+    RTGCPHYS volatile   GCPhys;
+    /** Event semaphore the thread is waiting on. */
+    RTSEMEVENT          hEvt;
+    /** Set while a thread other than an EMT owns the slot. */
+    bool volatile       fInUse;
+} PGMPOSTCOPYWAITER;
+/** Pointer to a post-copy waiter. */
+typedef PGMPOSTCOPYWAITER *PPGMPOSTCOPYWAITER;
+
+
+/**
+ * The post-copy page tracking state.
+ *
+ * Hangs off PGM::LiveSave::pPostCopyR3.
+ */
+typedef struct PGMPOSTCOPY
+{
+    /** Set on the target side once PGMR3PostCopyTrgBegin has been called. */
+    bool                fTarget;
+    /** Set when the post-copy phase was abandoned with pages still missing. */
+    bool volatile       fAborted;
+    /** Set while a no-wait request for draining the deferred list is queued. */
+    bool volatile       fDeferredReqQueued;
+    /** The size of the bitmap in bits (multiple of 64). */
+    uint32_t            cPages;
+    /** The number of pages still pending. */
+    uint32_t volatile   cPending;
+    /** Source: The next bit to look at in PGMR3PostCopySrcNextPage. */
+    uint32_t            iNextPush;
+    /** Bitmap of the pending pages, indexed by guest page frame number. */
+    uint32_t           *pbmPending;
+
+    /** @name Target side.
+     * @{ */
+    /** The callback for requesting a missing page. */
+    PFNPGMPOSTCOPYFETCH pfnFetch;
+    /** The user argument for pfnFetch. */
+    void               *pvFetchUser;
+    /** The access handler type covering the missing pages. */
+    PGMPHYSHANDLERTYPE  hHandlerType;
+    /** The number of registered access handlers (runs). */
+    uint32_t            cRuns;
+    /** The number of entries allocated for paGCPhysRuns. */
+    uint32_t            cRunsAlloc;
+    /** The start addresses of the registered access handlers. */
+    PRTGCPHYS           paGCPhysRuns;
+    /** Pages that need installing on an EMT (PGMPOSTCOPYDEFERRED), protected
+     * by the PGM lock. */
+    RTLISTANCHOR        DeferredList;
+    /** The number of pages fetched on demand. */
+    uint32_t volatile   cDemandFetches;
+    /** The number of pages which had to be deferred to an EMT. */
+    uint32_t volatile   cDeferred;
+    /** The nanosecond timestamp of PGMR3PostCopyTrgBegin. */
+    uint64_t            nsStart;
+    /** The number of threads in pgmR3PostCopyTrgEnsurePage past the check for
+     * a missing page.  pgmR3PostCopyDestroy waits for this to drop to zero. */
+    uint32_t volatile   cBusy;
+    /** The number of waiters (cCpus + PGM_POST_COPY_OTHER_WAITERS). */
+    uint32_t            cWaiters;
+    /** Per virtual CPU waiter state followed by the slots for other threads. */
+    PGMPOSTCOPYWAITER   aWaiters[1];
+    /** @} */
+} PGMPOSTCOPY;
+/** Pointer to the post-copy page tracking state. */
+typedef PGMPOSTCOPY *PPGMPOSTCOPY;
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+static DECLCALLBACK(void) pgmR3PostCopyTrgInstallDeferred(PVM pVM);
+
+
+/**
+ * Creates the post-copy page tracking state.
+ *
+ * The bitmap covers all the RAM ranges currently registered.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+static int pgmR3PostCopyCreate(PVM pVM)
+{
+    pgmLock(pVM);
+    RTGCPHYS GCPhysLast = 0;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+        if (   !PGM_RAM_RANGE_IS_AD_HOC(pRam)
+            && pRam->GCPhysLast > GCPhysLast)
+            GCPhysLast = pRam->GCPhysLast;
+    pgmUnlock(pVM);
+
+    uint64_t const cPages = RT_ALIGN_64((GCPhysLast >> PAGE_SHIFT) + 1, 64);
+    AssertLogRelMsgReturn(cPages < UINT32_MAX / 2, ("GCPhysLast=%RGp\n", GCPhysLast), VERR_OUT_OF_RANGE);
+
+    uint32_t const cWaiters  = pVM->cCpus + PGM_POST_COPY_OTHER_WAITERS;
+    PPGMPOSTCOPY   pPostCopy = (PPGMPOSTCOPY)MMR3HeapAllocZ(pVM, MM_TAG_PGM, RT_OFFSETOF(PGMPOSTCOPY, aWaiters[cWaiters]));
+    if (!pPostCopy)
+        return VERR_NO_MEMORY;
+    pPostCopy->pbmPending = (uint32_t *)RTMemAllocZ(cPages / 8);
+    if (!pPostCopy->pbmPending)
+    {
+        MMR3HeapFree(pPostCopy);
+        return VERR_NO_MEMORY;
+    }
+    pPostCopy->cPages       = (uint32_t)cPages;
+    pPostCopy->hHandlerType = NIL_PGMPHYSHANDLERTYPE;
+    pPostCopy->cWaiters     = cWaiters;
+    RTListInit(&pPostCopy->DeferredList);
+    for (uint32_t i = 0; i < cWaiters; i++)
+    {
+        pPostCopy->aWaiters[i].GCPhys = NIL_RTGCPHYS;
+        pPostCopy->aWaiters[i].hEvt   = NIL_RTSEMEVENT;
+    }
+
+    pVM->pgm.s.LiveSave.pPostCopyR3 = pPostCopy;
+    LogRel(("PGM: Post-copy tracking of %u pages (up to %RGp)\n", pPostCopy->cPages, GCPhysLast));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys the post-copy page tracking state.
+ *
+ * The caller must make sure that the access handlers have been deregistered
+ * or are about to be destroyed together with the VM.  Threads which are still
+ * on their way out of pgmR3PostCopyTrgEnsurePage are waited for.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+static void pgmR3PostCopyDestroy(PVM pVM)
+{
+    pgmLock(pVM);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    pVM->pgm.s.LiveSave.pPostCopyR3 = NULL;
+    pgmUnlock(pVM);
+    if (!pPostCopy)
+        return;
+    while (ASMAtomicReadU32(&pPostCopy->cBusy) != 0)
+        RTThreadSleep(1);
+
+    PPGMPOSTCOPYDEFERRED pCur, pNext;
+    RTListForEachSafe(&pPostCopy->DeferredList, pCur, pNext, PGMPOSTCOPYDEFERRED, ListEntry)
+    {
+        RTListNodeRemove(&pCur->ListEntry);
+        RTMemFree(pCur);
+    }
+    for (uint32_t i = 0; i < pPostCopy->cWaiters; i++)
+        if (pPostCopy->aWaiters[i].hEvt != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pPostCopy->aWaiters[i].hEvt);
+            pPostCopy->aWaiters[i].hEvt = NIL_RTSEMEVENT;
+        }
+    RTMemFree(pPostCopy->paGCPhysRuns);
+    RTMemFree(pPostCopy->pbmPending);
+    MMR3HeapFree(pPostCopy);
+}
+
+
+/**
+ * Called by PGMR3Term to free any post-copy state left behind.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void pgmR3PostCopyTerm(PVM pVM)
+{
+    pgmR3PostCopyDestroy(pVM);
+}
+
+
+/**
+ * Marks a page as pending post-copy transfer.
+ *
+ * This is called by the final pass of the live save on the source and by the
+ * saved state loader on the target.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+int pgmR3PostCopyMarkPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    if (!pVM->pgm.s.LiveSave.pPostCopyR3)
+    {
+        int rc = pgmR3PostCopyCreate(pVM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+
+    RTGCPHYS const iPage = GCPhys >> PAGE_SHIFT;
+    AssertLogRelMsgReturn(iPage < pPostCopy->cPages, ("GCPhys=%RGp cPages=%#x\n", GCPhys, pPostCopy->cPages), VERR_OUT_OF_RANGE);
+    if (!ASMAtomicBitTestAndSet(pPostCopy->pbmPending, (int32_t)iPage))
+        ASMAtomicIncU32(&pPostCopy->cPending);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Enables or disables post-copy mode.
+ *
+ * On the source this must be called before VMR3Teleport and makes the final
+ * pass of the live save record the dirty RAM pages instead of sending them.
+ * On the target it must be called before VMR3LoadFromStream to make the loader
+ * accept such records.
+ *
+ * Any state left over from a previous post-copy operation is discarded.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   fEnable     Whether to enable or disable post-copy mode.
+ * @thread  Any, but the VM must not be saving or loading.
+ */
+VMMR3DECL(int) PGMR3PostCopyEnable(PUVM pUVM, bool fEnable)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    AssertReturn(!pPostCopy || !pPostCopy->fTarget || !pPostCopy->cRuns, VERR_WRONG_ORDER);
+    pgmR3PostCopyDestroy(pVM);
+
+    pVM->pgm.s.LiveSave.fPostCopy = fEnable;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the next page the source should push to the target.
+ *
+ * The page is removed from the pending set, use PGMR3PostCopySrcReadPage to
+ * get the content.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_EOF if there are no more pending pages.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pGCPhys     Where to return the guest physical address of the page.
+ * @thread  Any, but the caller must serialize the source side calls.
+ */
+VMMR3DECL(int) PGMR3PostCopySrcNextPage(PUVM pUVM, PRTGCPHYS pGCPhys)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pGCPhys, VERR_INVALID_POINTER);
+    *pGCPhys = NIL_RTGCPHYS;
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    if (!pPostCopy)
+        return VINF_EOF;
+    AssertReturn(!pPostCopy->fTarget, VERR_WRONG_ORDER);
+
+    while (pPostCopy->iNextPush < pPostCopy->cPages)
+    {
+        int iBit = pPostCopy->iNextPush == 0
+                 ? ASMBitFirstSet(pPostCopy->pbmPending, pPostCopy->cPages)
+                 : ASMBitNextSet(pPostCopy->pbmPending, pPostCopy->cPages, pPostCopy->iNextPush - 1);
+        if (iBit < 0)
+            break;
+        pPostCopy->iNextPush = (uint32_t)iBit + 1;
+        if (ASMAtomicBitTestAndClear(pPostCopy->pbmPending, iBit))
+        {
+            ASMAtomicDecU32(&pPostCopy->cPending);
+            *pGCPhys = (RTGCPHYS)iBit << PAGE_SHIFT;
+            return VINF_SUCCESS;
+        }
+    }
+    pPostCopy->iNextPush = pPostCopy->cPages;
+    return VINF_EOF;
+}
+
+
+/**
+ * Reads a page on the source, removing it from the pending set.
+ *
+ * This is used both for pushing pages and for answering demand requests from
+ * the target.  The VM must be suspended.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   GCPhys      The guest physical address of the page.
+ * @param   pvPage      Where to return the page content (PAGE_SIZE bytes).
+ * @thread  Any, but the caller must serialize the source side calls.
+ */
+VMMR3DECL(int) PGMR3PostCopySrcReadPage(PUVM pUVM, RTGCPHYS GCPhys, void *pvPage)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertReturn(!(GCPhys & PAGE_OFFSET_MASK), VERR_INVALID_PARAMETER);
+    AssertPtrReturn(pvPage, VERR_INVALID_POINTER);
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    AssertReturn(pPostCopy, VERR_WRONG_ORDER);
+    AssertReturn(!pPostCopy->fTarget, VERR_WRONG_ORDER);
+    RTGCPHYS const iPage = GCPhys >> PAGE_SHIFT;
+    AssertMsgReturn(iPage < pPostCopy->cPages, ("GCPhys=%RGp\n", GCPhys), VERR_OUT_OF_RANGE);
+
+    if (ASMAtomicBitTestAndClear(pPostCopy->pbmPending, (int32_t)iPage))
+        ASMAtomicDecU32(&pPostCopy->cPending);
+    return PGMPhysSimpleReadGCPhys(pVM, pvPage, GCPhys, PAGE_SIZE);
+}
+
+
+/**
+ * Wakes up any thread waiting for the given page.
+ *
+ * @param   pPostCopy   The post-copy state.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static void pgmR3PostCopyTrgWakeUp(PPGMPOSTCOPY pPostCopy, RTGCPHYS GCPhys)
+{
+    for (uint32_t i = 0; i < pPostCopy->cWaiters; i++)
+        if (ASMAtomicReadU64(&pPostCopy->aWaiters[i].GCPhys) == GCPhys)
+            RTSemEventSignal(pPostCopy->aWaiters[i].hEvt);
+}
+
+
+/**
+ * Disables the access handler for a page that's present.
+ *
+ * This is PGMHandlerPhysicalPageTempOff without the handler lookup and
+ * validation.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pHandler    The handler covering the page.
+ * @param   pPage       The page.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static void pgmR3PostCopyTrgPageTempOff(PVM pVM, PPGMPHYSHANDLER pHandler, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (PGM_PAGE_GET_HNDL_PHYS_STATE(pPage) != PGM_PAGE_HNDL_PHYS_STATE_DISABLED)
+    {
+        PGM_PAGE_SET_HNDL_PHYS_STATE(pPage, PGM_PAGE_HNDL_PHYS_STATE_DISABLED);
+        pHandler->cTmpOffPages++;
+        if (VM_IS_NEM_ENABLED(pVM))
+        {
+            uint8_t     u2State = PGM_PAGE_GET_NEM_STATE(pPage);
+            PGMPAGETYPE enmType = (PGMPAGETYPE)PGM_PAGE_GET_TYPE(pPage);
+            NEMHCNotifyPhysPageProtChanged(pVM, GCPhys, PGM_PAGE_GET_HCPHYS(pPage),
+                                           pgmPhysPageCalcNemProtection(pPage, enmType), enmType, &u2State);
+            PGM_PAGE_SET_NEM_STATE(pPage, u2State);
+        }
+    }
+}
+
+
+/**
+ * Completes the installation of a page on the target.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pPostCopy   The post-copy state.
+ * @param   pPage       The page.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static void pgmR3PostCopyTrgPageDone(PVM pVM, PPGMPOSTCOPY pPostCopy, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (ASMAtomicBitTestAndClear(pPostCopy->pbmPending, (int32_t)(GCPhys >> PAGE_SHIFT)))
+    {
+        PPGMPHYSHANDLER pHandler = pgmHandlerPhysicalLookup(pVM, GCPhys);
+        AssertLogRelMsg(pHandler, ("GCPhys=%RGp\n", GCPhys));
+        if (pHandler)
+            pgmR3PostCopyTrgPageTempOff(pVM, pHandler, pPage, GCPhys);
+        ASMAtomicDecU32(&pPostCopy->cPending);
+    }
+}
+
+
+/**
+ * Installs the pages on the deferred list.
+ *
+ * This is called by EMTs waiting in the access handler and as a no-wait
+ * request when nobody is waiting for the deferred pages.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @thread  EMT
+ */
+static DECLCALLBACK(void) pgmR3PostCopyTrgInstallDeferred(PVM pVM)
+{
+    VM_ASSERT_EMT(pVM);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    if (!pPostCopy)
+        return;
+    ASMAtomicWriteBool(&pPostCopy->fDeferredReqQueued, false);
+
+    for (;;)
+    {
+        pgmLock(pVM);
+        PPGMPOSTCOPYDEFERRED pDeferred = RTListRemoveFirst(&pPostCopy->DeferredList, PGMPOSTCOPYDEFERRED, ListEntry);
+        pgmUnlock(pVM);
+        if (!pDeferred)
+            break;
+
+        RTGCPHYS const GCPhys = pDeferred->GCPhys;
+        if (ASMBitTest(pPostCopy->pbmPending, (int32_t)(GCPhys >> PAGE_SHIFT)))
+        {
+            /* This ignores access handlers and allocates the page as needed. */
+            int rc = PGMPhysSimpleWriteGCPhys(pVM, GCPhys, pDeferred->abPage, PAGE_SIZE);
+            if (RT_SUCCESS(rc))
+            {
+                pgmLock(pVM);
+                PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhys);
+                if (pPage)
+                    pgmR3PostCopyTrgPageDone(pVM, pPostCopy, pPage, GCPhys);
+                pgmUnlock(pVM);
+            }
+            else
+            {
+                LogRel(("PGM: Post-copy failed to install page %RGp: %Rrc\n", GCPhys, rc));
+                ASMAtomicWriteBool(&pPostCopy->fAborted, true);
+            }
+            pgmR3PostCopyTrgWakeUp(pPostCopy, GCPhys);
+        }
+        RTMemFree(pDeferred);
+    }
+}
+
+
+/**
+ * Waits for a missing page to arrive.
+ *
+ * EMTs install deferred pages themselves while waiting, other threads depend
+ * on the no-wait request queued by PGMR3PostCopyTrgPutPage for that.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_POST_COPY_ABORTED if the post-copy phase was abandoned.
+ * @param   pVM         The cross context VM structure.
+ * @param   pVCpu       The cross context virtual CPU structure of the calling
+ *                      EMT, NULL if not called on an EMT.
+ * @param   pPostCopy   The post-copy state.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static int pgmR3PostCopyTrgWaitForPage(PVM pVM, PVMCPU pVCpu, PPGMPOSTCOPY pPostCopy, RTGCPHYS GCPhys)
+{
+    int32_t const iPage = (int32_t)(GCPhys >> PAGE_SHIFT);
+    if (!ASMBitTest(pPostCopy->pbmPending, iPage))
+        return VINF_SUCCESS;
+
+    /* Pick the waiter slot.  Should all the slots for other threads be taken,
+       we poll instead of waiting on an event. */
+    PPGMPOSTCOPYWAITER pWaiter = NULL;
+    if (pVCpu)
+        pWaiter = &pPostCopy->aWaiters[pVCpu->idCpu];
+    else
+        for (uint32_t i = pVM->cCpus; i < pPostCopy->cWaiters; i++)
+            if (ASMAtomicCmpXchgBool(&pPostCopy->aWaiters[i].fInUse, true, false))
+            {
+                pWaiter = &pPostCopy->aWaiters[i];
+                break;
+            }
+    if (pWaiter)
+        ASMAtomicWriteU64(&pWaiter->GCPhys, GCPhys);
+
+    int  rc         = VINF_SUCCESS;
+    bool fRequested = false;
+    for (;;)
+    {
+        if (pVCpu)
+            pgmR3PostCopyTrgInstallDeferred(pVM);
+        if (!ASMBitTest(pPostCopy->pbmPending, iPage))
+            break;
+        if (ASMAtomicReadBool(&pPostCopy->fAborted))
+        {
+            rc = VERR_PGM_POST_COPY_ABORTED;
+            break;
+        }
+        if (!fRequested)
+        {
+            ASMAtomicIncU32(&pPostCopy->cDemandFetches);
+            rc = pPostCopy->pfnFetch(pVM->pUVM, GCPhys, pPostCopy->pvFetchUser);
+            if (RT_FAILURE(rc))
+                break;
+            fRequested = true;
+        }
+        /* The timeout is just paranoia, the receiver signals us. */
+        if (pWaiter)
+            RTSemEventWait(pWaiter->hEvt, 1000);
+        else
+            RTThreadSleep(1);
+    }
+
+    if (pWaiter)
+    {
+        ASMAtomicWriteU64(&pWaiter->GCPhys, NIL_RTGCPHYS);
+        if (!pVCpu)
+            ASMAtomicWriteBool(&pWaiter->fInUse, false);
+    }
+    return rc;
+}
+
+
+/**
+ * Makes sure a page has arrived from the source before it is accessed
+ * without going thru the access handlers.
+ *
+ * This is used by the page mapping APIs, it's a no-op unless this is the
+ * target of a post-copy operation and the page is still missing.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_POST_COPY_ABORTED if the post-copy phase was abandoned.
+ * @retval  VERR_PGM_POST_COPY_PAGE_MISSING if the page is missing and the
+ *          caller owns the PGM lock, which means we cannot wait for it.
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address.
+ * @thread  Any.
+ */
+int pgmR3PostCopyTrgEnsurePage(PVM pVM, RTGCPHYS GCPhys)
+{
+    RTGCPHYS const iPage      = GCPhys >> PAGE_SHIFT;
+    bool const     fLockOwner = PGMIsLockOwner(pVM);
+    pgmLock(pVM);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    if (   !pPostCopy
+        || !pPostCopy->fTarget
+        || iPage >= pPostCopy->cPages
+        || !ASMBitTest(pPostCopy->pbmPending, (int32_t)iPage))
+    {
+        pgmUnlock(pVM);
+        return VINF_SUCCESS;
+    }
+    if (fLockOwner)
+    {
+        pgmUnlock(pVM);
+        return VERR_PGM_POST_COPY_PAGE_MISSING;
+    }
+    ASMAtomicIncU32(&pPostCopy->cBusy);
+    pgmUnlock(pVM);
+
+    int rc = pgmR3PostCopyTrgWaitForPage(pVM, VMMGetCpu(pVM), pPostCopy, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+
+    ASMAtomicDecU32(&pPostCopy->cBusy);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPHYSHANDLER,
+ *      Access handler for RAM pages which haven't arrived from the source yet.}
+ *
+ * @remarks The @a pvUser argument points to the PGMPOSTCOPY structure.  This
+ *          is called without the PGM lock, on EMTs as well as other threads.
+ */
+static DECLCALLBACK(VBOXSTRICTRC)
+pgmR3PostCopyTrgHandler(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                        PGMACCESSTYPE enmAccessType, PGMACCESSORIGIN enmOrigin, void *pvUser)
+{
+    Log5(("pgmR3PostCopyTrgHandler: %c %RGp LB %#zx\n", enmAccessType == PGMACCESSTYPE_READ ? 'R' : 'W', GCPhys, cbBuf));
+    NOREF(pVCpu); NOREF(pvPhys); NOREF(enmOrigin); NOREF(pvUser);
+
+    /* Go via the VM structure rather than pvUser, this may be called on any
+       thread and the state is only safe to use under the PGM lock. */
+    int rc = pgmR3PostCopyTrgEnsurePage(pVM, GCPhys);
+    if (RT_FAILURE(rc))
+    {
+        LogRelMax(32, ("PGM: Post-copy access to missing page %RGp failed: %Rrc\n", GCPhys, rc));
+        if (enmAccessType == PGMACCESSTYPE_READ)
+            memset(pvBuf, 0xff, cbBuf);
+        return VINF_SUCCESS;
+    }
+
+    /* The write mapping PGM passed us is the page the content was written to. */
+    if (enmAccessType == PGMACCESSTYPE_WRITE)
+        return VINF_PGM_HANDLER_DO_DEFAULT;
+
+    /* The read mapping may be the zero page which has since been replaced. */
+    rc = PGMPhysSimpleReadGCPhys(pVM, pvBuf, GCPhys, cbBuf);
+    AssertLogRelMsgStmt(RT_SUCCESS(rc), ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc), memset(pvBuf, 0xff, cbBuf));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Registers an access handler for a run of pages and disables it for the
+ * pages in the run which are present.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pPostCopy   The post-copy state.
+ * @param   pRam        The RAM range containing the run.
+ * @param   iFirst      The index of the first page in the run.
+ * @param   iLast       The index of the last page in the run.
+ */
+static int pgmR3PostCopyTrgAddRun(PVM pVM, PPGMPOSTCOPY pPostCopy, PPGMRAMRANGE pRam, uint32_t iFirst, uint32_t iLast)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (pPostCopy->cRuns >= pPostCopy->cRunsAlloc)
+    {
+        uint32_t  cNew = pPostCopy->cRunsAlloc ? pPostCopy->cRunsAlloc * 2 : 16;
+        PRTGCPHYS paNew = (PRTGCPHYS)RTMemRealloc(pPostCopy->paGCPhysRuns, cNew * sizeof(RTGCPHYS));
+        if (!paNew)
+            return VERR_NO_MEMORY;
+        pPostCopy->paGCPhysRuns = paNew;
+        pPostCopy->cRunsAlloc   = cNew;
+    }
+
+    RTGCPHYS const GCPhysFirst = pRam->GCPhys + ((RTGCPHYS)iFirst << PAGE_SHIFT);
+    RTGCPHYS const GCPhysLast  = pRam->GCPhys + ((RTGCPHYS)iLast  << PAGE_SHIFT) + PAGE_OFFSET_MASK;
+    int rc = PGMHandlerPhysicalRegister(pVM, GCPhysFirst, GCPhysLast, pPostCopy->hHandlerType,
+                                        pPostCopy, NIL_RTR0PTR, NIL_RTRCPTR, "Post-copy RAM");
+    AssertLogRelMsgRCReturn(rc, ("%RGp-%RGp: %Rrc\n", GCPhysFirst, GCPhysLast, rc), rc);
+    pPostCopy->paGCPhysRuns[pPostCopy->cRuns++] = GCPhysFirst;
+
+    PPGMPHYSHANDLER pHandler = pgmHandlerPhysicalLookup(pVM, GCPhysFirst);
+    AssertReturn(pHandler, VERR_PGM_PHYS_HANDLER_IPE);
+    uint32_t const iBitBase = (uint32_t)(pRam->GCPhys >> PAGE_SHIFT);
+    for (uint32_t iPage = iFirst; iPage <= iLast; iPage++)
+        if (!ASMBitTest(pPostCopy->pbmPending, (int32_t)(iBitBase + iPage)))
+            pgmR3PostCopyTrgPageTempOff(pVM, pHandler, &pRam->aPages[iPage], pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+
+    Log(("pgmR3PostCopyTrgAddRun: %RGp-%RGp\n", GCPhysFirst, GCPhysLast));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Checks whether a page can be covered by a post-copy access handler.
+ *
+ * @returns true if it can, false if not.
+ * @param   pPage       The page.
+ */
+DECLINLINE(bool) pgmR3PostCopyTrgIsPageEligible(PCPGMPAGE pPage)
+{
+    return PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM
+        && !PGM_PAGE_HAS_ANY_PHYSICAL_HANDLERS(pPage);
+}
+
+
+/**
+ * @callback_method_impl{FNVMMEMTRENDEZVOUS,
+ *      Worker for PGMR3PostCopyTrgBegin.}
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PostCopyTrgBeginRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    PPGMPOSTCOPY pPostCopy = (PPGMPOSTCOPY)pvUser;
+    NOREF(pVCpu);
+
+    int rc = PGMR3HandlerPhysicalTypeRegister(pVM, PGMPHYSHANDLERKIND_ALL, pgmR3PostCopyTrgHandler,
+                                              NULL, NULL, NULL, NULL, NULL, NULL,
+                                              "Post-copy RAM", &pPostCopy->hHandlerType);
+    AssertLogRelRCReturn(rc, rc);
+
+    /*
+     * Cover the missing pages with as few handlers as possible: a run extends
+     * from a missing page to the last missing page before the next page which
+     * isn't plain RAM or already has a handler (ROM, MMIO2 and the like).
+     */
+    pgmLock(pVM);
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam && RT_SUCCESS(rc); pRam = pRam->pNextR3)
+    {
+        if (PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            continue;
+        uint32_t const cRamPages = (uint32_t)(pRam->cb >> PAGE_SHIFT);
+        uint32_t const iBitBase  = (uint32_t)(pRam->GCPhys >> PAGE_SHIFT);
+        AssertBreakStmt(iBitBase + cRamPages <= pPostCopy->cPages, rc = VERR_PGM_PHYS_HANDLER_IPE);
+
+        uint32_t iPage = 0;
+        while (iPage < cRamPages)
+        {
+            if (!ASMBitTest(pPostCopy->pbmPending, (int32_t)(iBitBase + iPage)))
+            {
+                iPage++;
+                continue;
+            }
+            AssertLogRelMsgBreakStmt(pgmR3PostCopyTrgIsPageEligible(&pRam->aPages[iPage]),
+                                     ("%RGp %R[pgmpage]\n", pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT), &pRam->aPages[iPage]),
+                                     rc = VERR_PGM_HANDLER_PHYSICAL_CONFLICT);
+
+            uint32_t const iFirst = iPage;
+            uint32_t       iLast  = iPage;
+            while (   ++iPage < cRamPages
+                   && pgmR3PostCopyTrgIsPageEligible(&pRam->aPages[iPage]))
+                if (ASMBitTest(pPostCopy->pbmPending, (int32_t)(iBitBase + iPage)))
+                    iLast = iPage;
+
+            rc = pgmR3PostCopyTrgAddRun(pVM, pPostCopy, pRam, iFirst, iLast);
+            if (RT_FAILURE(rc))
+                break;
+        }
+    }
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * Starts the post-copy phase on the target.
+ *
+ * This must be called after the saved state has been loaded and before the VM
+ * is resumed.  It covers all the pages which the loader found missing with an
+ * access handler that requests them from the source via @a pfnFetch.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pfnFetch    Callback for requesting a missing page.  This is called
+ *                      on the EMT accessing the page and must not block on
+ *                      the page arriving.
+ * @param   pvUser      User argument for @a pfnFetch.
+ * @param   pcPages     Where to return the number of missing pages.  When zero,
+ *                      there is nothing to do and PGMR3PostCopyEnd can be
+ *                      called right away.
+ * @thread  Any, but the VM must be suspended.
+ */
+VMMR3DECL(int) PGMR3PostCopyTrgBegin(PUVM pUVM, PFNPGMPOSTCOPYFETCH pfnFetch, void *pvUser, uint32_t *pcPages)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pfnFetch, VERR_INVALID_POINTER);
+    AssertPtrReturn(pcPages, VERR_INVALID_POINTER);
+    *pcPages = 0;
+    AssertReturn(pVM->pgm.s.LiveSave.fPostCopy, VERR_WRONG_ORDER);
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    if (!pPostCopy || !pPostCopy->cPending)
+        return VINF_SUCCESS;
+    AssertReturn(!pPostCopy->fTarget, VERR_WRONG_ORDER);
+
+    pPostCopy->fTarget     = true;
+    pPostCopy->pfnFetch    = pfnFetch;
+    pPostCopy->pvFetchUser = pvUser;
+    pPostCopy->nsStart     = RTTimeNanoTS();
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < pPostCopy->cWaiters && RT_SUCCESS(rc); i++)
+        rc = RTSemEventCreate(&pPostCopy->aWaiters[i].hEvt);
+    if (RT_SUCCESS(rc))
+        rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PostCopyTrgBeginRendezvous, pPostCopy);
+    if (RT_SUCCESS(rc))
+    {
+        *pcPages = pPostCopy->cPending;
+        LogRel(("PGM: Post-copy started with %u missing pages in %u runs\n", pPostCopy->cPending, pPostCopy->cRuns));
+    }
+    return rc;
+}
+
+
+/**
+ * Installs a page received from the source.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   GCPhys      The guest physical address of the page.
+ * @param   pvPage      The page content (PAGE_SIZE bytes), NULL for a page
+ *                      filled with zeros.
+ * @param   pcLeft      Where to return the number of pages still missing.
+ *                      Optional.
+ * @thread  Any but EMTs, the receiving thread.
+ */
+VMMR3DECL(int) PGMR3PostCopyTrgPutPage(PUVM pUVM, RTGCPHYS GCPhys, void const *pvPage, uint32_t *pcLeft)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_OTHER_THREAD(pVM);
+    AssertReturn(!(GCPhys & PAGE_OFFSET_MASK), VERR_INVALID_PARAMETER);
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    AssertReturn(pPostCopy && pPostCopy->fTarget, VERR_WRONG_ORDER);
+    RTGCPHYS const iPage = GCPhys >> PAGE_SHIFT;
+    AssertMsgReturn(iPage < pPostCopy->cPages, ("GCPhys=%RGp\n", GCPhys), VERR_OUT_OF_RANGE);
+
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    if (ASMBitTest(pPostCopy->pbmPending, (int32_t)iPage)) /* duplicates are normal (demand vs. push) */
+    {
+        PPGMPAGE pPage;
+        rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+        if (RT_SUCCESS(rc))
+        {
+            /*
+             * Private pages can be written right away, like PGMR3PhysWriteExternal
+             * does.  Zero pages stay as they are if the content is zero too,
+             * everything else must be done on an EMT.
+             */
+            if (PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED)
+            {
+                PGMPAGEMAPLOCK PgMpLck;
+                void          *pvDst;
+                rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDst, &PgMpLck);
+                if (RT_SUCCESS(rc))
+                {
+                    if (pvPage)
+                        memcpy(pvDst, pvPage, PAGE_SIZE);
+                    else
+                        ASMMemZeroPage(pvDst);
+                    pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                    pgmR3PostCopyTrgPageDone(pVM, pPostCopy, pPage, GCPhys);
+                }
+            }
+            else if (!pvPage && PGM_PAGE_IS_ZERO(pPage))
+                pgmR3PostCopyTrgPageDone(pVM, pPostCopy, pPage, GCPhys);
+            else
+            {
+                PPGMPOSTCOPYDEFERRED pDeferred = (PPGMPOSTCOPYDEFERRED)RTMemAlloc(sizeof(*pDeferred));
+                if (pDeferred)
+                {
+                    pDeferred->GCPhys = GCPhys;
+                    if (pvPage)
+                        memcpy(pDeferred->abPage, pvPage, PAGE_SIZE);
+                    else
+                        RT_ZERO(pDeferred->abPage);
+                    RTListAppend(&pPostCopy->DeferredList, &pDeferred->ListEntry);
+                    ASMAtomicIncU32(&pPostCopy->cDeferred);
+                    pgmUnlock(pVM);
+
+                    if (!ASMAtomicXchgBool(&pPostCopy->fDeferredReqQueued, true))
+                    {
+                        rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyTrgInstallDeferred, 1, pVM);
+                        AssertRC(rc);
+                    }
+                    pgmR3PostCopyTrgWakeUp(pPostCopy, GCPhys);
+                    if (pcLeft)
+                        *pcLeft = ASMAtomicReadU32(&pPostCopy->cPending);
+                    return rc;
+                }
+                rc = VERR_NO_MEMORY;
+            }
+        }
+        AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc));
+    }
+    pgmUnlock(pVM);
+
+    pgmR3PostCopyTrgWakeUp(pPostCopy, GCPhys);
+    if (pcLeft)
+        *pcLeft = ASMAtomicReadU32(&pPostCopy->cPending);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNVMMEMTRENDEZVOUS,
+ *      Worker for PGMR3PostCopyEnd that deregisters the access handlers.}
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PostCopyTrgEndRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    PPGMPOSTCOPY pPostCopy = (PPGMPOSTCOPY)pvUser;
+    NOREF(pVCpu);
+
+    pgmR3PostCopyTrgInstallDeferred(pVM);
+
+    /* The handlers must stay if pages are still missing, they keep the guest
+       off the pages until the VM is powered off. */
+    int rc = VINF_SUCCESS;
+    if (ASMAtomicReadU32(&pPostCopy->cPending) != 0)
+        return rc;
+    while (pPostCopy->cRuns > 0)
+    {
+        int rc2 = PGMHandlerPhysicalDeregister(pVM, pPostCopy->paGCPhysRuns[--pPostCopy->cRuns]);
+        AssertLogRelRC(rc2);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    if (pPostCopy->hHandlerType != NIL_PGMPHYSHANDLERTYPE)
+    {
+        PGMHandlerPhysicalTypeRelease(pVM, pPostCopy->hHandlerType);
+        pPostCopy->hHandlerType = NIL_PGMPHYSHANDLERTYPE;
+    }
+    return rc;
+}
+
+
+/**
+ * Ends the post-copy phase, on either side.
+ *
+ * On the source this discards the pending page bitmap.  On the target this
+ * removes the access handlers if all pages have arrived.  If pages are still
+ * missing, the EMTs waiting for them are released and the VM must be powered
+ * off by the caller.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_POST_COPY_ABORTED if pages are still missing on the target.
+ * @param   pUVM        The user mode VM handle.
+ * @thread  Any but EMTs.
+ */
+VMMR3DECL(int) PGMR3PostCopyEnd(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+
+    int rc = VINF_SUCCESS;
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.LiveSave.pPostCopyR3;
+    if (pPostCopy && pPostCopy->fTarget)
+    {
+        /* Install whatever is still on the deferred list and drop the handlers. */
+        rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PostCopyTrgEndRendezvous, pPostCopy);
+        AssertLogRelRC(rc);
+        uint64_t const cMsElapsed = (RTTimeNanoTS() - pPostCopy->nsStart) / RT_NS_1MS;
+        if (ASMAtomicReadU32(&pPostCopy->cPending) == 0)
+            LogRel(("PGM: Post-copy completed after %RU64 ms; %u pages fetched on demand, %u deferred\n",
+                    cMsElapsed, pPostCopy->cDemandFetches, pPostCopy->cDeferred));
+        else
+        {
+            LogRel(("PGM: Post-copy aborted after %RU64 ms with %u pages missing!\n",
+                    cMsElapsed, ASMAtomicReadU32(&pPostCopy->cPending)));
+            ASMAtomicWriteBool(&pPostCopy->fAborted, true);
+            for (uint32_t i = 0; i < pPostCopy->cWaiters; i++)
+                RTSemEventSignal(pPostCopy->aWaiters[i].hEvt);
+            pVM->pgm.s.LiveSave.fPostCopy = false;
+            return VERR_PGM_POST_COPY_ABORTED;
+        }
+    }
+
+    pgmR3PostCopyDestroy(pVM);
+    pVM->pgm.s.LiveSave.fPostCopy = false;
+    return rc;
+}
+
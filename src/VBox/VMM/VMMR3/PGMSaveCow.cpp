@@ -0,0 +1,856 @@
+/* $Id$ */
+/** @file
+ * PGM - Page Manager and Monitor, Copy-on-write saving of RAM.
+ */
+
+/*
+ * Copyright (C) 2017 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_pgm_save_cow  PGM Copy-on-write Saving
+ *
+ * A live save (VMR3Save with fContinueAfterwards set) still has to suspend
+ * the VM for its final pass, and when the guest keeps dirtying memory that
+ * pass may end up writing a lot of RAM to disk while the VM is standing
+ * still.  A copy-on-write save (VMR3SaveCow) avoids this for RAM pages.
+ *
+ * The PGM unit asks SSM to defer the execution of its final pass
+ * (SSMR3HandleDeferFinalExec).  The final pass run by pgmR3SaveExec while
+ * the VM is suspended then only marks the dirty RAM pages in a bitmap
+ * (pgmR3SaveCowMarkPage) and covers them with ring-3 only write handlers
+ * (pgmR3SaveCowArm), disabling the handler for the unmarked pages in each
+ * run.  The rest of the PGM unit is saved at its usual position, ending with
+ * a PGM_STATE_REC_RAM_COW_TRAILER record, so the units are loaded in the same
+ * order as usual.  The VM is resumed after the other units have been saved and
+ * the caller completes the save via VMR3SaveCowComplete, which ends up in
+ * pgmR3SaveCowSavePages on a non-EMT thread writing the marked pages into a
+ * second final pass instance of the PGM unit at the end of the stream.  Until
+ * that instance has been loaded, the marked pages hold the content from the
+ * last live pass; pgmR3LoadDone fails the load if it is missing.
+ *
+ * When the guest writes to a marked page before it has been saved, the
+ * access handler (pgmR3SaveCowWriteHandler) copies the original content onto
+ * a queue, unmarks the page and disables the handler for it before the write
+ * is done.  The writer drains the queue and saves the pages still marked in
+ * the bitmap, so the saved state reflects the memory at the time the VM was
+ * suspended.  The queue is limited by the /PGM/LiveSaveCowBufferSize config
+ * value; the writing EMTs are throttled while it is full.  Before the writer
+ * has started, an EMT waits at most PGM_SAVE_COW_THROTTLE_IDLE_MS per page.
+ *
+ * Paths which access guest memory without consulting the access handlers
+ * (PGMPhysGCPhys2CCPtr, ballooning and resetting the VM) preserve the
+ * content up front (pgmR3SaveCowPreservePage, pgmR3SaveCowPreserveAll).
+ * PGMPhysSimpleWriteGCPhys goes thru PGMPhysGCPhys2CCPtr, and
+ * PGMR3PhysWriteExternal leaves pages with active handlers to PGMPhysWrite
+ * on an EMT.  Ring-0 cannot preserve anything, so a write from there bypassing
+ * the handlers sets PGM::LiveSave::fSaveCowBypassed and fails the save.
+ *
+ * The write handlers rely on the shadow paging code not using physical
+ * handlers of its own for RAM, so this mode is only used with nested paging.
+ * ROM, MMIO2 and RAM pages with handlers or mapping locks are saved while the
+ * VM is suspended like before.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_PGM
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/nem.h>
+#include <VBox/vmm/ssm.h>
+#include <VBox/vmm/vmm.h>
+#include "PGMInternal.h"
+#include <VBox/vmm/vm.h>
+#include "PGMInline.h"
+
+#include <VBox/param.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** Saved state record types, must match the ones in PGMSavedState.cpp.
+ * @{ */
+#define PGM_STATE_REC_RAM_ZERO          UINT8_C(0x00)
+#define PGM_STATE_REC_RAM_RAW           UINT8_C(0x01)
+#define PGM_STATE_REC_FLAG_ADDR         UINT8_C(0x80)
+/** @} */
+
+/** How long (ms) a writing EMT waits for room in the full queue before the
+ * writer has started, after which the page is copied anyway. */
+#define PGM_SAVE_COW_THROTTLE_IDLE_MS   1000
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * The original content of a page which was copied before it got modified.
+ */
+typedef struct PGMSAVECOWPAGE
+{
+    /** Node in PGMSAVECOW::CopyList. */
+    RTLISTNODE          ListEntry;
+    /** The guest physical address of the page. */
+    RTGCPHYS            GCPhys;
+    /** The page content. */
+    uint8_t             abPage[PAGE_SIZE];
+} PGMSAVECOWPAGE;
+/** Pointer to a copied page. */
+typedef PGMSAVECOWPAGE *PPGMSAVECOWPAGE;
+
+
+/**
+ * The copy-on-write save state.
+ *
+ * Hangs off PGM::LiveSave::pSaveCowR3.  Everything but the statistics is
+ * protected by the PGM lock.
+ */
+typedef struct PGMSAVECOW
+{
+    /** Set once the write handlers have been registered. */
+    bool                fArmed;
+    /** Set while pgmR3SaveCowSavePages is running. */
+    bool volatile       fWriterActive;
+    /** Set if the content of a page could not be preserved. */
+    bool volatile       fFailed;
+    /** Set by pgmR3SaveCowDone before removing the handlers, writing EMTs
+     * must no longer wait for the queue. */
+    bool volatile       fClosing;
+    /** The size of the bitmap in bits (multiple of 64). */
+    uint32_t            cPages;
+    /** The number of pages still to be saved from guest memory. */
+    uint32_t            cPending;
+    /** The next bit to look at in pgmR3SaveCowSavePages. */
+    uint32_t            iNext;
+    /** Bitmap of the pages which haven't been saved or copied yet, indexed by
+     * guest page frame number. */
+    uint32_t           *pbmPending;
+
+    /** The access handler type covering the pending pages. */
+    PGMPHYSHANDLERTYPE  hHandlerType;
+    /** The number of registered access handlers (runs). */
+    uint32_t            cRuns;
+    /** The number of entries allocated for paGCPhysRuns. */
+    uint32_t            cRunsAlloc;
+    /** The start addresses of the registered access handlers. */
+    PRTGCPHYS           paGCPhysRuns;
+
+    /** Pages copied before they got modified (PGMSAVECOWPAGE). */
+    RTLISTANCHOR        CopyList;
+    /** The number of entries on CopyList. */
+    uint32_t            cQueued;
+    /** The max number of entries on CopyList before throttling the guest. */
+    uint32_t            cMaxQueued;
+
+    /** @name Statistics.
+     * @{ */
+    /** The number of pages marked by the final pass. */
+    uint32_t            cMarked;
+    /** The number of pages copied by the write handler. */
+    uint32_t volatile   cCopiedOnWrite;
+    /** The number of pages copied because of accesses bypassing the handlers. */
+    uint32_t            cPreserved;
+    /** The number of times a writing EMT had to wait for the queue. */
+    uint32_t volatile   cThrottled;
+    /** The nanosecond timestamp of pgmR3SaveCowArm. */
+    uint64_t            nsArmed;
+    /** @} */
+} PGMSAVECOW;
+/** Pointer to the copy-on-write save state. */
+typedef PGMSAVECOW *PPGMSAVECOW;
+
+
+/**
+ * Creates the copy-on-write save state.
+ *
+ * The bitmap covers all the RAM ranges currently registered.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+static int pgmR3SaveCowCreate(PVM pVM)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    RTGCPHYS GCPhysLast = 0;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+        if (   !PGM_RAM_RANGE_IS_AD_HOC(pRam)
+            && pRam->GCPhysLast > GCPhysLast)
+            GCPhysLast = pRam->GCPhysLast;
+
+    uint64_t const cPages = RT_ALIGN_64((GCPhysLast >> PAGE_SHIFT) + 1, 64);
+    AssertLogRelMsgReturn(cPages < UINT32_MAX / 2, ("GCPhysLast=%RGp\n", GCPhysLast), VERR_OUT_OF_RANGE);
+
+    PPGMSAVECOW pSaveCow = (PPGMSAVECOW)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(*pSaveCow));
+    if (!pSaveCow)
+        return VERR_NO_MEMORY;
+    pSaveCow->pbmPending = (uint32_t *)RTMemAllocZ(cPages / 8);
+    if (!pSaveCow->pbmPending)
+    {
+        MMR3HeapFree(pSaveCow);
+        return VERR_NO_MEMORY;
+    }
+    pSaveCow->cPages       = (uint32_t)cPages;
+    pSaveCow->hHandlerType = NIL_PGMPHYSHANDLERTYPE;
+    pSaveCow->cMaxQueued   = RT_MAX(pVM->pgm.s.LiveSave.cSaveCowMaxQueued, 1);
+    RTListInit(&pSaveCow->CopyList);
+    ASMAtomicWriteBool(&pVM->pgm.s.LiveSave.fSaveCowBypassed, false);
+
+    pVM->pgm.s.LiveSave.pSaveCowR3 = pSaveCow;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys the copy-on-write save state.
+ *
+ * The caller must make sure that the access handlers have been deregistered
+ * or are about to be destroyed together with the VM.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+static void pgmR3SaveCowDestroy(PVM pVM)
+{
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (!pSaveCow)
+        return;
+    pVM->pgm.s.LiveSave.pSaveCowR3 = NULL;
+
+    PPGMSAVECOWPAGE pCur, pNext;
+    RTListForEachSafe(&pSaveCow->CopyList, pCur, pNext, PGMSAVECOWPAGE, ListEntry)
+    {
+        RTListNodeRemove(&pCur->ListEntry);
+        RTMemFree(pCur);
+    }
+    RTMemFree(pSaveCow->paGCPhysRuns);
+    RTMemFree(pSaveCow->pbmPending);
+    MMR3HeapFree(pSaveCow);
+}
+
+
+/**
+ * Called by PGMR3Term to free any copy-on-write state left behind.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void pgmR3SaveCowTerm(PVM pVM)
+{
+    pgmR3SaveCowDestroy(pVM);
+}
+
+
+/**
+ * Marks a RAM page for saving after the VM has been resumed.
+ *
+ * This is called by the final pass of a copy-on-write save while the VM is
+ * suspended.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+int pgmR3SaveCowMarkPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (!pVM->pgm.s.LiveSave.pSaveCowR3)
+    {
+        int rc = pgmR3SaveCowCreate(pVM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    AssertReturn(!pSaveCow->fArmed, VERR_WRONG_ORDER);
+
+    RTGCPHYS const iPage = GCPhys >> PAGE_SHIFT;
+    AssertLogRelMsgReturn(iPage < pSaveCow->cPages, ("GCPhys=%RGp cPages=%#x\n", GCPhys, pSaveCow->cPages), VERR_OUT_OF_RANGE);
+    if (!ASMBitTestAndSet(pSaveCow->pbmPending, (int32_t)iPage))
+    {
+        pSaveCow->cPending++;
+        pSaveCow->cMarked++;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Disables the access handler for a page that has been taken care of.
+ *
+ * This is PGMHandlerPhysicalPageTempOff without the handler lookup and
+ * validation.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pHandler    The handler covering the page.
+ * @param   pPage       The page.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static void pgmR3SaveCowPageTempOff(PVM pVM, PPGMPHYSHANDLER pHandler, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (PGM_PAGE_GET_HNDL_PHYS_STATE(pPage) != PGM_PAGE_HNDL_PHYS_STATE_DISABLED)
+    {
+        PGM_PAGE_SET_HNDL_PHYS_STATE(pPage, PGM_PAGE_HNDL_PHYS_STATE_DISABLED);
+        pHandler->cTmpOffPages++;
+        if (VM_IS_NEM_ENABLED(pVM))
+        {
+            uint8_t     u2State = PGM_PAGE_GET_NEM_STATE(pPage);
+            PGMPAGETYPE enmType = (PGMPAGETYPE)PGM_PAGE_GET_TYPE(pPage);
+            NEMHCNotifyPhysPageProtChanged(pVM, GCPhys, PGM_PAGE_GET_HCPHYS(pPage),
+                                           pgmPhysPageCalcNemProtection(pPage, enmType), enmType, &u2State);
+            PGM_PAGE_SET_NEM_STATE(pPage, u2State);
+        }
+    }
+}
+
+
+/**
+ * Takes a page out of the pending set, disabling its access handler.
+ *
+ * @returns true if the page was pending, false if not.
+ * @param   pVM         The cross context VM structure.
+ * @param   pSaveCow    The copy-on-write save state.
+ * @param   pPage       The page.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+static bool pgmR3SaveCowPageDone(PVM pVM, PPGMSAVECOW pSaveCow, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (!ASMBitTestAndClear(pSaveCow->pbmPending, (int32_t)(GCPhys >> PAGE_SHIFT)))
+        return false;
+    pSaveCow->cPending--;
+
+    if (pSaveCow->fArmed)
+    {
+        PPGMPHYSHANDLER pHandler = pgmHandlerPhysicalLookup(pVM, GCPhys);
+        AssertLogRelMsg(pHandler && pHandler->hType == pSaveCow->hHandlerType, ("GCPhys=%RGp\n", GCPhys));
+        if (pHandler && pHandler->hType == pSaveCow->hHandlerType)
+            pgmR3SaveCowPageTempOff(pVM, pHandler, pPage, GCPhys);
+    }
+    return true;
+}
+
+
+/**
+ * Copies the current content of a page onto the queue.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pSaveCow    The copy-on-write save state.
+ * @param   pPage       The page.
+ * @param   GCPhys      The guest physical address of the page.
+ * @param   pvPage      The page content, NULL for mapping the page.
+ */
+static void pgmR3SaveCowPageCopy(PVM pVM, PPGMSAVECOW pSaveCow, PPGMPAGE pPage, RTGCPHYS GCPhys, void const *pvPage)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (!ASMBitTest(pSaveCow->pbmPending, (int32_t)(GCPhys >> PAGE_SHIFT)))
+        return;
+
+    int rc = VERR_NO_MEMORY;
+    PPGMSAVECOWPAGE pCopy = (PPGMSAVECOWPAGE)RTMemAlloc(sizeof(*pCopy));
+    if (pCopy)
+    {
+        pCopy->GCPhys = GCPhys;
+        if (pvPage)
+        {
+            memcpy(pCopy->abPage, pvPage, PAGE_SIZE);
+            rc = VINF_SUCCESS;
+        }
+        else if (PGM_PAGE_IS_ZERO(pPage) || PGM_PAGE_IS_BALLOONED(pPage))
+        {
+            RT_ZERO(pCopy->abPage);
+            rc = VINF_SUCCESS;
+        }
+        else
+        {
+            PGMPAGEMAPLOCK PgMpLck;
+            rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pPage, GCPhys, &pvPage, &PgMpLck);
+            if (RT_SUCCESS(rc))
+            {
+                memcpy(pCopy->abPage, pvPage, PAGE_SIZE);
+                pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+            }
+        }
+        if (RT_SUCCESS(rc))
+        {
+            RTListAppend(&pSaveCow->CopyList, &pCopy->ListEntry);
+            pSaveCow->cQueued++;
+        }
+        else
+            RTMemFree(pCopy);
+    }
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PGM: Copy-on-write save lost page %RGp: %Rrc\n", GCPhys, rc));
+        ASMAtomicWriteBool(&pSaveCow->fFailed, true);
+    }
+
+    /* Only now may the page be modified. */
+    pgmR3SaveCowPageDone(pVM, pSaveCow, pPage, GCPhys);
+}
+
+
+/**
+ * Preserves the content of a page before it is modified behind the back of
+ * the access handlers.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address of the page.
+ */
+void pgmR3SaveCowPreservePage(PVM pVM, RTGCPHYS GCPhys)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (   pSaveCow
+        && pSaveCow->fArmed
+        && (GCPhys >> PAGE_SHIFT) < pSaveCow->cPages
+        && ASMBitTest(pSaveCow->pbmPending, (int32_t)(GCPhys >> PAGE_SHIFT)))
+    {
+        PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhys);
+        AssertReturnVoid(pPage);
+        pgmR3SaveCowPageCopy(pVM, pSaveCow, pPage, GCPhys, NULL);
+        pSaveCow->cPreserved++;
+    }
+}
+
+
+/**
+ * Preserves the content of all pending pages, used when resetting the VM.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void pgmR3SaveCowPreserveAll(PVM pVM)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (!pSaveCow || !pSaveCow->fArmed || !pSaveCow->cPending)
+        return;
+
+    uint32_t const cBefore = pSaveCow->cPending;
+    int iBit = ASMBitFirstSet(pSaveCow->pbmPending, pSaveCow->cPages);
+    while (iBit >= 0)
+    {
+        RTGCPHYS const GCPhys = (RTGCPHYS)iBit << PAGE_SHIFT;
+        PPGMPAGE       pPage  = pgmPhysGetPage(pVM, GCPhys);
+        if (pPage)
+            pgmR3SaveCowPageCopy(pVM, pSaveCow, pPage, GCPhys, NULL);
+        else
+        {
+            LogRel(("PGM: Copy-on-write save lost page %RGp: no longer RAM\n", GCPhys));
+            ASMAtomicWriteBool(&pSaveCow->fFailed, true);
+            ASMBitClear(pSaveCow->pbmPending, iBit);
+            pSaveCow->cPending--;
+        }
+        iBit = ASMBitNextSet(pSaveCow->pbmPending, pSaveCow->cPages, iBit);
+    }
+    pSaveCow->cPreserved += cBefore;
+    LogRel(("PGM: Copy-on-write save preserved %u pages\n", cBefore));
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPHYSHANDLER,
+ *      Access handler for RAM pages which haven't been saved yet.}
+ *
+ * @remarks The @a pvUser argument points to the PGMSAVECOW structure.
+ */
+static DECLCALLBACK(VBOXSTRICTRC)
+pgmR3SaveCowWriteHandler(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                         PGMACCESSTYPE enmAccessType, PGMACCESSORIGIN enmOrigin, void *pvUser)
+{
+    PPGMSAVECOW pSaveCow = (PPGMSAVECOW)pvUser;
+    Log5(("pgmR3SaveCowWriteHandler: %RGp LB %#zx\n", GCPhys, cbBuf));
+    Assert(enmAccessType == PGMACCESSTYPE_WRITE);
+    NOREF(pVCpu); NOREF(pvBuf); NOREF(cbBuf); NOREF(enmAccessType); NOREF(enmOrigin);
+
+    /*
+     * pvPhys is the writable mapping of the page the write is about to go to,
+     * which still has the original content since the page is pending.
+     */
+    RTGCPHYS const GCPhysPage = GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK;
+    void const    *pvPage     = pvPhys ? (uint8_t const *)pvPhys - (GCPhys & PAGE_OFFSET_MASK) : NULL;
+    uint64_t       msThrottled = 0;
+    for (;;)
+    {
+        pgmLock(pVM);
+        if (!ASMBitTest(pSaveCow->pbmPending, (int32_t)(GCPhysPage >> PAGE_SHIFT)))
+            break;
+
+        /* Wait for the writer to make room if the queue is full.  Until the
+           writer has started the wait is bounded, as nothing drains the queue
+           and the EMTs must still respond to requests and rendezvous. */
+        if (   pSaveCow->cQueued < pSaveCow->cMaxQueued
+            || ASMAtomicReadBool(&pSaveCow->fClosing)
+            || (   msThrottled
+                && !ASMAtomicReadBool(&pSaveCow->fWriterActive)
+                && RTTimeMilliTS() - msThrottled >= PGM_SAVE_COW_THROTTLE_IDLE_MS))
+        {
+            PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhysPage);
+            AssertBreak(pPage);
+            pgmR3SaveCowPageCopy(pVM, pSaveCow, pPage, GCPhysPage, pvPage);
+            ASMAtomicIncU32(&pSaveCow->cCopiedOnWrite);
+            break;
+        }
+        pgmUnlock(pVM);
+
+        if (!msThrottled)
+        {
+            ASMAtomicIncU32(&pSaveCow->cThrottled);
+            msThrottled = RTTimeMilliTS();
+        }
+        RTThreadSleep(1);
+    }
+    pgmUnlock(pVM);
+
+    return VINF_PGM_HANDLER_DO_DEFAULT;
+}
+
+
+/**
+ * Registers an access handler for a run of pages and disables it for the
+ * pages in the run which aren't pending.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pSaveCow    The copy-on-write save state.
+ * @param   pRam        The RAM range containing the run.
+ * @param   iFirst      The index of the first page in the run.
+ * @param   iLast       The index of the last page in the run.
+ */
+static int pgmR3SaveCowAddRun(PVM pVM, PPGMSAVECOW pSaveCow, PPGMRAMRANGE pRam, uint32_t iFirst, uint32_t iLast)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    if (pSaveCow->cRuns >= pSaveCow->cRunsAlloc)
+    {
+        uint32_t  cNew = pSaveCow->cRunsAlloc ? pSaveCow->cRunsAlloc * 2 : 16;
+        PRTGCPHYS paNew = (PRTGCPHYS)RTMemRealloc(pSaveCow->paGCPhysRuns, cNew * sizeof(RTGCPHYS));
+        if (!paNew)
+            return VERR_NO_MEMORY;
+        pSaveCow->paGCPhysRuns = paNew;
+        pSaveCow->cRunsAlloc   = cNew;
+    }
+
+    RTGCPHYS const GCPhysFirst = pRam->GCPhys + ((RTGCPHYS)iFirst << PAGE_SHIFT);
+    RTGCPHYS const GCPhysLast  = pRam->GCPhys + ((RTGCPHYS)iLast  << PAGE_SHIFT) + PAGE_OFFSET_MASK;
+    int rc = PGMHandlerPhysicalRegister(pVM, GCPhysFirst, GCPhysLast, pSaveCow->hHandlerType,
+                                        pSaveCow, NIL_RTR0PTR, NIL_RTRCPTR, "Copy-on-write save");
+    AssertLogRelMsgRCReturn(rc, ("%RGp-%RGp: %Rrc\n", GCPhysFirst, GCPhysLast, rc), rc);
+    pSaveCow->paGCPhysRuns[pSaveCow->cRuns++] = GCPhysFirst;
+
+    PPGMPHYSHANDLER pHandler = pgmHandlerPhysicalLookup(pVM, GCPhysFirst);
+    AssertReturn(pHandler, VERR_PGM_PHYS_HANDLER_IPE);
+    uint32_t const iBitBase = (uint32_t)(pRam->GCPhys >> PAGE_SHIFT);
+    for (uint32_t iPage = iFirst; iPage <= iLast; iPage++)
+        if (!ASMBitTest(pSaveCow->pbmPending, (int32_t)(iBitBase + iPage)))
+            pgmR3SaveCowPageTempOff(pVM, pHandler, &pRam->aPages[iPage], pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+
+    Log(("pgmR3SaveCowAddRun: %RGp-%RGp\n", GCPhysFirst, GCPhysLast));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Checks whether a page can be covered by a copy-on-write access handler.
+ *
+ * @returns true if it can, false if not.
+ * @param   pPage       The page.
+ */
+DECLINLINE(bool) pgmR3SaveCowIsPageEligible(PCPGMPAGE pPage)
+{
+    return PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM
+        && !PGM_PAGE_HAS_ANY_PHYSICAL_HANDLERS(pPage);
+}
+
+
+/**
+ * Deregisters the access handlers.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pSaveCow    The copy-on-write save state.
+ */
+static int pgmR3SaveCowDisarm(PVM pVM, PPGMSAVECOW pSaveCow)
+{
+    int rc = VINF_SUCCESS;
+    while (pSaveCow->cRuns > 0)
+    {
+        int rc2 = PGMHandlerPhysicalDeregister(pVM, pSaveCow->paGCPhysRuns[--pSaveCow->cRuns]);
+        AssertLogRelRC(rc2);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    if (pSaveCow->hHandlerType != NIL_PGMPHYSHANDLERTYPE)
+    {
+        PGMHandlerPhysicalTypeRelease(pVM, pSaveCow->hHandlerType);
+        pSaveCow->hHandlerType = NIL_PGMPHYSHANDLERTYPE;
+    }
+    pSaveCow->fArmed = false;
+    return rc;
+}
+
+
+/**
+ * Covers the pages marked by the final pass with write handlers.
+ *
+ * This is called by pgmR3SaveExec after the final pass while the VM is
+ * suspended.  On failure, the caller must save the marked pages right away
+ * using pgmR3SaveCowSavePages.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @thread  EMT(0)
+ */
+int pgmR3SaveCowArm(PVM pVM)
+{
+    VM_ASSERT_EMT0(pVM);
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (!pSaveCow || !pSaveCow->cPending)
+        return VINF_SUCCESS;
+    AssertReturn(!pSaveCow->fArmed, VERR_WRONG_ORDER);
+
+    int rc = PGMR3HandlerPhysicalTypeRegister(pVM, PGMPHYSHANDLERKIND_WRITE, pgmR3SaveCowWriteHandler,
+                                              NULL, NULL, NULL, NULL, NULL, NULL,
+                                              "Copy-on-write save", &pSaveCow->hHandlerType);
+    AssertLogRelRCReturn(rc, rc);
+
+    /*
+     * Cover the pending pages with as few handlers as possible: a run extends
+     * from a pending page to the last pending page before the next page which
+     * isn't plain RAM or already has a handler.
+     */
+    pgmLock(pVM);
+    pSaveCow->fArmed = true;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam && RT_SUCCESS(rc); pRam = pRam->pNextR3)
+    {
+        if (PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            continue;
+        uint32_t const cRamPages = (uint32_t)(pRam->cb >> PAGE_SHIFT);
+        uint32_t const iBitBase  = (uint32_t)(pRam->GCPhys >> PAGE_SHIFT);
+        AssertBreakStmt(iBitBase + cRamPages <= pSaveCow->cPages, rc = VERR_PGM_PHYS_HANDLER_IPE);
+
+        uint32_t iPage = 0;
+        while (iPage < cRamPages)
+        {
+            if (!ASMBitTest(pSaveCow->pbmPending, (int32_t)(iBitBase + iPage)))
+            {
+                iPage++;
+                continue;
+            }
+            AssertLogRelMsgBreakStmt(pgmR3SaveCowIsPageEligible(&pRam->aPages[iPage]),
+                                     ("%RGp %R[pgmpage]\n", pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT), &pRam->aPages[iPage]),
+                                     rc = VERR_PGM_HANDLER_PHYSICAL_CONFLICT);
+
+            uint32_t const iFirst = iPage;
+            uint32_t       iLast  = iPage;
+            while (   ++iPage < cRamPages
+                   && pgmR3SaveCowIsPageEligible(&pRam->aPages[iPage]))
+                if (ASMBitTest(pSaveCow->pbmPending, (int32_t)(iBitBase + iPage)))
+                    iLast = iPage;
+
+            rc = pgmR3SaveCowAddRun(pVM, pSaveCow, pRam, iFirst, iLast);
+            if (RT_FAILURE(rc))
+                break;
+        }
+    }
+    if (RT_FAILURE(rc))
+        pgmR3SaveCowDisarm(pVM, pSaveCow);
+    pgmUnlock(pVM);
+
+    if (RT_SUCCESS(rc))
+    {
+        pSaveCow->nsArmed = RTTimeNanoTS();
+        LogRel(("PGM: Copy-on-write save armed for %u pages in %u runs\n", pSaveCow->cPending, pSaveCow->cRuns));
+    }
+    return rc;
+}
+
+
+/**
+ * Saves a page record.
+ *
+ * @returns VBox status code.
+ * @param   pSSM        The SSM handle.
+ * @param   GCPhys      The guest physical address of the page.
+ * @param   pbPage      The page content.
+ */
+static int pgmR3SaveCowPutPage(PSSMHANDLE pSSM, RTGCPHYS GCPhys, uint8_t const *pbPage)
+{
+    if (ASMMemIsZeroPage(pbPage))
+    {
+        SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_ZERO | PGM_STATE_REC_FLAG_ADDR);
+        return SSMR3PutGCPhys(pSSM, GCPhys);
+    }
+    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW | PGM_STATE_REC_FLAG_ADDR);
+    SSMR3PutGCPhys(pSSM, GCPhys);
+    return SSMR3PutMem(pSSM, pbPage, PAGE_SIZE);
+}
+
+
+/**
+ * Saves the pages marked by the final pass.
+ *
+ * Normally called by pgmR3LiveExec on the thread completing a copy-on-write
+ * save while the VM is running, pages copied by the write handler are saved
+ * first.  Also used by pgmR3SaveExec if arming the handlers failed.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_SAVE_COW_PAGE_LOST if the content of a page could not be
+ *          preserved.
+ * @param   pVM         The cross context VM structure.
+ * @param   pSSM        The SSM handle.
+ */
+int pgmR3SaveCowSavePages(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (!pSaveCow)
+        return VINF_SUCCESS;
+    ASMAtomicWriteBool(&pSaveCow->fWriterActive, true);
+
+    int     rc        = VINF_SUCCESS;
+    uint8_t abPage[PAGE_SIZE];
+    while (RT_SUCCESS(rc))
+    {
+        /*
+         * Pages copied on write first, they hold up the guest.
+         */
+        pgmLock(pVM);
+        PPGMSAVECOWPAGE pCopy = RTListRemoveFirst(&pSaveCow->CopyList, PGMSAVECOWPAGE, ListEntry);
+        if (pCopy)
+        {
+            pSaveCow->cQueued--;
+            pgmUnlock(pVM);
+            rc = pgmR3SaveCowPutPage(pSSM, pCopy->GCPhys, pCopy->abPage);
+            RTMemFree(pCopy);
+            continue;
+        }
+
+        /*
+         * Then the next page still in guest memory.  Copy it and stop
+         * intercepting writes to it while holding the lock, the saving is
+         * done outside it since SSM may block.
+         */
+        int iBit = pSaveCow->cPending == 0
+                 ? -1
+                 : pSaveCow->iNext == 0
+                 ? ASMBitFirstSet(pSaveCow->pbmPending, pSaveCow->cPages)
+                 : ASMBitNextSet(pSaveCow->pbmPending, pSaveCow->cPages, pSaveCow->iNext - 1);
+        if (iBit < 0)
+        {
+            pgmUnlock(pVM);
+            break;
+        }
+        pSaveCow->iNext = (uint32_t)iBit + 1;
+
+        RTGCPHYS const GCPhys = (RTGCPHYS)iBit << PAGE_SHIFT;
+        PPGMPAGE       pPage  = pgmPhysGetPage(pVM, GCPhys);
+        if (pPage)
+        {
+            if (PGM_PAGE_IS_ZERO(pPage) || PGM_PAGE_IS_BALLOONED(pPage))
+                RT_ZERO(abPage);
+            else
+            {
+                PGMPAGEMAPLOCK PgMpLck;
+                void const    *pvPage;
+                rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pPage, GCPhys, &pvPage, &PgMpLck);
+                if (RT_SUCCESS(rc))
+                {
+                    memcpy(abPage, pvPage, PAGE_SIZE);
+                    pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                }
+            }
+            pgmR3SaveCowPageDone(pVM, pSaveCow, pPage, GCPhys);
+        }
+        else
+        {
+            ASMBitClear(pSaveCow->pbmPending, iBit);
+            pSaveCow->cPending--;
+            rc = VERR_PGM_SAVE_COW_PAGE_LOST;
+        }
+        pgmUnlock(pVM);
+        AssertLogRelMsgRCBreak(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc));
+
+        rc = pgmR3SaveCowPutPage(pSSM, GCPhys, abPage);
+    }
+
+    ASMAtomicWriteBool(&pSaveCow->fWriterActive, false);
+    if (RT_SUCCESS(rc) && ASMAtomicReadBool(&pVM->pgm.s.LiveSave.fSaveCowBypassed))
+    {
+        LogRel(("PGM: Copy-on-write save lost pages written to by ring-0\n"));
+        ASMAtomicWriteBool(&pSaveCow->fFailed, true);
+    }
+    if (RT_SUCCESS(rc) && ASMAtomicReadBool(&pSaveCow->fFailed))
+        rc = VERR_PGM_SAVE_COW_PAGE_LOST;
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNVMMEMTRENDEZVOUS,
+ *      Worker for pgmR3SaveCowDone that deregisters the access handlers.}
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3SaveCowDoneRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    NOREF(pVCpu);
+    pgmLock(pVM);
+    int rc = pgmR3SaveCowDisarm(pVM, (PPGMSAVECOW)pvUser);
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * Ends a copy-on-write save, removing the access handlers and freeing
+ * whatever is left.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @thread  EMT(0)
+ */
+void pgmR3SaveCowDone(PVM pVM)
+{
+    VM_ASSERT_EMT0(pVM);
+    PPGMSAVECOW pSaveCow = pVM->pgm.s.LiveSave.pSaveCowR3;
+    if (!pSaveCow)
+        return;
+
+    if (pSaveCow->fArmed)
+    {
+        /* The other EMTs may be executing the write handler while the VM is running,
+           make sure they don't keep waiting for a queue nobody drains any more. */
+        ASMAtomicWriteBool(&pSaveCow->fClosing, true);
+        VMSTATE const enmState = VMR3GetState(pVM);
+        if (   enmState == VMSTATE_RUNNING
+            || enmState == VMSTATE_RUNNING_LS)
+        {
+            int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3SaveCowDoneRendezvous, pSaveCow);
+            AssertLogRelRC(rc);
+        }
+        else
+            pgmR3SaveCowDoneRendezvous(pVM, VMMGetCpu(pVM), pSaveCow);
+
+        uint64_t const cMsElapsed = (RTTimeNanoTS() - pSaveCow->nsArmed) / RT_NS_1MS;
+        LogRel(("PGM: Copy-on-write save of %u pages done after %RU64 ms; %u copied on write, %u preserved, %u throttled, %u left%s\n",
+                pSaveCow->cMarked, cMsElapsed, pSaveCow->cCopiedOnWrite, pSaveCow->cPreserved, pSaveCow->cThrottled,
+                pSaveCow->cPending, pSaveCow->fFailed ? ", FAILED" : ""));
+    }
+    pgmLock(pVM);
+    pgmR3SaveCowDestroy(pVM);
+    pgmUnlock(pVM);
+}
@@ -25,6 +25,7 @@
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmdrv.h>
 #include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/hm.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include "PGMInline.h"
@@ -46,7 +47,10 @@
 *   Defined Constants And Macros                                                                                                 *
 *********************************************************************************************************************************/
 /** Saved state data unit version.  */
-#define PGM_SAVED_STATE_VERSION                 14
+#define PGM_SAVED_STATE_VERSION                 15
+/** Saved state data unit version before the XBZRLE and duplicate page records
+ * (PGM_STATE_REC_RAM_XBZRLE, PGM_STATE_REC_RAM_DUP). */
+#define PGM_SAVED_STATE_VERSION_PRE_XBZRLE      14
 /** Saved state data unit version before the PAE PDPE registers. */
 #define PGM_SAVED_STATE_VERSION_PRE_PAE         13
 /** Saved state data unit version after this includes ballooned page flags in
@@ -87,8 +91,22 @@
 #define PGM_STATE_REC_ROM_PROT          UINT8_C(0x07)
 /** Ballooned page. No data. */
 #define PGM_STATE_REC_RAM_BALLOONED     UINT8_C(0x08)
+/** Dirty RAM page which content follows after the switchover (post-copy).
+ * No data. */
+#define PGM_STATE_REC_RAM_POST_COPY     UINT8_C(0x09)
+/** RAM page delta encoded against the content saved for it earlier in the
+ * stream.  The size of the encoded data (16-bit) precedes it, see
+ * pgmR3StateXbzrleEncode for the format. */
+#define PGM_STATE_REC_RAM_XBZRLE        UINT8_C(0x0a)
+/** RAM page identical to one saved earlier in the same pass, the address of
+ * that page (RTGCPHYS) is the only payload. */
+#define PGM_STATE_REC_RAM_DUP           UINT8_C(0x0b)
+/** The content of the RAM pages skipped by the final pass follows in a second
+ * final pass instance of the unit at the end of the stream (copy-on-write).
+ * No data. */
+#define PGM_STATE_REC_RAM_COW_TRAILER   UINT8_C(0x0c)
 /** The last record type. */
-#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_BALLOONED
+#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_COW_TRAILER
 /** End marker. */
 #define PGM_STATE_REC_END               UINT8_C(0xff)
 /** Flag indicating that the data is preceded by the page address.
@@ -124,6 +142,22 @@
 #define PGMPAGETYPE_OLD_MMIO                5
 /** @}  */
 
+/** The number of passes to do before voting for the final pass in post-copy
+ * mode.  The first two passes write monitor and send everything once, the
+ * remaining dirty pages are fetched by the target after the switchover. */
+#define PGM_POST_COPY_PASSES                3
+
+/** The number of passes to do before voting for the final pass in
+ * copy-on-write mode.  The dirty pages are saved after the VM has been
+ * resumed, so all we need is to get the bulk of the memory saved. */
+#define PGM_SAVE_COW_PASSES                 2
+
+/** The max size of the XBZRLE encoded data of a page, larger deltas are
+ * saved raw instead. */
+#define PGM_STATE_XBZRLE_MAX            (PAGE_SIZE - PAGE_SIZE / 8)
+/** The number of entries in the dedup hash table (power of two). */
+#define PGM_STATE_DEDUP_ENTRIES         _64K
+
 
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
@@ -148,6 +182,40 @@ typedef struct
     PGMMODE                         enmGuestMode;
 } PGMOLD;
 
+/**
+ * Cache of the RAM page contents last saved during a live save, used for the
+ * XBZRLE delta encoding of re-dirtied pages.
+ *
+ * The cache is direct mapped on the guest page frame number.
+ */
+typedef struct PGMXBZRLECACHE
+{
+    /** The number of entries (power of two). */
+    uint32_t                        cEntries;
+    /** Padding. */
+    uint32_t                        u32Padding;
+    /** The guest physical address of the page in each entry, NIL_RTGCPHYS if
+     * the entry is unused. */
+    RTGCPHYS                       *paGCPhys;
+    /** The page contents (cEntries * PAGE_SIZE). */
+    uint8_t                        *pabPages;
+} PGMXBZRLECACHE;
+/** Pointer to a XBZRLE cache. */
+typedef PGMXBZRLECACHE *PPGMXBZRLECACHE;
+
+/**
+ * Dedup hash table entry.
+ */
+typedef struct PGMSTATEDEDUPENTRY
+{
+    /** The SHA-1 hash of the saved content. */
+    uint8_t                         abSha1[RTSHA1_HASH_SIZE];
+    /** The guest physical address of the page, NIL_RTGCPHYS if unused. */
+    RTGCPHYS                        GCPhys;
+} PGMSTATEDEDUPENTRY;
+/** Pointer to a dedup hash table entry. */
+typedef PGMSTATEDEDUPENTRY *PPGMSTATEDEDUPENTRY;
+
 
 /*********************************************************************************************************************************
 *   Global Variables                                                                                                             *
@@ -1345,6 +1413,26 @@ static void pgmR3StateVerifyCrc32ForRamPage(PVM pVM, PPGMRAMRANGE pCur, PPGMLIVE
 
 #endif /* PGMLIVESAVERAMPAGE_WITH_CRC32 */
 
+/**
+ * Checks and clears the bit of a RAM page in the hardware dirty page bitmap.
+ *
+ * @returns true if the guest has written to the page since the last time,
+ *          false if not or if the hardware dirty flags aren't used.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pCur                The RAM range.
+ * @param   iPage               The page index within the range.
+ */
+DECLINLINE(bool) pgmR3ScanRamPageHwDirty(PVM pVM, PPGMRAMRANGE pCur, uint32_t iPage)
+{
+    if (pVM->pgm.s.LiveSave.enmDirtyLog != PGMDIRTYLOG_HW_DIRTY_BITS)
+        return false;
+    uint64_t const iBit = (pCur->GCPhys >> PAGE_SHIFT) + iPage;
+    if (RT_LIKELY(iBit < pVM->pgm.s.LiveSave.cHwDirtyBits))
+        return ASMBitTestAndClear(pVM->pgm.s.LiveSave.pbmHwDirtyR3, (int32_t)iBit);
+    return true; /* Not covered by the bitmap, so assume the worst. */
+}
+
+
 /**
  * Scan for RAM page modifications and reprotect them.
  *
@@ -1426,6 +1514,7 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
 
                                 pgmPhysPageWriteMonitor(pVM, &pCur->aPages[iPage],
                                                         pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+                                pgmR3ScanRamPageHwDirty(pVM, pCur, iPage); /* consumed, it's dirty anyway. */
                                 paLSPages[iPage].fWriteMonitored        = 1;
                                 paLSPages[iPage].fWriteMonitoredJustNow = 1;
                                 paLSPages[iPage].fDirty                 = 1;
@@ -1438,7 +1527,23 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
 
                             case PGM_PAGE_STATE_WRITE_MONITORED:
                                 Assert(paLSPages[iPage].fWriteMonitored);
-                                if (PGM_PAGE_GET_WRITE_LOCKS(&pCur->aPages[iPage]) == 0)
+                                if (pgmR3ScanRamPageHwDirty(pVM, pCur, iPage))
+                                {
+                                    /* Written to by the guest without faulting, see pgmR3PoolHarvestDirtyBits. */
+                                    paLSPages[iPage].fWriteMonitoredJustNow = 1;
+#ifdef PGMLIVESAVERAMPAGE_WITH_CRC32
+                                    paLSPages[iPage].u32Crc                 = UINT32_MAX; /* invalid */
+#endif
+                                    if (!paLSPages[iPage].fDirty)
+                                    {
+                                        paLSPages[iPage].fDirty = 1;
+                                        pVM->pgm.s.LiveSave.Ram.cReadyPages--;
+                                        pVM->pgm.s.LiveSave.Ram.cDirtyPages++;
+                                        if (++paLSPages[iPage].cDirtied > PGMLIVSAVEPAGE_MAX_DIRTIED)
+                                            paLSPages[iPage].cDirtied = PGMLIVSAVEPAGE_MAX_DIRTIED;
+                                    }
+                                }
+                                else if (PGM_PAGE_GET_WRITE_LOCKS(&pCur->aPages[iPage]) == 0)
                                 {
 #ifdef PGMLIVESAVERAMPAGE_WITH_CRC32
                                     if (paLSPages[iPage].fWriteMonitoredJustNow)
@@ -1553,18 +1658,278 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
 
 
 /**
- * Save quiescent RAM pages.
+ * Appends an ULEB128 encoded value.
+ *
+ * @returns false if it doesn't fit, true on success.
+ * @param   pbDst               The output buffer.
+ * @param   poffDst             The output offset, updated.
+ * @param   cbDst               The size of the output buffer.
+ * @param   uValue              The value.
+ */
+DECLINLINE(bool) pgmR3StatePutUleb128(uint8_t *pbDst, uint32_t *poffDst, uint32_t cbDst, uint32_t uValue)
+{
+    uint32_t offDst = *poffDst;
+    do
+    {
+        if (offDst >= cbDst)
+            return false;
+        uint8_t b = uValue & 0x7f;
+        uValue >>= 7;
+        pbDst[offDst++] = uValue ? b | 0x80 : b;
+    } while (uValue);
+    *poffDst = offDst;
+    return true;
+}
+
+
+/**
+ * Gets an ULEB128 encoded value.
+ *
+ * @returns false on malformed input, true on success.
+ * @param   pbSrc               The input buffer.
+ * @param   poffSrc             The input offset, updated.
+ * @param   cbSrc               The size of the input.
+ * @param   puValue             Where to return the value.  Limited to
+ *                              PAGE_SIZE since that's all we encode.
+ */
+DECLINLINE(bool) pgmR3StateGetUleb128(uint8_t const *pbSrc, uint32_t *poffSrc, uint32_t cbSrc, uint32_t *puValue)
+{
+    uint32_t offSrc = *poffSrc;
+    uint32_t uValue = 0;
+    for (unsigned iShift = 0; iShift < 21; iShift += 7)
+    {
+        if (offSrc >= cbSrc)
+            return false;
+        uint8_t const b = pbSrc[offSrc++];
+        uValue |= (uint32_t)(b & 0x7f) << iShift;
+        if (!(b & 0x80))
+        {
+            if (uValue > PAGE_SIZE)
+                return false;
+            *puValue = uValue;
+            *poffSrc = offSrc;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * XBZRLE encodes the changes between the previously saved and the current
+ * content of a page.
+ *
+ * The encoded data is a sequence of run pairs: The ULEB128 encoded length of
+ * a run of unchanged bytes, followed by the ULEB128 encoded length of a run of
+ * changed bytes and the new content of those.  A trailing run of unchanged
+ * bytes is omitted, so an unchanged page encodes into zero bytes.
+ *
+ * @returns The size of the encoded data, UINT32_MAX if it exceeds cbDst.
+ * @param   pbOld               The previously saved content.
+ * @param   pbNew               The current content.
+ * @param   pbDst               The output buffer.
+ * @param   cbDst               The size of the output buffer.
+ */
+static uint32_t pgmR3StateXbzrleEncode(uint8_t const *pbOld, uint8_t const *pbNew, uint8_t *pbDst, uint32_t cbDst)
+{
+    uint32_t offDst = 0;
+    uint32_t off    = 0;
+    while (off < PAGE_SIZE)
+    {
+        /* The unchanged run, compare 64-bit words where possible. */
+        uint32_t const offSame = off;
+        while (off < PAGE_SIZE && (off & 7) && pbOld[off] == pbNew[off])
+            off++;
+        if (!(off & 7))
+            while (   off < PAGE_SIZE
+                   && *(uint64_t const *)&pbOld[off] == *(uint64_t const *)&pbNew[off])
+                off += 8;
+        while (off < PAGE_SIZE && pbOld[off] == pbNew[off])
+            off++;
+        if (off >= PAGE_SIZE)
+            break;
+
+        /* The changed run. */
+        uint32_t const offChanged = off;
+        while (off < PAGE_SIZE && pbOld[off] != pbNew[off])
+            off++;
+        uint32_t const cbChanged = off - offChanged;
+
+        if (   !pgmR3StatePutUleb128(pbDst, &offDst, cbDst, offChanged - offSame)
+            || !pgmR3StatePutUleb128(pbDst, &offDst, cbDst, cbChanged)
+            || cbDst - offDst < cbChanged)
+            return UINT32_MAX;
+        memcpy(&pbDst[offDst], &pbNew[offChanged], cbChanged);
+        offDst += cbChanged;
+    }
+    return offDst;
+}
+
+
+/**
+ * Applies XBZRLE encoded changes to a page.
+ *
+ * @returns VBox status code.
+ * @param   pbSrc               The encoded data.
+ * @param   cbSrc               The size of the encoded data.
+ * @param   pbPage              The page to update.
+ */
+static int pgmR3StateXbzrleDecode(uint8_t const *pbSrc, uint32_t cbSrc, uint8_t *pbPage)
+{
+    uint32_t offSrc = 0;
+    uint32_t off    = 0;
+    while (offSrc < cbSrc)
+    {
+        uint32_t cbSame;
+        uint32_t cbChanged;
+        if (   !pgmR3StateGetUleb128(pbSrc, &offSrc, cbSrc, &cbSame)
+            || !pgmR3StateGetUleb128(pbSrc, &offSrc, cbSrc, &cbChanged))
+            return VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+        off += cbSame;
+        AssertLogRelMsgReturn(   cbChanged > 0
+                              && cbChanged <= PAGE_SIZE - RT_MIN(off, PAGE_SIZE)
+                              && cbChanged <= cbSrc - offSrc,
+                              ("off=%#x cbChanged=%#x offSrc=%#x cbSrc=%#x\n", off, cbChanged, offSrc, cbSrc),
+                              VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+        memcpy(&pbPage[off], &pbSrc[offSrc], cbChanged);
+        off    += cbChanged;
+        offSrc += cbChanged;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Looks up a page in the XBZRLE cache.
+ *
+ * @returns Pointer to the cached content if present, NULL if not.
+ * @param   pCache              The cache.
+ * @param   GCPhys              The guest physical address of the page.
+ */
+DECLINLINE(uint8_t *) pgmR3StateXbzrleLookup(PPGMXBZRLECACHE pCache, RTGCPHYS GCPhys)
+{
+    uint32_t const iEntry = (uint32_t)(GCPhys >> PAGE_SHIFT) & (pCache->cEntries - 1);
+    if (pCache->paGCPhys[iEntry] == GCPhys)
+        return &pCache->pabPages[(size_t)iEntry << PAGE_SHIFT];
+    return NULL;
+}
+
+
+/**
+ * Records the saved content of a page in the XBZRLE cache, evicting whatever
+ * page occupied the entry.
+ *
+ * @param   pCache              The cache.
+ * @param   GCPhys              The guest physical address of the page.
+ * @param   pbPage              The saved content, NULL to just drop the page
+ *                              from the cache (saved as zero, ballooned, ...).
+ */
+static void pgmR3StateXbzrleUpdate(PPGMXBZRLECACHE pCache, RTGCPHYS GCPhys, uint8_t const *pbPage)
+{
+    uint32_t const iEntry = (uint32_t)(GCPhys >> PAGE_SHIFT) & (pCache->cEntries - 1);
+    if (pbPage)
+    {
+        pCache->paGCPhys[iEntry] = GCPhys;
+        memcpy(&pCache->pabPages[(size_t)iEntry << PAGE_SHIFT], pbPage, PAGE_SIZE);
+    }
+    else if (pCache->paGCPhys[iEntry] == GCPhys)
+        pCache->paGCPhys[iEntry] = NIL_RTGCPHYS;
+}
+
+
+/**
+ * Allocates the XBZRLE cache for a live save.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 The cross context VM structure.
+ */
+static int pgmR3StateXbzrleCreate(PVM pVM)
+{
+    uint32_t cEntries = pVM->pgm.s.LiveSave.cXbzrleCachePages;
+    if (!cEntries)
+        return VINF_SUCCESS;
+    while (cEntries & (cEntries - 1))       /* round down to a power of two */
+        cEntries &= cEntries - 1;
+
+    PPGMXBZRLECACHE pCache = (PPGMXBZRLECACHE)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(*pCache));
+    if (!pCache)
+        return VERR_NO_MEMORY;
+    pCache->cEntries = cEntries;
+    pCache->paGCPhys = (RTGCPHYS *)MMR3HeapAlloc(pVM, MM_TAG_PGM, sizeof(RTGCPHYS) * cEntries);
+    pCache->pabPages = (uint8_t *)RTMemPageAlloc((size_t)cEntries << PAGE_SHIFT);
+    if (!pCache->paGCPhys || !pCache->pabPages)
+    {
+        LogRel(("PGM: Failed to allocate a %u page live save delta encoding cache, continuing without\n", cEntries));
+        MMR3HeapFree(pCache->paGCPhys);
+        RTMemPageFree(pCache->pabPages, (size_t)cEntries << PAGE_SHIFT);
+        MMR3HeapFree(pCache);
+        return VINF_SUCCESS;
+    }
+    for (uint32_t i = 0; i < cEntries; i++)
+        pCache->paGCPhys[i] = NIL_RTGCPHYS;
+
+    pVM->pgm.s.LiveSave.pXbzrleCacheR3 = pCache;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Frees the XBZRLE cache.
+ *
+ * @param   pVM                 The cross context VM structure.
+ */
+static void pgmR3StateXbzrleDestroy(PVM pVM)
+{
+    PPGMXBZRLECACHE pCache = pVM->pgm.s.LiveSave.pXbzrleCacheR3;
+    if (pCache)
+    {
+        pVM->pgm.s.LiveSave.pXbzrleCacheR3 = NULL;
+        RTMemPageFree(pCache->pabPages, (size_t)pCache->cEntries << PAGE_SHIFT);
+        MMR3HeapFree(pCache->paGCPhys);
+        MMR3HeapFree(pCache);
+    }
+}
+
+
+/**
+ * Looks for a page with the same content saved earlier in the pass, adding
+ * this page to the dedup hash table if there is none.
+ *
+ * @returns The guest physical address of the identical page, NIL_RTGCPHYS if
+ *          none.
+ * @param   paDedup             The dedup hash table.
+ * @param   GCPhys              The guest physical address of the page.
+ * @param   pbPage              The page content.
+ */
+static RTGCPHYS pgmR3StateDedupLookup(PPGMSTATEDEDUPENTRY paDedup, RTGCPHYS GCPhys, uint8_t const *pbPage)
+{
+    uint8_t abSha1[RTSHA1_HASH_SIZE];
+    RTSha1(pbPage, PAGE_SIZE, abSha1);
+
+    PPGMSTATEDEDUPENTRY pEntry = &paDedup[RT_MAKE_U16(abSha1[0], abSha1[1]) & (PGM_STATE_DEDUP_ENTRIES - 1)];
+    if (   pEntry->GCPhys != NIL_RTGCPHYS
+        && !memcmp(pEntry->abSha1, abSha1, sizeof(abSha1)))
+        return pEntry->GCPhys;
+
+    memcpy(pEntry->abSha1, abSha1, sizeof(abSha1));
+    pEntry->GCPhys = GCPhys;
+    return NIL_RTGCPHYS;
+}
+
+
+/**
+ * Worker for pgmR3SaveRamPages.
  *
  * @returns VBox status code.
  * @param   pVM                 The cross context VM structure.
  * @param   pSSM                The SSM handle.
  * @param   fLiveSave           Whether it's a live save or not.
  * @param   uPass               The pass number.
+ * @param   paDedup             The dedup hash table for this pass, NULL if
+ *                              not deduplicating.
  */
-static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t uPass)
+static int pgmR3SaveRamPagesWorker(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t uPass, PPGMSTATEDEDUPENTRY paDedup)
 {
-    NOREF(fLiveSave);
-
     /*
      * The RAM.
      */
@@ -1572,6 +1937,15 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
     RTGCPHYS GCPhysCur = 0;
     PPGMRAMRANGE pCur;
     bool fFTMDeltaSaveActive = FTMIsDeltaLoadSaveActive(pVM);
+    bool const fPostCopy = fLiveSave
+                        && uPass == SSM_PASS_FINAL
+                        && pVM->pgm.s.LiveSave.fPostCopy
+                        && !fFTMDeltaSaveActive;
+    bool const fSaveCow  = fLiveSave
+                        && uPass == SSM_PASS_FINAL
+                        && pVM->pgm.s.LiveSave.fSaveCow
+                        && !fFTMDeltaSaveActive;
+    PPGMXBZRLECACHE const pCache = fLiveSave && !fFTMDeltaSaveActive ? pVM->pgm.s.LiveSave.pXbzrleCacheR3 : NULL;
 
     pgmLock(pVM);
     do
@@ -1649,7 +2023,47 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                     bool        fBallooned = PGM_PAGE_IS_BALLOONED(pCurPage);
                     bool        fSkipped = false;
 
-                    if (!fZero && !fBallooned)
+                    if (   fSaveCow
+                        && !fZero
+                        && !fBallooned
+                        && !PGM_PAGE_HAS_ANY_PHYSICAL_HANDLERS(pCurPage)
+                        && PGM_PAGE_GET_WRITE_LOCKS(pCurPage) == 0)
+                    {
+                        /*
+                         * Copy-on-write: Just mark the page, it's saved by
+                         * pgmR3LiveExec after the VM has been resumed.
+                         */
+                        rc = pgmR3SaveCowMarkPage(pVM, GCPhys);
+                        pgmUnlock(pVM);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys), rc);
+                        if (pCache)
+                            pgmR3StateXbzrleUpdate(pCache, GCPhys, NULL);
+                        fSkipped = true;
+                    }
+                    else if (   fPostCopy
+                             && !fZero
+                             && !fBallooned
+                             && !PGM_PAGE_HAS_ANY_PHYSICAL_HANDLERS(pCurPage))
+                    {
+                        /*
+                         * Post-copy: Just record the address, the target fetches
+                         * the content after it has been started.
+                         */
+                        rc = pgmR3PostCopyMarkPage(pVM, GCPhys);
+                        pgmUnlock(pVM);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys), rc);
+                        if (pCache)
+                            pgmR3StateXbzrleUpdate(pCache, GCPhys, NULL);
+
+                        if (GCPhys == GCPhysLast + PAGE_SIZE)
+                            rc = SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_POST_COPY);
+                        else
+                        {
+                            SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_POST_COPY | PGM_STATE_REC_FLAG_ADDR);
+                            rc = SSMR3PutGCPhys(pSSM, GCPhys);
+                        }
+                    }
+                    else if (!fZero && !fBallooned)
                     {
                         /*
                          * Copy the page and then save it outside the lock (since any
@@ -1696,14 +2110,48 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                             }
                             else
                             {
+                                /*
+                                 * Try a delta against the content we saved for the page
+                                 * earlier, then look for an identical page saved in this pass.
+                                 */
+                                uint8_t         abDelta[PGM_STATE_XBZRLE_MAX];
+                                uint32_t        cbDelta   = UINT32_MAX;
+                                RTGCPHYS        GCPhysDup = NIL_RTGCPHYS;
+                                uint8_t const  *pbCached  = pCache ? pgmR3StateXbzrleLookup(pCache, GCPhys) : NULL;
+                                if (pbCached)
+                                    cbDelta = pgmR3StateXbzrleEncode(pbCached, abPage, abDelta, sizeof(abDelta));
+                                if (cbDelta == UINT32_MAX && paDedup)
+                                    GCPhysDup = pgmR3StateDedupLookup(paDedup, GCPhys, abPage);
+
+                                uint8_t const u8RecType = cbDelta != UINT32_MAX       ? PGM_STATE_REC_RAM_XBZRLE
+                                                        : GCPhysDup != NIL_RTGCPHYS ? PGM_STATE_REC_RAM_DUP
+                                                        :                             PGM_STATE_REC_RAM_RAW;
                                 if (GCPhys == GCPhysLast + PAGE_SIZE)
-                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW);
+                                    SSMR3PutU8(pSSM, u8RecType);
                                 else
                                 {
-                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_RAW | PGM_STATE_REC_FLAG_ADDR);
+                                    SSMR3PutU8(pSSM, u8RecType | PGM_STATE_REC_FLAG_ADDR);
                                     SSMR3PutGCPhys(pSSM, GCPhys);
                                 }
-                                rc = SSMR3PutMem(pSSM, abPage, PAGE_SIZE);
+                                if (u8RecType == PGM_STATE_REC_RAM_XBZRLE)
+                                {
+                                    rc = SSMR3PutU16(pSSM, (uint16_t)cbDelta);
+                                    if (RT_SUCCESS(rc) && cbDelta)
+                                        rc = SSMR3PutMem(pSSM, abDelta, cbDelta);
+                                    pVM->pgm.s.LiveSave.cXbzrlePages++;
+                                    pVM->pgm.s.LiveSave.cbXbzrle += cbDelta;
+                                }
+                                else if (u8RecType == PGM_STATE_REC_RAM_DUP)
+                                {
+                                    rc = SSMR3PutGCPhys(pSSM, GCPhysDup);
+                                    pVM->pgm.s.LiveSave.cDupPages++;
+                                }
+                                else
+                                    rc = SSMR3PutMem(pSSM, abPage, PAGE_SIZE);
+
+                                /* Nothing more is saved after the final pass. */
+                                if (pCache && uPass != SSM_PASS_FINAL)
+                                    pgmR3StateXbzrleUpdate(pCache, GCPhys, abPage);
                             }
                         }
                         else
@@ -1715,6 +2163,8 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                                 SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_ZERO | PGM_STATE_REC_FLAG_ADDR);
                                 rc = SSMR3PutGCPhys(pSSM, GCPhys);
                             }
+                            if (pCache)
+                                pgmR3StateXbzrleUpdate(pCache, GCPhys, NULL);
                         }
                     }
                     else
@@ -1736,6 +2186,8 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                             SSMR3PutU8(pSSM, u8RecType | PGM_STATE_REC_FLAG_ADDR);
                             rc = SSMR3PutGCPhys(pSSM, GCPhys);
                         }
+                        if (pCache)
+                            pgmR3StateXbzrleUpdate(pCache, GCPhys, NULL);
                     }
                     if (RT_FAILURE(rc))
                         return rc;
@@ -1773,6 +2225,39 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
 }
 
 
+/**
+ * Save quiescent RAM pages.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pSSM                The SSM handle.
+ * @param   fLiveSave           Whether it's a live save or not.
+ * @param   uPass               The pass number.
+ */
+static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t uPass)
+{
+    /*
+     * The dedup hash table only covers a single pass, as each page is saved
+     * at most once per pass and the target therefore still has the content
+     * we referenced.
+     */
+    PPGMSTATEDEDUPENTRY paDedup = NULL;
+    if (   pVM->pgm.s.fSaveDedup
+        && !FTMIsDeltaLoadSaveActive(pVM))
+    {
+        paDedup = (PPGMSTATEDEDUPENTRY)RTMemAlloc(sizeof(paDedup[0]) * PGM_STATE_DEDUP_ENTRIES);
+        if (paDedup)
+            for (uint32_t i = 0; i < PGM_STATE_DEDUP_ENTRIES; i++)
+                paDedup[i].GCPhys = NIL_RTGCPHYS;
+    }
+
+    int rc = pgmR3SaveRamPagesWorker(pVM, pSSM, fLiveSave, uPass, paDedup);
+
+    RTMemFree(paDedup);
+    return rc;
+}
+
+
 /**
  * Cleans up RAM pages after a live save.
  *
@@ -1847,6 +2332,19 @@ static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
 {
     int rc;
 
+    /*
+     * The deferred final pass of a copy-on-write save, the VM is running
+     * again.  This fills the trailing instance of the unit announced by
+     * pgmR3SaveExec with the pages it skipped.
+     */
+    if (uPass == SSM_PASS_FINAL)
+    {
+        AssertLogRelReturn(pVM->pgm.s.LiveSave.fSaveCow, VERR_SSM_UNEXPECTED_PASS);
+        rc = pgmR3SaveCowSavePages(pVM, pSSM);
+        SSMR3PutU8(pSSM, PGM_STATE_REC_END);    /* (Ignore the rc, SSM takes care of it.) */
+        return rc;
+    }
+
     /*
      * Save the MMIO2 and ROM range IDs in pass 0.
      */
@@ -1875,10 +2373,25 @@ static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
     /*
      * Do the scanning.
      */
+    if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+    {
+        rc = pgmR3PoolHarvestDirtyBitsAll(pVM);
+        AssertLogRelRCReturn(rc, rc);
+    }
     pgmR3ScanRomPages(pVM);
     pgmR3ScanMmio2Pages(pVM, uPass);
     pgmR3ScanRamPages(pVM, false /*fFinalPass*/);
-    pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/); /** @todo this could perhaps be optimized a bit. */
+    switch (pVM->pgm.s.LiveSave.enmDirtyLog)
+    {
+        case PGMDIRTYLOG_FLUSH_POOL:
+            pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/);
+            break;
+        case PGMDIRTYLOG_WRITE_PROTECT:
+            pgmR3PoolWriteProtectAll(pVM);
+            break;
+        case PGMDIRTYLOG_HW_DIRTY_BITS:
+            break; /* The CPU sets the dirty flags, nothing to rearm. */
+    }
 
     /*
      * Save the pages.
@@ -1947,6 +2460,27 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
                                           / ((long double)cNsElapsed / 1000000000.0) );
     pVM->pgm.s.LiveSave.cPagesPerSecond = cPagesPerSecond;
 
+    /*
+     * In post-copy mode there is no point in chasing a guest that keeps
+     * dirtying memory faster than we can send it, as whatever is dirty at the
+     * end is fetched by the target after the switchover.
+     */
+    if (   pVM->pgm.s.LiveSave.fPostCopy
+        && uPass + 1 >= PGM_POST_COPY_PASSES)
+    {
+        Log(("pgmR3LiveVote: VINF_SUCCESS - post-copy pass=%d cDirtyNow=%u\n", uPass, cDirtyNow));
+        return VINF_SUCCESS;
+    }
+
+    /* Likewise in copy-on-write mode, where the dirty pages are saved after
+       the VM has been resumed. */
+    if (   pVM->pgm.s.LiveSave.fSaveCow
+        && uPass + 1 >= PGM_SAVE_COW_PASSES)
+    {
+        Log(("pgmR3LiveVote: VINF_SUCCESS - copy-on-write pass=%d cDirtyNow=%u\n", uPass, cDirtyNow));
+        return VINF_SUCCESS;
+    }
+
     /*
      * Try make a decision.
      */
@@ -2002,6 +2536,69 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
 }
 
 
+/**
+ * Decides how to track the guest RAM modifications during the live save.
+ *
+ * Harvesting the hardware dirty flags of the nested page tables is preferred
+ * as the guest runs without write monitoring faults.  Without them, the shadow
+ * page tables are write protected in place after each pass, unless large
+ * pages are in use, in which case we have to flush the page pool.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 The cross context VM structure.
+ */
+static int pgmR3PrepDirtyLog(PVM pVM)
+{
+    PGMDIRTYLOG enmDirtyLog = PGMDIRTYLOG_FLUSH_POOL;
+    if (!PGMIsUsingLargePages(pVM))
+    {
+        enmDirtyLog = PGMDIRTYLOG_WRITE_PROTECT;
+#ifndef PGMLIVESAVERAMPAGE_WITH_CRC32
+        if (   HMAreNestedPagingDirtyBitsEnabled(pVM)
+            && pVM->pgm.s.enmHostMode != SUPPAGINGMODE_32_BIT
+            && pVM->pgm.s.enmHostMode != SUPPAGINGMODE_32_BIT_GLOBAL)
+            enmDirtyLog = PGMDIRTYLOG_HW_DIRTY_BITS;
+#endif
+    }
+
+    if (enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+    {
+        /*
+         * Allocate a bitmap covering all the RAM ranges.
+         */
+        pgmLock(pVM);
+        RTGCPHYS GCPhysLast = 0;
+        for (PPGMRAMRANGE pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
+            if (   !PGM_RAM_RANGE_IS_AD_HOC(pCur)
+                && pCur->GCPhysLast > GCPhysLast)
+                GCPhysLast = pCur->GCPhysLast;
+        pgmUnlock(pVM);
+
+        uint64_t const cBits = RT_ALIGN_64((GCPhysLast >> PAGE_SHIFT) + 1, 64);
+        uint64_t      *pbmDirty = cBits <= _2G ? (uint64_t *)MMR3HeapAllocZ(pVM, MM_TAG_PGM, cBits / 8) : NULL;
+        if (pbmDirty)
+        {
+            pgmLock(pVM);
+            pVM->pgm.s.LiveSave.pbmHwDirtyR3      = pbmDirty;
+            pVM->pgm.s.LiveSave.cHwDirtyBits      = (uint32_t)cBits;
+            pVM->pgm.s.LiveSave.cHwDirtyHarvested = 0;
+            pVM->pgm.s.LiveSave.enmDirtyLog       = (uint8_t)enmDirtyLog;
+            pgmUnlock(pVM);
+        }
+        else
+            enmDirtyLog = PGMDIRTYLOG_WRITE_PROTECT;
+    }
+    if (enmDirtyLog != PGMDIRTYLOG_HW_DIRTY_BITS)
+        pVM->pgm.s.LiveSave.enmDirtyLog = (uint8_t)enmDirtyLog;
+
+    LogRel(("PGM: Live save dirty page tracking: %s\n",
+            enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS ? "nested page table dirty flags"
+            : enmDirtyLog == PGMDIRTYLOG_WRITE_PROTECT ? "write protecting the shadow page tables"
+            : "flushing the shadow page pool"));
+    return VINF_SUCCESS;
+}
+
+
 /**
  * @callback_method_impl{FNSSMINTLIVEPREP}
  *
@@ -2041,6 +2638,10 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
     pVM->pgm.s.LiveSave.cSavedPages       = 0;
     pVM->pgm.s.LiveSave.uSaveStartNS      = RTTimeNanoTS();
     pVM->pgm.s.LiveSave.cPagesPerSecond   = 8192;
+    pVM->pgm.s.LiveSave.cXbzrlePages      = 0;
+    pVM->pgm.s.LiveSave.cbXbzrle          = 0;
+    pVM->pgm.s.LiveSave.cDupPages         = 0;
+    pVM->pgm.s.LiveSave.fSaveCow          = false;
 
     /*
      * Per page type.
@@ -2050,8 +2651,27 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
         rc = pgmR3PrepMmio2Pages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepRamPages(pVM);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3PrepDirtyLog(pVM);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3StateXbzrleCreate(pVM);
+
+    /*
+     * Copy-on-write saving of the final pass if the caller allows it (see
+     * PGMSaveCow.cpp).  The write handlers don't mix with the shadow paging
+     * code's own monitoring of guest page tables, so nested paging is required.
+     */
+    if (   RT_SUCCESS(rc)
+        && pVM->pgm.s.fNestedPaging
+        && !pVM->pgm.s.LiveSave.fPostCopy
+        && !FTMIsDeltaLoadSaveActive(pVM)
+        && pVM->pgm.s.LiveSave.cSaveCowMaxQueued > 0
+        && RT_SUCCESS(SSMR3HandleDeferFinalExec(pSSM)))
+    {
+        pVM->pgm.s.LiveSave.fSaveCow = true;
+        LogRel(("PGM: Saving RAM copy-on-write after the VM has been resumed\n"));
+    }
 
-    NOREF(pSSM);
     return rc;
 }
 
@@ -2088,6 +2708,9 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
     {
         if (pVM->pgm.s.LiveSave.fActive)
         {
+            /* The VM is suspended, so we can harvest the dirty flags directly. */
+            if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+                pgmR3PoolHarvestDirtyBits(pVM);
             pgmR3ScanRomPages(pVM);
             pgmR3ScanMmio2Pages(pVM, SSM_PASS_FINAL);
             pgmR3ScanRamPages(pVM, true /*fFinalPass*/);
@@ -2097,6 +2720,21 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
                 rc = pgmR3SaveMmio2Pages(      pVM, pSSM, true /*fLiveSave*/, SSM_PASS_FINAL);
             if (RT_SUCCESS(rc))
                 rc = pgmR3SaveRamPages(        pVM, pSSM, true /*fLiveSave*/, SSM_PASS_FINAL);
+
+            /* In copy-on-write mode, pgmR3LiveExec saves the pages the final
+               pass skipped into a trailing instance of the unit after the VM
+               has been resumed.  If we cannot intercept the writes, we have
+               to save them right now and the trailer remains empty. */
+            if (RT_SUCCESS(rc) && pVM->pgm.s.LiveSave.fSaveCow)
+            {
+                rc = pgmR3SaveCowArm(pVM);
+                if (RT_FAILURE(rc))
+                {
+                    LogRel(("PGM: Failed to arm the copy-on-write save (%Rrc), saving the pages now\n", rc));
+                    rc = pgmR3SaveCowSavePages(pVM, pSSM);
+                }
+                SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_COW_TRAILER);
+            }
         }
         else
         {
@@ -2118,6 +2756,18 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
     }
 
     pgmUnlock(pVM);
+
+    /*
+     * The write monitoring and tracking structures of the live save are no
+     * longer needed when the VM continues before the save is done.
+     */
+    if (RT_SUCCESS(rc) && pVM->pgm.s.LiveSave.fSaveCow)
+    {
+        pgmR3DoneRomPages(pVM);
+        pgmR3DoneMmio2Pages(pVM);
+        pgmR3DoneRamPages(pVM);
+        pgmR3StateXbzrleDestroy(pVM);
+    }
     return rc;
 }
 
@@ -2135,7 +2785,12 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
         pgmR3DoneRomPages(pVM);
         pgmR3DoneMmio2Pages(pVM);
         pgmR3DoneRamPages(pVM);
+        pgmR3StateXbzrleDestroy(pVM);
+        LogRel(("PGM: Live save saved %u RAM pages as %RU64 bytes of deltas and %u as duplicates\n",
+                pVM->pgm.s.LiveSave.cXbzrlePages, pVM->pgm.s.LiveSave.cbXbzrle, pVM->pgm.s.LiveSave.cDupPages));
     }
+    pgmR3SaveCowDone(pVM);
+    pVM->pgm.s.LiveSave.fSaveCow = false;
 
     /*
      * Clear the live save indicator and disengage write monitoring.
@@ -2145,7 +2800,16 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     /** @todo this is blindly assuming that we're the only user of write
      *        monitoring. Fix this when more users are added. */
     pVM->pgm.s.fPhysWriteMonitoringEngaged = false;
+    uint64_t *pbmHwDirty = pVM->pgm.s.LiveSave.pbmHwDirtyR3;
+    if (pVM->pgm.s.LiveSave.enmDirtyLog == PGMDIRTYLOG_HW_DIRTY_BITS)
+        LogRel(("PGM: Harvested %u nested page table dirty flags during the live save\n",
+                pVM->pgm.s.LiveSave.cHwDirtyHarvested));
+    pVM->pgm.s.LiveSave.enmDirtyLog  = PGMDIRTYLOG_FLUSH_POOL;
+    pVM->pgm.s.LiveSave.pbmHwDirtyR3 = NULL;
+    pVM->pgm.s.LiveSave.cHwDirtyBits = 0;
     pgmUnlock(pVM);
+    if (pbmHwDirty)
+        MMR3HeapFree(pbmHwDirty);
 
     NOREF(pSSM);
     return VINF_SUCCESS;
@@ -2162,6 +2826,7 @@ static DECLCALLBACK(int) pgmR3LoadPrep(PVM pVM, PSSMHANDLE pSSM)
      */
     PGMR3Reset(pVM);
     pVM->pgm.s.LiveSave.fActive = false;
+    pVM->pgm.s.LiveSave.fLoadCowTrailer = false;
     NOREF(pSSM);
     return VINF_SUCCESS;
 }
@@ -2623,8 +3288,6 @@ static int pgmR3LoadMemoryOld(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion)
  */
 static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
 {
-    NOREF(uPass);
-
     /*
      * Process page records until we hit the terminator.
      */
@@ -2669,6 +3332,16 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             return VINF_SUCCESS;
         }
         AssertLogRelMsgReturn((u8 & ~PGM_STATE_REC_FLAG_ADDR) <= PGM_STATE_REC_LAST, ("%#x\n", u8), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+        if (u8 == PGM_STATE_REC_RAM_COW_TRAILER)
+        {
+            /* The rest of the RAM follows in a trailing instance of the unit. */
+            AssertLogRelMsgReturn(   uVersion > PGM_SAVED_STATE_VERSION_PRE_XBZRLE
+                                  && uPass == SSM_PASS_FINAL
+                                  && !pVM->pgm.s.LiveSave.fLoadCowTrailer,
+                                  ("uVersion=%u uPass=%#x\n", uVersion, uPass), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+            pVM->pgm.s.LiveSave.fLoadCowTrailer = true;
+            continue;
+        }
         switch (u8 & ~PGM_STATE_REC_FLAG_ADDR)
         {
             /*
@@ -2677,6 +3350,9 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             case PGM_STATE_REC_RAM_ZERO:
             case PGM_STATE_REC_RAM_RAW:
             case PGM_STATE_REC_RAM_BALLOONED:
+            case PGM_STATE_REC_RAM_POST_COPY:
+            case PGM_STATE_REC_RAM_XBZRLE:
+            case PGM_STATE_REC_RAM_DUP:
             {
                 /*
                  * Get the address and resolve it into a page descriptor.
@@ -2782,6 +3458,80 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
                         break;
                     }
 
+                    case PGM_STATE_REC_RAM_POST_COPY:
+                    {
+                        /* Only valid if the teleporter negotiated post-copy, the
+                           content is delivered by PGMR3PostCopyTrgPutPage. */
+                        AssertLogRelMsgReturn(pVM->pgm.s.LiveSave.fPostCopy, ("GCPhys=%RGp\n", GCPhys), VERR_PGM_SAVED_REC_TYPE);
+                        AssertLogRelMsgReturn(PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM,
+                                              ("GCPhys=%RGp %R[pgmpage]\n", GCPhys, pPage), VERR_PGM_LOAD_UNEXPECTED_PAGE_TYPE);
+                        rc = pgmR3PostCopyMarkPage(pVM, GCPhys);
+                        AssertLogRelRCReturn(rc, rc);
+                        break;
+                    }
+
+                    case PGM_STATE_REC_RAM_XBZRLE:
+                    {
+                        AssertLogRelMsgReturn(uVersion > PGM_SAVED_STATE_VERSION_PRE_XBZRLE, ("GCPhys=%RGp uVersion=%u\n", GCPhys, uVersion),
+                                              VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+
+                        /* The page holds what was saved for it earlier in the stream. */
+                        uint16_t cbDelta;
+                        rc = SSMR3GetU16(pSSM, &cbDelta);
+                        if (RT_FAILURE(rc))
+                            return rc;
+                        AssertLogRelMsgReturn(cbDelta <= PAGE_SIZE, ("GCPhys=%RGp cbDelta=%#x\n", GCPhys, cbDelta),
+                                              VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+                        if (!cbDelta)
+                            break;
+                        uint8_t abDelta[PAGE_SIZE];
+                        rc = SSMR3GetMem(pSSM, abDelta, cbDelta);
+                        if (RT_FAILURE(rc))
+                            return rc;
+
+                        PGMPAGEMAPLOCK PgMpLck;
+                        void          *pvDstPage;
+                        rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp %R[pgmpage] rc=%Rrc\n", GCPhys, pPage, rc), rc);
+                        rc = pgmR3StateXbzrleDecode(abDelta, cbDelta, (uint8_t *)pvDstPage);
+                        pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc), rc);
+                        break;
+                    }
+
+                    case PGM_STATE_REC_RAM_DUP:
+                    {
+                        AssertLogRelMsgReturn(uVersion > PGM_SAVED_STATE_VERSION_PRE_XBZRLE, ("GCPhys=%RGp uVersion=%u\n", GCPhys, uVersion),
+                                              VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+
+                        RTGCPHYS GCPhysSrc;
+                        rc = SSMR3GetGCPhys(pSSM, &GCPhysSrc);
+                        if (RT_FAILURE(rc))
+                            return rc;
+                        AssertLogRelMsgReturn(!(GCPhysSrc & PAGE_OFFSET_MASK) && GCPhysSrc != GCPhys,
+                                              ("GCPhys=%RGp GCPhysSrc=%RGp\n", GCPhys, GCPhysSrc), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+                        PPGMPAGE pSrcPage;
+                        rc = pgmPhysGetPageEx(pVM, GCPhysSrc, &pSrcPage);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc %RGp\n", rc, GCPhysSrc), rc);
+
+                        /* Copy it via a buffer so we don't hold two page mapping
+                           locks at the same time. */
+                        uint8_t         abPage[PAGE_SIZE];
+                        PGMPAGEMAPLOCK  PgMpLck;
+                        void const     *pvSrcPage;
+                        rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pSrcPage, GCPhysSrc, &pvSrcPage, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhysSrc=%RGp %R[pgmpage] rc=%Rrc\n", GCPhysSrc, pSrcPage, rc), rc);
+                        memcpy(abPage, pvSrcPage, PAGE_SIZE);
+                        pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+
+                        void          *pvDstPage;
+                        rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp %R[pgmpage] rc=%Rrc\n", GCPhys, pPage, rc), rc);
+                        memcpy(pvDstPage, abPage, PAGE_SIZE);
+                        pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                        break;
+                    }
+
                     default:
                         AssertMsgFailedReturn(("%#x\n", u8), VERR_PGM_SAVED_REC_TYPE);
                 }
@@ -3144,11 +3894,13 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
      */
     if (   (   uPass != SSM_PASS_FINAL
             && uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_XBZRLE
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
             && uVersion != PGM_SAVED_STATE_VERSION_NO_RAM_CFG)
         || (   uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_XBZRLE
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
@@ -3188,6 +3940,25 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
         }
         pgmUnlock(pVM);
     }
+    else if (pVM->pgm.s.LiveSave.fLoadCowTrailer)
+    {
+        /*
+         * The trailing instance of a copy-on-write save.  Only RAM pages,
+         * everything else was restored by the regular final pass.
+         */
+        pgmLock(pVM);
+        rc = pgmR3LoadMemory(pVM, pSSM, uVersion, SSM_PASS_FINAL);
+        pVM->pgm.s.LiveSave.fLoadCowTrailer = false;
+        pgmUnlock(pVM);
+        if (RT_SUCCESS(rc))
+            for (VMCPUID i = 0; i < pVM->cCpus; i++)
+            {
+                PVMCPU pVCpu = &pVM->aCpus[i];
+                VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3_NON_GLOBAL);
+                VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3);
+                pVCpu->pgm.s.fSyncFlags |= PGM_SYNC_UPDATE_PAGE_BIT_VIRTUAL;
+            }
+    }
     else
     {
         pgmLock(pVM);
@@ -3306,7 +4077,12 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
 static DECLCALLBACK(int) pgmR3LoadDone(PVM pVM, PSSMHANDLE pSSM)
 {
     pVM->pgm.s.fRestoreRomPagesOnReset = true;
-    NOREF(pSSM);
+    if (pVM->pgm.s.LiveSave.fLoadCowTrailer)
+    {
+        pVM->pgm.s.LiveSave.fLoadCowTrailer = false;
+        return SSMR3SetLoadError(pSSM, VERR_SSM_LOADED_TOO_LITTLE, RT_SRC_POS,
+                                 N_("The RAM saved after the VM was resumed is missing"));
+    }
     return VINF_SUCCESS;
 }
 
@@ -127,6 +127,14 @@
  * based. The unit header contained the compressed size of the data, i.e. it
  * needed updating after the data was written.)
  *
+ * The LZF records are compressed and decompressed by a small pool of worker
+ * threads (SSMZIPPOOL) when the host has more than one CPU, the number of
+ * threads can be configured with the SSM/ZipThreads CFGM key.  The records
+ * are queued up in a ring and retired in order, so the stream is identical to
+ * the one produced by the calling thread alone.  When loading, a batch of
+ * records up to the end of the unit is read ahead and the LZF ones are
+ * decompressed in parallel.
+ *
  *
  * @section sec_ssm_future          Future Changes
  *
@@ -149,6 +157,7 @@
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/vmm/pdmcritsect.h>
 #include <VBox/vmm/mm.h>
+#include <VBox/vmm/cfgm.h>
 #include "SSMInternal.h"
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
@@ -161,6 +170,7 @@
 #include <iprt/crc.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/param.h>
 #include <iprt/thread.h>
 #include <iprt/semaphore.h>
@@ -285,6 +295,25 @@
 #define SSM_ZIP_BLOCK_SIZE                      _4K
 AssertCompile(SSM_ZIP_BLOCK_SIZE / _1K * _1K == SSM_ZIP_BLOCK_SIZE);
 
+/** The number of slots in the parallel (de)compression ring.
+ * Must be a power of two. */
+#define SSM_ZIP_SLOTS                           64
+AssertCompile(RT_IS_POWER_OF_TWO(SSM_ZIP_SLOTS));
+/** The max number of (de)compression worker threads. */
+#define SSM_ZIP_MAX_THREADS                     8
+
+/** @name SSMZIPSLOT_STATE_XXX - Parallel (de)compression slot states.
+ * @{ */
+/** The slot is free. */
+#define SSMZIPSLOT_STATE_FREE                   UINT32_C(0)
+/** The slot is waiting for a worker. */
+#define SSMZIPSLOT_STATE_PENDING                UINT32_C(1)
+/** A worker (or the EMT) is processing the slot. */
+#define SSMZIPSLOT_STATE_BUSY                   UINT32_C(2)
+/** The slot is ready to be retired. */
+#define SSMZIPSLOT_STATE_DONE                   UINT32_C(3)
+/** @} */
+
 
 /**
  * Asserts that the handle is writable and returns with VERR_SSM_INVALID_STATE
@@ -355,6 +384,7 @@ typedef enum SSMSTATE
     SSMSTATE_LIVE_STEP2,
     SSMSTATE_SAVE_PREP,
     SSMSTATE_SAVE_EXEC,
+    SSMSTATE_LIVE_STEP3,
     SSMSTATE_SAVE_DONE,
     SSMSTATE_LOAD_PREP,
     SSMSTATE_LOAD_EXEC,
@@ -447,6 +477,73 @@ typedef struct SSMSTRM
 typedef SSMSTRM *PSSMSTRM;
 
 
+/**
+ * A slot in the parallel (de)compression ring.
+ *
+ * When saving, the EMT copies a block of SSM_ZIP_BLOCK_SIZE bytes into abSrc
+ * and a worker turns it into a complete record in abDst.  When loading, the
+ * EMT copies the payload of a LZF record into abSrc and a worker decompresses
+ * it into abDst.  Records which don't need any work go straight into abDst.
+ */
+typedef struct SSMZIPSLOT
+{
+    /** The slot state, SSMZIPSLOT_STATE_XXX. */
+    uint32_t volatile       u32State;
+    /** The status of the (de)compression job. */
+    int32_t                 rc;
+    /** The number of bytes in abSrc.  When saving, this is the number of
+     * user bytes the record represents (for the progress indicator). */
+    uint32_t                cbSrc;
+    /** The number of bytes in abDst. */
+    uint32_t                cbDst;
+    /** Load: The type and flags byte of the record. */
+    uint8_t                 u8TypeAndFlags;
+    /** Load: The payload was left in the stream, cbDst is the record size. */
+    bool                    fInStream;
+    /** The input buffer. */
+    uint8_t                 abSrc[SSM_ZIP_BLOCK_SIZE + 16];
+    /** The output buffer (save: header, LZF size byte and data). */
+    uint8_t                 abDst[1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE];
+} SSMZIPSLOT;
+/** Pointer to a parallel (de)compression slot. */
+typedef SSMZIPSLOT *PSSMZIPSLOT;
+
+
+/**
+ * Parallel (de)compression worker pool.
+ *
+ * The thread owning the saved state handle is the only one submitting and
+ * retiring slots; the workers claim pending slots in submission order and mark
+ * them done.  Since slots are always retired in submission order, the stream
+ * ends up byte for byte identical to what the serial code produces.
+ */
+typedef struct SSMZIPPOOL
+{
+    /** Set when saving, clear when loading. */
+    bool                    fWrite;
+    /** Termination indicator. */
+    bool volatile           fTerminating;
+    /** The number of worker threads. */
+    uint32_t                cThreads;
+    /** Event the workers wait on for more work. */
+    RTSEMEVENT              hEvtWork;
+    /** Event signalled whenever a slot is done. */
+    RTSEMEVENT              hEvtDone;
+    /** The submission counter. */
+    uint32_t volatile       iSubmit;
+    /** The claim counter (workers). */
+    uint32_t volatile       iClaim;
+    /** The retire counter. */
+    uint32_t                iRetire;
+    /** The worker threads. */
+    RTTHREAD                ahThreads[SSM_ZIP_MAX_THREADS];
+    /** The slot ring. */
+    SSMZIPSLOT              aSlots[SSM_ZIP_SLOTS];
+} SSMZIPPOOL;
+/** Pointer to a parallel (de)compression worker pool. */
+typedef SSMZIPPOOL *PSSMZIPPOOL;
+
+
 /**
  * Handle structure.
  */
@@ -454,6 +551,8 @@ typedef struct SSMHANDLE
 {
     /** Stream/buffer manager. */
     SSMSTRM                 Strm;
+    /** The parallel (de)compression pool, NULL if not used. */
+    PSSMZIPPOOL             pZipPool;
 
     /** Pointer to the VM. */
     PVM                     pVM;
@@ -514,6 +613,17 @@ typedef struct SSMHANDLE
             uint8_t         abDataBuffer[4096];
             /** The maximum downtime given as milliseconds. */
             uint32_t        cMsMaxDowntime;
+            /** Set by SSMR3LiveAllowDeferredExec if the caller is prepared to
+             * drive SSMR3LiveDoStep3 after the VM has been resumed. */
+            bool            fDeferredExecAllowed;
+            /** Set once SSMR3LiveDoStep3 has completed the deferred unit. */
+            bool            fDeferredExecDone;
+            /** The unit whose pfnLivePrep callback is currently executing.
+             * (Only valid during ssmR3DoLivePrepRun.) */
+            PSSMUNIT        pCurUnit;
+            /** The unit which asked for its final pass to be deferred, NULL if
+             * none. */
+            PSSMUNIT        pDeferredUnit;
         } Write;
 
         /** Read data. */
@@ -536,6 +646,11 @@ typedef struct SSMHANDLE
             bool            fEndOfData;
             /** V2: The type and flags byte fo the current record. */
             uint8_t         u8TypeAndFlags;
+            /** V2: The pool slot the current record is read from, NULL if it is
+             * read from the stream. */
+            PSSMZIPSLOT     pZipSlot;
+            /** V2: The read offset into pZipSlot->abDst. */
+            uint32_t        offZipSlot;
 
             /** @name Context info for SSMR3SetLoadError.
              * @{  */
@@ -892,7 +1007,9 @@ static int                  ssmR3StrmWriteBuffers(PSSMSTRM pStrm);
 static int                  ssmR3StrmReadMore(PSSMSTRM pStrm);
 
 #ifndef SSM_STANDALONE
+static void                 ssmR3ZipPoolDestroy(PSSMHANDLE pSSM);
 static int                  ssmR3DataFlushBuffer(PSSMHANDLE pSSM);
+static int                  ssmR3SaveDoFinalization(PVM pVM, PSSMHANDLE pSSM);
 #endif
 static int                  ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM);
 
@@ -3172,6 +3289,252 @@ static void ssmR3StrmStopIoThread(PSSMSTRM pStrm)
 
 #endif /* !SSM_STANDALONE */
 
+/**
+ * Turns a block of SSM_ZIP_BLOCK_SIZE bytes into a LZF record, falling back on
+ * a raw record if it doesn't compress.
+ *
+ * @returns The size of the record, header included.
+ * @param   pvBlock         The block.
+ * @param   pbRec           Where to put the record.  Must have room for
+ *                          1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE bytes.
+ */
+static size_t ssmR3DataZipBlock(const void *pvBlock, uint8_t *pbRec)
+{
+    AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
+    size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
+    int rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
+                                pvBlock, SSM_ZIP_BLOCK_SIZE,
+                                pbRec + 1 + 3 + 1, cbRec, &cbRec);
+    if (RT_SUCCESS(rc))
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
+        pbRec[4] = SSM_ZIP_BLOCK_SIZE / _1K;
+        cbRec += 1;
+    }
+    else
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
+        memcpy(&pbRec[4], pvBlock, SSM_ZIP_BLOCK_SIZE);
+        cbRec = SSM_ZIP_BLOCK_SIZE;
+    }
+    pbRec[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
+    pbRec[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
+    pbRec[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
+    return cbRec + 1 + 3;
+}
+
+
+/**
+ * Does the (de)compression job of a slot and marks it done.
+ *
+ * @param   pPool       The pool.
+ * @param   pSlot       The slot, in the busy state.
+ */
+static void ssmR3ZipProcessSlot(PSSMZIPPOOL pPool, PSSMZIPSLOT pSlot)
+{
+    Assert(ASMAtomicReadU32(&pSlot->u32State) == SSMZIPSLOT_STATE_BUSY);
+    if (pPool->fWrite)
+    {
+        pSlot->cbDst = (uint32_t)ssmR3DataZipBlock(pSlot->abSrc, pSlot->abDst);
+        pSlot->rc    = VINF_SUCCESS;
+    }
+    else
+    {
+        size_t cbDstActual = 0;
+        int rc = RTZipBlockDecompress(RTZIPTYPE_LZF, 0 /*fFlags*/,
+                                      pSlot->abSrc, pSlot->cbSrc, NULL /*pcbSrcActual*/,
+                                      pSlot->abDst, pSlot->cbDst, &cbDstActual);
+        if (RT_FAILURE(rc) || cbDstActual != pSlot->cbDst)
+        {
+            LogRel(("SSM: Decompression failed: cbCompr=%#x cbDecompr=%#x cbDstActual=%#zx rc=%Rrc\n",
+                    pSlot->cbSrc, pSlot->cbDst, cbDstActual, rc));
+            rc = VERR_SSM_INTEGRITY_DECOMPRESSION;
+        }
+        pSlot->rc = rc;
+    }
+    ASMAtomicWriteU32(&pSlot->u32State, SSMZIPSLOT_STATE_DONE);
+    RTSemEventSignal(pPool->hEvtDone);
+}
+
+
+#ifndef SSM_STANDALONE
+/**
+ * Parallel (de)compression worker thread.
+ *
+ * @returns VINF_SUCCESS
+ * @param   hSelf       The thread handle.
+ * @param   pvUser      The pool.
+ */
+static DECLCALLBACK(int) ssmR3ZipThread(RTTHREAD hSelf, void *pvUser)
+{
+    PSSMZIPPOOL pPool = (PSSMZIPPOOL)pvUser;
+    NOREF(hSelf);
+
+    while (!ASMAtomicReadBool(&pPool->fTerminating))
+    {
+        uint32_t const iClaim = ASMAtomicReadU32(&pPool->iClaim);
+        if (iClaim == ASMAtomicReadU32(&pPool->iSubmit))
+        {
+            RTSemEventWait(pPool->hEvtWork, RT_INDEFINITE_WAIT);
+            continue;
+        }
+        if (!ASMAtomicCmpXchgU32(&pPool->iClaim, iClaim + 1, iClaim))
+            continue;
+
+        /* Kick a sibling if there is more work, then do the job unless the
+           slot didn't need any or the EMT got impatient and took it. */
+        if (iClaim + 1 != ASMAtomicReadU32(&pPool->iSubmit))
+            RTSemEventSignal(pPool->hEvtWork);
+        PSSMZIPSLOT pSlot = &pPool->aSlots[iClaim % SSM_ZIP_SLOTS];
+        if (ASMAtomicCmpXchgU32(&pSlot->u32State, SSMZIPSLOT_STATE_BUSY, SSMZIPSLOT_STATE_PENDING))
+            ssmR3ZipProcessSlot(pPool, pSlot);
+    }
+
+    /* The event may only have been signalled once, pass it on. */
+    RTSemEventSignal(pPool->hEvtWork);
+    return VINF_SUCCESS;
+}
+#endif /* !SSM_STANDALONE */
+
+
+/**
+ * Submits the next slot in the ring.
+ *
+ * @param   pPool       The pool.
+ * @param   pSlot       The slot, must be the one at iSubmit.
+ * @param   fProcess    Whether the slot needs (de)compressing or whether it's
+ *                      ready to be retired as is.
+ */
+static void ssmR3ZipSubmit(PSSMZIPPOOL pPool, PSSMZIPSLOT pSlot, bool fProcess)
+{
+    Assert(pSlot == &pPool->aSlots[pPool->iSubmit % SSM_ZIP_SLOTS]);
+    Assert(pPool->iSubmit - pPool->iRetire < SSM_ZIP_SLOTS);
+    ASMAtomicWriteU32(&pSlot->u32State, fProcess ? SSMZIPSLOT_STATE_PENDING : SSMZIPSLOT_STATE_DONE);
+    ASMAtomicIncU32(&pPool->iSubmit);
+    if (fProcess)
+        RTSemEventSignal(pPool->hEvtWork);
+}
+
+
+/**
+ * Waits for a slot to become done, doing the job on the calling thread if no
+ * worker has picked it up yet.
+ *
+ * @param   pPool       The pool.
+ * @param   pSlot       The slot.
+ */
+static void ssmR3ZipWaitForSlot(PSSMZIPPOOL pPool, PSSMZIPSLOT pSlot)
+{
+    if (ASMAtomicCmpXchgU32(&pSlot->u32State, SSMZIPSLOT_STATE_BUSY, SSMZIPSLOT_STATE_PENDING))
+        ssmR3ZipProcessSlot(pPool, pSlot);
+    while (ASMAtomicReadU32(&pSlot->u32State) != SSMZIPSLOT_STATE_DONE)
+        RTSemEventWait(pPool->hEvtDone, RT_INDEFINITE_WAIT);
+}
+
+
+/**
+ * Waits for all submitted slots and frees them without retiring them.
+ *
+ * @param   pPool       The pool.
+ */
+static void ssmR3ZipDiscard(PSSMZIPPOOL pPool)
+{
+    while (pPool->iRetire != pPool->iSubmit)
+    {
+        PSSMZIPSLOT pSlot = &pPool->aSlots[pPool->iRetire % SSM_ZIP_SLOTS];
+        ssmR3ZipWaitForSlot(pPool, pSlot);
+        ASMAtomicWriteU32(&pSlot->u32State, SSMZIPSLOT_STATE_FREE);
+        pPool->iRetire++;
+    }
+}
+
+
+#ifndef SSM_STANDALONE
+/**
+ * Creates the parallel (de)compression pool for a handle.
+ *
+ * The number of worker threads defaults to one less than the number of online
+ * host CPUs and can be configured with the SSM/ZipThreads CFGM key, zero
+ * disables the pool.  Failing to create the pool isn't fatal, the data is then
+ * (de)compressed on the calling thread like before.
+ *
+ * @param   pSSM        The saved state handle.
+ * @param   fWrite      Set when saving, clear when loading.
+ */
+static void ssmR3ZipPoolCreate(PSSMHANDLE pSSM, bool fWrite)
+{
+    Assert(!pSSM->pZipPool);
+
+    uint32_t cThreads;
+    int rc = CFGMR3QueryU32Def(CFGMR3GetChild(CFGMR3GetRoot(pSSM->pVM), "SSM"), "ZipThreads", &cThreads, UINT32_MAX);
+    AssertLogRelRCReturnVoid(rc);
+    if (cThreads == UINT32_MAX)
+    {
+        RTCPUID const cCpus = RTMpGetOnlineCount();
+        cThreads = cCpus > 1 ? (uint32_t)cCpus - 1 : 0;
+    }
+    cThreads = RT_MIN(cThreads, SSM_ZIP_MAX_THREADS);
+    if (!cThreads)
+        return;
+
+    PSSMZIPPOOL pPool = (PSSMZIPPOOL)RTMemAllocZ(sizeof(*pPool));
+    AssertReturnVoid(pPool);
+    pPool->fWrite       = fWrite;
+    pPool->fTerminating = false;
+    pPool->cThreads     = 0;
+    pPool->hEvtWork     = NIL_RTSEMEVENT;
+    pPool->hEvtDone     = NIL_RTSEMEVENT;
+    rc = RTSemEventCreate(&pPool->hEvtWork);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPool->hEvtDone);
+    while (RT_SUCCESS(rc) && pPool->cThreads < cThreads)
+    {
+        rc = RTThreadCreateF(&pPool->ahThreads[pPool->cThreads], ssmR3ZipThread, pPool, 0, RTTHREADTYPE_DEFAULT,
+                             RTTHREADFLAGS_WAITABLE, "SSM-Zip%u", pPool->cThreads);
+        if (RT_SUCCESS(rc))
+            pPool->cThreads++;
+    }
+
+    pSSM->pZipPool = pPool;
+    if (pPool->cThreads)
+        LogRel(("SSM: Using %u %s threads\n", pPool->cThreads, fWrite ? "compression" : "decompression"));
+    else
+    {
+        LogRel(("SSM: Failed to create the %s pool: %Rrc\n", fWrite ? "compression" : "decompression", rc));
+        ssmR3ZipPoolDestroy(pSSM);
+    }
+}
+
+
+/**
+ * Destroys the parallel (de)compression pool of a handle, if any.
+ *
+ * Any slots not yet retired are discarded.
+ *
+ * @param   pSSM        The saved state handle.
+ */
+static void ssmR3ZipPoolDestroy(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    if (!pPool)
+        return;
+    pSSM->pZipPool = NULL;
+
+    ASMAtomicWriteBool(&pPool->fTerminating, true);
+    if (pPool->hEvtWork != NIL_RTSEMEVENT)
+        RTSemEventSignal(pPool->hEvtWork);
+    for (uint32_t i = 0; i < pPool->cThreads; i++)
+    {
+        int rc = RTThreadWait(pPool->ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+        AssertLogRelRC(rc);
+    }
+    RTSemEventDestroy(pPool->hEvtWork);
+    RTSemEventDestroy(pPool->hEvtDone);
+    RTMemFree(pPool);
+}
+#endif /* !SSM_STANDALONE */
+
+
 /**
  * Works the progress calculation for non-live saves and restores.
  *
@@ -3311,6 +3674,156 @@ static void ssmR3DataWriteBegin(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Encodes a record header for the specified amount of data.
+ *
+ * @returns The size of the header, 0 if @a cb is too big.
+ * @param   pbHdr           Where to put the header.  Must have room for 7
+ *                          bytes.
+ * @param   cb              The amount of data.
+ * @param   u8TypeAndFlags  The record type and flags.
+ */
+static size_t ssmR3DataEncodeRecHdr(uint8_t *pbHdr, size_t cb, uint8_t u8TypeAndFlags)
+{
+    size_t  cbHdr;
+    pbHdr[0] = u8TypeAndFlags;
+    if (cb < 0x80)
+    {
+        cbHdr = 2;
+        pbHdr[1] = (uint8_t)cb;
+    }
+    else if (cb < 0x00000800)
+    {
+        cbHdr = 3;
+        pbHdr[1] = (uint8_t)(0xc0 | (cb >> 6));
+        pbHdr[2] = (uint8_t)(0x80 | (cb & 0x3f));
+    }
+    else if (cb < 0x00010000)
+    {
+        cbHdr = 4;
+        pbHdr[1] = (uint8_t)(0xe0 | (cb >> 12));
+        pbHdr[2] = (uint8_t)(0x80 | ((cb >> 6) & 0x3f));
+        pbHdr[3] = (uint8_t)(0x80 | (cb & 0x3f));
+    }
+    else if (cb < 0x00200000)
+    {
+        cbHdr = 5;
+        pbHdr[1] = (uint8_t)(0xf0 |  (cb >> 18));
+        pbHdr[2] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
+        pbHdr[3] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
+        pbHdr[4] = (uint8_t)(0x80 |  (cb        & 0x3f));
+    }
+    else if (cb < 0x04000000)
+    {
+        cbHdr = 6;
+        pbHdr[1] = (uint8_t)(0xf8 |  (cb >> 24));
+        pbHdr[2] = (uint8_t)(0x80 | ((cb >> 18) & 0x3f));
+        pbHdr[3] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
+        pbHdr[4] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
+        pbHdr[5] = (uint8_t)(0x80 |  (cb        & 0x3f));
+    }
+    else if (cb <= 0x7fffffff)
+    {
+        cbHdr = 7;
+        pbHdr[1] = (uint8_t)(0xfc |  (cb >> 30));
+        pbHdr[2] = (uint8_t)(0x80 | ((cb >> 24) & 0x3f));
+        pbHdr[3] = (uint8_t)(0x80 | ((cb >> 18) & 0x3f));
+        pbHdr[4] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
+        pbHdr[5] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
+        pbHdr[6] = (uint8_t)(0x80 | (cb & 0x3f));
+    }
+    else
+        cbHdr = 0;
+    return cbHdr;
+}
+
+
+/**
+ * Writes completed records in the compression pool to the stream.
+ *
+ * The records are retired strictly in submission order.  This returns when
+ * the oldest record isn't done yet and no more than @a cMaxPending records
+ * are outstanding, otherwise it waits for it.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   cMaxPending     The max number of records to leave outstanding.
+ */
+static int ssmR3DataWriteZipRetire(PSSMHANDLE pSSM, uint32_t cMaxPending)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    while (pPool->iRetire != pPool->iSubmit)
+    {
+        PSSMZIPSLOT pSlot = &pPool->aSlots[pPool->iRetire % SSM_ZIP_SLOTS];
+        if (ASMAtomicReadU32(&pSlot->u32State) != SSMZIPSLOT_STATE_DONE)
+        {
+            if (pPool->iSubmit - pPool->iRetire <= cMaxPending)
+                break;
+            ssmR3ZipWaitForSlot(pPool, pSlot);
+        }
+
+        Log3(("ssmR3DataWriteZipRetire: %08llx|%08llx/%08x: Type=%02x\n",
+              ssmR3StrmTell(&pSSM->Strm), pSSM->offUnit, pSlot->cbDst, pSlot->abDst[0] & SSM_REC_TYPE_MASK));
+        int rc = ssmR3StrmWrite(&pSSM->Strm, pSlot->abDst, pSlot->cbDst);
+        if (RT_FAILURE(rc))
+            return rc;
+        pSSM->offUnit += pSlot->cbDst;
+        ssmR3ProgressByByte(pSSM, pSlot->cbSrc);
+
+        ASMAtomicWriteU32(&pSlot->u32State, SSMZIPSLOT_STATE_FREE);
+        pPool->iRetire++;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the next free slot in the compression pool, writing out completed
+ * records and waiting for the oldest if the ring is full.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   ppSlot          Where to return the slot.
+ */
+static int ssmR3DataWriteZipGetSlot(PSSMHANDLE pSSM, PSSMZIPSLOT *ppSlot)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    int rc = ssmR3DataWriteZipRetire(pSSM, SSM_ZIP_SLOTS - 1);
+    if (RT_SUCCESS(rc))
+        *ppSlot = &pPool->aSlots[pPool->iSubmit % SSM_ZIP_SLOTS];
+    return rc;
+}
+
+
+/**
+ * Queues up a record which doesn't need compressing in the compression pool.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   u8TypeAndFlags  The record type and flags.
+ * @param   pvPayload       The record payload.
+ * @param   cbPayload       The size of the payload, SSM_ZIP_BLOCK_SIZE max.
+ * @param   cbUser          The number of user bytes the record represents.
+ */
+static int ssmR3DataWriteZipRec(PSSMHANDLE pSSM, uint8_t u8TypeAndFlags, const void *pvPayload, uint32_t cbPayload,
+                                uint32_t cbUser)
+{
+    Assert(cbPayload <= SSM_ZIP_BLOCK_SIZE);
+    PSSMZIPSLOT pSlot;
+    int rc = ssmR3DataWriteZipGetSlot(pSSM, &pSlot);
+    if (RT_SUCCESS(rc))
+    {
+        size_t cbHdr = ssmR3DataEncodeRecHdr(pSlot->abDst, cbPayload, u8TypeAndFlags);
+        Assert(cbHdr && cbHdr + cbPayload <= sizeof(pSlot->abDst));
+        memcpy(&pSlot->abDst[cbHdr], pvPayload, cbPayload);
+        pSlot->cbDst = (uint32_t)(cbHdr + cbPayload);
+        pSlot->cbSrc = cbUser;
+        ssmR3ZipSubmit(pSSM->pZipPool, pSlot, false /*fProcess*/);
+    }
+    return rc;
+}
+
+
 /**
  * Writes a record to the current data item in the saved state file.
  *
@@ -3330,6 +3843,16 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
     if (RT_FAILURE(pSSM->rc))
         return pSSM->rc;
 
+    /*
+     * Records still in the compression pool goes first.
+     */
+    if (pSSM->pZipPool)
+    {
+        int rc = ssmR3DataWriteZipRetire(pSSM, 0 /*cMaxPending*/);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
     /*
      * Write the data item in 1MB chunks for progress indicator reasons.
      */
@@ -3358,56 +3881,9 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
  */
 static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFlags)
 {
-    size_t  cbHdr;
     uint8_t abHdr[8];
-    abHdr[0] = u8TypeAndFlags;
-    if (cb < 0x80)
-    {
-        cbHdr = 2;
-        abHdr[1] = (uint8_t)cb;
-    }
-    else if (cb < 0x00000800)
-    {
-        cbHdr = 3;
-        abHdr[1] = (uint8_t)(0xc0 | (cb >> 6));
-        abHdr[2] = (uint8_t)(0x80 | (cb & 0x3f));
-    }
-    else if (cb < 0x00010000)
-    {
-        cbHdr = 4;
-        abHdr[1] = (uint8_t)(0xe0 | (cb >> 12));
-        abHdr[2] = (uint8_t)(0x80 | ((cb >> 6) & 0x3f));
-        abHdr[3] = (uint8_t)(0x80 | (cb & 0x3f));
-    }
-    else if (cb < 0x00200000)
-    {
-        cbHdr = 5;
-        abHdr[1] = (uint8_t)(0xf0 |  (cb >> 18));
-        abHdr[2] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
-        abHdr[3] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
-        abHdr[4] = (uint8_t)(0x80 |  (cb        & 0x3f));
-    }
-    else if (cb < 0x04000000)
-    {
-        cbHdr = 6;
-        abHdr[1] = (uint8_t)(0xf8 |  (cb >> 24));
-        abHdr[2] = (uint8_t)(0x80 | ((cb >> 18) & 0x3f));
-        abHdr[3] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
-        abHdr[4] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
-        abHdr[5] = (uint8_t)(0x80 |  (cb        & 0x3f));
-    }
-    else if (cb <= 0x7fffffff)
-    {
-        cbHdr = 7;
-        abHdr[1] = (uint8_t)(0xfc |  (cb >> 30));
-        abHdr[2] = (uint8_t)(0x80 | ((cb >> 24) & 0x3f));
-        abHdr[3] = (uint8_t)(0x80 | ((cb >> 18) & 0x3f));
-        abHdr[4] = (uint8_t)(0x80 | ((cb >> 12) & 0x3f));
-        abHdr[5] = (uint8_t)(0x80 | ((cb >>  6) & 0x3f));
-        abHdr[6] = (uint8_t)(0x80 | (cb & 0x3f));
-    }
-    else
-        AssertLogRelMsgFailedReturn(("cb=%#x\n", cb), pSSM->rc = VERR_SSM_MEM_TOO_BIG);
+    size_t  cbHdr = ssmR3DataEncodeRecHdr(abHdr, cb, u8TypeAndFlags);
+    AssertLogRelMsgReturn(cbHdr, ("cb=%#x\n", cb), pSSM->rc = VERR_SSM_MEM_TOO_BIG);
 
     Log3(("ssmR3DataWriteRecHdr: %08llx|%08llx/%08x: Type=%02x fImportant=%RTbool cbHdr=%u\n",
           ssmR3StrmTell(&pSSM->Strm) + cbHdr, pSSM->offUnit + cbHdr, cb, u8TypeAndFlags & SSM_REC_TYPE_MASK, !!(u8TypeAndFlags & SSM_REC_FLAGS_IMPORTANT), cbHdr));
@@ -3417,12 +3893,13 @@ static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFla
 
 
 /**
- * Worker that flushes the buffered data.
+ * Worker that writes the buffered data as a record, or queues it up in the
+ * compression pool behind the records already there.
  *
  * @returns VBox status code. Will set pSSM->rc on error.
  * @param   pSSM            The saved state handle.
  */
-static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
+static int ssmR3DataSubmitBuffer(PSSMHANDLE pSSM)
 {
     /*
      * Check how much there current is in the buffer.
@@ -3432,6 +3909,10 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
         return pSSM->rc;
     pSSM->u.Write.offDataBuffer = 0;
 
+    if (pSSM->pZipPool)
+        return ssmR3DataWriteZipRec(pSSM, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW,
+                                    pSSM->u.Write.abDataBuffer, cb, cb);
+
     /*
      * Write a record header and then the data.
      * (No need for fancy optimizations here any longer since the stream is
@@ -3445,6 +3926,22 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Worker that flushes the buffered data and any records still in the
+ * compression pool to the stream.
+ *
+ * @returns VBox status code. Will set pSSM->rc on error.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
+{
+    int rc = ssmR3DataSubmitBuffer(pSSM);
+    if (RT_SUCCESS(rc) && pSSM->pZipPool)
+        rc = ssmR3DataWriteZipRetire(pSSM, 0 /*cMaxPending*/);
+    return rc;
+}
+
+
 /**
  * ssmR3DataWrite worker that writes big stuff.
  *
@@ -3455,7 +3952,7 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
  */
 static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
+    int rc = ssmR3DataSubmitBuffer(pSSM);
     if (RT_SUCCESS(rc))
     {
         pSSM->offUnitUser += cbBuf;
@@ -3472,39 +3969,33 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
                )
             {
                 /*
-                 * Compress it.
+                 * Compress it, preferably on one of the pool threads.
                  */
-                AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
-                uint8_t *pb;
-                rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
-                if (RT_FAILURE(rc))
-                    break;
-                size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
-                rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
-                                        pvBuf, SSM_ZIP_BLOCK_SIZE,
-                                        pb + 1 + 3 + 1, cbRec, &cbRec);
-                if (RT_SUCCESS(rc))
+                PSSMZIPPOOL pPool = pSSM->pZipPool;
+                if (pPool)
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
-                    pb[4] = SSM_ZIP_BLOCK_SIZE / _1K;
-                    cbRec += 1;
+                    PSSMZIPSLOT pSlot;
+                    rc = ssmR3DataWriteZipGetSlot(pSSM, &pSlot);
+                    if (RT_FAILURE(rc))
+                        break;
+                    memcpy(pSlot->abSrc, pvBuf, SSM_ZIP_BLOCK_SIZE);
+                    pSlot->cbSrc = SSM_ZIP_BLOCK_SIZE;
+                    ssmR3ZipSubmit(pPool, pSlot, true /*fProcess*/);
                 }
                 else
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
-                    memcpy(&pb[4], pvBuf, SSM_ZIP_BLOCK_SIZE);
-                    cbRec = SSM_ZIP_BLOCK_SIZE;
-                }
-                pb[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
-                pb[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
-                pb[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
-                cbRec += 1 + 3;
-                rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
-                if (RT_FAILURE(rc))
-                    break;
+                    uint8_t *pb;
+                    rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
+                    if (RT_FAILURE(rc))
+                        break;
+                    size_t cbRec = ssmR3DataZipBlock(pvBuf, pb);
+                    rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
+                    if (RT_FAILURE(rc))
+                        break;
 
-                pSSM->offUnit += cbRec;
-                ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
+                    pSSM->offUnit += cbRec;
+                    ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
+                }
 
                 /* advance */
                 if (cbBuf == SSM_ZIP_BLOCK_SIZE)
@@ -3517,17 +4008,28 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
                 /*
                  * Zero block.
                  */
-                uint8_t abRec[3];
-                abRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_ZERO;
-                abRec[1] = 1;
-                abRec[2] = SSM_ZIP_BLOCK_SIZE / _1K;
-                Log3(("ssmR3DataWriteBig: %08llx|%08llx/%08x: ZERO\n", ssmR3StrmTell(&pSSM->Strm) + 2, pSSM->offUnit + 2, 1));
-                rc = ssmR3DataWriteRaw(pSSM, &abRec[0], sizeof(abRec));
-                if (RT_FAILURE(rc))
-                    break;
+                if (pSSM->pZipPool)
+                {
+                    uint8_t const cKB = SSM_ZIP_BLOCK_SIZE / _1K;
+                    rc = ssmR3DataWriteZipRec(pSSM, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_ZERO,
+                                              &cKB, sizeof(cKB), SSM_ZIP_BLOCK_SIZE);
+                    if (RT_FAILURE(rc))
+                        break;
+                }
+                else
+                {
+                    uint8_t abRec[3];
+                    abRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_ZERO;
+                    abRec[1] = 1;
+                    abRec[2] = SSM_ZIP_BLOCK_SIZE / _1K;
+                    Log3(("ssmR3DataWriteBig: %08llx|%08llx/%08x: ZERO\n", ssmR3StrmTell(&pSSM->Strm) + 2, pSSM->offUnit + 2, 1));
+                    rc = ssmR3DataWriteRaw(pSSM, &abRec[0], sizeof(abRec));
+                    if (RT_FAILURE(rc))
+                        break;
+                    ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
+                }
 
                 /* advance */
-                ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
                 if (cbBuf == SSM_ZIP_BLOCK_SIZE)
                     return VINF_SUCCESS;
                 cbBuf -= SSM_ZIP_BLOCK_SIZE;
@@ -3538,6 +4040,12 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
                 /*
                  * Less than one block left, store it the simple way.
                  */
+                if (pSSM->pZipPool)
+                {
+                    rc = ssmR3DataWriteZipRec(pSSM, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW,
+                                              pvBuf, (uint32_t)cbBuf, (uint32_t)cbBuf);
+                    break;
+                }
                 rc = ssmR3DataWriteRecHdr(pSSM, cbBuf, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW);
                 if (RT_SUCCESS(rc))
                     rc = ssmR3DataWriteRaw(pSSM, pvBuf, cbBuf);
@@ -3563,7 +4071,7 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
  */
 static int ssmR3DataWriteFlushAndBuffer(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
+    int rc = ssmR3DataSubmitBuffer(pSSM);
     if (RT_SUCCESS(rc))
     {
         memcpy(&pSSM->u.Write.abDataBuffer[0], pvBuf, cbBuf);
@@ -4506,14 +5014,67 @@ DECLINLINE(void) ssmR3UnitCritSectLeave(PSSMUNIT pUnit)
 }
 
 
+/**
+ * Calls the pfnSaveDone callback of a single unit if applicable.
+ *
+ * @param   pVM                 The cross context VM structure.
+ * @param   pSSM                The saved state handle.
+ * @param   pUnit               The unit.
+ */
+static void ssmR3SaveDoDoneUnit(PVM pVM, PSSMHANDLE pSSM, PSSMUNIT pUnit)
+{
+    if (    pUnit->u.Common.pfnSaveDone
+        &&  (   pUnit->fCalled
+             || (!pUnit->u.Common.pfnSavePrep && !pUnit->u.Common.pfnSaveExec)))
+    {
+        int rcOld = pSSM->rc;
+        int rc;
+        ssmR3UnitCritSectEnter(pUnit);
+        switch (pUnit->enmType)
+        {
+            case SSMUNITTYPE_DEV:
+                rc = pUnit->u.Dev.pfnSaveDone(pUnit->u.Dev.pDevIns, pSSM);
+                break;
+            case SSMUNITTYPE_DRV:
+                rc = pUnit->u.Drv.pfnSaveDone(pUnit->u.Drv.pDrvIns, pSSM);
+                break;
+            case SSMUNITTYPE_USB:
+                rc = pUnit->u.Usb.pfnSaveDone(pUnit->u.Usb.pUsbIns, pSSM);
+                break;
+            case SSMUNITTYPE_INTERNAL:
+                rc = pUnit->u.Internal.pfnSaveDone(pVM, pSSM);
+                break;
+            case SSMUNITTYPE_EXTERNAL:
+                rc = pUnit->u.External.pfnSaveDone(pSSM, pUnit->u.External.pvUser);
+                break;
+            default:
+                rc = VERR_SSM_IPE_1;
+                break;
+        }
+        ssmR3UnitCritSectLeave(pUnit);
+        if (RT_SUCCESS(rc) && pSSM->rc != rcOld)
+            rc = pSSM->rc;
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("SSM: Done save failed with rc=%Rrc for data unit '%s.\n", rc, pUnit->szName));
+            if (RT_SUCCESS_NP(pSSM->rc))
+                pSSM->rc = rc;
+        }
+    }
+}
+
+
 /**
  * Do the pfnSaveDone run.
  *
  * @returns VBox status code (pSSM->rc).
  * @param   pVM                 The cross context VM structure.
  * @param   pSSM                The saved state handle.
+ * @param   pSkipUnit           Unit to leave out, NULL if none.  This is the
+ *                              deferred unit (see SSMR3HandleDeferFinalExec)
+ *                              whose done callback is made by SSMR3LiveDone.
  */
-static int ssmR3SaveDoDoneRun(PVM pVM, PSSMHANDLE pSSM)
+static int ssmR3SaveDoDoneRun(PVM pVM, PSSMHANDLE pSSM, PSSMUNIT pSkipUnit)
 {
     VM_ASSERT_EMT0(pVM);
 
@@ -4522,46 +5083,8 @@ static int ssmR3SaveDoDoneRun(PVM pVM, PSSMHANDLE pSSM)
      */
     pSSM->enmOp = SSMSTATE_SAVE_DONE;
     for (PSSMUNIT pUnit = pVM->ssm.s.pHead; pUnit; pUnit = pUnit->pNext)
-    {
-        if (    pUnit->u.Common.pfnSaveDone
-            &&  (   pUnit->fCalled
-                 || (!pUnit->u.Common.pfnSavePrep && !pUnit->u.Common.pfnSaveExec)))
-        {
-            int rcOld = pSSM->rc;
-            int rc;
-            ssmR3UnitCritSectEnter(pUnit);
-            switch (pUnit->enmType)
-            {
-                case SSMUNITTYPE_DEV:
-                    rc = pUnit->u.Dev.pfnSaveDone(pUnit->u.Dev.pDevIns, pSSM);
-                    break;
-                case SSMUNITTYPE_DRV:
-                    rc = pUnit->u.Drv.pfnSaveDone(pUnit->u.Drv.pDrvIns, pSSM);
-                    break;
-                case SSMUNITTYPE_USB:
-                    rc = pUnit->u.Usb.pfnSaveDone(pUnit->u.Usb.pUsbIns, pSSM);
-                    break;
-                case SSMUNITTYPE_INTERNAL:
-                    rc = pUnit->u.Internal.pfnSaveDone(pVM, pSSM);
-                    break;
-                case SSMUNITTYPE_EXTERNAL:
-                    rc = pUnit->u.External.pfnSaveDone(pSSM, pUnit->u.External.pvUser);
-                    break;
-                default:
-                    rc = VERR_SSM_IPE_1;
-                    break;
-            }
-            ssmR3UnitCritSectLeave(pUnit);
-            if (RT_SUCCESS(rc) && pSSM->rc != rcOld)
-                rc = pSSM->rc;
-            if (RT_FAILURE(rc))
-            {
-                LogRel(("SSM: Done save failed with rc=%Rrc for data unit '%s.\n", rc, pUnit->szName));
-                if (RT_SUCCESS_NP(pSSM->rc))
-                    pSSM->rc = rc;
-            }
-        }
-    }
+        if (pUnit != pSkipUnit)
+            ssmR3SaveDoDoneUnit(pVM, pSSM, pUnit);
     return pSSM->rc;
 }
 
@@ -4583,6 +5106,7 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
      * Make it non-cancellable, close the stream and delete the file on failure.
      */
     ssmR3SetCancellable(pVM, pSSM, false);
+    ssmR3ZipPoolDestroy(pSSM);
     int rc = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     if (RT_SUCCESS(rc))
         rc = pSSM->rc;
@@ -4612,7 +5136,7 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
 
         Assert(pSSM->enmOp <= SSMSTATE_SAVE_DONE);
         if (pSSM->enmOp != SSMSTATE_SAVE_DONE)
-            ssmR3SaveDoDoneRun(pVM, pSSM);
+            ssmR3SaveDoDoneRun(pVM, pSSM, NULL /*pSkipUnit*/);
     }
 
     /*
@@ -4659,6 +5183,20 @@ VMMR3_INT_DECL(int) SSMR3LiveDone(PSSMHANDLE pSSM)
                     &&  pSSM->enmOp <= SSMSTATE_SAVE_DONE,
                     ("%d\n", pSSM->enmOp), VERR_INVALID_STATE);
 
+    /*
+     * If a unit deferred its final pass, write the directory and footer
+     * (provided SSMR3LiveDoStep3 got that far) and let the unit clean up.
+     */
+    if (pSSM->enmOp == SSMSTATE_LIVE_STEP3)
+    {
+        if (!pSSM->u.Write.fDeferredExecDone && RT_SUCCESS(pSSM->rc))
+            pSSM->rc = VERR_SSM_CANCELLED;
+        if (RT_SUCCESS(pSSM->rc))
+            ssmR3SaveDoFinalization(pVM, pSSM);
+        pSSM->enmOp = SSMSTATE_SAVE_DONE;
+        ssmR3SaveDoDoneUnit(pVM, pSSM, pSSM->u.Write.pDeferredUnit);
+    }
+
     /*
      * Join paths with SSMR3Save again.
      */
@@ -4813,134 +5351,187 @@ static void ssmR3ProgressByUnit(PSSMHANDLE pSSM, uint32_t iUnit)
 
 
 /**
- * Do the pfnSaveExec run.
+ * Writes the header of a final pass unit.
+ *
+ * @returns VBox status code (pSSM->rc).
+ * @param   pSSM                The saved state handle.
+ * @param   pUnit               The unit.
+ * @param   poffUnit            Where to return the stream offset of the unit.
+ */
+static int ssmR3SaveDoUnitHdr(PSSMHANDLE pSSM, PSSMUNIT pUnit, PRTFOFF poffUnit)
+{
+    *poffUnit = ssmR3StrmTell(&pSSM->Strm);
+
+    /*
+     * Check for cancellation.
+     */
+    if (RT_UNLIKELY(ASMAtomicUoReadU32(&(pSSM)->fCancelled) == SSMHANDLE_CANCELLED))
+    {
+        LogRel(("SSM: Cancelled!\n"));
+        AssertRC(pSSM->rc);
+        return pSSM->rc = VERR_SSM_CANCELLED;
+    }
+
+    /*
+     * Write data unit header
+     */
+    SSMFILEUNITHDRV2 UnitHdr;
+    memcpy(&UnitHdr.szMagic[0], SSMFILEUNITHDR_MAGIC, sizeof(UnitHdr.szMagic));
+    UnitHdr.offStream       = *poffUnit;
+    UnitHdr.u32CurStreamCRC = ssmR3StrmCurCRC(&pSSM->Strm);
+    UnitHdr.u32CRC          = 0;
+    UnitHdr.u32Version      = pUnit->u32Version;
+    UnitHdr.u32Instance     = pUnit->u32Instance;
+    UnitHdr.u32Pass         = SSM_PASS_FINAL;
+    UnitHdr.fFlags          = 0;
+    UnitHdr.cbName          = (uint32_t)pUnit->cchName + 1;
+    memcpy(&UnitHdr.szName[0], &pUnit->szName[0], UnitHdr.cbName);
+    UnitHdr.u32CRC          = RTCrc32(&UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
+    Log(("SSM: Unit at %#9llx: '%s', instance %u, pass %#x, version %u\n",
+         UnitHdr.offStream, UnitHdr.szName, UnitHdr.u32Instance, UnitHdr.u32Pass, UnitHdr.u32Version));
+    int rc = ssmR3StrmWrite(&pSSM->Strm, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("SSM: Failed to write unit header. rc=%Rrc\n", rc));
+        return pSSM->rc = rc;
+    }
+    ssmR3DataWriteBegin(pSSM);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Writes the unit header of a final pass unit and calls its execute handler.
+ *
+ * The caller must terminate the unit using ssmR3SaveDoTermUnit.
  *
  * @returns VBox status code (pSSM->rc).
  * @param   pVM                 The cross context VM structure.
  * @param   pSSM                The saved state handle.
+ * @param   pUnit               The unit.
  */
-static int ssmR3SaveDoExecRun(PVM pVM, PSSMHANDLE pSSM)
+static int ssmR3SaveDoExecUnit(PVM pVM, PSSMHANDLE pSSM, PSSMUNIT pUnit)
 {
-    VM_ASSERT_EMT0(pVM);
-    AssertRC(pSSM->rc);
-    pSSM->rc = VINF_SUCCESS;
-    pSSM->enmOp = SSMSTATE_SAVE_EXEC;
-    unsigned iUnit = 0;
-    for (PSSMUNIT pUnit = pVM->ssm.s.pHead; pUnit; pUnit = pUnit->pNext, iUnit++)
+    int rc = ssmR3SaveDoUnitHdr(pSSM, pUnit, &pUnit->offStream);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * Call the execute handler.
+     */
+    ssmR3UnitCritSectEnter(pUnit);
+    switch (pUnit->enmType)
     {
-        /*
-         * Not all unit have a callback. Skip those which don't and
-         * make sure to keep the progress indicator up to date.
-         */
-        ssmR3ProgressByUnit(pSSM, iUnit);
-        pSSM->offEstUnitEnd += pUnit->cbGuess;
-        if (!pUnit->u.Common.pfnSaveExec)
-        {
-            pUnit->fCalled = true;
-            if (pUnit->cbGuess)
-                ssmR3ProgressByByte(pSSM, pSSM->offEstUnitEnd - pSSM->offEst);
-            continue;
-        }
-        pUnit->offStream = ssmR3StrmTell(&pSSM->Strm);
+        case SSMUNITTYPE_DEV:
+            rc = pUnit->u.Dev.pfnSaveExec(pUnit->u.Dev.pDevIns, pSSM);
+            break;
+        case SSMUNITTYPE_DRV:
+            rc = pUnit->u.Drv.pfnSaveExec(pUnit->u.Drv.pDrvIns, pSSM);
+            break;
+        case SSMUNITTYPE_USB:
+            rc = pUnit->u.Usb.pfnSaveExec(pUnit->u.Usb.pUsbIns, pSSM);
+            break;
+        case SSMUNITTYPE_INTERNAL:
+            rc = pUnit->u.Internal.pfnSaveExec(pVM, pSSM);
+            break;
+        case SSMUNITTYPE_EXTERNAL:
+            pUnit->u.External.pfnSaveExec(pSSM, pUnit->u.External.pvUser);
+            rc = pSSM->rc;
+            break;
+        default:
+            rc = VERR_SSM_IPE_1;
+            break;
+    }
+    ssmR3UnitCritSectLeave(pUnit);
+    pUnit->fCalled = true;
+    if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
+        pSSM->rc = rc;
+    else
+        rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
+    if (RT_FAILURE(rc))
+        LogRel(("SSM: Execute save failed with rc=%Rrc for data unit '%s'/#%u.\n", rc, pUnit->szName, pUnit->u32Instance));
+    return rc;
+}
 
-        /*
-         * Check for cancellation.
-         */
-        if (RT_UNLIKELY(ASMAtomicUoReadU32(&(pSSM)->fCancelled) == SSMHANDLE_CANCELLED))
-        {
-            LogRel(("SSM: Cancelled!\n"));
-            AssertRC(pSSM->rc);
-            return pSSM->rc = VERR_SSM_CANCELLED;
-        }
 
-        /*
-         * Write data unit header
-         */
-        SSMFILEUNITHDRV2 UnitHdr;
-        memcpy(&UnitHdr.szMagic[0], SSMFILEUNITHDR_MAGIC, sizeof(UnitHdr.szMagic));
-        UnitHdr.offStream       = pUnit->offStream;
-        UnitHdr.u32CurStreamCRC = ssmR3StrmCurCRC(&pSSM->Strm);
-        UnitHdr.u32CRC          = 0;
-        UnitHdr.u32Version      = pUnit->u32Version;
-        UnitHdr.u32Instance     = pUnit->u32Instance;
-        UnitHdr.u32Pass         = SSM_PASS_FINAL;
-        UnitHdr.fFlags          = 0;
-        UnitHdr.cbName          = (uint32_t)pUnit->cchName + 1;
-        memcpy(&UnitHdr.szName[0], &pUnit->szName[0], UnitHdr.cbName);
-        UnitHdr.u32CRC          = RTCrc32(&UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
-        Log(("SSM: Unit at %#9llx: '%s', instance %u, pass %#x, version %u\n",
-             UnitHdr.offStream, UnitHdr.szName, UnitHdr.u32Instance, UnitHdr.u32Pass, UnitHdr.u32Version));
-        int rc = ssmR3StrmWrite(&pSSM->Strm, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
-        if (RT_FAILURE(rc))
-        {
-            LogRel(("SSM: Failed to write unit header. rc=%Rrc\n", rc));
-            return pSSM->rc = rc;
-        }
+/**
+ * Writes the termination record of the current unit and flushes the
+ * compression stream.
+ *
+ * @returns VBox status code (pSSM->rc).
+ * @param   pSSM                The saved state handle.
+ */
+static int ssmR3SaveDoTermUnit(PSSMHANDLE pSSM)
+{
+    SSMRECTERM TermRec;
+    TermRec.u8TypeAndFlags   = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_TERM;
+    TermRec.cbRec            = sizeof(TermRec) - 2;
+    if (pSSM->Strm.fChecksummed)
+    {
+        TermRec.fFlags       = SSMRECTERM_FLAGS_CRC32;
+        TermRec.u32StreamCRC = RTCrc32Finish(RTCrc32Process(ssmR3StrmCurCRC(&pSSM->Strm), &TermRec, 2));
+    }
+    else
+    {
+        TermRec.fFlags       = 0;
+        TermRec.u32StreamCRC = 0;
+    }
+    TermRec.cbUnit           = pSSM->offUnit + sizeof(TermRec);
+    int rc = ssmR3DataWriteRaw(pSSM, &TermRec, sizeof(TermRec));
+    if (RT_SUCCESS(rc))
+        rc = ssmR3DataWriteFinish(pSSM);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("SSM: Failed terminating unit: %Rrc\n", rc));
+        return pSSM->rc = rc;
+    }
+    return VINF_SUCCESS;
+}
 
+
+/**
+ * Do the pfnSaveExec run.
+ *
+ * If a unit has deferred its final pass (see SSMR3HandleDeferFinalExec), a
+ * second instance of it is started after the last unit and left open for
+ * SSMR3LiveDoStep3 to complete.
+ *
+ * @returns VBox status code (pSSM->rc).
+ * @param   pVM                 The cross context VM structure.
+ * @param   pSSM                The saved state handle.
+ */
+static int ssmR3SaveDoExecRun(PVM pVM, PSSMHANDLE pSSM)
+{
+    VM_ASSERT_EMT0(pVM);
+    AssertRC(pSSM->rc);
+    pSSM->rc = VINF_SUCCESS;
+    pSSM->enmOp = SSMSTATE_SAVE_EXEC;
+    PSSMUNIT const pDeferredUnit = pSSM->u.Write.pDeferredUnit;
+    unsigned iUnit = 0;
+    for (PSSMUNIT pUnit = pVM->ssm.s.pHead; pUnit; pUnit = pUnit->pNext, iUnit++)
+    {
         /*
-         * Call the execute handler.
+         * Not all unit have a callback. Skip those which don't and
+         * make sure to keep the progress indicator up to date.
          */
-        ssmR3DataWriteBegin(pSSM);
-        ssmR3UnitCritSectEnter(pUnit);
-        switch (pUnit->enmType)
-        {
-            case SSMUNITTYPE_DEV:
-                rc = pUnit->u.Dev.pfnSaveExec(pUnit->u.Dev.pDevIns, pSSM);
-                break;
-            case SSMUNITTYPE_DRV:
-                rc = pUnit->u.Drv.pfnSaveExec(pUnit->u.Drv.pDrvIns, pSSM);
-                break;
-            case SSMUNITTYPE_USB:
-                rc = pUnit->u.Usb.pfnSaveExec(pUnit->u.Usb.pUsbIns, pSSM);
-                break;
-            case SSMUNITTYPE_INTERNAL:
-                rc = pUnit->u.Internal.pfnSaveExec(pVM, pSSM);
-                break;
-            case SSMUNITTYPE_EXTERNAL:
-                pUnit->u.External.pfnSaveExec(pSSM, pUnit->u.External.pvUser);
-                rc = pSSM->rc;
-                break;
-            default:
-                rc = VERR_SSM_IPE_1;
-                break;
-        }
-        ssmR3UnitCritSectLeave(pUnit);
-        pUnit->fCalled = true;
-        if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
-            pSSM->rc = rc;
-        else
-            rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
-        if (RT_FAILURE(rc))
+        ssmR3ProgressByUnit(pSSM, iUnit);
+        pSSM->offEstUnitEnd += pUnit->cbGuess;
+        if (!pUnit->u.Common.pfnSaveExec)
         {
-            LogRel(("SSM: Execute save failed with rc=%Rrc for data unit '%s'/#%u.\n", rc, pUnit->szName, pUnit->u32Instance));
-            return rc;
+            pUnit->fCalled = true;
+            if (pUnit->cbGuess)
+                ssmR3ProgressByByte(pSSM, pSSM->offEstUnitEnd - pSSM->offEst);
+            continue;
         }
 
         /*
-         * Write the termination record and flush the compression stream.
+         * Write the unit header, call the execute handler and terminate it.
          */
-        SSMRECTERM TermRec;
-        TermRec.u8TypeAndFlags   = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_TERM;
-        TermRec.cbRec            = sizeof(TermRec) - 2;
-        if (pSSM->Strm.fChecksummed)
-        {
-            TermRec.fFlags       = SSMRECTERM_FLAGS_CRC32;
-            TermRec.u32StreamCRC = RTCrc32Finish(RTCrc32Process(ssmR3StrmCurCRC(&pSSM->Strm), &TermRec, 2));
-        }
-        else
-        {
-            TermRec.fFlags       = 0;
-            TermRec.u32StreamCRC = 0;
-        }
-        TermRec.cbUnit           = pSSM->offUnit + sizeof(TermRec);
-        rc = ssmR3DataWriteRaw(pSSM, &TermRec, sizeof(TermRec));
+        int rc = ssmR3SaveDoExecUnit(pVM, pSSM, pUnit);
         if (RT_SUCCESS(rc))
-            rc = ssmR3DataWriteFinish(pSSM);
+            rc = ssmR3SaveDoTermUnit(pSSM);
         if (RT_FAILURE(rc))
-        {
-            LogRel(("SSM: Failed terminating unit: %Rrc\n", rc));
-            return pSSM->rc = rc;
-        }
+            return rc;
 
         /*
          * Advance the progress indicator to the end of the current unit.
@@ -4953,6 +5544,17 @@ static int ssmR3SaveDoExecRun(PVM pVM, PSSMHANDLE pSSM)
     AssertMsg(   pSSM->uPercent == 101 - pSSM->uPercentDone
               || pSSM->uPercent == 100 - pSSM->uPercentDone,
               ("%d\n", pSSM->uPercent));
+
+    /*
+     * Start the trailing instance of the deferred unit; SSMR3LiveDoStep3 adds
+     * the data and terminates it.  The unit keeps the stream offset of its
+     * regular instance, which is what ends up in the directory.
+     */
+    if (pDeferredUnit)
+    {
+        RTFOFF offTrailer;
+        return ssmR3SaveDoUnitHdr(pSSM, pDeferredUnit, &offTrailer);
+    }
     return VINF_SUCCESS;
 }
 
@@ -5039,18 +5641,36 @@ static int ssmR3SaveDoCommon(PVM pVM, PSSMHANDLE pSSM)
     /*
      * Do the work.
      */
+    PSSMUNIT const pDeferredUnit = pSSM->u.Write.pDeferredUnit;
     int rc = ssmR3SaveDoPrepRun(pVM, pSSM);
     if (RT_SUCCESS(rc))
     {
         rc = ssmR3SaveDoExecRun(pVM, pSSM);
-        if (RT_SUCCESS(rc))
+        if (RT_SUCCESS(rc) && !pDeferredUnit)
             rc = ssmR3SaveDoFinalization(pVM, pSSM);
     }
     Assert(pSSM->rc == rc);
-    int rc2 = ssmR3SaveDoDoneRun(pVM, pSSM);
+    int rc2 = ssmR3SaveDoDoneRun(pVM, pSSM, pDeferredUnit);
     if (RT_SUCCESS(rc))
         rc = rc2;
 
+    /*
+     * If a unit deferred its final pass, park the handle in the step 3 state
+     * so the VM can be resumed before SSMR3LiveDoStep3 is called.  The
+     * progress callback belongs to the caller of the save operation and
+     * must not be used after this point.
+     */
+    if (pDeferredUnit)
+    {
+        if (RT_SUCCESS(rc))
+        {
+            pSSM->enmOp       = SSMSTATE_LIVE_STEP3;
+            pSSM->pfnProgress = NULL;
+        }
+        else
+            ssmR3SaveDoDoneUnit(pVM, pSSM, pDeferredUnit);
+    }
+
     return rc;
 }
 
@@ -5090,6 +5710,88 @@ VMMR3_INT_DECL(int) SSMR3LiveDoStep2(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Completes the final pass of the unit that deferred it while the VM is
+ * running again.
+ *
+ * This is only applicable when a unit called SSMR3HandleDeferFinalExec during
+ * the live prep run, in which case SSMR3LiveDoStep2 leaves the handle in the
+ * step 3 state.  The deferred unit's pfnLiveExec callback is called with
+ * SSM_PASS_FINAL to fill the trailing instance of the unit, which is then
+ * terminated.  SSMR3LiveDone writes the
+ * directory and footer afterwards.  When no unit deferred anything, this is a
+ * no-op.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pSSM            The SSM handle returned by SSMR3LiveSave.
+ *
+ * @thread  Non-EMT thread.
+ */
+VMMR3_INT_DECL(int) SSMR3LiveDoStep3(PSSMHANDLE pSSM)
+{
+    LogFlow(("SSMR3LiveDoStep3: pSSM=%p\n", pSSM));
+
+    /*
+     * Validate input.
+     */
+    AssertPtrReturn(pSSM, VERR_INVALID_POINTER);
+    PVM pVM = pSSM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_OTHER_THREAD(pVM);
+    if (pSSM->enmOp == SSMSTATE_SAVE_DONE)
+        return pSSM->rc; /* No unit deferred its final pass. */
+    AssertMsgReturn(pSSM->enmOp == SSMSTATE_LIVE_STEP3, ("%d\n", pSSM->enmOp), VERR_INVALID_STATE);
+    AssertReturn(!pSSM->u.Write.fDeferredExecDone, VERR_WRONG_ORDER);
+    PSSMUNIT pUnit = pSSM->u.Write.pDeferredUnit;
+    AssertPtrReturn(pUnit, VERR_SSM_IPE_2);
+    AssertRCReturn(pSSM->rc, pSSM->rc);
+
+    /*
+     * Call the live exec handler for the final pass and terminate the
+     * trailing unit instance that ssmR3SaveDoExecRun started.
+     */
+    pSSM->enmOp = SSMSTATE_SAVE_EXEC;
+    pVM->ssm.s.uPass = SSM_PASS_FINAL;
+    int rc;
+    ssmR3UnitCritSectEnter(pUnit);
+    switch (pUnit->enmType)
+    {
+        case SSMUNITTYPE_DEV:
+            rc = pUnit->u.Dev.pfnLiveExec(pUnit->u.Dev.pDevIns, pSSM, SSM_PASS_FINAL);
+            break;
+        case SSMUNITTYPE_DRV:
+            rc = pUnit->u.Drv.pfnLiveExec(pUnit->u.Drv.pDrvIns, pSSM, SSM_PASS_FINAL);
+            break;
+        case SSMUNITTYPE_USB:
+            rc = pUnit->u.Usb.pfnLiveExec(pUnit->u.Usb.pUsbIns, pSSM, SSM_PASS_FINAL);
+            break;
+        case SSMUNITTYPE_INTERNAL:
+            rc = pUnit->u.Internal.pfnLiveExec(pVM, pSSM, SSM_PASS_FINAL);
+            break;
+        case SSMUNITTYPE_EXTERNAL:
+            rc = pUnit->u.External.pfnLiveExec(pSSM, pUnit->u.External.pvUser, SSM_PASS_FINAL);
+            break;
+        default:
+            rc = VERR_SSM_IPE_1;
+            break;
+    }
+    ssmR3UnitCritSectLeave(pUnit);
+    if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
+        pSSM->rc = rc;
+    else
+        rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
+    if (RT_SUCCESS(rc))
+        rc = ssmR3SaveDoTermUnit(pSSM);
+    else
+        LogRel(("SSM: Deferred execute save failed with rc=%Rrc for data unit '%s'/#%u.\n", rc, pUnit->szName, pUnit->u32Instance));
+
+    pSSM->enmOp = SSMSTATE_LIVE_STEP3;
+    pSSM->u.Write.fDeferredExecDone = true;
+    return rc;
+}
+
+
 /**
  * Writes the file header and clear the per-unit data.
  *
@@ -5183,6 +5885,10 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
     pSSM->pszFilename               = pszFilename;
     pSSM->u.Write.offDataBuffer     = 0;
     pSSM->u.Write.cMsMaxDowntime    = UINT32_MAX;
+    pSSM->u.Write.fDeferredExecAllowed = false;
+    pSSM->u.Write.fDeferredExecDone = false;
+    pSSM->u.Write.pCurUnit          = NULL;
+    pSSM->u.Write.pDeferredUnit     = NULL;
 
     int rc;
     if (pStreamOps)
@@ -5195,6 +5901,7 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
         RTMemFree(pSSM);
         return rc;
     }
+    ssmR3ZipPoolCreate(pSSM, true /*fWrite*/);
 
     *ppSSM = pSSM;
     return VINF_SUCCESS;
@@ -5625,6 +6332,7 @@ static int ssmR3DoLivePrepRun(PVM pVM, PSSMHANDLE pSSM)
         if (pUnit->u.Common.pfnLivePrep)
         {
             int rc;
+            pSSM->u.Write.pCurUnit = pUnit;
             ssmR3UnitCritSectEnter(pUnit);
             switch (pUnit->enmType)
             {
@@ -5648,6 +6356,7 @@ static int ssmR3DoLivePrepRun(PVM pVM, PSSMHANDLE pSSM)
                     break;
             }
             ssmR3UnitCritSectLeave(pUnit);
+            pSSM->u.Write.pCurUnit = NULL;
             pUnit->fCalled = true;
             if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
                 pSSM->rc = rc;
@@ -5801,6 +6510,7 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
         return VINF_SUCCESS;
     }
     /* bail out. */
+    ssmR3ZipPoolDestroy(pSSM);
     int rc2 = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     RTMemFree(pSSM);
     rc2 = RTFileDelete(pszFilename);
@@ -5808,6 +6518,32 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
     return rc;
 }
 
+
+/**
+ * Allows a unit to defer its final pass past SSMR3LiveDoStep2.
+ *
+ * The caller commits to calling SSMR3LiveDoStep3 after the VM has been
+ * resumed, and SSMR3LiveDone after that.  See SSMR3HandleDeferFinalExec.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pSSM            The SSM handle returned by SSMR3LiveSave.
+ *
+ * @thread  EMT0
+ */
+VMMR3_INT_DECL(int) SSMR3LiveAllowDeferredExec(PSSMHANDLE pSSM)
+{
+    AssertPtrReturn(pSSM, VERR_INVALID_POINTER);
+    PVM pVM = pSSM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_EMT0(pVM);
+    AssertMsgReturn(pSSM->enmOp == SSMSTATE_LIVE_STEP1, ("%d\n", pSSM->enmOp), VERR_INVALID_STATE);
+    AssertReturn(pSSM->enmAfter == SSMAFTER_CONTINUE, VERR_INVALID_PARAMETER);
+
+    pSSM->u.Write.fDeferredExecAllowed = true;
+    return VINF_SUCCESS;
+}
+
 #endif /* !SSM_STANDALONE */
 
 
@@ -5943,6 +6679,10 @@ static void ssmR3DataReadBeginV2(PSSMHANDLE pSSM)
     pSSM->u.Read.offDataBuffer  = 0;
     pSSM->u.Read.fEndOfData     = false;
     pSSM->u.Read.u8TypeAndFlags = 0;
+    pSSM->u.Read.pZipSlot       = NULL;
+    pSSM->u.Read.offZipSlot     = 0;
+    if (pSSM->pZipPool)
+        ssmR3ZipDiscard(pSSM->pZipPool);
 }
 
 
@@ -5998,6 +6738,20 @@ static int ssmR3DataReadFinishV2(PSSMHANDLE pSSM)
  */
 DECLINLINE(int) ssmR3DataReadV2Raw(PSSMHANDLE pSSM, void *pvBuf, size_t cbToRead)
 {
+    /*
+     * Records read ahead by the decompression pool have already been
+     * accounted for in the unit offset and progress indicator.
+     */
+    PSSMZIPSLOT pSlot = pSSM->u.Read.pZipSlot;
+    if (pSlot)
+    {
+        uint32_t const off = pSSM->u.Read.offZipSlot;
+        AssertMsgReturn(cbToRead <= pSlot->cbDst - off, ("%#zx %#x %#x\n", cbToRead, off, pSlot->cbDst), VERR_SSM_LOADED_TOO_MUCH);
+        memcpy(pvBuf, &pSlot->abDst[off], cbToRead);
+        pSSM->u.Read.offZipSlot = off + (uint32_t)cbToRead;
+        return VINF_SUCCESS;
+    }
+
     int rc = ssmR3StrmRead(&pSSM->Strm, pvBuf, cbToRead);
     if (RT_SUCCESS(rc))
     {
@@ -6125,7 +6879,7 @@ DECLINLINE(int) ssmR3DataReadV2RawZeroHdr(PSSMHANDLE pSSM, uint32_t *pcbZero)
 
 
 /**
- * Worker for reading the record header.
+ * Worker for reading the record header from the stream.
  *
  * It sets pSSM->u.Read.cbRecLeft, pSSM->u.Read.u8TypeAndFlags and
  * pSSM->u.Read.fEndOfData.  When a termination record is encounter, it will be
@@ -6135,7 +6889,7 @@ DECLINLINE(int) ssmR3DataReadV2RawZeroHdr(PSSMHANDLE pSSM, uint32_t *pcbZero)
  * @returns VBox status code. Does not set pSSM->rc.
  * @param   pSSM            The saved state handle.
  */
-static int ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM)
+static int ssmR3DataReadStrmRecHdrV2(PSSMHANDLE pSSM)
 {
     AssertLogRelReturn(!pSSM->u.Read.fEndOfData, VERR_SSM_LOADED_TOO_MUCH);
 
@@ -6177,7 +6931,7 @@ static int ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM)
             AssertLogRelMsgReturn(TermRec.u32StreamCRC == u32StreamCRC, ("%#x, %#x\n", TermRec.u32StreamCRC, u32StreamCRC),
                                   VERR_SSM_INTEGRITY_REC_TERM_CRC);
 
-        Log3(("ssmR3DataReadRecHdrV2: %08llx|%08llx: TERM\n", ssmR3StrmTell(&pSSM->Strm) - sizeof(SSMRECTERM), pSSM->offUnit));
+        Log3(("ssmR3DataReadStrmRecHdrV2: %08llx|%08llx: TERM\n", ssmR3StrmTell(&pSSM->Strm) - sizeof(SSMRECTERM), pSSM->offUnit));
         return VINF_SUCCESS;
     }
 
@@ -6287,7 +7041,7 @@ static int ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM)
         pSSM->u.Read.cbRecLeft = cb;
     }
 
-    Log3(("ssmR3DataReadRecHdrV2: %08llx|%08llx/%08x: Type=%02x fImportant=%RTbool cbHdr=%u\n",
+    Log3(("ssmR3DataReadStrmRecHdrV2: %08llx|%08llx/%08x: Type=%02x fImportant=%RTbool cbHdr=%u\n",
           ssmR3StrmTell(&pSSM->Strm), pSSM->offUnit, pSSM->u.Read.cbRecLeft,
           pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK,
           !!(pSSM->u.Read.u8TypeAndFlags & SSM_REC_FLAGS_IMPORTANT),
@@ -6297,6 +7051,152 @@ static int ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Reads ahead a batch of records, handing the LZF ones to the decompression
+ * pool.
+ *
+ * This stops after the termination record, after a record which doesn't fit
+ * into a slot and when the ring is full, so it never reads beyond the current
+ * data unit.  The record state of the handle is garbage afterwards.
+ *
+ * @returns VBox status code. Does not set pSSM->rc.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataReadZipAheadV2(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    Assert(pPool->iRetire == pPool->iSubmit);
+    Assert(!pSSM->u.Read.pZipSlot);
+
+    for (;;)
+    {
+        int rc = ssmR3DataReadStrmRecHdrV2(pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        PSSMZIPSLOT pSlot = &pPool->aSlots[pPool->iSubmit % SSM_ZIP_SLOTS];
+        pSlot->u8TypeAndFlags = pSSM->u.Read.u8TypeAndFlags;
+        pSlot->fInStream      = false;
+        pSlot->rc             = VINF_SUCCESS;
+        pSlot->cbSrc          = 0;
+        pSlot->cbDst          = 0;
+        bool fProcess = false;
+        bool fStop    = false;
+        switch (pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK)
+        {
+            case SSM_REC_TYPE_TERM:
+                /* The end of data condition is raised when the slot is retired. */
+                pSSM->u.Read.fEndOfData = false;
+                fStop = true;
+                break;
+
+            case SSM_REC_TYPE_RAW_LZF:
+            {
+                uint32_t cbDecompr;
+                rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbDecompr);
+                if (RT_FAILURE(rc))
+                    return rc;
+                pSlot->cbSrc = pSSM->u.Read.cbRecLeft;
+                pSlot->cbDst = cbDecompr;
+                AssertCompile(RT_SIZEOFMEMB(SSMHANDLE, u.Read.abComprBuffer) + 1 <= RT_SIZEOFMEMB(SSMZIPSLOT, abSrc));
+                AssertCompile(RT_SIZEOFMEMB(SSMHANDLE, u.Read.abDataBuffer) <= RT_SIZEOFMEMB(SSMZIPSLOT, abDst));
+                rc = ssmR3DataReadV2Raw(pSSM, pSlot->abSrc, pSlot->cbSrc);
+                if (RT_FAILURE(rc))
+                    return rc;
+                fProcess = true;
+                break;
+            }
+
+            case SSM_REC_TYPE_RAW_ZERO:
+                rc = ssmR3DataReadV2RawZeroHdr(pSSM, &pSlot->cbDst);
+                if (RT_FAILURE(rc))
+                    return rc;
+                memset(pSlot->abDst, 0, pSlot->cbDst);
+                break;
+
+            case SSM_REC_TYPE_RAW:
+                if (pSSM->u.Read.cbRecLeft <= sizeof(pSlot->abDst))
+                {
+                    pSlot->cbDst = pSSM->u.Read.cbRecLeft;
+                    rc = ssmR3DataReadV2Raw(pSSM, pSlot->abDst, pSlot->cbDst);
+                    if (RT_FAILURE(rc))
+                        return rc;
+                    break;
+                }
+                RT_FALL_THRU();
+            default:
+                /* Leave it to the consumer. */
+                pSlot->fInStream = true;
+                pSlot->cbDst     = pSSM->u.Read.cbRecLeft;
+                fStop = true;
+                break;
+        }
+        pSSM->u.Read.cbRecLeft = 0;
+
+        ssmR3ZipSubmit(pPool, pSlot, fProcess);
+        if (   fStop
+            || pPool->iSubmit - pPool->iRetire >= SSM_ZIP_SLOTS)
+            return VINF_SUCCESS;
+    }
+}
+
+
+/**
+ * Advances to the next record.
+ *
+ * Takes the record from the decompression pool if we've got one, otherwise
+ * it's read straight from the stream.  Decompressed records are presented as
+ * raw records which ssmR3DataReadV2Raw reads from the pool slot.
+ *
+ * @returns VBox status code. Does not set pSSM->rc.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataReadRecHdrV2(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    if (!pPool)
+        return ssmR3DataReadStrmRecHdrV2(pSSM);
+    AssertLogRelReturn(!pSSM->u.Read.fEndOfData, VERR_SSM_LOADED_TOO_MUCH);
+
+    pSSM->u.Read.pZipSlot   = NULL;
+    pSSM->u.Read.offZipSlot = 0;
+    if (pPool->iRetire == pPool->iSubmit)
+    {
+        int rc = ssmR3DataReadZipAheadV2(pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    /* The slot data stays valid until we get here the next time as nothing
+       is submitted before the ring has been drained. */
+    PSSMZIPSLOT pSlot = &pPool->aSlots[pPool->iRetire % SSM_ZIP_SLOTS];
+    ssmR3ZipWaitForSlot(pPool, pSlot);
+    ASMAtomicWriteU32(&pSlot->u32State, SSMZIPSLOT_STATE_FREE);
+    pPool->iRetire++;
+    if (RT_FAILURE(pSlot->rc))
+        return pSlot->rc;
+
+    if ((pSlot->u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_TERM)
+    {
+        pSSM->u.Read.u8TypeAndFlags = pSlot->u8TypeAndFlags;
+        pSSM->u.Read.cbRecLeft      = 0;
+        pSSM->u.Read.fEndOfData     = true;
+    }
+    else if (pSlot->fInStream)
+    {
+        pSSM->u.Read.u8TypeAndFlags = pSlot->u8TypeAndFlags;
+        pSSM->u.Read.cbRecLeft      = pSlot->cbDst;
+    }
+    else
+    {
+        pSSM->u.Read.u8TypeAndFlags = (pSlot->u8TypeAndFlags & ~SSM_REC_TYPE_MASK) | SSM_REC_TYPE_RAW;
+        pSSM->u.Read.cbRecLeft      = pSlot->cbDst;
+        pSSM->u.Read.pZipSlot       = pSlot;
+    }
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Buffer miss, do an unbuffered read.
  *
@@ -8047,6 +8947,7 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->uPercentDone          = 2;
     pSSM->uReportedLivePercent  = 0;
     pSSM->pszFilename           = pszFilename;
+    pSSM->pZipPool              = NULL;
 
     pSSM->u.Read.pZipDecompV1   = NULL;
     pSSM->u.Read.uFmtVerMajor   = UINT32_MAX;
@@ -8069,6 +8970,8 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->u.Read.offDataBuffer  = 0;
     pSSM->u.Read.fEndOfData     = 0;
     pSSM->u.Read.u8TypeAndFlags = 0;
+    pSSM->u.Read.pZipSlot       = NULL;
+    pSSM->u.Read.offZipSlot     = 0;
 
     pSSM->u.Read.pCurUnit       = NULL;
     pSSM->u.Read.uCurUnitVer    = UINT32_MAX;
@@ -8804,6 +9707,8 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     {
         ssmR3StrmStartIoThread(&Handle.Strm);
         ssmR3SetCancellable(pVM, &Handle, true);
+        if (Handle.u.Read.uFmtVerMajor >= 2)
+            ssmR3ZipPoolCreate(&Handle, false /*fWrite*/);
 
         Handle.enmAfter         = enmAfter;
         Handle.pfnProgress      = pfnProgress;
@@ -8963,6 +9868,7 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
             pfnProgress(pVM->pUVM, 99, pvProgressUser);
 
         ssmR3SetCancellable(pVM, &Handle, false);
+        ssmR3ZipPoolDestroy(&Handle);
         ssmR3StrmClose(&Handle.Strm, Handle.rc == VERR_SSM_CANCELLED);
         rc = Handle.rc;
     }
@@ -9543,6 +10449,45 @@ VMMR3DECL(uint32_t) SSMR3HandleMaxDowntime(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Requests that the final pass of the calling unit is deferred until after the
+ * VM has been resumed.
+ *
+ * This can only be called from a pfnLivePrep callback, and only when the
+ * caller of SSMR3LiveSave has opted in using SSMR3LiveAllowDeferredExec.  At
+ * most one unit can defer its final pass.  The unit's pfnSaveExec callback is
+ * called at the unit's usual position while the VM is still suspended, so the
+ * order in which units are loaded doesn't change.  After the last unit, a
+ * second SSM_PASS_FINAL instance of the unit is started and left open, and
+ * SSMR3LiveDoStep3 calls pfnLiveExec with SSM_PASS_FINAL to fill it while the
+ * VM is running.  It is the unit's job to make sure the data it writes at that
+ * point reflects the state as of its pfnSaveExec call, and to tell the two
+ * instances apart when loading; pfnLoadExec is called with SSM_PASS_FINAL for
+ * both of them.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if deferring isn't possible for this save.
+ *
+ * @param   pSSM            The saved state handle.
+ */
+VMMR3_INT_DECL(int) SSMR3HandleDeferFinalExec(PSSMHANDLE pSSM)
+{
+    SSM_ASSERT_VALID_HANDLE(pSSM);
+    AssertMsgReturn(pSSM->enmOp == SSMSTATE_SAVE_PREP, ("%d\n", pSSM->enmOp), VERR_SSM_INVALID_STATE);
+    if (   !pSSM->fLiveSave
+        || !pSSM->u.Write.fDeferredExecAllowed
+        || pSSM->u.Write.pDeferredUnit)
+        return VERR_NOT_SUPPORTED;
+    PSSMUNIT pUnit = pSSM->u.Write.pCurUnit;
+    AssertPtrReturn(pUnit, VERR_SSM_INVALID_STATE);
+    AssertReturn(pUnit->u.Common.pfnLiveExec && pUnit->u.Common.pfnSaveExec, VERR_NOT_SUPPORTED);
+
+    LogRel(("SSM: Deferring the final pass of data unit '%s'/#%u.\n", pUnit->szName, pUnit->u32Instance));
+    pSSM->u.Write.pDeferredUnit = pUnit;
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Gets the host bit count of a saved state.
  *
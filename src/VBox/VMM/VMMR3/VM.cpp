@@ -1731,10 +1731,13 @@ static DECLCALLBACK(VBOXSTRICTRC) vmR3LiveDoStep1Cleanup(PVM pVM, PVMCPU pVCpu,
  *
  * @param   pVM             The cross context VM structure.
  * @param   pSSM            The handle of saved state operation.
+ * @param   ppSaveCowSSM    Where to return the handle of a copy-on-write save
+ *                          for VMR3SaveCowComplete on success rather than
+ *                          releasing it.  NULL if not a copy-on-write save.
  *
  * @thread  EMT(0)
  */
-static DECLCALLBACK(int) vmR3LiveDoStep2(PVM pVM, PSSMHANDLE pSSM)
+static DECLCALLBACK(int) vmR3LiveDoStep2(PVM pVM, PSSMHANDLE pSSM, PSSMHANDLE *ppSaveCowSSM)
 {
     LogFlow(("vmR3LiveDoStep2: pVM=%p pSSM=%p\n", pVM, pSSM));
     VM_ASSERT_EMT0(pVM);
@@ -1760,9 +1763,14 @@ static DECLCALLBACK(int) vmR3LiveDoStep2(PVM pVM, PSSMHANDLE pSSM)
     if (rc == VINF_SUCCESS || (RT_FAILURE(rc2) && RT_SUCCESS(rc)))
         rc = rc2;
 
-    rc2 = SSMR3LiveDone(pSSM);
-    if (rc == VINF_SUCCESS || (RT_FAILURE(rc2) && RT_SUCCESS(rc)))
-        rc = rc2;
+    if (ppSaveCowSSM && RT_SUCCESS(rc) && RT_SUCCESS(rc2))
+        *ppSaveCowSSM = pSSM;
+    else
+    {
+        rc2 = SSMR3LiveDone(pSSM);
+        if (rc == VINF_SUCCESS || (RT_FAILURE(rc2) && RT_SUCCESS(rc)))
+            rc = rc2;
+    }
 
     /*
      * Advance to the final state and return.
@@ -1790,12 +1798,14 @@ static DECLCALLBACK(int) vmR3LiveDoStep2(PVM pVM, PSSMHANDLE pSSM)
  * @param   ppSSM               Where to return the saved state handle in case of a
  *                              live snapshot scenario.
  * @param   fSkipStateChanges   Set if we're supposed to skip state changes (FTM delta case)
+ * @param   fSaveCow            Set if saved state units may defer their final
+ *                              pass until after the VM has been resumed.
  *
  * @thread  EMT
  */
 static DECLCALLBACK(int) vmR3Save(PVM pVM, uint32_t cMsMaxDowntime, const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
                                   SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser, PSSMHANDLE *ppSSM,
-                                  bool fSkipStateChanges)
+                                  bool fSkipStateChanges, bool fSaveCow)
 {
     int rc = VINF_SUCCESS;
 
@@ -1842,6 +1852,11 @@ static DECLCALLBACK(int) vmR3Save(PVM pVM, uint32_t cMsMaxDowntime, const char *
             pVM->vm.s.fTeleportedAndNotFullyResumedYet = true;
         rc = SSMR3LiveSave(pVM, cMsMaxDowntime, pszFilename, pStreamOps, pvStreamOpsUser,
                            enmAfter, pfnProgress, pvProgressUser, ppSSM);
+        if (RT_SUCCESS(rc) && fSaveCow)
+        {
+            int rc2 = SSMR3LiveAllowDeferredExec(*ppSSM);
+            AssertRC(rc2);
+        }
         /* (We're not subject to cancellation just yet.) */
     }
     else
@@ -1865,21 +1880,32 @@ static DECLCALLBACK(int) vmR3Save(PVM pVM, uint32_t cMsMaxDowntime, const char *
  * @param   pvProgressUser      User argument for the progress callback.
  * @param   pfSuspended         Set if we suspended the VM.
  * @param   fSkipStateChanges   Set if we're supposed to skip state changes (FTM delta case)
+ * @param   ppSaveCowSSM        Where to return the saved state handle of a
+ *                              copy-on-write save (VMR3SaveCow) which has to be
+ *                              completed.  NULL if not a copy-on-write save.
  *
  * @thread  Non-EMT
  */
 static int vmR3SaveTeleport(PVM pVM, uint32_t cMsMaxDowntime,
                             const char *pszFilename, PCSSMSTRMOPS pStreamOps, void *pvStreamOpsUser,
                             SSMAFTER enmAfter, PFNVMPROGRESS pfnProgress, void *pvProgressUser, bool *pfSuspended,
-                            bool fSkipStateChanges)
+                            bool fSkipStateChanges, PSSMHANDLE *ppSaveCowSSM)
 {
+    /*
+     * A pending copy-on-write save must be completed first.
+     */
+    AssertLogRelMsgReturn(   ppSaveCowSSM
+                          || !ASMAtomicReadPtrT(&pVM->pUVM->vm.s.pszSaveCowFilename, char *),
+                          ("Copy-on-write save pending, call VMR3SaveCowComplete first\n"), VERR_WRONG_ORDER);
+
     /*
      * Request the operation in EMT(0).
      */
     PSSMHANDLE pSSM;
     int rc = VMR3ReqCallWait(pVM, 0 /*idDstCpu*/,
-                             (PFNRT)vmR3Save, 10, pVM, cMsMaxDowntime, pszFilename, pStreamOps, pvStreamOpsUser,
-                             enmAfter, pfnProgress, pvProgressUser, &pSSM, fSkipStateChanges);
+                             (PFNRT)vmR3Save, 11, pVM, cMsMaxDowntime, pszFilename, pStreamOps, pvStreamOpsUser,
+                             enmAfter, pfnProgress, pvProgressUser, &pSSM, fSkipStateChanges,
+                             ppSaveCowSSM != NULL);
     if (    RT_SUCCESS(rc)
         &&  pSSM)
     {
@@ -1907,7 +1933,7 @@ static int vmR3SaveTeleport(PVM pVM, uint32_t cMsMaxDowntime,
                     RTThreadSleep(250); /** @todo Live Migration: fix this polling wait by some smart use of multiple release event  semaphores.. */
                 }
             if (RT_SUCCESS(rc))
-                rc = VMR3ReqCallWait(pVM, 0 /*idDstCpu*/, (PFNRT)vmR3LiveDoStep2, 2, pVM, pSSM);
+                rc = VMR3ReqCallWait(pVM, 0 /*idDstCpu*/, (PFNRT)vmR3LiveDoStep2, 3, pVM, pSSM, ppSaveCowSSM);
             else
             {
                 int rc2 = VMR3ReqCallWait(pVM, 0 /*idDstCpu*/, (PFNRT)SSMR3LiveDone, 1, pSSM);
@@ -1981,11 +2007,123 @@ VMMR3DECL(int) VMR3Save(PUVM pUVM, const char *pszFilename, bool fContinueAfterw
     int rc = vmR3SaveTeleport(pVM, 250 /*cMsMaxDowntime*/,
                               pszFilename, NULL /* pStreamOps */, NULL /* pvStreamOpsUser */,
                               enmAfter, pfnProgress, pvUser, pfSuspended,
-                              false /* fSkipStateChanges */);
+                              false /* fSkipStateChanges */, NULL /* ppSaveCowSSM */);
     LogFlow(("VMR3Save: returns %Rrc (*pfSuspended=%RTbool)\n", rc, *pfSuspended));
     return rc;
 }
 
+
+/**
+ * Save current VM state without holding up the VM for copying guest memory.
+ *
+ * Works like VMR3Save with fContinueAfterwards set, except that saved state
+ * units may defer their final pass (see SSMR3HandleDeferFinalExec) so that it
+ * can be completed while the VM is running again.  PGM uses this to write
+ * protect guest RAM when the VM is suspended instead of copying it, saving
+ * the original content of pages as they are first written to (copy-on-write).
+ * The saved state reflects the time the VM was suspended.
+ *
+ * The caller must call VMR3SaveCowComplete after resuming the VM (or after
+ * deciding not to) to finish writing the saved state.  Until then no other
+ * save or teleportation can be started.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pUVM                The VM which state should be saved.
+ * @param   pszFilename         The name of the save state file.
+ * @param   pfnProgress         Progress callback. Optional.  Only used until
+ *                              this function returns.
+ * @param   pvUser              User argument for the progress callback.
+ * @param   pfSuspended         Set if we suspended the VM.
+ *
+ * @thread      Non-EMT.
+ * @vmstate     Suspended or Running
+ * @vmstateto   Saving+Suspended or
+ *              RunningLS+SuspendingLS+SuspendedLS+Saving+Suspended.
+ */
+VMMR3DECL(int) VMR3SaveCow(PUVM pUVM, const char *pszFilename, PFNVMPROGRESS pfnProgress, void *pvUser, bool *pfSuspended)
+{
+    LogFlow(("VMR3SaveCow: pUVM=%p pszFilename=%p:{%s} pfnProgress=%p pvUser=%p pfSuspended=%p\n",
+             pUVM, pszFilename, pszFilename, pfnProgress, pvUser, pfSuspended));
+
+    /*
+     * Validate input.
+     */
+    AssertPtr(pfSuspended);
+    *pfSuspended = false;
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_OTHER_THREAD(pVM);
+    AssertReturn(VALID_PTR(pszFilename), VERR_INVALID_POINTER);
+    AssertReturn(*pszFilename, VERR_INVALID_PARAMETER);
+    AssertPtrNullReturn(pfnProgress, VERR_INVALID_POINTER);
+
+    /*
+     * The saved state handle may outlive the caller's filename string.  The
+     * copy also serves as the indicator of a pending copy-on-write save.
+     */
+    char *pszCopy = RTStrDup(pszFilename);
+    AssertReturn(pszCopy, VERR_NO_STR_MEMORY);
+    if (!ASMAtomicCmpXchgPtr(&pUVM->vm.s.pszSaveCowFilename, pszCopy, NULL))
+    {
+        RTStrFree(pszCopy);
+        AssertLogRelMsgFailedReturn(("VMR3SaveCow: Another copy-on-write save is pending\n"), VERR_WRONG_ORDER);
+    }
+
+    /*
+     * Join paths with VMR3Save.
+     */
+    PSSMHANDLE pSSM = NULL;
+    int rc = vmR3SaveTeleport(pVM, 250 /*cMsMaxDowntime*/,
+                              pszCopy, NULL /* pStreamOps */, NULL /* pvStreamOpsUser */,
+                              SSMAFTER_CONTINUE, pfnProgress, pvUser, pfSuspended,
+                              false /* fSkipStateChanges */, &pSSM);
+    if (pSSM)
+        ASMAtomicWritePtr(&pUVM->vm.s.pSaveCowSSM, pSSM);
+    else
+        RTStrFree(ASMAtomicXchgPtrT(&pUVM->vm.s.pszSaveCowFilename, NULL, char *));
+    LogFlow(("VMR3SaveCow: returns %Rrc (*pfSuspended=%RTbool)\n", rc, *pfSuspended));
+    return rc;
+}
+
+
+/**
+ * Completes a save started by VMR3SaveCow.
+ *
+ * This writes the deferred part of the saved state while the VM is running
+ * and closes the saved state file.  The file is deleted on failure.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_SUCCESS if there is nothing pending.
+ *
+ * @param   pUVM                The user mode VM handle.
+ *
+ * @thread      Non-EMT.
+ * @vmstate     Any, but preferably Running.
+ */
+VMMR3DECL(int) VMR3SaveCowComplete(PUVM pUVM)
+{
+    LogFlow(("VMR3SaveCowComplete: pUVM=%p\n", pUVM));
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_OTHER_THREAD(pVM);
+
+    PSSMHANDLE pSSM = ASMAtomicXchgPtrT(&pUVM->vm.s.pSaveCowSSM, NULL, PSSMHANDLE);
+    if (!pSSM)
+        return VINF_SUCCESS;
+
+    int rc = SSMR3LiveDoStep3(pSSM);
+    int rc2 = VMR3ReqCallWait(pVM, 0 /*idDstCpu*/, (PFNRT)SSMR3LiveDone, 1, pSSM);
+    if (RT_SUCCESS(rc))
+        rc = rc2;
+
+    RTStrFree(ASMAtomicXchgPtrT(&pUVM->vm.s.pszSaveCowFilename, NULL, char *));
+    LogFlow(("VMR3SaveCowComplete: returns %Rrc\n", rc));
+    return rc;
+}
+
 /**
  * Save current VM state (used by FTM)
  *
@@ -2024,7 +2162,7 @@ VMMR3_INT_DECL(int) VMR3SaveFT(PUVM pUVM, PCSSMSTRMOPS pStreamOps, void *pvStrea
     int rc = vmR3SaveTeleport(pVM, 250 /*cMsMaxDowntime*/,
                               NULL, pStreamOps, pvStreamOpsUser,
                               SSMAFTER_CONTINUE, NULL, NULL, pfSuspended,
-                              fSkipStateChanges);
+                              fSkipStateChanges, NULL /* ppSaveCowSSM */);
     LogFlow(("VMR3SaveFT: returns %Rrc (*pfSuspended=%RTbool)\n", rc, *pfSuspended));
     return rc;
 }
@@ -2072,7 +2210,7 @@ VMMR3DECL(int) VMR3Teleport(PUVM pUVM, uint32_t cMsMaxDowntime, PCSSMSTRMOPS pSt
     int rc = vmR3SaveTeleport(pVM, cMsMaxDowntime,
                               NULL /*pszFilename*/, pStreamOps, pvStreamOpsUser,
                               SSMAFTER_TELEPORT, pfnProgress, pvProgressUser, pfSuspended,
-                              false /* fSkipStateChanges */);
+                              false /* fSkipStateChanges */, NULL /* ppSaveCowSSM */);
     LogFlow(("VMR3Teleport: returns %Rrc (*pfSuspended=%RTbool)\n", rc, *pfSuspended));
     return rc;
 }
@@ -2500,6 +2638,17 @@ DECLCALLBACK(int) vmR3Destroy(PVM pVM)
         LogRel(("********************* End of statistics **********************\n"));
 //#endif
 
+        /*
+         * Abandon any copy-on-write save which was never completed.
+         */
+        PSSMHANDLE pSSM = ASMAtomicXchgPtrT(&pUVM->vm.s.pSaveCowSSM, NULL, PSSMHANDLE);
+        if (pSSM)
+        {
+            LogRel(("VM: Abandoning incomplete copy-on-write save.\n"));
+            SSMR3LiveDone(pSSM);
+        }
+        RTStrFree(ASMAtomicXchgPtrT(&pUVM->vm.s.pszSaveCowFilename, NULL, char *));
+
         /*
          * Destroy the VM components.
          */
@@ -483,6 +483,10 @@ typedef struct HM
         bool                        fUsePreemptTimer;
         /** The shift mask employed by the VMX-Preemption timer. */
         uint8_t                     cPreemptTimerShift;
+        /** Set if the EPT accessed and dirty flags are enabled in the EPTP. */
+        bool                        fEptAccessDirty;
+        /** Alignment padding. */
+        uint8_t                     abAlignment0[7];
 
         /** Virtual address of the TSS page used for real mode emulation. */
         R3PTRTYPE(PVBOXTSS)         pRealModeTSS;
@@ -97,6 +97,8 @@ typedef enum PDMACEPFILEMGRTYPE
     PDMACEPFILEMGRTYPE_SIMPLE = 0,
     /** Async I/O with host cache enabled. */
     PDMACEPFILEMGRTYPE_ASYNC,
+    /** Async I/O using the io_uring interface if the host supports it (Linux only). */
+    PDMACEPFILEMGRTYPE_ASYNC_IO_URING,
     /** 32bit hack */
     PDMACEPFILEMGRTYPE_32BIT_HACK = 0x7fffffff
 } PDMACEPFILEMGRTYPE;
@@ -41,6 +41,8 @@ RT_C_DECLS_BEGIN
 typedef struct PDMBLKLRULIST *PPDMBLKLRULIST;
 /** Pointer to the global cache structure. */
 typedef struct PDMBLKCACHEGLOBAL *PPDMBLKCACHEGLOBAL;
+/** Pointer to a cache shard. */
+typedef struct PDMBLKCACHESHARD *PPDMBLKCACHESHARD;
 /** Pointer to a cache entry waiter structure. */
 typedef struct PDMBLKCACHEWAITER *PPDMBLKCACHEWAITER;
 
@@ -57,6 +59,8 @@ typedef struct PDMBLKCACHEENTRY
     struct PDMBLKCACHEENTRY        *pNext;
     /** Pointer to the list the entry is in. */
     PPDMBLKLRULIST                  pList;
+    /** The shard the entry is accounted in. */
+    PPDMBLKCACHESHARD               pShard;
     /** Cache the entry belongs to. */
     PPDMBLKCACHE                    pBlkCache;
     /** Flags for this entry. Combinations of PDMACFILECACHE_* \#defines */
@@ -96,6 +100,48 @@ typedef struct PDMBLKLRULIST
     uint32_t          cbCached;
 } PDMBLKLRULIST;
 
+/** Maximum number of shards the cache can be split into. */
+#define PDMBLKCACHE_SHARDS_MAX              16
+/** Size of the disk regions (as a shift) which are mapped to the same shard. */
+#define PDMBLKCACHE_SHARD_REGION_SHIFT      20
+
+/**
+ * Cache shard.
+ *
+ * The cache memory is split evenly between the shards and each shard manages
+ * its part with the ARC replacement policy under its own lock.
+ */
+typedef struct PDMBLKCACHESHARD
+{
+    /** Critical section protecting the lists of this shard. */
+    RTCRITSECT          CritSect;
+    /** Maximum size of the shard in bytes. */
+    uint32_t            cbMax;
+    /** Current size of the shard in bytes. */
+    uint32_t            cbCached;
+    /** Adaptive target size of the recently used list (ARC's p). */
+    uint32_t            cbRecentlyUsedInTarget;
+    /** Maximum number of bytes each ghost list can reference. */
+    uint32_t            cbGhostMax;
+    /** Recently used cache entries list (T1). */
+    PDMBLKLRULIST       LruRecentlyUsedIn;
+    /** Ghost list of entries evicted from the recently used list (B1). */
+    PDMBLKLRULIST       LruRecentlyUsedOut;
+    /** List of frequently used cache entries (T2). */
+    PDMBLKLRULIST       LruFrequentlyUsed;
+    /** Ghost list of entries evicted from the frequently used list (B2). */
+    PDMBLKLRULIST       LruFrequentlyUsedOut;
+#ifdef VBOX_WITH_STATISTICS
+    /** Number of hits in the recently used ghost list. */
+    STAMCOUNTER         StatGhostHitsRecentlyUsed;
+    /** Number of hits in the frequently used ghost list. */
+    STAMCOUNTER         StatGhostHitsFrequentlyUsed;
+#endif
+} PDMBLKCACHESHARD;
+#ifdef VBOX_WITH_STATISTICS
+AssertCompileMemberAlignment(PDMBLKCACHESHARD, StatGhostHitsRecentlyUsed, sizeof(uint64_t));
+#endif
+
 /**
  * Global cache data.
  */
@@ -105,20 +151,13 @@ typedef struct PDMBLKCACHEGLOBAL
     PVM                 pVM;
     /** Maximum size of the cache in bytes. */
     uint32_t            cbMax;
-    /** Current size of the cache in bytes. */
-    uint32_t            cbCached;
-    /** Critical section protecting the cache. */
+    /** Number of shards in use. */
+    uint32_t            cShards;
+    /** Critical section protecting the list of users and the saved state handling.
+     * Taken before any shard lock. */
     RTCRITSECT          CritSect;
-    /** Maximum number of bytes cached. */
-    uint32_t            cbRecentlyUsedInMax;
-    /** Maximum number of bytes in the paged out list .*/
-    uint32_t            cbRecentlyUsedOutMax;
-    /** Recently used cache entries list */
-    PDMBLKLRULIST       LruRecentlyUsedIn;
-    /** Scorecard cache entry list. */
-    PDMBLKLRULIST       LruRecentlyUsedOut;
-    /** List of frequently used cache entries */
-    PDMBLKLRULIST       LruFrequentlyUsed;
+    /** The cache shards. */
+    PDMBLKCACHESHARD    aShards[PDMBLKCACHE_SHARDS_MAX];
     /** Commit timeout in milli seconds */
     uint32_t            u32CommitTimeoutMs;
     /** Number of dirty bytes needed to start a commit of the data to the disk. */
@@ -188,6 +227,8 @@ typedef struct PDMBLKCACHE
     RTSEMRW                       SemRWEntries;
     /** Pointer to the gobal cache data */
     PPDMBLKCACHEGLOBAL            pCache;
+    /** Hash of the id, used to spread the endpoints over the shards. */
+    uint32_t                      uShardHash;
     /** Lock protecting the dirty entries list. */
     RTSPINLOCK                    LockList;
     /** List of dirty but not committed entries for this endpoint. */
@@ -1476,6 +1476,22 @@ typedef PGMLIVESAVERAMPAGE *PPGMLIVESAVERAMPAGE;
 /** The max value of PGMLIVESAVERAMPAGE::cDirtied. */
 #define PGMLIVSAVEPAGE_MAX_DIRTIED 0x00fffff0
 
+/**
+ * How guest RAM modifications are tracked during live save.
+ */
+typedef enum PGMDIRTYLOG
+{
+    /** Write monitoring, the shadow page pool is flushed after each pass so
+     * the guest faults on writes to the newly monitored pages. */
+    PGMDIRTYLOG_FLUSH_POOL = 0,
+    /** Write monitoring, the writable entries of the shadow page pool are
+     * write protected in place after each pass instead of flushing it. */
+    PGMDIRTYLOG_WRITE_PROTECT,
+    /** The hardware dirty flags of the nested page tables (EPT/NPT) are
+     * harvested into a bitmap before each pass, no write faults. */
+    PGMDIRTYLOG_HW_DIRTY_BITS
+} PGMDIRTYLOG;
+
 
 /**
  * RAM range for GC Phys to HC Phys conversion.
@@ -3303,8 +3319,12 @@ typedef struct PGM
     bool                            fRestoreRomPagesOnReset;
     /** Whether to automatically clear all RAM pages on reset. */
     bool                            fZeroRamPagesOnReset;
+    /** @cfgm{/PGM/SaveDedup, boolean, true}
+     * Whether to replace RAM pages identical to one already saved in the same
+     * pass by a reference to it (PGM_STATE_REC_RAM_DUP). */
+    bool                            fSaveDedup;
     /** Alignment padding. */
-    bool                            afAlignment3[7];
+    bool                            afAlignment3[6];
 
     /** Indicates that PGMR3FinalizeMappings has been called and that further
      * PGMR3MapIntermediate calls will be rejected. */
@@ -3585,8 +3605,11 @@ typedef struct PGM
         uint32_t                    cIgnoredPages;
         /** Indicates that a live save operation is active. */
         bool                        fActive;
-        /** Padding. */
-        bool                        afReserved[2];
+        /** Post-copy mode: the final pass only records the dirty RAM pages on
+         * the source, and the target accepts such records.  See PGMPostCopy.cpp. */
+        bool                        fPostCopy;
+        /** How RAM modifications are tracked (PGMDIRTYLOG). */
+        uint8_t                     enmDirtyLog;
         /** The next history index. */
         uint8_t                     iDirtyPagesHistory;
         /** History of the total amount of dirty pages. */
@@ -3604,7 +3627,47 @@ typedef struct PGM
         uint64_t                    uSaveStartNS;
         /** Pages per second (for statistics). */
         uint32_t                    cPagesPerSecond;
-        uint32_t                    cAlignment;
+        /** Copy-on-write mode: the final pass write protects the dirty RAM
+         * pages instead of saving them and the content is saved after the VM
+         * has been resumed.  See PGMSaveCow.cpp. */
+        bool                        fSaveCow;
+        /** Set while loading when the final pass announced a trailing instance
+         * of the unit with the pages saved copy-on-write. */
+        bool                        fLoadCowTrailer;
+        /** Set when a page was written to outside ring-3 bypassing the access
+         * handlers of a copy-on-write save, which then fails. */
+        bool volatile               fSaveCowBypassed;
+        bool                        afAlignment[1];
+        /** The post-copy page tracking state (PGMPostCopy.cpp), NULL if not
+         * in use. */
+        R3PTRTYPE(struct PGMPOSTCOPY *) pPostCopyR3;
+        /** Bitmap of the RAM pages found dirty in the nested page tables,
+         * indexed by guest page frame number (PGMDIRTYLOG_HW_DIRTY_BITS). */
+        R3PTRTYPE(uint64_t *)       pbmHwDirtyR3;
+        /** The number of bits in pbmHwDirtyR3. */
+        uint32_t                    cHwDirtyBits;
+        /** The number of dirty flags harvested (for statistics). */
+        uint32_t                    cHwDirtyHarvested;
+        /** The cache of previously saved page contents for the delta encoding
+         * (PGMSavedState.cpp), NULL if not in use. */
+        R3PTRTYPE(struct PGMXBZRLECACHE *) pXbzrleCacheR3;
+        /** @cfgm{/PGM/LiveSaveXbzrleCacheSize, uint64_t, 64M}
+         * The size of the delta encoding cache in pages, 0 to disable it. */
+        uint32_t                    cXbzrleCachePages;
+        /** The number of pages saved as delta (for statistics). */
+        uint32_t                    cXbzrlePages;
+        /** The number of pages saved as reference to an identical page (for
+         * statistics). */
+        uint32_t                    cDupPages;
+        /** @cfgm{/PGM/LiveSaveCowBufferSize, uint64_t, 64M}
+         * The max amount of memory used for pages copied on write during a
+         * copy-on-write save before the guest is throttled, given in pages.
+         * 0 disables copy-on-write saving. */
+        uint32_t                    cSaveCowMaxQueued;
+        /** The number of delta encoded bytes saved (for statistics). */
+        uint64_t                    cbXbzrle;
+        /** The copy-on-write save state (PGMSaveCow.cpp), NULL if not in use. */
+        R3PTRTYPE(struct PGMSAVECOW *) pSaveCowR3;
     } LiveSave;
 
     /** @name   Error injection.
@@ -4214,6 +4277,16 @@ void            pgmHandlerVirtualDumpPhysPages(PVM pVM);
 #endif /* VBOX_WITH_RAW_MODE */
 DECLCALLBACK(void) pgmR3InfoHandlers(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 int             pgmR3InitSavedState(PVM pVM, uint64_t cbRam);
+int             pgmR3PostCopyMarkPage(PVM pVM, RTGCPHYS GCPhys);
+int             pgmR3PostCopyTrgEnsurePage(PVM pVM, RTGCPHYS GCPhys);
+void            pgmR3PostCopyTerm(PVM pVM);
+int             pgmR3SaveCowMarkPage(PVM pVM, RTGCPHYS GCPhys);
+int             pgmR3SaveCowArm(PVM pVM);
+int             pgmR3SaveCowSavePages(PVM pVM, PSSMHANDLE pSSM);
+void            pgmR3SaveCowPreservePage(PVM pVM, RTGCPHYS GCPhys);
+void            pgmR3SaveCowPreserveAll(PVM pVM);
+void            pgmR3SaveCowDone(PVM pVM);
+void            pgmR3SaveCowTerm(PVM pVM);
 
 int             pgmPhysAllocPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys);
 int             pgmPhysAllocLargePage(PVM pVM, RTGCPHYS GCPhys);
@@ -4267,6 +4340,9 @@ void            pgmR3PoolReset(PVM pVM);
 void            pgmR3PoolClearAll(PVM pVM, bool fFlushRemTlb);
 DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolClearAllRendezvous(PVM pVM, PVMCPU pVCpu, void *fpvFlushRemTbl);
 void            pgmR3PoolWriteProtectPages(PVM pVM);
+void            pgmR3PoolWriteProtectAll(PVM pVM);
+uint32_t        pgmR3PoolHarvestDirtyBits(PVM pVM);
+int             pgmR3PoolHarvestDirtyBitsAll(PVM pVM);
 
 #endif /* IN_RING3 */
 #if defined(VBOX_WITH_2X_4GB_ADDR_SPACE_IN_R0) || defined(IN_RC)
@@ -4291,6 +4367,7 @@ bool            pgmPoolIsDirtyPage(PVM pVM, RTGCPHYS GCPhys);
 void            pgmPoolInvalidateDirtyPage(PVM pVM, RTGCPHYS GCPhysPT);
 int             pgmPoolTrackUpdateGCPhys(PVM pVM, RTGCPHYS GCPhysPage, PPGMPAGE pPhysPage, bool fFlushPTEs, bool *pfFlushTLBs);
 void            pgmPoolTracDerefGCPhysHint(PPGMPOOL pPool, PPGMPOOLPAGE pPage, RTHCPHYS HCPhys, RTGCPHYS GCPhysHint, uint16_t iPte);
+void            pgmPoolTrackDirtyLogDiscard(PPGMPOOL pPool, RTGCPHYS GCPhys);
 uint16_t        pgmPoolTrackPhysExtAddref(PVM pVM, PPGMPAGE pPhysPage, uint16_t u16, uint16_t iShwPT, uint16_t iPte);
 void            pgmPoolTrackPhysExtDerefGCPhys(PPGMPOOL pPool, PPGMPOOLPAGE pPoolPage, PPGMPAGE pPhysPage, uint16_t iPte);
 int             pgmPoolMonitorChainFlush(PPGMPOOL pPool, PPGMPOOLPAGE pPage);
@@ -241,6 +241,13 @@ typedef struct VMINTUSERPERVM
     /** Reason for the most recent operation. */
     VMRESUMEREASON                  enmResumeReason;
 
+    /** The saved state handle of a copy-on-write save waiting for
+     * VMR3SaveCowComplete, NULL if none.  Atomic. */
+    struct SSMHANDLE * volatile     pSaveCowSSM;
+    /** Copy of the filename of the copy-on-write save (referenced by the
+     * saved state handle), NULL if none pending.  Atomic. */
+    char * volatile                 pszSaveCowFilename;
+
     /** Critical section for pAtError and pAtRuntimeError. */
     RTCRITSECT                      AtErrorCritSect;
 